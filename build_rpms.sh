@@ -21,6 +21,8 @@ cmake ../src -DBUILD_CONFIG=rpmbuild -DCMAKE_BUILD_TYPE=Release            \
 	-DRADOS_URLS=OFF -DUSE_RADOS_RECOV=OFF               		   \
 	-DUSE_9P=OFF       						   \
 	-DUSE_FSAL_NULL=OFF      					   \
+	-DUSE_FSAL_WBCACHE=OFF      					   \
+	-DUSE_FSAL_LATENCY=OFF      					   \
 	-DUSE_FSAL_XFS=OFF 						   \
 	-DUSE_FSAL_MEM=OFF 						   \
 	-DUSE_FSAL_LUSTRE=OFF			                           \
@@ -34,6 +34,7 @@
 #include <pthread.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/param.h>
 #include <os/mntent.h>
 #include <os/quota.h>
 #include <dlfcn.h>
@@ -64,6 +65,7 @@
 static void mem_release_export(struct fsal_export *exp_hdl)
 {
 	struct mem_fsal_export *myself;
+	struct glist_head *glist, *glistn;
 
 	myself = container_of(exp_hdl, struct mem_fsal_export, export);
 
@@ -88,6 +90,11 @@ static void mem_release_export(struct fsal_export *exp_hdl)
 
 	glist_del(&myself->export_entry);
 
+	glist_for_each_safe(glist, glistn, &myself->mfe_quotas) {
+		glist_del(glist);
+		gsh_free(glist_entry(glist, struct mem_quota, mq_list));
+	}
+
 	gsh_free(myself->export_path);
 	gsh_free(myself);
 }
@@ -108,6 +115,153 @@ static fsal_status_t mem_get_dynamic_info(struct fsal_export *exp_hdl,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Find the quota limits of a user or group
+ *
+ * @note mfe_exp_lock MUST be held
+ *
+ * @param[in] mfe		Export
+ * @param[in] quota_type	USRQUOTA or GRPQUOTA
+ * @param[in] quota_id		User or group id
+ *
+ * @return The limits, or NULL if none were set.
+ */
+static struct mem_quota *mem_find_quota(struct mem_fsal_export *mfe,
+					int quota_type, int quota_id)
+{
+	struct glist_head *glist;
+	struct mem_quota *mq;
+
+	glist_for_each(glist, &mfe->mfe_quotas) {
+		mq = glist_entry(glist, struct mem_quota, mq_list);
+
+		if (mq->mq_type == quota_type && mq->mq_id == quota_id)
+			return mq;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Get the quota of a user or group
+ *
+ * Usage is counted from the objects the user or group owns, every time,
+ * so this is slow on large exports.  Ids without limits get zero limits,
+ * as from quotactl.  Object attributes are read without their locks; an
+ * answer off by a write in progress is good enough for testing.
+ *
+ * @param[in]  exp_hdl		Export
+ * @param[in]  filepath		Path within the export, unused
+ * @param[in]  quota_type	USRQUOTA or GRPQUOTA
+ * @param[in]  quota_id		User or group id
+ * @param[out] pquota		Quota
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mem_get_quota(struct fsal_export *exp_hdl,
+				   const char *filepath, int quota_type,
+				   int quota_id, fsal_quota_t *pquota)
+{
+	struct mem_fsal_export *mfe =
+		container_of(exp_hdl, struct mem_fsal_export, export);
+	struct mem_fsal_obj_handle *hdl;
+	struct glist_head *glist;
+	struct mem_quota *mq;
+	uint64_t bytes = 0, id;
+
+	if (quota_type != USRQUOTA && quota_type != GRPQUOTA)
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+
+	memset(pquota, 0, sizeof(*pquota));
+
+	PTHREAD_RWLOCK_rdlock(&mfe->mfe_exp_lock);
+
+	mq = mem_find_quota(mfe, quota_type, quota_id);
+	if (mq != NULL)
+		*pquota = mq->mq_limits;
+
+	glist_for_each(glist, &mfe->mfe_objs) {
+		hdl = glist_entry(glist, struct mem_fsal_obj_handle,
+				  mfo_exp_entry);
+		id = quota_type == USRQUOTA ? hdl->attrs.owner
+					    : hdl->attrs.group;
+
+		if (id == (uint64_t) quota_id) {
+			pquota->curfiles++;
+			bytes += hdl->attrs.spaceused;
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&mfe->mfe_exp_lock);
+
+	pquota->curblocks = howmany(bytes, DEV_BSIZE);
+	pquota->bsize = DEV_BSIZE;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Set the quota limits of a user or group
+ *
+ * As with FSAL_VFS, a zero leaves a limit unchanged.  Only root may set
+ * limits.
+ *
+ * @param[in]  exp_hdl		Export
+ * @param[in]  filepath		Path within the export, unused
+ * @param[in]  quota_type	USRQUOTA or GRPQUOTA
+ * @param[in]  quota_id		User or group id
+ * @param[in]  pquota		Limits to set
+ * @param[out] presquota	Quota after the change (optional)
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mem_set_quota(struct fsal_export *exp_hdl,
+				   const char *filepath, int quota_type,
+				   int quota_id, fsal_quota_t *pquota,
+				   fsal_quota_t *presquota)
+{
+	struct mem_fsal_export *mfe =
+		container_of(exp_hdl, struct mem_fsal_export, export);
+	struct mem_quota *mq;
+
+	if (quota_type != USRQUOTA && quota_type != GRPQUOTA)
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+
+	if (op_ctx->creds != NULL && op_ctx->creds->caller_uid != 0)
+		return fsalstat(ERR_FSAL_PERM, EPERM);
+
+	PTHREAD_RWLOCK_wrlock(&mfe->mfe_exp_lock);
+
+	mq = mem_find_quota(mfe, quota_type, quota_id);
+	if (mq == NULL) {
+		mq = gsh_calloc(1, sizeof(*mq));
+		mq->mq_type = quota_type;
+		mq->mq_id = quota_id;
+		glist_add_tail(&mfe->mfe_quotas, &mq->mq_list);
+	}
+
+	if (pquota->bhardlimit != 0)
+		mq->mq_limits.bhardlimit = pquota->bhardlimit;
+	if (pquota->bsoftlimit != 0)
+		mq->mq_limits.bsoftlimit = pquota->bsoftlimit;
+	if (pquota->fhardlimit != 0)
+		mq->mq_limits.fhardlimit = pquota->fhardlimit;
+	if (pquota->fsoftlimit != 0)
+		mq->mq_limits.fsoftlimit = pquota->fsoftlimit;
+	if (pquota->btimeleft != 0)
+		mq->mq_limits.btimeleft = pquota->btimeleft;
+	if (pquota->ftimeleft != 0)
+		mq->mq_limits.ftimeleft = pquota->ftimeleft;
+
+	PTHREAD_RWLOCK_unlock(&mfe->mfe_exp_lock);
+
+	if (presquota != NULL)
+		return mem_get_quota(exp_hdl, filepath, quota_type, quota_id,
+				     presquota);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /* extract a file handle from a buffer.
  * do verification checks and flag any and all suspicious bits.
  * Return an updated fh_desc into whatever was passed.  The most
@@ -187,6 +341,8 @@ void mem_export_ops_init(struct export_ops *ops)
 	ops->wire_to_host = mem_wire_to_host;
 	ops->create_handle = mem_create_handle;
 	ops->get_fs_dynamic_info = mem_get_dynamic_info;
+	ops->get_quota = mem_get_quota;
+	ops->set_quota = mem_set_quota;
 	ops->alloc_state = mem_alloc_state;
 }
 
@@ -209,6 +365,7 @@ fsal_status_t mem_create_export(struct fsal_module *fsal_hdl,
 	myself = gsh_calloc(1, sizeof(struct mem_fsal_export));
 
 	glist_init(&myself->mfe_objs);
+	glist_init(&myself->mfe_quotas);
 	pthread_rwlockattr_init(&attrs);
 #ifdef GLIBC
 	pthread_rwlockattr_setkind_np(&attrs,
@@ -79,6 +79,213 @@ mem_i_cmpf(const struct avltree_node *lhs,
 	return 1;
 }
 
+/**
+ * @brief Free an extent
+ */
+static void mem_extent_free(struct mem_extent *ext)
+{
+	glist_del(&ext->ext_list);
+	gsh_free(ext->ws.pattern.addr);
+	gsh_free(ext);
+}
+
+/**
+ * @brief Add an extent for [start, end) described by @a ws
+ *
+ * @note ext_mutex MUST be held, and the range MUST have been punched
+ */
+static void mem_extent_add(struct mem_fsal_obj_handle *myself,
+			   uint64_t start, uint64_t end,
+			   const struct fsal_write_same_arg *ws)
+{
+	struct mem_extent *ext = gsh_malloc(sizeof(*ext));
+
+	ext->start = start;
+	ext->end = end;
+	ext->ws = *ws;
+	ext->ws.pattern.addr = ws->pattern.len == 0 ? NULL :
+		gsh_memdup(ws->pattern.addr, ws->pattern.len);
+
+	glist_add_tail(&myself->mh_file.extents, &ext->ext_list);
+}
+
+/**
+ * @brief Forget what is known of [start, end)
+ *
+ * Extents are trimmed, split or freed so that none overlaps the range.
+ *
+ * @note ext_mutex MUST be held
+ */
+static void mem_extent_punch(struct mem_fsal_obj_handle *myself,
+			     uint64_t start, uint64_t end)
+{
+	struct glist_head *glist, *glistn;
+
+	glist_for_each_safe(glist, glistn, &myself->mh_file.extents) {
+		struct mem_extent *ext =
+			glist_entry(glist, struct mem_extent, ext_list);
+
+		if (ext->end <= start || ext->start >= end)
+			continue;
+
+		if (ext->start >= start && ext->end <= end) {
+			mem_extent_free(ext);
+		} else if (ext->start < start && ext->end > end) {
+			/* Keep the tail as an extent of its own */
+			mem_extent_add(myself, end, ext->end, &ext->ws);
+			ext->end = start;
+		} else if (ext->start < start) {
+			ext->end = start;
+		} else {
+			ext->start = end;
+		}
+	}
+}
+
+/**
+ * @brief Describe [start, end) as zeroes
+ *
+ * @note ext_mutex MUST be held
+ */
+static void mem_extent_zero(struct mem_fsal_obj_handle *myself,
+			    uint64_t start, uint64_t end)
+{
+	struct fsal_write_same_arg zero = {
+		.offset = start,
+		.block_size = UINT64_MAX,
+		.reloff_blocknum = UINT64_MAX,
+		.reloff_pattern = UINT64_MAX,
+	};
+
+	mem_extent_punch(myself, start, end);
+	mem_extent_add(myself, start, end, &zero);
+}
+
+/**
+ * @brief Put the known content of [offset, offset + len) in a buffer
+ *
+ * @note ext_mutex MUST be held
+ */
+static void mem_extent_read(struct mem_fsal_obj_handle *myself,
+			    uint64_t offset, char *buf, uint64_t len)
+{
+	struct glist_head *glist;
+
+	glist_for_each(glist, &myself->mh_file.extents) {
+		struct mem_extent *ext =
+			glist_entry(glist, struct mem_extent, ext_list);
+		uint64_t from = MAX(ext->start, offset);
+		uint64_t to = MIN(ext->end, offset + len);
+
+		if (from < to)
+			fsal_write_same_fill(&ext->ws, from,
+					     buf + (from - offset), to - from);
+	}
+}
+
+/**
+ * @brief Drop the extents past a new end of file
+ */
+static void mem_extent_truncate(struct mem_fsal_obj_handle *myself,
+				uint64_t size)
+{
+	PTHREAD_MUTEX_lock(&myself->mh_file.ext_mutex);
+	mem_extent_punch(myself, size, UINT64_MAX);
+	PTHREAD_MUTEX_unlock(&myself->mh_file.ext_mutex);
+}
+
+/**
+ * @brief Zero [start, end) of a file
+ *
+ * The stored part is cleared, the rest is described by a zero extent.
+ */
+static void mem_zero_range(struct mem_fsal_obj_handle *myself,
+			   uint64_t start, uint64_t end)
+{
+	if (start < myself->datasize)
+		memset(myself->data + start, 0,
+		       MIN(end, myself->datasize) - start);
+
+	if (end > myself->datasize) {
+		PTHREAD_MUTEX_lock(&myself->mh_file.ext_mutex);
+		mem_extent_zero(myself, MAX(start, myself->datasize), end);
+		PTHREAD_MUTEX_unlock(&myself->mh_file.ext_mutex);
+	}
+}
+
+/**
+ * @brief Copy the extents of a source range to a destination
+ *
+ * Source extents are moved to destination offsets by shifting their
+ * description.  The parts landing in the destination's stored data are
+ * filled in, the rest replaces what the destination knew of the range.
+ * The source is snapshotted first, so both may be the same file.
+ */
+static void mem_extent_copy(struct mem_fsal_obj_handle *dst,
+			    uint64_t dst_offset,
+			    struct mem_fsal_obj_handle *src,
+			    uint64_t src_offset, uint64_t count)
+{
+	uint64_t delta = dst_offset - src_offset;
+	struct glist_head copies;
+	struct glist_head *glist, *glistn;
+
+	glist_init(&copies);
+
+	PTHREAD_MUTEX_lock(&src->mh_file.ext_mutex);
+
+	glist_for_each(glist, &src->mh_file.extents) {
+		struct mem_extent *ext =
+			glist_entry(glist, struct mem_extent, ext_list);
+		uint64_t start = MAX(ext->start, src_offset);
+		uint64_t end = MIN(ext->end, src_offset + count);
+		struct mem_extent *copy;
+
+		if (start >= end)
+			continue;
+
+		copy = gsh_malloc(sizeof(*copy));
+		copy->start = start + delta;
+		copy->end = end + delta;
+		copy->ws = ext->ws;
+		copy->ws.offset += delta;
+		copy->ws.pattern.addr = ext->ws.pattern.len == 0 ? NULL :
+			gsh_memdup(ext->ws.pattern.addr, ext->ws.pattern.len);
+		glist_add_tail(&copies, &copy->ext_list);
+	}
+
+	PTHREAD_MUTEX_unlock(&src->mh_file.ext_mutex);
+
+	PTHREAD_MUTEX_lock(&dst->mh_file.ext_mutex);
+
+	if (dst_offset + count > dst->datasize)
+		mem_extent_punch(dst, MAX(dst_offset, dst->datasize),
+				 dst_offset + count);
+
+	glist_for_each_safe(glist, glistn, &copies) {
+		struct mem_extent *copy =
+			glist_entry(glist, struct mem_extent, ext_list);
+
+		glist_del(&copy->ext_list);
+
+		if (copy->start < dst->datasize) {
+			uint64_t to = MIN(copy->end, dst->datasize);
+
+			fsal_write_same_fill(&copy->ws, copy->start,
+					     dst->data + copy->start,
+					     to - copy->start);
+			copy->start = to;
+		}
+
+		if (copy->start < copy->end)
+			glist_add_tail(&dst->mh_file.extents, &copy->ext_list);
+		else
+			mem_extent_free(copy);
+	}
+
+	PTHREAD_MUTEX_unlock(&dst->mh_file.ext_mutex);
+}
+
 /**
  * @brief Clean up and free an object handle
  *
@@ -116,6 +323,8 @@ static void mem_cleanup(struct mem_fsal_obj_handle *myself)
 		mem_clean_all_dirents(myself);
 		break;
 	case REGULAR_FILE:
+		mem_extent_truncate(myself, 0);
+		PTHREAD_MUTEX_destroy(&myself->mh_file.ext_mutex);
 		break;
 	case SYMBOLIC_LINK:
 		gsh_free(myself->mh_symlink.link_contents);
@@ -648,6 +857,8 @@ _mem_alloc_handle(struct mem_fsal_obj_handle *parent,
 			hdl->attrs.filesize = 0;
 			hdl->attrs.spaceused = 0;
 		}
+		glist_init(&hdl->mh_file.extents);
+		PTHREAD_MUTEX_init(&hdl->mh_file.ext_mutex, NULL);
 		hdl->attrs.numlinks = 1;
 		break;
 	case BLOCK_FILE:
@@ -1167,6 +1378,9 @@ fsal_status_t mem_setattr2(struct fsal_obj_handle *obj_hdl,
 
 	mem_copy_attrs_mask(attrs_set, &myself->attrs);
 
+	if (FSAL_TEST_MASK(attrs_set->valid_mask, ATTR_SIZE))
+		mem_extent_truncate(myself, attrs_set->filesize);
+
 #ifdef USE_LTTNG
 	tracepoint(fsalmem, mem_setattrs, __func__, __LINE__, obj_hdl,
 		   myself->m_name, myself->attrs.filesize,
@@ -1504,8 +1718,10 @@ fsal_status_t mem_open2(struct fsal_obj_handle *obj_hdl,
 			openflags |= FSAL_O_READ;
 		mem_open_my_fd(my_fd, openflags);
 
-		if (truncated)
+		if (truncated) {
 			myself->attrs.filesize = myself->attrs.spaceused = 0;
+			mem_extent_truncate(myself, 0);
+		}
 
 		/* Now check verifier for exclusive, but not for
 		 * FSAL_EXCLUSIVE_9P.
@@ -1695,8 +1911,10 @@ fsal_status_t mem_reopen2(struct fsal_obj_handle *obj_hdl,
 	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
 	mem_open_my_fd(my_fd, openflags);
-	if (openflags & FSAL_O_TRUNC)
+	if (openflags & FSAL_O_TRUNC) {
 		myself->attrs.filesize = myself->attrs.spaceused = 0;
+		mem_extent_truncate(myself, 0);
+	}
 
 	return status;
 }
@@ -1781,6 +1999,17 @@ void mem_read2(struct fsal_obj_handle *obj_hdl,
 		} else {
 			memset(read_arg->iov[i].iov_base, 'a', bufsize);
 		}
+		if (offset + bufsize > myself->datasize) {
+			uint64_t from = MAX(offset, myself->datasize);
+
+			/* Past the data, use what is known of the content */
+			PTHREAD_MUTEX_lock(&myself->mh_file.ext_mutex);
+			mem_extent_read(myself, from,
+					(char *)read_arg->iov[i].iov_base +
+						(from - offset),
+					offset + bufsize - from);
+			PTHREAD_MUTEX_unlock(&myself->mh_file.ext_mutex);
+		}
 		read_arg->io_amount += bufsize;
 		offset += bufsize;
 	}
@@ -1874,6 +2103,13 @@ void mem_write2(struct fsal_obj_handle *obj_hdl,
 			memcpy(myself->data + offset,
 			       write_arg->iov[i].iov_base, writesize);
 		}
+		if (offset + bufsize > myself->datasize) {
+			PTHREAD_MUTEX_lock(&myself->mh_file.ext_mutex);
+			mem_extent_punch(myself,
+					 MAX(offset, myself->datasize),
+					 offset + bufsize);
+			PTHREAD_MUTEX_unlock(&myself->mh_file.ext_mutex);
+		}
 		write_arg->io_amount += bufsize;
 		offset += bufsize;
 	}
@@ -1920,6 +2156,260 @@ fsal_status_t mem_commit2(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Copy or clone a range of one file into another
+ *
+ * Only the first datasize bytes of a MEM file are stored; everything past
+ * them reads back as the same fill byte or as described by an extent, so
+ * a copy only needs to move the stored bytes and shift the extents.  This
+ * makes COPY and CLONE the same operation and both cheap regardless of the
+ * length of the range.
+ *
+ * @param[in]  obj_hdl     Destination file
+ * @param[in]  dst_state   State for the destination, may be NULL
+ * @param[in]  dst_offset  Offset in the destination
+ * @param[in]  src_hdl     Source file
+ * @param[in]  src_state   State for the source, may be NULL
+ * @param[in]  src_offset  Offset in the source
+ * @param[in]  count       Bytes to copy
+ * @param[in]  flags       FSAL_COPY_* flags
+ * @param[out] copied      Bytes actually copied
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t mem_copy_range2(struct fsal_obj_handle *obj_hdl,
+				     struct state_t *dst_state,
+				     uint64_t dst_offset,
+				     struct fsal_obj_handle *src_hdl,
+				     struct state_t *src_state,
+				     uint64_t src_offset,
+				     uint64_t count,
+				     uint32_t flags,
+				     uint64_t *copied)
+{
+	struct mem_fsal_obj_handle *dst = container_of(obj_hdl,
+				  struct mem_fsal_obj_handle, obj_handle);
+	struct mem_fsal_obj_handle *src = container_of(src_hdl,
+				  struct mem_fsal_obj_handle, obj_handle);
+	struct fsal_fd *fsal_fd;
+	bool src_has_lock = false, dst_has_lock = false, closefd = false;
+	bool reusing_open_state_fd = false;
+	bool same = src == dst;
+	fsal_status_t status;
+	uint64_t end, i;
+
+	*copied = 0;
+
+	if (obj_hdl->type != REGULAR_FILE || src_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+
+	/* For a copy within one file the caller has checked both stateids;
+	 * check the share reservation once rather than taking obj_lock twice.
+	 */
+	if (!same) {
+		status = fsal_find_fd(&fsal_fd, src_hdl, &src->mh_file.fd,
+				      &src->mh_file.share, false, src_state,
+				      FSAL_O_READ, mem_open_func,
+				      mem_close_func, &src_has_lock, &closefd,
+				      false, &reusing_open_state_fd);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	status = fsal_find_fd(&fsal_fd, obj_hdl, &dst->mh_file.fd,
+			      &dst->mh_file.share, false,
+			      same ? NULL : dst_state,
+			      same ? FSAL_O_RDWR : FSAL_O_WRITE,
+			      mem_open_func, mem_close_func, &dst_has_lock,
+			      &closefd, false, &reusing_open_state_fd);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	/* A copy stops at the end of the source */
+	if (src_offset >= src->attrs.filesize)
+		goto out;
+
+	*copied = MIN(count, src->attrs.filesize - src_offset);
+	end = dst_offset + *copied;
+
+	/* Fill in the stored part of the destination range.  memmove handles
+	 * overlapping ranges within one file.
+	 */
+	if (dst_offset < dst->datasize) {
+		uint64_t len = MIN(*copied, dst->datasize - dst_offset);
+		uint64_t stored = 0;
+
+		if (src_offset < src->datasize)
+			stored = MIN(len, src->datasize - src_offset);
+
+		if (stored > 0)
+			memmove(dst->data + dst_offset, src->data + src_offset,
+				stored);
+
+		for (i = stored; i < len; i++)
+			dst->data[dst_offset + i] = 'a';
+	}
+
+	mem_extent_copy(dst, dst_offset, src, src_offset, *copied);
+
+	if (end > dst->attrs.filesize)
+		dst->attrs.filesize = dst->attrs.spaceused = end;
+
+	now(&dst->attrs.mtime);
+	dst->attrs.chgtime = dst->attrs.mtime;
+	dst->attrs.change = timespec_to_nsecs(&dst->attrs.chgtime);
+
+	if (!same)
+		now(&src->attrs.atime);
+
+out:
+
+	if (dst_has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	if (src_has_lock)
+		PTHREAD_RWLOCK_unlock(&src_hdl->obj_lock);
+
+	return status;
+}
+
+/**
+ * @brief Write a repeated pattern to a file
+ *
+ * The stored part of the range is filled in; past it, only the
+ * description of the blocks is kept, so the cost does not depend on the
+ * length of the range.
+ *
+ * @param[in]     obj_hdl File on which to operate
+ * @param[in]     state   state_t to use for this operation
+ * @param[in,out] ws_arg  What to write, and how much was written
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t mem_write_same2(struct fsal_obj_handle *obj_hdl,
+				     struct state_t *state,
+				     struct fsal_write_same_arg *ws_arg)
+{
+	struct mem_fsal_obj_handle *myself = container_of(obj_hdl,
+				  struct mem_fsal_obj_handle, obj_handle);
+	struct fsal_fd *fsal_fd;
+	bool has_lock = false, closefd = false;
+	bool reusing_open_state_fd = false;
+	fsal_status_t status;
+	uint64_t start = ws_arg->offset;
+	uint64_t end;
+
+	ws_arg->io_amount = 0;
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+
+	status = fsal_find_fd(&fsal_fd, obj_hdl, &myself->mh_file.fd,
+			      &myself->mh_file.share, false, state,
+			      FSAL_O_WRITE, mem_open_func, mem_close_func,
+			      &has_lock, &closefd, false,
+			      &reusing_open_state_fd);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	ws_arg->io_amount = ws_arg->block_size * ws_arg->block_count;
+	end = start + ws_arg->io_amount;
+
+	if (fsal_write_same_is_zero(ws_arg)) {
+		mem_zero_range(myself, start, end);
+	} else {
+		if (start < myself->datasize)
+			fsal_write_same_fill(ws_arg, start,
+					     myself->data + start,
+					     MIN(end, myself->datasize) -
+						start);
+
+		if (end > myself->datasize) {
+			uint64_t from = MAX(start, myself->datasize);
+
+			PTHREAD_MUTEX_lock(&myself->mh_file.ext_mutex);
+			mem_extent_punch(myself, from, end);
+			mem_extent_add(myself, from, end, ws_arg);
+			PTHREAD_MUTEX_unlock(&myself->mh_file.ext_mutex);
+		}
+	}
+
+	if (end > myself->attrs.filesize)
+		myself->attrs.filesize = myself->attrs.spaceused = end;
+
+	now(&myself->attrs.mtime);
+	myself->attrs.chgtime = myself->attrs.mtime;
+	myself->attrs.change = timespec_to_nsecs(&myself->attrs.chgtime);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+/**
+ * @brief Allocate or deallocate a range of a file
+ *
+ * MEM files take no space, so allocation only extends the file with
+ * zeroes.  Deallocation zeroes the range within the file and, like
+ * punching a hole, does not change its size.
+ *
+ * @param[in] obj_hdl  File on which to operate
+ * @param[in] state    state_t to use for this operation
+ * @param[in] offset   Start of the range
+ * @param[in] length   Length of the range
+ * @param[in] allocate true to allocate, false to deallocate
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t mem_fallocate(struct fsal_obj_handle *obj_hdl,
+				   struct state_t *state, uint64_t offset,
+				   uint64_t length, bool allocate)
+{
+	struct mem_fsal_obj_handle *myself = container_of(obj_hdl,
+				  struct mem_fsal_obj_handle, obj_handle);
+	struct fsal_fd *fsal_fd;
+	bool has_lock = false, closefd = false;
+	bool reusing_open_state_fd = false;
+	fsal_status_t status;
+	uint64_t end = offset + length;
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+
+	status = fsal_find_fd(&fsal_fd, obj_hdl, &myself->mh_file.fd,
+			      &myself->mh_file.share, false, state,
+			      FSAL_O_WRITE, mem_open_func, mem_close_func,
+			      &has_lock, &closefd, false,
+			      &reusing_open_state_fd);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (allocate) {
+		if (end > myself->attrs.filesize) {
+			mem_zero_range(myself,
+				       MAX(offset, myself->attrs.filesize),
+				       end);
+			myself->attrs.filesize = myself->attrs.spaceused = end;
+		}
+	} else if (offset < myself->attrs.filesize) {
+		mem_zero_range(myself, offset,
+			       MIN(end, myself->attrs.filesize));
+	}
+
+	now(&myself->attrs.mtime);
+	myself->attrs.chgtime = myself->attrs.mtime;
+	myself->attrs.change = timespec_to_nsecs(&myself->attrs.chgtime);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
 /**
  * @brief Perform a lock operation
  *
@@ -2228,6 +2718,9 @@ void mem_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->read2 = mem_read2;
 	ops->write2 = mem_write2;
 	ops->commit2 = mem_commit2;
+	ops->copy_range2 = mem_copy_range2;
+	ops->write_same2 = mem_write_same2;
+	ops->fallocate = mem_fallocate;
 	ops->lock_op2 = mem_lock_op2;
 	ops->close2 = mem_close2;
 	ops->handle_to_wire = mem_handle_to_wire;
@@ -46,10 +46,25 @@ struct mem_fsal_export {
 	struct mem_fsal_obj_handle *root_handle;
 	/** Entry into list of exports */
 	struct glist_head export_entry;
-	/** Lock protecting mfe_objs */
+	/** Lock protecting mfe_objs and mfe_quotas */
 	pthread_rwlock_t mfe_exp_lock;
 	/** List of all the objects in this export */
 	struct glist_head mfe_objs;
+	/** List of quota limits set on this export */
+	struct glist_head mfe_quotas;
+};
+
+/**
+ * @brief Quota limits set for one user or group of a MEM export
+ *
+ * Usage is not kept, it is counted from the export's objects when asked
+ * for.
+ */
+struct mem_quota {
+	struct glist_head mq_list;	/**< Entry in mfe_quotas */
+	int mq_type;			/**< USRQUOTA or GRPQUOTA */
+	int mq_id;			/**< User or group id */
+	fsal_quota_t mq_limits;		/**< Limits and grace times */
 };
 
 fsal_status_t mem_lookup_path(struct fsal_export *exp_hdl,
@@ -84,6 +99,11 @@ struct mem_fsal_obj_handle {
 		struct {
 			struct fsal_share share;
 			struct fsal_fd fd;
+			/** Extents past datasize written by WRITE_SAME or
+			 *  deallocated, see struct mem_extent */
+			struct glist_head extents;
+			/** Lock protecting extents */
+			pthread_mutex_t ext_mutex;
 		} mh_file;
 		struct {
 			object_file_type_t nodetype;
@@ -103,6 +123,21 @@ struct mem_fsal_obj_handle {
 	char data[0]; /* Allocated data */
 };
 
+/**
+ * @brief Known content of a range past datasize
+ *
+ * Past datasize a MEM file reads back as a fill byte, except in ranges
+ * where WRITE_SAME or DEALLOCATE said what the content is.  The
+ * description is kept rather than the data, so splitting or moving an
+ * extent only needs its bounds changed.
+ */
+struct mem_extent {
+	struct glist_head ext_list;	/**< Entry in mh_file.extents */
+	uint64_t start;			/**< First byte covered */
+	uint64_t end;			/**< Byte after the last covered */
+	struct fsal_write_same_arg ws;	/**< Content, pattern is owned */
+};
+
 /**
  * @brief Dirent for FSAL_MEM
  */
@@ -273,9 +273,17 @@ static struct pseudo_fsal_obj_handle
 	avltree_init(&hdl->avl_index, pseudofs_i_cmpf, 0 /* flags */);
 	hdl->next_i = 2;
 	if (parent != NULL) {
-		/* Attach myself to my parent */
+		/* Attach myself to my parent, unless another create of the
+		 * same name got there first.
+		 */
 		PTHREAD_RWLOCK_wrlock(&parent->obj_handle.obj_lock);
-		avltree_insert(&hdl->avl_n, &parent->avl_name);
+		if (avltree_insert(&hdl->avl_n, &parent->avl_name) != NULL) {
+			PTHREAD_RWLOCK_unlock(&parent->obj_handle.obj_lock);
+			LogDebug(COMPONENT_FSAL,
+				 "%s already exists", name);
+			fsal_obj_handle_fini(&hdl->obj_handle);
+			goto spcerr;
+		}
 		hdl->index = (parent->next_i)++;
 		avltree_insert(&hdl->avl_i, &parent->avl_index);
 		hdl->inavl = true;
@@ -414,6 +422,9 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 				     op_ctx->fsal_export,
 				     attrs_in);
 
+	if (hdl == NULL)
+		return fsalstat(ERR_FSAL_EXIST, 0);
+
 	numlinks = atomic_inc_uint32_t(&myself->numlinks);
 
 	LogFullDebug(COMPONENT_FSAL,
@@ -38,6 +38,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/statvfs.h>
+#include <sys/param.h>
 #include <os/mntent.h>
 #include <os/quota.h>
 #include <dlfcn.h>
@@ -46,6 +47,7 @@
 #include "config_parsing.h"
 #include "FSAL/fsal_commonlib.h"
 #include "FSAL/fsal_config.h"
+#include "FSAL/fsal_fdcache.h"
 #include "fsal_handle_syscalls.h"
 #include "vfs_methods.h"
 #include "nfs_exports.h"
@@ -185,13 +187,19 @@ static fsal_status_t get_quota(struct fsal_export *exp_hdl,
 	}
 	pquota->bhardlimit = fs_quota.dqb_bhardlimit;
 	pquota->bsoftlimit = fs_quota.dqb_bsoftlimit;
-	pquota->curblocks = fs_quota.dqb_curspace;
 	pquota->fhardlimit = fs_quota.dqb_ihardlimit;
 	pquota->fsoftlimit = fs_quota.dqb_isoftlimit;
 	pquota->curfiles = fs_quota.dqb_curinodes;
 	pquota->btimeleft = fs_quota.dqb_btime;
 	pquota->ftimeleft = fs_quota.dqb_itime;
+#ifdef LINUX
+	/* Linux gives block limits in 1K quota blocks but usage in bytes */
+	pquota->curblocks = howmany(fs_quota.dqb_curspace, 1024);
+	pquota->bsize = 1024;
+#else
+	pquota->curblocks = fs_quota.dqb_curspace;
 	pquota->bsize = DEV_BSIZE;
+#endif
 
  out:
 	return fsalstat(fsal_error, retval);
@@ -394,6 +402,8 @@ void vfs_unclaim_filesystem(struct fsal_filesystem *fs)
 	struct glist_head *glist, *glistn;
 	struct vfs_filesystem_export_map *map;
 
+	fsal_fdcache_purge_fs(fs);
+
 	if (vfs_fs != NULL) {
 		glist_for_each_safe(glist, glistn, &vfs_fs->exports) {
 			map = glist_entry(glist,
@@ -35,10 +35,19 @@
 #include <assert.h>
 #include "fsal.h"
 #include "FSAL/access_check.h"
+#include "FSAL/fsal_fdcache.h"
+#include "FSAL/fsal_readahead.h"
+#include "mdcache.h"
 #include "fsal_convert.h"
+#include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/uio.h>
+#ifdef LINUX
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
 #include "vfs_methods.h"
 #include "os/subr.h"
 #include "sal_data.h"
@@ -272,8 +281,8 @@ fsal_status_t vfs_merge(struct fsal_obj_handle *orig_hdl,
 	return status;
 }
 
-static fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
-				 int my_fd, struct attrlist *attrs)
+fsal_status_t vfs_fetch_attrs(struct vfs_fsal_obj_handle *myself,
+			      int my_fd, struct attrlist *attrs)
 {
 	struct stat stat;
 	int retval = 0;
@@ -472,7 +481,7 @@ static fsal_status_t vfs_open2_by_handle(struct fsal_obj_handle *obj_hdl,
 
 		fsal_prepare_attrs(&attrs, attrs_mask);
 
-		status = fetch_attrs(myself, my_fd->fd, &attrs);
+		status = vfs_fetch_attrs(myself, my_fd->fd, &attrs);
 		if (FSAL_IS_SUCCESS(status)) {
 			LogFullDebug(COMPONENT_FSAL,
 				     "New size = %" PRIx64,
@@ -1169,6 +1178,170 @@ fsal_status_t find_fd(int *fd,
 	return status;
 }
 
+/**
+ * @brief Find a file descriptor for stateless or stateful I/O
+ *
+ * When the shared fd cache is enabled and no state is presented, this
+ * uses the global file descriptor only if it is already open in a usable
+ * mode, and otherwise takes a descriptor from the fd cache (opening and
+ * inserting one on a miss) rather than upgrading the global descriptor or
+ * opening a temporary one.  Share reservations are checked as usual and
+ * obj_lock is held for read on return, just as for a temporary fd.
+ *
+ * In every other case this is just find_fd.
+ *
+ * @param[out] fd        The file descriptor to use
+ * @param[out] cached    The fd cache entry to put when done, if any
+ *
+ * The other parameters are as for find_fd.
+ */
+
+static fsal_status_t find_io_fd(int *fd,
+				struct fsal_obj_handle *obj_hdl,
+				bool bypass,
+				struct state_t *state,
+				fsal_openflags_t openflags,
+				bool *has_lock,
+				bool *closefd,
+				struct fsal_fdcache_entry **cached)
+{
+	struct vfs_fsal_obj_handle *myself;
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	fsal_status_t status;
+	bool reusing_open_state_fd = false;
+	int posix_flags, rc;
+
+	*cached = NULL;
+
+	if (state != NULL || !fsal_fdcache_enabled() ||
+	    obj_hdl->type != REGULAR_FILE)
+		return find_fd(fd, obj_hdl, bypass, state, openflags,
+			       has_lock, closefd, false);
+
+	myself = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	*closefd = false;
+
+	/* Only check the share reservation, leaving obj_lock held */
+	status = fsal_find_fd(NULL, obj_hdl,
+			      (struct fsal_fd *)&myself->u.file.fd,
+			      &myself->u.file.share,
+			      bypass, NULL, openflags,
+			      vfs_open_func, vfs_close_func,
+			      has_lock, closefd, false,
+			      &reusing_open_state_fd);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (open_correct(myself->u.file.fd.openflags, openflags)) {
+		*fd = myself->u.file.fd.fd;
+		return status;
+	}
+
+	/* VFS always opens with the server's credentials, so there is only
+	 * one credentials class.
+	 */
+	*cached = fsal_fdcache_get(obj_hdl->fs, myself->handle->handle_data,
+				   myself->handle->handle_len, openflags, 0);
+
+	if (*cached != NULL) {
+		*fd = (*cached)->fd;
+		return status;
+	}
+
+	if (!mdcache_lru_fds_available()) {
+		status = fsalstat(ERR_FSAL_DELAY, 0);
+		goto fail;
+	}
+
+	fsal2posix_openflags(openflags, &posix_flags);
+
+	rc = vfs_fsal_open(myself, posix_flags, &fsal_error);
+
+	if (rc < 0) {
+		LogDebug(COMPONENT_FSAL,
+			 "Failed with %s openflags 0x%08x",
+			 strerror(-rc), openflags);
+		status = fsalstat(fsal_error, -rc);
+		goto fail;
+	}
+
+	*cached = fsal_fdcache_insert(obj_hdl->fs, myself->handle->handle_data,
+				      myself->handle->handle_len, openflags, 0,
+				      rc);
+	*fd = (*cached)->fd;
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "Cached fd=%d for file %p", *fd, myself);
+
+	return status;
+
+fail:
+
+	if (*has_lock) {
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+		*has_lock = false;
+	}
+
+	return status;
+}
+
+/**
+ * @brief Carry out readahead advice on a file descriptor
+ *
+ * Strided access is advised as random, so the kernel does not read
+ * ahead on its own while we read the next stride ahead.
+ *
+ * @param[in] fd     File descriptor to advise on
+ * @param[in] advice Advice from the access pattern tracker
+ */
+static void vfs_advise(int fd, const struct fsal_ra_advice *advice)
+{
+	int posix_advice;
+	int rc;
+
+	if (advice->pattern_changed) {
+		switch (advice->pattern) {
+		case FSAL_IO_SEQUENTIAL:
+			posix_advice = POSIX_FADV_SEQUENTIAL;
+			break;
+		case FSAL_IO_STRIDE:
+		case FSAL_IO_RANDOM:
+			posix_advice = POSIX_FADV_RANDOM;
+			break;
+		default:
+			posix_advice = POSIX_FADV_NORMAL;
+			break;
+		}
+
+		rc = posix_fadvise(fd, 0, 0, posix_advice);
+		if (rc != 0)
+			LogFullDebug(COMPONENT_FSAL,
+				     "posix_fadvise %d on fd %d failed: %s",
+				     posix_advice, fd, strerror(rc));
+	}
+
+	switch (advice->op) {
+	case FSAL_RA_WILLNEED:
+		posix_advice = POSIX_FADV_WILLNEED;
+		break;
+	case FSAL_RA_DONTNEED:
+		posix_advice = POSIX_FADV_DONTNEED;
+		break;
+	case FSAL_RA_NOREUSE:
+		posix_advice = POSIX_FADV_NOREUSE;
+		break;
+	default:
+		return;
+	}
+
+	rc = posix_fadvise(fd, advice->offset, advice->length, posix_advice);
+	if (rc != 0)
+		LogFullDebug(COMPONENT_FSAL,
+			     "posix_fadvise %d on fd %d failed: %s",
+			     posix_advice, fd, strerror(rc));
+}
+
 /**
  * @brief Read data from a file
  *
@@ -1201,6 +1374,12 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 	bool has_lock = false;
 	bool closefd = false;
 	struct vfs_fd *vfs_fd = NULL;
+	struct fsal_fdcache_entry *cached = NULL;
+	struct fsal_readahead *ra;
+	struct fsal_ra_advice advice;
+	bool submitted = false;
+	uint64_t length = 0;
+	int i;
 
 	if (read_arg->info != NULL) {
 		/* Currently we don't support READ_PLUS */
@@ -1231,12 +1410,34 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 	/* Get a usable file descriptor */
 	LogFullDebug(COMPONENT_FSAL, "Calling find_fd, state = %p",
 		     read_arg->state);
-	status = find_fd(&my_fd, obj_hdl, bypass, read_arg->state, FSAL_O_READ,
-			 &has_lock, &closefd, false);
+	status = find_io_fd(&my_fd, obj_hdl, bypass, read_arg->state,
+			    FSAL_O_READ, &has_lock, &closefd, &cached);
 
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
+	/* Follow the access pattern of the open file, stateless READs
+	 * share the tracker of the global file descriptor.
+	 */
+	if (vfs_fd != NULL)
+		ra = &vfs_fd->ra;
+	else
+		ra = &container_of(obj_hdl, struct vfs_fsal_obj_handle,
+				   obj_handle)->u.file.fd.ra;
+
+	for (i = 0; i < read_arg->iov_count; i++)
+		length += read_arg->iov[i].iov_len;
+
+	if (fsal_readahead_read(ra, read_arg->offset, length, &advice))
+		vfs_advise(my_fd, &advice);
+
+#ifdef USE_FSAL_VFS_IO_URING
+	submitted = vfs_uring_submit(obj_hdl, my_fd, false, read_arg, done_cb,
+				     caller_arg);
+	if (submitted)
+		goto out;
+#endif
+
 	nb_read = preadv(my_fd, read_arg->iov, read_arg->iov_count,
 			 read_arg->offset);
 
@@ -1271,6 +1472,9 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (vfs_fd)
 		PTHREAD_RWLOCK_unlock(&vfs_fd->fdlock);
 
+	if (cached != NULL)
+		fsal_fdcache_put(cached);
+
 	if (closefd) {
 		LogFullDebug(COMPONENT_FSAL, "Closing Opened fd %d", my_fd);
 		close(my_fd);
@@ -1279,7 +1483,8 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
-	done_cb(obj_hdl, status, read_arg, caller_arg);
+	if (!submitted)
+		done_cb(obj_hdl, status, read_arg, caller_arg);
 }
 
 /**
@@ -1317,6 +1522,10 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 	bool closefd = false;
 	fsal_openflags_t openflags = FSAL_O_WRITE;
 	struct vfs_fd *vfs_fd = NULL;
+	struct fsal_fdcache_entry *cached = NULL;
+	struct vfs_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	bool submitted = false;
 
 	if (write_arg->info != NULL) {
 		/* Currently we don't support WRITE_PLUS */
@@ -1347,8 +1556,8 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 	/* Get a usable file descriptor */
 	LogFullDebug(COMPONENT_FSAL, "Calling find_fd, state = %p",
 		     write_arg->state);
-	status = find_fd(&my_fd, obj_hdl, bypass, write_arg->state, openflags,
-			 &has_lock, &closefd, false);
+	status = find_io_fd(&my_fd, obj_hdl, bypass, write_arg->state,
+			    openflags, &has_lock, &closefd, &cached);
 
 	if (FSAL_IS_ERROR(status)) {
 		LogDebug(COMPONENT_FSAL,
@@ -1362,6 +1571,13 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
+#ifdef USE_FSAL_VFS_IO_URING
+	submitted = vfs_uring_submit(obj_hdl, my_fd, true, write_arg, done_cb,
+				     caller_arg);
+	if (submitted)
+		goto out;
+#endif
+
 	nb_written = pwritev(my_fd, write_arg->iov, write_arg->iov_count,
 			     write_arg->offset);
 
@@ -1382,6 +1598,12 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 		}
 	}
 
+	/* The fd is at hand, so the post write attributes are one fstat
+	 * away.  If this fails the caller falls back to getattrs.
+	 */
+	if (write_arg->attrs_out != NULL && !FSAL_IS_ERROR(status))
+		(void) vfs_fetch_attrs(myself, my_fd, write_arg->attrs_out);
+
  out:
 
 	vfs_restore_ganesha_credentials(obj_hdl->fsal);
@@ -1389,6 +1611,9 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 	if (vfs_fd)
 		PTHREAD_RWLOCK_unlock(&vfs_fd->fdlock);
 
+	if (cached != NULL)
+		fsal_fdcache_put(cached);
+
 	if (closefd) {
 		LogFullDebug(COMPONENT_FSAL, "Closing Opened fd %d", my_fd);
 		close(my_fd);
@@ -1397,7 +1622,8 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
-	done_cb(obj_hdl, status, write_arg, caller_arg);
+	if (!submitted)
+		done_cb(obj_hdl, status, write_arg, caller_arg);
 }
 
 /**
@@ -1473,6 +1699,564 @@ out:
 	return status;
 }
 
+/* Size of the bounce buffer used when the kernel can't copy for us */
+#define VFS_COPY_BUFSIZE (1024 * 1024)
+
+/**
+ * @brief Get a file descriptor for one side of a copy
+ *
+ * Like vfs_read2/vfs_write2, this holds the state's fdlock, if any, across
+ * the use of the descriptor.  copy_fd_put releases everything taken here.
+ */
+
+static fsal_status_t copy_fd_get(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *state,
+				 fsal_openflags_t openflags,
+				 int *fd, struct vfs_fd **vfs_fd,
+				 bool *has_lock, bool *closefd,
+				 struct fsal_fdcache_entry **cached)
+{
+	fsal_status_t status;
+
+	*vfs_fd = NULL;
+
+	if (state) {
+		*vfs_fd = &container_of(state, struct vfs_state_fd,
+					state)->vfs_fd;
+
+		PTHREAD_RWLOCK_rdlock(&(*vfs_fd)->fdlock);
+	}
+
+	status = find_io_fd(fd, obj_hdl, false, state, openflags,
+			    has_lock, closefd, cached);
+
+	if (FSAL_IS_ERROR(status) && *vfs_fd) {
+		PTHREAD_RWLOCK_unlock(&(*vfs_fd)->fdlock);
+		*vfs_fd = NULL;
+	}
+
+	return status;
+}
+
+static void copy_fd_put(struct fsal_obj_handle *obj_hdl, int fd,
+			struct vfs_fd *vfs_fd, bool has_lock, bool closefd,
+			struct fsal_fdcache_entry *cached)
+{
+	if (vfs_fd)
+		PTHREAD_RWLOCK_unlock(&vfs_fd->fdlock);
+
+	if (cached != NULL)
+		fsal_fdcache_put(cached);
+
+	if (closefd) {
+		LogFullDebug(COMPONENT_FSAL, "Closing Opened fd %d", fd);
+		close(fd);
+	}
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+}
+
+/**
+ * @brief Copy a range through a bounce buffer
+ *
+ * Used when neither a clone nor copy_file_range is possible, which is the
+ * case across filesystems on older kernels.
+ */
+
+static int copy_range_buffered(int src_fd, uint64_t src_offset,
+			       int dst_fd, uint64_t dst_offset,
+			       uint64_t count, uint64_t *copied)
+{
+	size_t bufsize = MIN(count, VFS_COPY_BUFSIZE);
+	char *buf = gsh_malloc(bufsize);
+	int retval = 0;
+
+	while (*copied < count) {
+		size_t len = MIN(count - *copied, bufsize);
+		ssize_t nb_read, nb_written, done = 0;
+
+		nb_read = pread(src_fd, buf, len, src_offset + *copied);
+
+		if (nb_read == -1) {
+			retval = errno;
+			break;
+		}
+
+		if (nb_read == 0)
+			break;
+
+		while (done < nb_read) {
+			nb_written = pwrite(dst_fd, buf + done, nb_read - done,
+					    dst_offset + *copied + done);
+			if (nb_written == -1) {
+				retval = errno;
+				break;
+			}
+			done += nb_written;
+		}
+
+		*copied += done;
+
+		if (retval != 0)
+			break;
+	}
+
+	gsh_free(buf);
+
+	return retval;
+}
+
+/**
+ * @brief Copy or clone a range of one file into another
+ *
+ * A clone is done with FICLONERANGE and either shares every block of the
+ * range or fails.  A copy is handed to copy_file_range, which lets the
+ * filesystem reflink or copy server side where it can, and falls back to
+ * copying through a buffer where the kernel won't.  The source and
+ * destination may be the same file.
+ *
+ * @param[in]  obj_hdl     Destination file
+ * @param[in]  dst_state   State for the destination, may be NULL
+ * @param[in]  dst_offset  Offset in the destination
+ * @param[in]  src_hdl     Source file
+ * @param[in]  src_state   State for the source, may be NULL
+ * @param[in]  src_offset  Offset in the source
+ * @param[in]  count       Bytes to copy
+ * @param[in]  flags       FSAL_COPY_* flags
+ * @param[out] copied      Bytes actually copied
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_copy_range2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *dst_state,
+			      uint64_t dst_offset,
+			      struct fsal_obj_handle *src_hdl,
+			      struct state_t *src_state,
+			      uint64_t src_offset,
+			      uint64_t count,
+			      uint32_t flags,
+			      uint64_t *copied)
+{
+	fsal_status_t status;
+	int src_fd = -1, dst_fd = -1;
+	struct vfs_fd *src_vfs_fd = NULL, *dst_vfs_fd = NULL;
+	struct fsal_fdcache_entry *src_cached = NULL, *dst_cached = NULL;
+	bool src_has_lock = false, src_closefd = false;
+	bool dst_has_lock = false, dst_closefd = false;
+	bool same = src_hdl == obj_hdl;
+	int retval = 0;
+
+	*copied = 0;
+
+	if (obj_hdl->type != REGULAR_FILE || src_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+
+	if (same) {
+		/* The stateids have been checked by the caller, and taking
+		 * obj_lock twice could deadlock against a writer, so use one
+		 * stateless read/write descriptor for both sides.
+		 */
+		status = copy_fd_get(obj_hdl, NULL, FSAL_O_RDWR, &dst_fd,
+				     &dst_vfs_fd, &dst_has_lock, &dst_closefd,
+				     &dst_cached);
+		if (FSAL_IS_ERROR(status))
+			return status;
+
+		src_fd = dst_fd;
+	} else {
+		status = copy_fd_get(src_hdl, src_state, FSAL_O_READ, &src_fd,
+				     &src_vfs_fd, &src_has_lock, &src_closefd,
+				     &src_cached);
+		if (FSAL_IS_ERROR(status))
+			return status;
+
+		status = copy_fd_get(obj_hdl, dst_state, FSAL_O_WRITE, &dst_fd,
+				     &dst_vfs_fd, &dst_has_lock, &dst_closefd,
+				     &dst_cached);
+		if (FSAL_IS_ERROR(status))
+			goto out_src;
+	}
+
+	if (!vfs_set_credentials(op_ctx->creds, obj_hdl->fsal)) {
+		status = fsalstat(ERR_FSAL_PERM, EPERM);
+		goto out;
+	}
+
+	if (flags & FSAL_COPY_CLONE) {
+#ifdef FICLONERANGE
+		struct file_clone_range range = {
+			.src_fd = src_fd,
+			.src_offset = src_offset,
+			.src_length = count,
+			.dest_offset = dst_offset,
+		};
+
+		if (ioctl(dst_fd, FICLONERANGE, &range) == -1)
+			retval = errno;
+		else
+			*copied = count;
+#else
+		retval = EOPNOTSUPP;
+#endif
+		if (retval == EOPNOTSUPP || retval == EXDEV ||
+		    retval == ENOTTY || retval == EINVAL)
+			status = fsalstat(ERR_FSAL_NOTSUPP, retval);
+		else if (retval != 0)
+			status = fsalstat(posix2fsal_error(retval), retval);
+
+		goto restore;
+	}
+
+#ifdef __NR_copy_file_range
+	while (*copied < count) {
+		loff_t off_in = src_offset + *copied;
+		loff_t off_out = dst_offset + *copied;
+		ssize_t nb_copied;
+
+		nb_copied = syscall(__NR_copy_file_range, src_fd, &off_in,
+				    dst_fd, &off_out,
+				    (size_t) MIN(count - *copied, SSIZE_MAX),
+				    0);
+		if (nb_copied == -1) {
+			retval = errno;
+			break;
+		}
+
+		if (nb_copied == 0)
+			break;
+
+		*copied += nb_copied;
+	}
+
+	/* Only fall back if nothing has been copied, so a partial copy is
+	 * reported as short rather than mixed with a buffered one.
+	 */
+	if (*copied == 0 &&
+	    (retval == ENOSYS || retval == EXDEV || retval == EOPNOTSUPP ||
+	     retval == EINVAL))
+		retval = copy_range_buffered(src_fd, src_offset, dst_fd,
+					     dst_offset, count, copied);
+#else
+	retval = copy_range_buffered(src_fd, src_offset, dst_fd, dst_offset,
+				     count, copied);
+#endif
+
+	/* A short copy is not an error */
+	if (retval != 0 && *copied == 0)
+		status = fsalstat(posix2fsal_error(retval), retval);
+
+restore:
+
+	vfs_restore_ganesha_credentials(obj_hdl->fsal);
+
+out:
+
+	copy_fd_put(obj_hdl, dst_fd, dst_vfs_fd, dst_has_lock, dst_closefd,
+		    dst_cached);
+
+out_src:
+
+	if (!same)
+		copy_fd_put(src_hdl, src_fd, src_vfs_fd, src_has_lock,
+			    src_closefd, src_cached);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "Copied %"PRIu64" of %"PRIu64" bytes, flags 0x%x",
+		     *copied, count, flags);
+
+	return status;
+}
+
+/**
+ * @brief Act on IO_ADVISE hints
+ *
+ * Pattern hints are kept in the state's access pattern tracker so they
+ * steer readahead of later READs, range hints are passed to the kernel.
+ *
+ * @param[in]     obj_hdl File on which to operate
+ * @param[in]     state   State the hints apply to, NULL for stateless
+ * @param[in,out] hints   Hints to apply, set to the hints honoured
+ *
+ * @return FSAL status.
+ */
+fsal_status_t vfs_io_advise2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     struct io_hints *hints)
+{
+	struct vfs_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	struct fsal_fdcache_entry *cached = NULL;
+	struct vfs_fd *vfs_fd = NULL;
+	struct fsal_ra_advice advice;
+	struct fsal_readahead *ra;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+	int my_fd = -1;
+
+	if (state != NULL)
+		ra = &container_of(state, struct vfs_state_fd,
+				   state)->vfs_fd.ra;
+	else
+		ra = &myself->u.file.fd.ra;
+
+	hints->hints = fsal_readahead_hint(ra, hints, &advice);
+
+	if (!advice.pattern_changed && advice.op == FSAL_RA_NONE)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	status = copy_fd_get(obj_hdl, state,
+			     state != NULL ? FSAL_O_ANY : FSAL_O_READ,
+			     &my_fd, &vfs_fd, &has_lock, &closefd, &cached);
+
+	if (FSAL_IS_ERROR(status)) {
+		/* The pattern still applies to later READs */
+		LogFullDebug(COMPONENT_FSAL,
+			     "No fd to advise on: %s",
+			     msg_fsal_err(status.major));
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	vfs_advise(my_fd, &advice);
+
+	copy_fd_put(obj_hdl, my_fd, vfs_fd, has_lock, closefd, cached);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* Most a pattern WRITE_SAME writes in one call, zeroing is not capped */
+#define VFS_WRITE_SAME_MAX (1024ULL * 1024 * 1024)
+/* Times the pattern buffer is repeated in one pwritev */
+#define VFS_WRITE_SAME_IOV 16
+
+/**
+ * @brief Write the blocks of a WRITE_SAME
+ *
+ * When every block is the same, the blocks are laid out once in a buffer
+ * that is then handed to pwritev several times over, otherwise the buffer
+ * is refilled for each chunk.  A short write ends the loop.
+ *
+ * @return 0 or an errno if nothing could be written.
+ */
+
+static int vfs_write_pattern(int fd, struct fsal_write_same_arg *ws_arg,
+			     uint64_t total)
+{
+	uint64_t bs = ws_arg->block_size;
+	bool periodic = !fsal_write_same_numbered(ws_arg) &&
+			bs <= VFS_COPY_BUFSIZE;
+	size_t buflen;
+	char *buf;
+	int retval = 0;
+
+	if (periodic)
+		buflen = MIN(VFS_COPY_BUFSIZE / bs * bs, total);
+	else
+		buflen = MIN(VFS_COPY_BUFSIZE, total);
+
+	buf = gsh_malloc(buflen);
+
+	if (periodic)
+		fsal_write_same_fill(ws_arg, ws_arg->offset, buf, buflen);
+
+	while (ws_arg->io_amount < total) {
+		uint64_t pos = ws_arg->offset + ws_arg->io_amount;
+		uint64_t left = total - ws_arg->io_amount;
+		size_t want = 0;
+		ssize_t nb;
+
+		if (periodic) {
+			struct iovec iov[VFS_WRITE_SAME_IOV];
+			int cnt;
+
+			for (cnt = 0; cnt < VFS_WRITE_SAME_IOV && left > 0;
+			     cnt++) {
+				iov[cnt].iov_base = buf;
+				iov[cnt].iov_len = MIN(buflen, left);
+				left -= iov[cnt].iov_len;
+				want += iov[cnt].iov_len;
+			}
+
+			nb = pwritev(fd, iov, cnt, pos);
+		} else {
+			want = MIN(buflen, left);
+			fsal_write_same_fill(ws_arg, pos, buf, want);
+			nb = pwrite(fd, buf, want, pos);
+		}
+
+		if (nb == -1) {
+			retval = errno;
+			break;
+		}
+
+		ws_arg->io_amount += nb;
+
+		if ((size_t) nb < want)
+			break;
+	}
+
+	gsh_free(buf);
+
+	return ws_arg->io_amount == 0 ? retval : 0;
+}
+
+/**
+ * @brief Write a repeated pattern to a file
+ *
+ * Zeroing is done with FALLOC_FL_ZERO_RANGE where the filesystem has it,
+ * so no data goes through the server; anything else is replicated here
+ * and written without being sent over the wire.
+ *
+ * @param[in]     obj_hdl File on which to operate
+ * @param[in]     state   state_t to use for this operation
+ * @param[in,out] ws_arg  What to write, and how much was written
+ *
+ * @return FSAL status.
+ */
+fsal_status_t vfs_write_same2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      struct fsal_write_same_arg *ws_arg)
+{
+	struct fsal_fdcache_entry *cached = NULL;
+	struct vfs_fd *vfs_fd = NULL;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+	uint64_t total, max;
+	int my_fd = -1;
+	int retval = 0;
+
+	ws_arg->io_amount = 0;
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+
+	total = ws_arg->block_size * ws_arg->block_count;
+	if (total == 0)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	status = copy_fd_get(obj_hdl, state, FSAL_O_WRITE, &my_fd, &vfs_fd,
+			     &has_lock, &closefd, &cached);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (!vfs_set_credentials(op_ctx->creds, obj_hdl->fsal)) {
+		status = fsalstat(ERR_FSAL_PERM, EPERM);
+		goto out;
+	}
+
+	if (fsal_write_same_is_zero(ws_arg)) {
+#ifdef FALLOC_FL_ZERO_RANGE
+		if (fallocate(my_fd, FALLOC_FL_ZERO_RANGE, ws_arg->offset,
+			      total) == 0)
+			ws_arg->io_amount = total;
+		else
+			retval = errno;
+#else
+		retval = EOPNOTSUPP;
+#endif
+		if (retval != 0 && retval != EOPNOTSUPP) {
+			status = fsalstat(posix2fsal_error(retval), retval);
+			goto restore;
+		}
+	}
+
+	if (ws_arg->io_amount == 0) {
+		/* Whole blocks, at least one */
+		max = MAX(VFS_WRITE_SAME_MAX / ws_arg->block_size, 1) *
+		      ws_arg->block_size;
+
+		retval = vfs_write_pattern(my_fd, ws_arg, MIN(total, max));
+		if (retval != 0) {
+			status = fsalstat(posix2fsal_error(retval), retval);
+			goto restore;
+		}
+
+		ws_arg->io_amount -= ws_arg->io_amount % ws_arg->block_size;
+	}
+
+	if (ws_arg->fsal_stable && fsync(my_fd) == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		ws_arg->fsal_stable = false;
+	}
+
+restore:
+
+	vfs_restore_ganesha_credentials(obj_hdl->fsal);
+
+out:
+
+	copy_fd_put(obj_hdl, my_fd, vfs_fd, has_lock, closefd, cached);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "WRITE_SAME wrote %"PRIu64" of %"PRIu64" bytes",
+		     ws_arg->io_amount, total);
+
+	return status;
+}
+
+/**
+ * @brief Allocate or deallocate a range of a file
+ *
+ * Deallocation punches a hole, which reads back as zeroes, without
+ * changing the size of the file.
+ *
+ * @param[in] obj_hdl  File on which to operate
+ * @param[in] state    state_t to use for this operation
+ * @param[in] offset   Start of the range
+ * @param[in] length   Length of the range
+ * @param[in] allocate true to allocate, false to deallocate
+ *
+ * @return FSAL status.
+ */
+fsal_status_t vfs_fallocate(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state, uint64_t offset,
+			    uint64_t length, bool allocate)
+{
+#ifdef FALLOC_FL_PUNCH_HOLE
+	struct fsal_fdcache_entry *cached = NULL;
+	struct vfs_fd *vfs_fd = NULL;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+	int my_fd = -1;
+	int retval;
+
+	status = copy_fd_get(obj_hdl, state, FSAL_O_WRITE, &my_fd, &vfs_fd,
+			     &has_lock, &closefd, &cached);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (!vfs_set_credentials(op_ctx->creds, obj_hdl->fsal)) {
+		status = fsalstat(ERR_FSAL_PERM, EPERM);
+		goto out;
+	}
+
+	retval = fallocate(my_fd,
+			   allocate ? 0
+				    : FALLOC_FL_PUNCH_HOLE |
+				      FALLOC_FL_KEEP_SIZE,
+			   offset, length);
+	if (retval == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	}
+
+	vfs_restore_ganesha_credentials(obj_hdl->fsal);
+
+out:
+
+	copy_fd_put(obj_hdl, my_fd, vfs_fd, has_lock, closefd, cached);
+
+	return status;
+#else
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
+#endif
+}
+
 #ifdef F_OFD_GETLK
 /**
  * @brief Perform a lock operation
@@ -1737,7 +2521,7 @@ fsal_status_t vfs_getattr2(struct fsal_obj_handle *obj_hdl,
 #ifdef __FreeBSD__
  fetch:
 #endif
-	status = fetch_attrs(myself, my_fd, attrs);
+	status = vfs_fetch_attrs(myself, my_fd, attrs);
 
  out:
 
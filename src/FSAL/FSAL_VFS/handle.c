@@ -44,6 +44,7 @@
 #include "fsal_convert.h"
 #include "fsal_handle_syscalls.h"
 #include "FSAL/fsal_commonlib.h"
+#include "FSAL/fsal_fdcache.h"
 #include "vfs_methods.h"
 #include <os/subr.h>
 #include "subfsal.h"
@@ -1613,6 +1614,15 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 			fsal_error = ERR_FSAL_STALE;
 		else
 			fsal_error = posix2fsal_error(retval);
+	} else if (S_ISREG(stat.st_mode) && stat.st_nlink <= 1) {
+		struct vfs_fsal_obj_handle *victim;
+
+		/* Don't let cached descriptors keep the inode alive */
+		victim = container_of(obj_hdl, struct vfs_fsal_obj_handle,
+				      obj_handle);
+		fsal_fdcache_invalidate(obj_hdl->fs,
+					victim->handle->handle_data,
+					victim->handle->handle_len);
 	}
 	vfs_restore_ganesha_credentials(dir_hdl->fsal);
 
@@ -1763,6 +1773,10 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->read2 = vfs_read2;
 	ops->write2 = vfs_write2;
 	ops->commit2 = vfs_commit2;
+	ops->copy_range2 = vfs_copy_range2;
+	ops->io_advise2 = vfs_io_advise2;
+	ops->write_same2 = vfs_write_same2;
+	ops->fallocate = vfs_fallocate;
 #ifdef F_OFD_GETLK
 	ops->lock_op2 = vfs_lock_op2;
 #endif
@@ -104,6 +104,14 @@ static struct config_item vfs_params[] = {
 		       module.fs_info.auth_exportpath_xdev),
 	CONF_ITEM_BOOL("only_one_user", false, vfs_fsal_module,
 		       only_one_user),
+#ifdef USE_FSAL_VFS_IO_URING
+	CONF_ITEM_BOOL("io_uring", false, vfs_fsal_module,
+		       io_uring),
+	CONF_ITEM_UI32("io_uring_rings", 1, 64, 4, vfs_fsal_module,
+		       io_uring_rings),
+	CONF_ITEM_UI32("io_uring_depth", 8, 4096, 256, vfs_fsal_module,
+		       io_uring_depth),
+#endif
 	CONFIG_EOL
 };
 
@@ -190,6 +198,15 @@ static fsal_status_t init_config(struct fsal_module *vfs_fsal_module,
 	    !config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
 
+#ifdef USE_FSAL_VFS_IO_URING
+	/* Without io_uring, or if the kernel lacks it, fall back to plain
+	 * synchronous I/O.
+	 */
+	if (vfs_module->io_uring)
+		(void) vfs_uring_init(vfs_module->io_uring_rings,
+				      vfs_module->io_uring_depth);
+#endif
+
 	display_fsinfo(&vfs_module->module);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
@@ -239,6 +256,10 @@ MODULE_FINI void vfs_unload(void)
 {
 	int retval;
 
+#ifdef USE_FSAL_VFS_IO_URING
+	vfs_uring_shutdown();
+#endif
+
 	retval = unregister_fsal(&VFS.module);
 	if (retval != 0) {
 		fprintf(stderr, "VFS module failed to unregister");
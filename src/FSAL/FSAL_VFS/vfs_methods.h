@@ -34,6 +34,7 @@
 #include "fsal_api.h"
 #include "FSAL/fsal_commonlib.h"
 #include "FSAL/access_check.h"
+#include "FSAL/fsal_readahead.h"
 
 struct vfs_fsal_obj_handle;
 struct vfs_fsal_export;
@@ -46,6 +47,9 @@ struct vfs_fsal_module {
 	struct fsal_module module;
 	struct fsal_obj_ops handle_ops;
 	bool only_one_user;
+	bool io_uring;		/*< Use the io_uring engine for read2/write2 */
+	uint32_t io_uring_rings;	/*< Number of rings */
+	uint32_t io_uring_depth;	/*< Entries of each ring */
 };
 
 /*
@@ -143,6 +147,8 @@ struct vfs_fd {
 	pthread_rwlock_t fdlock;
 	/** The kernel file descriptor. */
 	int fd;
+	/** Access pattern of reads through this descriptor */
+	struct fsal_readahead ra;
 };
 
 struct vfs_state_fd {
@@ -318,6 +324,40 @@ fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 			  off_t offset,
 			  size_t len);
 
+fsal_status_t vfs_copy_range2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *dst_state,
+			      uint64_t dst_offset,
+			      struct fsal_obj_handle *src_hdl,
+			      struct state_t *src_state,
+			      uint64_t src_offset,
+			      uint64_t count,
+			      uint32_t flags,
+			      uint64_t *copied);
+
+fsal_status_t vfs_io_advise2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     struct io_hints *hints);
+
+fsal_status_t vfs_write_same2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      struct fsal_write_same_arg *ws_arg);
+
+fsal_status_t vfs_fallocate(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state, uint64_t offset,
+			    uint64_t length, bool allocate);
+
+fsal_status_t vfs_fetch_attrs(struct vfs_fsal_obj_handle *myself,
+			      int my_fd, struct attrlist *attrs);
+
+#ifdef USE_FSAL_VFS_IO_URING
+/* io_uring I/O engine */
+int vfs_uring_init(uint32_t rings, uint32_t depth);
+void vfs_uring_shutdown(void);
+bool vfs_uring_submit(struct fsal_obj_handle *obj_hdl, int fd, bool write,
+		      struct fsal_io_arg *io_arg, fsal_async_cb done_cb,
+		      void *caller_arg);
+#endif
+
 fsal_status_t vfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 			   struct state_t *state,
 			   void *owner,
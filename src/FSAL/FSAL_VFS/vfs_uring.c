@@ -0,0 +1,413 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file FSAL/FSAL_VFS/vfs_uring.c
+ * @brief io_uring I/O engine for read2/write2
+ *
+ * A small set of rings is shared by all the threads doing I/O, each
+ * thread sticking to one ring.  A thread submits its I/O, with the fsync
+ * of a stable write linked behind it so both go in with one system call,
+ * and returns.  Each ring has a reaper thread that collects completions
+ * in batches, finishes the I/O and calls the read2/write2 callback.
+ *
+ * The I/O is done on a duplicate of the file descriptor, so the caller
+ * can drop its locks on the file and the fd cache entry right away.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <liburing.h>
+#include "gsh_list.h"
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "abstract_atomic.h"
+#include "vfs_methods.h"
+
+/** Tag of the user data of the fsync linked behind a stable write */
+#define VFS_URING_FSYNC 0x1
+
+/** User data of an SQE whose submission failed, turned into a NOP */
+#define VFS_URING_DROPPED 0x2
+
+struct vfs_uring {
+	struct io_uring ring;		/*< The ring */
+	pthread_mutex_t sq_mutex;	/*< Serializes submissions */
+	pthread_t reaper;		/*< Thread reaping completions */
+	uint32_t inflight;		/*< SQEs submitted and not reaped */
+};
+
+struct vfs_uring_io {
+	struct fsal_obj_handle *obj_hdl;	/*< Object of the I/O */
+	struct fsal_io_arg *io_arg;		/*< Caller's I/O arguments */
+	fsal_async_cb done_cb;			/*< Caller's callback */
+	void *caller_arg;			/*< Caller's callback argument */
+	struct req_op_context ctx;		/*< Copy of the caller's op_ctx */
+	int fd;					/*< Our duplicate of the fd */
+	bool write;				/*< Write or read */
+	int pending;				/*< SQEs not yet reaped */
+	int res;				/*< Result of the read/write */
+	int sync_res;				/*< Result of the linked fsync */
+};
+
+static struct vfs_uring *vfs_urings;
+static uint32_t vfs_uring_count;
+static uint32_t vfs_uring_depth;
+static uint32_t vfs_uring_next;
+static __thread int32_t vfs_uring_mine = -1;
+
+/**
+ * @brief Finish an I/O once all its SQEs have completed
+ *
+ * @param[in] io	The I/O
+ */
+static void vfs_uring_complete(struct vfs_uring_io *io)
+{
+	struct fsal_io_arg *io_arg = io->io_arg;
+	fsal_status_t status = {0, 0};
+	int retval;
+
+	/* Callbacks, and the stackable FSALs above us, expect the op_ctx
+	 * of the request.  Use our copy so they can swap fsal_export while
+	 * the submitting thread is still unwinding through them.
+	 */
+	op_ctx = &io->ctx;
+
+	if (io->res < 0) {
+		retval = -io->res;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		if (io->write)
+			io_arg->fsal_stable = false;
+	} else if (!io->write) {
+		io_arg->io_amount = io->res;
+		io_arg->end_of_file = (io->res == 0);
+	} else {
+		io_arg->io_amount = io->res;
+
+		if (io_arg->fsal_stable) {
+			retval = io->sync_res;
+
+			/* A short write breaks the link and cancels the
+			 * fsync, do it ourselves then.
+			 */
+			if (retval == -ECANCELED)
+				retval = (fsync(io->fd) == -1) ? -errno : 0;
+
+			if (retval < 0) {
+				status = fsalstat(posix2fsal_error(-retval),
+						  -retval);
+				io_arg->fsal_stable = false;
+			}
+		}
+
+		if (io_arg->attrs_out != NULL && !FSAL_IS_ERROR(status))
+			(void) vfs_fetch_attrs(OBJ_VFS_FROM_FSAL(io->obj_hdl),
+					       io->fd, io_arg->attrs_out);
+	}
+
+	close(io->fd);
+
+	io->done_cb(io->obj_hdl, status, io_arg, io->caller_arg);
+
+	op_ctx = NULL;
+	gsh_free(io);
+}
+
+/**
+ * @brief Reap completions of a ring until it is shut down
+ *
+ * @param[in] arg	The ring
+ */
+static void *vfs_uring_reaper(void *arg)
+{
+	struct vfs_uring *ur = arg;
+	struct io_uring_cqe *cqe;
+	struct vfs_uring_io *io;
+	uintptr_t data;
+	unsigned int head, count;
+	bool shutdown = false;
+	int rc;
+
+	SetNameFunction("vfs_uring");
+
+	while (!shutdown) {
+		rc = io_uring_wait_cqe(&ur->ring, &cqe);
+
+		if (rc == -EINTR)
+			continue;
+
+		if (rc < 0) {
+			LogCrit(COMPONENT_FSAL,
+				"io_uring_wait_cqe failed: %s", strerror(-rc));
+			break;
+		}
+
+		/* Take everything that is there in one go */
+		count = 0;
+		io_uring_for_each_cqe(&ur->ring, head, cqe) {
+			count++;
+			data = (uintptr_t) io_uring_cqe_get_data(cqe);
+
+			if (data == 0) {
+				/* The NOP from vfs_uring_shutdown() */
+				shutdown = true;
+				continue;
+			}
+
+			if (data == VFS_URING_DROPPED) {
+				/* Its I/O was done synchronously */
+				(void) atomic_dec_uint32_t(&ur->inflight);
+				continue;
+			}
+
+			io = (struct vfs_uring_io *) (data & ~VFS_URING_FSYNC);
+
+			if (data & VFS_URING_FSYNC)
+				io->sync_res = cqe->res;
+			else
+				io->res = cqe->res;
+
+			(void) atomic_dec_uint32_t(&ur->inflight);
+
+			if (--io->pending == 0)
+				vfs_uring_complete(io);
+		}
+
+		io_uring_cq_advance(&ur->ring, count);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Submit a read or write to the io_uring engine
+ *
+ * Must be called with the credentials of the request set, as the kernel
+ * does the I/O with those of the submitting thread.  On success the
+ * engine owns the I/O and calls @a done_cb from its reaper thread, the
+ * caller must not call it.
+ *
+ * @param[in] obj_hdl		Object to do I/O on
+ * @param[in] fd		File descriptor to use, not kept
+ * @param[in] write		Write or read
+ * @param[in] io_arg		I/O arguments
+ * @param[in] done_cb		Callback to call when the I/O is done
+ * @param[in] caller_arg	Argument for @a done_cb
+ *
+ * @return true if the I/O was submitted, false if the caller must do it.
+ */
+bool vfs_uring_submit(struct fsal_obj_handle *obj_hdl, int fd, bool write,
+		      struct fsal_io_arg *io_arg, fsal_async_cb done_cb,
+		      void *caller_arg)
+{
+	struct vfs_uring *ur;
+	struct vfs_uring_io *io;
+	struct io_uring_sqe *sqe[2];
+	int nsqe = (write && io_arg->fsal_stable) ? 2 : 1;
+	int rc, i;
+
+	if (vfs_urings == NULL)
+		return false;
+
+	if (vfs_uring_mine < 0)
+		vfs_uring_mine = atomic_inc_uint32_t(&vfs_uring_next) %
+				 vfs_uring_count;
+
+	ur = &vfs_urings[vfs_uring_mine];
+
+	/* Don't queue more than the ring holds, do it synchronously */
+	if (atomic_add_uint32_t(&ur->inflight, nsqe) > vfs_uring_depth) {
+		(void) atomic_sub_uint32_t(&ur->inflight, nsqe);
+		return false;
+	}
+
+	io = gsh_calloc(1, sizeof(*io));
+	io->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+
+	if (io->fd < 0) {
+		(void) atomic_sub_uint32_t(&ur->inflight, nsqe);
+		gsh_free(io);
+		return false;
+	}
+
+	io->obj_hdl = obj_hdl;
+	io->io_arg = io_arg;
+	io->done_cb = done_cb;
+	io->caller_arg = caller_arg;
+	io->ctx = *op_ctx;
+	io->write = write;
+	io->pending = nsqe;
+
+	PTHREAD_MUTEX_lock(&ur->sq_mutex);
+
+	/* We submit whatever we queue before dropping the mutex, and never
+	 * have more than vfs_uring_depth SQEs in flight, so there is room.
+	 */
+	sqe[0] = io_uring_get_sqe(&ur->ring);
+
+	if (write)
+		io_uring_prep_writev(sqe[0], io->fd, io_arg->iov,
+				     io_arg->iov_count, io_arg->offset);
+	else
+		io_uring_prep_readv(sqe[0], io->fd, io_arg->iov,
+				    io_arg->iov_count, io_arg->offset);
+
+	io_uring_sqe_set_data(sqe[0], io);
+
+	if (nsqe == 2) {
+		sqe[0]->flags |= IOSQE_IO_LINK;
+		sqe[1] = io_uring_get_sqe(&ur->ring);
+		io_uring_prep_fsync(sqe[1], io->fd, 0);
+		io_uring_sqe_set_data(sqe[1],
+				      (void *) ((uintptr_t) io |
+						VFS_URING_FSYNC));
+	}
+
+	do {
+		rc = io_uring_submit(&ur->ring);
+	} while (rc == -EINTR || rc == -EAGAIN);
+
+	if (rc < 0) {
+		/* The kernel took none of the SQEs, but they are in the ring
+		 * and go in with the next submission.  We hold sq_mutex and
+		 * don't use SQPOLL, so nobody reads them before that: make
+		 * them NOPs the reaper ignores and let the caller do the I/O.
+		 * They stay counted in inflight until they are reaped.
+		 */
+		for (i = 0; i < nsqe; i++) {
+			io_uring_prep_nop(sqe[i]);
+			sqe[i]->flags = 0;
+			io_uring_sqe_set_data(sqe[i],
+					      (void *) VFS_URING_DROPPED);
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&ur->sq_mutex);
+
+	if (rc < 0) {
+		LogCrit(COMPONENT_FSAL,
+			"io_uring_submit failed: %s, doing the I/O synchronously",
+			strerror(-rc));
+		close(io->fd);
+		gsh_free(io);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Set up the io_uring engine
+ *
+ * @param[in] rings	Number of rings
+ * @param[in] depth	Number of SQEs of each ring
+ *
+ * @return 0 on success, -errno otherwise.
+ */
+int vfs_uring_init(uint32_t rings, uint32_t depth)
+{
+	struct vfs_uring *urings;
+	uint32_t i;
+	int rc = 0;
+
+	if (vfs_urings != NULL)
+		return 0;
+
+	urings = gsh_calloc(rings, sizeof(*urings));
+
+	for (i = 0; i < rings; i++) {
+		rc = io_uring_queue_init(depth, &urings[i].ring, 0);
+		if (rc < 0)
+			break;
+
+		PTHREAD_MUTEX_init(&urings[i].sq_mutex, NULL);
+
+		rc = -pthread_create(&urings[i].reaper, NULL, vfs_uring_reaper,
+				     &urings[i]);
+		if (rc < 0) {
+			PTHREAD_MUTEX_destroy(&urings[i].sq_mutex);
+			io_uring_queue_exit(&urings[i].ring);
+			break;
+		}
+	}
+
+	if (rc < 0) {
+		LogWarn(COMPONENT_FSAL,
+			"Could not set up io_uring engine: %s",
+			strerror(-rc));
+		vfs_urings = urings;
+		vfs_uring_count = i;
+		vfs_uring_shutdown();
+		return rc;
+	}
+
+	vfs_uring_count = rings;
+	vfs_uring_depth = depth;
+	vfs_urings = urings;
+
+	LogInfo(COMPONENT_FSAL,
+		"io_uring engine enabled, %"PRIu32" rings of %"PRIu32" entries",
+		rings, depth);
+
+	return 0;
+}
+
+/**
+ * @brief Tear down the io_uring engine
+ *
+ * All the I/O must have completed.
+ */
+void vfs_uring_shutdown(void)
+{
+	struct vfs_uring *urings = vfs_urings;
+	struct io_uring_sqe *sqe;
+	uint32_t i;
+
+	if (urings == NULL)
+		return;
+
+	vfs_urings = NULL;
+
+	for (i = 0; i < vfs_uring_count; i++) {
+		/* A NOP with no I/O attached tells the reaper to stop */
+		PTHREAD_MUTEX_lock(&urings[i].sq_mutex);
+		sqe = io_uring_get_sqe(&urings[i].ring);
+		io_uring_prep_nop(sqe);
+		io_uring_sqe_set_data(sqe, NULL);
+		(void) io_uring_submit(&urings[i].ring);
+		PTHREAD_MUTEX_unlock(&urings[i].sq_mutex);
+
+		pthread_join(urings[i].reaper, NULL);
+
+		PTHREAD_MUTEX_destroy(&urings[i].sq_mutex);
+		io_uring_queue_exit(&urings[i].ring);
+	}
+
+	vfs_uring_count = 0;
+	gsh_free(urings);
+}
@@ -0,0 +1,307 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published
+ *   by the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @brief LATENCY methods for handles
+ */
+
+/* LATENCY methods for handles
+ */
+
+#ifndef LATENCY_METHODS_H
+#define LATENCY_METHODS_H
+
+#include "common_utils.h"
+#include "gsh_config.h"
+
+struct latency_fsal_module {
+	struct fsal_module module;
+	struct fsal_obj_ops handle_ops;
+};
+
+extern struct latency_fsal_module LATENCY;
+
+struct latency_fsal_obj_handle;
+
+/**
+ * Structure used to store data for read_dirents callback.
+ *
+ * Before executing the upper level callback (it might be another
+ * stackable fsal or the inode cache), the context has to be restored.
+ */
+struct latency_readdir_state {
+	fsal_readdir_cb cb; /*< Callback to the upper layer. */
+	struct latency_fsal_export *exp; /*< Export of the current latency. */
+	void *dir_state; /*< State to be sent to the next callback. */
+	uint64_t upcall_ns; /*< Time spent in the upper layer's callback. */
+};
+
+extern struct fsal_up_vector fsal_up_top;
+void latency_handle_ops_init(struct fsal_obj_ops *ops);
+
+/**
+ * @brief Methods timed by LATENCY
+ *
+ * Keep latency_op_names in stats.c in step.
+ */
+enum latency_op {
+	LATENCY_LOOKUP,
+	LATENCY_READDIR,
+	LATENCY_MKDIR,
+	LATENCY_MKNODE,
+	LATENCY_SYMLINK,
+	LATENCY_READLINK,
+	LATENCY_GETATTRS,
+	LATENCY_SETATTR2,
+	LATENCY_LINK,
+	LATENCY_RENAME,
+	LATENCY_UNLINK,
+	LATENCY_OPEN2,
+	LATENCY_REOPEN2,
+	LATENCY_READ2,
+	LATENCY_WRITE2,
+	LATENCY_COMMIT2,
+	LATENCY_SEEK2,
+	LATENCY_IO_ADVISE2,
+	LATENCY_LOCK_OP2,
+	LATENCY_CLOSE,
+	LATENCY_CLOSE2,
+	LATENCY_FALLOCATE,
+	LATENCY_COPY_RANGE2,
+	LATENCY_WRITE_SAME2,
+	LATENCY_XATTR,
+	LATENCY_LOOKUP_PATH,
+	LATENCY_CREATE_HANDLE,
+	LATENCY_OP_COUNT
+};
+
+/** Buckets of the latency histograms.  Bucket 0 counts calls that took
+ *  less than 1 microsecond, bucket n > 0 those that took less than 2^n
+ *  microseconds, and the last bucket everything longer.
+ */
+#define LATENCY_BUCKETS 24
+
+/**
+ * @brief Statistics of one method on one export
+ *
+ * All counters are updated with atomics.
+ */
+struct latency_op_stats {
+	uint64_t calls;		/*< Calls completed */
+	uint64_t errors;	/*< Calls that returned an error */
+	uint64_t total;		/*< Total latency, nanoseconds */
+	uint64_t max;		/*< Longest call, nanoseconds */
+	uint64_t hist[LATENCY_BUCKETS];
+};
+
+/*
+ * LATENCY internal export
+ */
+struct latency_fsal_export {
+	struct fsal_export export;
+	struct latency_op_stats stats[LATENCY_OP_COUNT];
+};
+
+void latency_record(struct latency_fsal_export *exp, enum latency_op op,
+		    const struct timespec *start, bool error);
+#ifdef USE_DBUS
+void latency_extract_stats(struct fsal_module *fsal_hdl, void *iter);
+#endif
+void latency_reset_stats(struct fsal_module *fsal_hdl);
+
+/**
+ * @brief Start timing a call to the sub-FSAL
+ *
+ * Nothing is measured unless FSAL stats are enabled, which leaves the
+ * start time zero.
+ */
+static inline void latency_start(struct timespec *start)
+{
+	if (nfs_param.core_param.enable_FSALSTATS) {
+		now(start);
+	} else {
+		start->tv_sec = 0;
+		start->tv_nsec = 0;
+	}
+}
+
+/**
+ * @brief Account for a call to the sub-FSAL that has completed
+ */
+static inline void latency_done(struct latency_fsal_export *exp,
+				enum latency_op op,
+				const struct timespec *start,
+				fsal_status_t status)
+{
+	if (start->tv_sec != 0 || start->tv_nsec != 0)
+		latency_record(exp, op, start, FSAL_IS_ERROR(status));
+}
+
+fsal_status_t latency_lookup_path(struct fsal_export *exp_hdl,
+				 const char *path,
+				 struct fsal_obj_handle **handle,
+				 struct attrlist *attrs_out);
+
+fsal_status_t latency_create_handle(struct fsal_export *exp_hdl,
+				   struct gsh_buffdesc *hdl_desc,
+				   struct fsal_obj_handle **handle,
+				   struct attrlist *attrs_out);
+
+fsal_status_t latency_alloc_and_check_handle(
+		struct latency_fsal_export *export,
+		struct fsal_obj_handle *sub_handle,
+		struct fsal_filesystem *fs,
+		struct fsal_obj_handle **new_handle,
+		fsal_status_t subfsal_status);
+
+/*
+ * LATENCY internal object handle
+ *
+ * It contains a pointer to the fsal_obj_handle used by the subfsal.
+ *
+ * AF_UNIX sockets are strange ducks.  I personally cannot see why they
+ * are here except for the ability of a client to see such an animal with
+ * an 'ls' or get rid of one with an 'rm'.  You can't open them in the
+ * usual file way so open_by_handle_at leads to a deadend.  To work around
+ * this, we save the args that were used to mknod or lookup the socket.
+ */
+
+struct latency_fsal_obj_handle {
+	struct fsal_obj_handle obj_handle; /*< Handle containing latency data.*/
+	struct fsal_obj_handle *sub_handle; /*< Handle of the sub fsal.*/
+	int32_t refcnt;		/*< Reference count.  This is signed to make
+				   mistakes easy to see. */
+};
+
+int latency_fsal_open(struct latency_fsal_obj_handle *, int, fsal_errors_t *);
+int latency_fsal_readlink(struct latency_fsal_obj_handle *, fsal_errors_t *);
+
+static inline bool latency_unopenable_type(object_file_type_t type)
+{
+	if ((type == SOCKET_FILE) || (type == CHARACTER_FILE)
+	    || (type == BLOCK_FILE)) {
+		return true;
+	} else {
+		return false;
+	}
+}
+
+/* I/O management */
+fsal_status_t latency_close(struct fsal_obj_handle *obj_hdl);
+
+/* Multi-FD */
+fsal_status_t latency_open2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags,
+			   enum fsal_create_mode createmode,
+			   const char *name,
+			   struct attrlist *attrs_in,
+			   fsal_verifier_t verifier,
+			   struct fsal_obj_handle **new_obj,
+			   struct attrlist *attrs_out,
+			   bool *caller_perm_check);
+bool latency_check_verifier(struct fsal_obj_handle *obj_hdl,
+			   fsal_verifier_t verifier);
+fsal_openflags_t latency_status2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state);
+fsal_status_t latency_reopen2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     fsal_openflags_t openflags);
+void latency_read2(struct fsal_obj_handle *obj_hdl,
+		  bool bypass,
+		  fsal_async_cb done_cb,
+		  struct fsal_io_arg *read_arg,
+		  void *caller_arg);
+void latency_write2(struct fsal_obj_handle *obj_hdl,
+		   bool bypass,
+		   fsal_async_cb done_cb,
+		   struct fsal_io_arg *write_arg,
+		   void *caller_arg);
+fsal_status_t latency_seek2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   struct io_info *info);
+fsal_status_t latency_io_advise2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				struct io_hints *hints);
+fsal_status_t latency_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			     size_t len);
+fsal_status_t latency_lock_op2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      void *p_owner,
+			      fsal_lock_op_t lock_op,
+			      fsal_lock_param_t *req_lock,
+			      fsal_lock_param_t *conflicting_lock);
+fsal_status_t latency_close2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state);
+fsal_status_t latency_fallocate(struct fsal_obj_handle *obj_hdl,
+			       struct state_t *state, uint64_t offset,
+			       uint64_t length, bool allocate);
+fsal_status_t latency_copy_range2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *dst_state,
+				  uint64_t dst_offset,
+				  struct fsal_obj_handle *src_hdl,
+				  struct state_t *src_state,
+				  uint64_t src_offset,
+				  uint64_t count,
+				  uint32_t flags,
+				  uint64_t *copied);
+fsal_status_t latency_write_same2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *state,
+				  struct fsal_write_same_arg *ws_arg);
+
+/* extended attributes management */
+fsal_status_t latency_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
+				    unsigned int cookie,
+				    fsal_xattrent_t *xattrs_tab,
+				    unsigned int xattrs_tabsize,
+				    unsigned int *p_nb_returned,
+				    int *end_of_list);
+fsal_status_t latency_getextattr_id_by_name(struct fsal_obj_handle *obj_hdl,
+					   const char *xattr_name,
+					   unsigned int *pxattr_id);
+fsal_status_t latency_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
+					      const char *xattr_name,
+					      void *buffer_addr,
+					      size_t buffer_size,
+					      size_t *p_output_size);
+fsal_status_t latency_getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    void *buffer_addr,
+					    size_t buffer_size,
+					    size_t *p_output_size);
+fsal_status_t latency_setextattr_value(struct fsal_obj_handle *obj_hdl,
+				      const char *xattr_name,
+				      void *buffer_addr,
+				      size_t buffer_size,
+				      int create);
+fsal_status_t latency_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    void *buffer_addr,
+					    size_t buffer_size);
+fsal_status_t latency_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
+					  unsigned int xattr_id);
+fsal_status_t latency_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
+					    const char *xattr_name);
+
+#endif			/* LATENCY_METHODS_H */
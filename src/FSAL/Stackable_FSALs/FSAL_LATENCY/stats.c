@@ -0,0 +1,231 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* stats.c
+ * Per export, per method latency statistics of the LATENCY module
+ *
+ * Every method that goes down to the sub-FSAL is timed while FSAL stats
+ * are enabled, so the figures are those of the backend alone.  Comparing
+ * them with the request latencies of server_stats tells how much of a
+ * request was spent above the FSAL.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "FSAL/fsal_commonlib.h"
+#include "latency_methods.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+static inline unsigned int latency_bucket(uint64_t ns)
+{
+	uint64_t usec = ns / NS_PER_USEC;
+	unsigned int b;
+
+	if (usec == 0)
+		return 0;
+
+	b = 64 - __builtin_clzll(usec);
+	return b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1;
+}
+
+/**
+ * @brief Record a completed call to the sub-FSAL
+ *
+ * @param[in] exp    Export the call was made on
+ * @param[in] op     Method called
+ * @param[in] start  Time the call was started
+ * @param[in] error  Whether the call failed
+ */
+void latency_record(struct latency_fsal_export *exp, enum latency_op op,
+		    const struct timespec *start, bool error)
+{
+	struct latency_op_stats *st = &exp->stats[op];
+	struct timespec end;
+	uint64_t ns, max;
+
+	now(&end);
+	ns = timespec_diff(start, &end);
+
+	(void)atomic_inc_uint64_t(&st->calls);
+	if (error)
+		(void)atomic_inc_uint64_t(&st->errors);
+	(void)atomic_add_uint64_t(&st->total, ns);
+	(void)atomic_inc_uint64_t(&st->hist[latency_bucket(ns)]);
+
+	max = atomic_fetch_uint64_t(&st->max);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&st->max, &max, ns, true,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+#ifdef USE_DBUS
+static const char * const latency_op_names[LATENCY_OP_COUNT] = {
+	[LATENCY_LOOKUP] = "lookup",
+	[LATENCY_READDIR] = "readdir",
+	[LATENCY_MKDIR] = "mkdir",
+	[LATENCY_MKNODE] = "mknode",
+	[LATENCY_SYMLINK] = "symlink",
+	[LATENCY_READLINK] = "readlink",
+	[LATENCY_GETATTRS] = "getattrs",
+	[LATENCY_SETATTR2] = "setattr2",
+	[LATENCY_LINK] = "link",
+	[LATENCY_RENAME] = "rename",
+	[LATENCY_UNLINK] = "unlink",
+	[LATENCY_OPEN2] = "open2",
+	[LATENCY_REOPEN2] = "reopen2",
+	[LATENCY_READ2] = "read2",
+	[LATENCY_WRITE2] = "write2",
+	[LATENCY_COMMIT2] = "commit2",
+	[LATENCY_SEEK2] = "seek2",
+	[LATENCY_IO_ADVISE2] = "io_advise2",
+	[LATENCY_LOCK_OP2] = "lock_op2",
+	[LATENCY_CLOSE] = "close",
+	[LATENCY_CLOSE2] = "close2",
+	[LATENCY_FALLOCATE] = "fallocate",
+	[LATENCY_COPY_RANGE2] = "copy_range2",
+	[LATENCY_WRITE_SAME2] = "write_same2",
+	[LATENCY_XATTR] = "xattr",
+	[LATENCY_LOOKUP_PATH] = "lookup_path",
+	[LATENCY_CREATE_HANDLE] = "create_handle",
+};
+
+/**
+ * @brief Append the method statistics of every LATENCY export
+ *
+ * The reply is the FSAL name, an array with a row for each method that
+ * has been called on each export, and a status message.  Times are in
+ * nanoseconds, the histogram is described at LATENCY_BUCKETS.
+ */
+void latency_extract_stats(struct fsal_module *fsal_hdl, void *iter)
+{
+	DBusMessageIter *iter1 = iter;
+	DBusMessageIter array_iter, struct_iter, hist_iter;
+	struct glist_head *glist;
+	struct fsal_export *exp_hdl;
+	struct latency_fsal_export *exp;
+	struct latency_op_stats *st;
+	uint64_t hist[LATENCY_BUCKETS];
+	uint64_t val, *hist_ptr = hist;
+	char *message = "LATENCY";
+	const char *name;
+	unsigned int op, b;
+
+	dbus_message_iter_append_basic(iter1, DBUS_TYPE_STRING, &message);
+	dbus_message_iter_open_container(iter1, DBUS_TYPE_ARRAY,
+					 "(qsttttat)", &array_iter);
+
+	PTHREAD_RWLOCK_rdlock(&fsal_hdl->lock);
+
+	glist_for_each(glist, &fsal_hdl->exports) {
+		exp_hdl = glist_entry(glist, struct fsal_export, exports);
+		exp = container_of(exp_hdl, struct latency_fsal_export,
+				   export);
+
+		for (op = 0; op < LATENCY_OP_COUNT; op++) {
+			st = &exp->stats[op];
+			if (atomic_fetch_uint64_t(&st->calls) == 0)
+				continue;
+
+			dbus_message_iter_open_container(&array_iter,
+							 DBUS_TYPE_STRUCT,
+							 NULL, &struct_iter);
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT16,
+						       &exp_hdl->export_id);
+			name = latency_op_names[op];
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_STRING,
+						       &name);
+			val = atomic_fetch_uint64_t(&st->calls);
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64, &val);
+			val = atomic_fetch_uint64_t(&st->errors);
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64, &val);
+			val = atomic_fetch_uint64_t(&st->total);
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64, &val);
+			val = atomic_fetch_uint64_t(&st->max);
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64, &val);
+
+			for (b = 0; b < LATENCY_BUCKETS; b++)
+				hist[b] = atomic_fetch_uint64_t(&st->hist[b]);
+			dbus_message_iter_open_container(&struct_iter,
+							 DBUS_TYPE_ARRAY, "t",
+							 &hist_iter);
+			dbus_message_iter_append_fixed_array(&hist_iter,
+							     DBUS_TYPE_UINT64,
+							     &hist_ptr,
+							     LATENCY_BUCKETS);
+			dbus_message_iter_close_container(&struct_iter,
+							  &hist_iter);
+
+			dbus_message_iter_close_container(&array_iter,
+							  &struct_iter);
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&fsal_hdl->lock);
+
+	dbus_message_iter_close_container(iter1, &array_iter);
+
+	message = "OK";
+	dbus_message_iter_append_basic(iter1, DBUS_TYPE_STRING, &message);
+}
+#endif
+
+/**
+ * @brief Reset the method statistics of every LATENCY export
+ */
+void latency_reset_stats(struct fsal_module *fsal_hdl)
+{
+	struct glist_head *glist;
+	struct latency_fsal_export *exp;
+	struct latency_op_stats *st;
+	unsigned int op, b;
+
+	PTHREAD_RWLOCK_rdlock(&fsal_hdl->lock);
+
+	glist_for_each(glist, &fsal_hdl->exports) {
+		exp = container_of(glist_entry(glist, struct fsal_export,
+					       exports),
+				   struct latency_fsal_export, export);
+
+		for (op = 0; op < LATENCY_OP_COUNT; op++) {
+			st = &exp->stats[op];
+			atomic_store_uint64_t(&st->calls, 0);
+			atomic_store_uint64_t(&st->errors, 0);
+			atomic_store_uint64_t(&st->total, 0);
+			atomic_store_uint64_t(&st->max, 0);
+			for (b = 0; b < LATENCY_BUCKETS; b++)
+				atomic_store_uint64_t(&st->hist[b], 0);
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&fsal_hdl->lock);
+}
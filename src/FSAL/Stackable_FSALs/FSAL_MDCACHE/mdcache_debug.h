@@ -55,5 +55,7 @@ struct fsal_obj_handle *mdcdb_get_sub_handle(struct fsal_obj_handle *obj_hdl)
 }
 
 void lru_cleanup_entries(void);
+uint64_t lru_set_entries_hiwat(uint64_t hiwat);
+uint64_t lru_budget_cut(uint64_t bytes, uint64_t *usage);
 
 #endif /* MDCACHE_DEBUG_H */
@@ -209,6 +209,7 @@ static void mdcache_exp_release(struct fsal_export *exp_hdl)
 	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
 	free_export_ops(exp_hdl);
 
+	mdc_quota_destroy(exp);
 	gsh_free(exp->name);
 
 	gsh_free(exp);	/* elvis has left the building */
@@ -481,11 +482,12 @@ static int32_t mdcache_fs_expiretimeparent(struct fsal_export *exp_hdl)
 /**
  * @brief Check quota on a file
  *
- * MDCACHE only caches metadata, so it imposes no restrictions itself.
+ * With Quota_Expiration set, the caller's cached quotas are checked
+ * before the sub-FSAL is asked.
  *
  * @param[in] exp_hdl	Export to query
  * @param[in] filepath	Path to file to query
- * @param[in] quota_type	Type of quota (user or group)
+ * @param[in] quota_type	Type of quota (blocks or inodes)
  * @return FSAL status
  */
 static fsal_status_t mdcache_check_quota(struct fsal_export *exp_hdl,
@@ -495,6 +497,12 @@ static fsal_status_t mdcache_check_quota(struct fsal_export *exp_hdl,
 	struct fsal_export *sub_export = exp->mfe_exp.sub_export;
 	fsal_status_t status;
 
+	if (mdc_quota_enabled(exp)) {
+		status = mdc_quota_check(exp, filepath, quota_type);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
 	subcall_raw(exp,
 		status = sub_export->exp_ops.check_quota(sub_export, filepath,
 							 quota_type)
@@ -506,7 +514,7 @@ static fsal_status_t mdcache_check_quota(struct fsal_export *exp_hdl,
 /**
  * @brief Get quota information for a file
  *
- * MDCACHE only caches metadata, so it imposes no restrictions itself.
+ * With Quota_Expiration set, this is answered from the quota cache.
  *
  * @param[in] exp_hdl	Export to query
  * @param[in] filepath	Path to file to query
@@ -524,6 +532,10 @@ static fsal_status_t mdcache_get_quota(struct fsal_export *exp_hdl,
 	struct fsal_export *sub_export = exp->mfe_exp.sub_export;
 	fsal_status_t status;
 
+	if (mdc_quota_enabled(exp))
+		return mdc_quota_get(exp, filepath, quota_type, quota_id,
+				     pquota);
+
 	subcall_raw(exp,
 		status = sub_export->exp_ops.get_quota(sub_export, filepath,
 						       quota_type, quota_id,
@@ -535,7 +547,7 @@ static fsal_status_t mdcache_get_quota(struct fsal_export *exp_hdl,
 /**
  * @brief Set a quota for a file
  *
- * MDCACHE only caches metadata, so it imposes no restrictions itself.
+ * The cached quota is fetched again on its next use.
  *
  * @param[in] exp_hdl	Export to query
  * @param[in] filepath	Path to file to query
@@ -560,6 +572,9 @@ static fsal_status_t mdcache_set_quota(struct fsal_export *exp_hdl,
 			filepath, quota_type, quota_id, pquota, presquota)
 	       );
 
+	if (!FSAL_IS_ERROR(status) && mdc_quota_enabled(exp))
+		mdc_quota_forget(exp, quota_type, quota_id);
+
 	return status;
 }
 
@@ -49,6 +49,10 @@ struct mdcache_parameter {
 	/** Per-partition hash table size.  Defaults to 32633,
 	 * settable with Cache_Size. */
 	uint32_t cache_size;
+	/** Look up handles in a lockless index before taking the
+	    partition lock.  Defaults to false, settable with
+	    Handle_Index. */
+	bool handle_index;
 	/** Use getattr for directory invalidation.  Defaults to
 	    false.  Settable with Use_Getattr_Directory_Invalidation. */
 	bool getattr_dir_invalidation;
@@ -69,6 +73,9 @@ struct mdcache_parameter {
 	/** High water mark for cache entries.  Defaults to 100000,
 	    settable by Entries_HWMark. */
 	uint32_t entries_hwmark;
+	/** Fewest entries the memory budget may shrink the cache to.
+	    Defaults to 10000, settable by Entries_Budget_Floor. */
+	uint32_t entries_budget_floor;
 	/** High water mark for chunks.  Defaults to 100000,
 	    settable by Chunks_HWMark. */
 	uint32_t chunks_hwmark;
@@ -120,6 +127,10 @@ struct mdcache_parameter {
 	/** High water mark for dirent mapping entries.  Defaults to 10000,
 	    settable by Dirmap_HWMark. */
 	uint32_t dirmap_hwmark;
+	/** Seconds a quota fetched from the sub-FSAL is used before it
+	    is fetched again, 0 to pass quota calls through.  Defaults
+	    to 0, settable by Quota_Expiration. */
+	uint32_t quota_expiration;
 };
 
 extern struct mdcache_parameter mdcache_param;
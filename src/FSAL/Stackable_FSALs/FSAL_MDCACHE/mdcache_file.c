@@ -32,6 +32,7 @@
 #include "fsal_convert.h"
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/param.h>
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_int.h"
 #include "mdcache_lru.h"
@@ -47,6 +48,13 @@ struct mdc_async_arg {
 	struct fsal_obj_handle *obj_hdl;	/**< MDCACHE's handle */
 	fsal_async_cb cb;			/**< Wrapped callback */
 	void *cb_arg;				/**< Wrapped callback data */
+	struct attrlist *attrs_out;		/**< Caller's write attributes */
+	struct attrlist attrs;			/**< Write attributes from the
+						     sub-FSAL */
+	struct mdcache_fsal_export *export;	/**< Export charged for quota */
+	uint64_t quota_bytes;			/**< Bytes charged to quota */
+	uid_t quota_uid;			/**< User charged */
+	gid_t quota_gid;			/**< Group charged */
 };
 
 /**
@@ -438,6 +446,9 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 
 	fsal_release_attrs(&attrs);
 
+	if (FSAL_IS_SUCCESS(status) && createmode != FSAL_NO_CREATE)
+		mdc_quota_charge_file(export);
+
 	if (FSAL_IS_SUCCESS(status) && createmode != FSAL_NO_CREATE &&
 	    !invalidate) {
 		/* Refresh destination directory attributes without
@@ -620,9 +631,16 @@ static void mdc_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 			void *obj_data, void *caller_data)
 {
 	struct mdc_async_arg *arg = caller_data;
+	struct fsal_io_arg *write_arg = obj_data;
 	mdcache_entry_t *entry =
 		container_of(arg->obj_hdl, mdcache_entry_t, obj_handle);
 
+	write_arg->attrs_out = arg->attrs_out;
+
+	if (FSAL_IS_ERROR(ret) && arg->quota_bytes != 0)
+		mdc_quota_charge(arg->export, arg->quota_uid, arg->quota_gid,
+				 -(int64_t) arg->quota_bytes, 0);
+
 	if (ret.major == ERR_FSAL_STALE) {
 		/*
 		 * killing the entry might drop the sentinel ref. Take an
@@ -630,11 +648,52 @@ static void mdc_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 		 */
 		mdcache_get(entry);
 		mdcache_kill_entry(entry);
-	}
-	else
+	} else if (!FSAL_IS_ERROR(ret) && arg->attrs.valid_mask != 0 &&
+		   !(arg->attrs.valid_mask & ATTR_RDATTR_ERR)) {
+		/* write2() gave us attributes.  Hand them to the caller and
+		 * refresh the cache with them, so the next getattrs does
+		 * not have to go down to the sub-FSAL.
+		 */
+		if (arg->attrs_out != NULL)
+			fsal_copy_attrs(arg->attrs_out, &arg->attrs, false);
+
+		PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+		/* Concurrent writes may complete out of order.  Don't let
+		 * the attributes of an older write replace newer ones; a
+		 * file only shrinks through setattr2, which refreshes the
+		 * cache itself.
+		 */
+		if (!test_mde_flags(entry, MDCACHE_TRUST_ATTRS) ||
+		    gsh_time_cmp(&arg->attrs.ctime, &entry->attrs.ctime) > 0 ||
+		    (gsh_time_cmp(&arg->attrs.ctime,
+				  &entry->attrs.ctime) == 0 &&
+		     arg->attrs.filesize >= entry->attrs.filesize)) {
+			mdc_update_attr_cache(entry, &arg->attrs);
+			(void)atomic_inc_uint64_t(&cache_stp->getattrs_saved);
+		} else {
+			atomic_clear_uint32_t_bits(&entry->mde_flags,
+						   MDCACHE_TRUST_ATTRS);
+		}
+
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	} else {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
 
+		if (!FSAL_IS_ERROR(ret) && arg->quota_bytes != 0) {
+			/* Keep the size later writes are charged against */
+			uint64_t end = write_arg->offset + write_arg->io_amount;
+
+			PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+			if (end > entry->attrs.filesize)
+				entry->attrs.filesize = end;
+			PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+		}
+	}
+
+	fsal_release_attrs(&arg->attrs);
+
 	supercall(
 		  arg->cb(arg->obj_hdl, ret, obj_data, arg->cb_arg);
 		 );
@@ -644,6 +703,44 @@ static void mdc_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 	gsh_free(arg);
 }
 
+/**
+ * @brief Charge a write to the quotas of the file's owner
+ *
+ * A write consumes space only where it extends the file.  As other writes
+ * may be extending it too, no more than the length of this write is
+ * charged.  The charge is made before the write is done, so that quota
+ * checks see writes in progress.
+ *
+ * @param[in] entry	File being written
+ * @param[in] write_arg	Write to charge
+ * @param[in] arg	Callback argument, to record the charge in
+ */
+static void mdc_write_charge(mdcache_entry_t *entry,
+			     struct fsal_io_arg *write_arg,
+			     struct mdc_async_arg *arg)
+{
+	uint64_t len = 0, end, size;
+	int i;
+
+	for (i = 0; i < write_arg->iov_count; i++)
+		len += write_arg->iov[i].iov_len;
+
+	end = write_arg->offset + len;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+	size = entry->attrs.filesize;
+	arg->quota_uid = entry->attrs.owner;
+	arg->quota_gid = entry->attrs.group;
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (end <= size)
+		return;
+
+	arg->quota_bytes = MIN(len, end - size);
+	mdc_quota_charge(arg->export, arg->quota_uid, arg->quota_gid,
+			 arg->quota_bytes, 0);
+}
+
 /**
  * @brief Write to a file (new style)
  *
@@ -670,6 +767,21 @@ void mdcache_write2(struct fsal_obj_handle *obj_hdl,
 	arg->obj_hdl = obj_hdl;
 	arg->cb = done_cb;
 	arg->cb_arg = caller_arg;
+	arg->export = mdc_cur_export();
+
+	if (mdc_quota_enabled(arg->export))
+		mdc_write_charge(entry, write_arg, arg);
+
+	/* Always ask the sub-FSAL for the attributes after the write.  If
+	 * it can get them cheaply they save a getattrs on the next request
+	 * for this file, if not we are no worse off.
+	 */
+	arg->attrs_out = write_arg->attrs_out;
+	fsal_prepare_attrs(&arg->attrs,
+			   op_ctx->fsal_export->exp_ops.fs_supported_attrs(
+				op_ctx->fsal_export) & ~(ATTR_ACL |
+							 ATTR4_FS_LOCATIONS));
+	write_arg->attrs_out = &arg->attrs;
 
 	subcall(
 		entry->sub_handle->obj_ops->write2(entry->sub_handle, bypass,
@@ -878,3 +990,60 @@ fsal_status_t mdcache_fallocate(struct fsal_obj_handle *obj_hdl,
 
 	return status;
 }
+
+fsal_status_t mdcache_copy_range2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *dst_state,
+				  uint64_t dst_offset,
+				  struct fsal_obj_handle *src_hdl,
+				  struct state_t *src_state,
+				  uint64_t src_offset,
+				  uint64_t count,
+				  uint32_t flags,
+				  uint64_t *copied)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	subcall(
+		status = entry->sub_handle->obj_ops->copy_range2(
+							entry->sub_handle,
+							dst_state, dst_offset,
+							src->sub_handle,
+							src_state, src_offset,
+							count, flags, copied);
+	       );
+
+	if (status.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(entry);
+	else
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	return status;
+}
+
+fsal_status_t mdcache_write_same2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *state,
+				  struct fsal_write_same_arg *ws_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	subcall(
+		status = entry->sub_handle->obj_ops->write_same2(
+							entry->sub_handle,
+							state, ws_arg);
+	       );
+
+	if (status.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(entry);
+	else
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	return status;
+}
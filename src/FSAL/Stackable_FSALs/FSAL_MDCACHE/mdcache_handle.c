@@ -252,6 +252,9 @@ static fsal_status_t mdcache_mkdir(struct fsal_obj_handle *dir_hdl,
 
 	fsal_release_attrs(&attrs);
 
+	if (FSAL_IS_SUCCESS(status))
+		mdc_quota_charge_file(export);
+
 	if (FSAL_IS_SUCCESS(status) && !invalidate) {
 		/* Refresh destination directory attributes without
 		 * invalidating dirents.
@@ -332,6 +335,9 @@ static fsal_status_t mdcache_mknode(struct fsal_obj_handle *dir_hdl,
 
 	fsal_release_attrs(&attrs);
 
+	if (FSAL_IS_SUCCESS(status))
+		mdc_quota_charge_file(export);
+
 	if (FSAL_IS_SUCCESS(status) && !invalidate) {
 		/* Refresh destination directory attributes without
 		 * invalidating dirents.
@@ -412,6 +418,9 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 
 	fsal_release_attrs(&attrs);
 
+	if (FSAL_IS_SUCCESS(status))
+		mdc_quota_charge_file(export);
+
 	if (FSAL_IS_SUCCESS(status) && !invalidate) {
 		/* Refresh destination directory attributes without
 		 * invalidating dirents.
@@ -563,6 +572,101 @@ static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
 	}
 }
 
+/**
+ * @brief Hash the alternate groups of a credential
+ */
+static inline uint64_t mdc_access_groups(const struct user_cred *creds)
+{
+	if (creds->caller_glen == 0)
+		return 0;
+
+	return CityHash64WithSeed((const char *)creds->caller_garray,
+				  creds->caller_glen * sizeof(gid_t),
+				  creds->caller_glen);
+}
+
+/**
+ * @brief Find a remembered access decision
+ *
+ * @note The caller must hold the attr_lock for read.
+ *
+ * @param[in] entry       Entry to look in
+ * @param[in] access_type Access requested
+ * @param[in] groups      Hash of the caller's alternate groups
+ *
+ * @return The decision, or NULL if none applies.
+ */
+static struct mdcache_access *mdc_access_find(mdcache_entry_t *entry,
+					      fsal_accessflags_t access_type,
+					      uint64_t groups)
+{
+	const struct user_cred *creds = op_ctx->creds;
+	struct mdcache_access *acc;
+	int i;
+
+	for (i = 0; i < MDCACHE_ACCESS_SLOTS; i++) {
+		acc = &entry->acc[i];
+
+		if (acc->gen == entry->attr_gen &&
+		    acc->access_type == access_type &&
+		    acc->uid == creds->caller_uid &&
+		    acc->gid == creds->caller_gid &&
+		    acc->glen == creds->caller_glen &&
+		    acc->groups == groups &&
+		    acc->export_id == op_ctx->ctx_export->export_id)
+			return acc;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Remember an access decision
+ *
+ * The decision is dropped if the attributes were refreshed since @a gen
+ * was read, since it may have been made against other attributes.
+ *
+ * @param[in] entry       Entry the decision is for
+ * @param[in] gen         attr_gen before the check was made
+ * @param[in] access_type Access requested
+ * @param[in] groups      Hash of the caller's alternate groups
+ * @param[in] major       Result of the check
+ * @param[in] allowed     Access that could be granted
+ * @param[in] denied      Access that would be denied
+ */
+static void mdc_access_store(mdcache_entry_t *entry, uint32_t gen,
+			     fsal_accessflags_t access_type, uint64_t groups,
+			     fsal_errors_t major, fsal_accessflags_t allowed,
+			     fsal_accessflags_t denied)
+{
+	const struct user_cred *creds = op_ctx->creds;
+	struct mdcache_access *acc;
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	if (gen != entry->attr_gen ||
+	    mdc_access_find(entry, access_type, groups) != NULL) {
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+		return;
+	}
+
+	acc = &entry->acc[entry->acc_next];
+	entry->acc_next = (entry->acc_next + 1) % MDCACHE_ACCESS_SLOTS;
+
+	acc->uid = creds->caller_uid;
+	acc->gid = creds->caller_gid;
+	acc->export_id = op_ctx->ctx_export->export_id;
+	acc->glen = creds->caller_glen;
+	acc->groups = groups;
+	acc->gen = gen;
+	acc->access_type = access_type;
+	acc->allowed = allowed;
+	acc->denied = denied;
+	acc->major = major;
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+}
+
 /**
  * @brief Check access for a given user against a given object
  *
@@ -572,6 +676,11 @@ static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
  * FSALs call the default method.  This should be revisited if a FSAL wants to
  * override test_access().
  *
+ * The last few decisions are remembered in the entry, keyed by the caller's
+ * credentials and the export, and are answered from there until the
+ * attributes are refreshed.  Only grants and EACCES are remembered; any other
+ * error is retried.
+ *
  * @note If @a owner_skip is provided, we test against the cached owner.  This
  * is because doing a getattrs() potentially on each read and write (writes
  * invalidate cached attributes) is a huge performance hit.  Eventually, finer
@@ -593,12 +702,58 @@ static fsal_status_t mdcache_test_access(struct fsal_obj_handle *obj_hdl,
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct fsal_export *export = op_ctx->fsal_export;
+	fsal_accessflags_t acc_allowed = 0, acc_denied = 0;
+	struct mdcache_access *acc;
+	fsal_status_t status;
+	attrmask_t mask;
+	uint64_t groups;
+	uint32_t gen;
 
 	if (owner_skip && entry->attrs.owner == op_ctx->creds->caller_uid)
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 
-	return fsal_test_access(obj_hdl, access_type, allowed, denied,
-				owner_skip);
+	mask = export->exp_ops.fs_supported_attrs(export) &
+	       (ATTRS_CREDS | ATTR_MODE | ATTR_ACL);
+	groups = mdc_access_groups(op_ctx->creds);
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+
+	if (mdcache_is_attrs_valid(entry, mask)) {
+		acc = mdc_access_find(entry, access_type, groups);
+		if (acc != NULL) {
+			status = fsalstat(acc->major, 0);
+			if (allowed != NULL)
+				*allowed = acc->allowed;
+			if (denied != NULL)
+				*denied = acc->denied;
+
+			PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+			(void)atomic_inc_uint64_t(&cache_stp->access_hit);
+			return status;
+		}
+	}
+
+	gen = entry->attr_gen;
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	(void)atomic_inc_uint64_t(&cache_stp->access_miss);
+
+	status = fsal_test_access(obj_hdl, access_type, &acc_allowed,
+				  &acc_denied, owner_skip);
+
+	if (allowed != NULL)
+		*allowed = acc_allowed;
+	if (denied != NULL)
+		*denied = acc_denied;
+
+	if (access_type != 0 && (status.major == ERR_FSAL_NO_ERROR ||
+				 status.major == ERR_FSAL_ACCESS))
+		mdc_access_store(entry, gen, access_type, groups,
+				 status.major, acc_allowed, acc_denied);
+
+	return status;
 }
 
 /**
@@ -1460,6 +1615,8 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->setattr2 = mdcache_setattr2;
 	ops->close2 = mdcache_close2;
 	ops->fallocate = mdcache_fallocate;
+	ops->copy_range2 = mdcache_copy_range2;
+	ops->write_same2 = mdcache_write_same2;
 
 	/* xattr related functions */
 	ops->list_ext_attrs = mdcache_list_ext_attrs;
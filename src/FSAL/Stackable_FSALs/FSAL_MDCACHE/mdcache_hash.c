@@ -63,6 +63,121 @@
 struct cih_lookup_table cih_fhcache;
 static bool initialized;
 
+/**
+ * @brief Take the writer side of a handle index bucket
+ */
+static inline void cih_idx_lock(struct cih_idx_bucket *b)
+{
+	uint32_t seq;
+
+	for (;;) {
+		seq = atomic_fetch_uint32_t(&b->seq);
+		if (!(seq & 1) &&
+		    __atomic_compare_exchange_n(&b->seq, &seq, seq + 1, true,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			return;
+	}
+}
+
+static inline void cih_idx_unlock(struct cih_idx_bucket *b)
+{
+	(void) atomic_inc_uint32_t(&b->seq);
+}
+
+/**
+ * @brief Add an entry to the handle index
+ *
+ * Called with the entry's partition write locked, once it is in the
+ * AVL tree, so no other entry with its key can be indexed.
+ *
+ * @param[in] entry The entry, hashed
+ */
+void cih_idx_insert(mdcache_entry_t *entry)
+{
+	uint64_t hk = entry->fh_hk.key.hk;
+	uint64_t tag = cih_idx_tag(hk);
+	struct cih_idx_bucket *b;
+	uint64_t tags;
+	uint32_t probe, ix;
+
+	for (probe = 0; probe <= CIH_IDX_PROBE; probe++) {
+		b = cih_idx_bucket(hk, probe);
+		cih_idx_lock(b);
+
+		tags = b->tags;
+		for (ix = 0; ix < CIH_IDX_SLOTS; ix++)
+			if (((tags >> (ix * 8)) & 0xff) == 0)
+				break;
+
+		if (ix < CIH_IDX_SLOTS) {
+			atomic_store_voidptr((void **)&b->slot[ix], entry);
+			atomic_store_uint64_t(&b->tags,
+					      tags | (tag << (ix * 8)));
+			cih_idx_unlock(b);
+			break;
+		}
+
+		cih_idx_unlock(b);
+	}
+
+	if (probe > CIH_IDX_PROBE) {
+		LogFullDebug(COMPONENT_HASHTABLE_CACHE,
+			     "no room to index entry %p", entry);
+		return;
+	}
+
+	/* Readers of the buckets passed over must probe further */
+	for (ix = 0; ix < probe; ix++) {
+		b = cih_idx_bucket(hk, ix);
+		cih_idx_lock(b);
+		atomic_store_uint32_t(&b->overflow, b->overflow + 1);
+		cih_idx_unlock(b);
+	}
+
+	entry->fh_hk.inidx = true;
+	entry->fh_hk.idx_probe = probe;
+}
+
+/**
+ * @brief Remove an entry from the handle index
+ *
+ * Called with the entry's partition write locked, before the sentinel
+ * reference is released.
+ *
+ * @param[in] entry The entry
+ */
+void cih_idx_remove(mdcache_entry_t *entry)
+{
+	uint64_t hk = entry->fh_hk.key.hk;
+	struct cih_idx_bucket *b;
+	uint32_t ix;
+
+	if (!entry->fh_hk.inidx)
+		return;
+
+	b = cih_idx_bucket(hk, entry->fh_hk.idx_probe);
+	cih_idx_lock(b);
+	for (ix = 0; ix < CIH_IDX_SLOTS; ix++) {
+		if (b->slot[ix] == entry) {
+			atomic_store_uint64_t(&b->tags, b->tags &
+					      ~(0xffULL << (ix * 8)));
+			atomic_store_voidptr((void **)&b->slot[ix], NULL);
+			break;
+		}
+	}
+	cih_idx_unlock(b);
+
+	for (ix = 0; ix < entry->fh_hk.idx_probe; ix++) {
+		b = cih_idx_bucket(hk, ix);
+		cih_idx_lock(b);
+		atomic_store_uint32_t(&b->overflow, b->overflow - 1);
+		cih_idx_unlock(b);
+	}
+
+	entry->fh_hk.inidx = false;
+}
+
 /**
  * @brief Initialize the package.
  */
@@ -86,6 +201,24 @@ cih_pkginit(void)
 	cih_fhcache.partition =
 		gsh_calloc(cih_fhcache.npart, sizeof(cih_partition_t));
 	cih_fhcache.cache_sz = mdcache_param.cache_size;
+
+	if (mdcache_param.handle_index) {
+		/* Room for the high water mark at three quarters full */
+		uint64_t nbuckets = 64;
+
+		while (nbuckets * CIH_IDX_SLOTS * 3 / 4 <
+		       mdcache_param.entries_hwmark)
+			nbuckets <<= 1;
+
+		cih_fhcache.index =
+			gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+					   nbuckets *
+					   sizeof(struct cih_idx_bucket));
+		memset(cih_fhcache.index, 0,
+		       nbuckets * sizeof(struct cih_idx_bucket));
+		cih_fhcache.index_mask = nbuckets - 1;
+	}
+
 	for (ix = 0; ix < cih_fhcache.npart; ++ix) {
 		cp = &cih_fhcache.partition[ix];
 		cp->part_ix = ix;
@@ -118,6 +251,8 @@ cih_pkgdestroy(void)
 	/* Destroy the partition table */
 	gsh_free(cih_fhcache.partition);
 	cih_fhcache.partition = NULL;
+	gsh_free(cih_fhcache.index);
+	cih_fhcache.index = NULL;
 	initialized = false;
 }
 
@@ -76,6 +76,38 @@ typedef struct cih_partition {
 	GSH_CACHE_PAD(0);
 } cih_partition_t;
 
+/** Slots in a handle index bucket, which fills a 64 byte line */
+#define CIH_IDX_SLOTS 6
+/** Buckets past its home bucket an entry may be stored in */
+#define CIH_IDX_PROBE 4
+
+/**
+ * @brief A bucket of the handle index
+ *
+ * With Handle_Index set, hashed entries are also kept in an open
+ * addressing table of these, so that a lookup by handle finds its
+ * entry without the partition lock.  Each slot has a tag byte taken
+ * from the hash, and the tags of a bucket are matched all at once, so
+ * a lookup reads the bucket and the entries whose tag matched.
+ *
+ * Writers serialize on a bucket by making its sequence number odd.
+ * Readers take no lock: they read the bucket between two reads of the
+ * sequence number and retry if it moved.  Entries are only ever freed
+ * to mdcache_entry_pool, so a stale slot still points at an entry.  That
+ * depends on the pool keeping its slabs mapped: pools normally return
+ * empty slabs to the system, so mdcache_pkginit marks the entry pool
+ * type stable (pool_set_type_stable) whenever the index is enabled.
+ *
+ * An entry that finds no free slot within CIH_IDX_PROBE buckets of its
+ * home is not indexed; lookups for it fall back to the partition.
+ */
+struct cih_idx_bucket {
+	uint32_t seq;		/*< Odd while a writer changes the bucket */
+	uint32_t overflow;	/*< Entries homed here, stored further on */
+	uint64_t tags;		/*< A tag byte per slot, 0 if free */
+	mdcache_entry_t *slot[CIH_IDX_SLOTS];
+} __attribute__ ((aligned(GSH_CACHE_LINE_SIZE)));
+
 /**
  * @brief The weakref table structure
  *
@@ -86,6 +118,8 @@ struct cih_lookup_table {
 	cih_partition_t *partition;
 	uint32_t npart;
 	uint32_t cache_sz;
+	struct cih_idx_bucket *index;	/*< Handle index, or NULL */
+	uint64_t index_mask;		/*< Buckets in the index, less one */
 };
 
 /* Support inline lookups */
@@ -101,6 +135,9 @@ void cih_pkginit(void);
  */
 void cih_pkgdestroy(void);
 
+void cih_idx_insert(mdcache_entry_t *entry);
+void cih_idx_remove(mdcache_entry_t *entry);
+
 /**
  * @brief Find the correct partition for a pointer
  *
@@ -217,6 +254,116 @@ cih_hash_key(mdcache_key_t *key,
 	return true;
 }
 
+/**
+ * @brief Tag of a hash in the handle index, never 0
+ */
+static inline uint8_t cih_idx_tag(uint64_t hk)
+{
+	return (hk >> 56) | 0x80;
+}
+
+/**
+ * @brief Bucket of the handle index @a probe buckets past the home of @a hk
+ */
+static inline struct cih_idx_bucket *cih_idx_bucket(uint64_t hk,
+						    uint32_t probe)
+{
+	return &cih_fhcache.index[(hk + probe) & cih_fhcache.index_mask];
+}
+
+/**
+ * @brief Find the slots of a bucket holding a tag
+ *
+ * The eight tag bytes are compared in one go.  The high bit of each
+ * matching byte is set in the result.  A borrow can also flag the byte
+ * after a match, so callers must check the hash of what they find.
+ *
+ * @param[in] tags The tags of a bucket
+ * @param[in] tag  The tag looked for
+ *
+ * @return A mask of candidate slots.
+ */
+static inline uint64_t cih_idx_match(uint64_t tags, uint8_t tag)
+{
+	uint64_t x = tags ^ (0x0101010101010101ULL * tag);
+
+	return (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+}
+
+/**
+ * @brief Look up and reference an entry through the handle index
+ *
+ * No lock is taken.  A candidate is referenced, then kept only if its
+ * bucket did not change in the meantime, which proves the entry was
+ * still hashed, and so alive and with a stable key, when the reference
+ * was taken.
+ *
+ * @param[in] key Key being searched
+ *
+ * @return The entry, with a reference not yet accounted in the LRU, or
+ *         NULL if it was not found in the index.
+ */
+static inline mdcache_entry_t *cih_idx_get(mdcache_key_t *key)
+{
+	struct cih_idx_bucket *b;
+	mdcache_entry_t *entry, *cand;
+	uint8_t tag = cih_idx_tag(key->hk);
+	uint32_t seq, overflow, probe;
+	uint64_t match;
+
+	for (probe = 0; probe <= CIH_IDX_PROBE; probe++) {
+		b = cih_idx_bucket(key->hk, probe);
+ again:
+		seq = atomic_fetch_uint32_t(&b->seq);
+		if (unlikely(seq & 1))
+			goto again;
+
+		entry = NULL;
+		match = cih_idx_match(atomic_fetch_uint64_t(&b->tags), tag);
+		while (match != 0) {
+			cand = atomic_fetch_voidptr(
+				(void **)&b->slot[__builtin_ctzll(match) / 8]);
+			if (cand != NULL &&
+			    atomic_fetch_uint64_t(&cand->fh_hk.key.hk) ==
+			    key->hk) {
+				entry = cand;
+				break;
+			}
+			match &= match - 1;
+		}
+		overflow = atomic_fetch_uint32_t(&b->overflow);
+
+		if (atomic_fetch_uint32_t(&b->seq) != seq)
+			goto again;
+
+		if (entry != NULL) {
+			/* Being freed, the partition will not have it */
+			if (!mdcache_lru_ref_live(entry))
+				return NULL;
+
+			if (atomic_fetch_uint32_t(&b->seq) != seq) {
+				mdcache_lru_unref(entry);
+				goto again;
+			}
+
+			if (likely(mdcache_key_cmp(&entry->fh_hk.key,
+						   key) == 0))
+				return entry;
+
+			/* Same hash, another handle: let the partition
+			 * sort it out.
+			 */
+			mdcache_lru_unref(entry);
+			return NULL;
+		}
+
+		if (overflow == 0)
+			break;
+	}
+
+	return NULL;
+}
+
 #define CIH_GET_NONE           0x0000
 #define CIH_GET_RLOCK          0x0001
 #define CIH_GET_WLOCK          0x0002
@@ -370,7 +517,9 @@ cih_set_latched(mdcache_entry_t *entry, cih_latch_t *latch,
 				  fh_desc, CIH_HASH_NONE))
 			return 1;
 
-	(void)avltree_insert(&entry->fh_hk.node_k, &cp->t);
+	if (avltree_insert(&entry->fh_hk.node_k, &cp->t) == NULL &&
+	    cih_fhcache.index != NULL)
+		cih_idx_insert(entry);
 	entry->fh_hk.inavl = true;
 #ifdef USE_LTTNG
 	tracepoint(mdcache, mdc_lru_insert, __func__, __LINE__,
@@ -412,6 +561,7 @@ cih_remove_checked(mdcache_entry_t *entry)
 		avltree_remove(node, &cp->t);
 		cp->cache[cih_cache_offsetof(&cih_fhcache,
 					     entry->fh_hk.key.hk)] = NULL;
+		cih_idx_remove(entry);
 		entry->fh_hk.inavl = false;
 		/* return sentinel ref */
 		unref = true;
@@ -456,6 +606,7 @@ cih_remove_latched(mdcache_entry_t *entry, cih_latch_t *latch, uint32_t flags)
 		avltree_remove(&entry->fh_hk.node_k, &cp->t);
 		cp->cache[cih_cache_offsetof(&cih_fhcache,
 					     entry->fh_hk.key.hk)] = NULL;
+		cih_idx_remove(entry);
 		entry->fh_hk.inavl = false;
 		mdcache_lru_unref(entry);
 		if (flags & CIH_REMOVE_UNLOCK)
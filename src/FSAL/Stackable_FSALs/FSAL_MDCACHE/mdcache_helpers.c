@@ -982,6 +982,7 @@ mdcache_find_keyed_reason(mdcache_key_t *key, mdcache_entry_t **entry,
 			  mdc_reason_t reason)
 {
 	cih_latch_t latch;
+	fsal_status_t status;
 
 	if (key->kv.addr == NULL) {
 		LogDebug(COMPONENT_CACHE_INODE,
@@ -999,12 +1000,27 @@ mdcache_find_keyed_reason(mdcache_key_t *key, mdcache_entry_t **entry,
 			     "Looking for %s", str);
 	}
 
+	if (cih_fhcache.index != NULL) {
+		*entry = cih_idx_get(key);
+		if (likely(*entry)) {
+			/* Move the entry in the LRU as an initial ref
+			 * would, then drop the extra ref.  The index
+			 * ref keeps the count from reaching zero.
+			 */
+			if (reason != MDC_REASON_SCAN) {
+				(void) mdcache_lru_ref(*entry,
+						       LRU_REQ_INITIAL);
+				(void) atomic_dec_int32_t(
+						&(*entry)->lru.refcnt);
+			}
+			goto check_mapping;
+		}
+	}
+
 	*entry = cih_get_by_key_latch(key, &latch,
 					CIH_GET_RLOCK | CIH_GET_UNLOCK_ON_MISS,
 					__func__, __LINE__);
 	if (likely(*entry)) {
-		fsal_status_t status;
-
 		/* Initial Ref on entry */
 		status = mdcache_lru_ref(*entry, (reason != MDC_REASON_SCAN) ?
 					 LRU_REQ_INITIAL : LRU_FLAG_NONE);
@@ -1020,6 +1036,7 @@ mdcache_find_keyed_reason(mdcache_key_t *key, mdcache_entry_t **entry,
 			return status;
 		}
 
+ check_mapping:
 		status = mdc_check_mapping(*entry);
 
 		if (unlikely(FSAL_IS_ERROR(status))) {
@@ -40,6 +40,7 @@
 #include "fsal_up.h"
 #include "fsal_convert.h"
 #include "display.h"
+#include "flight_recorder.h"
 
 typedef struct mdcache_fsal_obj_handle mdcache_entry_t;
 
@@ -51,6 +52,7 @@ struct mdcache_fsal_module {
 extern struct mdcache_fsal_module MDCACHE;
 
 #define MDC_UNEXPORT 1
+#define MDC_QUOTA_NOTSUPP 2
 
 /**
  * @brief Reason an entry is being inserted/looked up
@@ -84,6 +86,50 @@ typedef struct {
 	uint32_t count;
 } mdc_dirmap_t;
 
+/**
+ * @brief A quota result cached for one user or group of an export
+ */
+struct mdc_quota {
+	/** Entry in the partition's list */
+	struct glist_head q_list;
+	/** USRQUOTA or GRPQUOTA */
+	int q_type;
+	/** User or group id */
+	int q_id;
+	/** When q_status and q_quota were fetched, 0 if never */
+	time_t q_fetched;
+	/** When last looked up */
+	time_t q_used;
+	/** Fetches from the sub-FSAL in progress */
+	uint32_t q_fetching;
+	/** Fetches from the sub-FSAL started */
+	uint64_t q_gen;
+	/** Fetch q_status and q_quota came from */
+	uint64_t q_quota_gen;
+	/** Status of the sub-FSAL's get_quota */
+	fsal_status_t q_status;
+	/** Quota as returned by the sub-FSAL */
+	fsal_quota_t q_quota;
+	/** Bytes written through this export, less refunds, since cached */
+	int64_t q_bytes;
+	/** Files created through this export, less removed, since cached */
+	int64_t q_files;
+	/** q_bytes when the fetch of q_quota started */
+	int64_t q_base_bytes;
+	/** q_files when the fetch of q_quota started */
+	int64_t q_base_files;
+};
+
+/** Partitions of an export's quota cache.  This should be prime. */
+#define MDC_QUOTA_PARTS 31
+
+struct mdc_quota_part {
+	/** Lock protecting this partition */
+	pthread_mutex_t mtx;
+	/** Cached quotas, most recently used first */
+	struct glist_head entries;
+};
+
 /*
  * MDCACHE internal export
  */
@@ -104,6 +150,8 @@ struct mdcache_fsal_export {
 	mdc_dirmap_t dirent_map;
 	/** Thread for dirmap processing */
 	struct fridgethr *dirmap_fridge;
+	/** Cached quotas of users and groups */
+	struct mdc_quota_part quota[MDC_QUOTA_PARTS];
 };
 
 /**
@@ -188,6 +236,9 @@ struct mdcache_stats {
 	uint64_t inode_conf;
 	uint64_t inode_added;
 	uint64_t inode_mapping;
+	uint64_t getattrs_saved;
+	uint64_t access_hit;
+	uint64_t access_miss;
 };
 
 extern struct mdcache_stats *cache_stp;
@@ -272,6 +323,29 @@ static const uint32_t MDCACHE_UNREACHABLE = 0x100;
  * stuff the the fsal has to manage, i.e. filesystem bits.
  */
 
+/** Number of access decisions remembered per entry */
+#define MDCACHE_ACCESS_SLOTS 4
+
+/**
+ * @brief A remembered access decision
+ *
+ * The decision depends on the caller's credentials, on the export (for
+ * the superuser check) and on the owner, mode and ACL of the entry.  It
+ * is valid as long as @a gen matches the entry's attr_gen.
+ */
+struct mdcache_access {
+	uid_t uid;		/*< Caller uid */
+	gid_t gid;		/*< Caller primary gid */
+	uint16_t export_id;	/*< Export the check was made through */
+	uint32_t glen;		/*< Number of alternate groups */
+	uint64_t groups;	/*< Hash of the alternate groups */
+	uint32_t gen;		/*< attr_gen of the entry, 0 if unused */
+	fsal_accessflags_t access_type;	/*< Access checked */
+	fsal_accessflags_t allowed;	/*< Access that could be granted */
+	fsal_accessflags_t denied;	/*< Access that would be denied */
+	fsal_errors_t major;	/*< Result of the check */
+};
+
 struct mdcache_fsal_obj_handle {
 	/** Reader-writer lock for attributes */
 	pthread_rwlock_t attr_lock;
@@ -281,11 +355,19 @@ struct mdcache_fsal_obj_handle {
 	struct fsal_obj_handle *sub_handle;
 	/** Cached attributes */
 	struct attrlist attrs;
+	/** Bumped every time attrs are refreshed (protected by attr_lock) */
+	uint32_t attr_gen;
+	/** Next slot of acc to reuse (protected by attr_lock) */
+	uint32_t acc_next;
+	/** Recent access decisions (protected by attr_lock) */
+	struct mdcache_access acc[MDCACHE_ACCESS_SLOTS];
 	/** FH hash linkage */
 	struct {
 		struct avltree_node node_k;	/*< AVL node in tree */
 		mdcache_key_t key;	/*< Key of this entry */
 		bool inavl;
+		bool inidx;		/*< In the handle index */
+		uint8_t idx_probe;	/*< Buckets past its home bucket */
 	} fh_hk;
 	/** Flags for this entry */
 	uint32_t mde_flags;
@@ -579,6 +661,44 @@ mdc_get_parent_handle(struct mdcache_fsal_export *exp,
 		      mdcache_entry_t *entry,
 		      struct fsal_obj_handle *sub_parent);
 
+/* Quota cache */
+void mdc_quota_init(struct mdcache_fsal_export *exp);
+void mdc_quota_destroy(struct mdcache_fsal_export *exp);
+fsal_status_t mdc_quota_get(struct mdcache_fsal_export *exp,
+			    const char *filepath, int quota_type,
+			    int quota_id, fsal_quota_t *pquota);
+fsal_status_t mdc_quota_check(struct mdcache_fsal_export *exp,
+			      const char *filepath, int quota_type);
+void mdc_quota_charge(struct mdcache_fsal_export *exp, uid_t uid, gid_t gid,
+		      int64_t bytes, int64_t files);
+void mdc_quota_forget(struct mdcache_fsal_export *exp, int quota_type,
+		      int quota_id);
+
+/**
+ * @brief Check whether quota calls are answered from the cache
+ *
+ * @param[in] exp	MDCACHE export
+ *
+ * @return true if Quota_Expiration is set and the sub-FSAL has quotas.
+ */
+static inline bool mdc_quota_enabled(struct mdcache_fsal_export *exp)
+{
+	return mdcache_param.quota_expiration != 0 &&
+	       !(atomic_fetch_uint8_t(&exp->flags) & MDC_QUOTA_NOTSUPP);
+}
+
+/**
+ * @brief Charge a file just created by the caller to its quotas
+ *
+ * @param[in] exp	MDCACHE export
+ */
+static inline void mdc_quota_charge_file(struct mdcache_fsal_export *exp)
+{
+	if (mdc_quota_enabled(exp) && op_ctx->creds != NULL)
+		mdc_quota_charge(exp, op_ctx->creds->caller_uid,
+				 op_ctx->creds->caller_gid, 0, 1);
+}
+
 
 
 extern struct config_block mdcache_param_blk;
@@ -592,10 +712,14 @@ extern struct config_block mdcache_param_blk;
 		op_ctx->fsal_export = &(myexp)->mfe_exp; \
 } while (0)
 
-/* Call a sub-FSAL function using it's export */
+/* Call a sub-FSAL function using it's export.  The call shows up in the
+ * flight recorder timeline as an FSAL span named after the caller.
+ */
 #define subcall_raw(myexp, call) do { \
 	op_ctx->fsal_export = (myexp)->mfe_exp.sub_export; \
+	fr_mark(FR_FSAL, __func__); \
 	call; \
+	fr_mark(FR_FSAL_DONE, __func__); \
 	op_ctx->fsal_export = &(myexp)->mfe_exp; \
 } while (0)
 
@@ -773,6 +897,10 @@ mdc_fixup_md(mdcache_entry_t *entry, struct attrlist *attrs)
 				    ATTR4_SEC_LABEL))
 		flags |= MDCACHE_TRUST_ATTRS;
 
+	/* Access decisions made against the old attributes are stale */
+	if (++entry->attr_gen == 0)
+		entry->attr_gen = 1;
+
 	if (attrs->valid_mask == ATTR_RDATTR_ERR) {
 		/* The attribute fetch failed, mark the attributes and ACL as
 		 * untrusted.
@@ -938,6 +1066,8 @@ mdc_has_state(mdcache_entry_t *entry)
 			return true;
 		if (entry->fsobj.fsdir.dhdl.dir.exp_root_refcount)
 			return true;
+		if (!glist_empty(&entry->fsobj.fsdir.dhdl.dir.list_of_states))
+			return true;
 		return false;
 	default:
 		/* No state for these types */
@@ -1075,6 +1205,18 @@ fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 fsal_status_t mdcache_fallocate(struct fsal_obj_handle *obj_hdl,
 				struct state_t *state, uint64_t offset,
 				uint64_t length, bool allocate);
+fsal_status_t mdcache_copy_range2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *dst_state,
+				  uint64_t dst_offset,
+				  struct fsal_obj_handle *src_hdl,
+				  struct state_t *src_state,
+				  uint64_t src_offset,
+				  uint64_t count,
+				  uint32_t flags,
+				  uint64_t *copied);
+fsal_status_t mdcache_write_same2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *state,
+				  struct fsal_write_same_arg *ws_arg);
 
 /* extended attributes management */
 fsal_status_t mdcache_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
@@ -49,6 +49,7 @@
 #include "fsal.h"
 #include "fsal_convert.h"
 #include "FSAL/fsal_commonlib.h"
+#include "FSAL/fsal_fdcache.h"
 #include "nfs_core.h"
 #include "log.h"
 #include "mdcache_lru.h"
@@ -57,6 +58,7 @@
 #include "gsh_intrinsic.h"
 #include "sal_functions.h"
 #include "nfs_exports.h"
+#include "mem_budget.h"
 #ifdef USE_LTTNG
 #include "gsh_lttng/mdcache.h"
 #endif
@@ -643,6 +645,7 @@ lru_reap_impl(enum lru_q_id qid)
 	mdcache_entry_t *entry;
 	uint32_t refcnt;
 	cih_latch_t latch;
+	bool indexed;
 	int ix;
 
 	lane = LRU_NEXT(reap_lane);
@@ -674,6 +677,14 @@ lru_reap_impl(enum lru_q_id qid)
 		/* entry must be unreachable from CIH when recycled */
 		if (cih_latch_entry(&entry->fh_hk.key, &latch, CIH_GET_WLOCK,
 				    __func__, __LINE__)) {
+			/* Take it out of the handle index before looking at
+			 * refcnt.  A lockless lookup referencing it after this
+			 * sees its bucket change and lets go, one that got in
+			 * before shows in refcnt.
+			 */
+			indexed = entry->fh_hk.inidx;
+			cih_idx_remove(entry);
+
 			QLOCK(qlane);
 			refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
 			/* there are two cases which permit reclaim,
@@ -705,8 +716,11 @@ lru_reap_impl(enum lru_q_id qid)
 				 * */
 				goto out;
 			}
-			cih_hash_release(&latch);
 			QUNLOCK(qlane);
+			/* Still in use, publish it again */
+			if (indexed && entry->fh_hk.inavl)
+				cih_idx_insert(entry);
+			cih_hash_release(&latch);
 			/* return the ref we took above--unref deals
 			 * correctly with reclaim case */
 			mdcache_lru_unref(entry);
@@ -1305,6 +1319,11 @@ lru_run(struct fridgethr_context *ctx)
 	LogFullDebug(COMPONENT_CACHE_INODE_LRU, "lru entries: %" PRIu64,
 		     lru_state.entries_used);
 
+	/* Age out the shared stateless fd cache first; when over the high
+	 * water mark its idle descriptors are the cheapest ones to give up.
+	 */
+	fsal_fdcache_reap(extremis);
+
 	/* Reap file descriptors.  This is a preliminary example of the
 	   L2 functionality rather than something we expect to be
 	   permanent.  (It will have to adapt heavily to the new FSAL
@@ -1609,6 +1628,118 @@ void lru_cleanup_entries(void)
 	}
 }
 
+/**
+ * @brief Set the entry high water mark, for white-box tests
+ *
+ * @param[in] hiwat New high water mark
+ *
+ * @return The previous high water mark.
+ */
+uint64_t lru_set_entries_hiwat(uint64_t hiwat)
+{
+	uint64_t prev = atomic_fetch_uint64_t(&lru_state.entries_hiwat);
+
+	atomic_store_uint64_t(&lru_state.entries_hiwat, hiwat);
+	return prev;
+}
+
+/**
+ * @brief Fewest entries a memory budget may shrink the cache to
+ */
+static inline uint64_t lru_budget_floor(void)
+{
+	return MIN(mdcache_param.entries_budget_floor,
+		   mdcache_param.entries_hwmark);
+}
+
+/**
+ * @brief Memory held by cache entries
+ *
+ * What the entry pool has mapped, free entries in its slabs included.
+ * A type-stable pool, as used with Handle_Index, never unmaps its slabs,
+ * so there only the entries in use are counted: shrinking the cache
+ * leaves their memory to new entries instead of growing the pool.  The
+ * handles and names hanging off entries are not counted.
+ */
+static uint64_t lru_budget_usage(void)
+{
+	if (mdcache_entry_pool->type_stable)
+		return atomic_fetch_uint64_t(&lru_state.entries_used) *
+		       sizeof(mdcache_entry_t);
+
+	return atomic_fetch_uint64_t(&mdcache_entry_pool->slab_bytes);
+}
+
+/**
+ * @brief Lookups served from the cache, and entries created on a miss
+ */
+static void lru_budget_benefit(uint64_t *hits, uint64_t *misses)
+{
+	*hits = atomic_fetch_uint64_t(&cache_stp->inode_hit);
+	*misses = atomic_fetch_uint64_t(&cache_stp->inode_added);
+}
+
+/**
+ * @brief Move the entry high water mark to fit a memory budget
+ *
+ * Bytes are turned into entries at what each entry in use costs in the
+ * pool's slabs, so that the pool's slack counts against the budget.
+ *
+ * @return Bytes the entry pool unmapped, or for a type-stable pool the
+ *         bytes of the entries freed to it.
+ */
+static uint64_t lru_budget_limit(uint64_t bytes)
+{
+	uint64_t before = lru_budget_usage();
+	uint64_t used = atomic_fetch_uint64_t(&lru_state.entries_used);
+	uint64_t per_entry = sizeof(mdcache_entry_t);
+	uint64_t hiwat, after;
+
+	if (used != 0 && before / used > per_entry)
+		per_entry = before / used;
+
+	hiwat = bytes / per_entry;
+
+	if (bytes == 0 || hiwat > mdcache_param.entries_hwmark)
+		hiwat = mdcache_param.entries_hwmark;
+	else if (hiwat < lru_budget_floor())
+		hiwat = lru_budget_floor();
+
+	atomic_store_uint64_t(&lru_state.entries_hiwat, hiwat);
+
+	if (used > hiwat) {
+		lru_cleanup_entries();
+		(void)pool_reclaim(mdcache_entry_pool);
+	}
+
+	after = lru_budget_usage();
+
+	return before > after ? before - after : 0;
+}
+
+static struct mem_budget_client lru_budget = {
+	.name = "mdcache entries",
+	.usage = lru_budget_usage,
+	.benefit = lru_budget_benefit,
+	.limit = lru_budget_limit,
+};
+
+/**
+ * @brief Set the entry budget by hand, for white-box tests
+ *
+ * @param[in]  bytes Budget, as the accountant would set it
+ * @param[out] usage Usage reported once the budget is applied
+ *
+ * @return Bytes reported freed.
+ */
+uint64_t lru_budget_cut(uint64_t bytes, uint64_t *usage)
+{
+	uint64_t freed = lru_budget_limit(bytes);
+
+	*usage = lru_budget_usage();
+	return freed;
+}
+
 void init_fds_limit(void)
 {
 	int code = 0;
@@ -1748,6 +1879,11 @@ mdcache_lru_pkginit(void)
 	lru_state.chunks_hiwat = mdcache_param.chunks_hwmark;
 	lru_state.chunks_used = 0;
 
+	/* Let the memory budget move the entry high water mark */
+	lru_budget.max_bytes = (uint64_t)mdcache_param.entries_hwmark *
+			       sizeof(mdcache_entry_t);
+	lru_budget.min_bytes = lru_budget_floor() * sizeof(mdcache_entry_t);
+	mem_budget_register(&lru_budget);
 
 	/* init queue complex */
 	lru_init_queues();
@@ -1788,9 +1924,11 @@ mdcache_lru_pkginit(void)
 fsal_status_t
 mdcache_lru_pkgshutdown(void)
 {
-	int rc = fridgethr_sync_command(lru_fridge,
-					fridgethr_comm_stop,
-					120);
+	int rc;
+
+	mem_budget_unregister(&lru_budget);
+
+	rc = fridgethr_sync_command(lru_fridge, fridgethr_comm_stop, 120);
 
 	if (rc == ETIMEDOUT) {
 		LogMajor(COMPONENT_CACHE_INODE_LRU,
@@ -1848,14 +1986,22 @@ mdcache_entry_t *mdcache_lru_get(struct fsal_obj_handle *sub_handle)
 		nentry = container_of(lru, mdcache_entry_t, lru);
 		mdcache_lru_clean(nentry);
 		memset(&nentry->attrs, 0, sizeof(nentry->attrs));
+		nentry->attr_gen = 0;
+		nentry->acc_next = 0;
+		memset(nentry->acc, 0, sizeof(nentry->acc));
 		init_rw_locks(nentry);
+		/* A lookup through the handle index may still be holding
+		 * a reference it is about to give back, so add ours to
+		 * the one we hold rather than overwrite the count.
+		 */
+		(void) atomic_inc_int32_t(&nentry->lru.refcnt);
 	} else {
 		/* alloc entry (if fails, aborts) */
 		nentry = alloc_cache_entry();
+		/* Since the entry was freed, nobody can bump refcnt. */
+		nentry->lru.refcnt = 2;
 	}
 
-	/* Since the entry isn't in a queue, nobody can bump refcnt. */
-	nentry->lru.refcnt = 2;
 	nentry->lru.cf = 0;
 	nentry->lru.lane = lru_lane_of(nentry);
 	nentry->sub_handle = sub_handle;
@@ -175,6 +175,33 @@ static inline fsal_status_t mdcache_get(mdcache_entry_t *entry)
 	return mdcache_lru_ref(entry, LRU_FLAG_NONE);
 }
 
+/**
+ *
+ * @brief Get a reference to an entry unless it is being freed
+ *
+ * For lookups that found @a entry without holding its hash partition
+ * lock.  An entry whose count has dropped to zero is never revived.
+ * The LRU is not adjusted.
+ *
+ * @param[in] entry Cache entry
+ *
+ * @return true if a reference was taken.
+ */
+static inline bool mdcache_lru_ref_live(mdcache_entry_t *entry)
+{
+	int32_t refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
+
+	while (refcnt > 0) {
+		if (__atomic_compare_exchange_n(&entry->lru.refcnt, &refcnt,
+						refcnt + 1, true,
+						__ATOMIC_SEQ_CST,
+						__ATOMIC_SEQ_CST))
+			return true;
+	}
+
+	return false;
+}
+
 /**
  *
  * @brief Release logical reference to a cache entry
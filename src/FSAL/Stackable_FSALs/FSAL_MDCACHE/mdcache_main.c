@@ -147,6 +147,7 @@ void mdcache_export_uninit(void)
 			   &op_ctx->fsal_export->exports);
 	free_export_ops(op_ctx->fsal_export);
 
+	mdc_quota_destroy(exp);
 	gsh_free(exp);
 
 	/* Put back sub export */
@@ -237,6 +238,8 @@ mdcache_fsal_create_export(struct fsal_module *sub_fsal, void *parse_node,
 		return status;
 	}
 
+	mdc_quota_init(myself);
+
 	/* Set up op_ctx */
 	op_ctx->fsal_export = &myself->mfe_exp;
 	op_ctx->fsal_module = &MDCACHE.module;
@@ -319,6 +322,10 @@ fsal_status_t mdcache_pkginit(void)
 	mdcache_entry_pool = pool_basic_init("MDCACHE Entry Pool",
 					     sizeof(mdcache_entry_t));
 
+	/* The handle index may still read an entry after it was freed */
+	if (mdcache_param.handle_index)
+		pool_set_type_stable(mdcache_entry_pool);
+
 	status = mdcache_lru_pkginit();
 	if (FSAL_IS_ERROR(status)) {
 		pool_destroy(mdcache_entry_pool);
@@ -363,6 +370,18 @@ void mdcache_dbus_show(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 					&cache_st.inode_mapping);
+	type = " Getattrs Saved: ";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.getattrs_saved);
+	type = " Access Cache Hits: ";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.access_hit);
+	type = " Access Cache Misses: ";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.access_miss);
 
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
@@ -0,0 +1,467 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_quota.c
+ * @brief Cached quota results
+ *
+ * With Quota_Expiration set, RQUOTA GETQUOTA and the quota checks made by
+ * WRITE and the create operations are answered from a per-export table of
+ * the sub-FSAL's get_quota results, fetched again once older than
+ * Quota_Expiration seconds.  Space and files consumed through the export
+ * since a result was fetched, including writes still in progress, are
+ * added to it, so the checks do not wait for the next fetch to see them.
+ *
+ * Charges are kept as running totals.  A fetch notes the totals when it
+ * starts, and only what was charged after that is added to its result:
+ * what was charged while it ran may not be in the usage it read.
+ */
+
+#include "config.h"
+#include <sys/types.h>
+#include <sys/param.h>
+#include <time.h>
+#include <os/quota.h>
+#include "log.h"
+#include "fsal.h"
+#include "mdcache_int.h"
+
+/** Quotas unused for this many expiration periods are dropped */
+#define MDC_QUOTA_IDLE 4
+
+static inline struct mdc_quota_part *
+mdc_quota_part(struct mdcache_fsal_export *exp, int quota_type, int quota_id)
+{
+	uint32_t hash = (uint32_t) quota_id * 2654435761U + quota_type;
+
+	return &exp->quota[hash % MDC_QUOTA_PARTS];
+}
+
+/**
+ * @brief Initialize the quota cache of an export
+ *
+ * @param[in] exp	MDCACHE export
+ */
+void mdc_quota_init(struct mdcache_fsal_export *exp)
+{
+	int i;
+
+	for (i = 0; i < MDC_QUOTA_PARTS; i++) {
+		PTHREAD_MUTEX_init(&exp->quota[i].mtx, NULL);
+		glist_init(&exp->quota[i].entries);
+	}
+}
+
+/**
+ * @brief Free the quota cache of an export
+ *
+ * @param[in] exp	MDCACHE export
+ */
+void mdc_quota_destroy(struct mdcache_fsal_export *exp)
+{
+	struct glist_head *glist, *glistn;
+	int i;
+
+	for (i = 0; i < MDC_QUOTA_PARTS; i++) {
+		glist_for_each_safe(glist, glistn, &exp->quota[i].entries) {
+			glist_del(glist);
+			gsh_free(glist_entry(glist, struct mdc_quota, q_list));
+		}
+		PTHREAD_MUTEX_destroy(&exp->quota[i].mtx);
+	}
+}
+
+/**
+ * @brief Find a cached quota
+ *
+ * The quota found is moved to the front of its partition.
+ *
+ * @note The partition lock MUST be held
+ *
+ * @param[in] part		Partition
+ * @param[in] quota_type	USRQUOTA or GRPQUOTA
+ * @param[in] quota_id		User or group id
+ *
+ * @return The quota, or NULL if not cached.
+ */
+static struct mdc_quota *mdc_quota_lookup(struct mdc_quota_part *part,
+					  int quota_type, int quota_id)
+{
+	struct glist_head *glist;
+	struct mdc_quota *q;
+
+	glist_for_each(glist, &part->entries) {
+		q = glist_entry(glist, struct mdc_quota, q_list);
+
+		if (q->q_type == quota_type && q->q_id == quota_id) {
+			glist_del(&q->q_list);
+			glist_add(&part->entries, &q->q_list);
+			return q;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Add a quota to the cache
+ *
+ * Quotas idle for a while are dropped from the tail of the partition
+ * first, which keeps the cache to the users and groups active recently.
+ *
+ * @note The partition lock MUST be held
+ *
+ * @param[in] part		Partition
+ * @param[in] quota_type	USRQUOTA or GRPQUOTA
+ * @param[in] quota_id		User or group id
+ * @param[in] now		Current time
+ *
+ * @return The quota, not yet fetched.
+ */
+static struct mdc_quota *mdc_quota_add(struct mdc_quota_part *part,
+				       int quota_type, int quota_id,
+				       time_t now)
+{
+	time_t idle = MDC_QUOTA_IDLE * mdcache_param.quota_expiration;
+	struct mdc_quota *q;
+
+	while (!glist_empty(&part->entries)) {
+		q = glist_last_entry(&part->entries, struct mdc_quota, q_list);
+
+		if (now - q->q_used <= idle || q->q_fetching != 0)
+			break;
+
+		glist_del(&q->q_list);
+		gsh_free(q);
+	}
+
+	q = gsh_calloc(1, sizeof(*q));
+	q->q_type = quota_type;
+	q->q_id = quota_id;
+	glist_add(&part->entries, &q->q_list);
+
+	return q;
+}
+
+/**
+ * @brief Check whether the caller may read a quota
+ *
+ * A quota fetched with one caller's credentials must not be handed to a
+ * caller the sub-FSAL would have refused.
+ *
+ * @param[in] quota_type	USRQUOTA or GRPQUOTA
+ * @param[in] quota_id		User or group id
+ *
+ * @return true if the caller is root, or is the user or in the group.
+ */
+static bool mdc_quota_may_read(int quota_type, int quota_id)
+{
+	struct user_cred *creds = op_ctx->creds;
+	unsigned int i;
+
+	if (creds == NULL || creds->caller_uid == 0)
+		return true;
+
+	if (quota_type == USRQUOTA)
+		return creds->caller_uid == quota_id;
+
+	if (creds->caller_gid == quota_id)
+		return true;
+
+	for (i = 0; i < creds->caller_glen; i++)
+		if (creds->caller_garray[i] == quota_id)
+			return true;
+
+	return false;
+}
+
+/**
+ * @brief Get the quota of a user or group, fetching it if stale
+ *
+ * While one caller fetches a stale quota, others are answered with the
+ * stale one rather than fetching it too.
+ *
+ * @param[in]  exp		MDCACHE export
+ * @param[in]  filepath		Path passed to the sub-FSAL
+ * @param[in]  quota_type	USRQUOTA or GRPQUOTA
+ * @param[in]  quota_id		User or group id
+ * @param[out] pquota		Quota, with local usage added
+ *
+ * @return FSAL status of the sub-FSAL's get_quota.
+ */
+static fsal_status_t mdc_quota_fetch(struct mdcache_fsal_export *exp,
+				     const char *filepath, int quota_type,
+				     int quota_id, fsal_quota_t *pquota)
+{
+	struct mdc_quota_part *part = mdc_quota_part(exp, quota_type,
+						     quota_id);
+	struct fsal_export *sub_export = exp->mfe_exp.sub_export;
+	struct mdc_quota *q;
+	fsal_quota_t fetched;
+	fsal_status_t status;
+	time_t now = time(NULL);
+	int64_t base_bytes, base_files;
+	uint64_t bsize, gen;
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	q = mdc_quota_lookup(part, quota_type, quota_id);
+	if (q == NULL)
+		q = mdc_quota_add(part, quota_type, quota_id, now);
+	q->q_used = now;
+
+	if (now - q->q_fetched >= mdcache_param.quota_expiration &&
+	    !(q->q_fetching != 0 && q->q_fetched != 0)) {
+		q->q_fetching++;
+		gen = ++q->q_gen;
+		base_bytes = q->q_bytes;
+		base_files = q->q_files;
+		PTHREAD_MUTEX_unlock(&part->mtx);
+
+		memset(&fetched, 0, sizeof(fetched));
+		subcall_raw(exp,
+			status = sub_export->exp_ops.get_quota(sub_export,
+							       filepath,
+							       quota_type,
+							       quota_id,
+							       &fetched)
+		       );
+
+		if (status.major == ERR_FSAL_NOTSUPP) {
+			/* Don't ask again, pass quota calls through */
+			atomic_set_uint8_t_bits(&exp->flags,
+						MDC_QUOTA_NOTSUPP);
+		}
+
+		PTHREAD_MUTEX_lock(&part->mtx);
+
+		q->q_fetching--;
+
+		/* A fetch started later may have finished first */
+		if (gen > q->q_quota_gen) {
+			q->q_quota_gen = gen;
+			q->q_fetched = now;
+			q->q_status = status;
+			q->q_quota = fetched;
+			q->q_base_bytes = base_bytes;
+			q->q_base_files = base_files;
+		}
+	}
+
+	status = q->q_status;
+	if (!FSAL_IS_ERROR(status)) {
+		*pquota = q->q_quota;
+		bsize = pquota->bsize != 0 ? pquota->bsize : DEV_BSIZE;
+		/* Refunds of what was in the fetched usage come off nothing */
+		if (q->q_bytes > q->q_base_bytes)
+			pquota->curblocks += howmany(q->q_bytes -
+						     q->q_base_bytes, bsize);
+		if (q->q_files > q->q_base_files)
+			pquota->curfiles += q->q_files - q->q_base_files;
+	}
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+
+	return status;
+}
+
+/**
+ * @brief Get the quota of a user or group
+ *
+ * A caller that could not read the quota from the sub-FSAL is passed
+ * through to it, rather than answered from the cache.
+ *
+ * @param[in]  exp		MDCACHE export
+ * @param[in]  filepath		Path to query
+ * @param[in]  quota_type	USRQUOTA or GRPQUOTA
+ * @param[in]  quota_id		User or group id
+ * @param[out] pquota		Quota, with local usage added
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdc_quota_get(struct mdcache_fsal_export *exp,
+			    const char *filepath, int quota_type,
+			    int quota_id, fsal_quota_t *pquota)
+{
+	struct fsal_export *sub_export = exp->mfe_exp.sub_export;
+	fsal_status_t status;
+
+	if (mdc_quota_may_read(quota_type, quota_id))
+		return mdc_quota_fetch(exp, filepath, quota_type, quota_id,
+				       pquota);
+
+	subcall_raw(exp,
+		status = sub_export->exp_ops.get_quota(sub_export, filepath,
+						       quota_type, quota_id,
+						       pquota)
+	       );
+
+	return status;
+}
+
+/**
+ * @brief Check one quota against its limits
+ *
+ * @param[in] exp		MDCACHE export
+ * @param[in] filepath		Path passed to the sub-FSAL
+ * @param[in] quota_type	USRQUOTA or GRPQUOTA
+ * @param[in] quota_id		User or group id
+ * @param[in] resource		FSAL_QUOTA_BLOCKS or FSAL_QUOTA_INODES
+ *
+ * @return true if at the hard limit, or past the soft limit with the
+ *         grace period over.
+ */
+static bool mdc_quota_over(struct mdcache_fsal_export *exp,
+			   const char *filepath, int quota_type,
+			   int quota_id, int resource)
+{
+	fsal_quota_t quota;
+	fsal_status_t status;
+	uint64_t used, hard, soft, grace;
+
+	status = mdc_quota_fetch(exp, filepath, quota_type, quota_id, &quota);
+
+	/* No quota, no limit */
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	if (resource == FSAL_QUOTA_BLOCKS) {
+		used = quota.curblocks;
+		hard = quota.bhardlimit;
+		soft = quota.bsoftlimit;
+		grace = quota.btimeleft;
+	} else {
+		used = quota.curfiles;
+		hard = quota.fhardlimit;
+		soft = quota.fsoftlimit;
+		grace = quota.ftimeleft;
+	}
+
+	if (hard != 0 && used >= hard)
+		return true;
+
+	return soft != 0 && used > soft && grace != 0 &&
+	       grace <= (uint64_t) time(NULL);
+}
+
+/**
+ * @brief Check whether the caller's quotas allow consuming more
+ *
+ * Both the caller's user and primary group quotas are checked.  Root is
+ * not checked, as the kernel lets CAP_SYS_RESOURCE through.
+ *
+ * @param[in] exp		MDCACHE export
+ * @param[in] filepath		Path to check
+ * @param[in] quota_type	FSAL_QUOTA_BLOCKS or FSAL_QUOTA_INODES
+ *
+ * @return ERR_FSAL_DQUOT if over quota.
+ */
+fsal_status_t mdc_quota_check(struct mdcache_fsal_export *exp,
+			      const char *filepath, int quota_type)
+{
+	struct user_cred *creds = op_ctx->creds;
+
+	if (creds == NULL || creds->caller_uid == 0)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	if (mdc_quota_over(exp, filepath, USRQUOTA, creds->caller_uid,
+			   quota_type) ||
+	    mdc_quota_over(exp, filepath, GRPQUOTA, creds->caller_gid,
+			   quota_type))
+		return fsalstat(ERR_FSAL_DQUOT, EDQUOT);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Charge one cached quota
+ *
+ * @param[in] exp		MDCACHE export
+ * @param[in] quota_type	USRQUOTA or GRPQUOTA
+ * @param[in] quota_id		User or group id
+ * @param[in] bytes		Bytes to charge, negative to refund
+ * @param[in] files		Files to charge, negative to refund
+ */
+static void mdc_quota_charge_one(struct mdcache_fsal_export *exp,
+				 int quota_type, int quota_id,
+				 int64_t bytes, int64_t files)
+{
+	struct mdc_quota_part *part = mdc_quota_part(exp, quota_type,
+						     quota_id);
+	struct mdc_quota *q;
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	/* Not cached, the next fetch will see the usage anyway */
+	q = mdc_quota_lookup(part, quota_type, quota_id);
+	if (q != NULL) {
+		q->q_bytes += bytes;
+		q->q_files += files;
+	}
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+}
+
+/**
+ * @brief Charge space or files consumed through the export
+ *
+ * @param[in] exp	MDCACHE export
+ * @param[in] uid	Owning user
+ * @param[in] gid	Owning group
+ * @param[in] bytes	Bytes to charge, negative to refund
+ * @param[in] files	Files to charge, negative to refund
+ */
+void mdc_quota_charge(struct mdcache_fsal_export *exp, uid_t uid, gid_t gid,
+		      int64_t bytes, int64_t files)
+{
+	mdc_quota_charge_one(exp, USRQUOTA, uid, bytes, files);
+	mdc_quota_charge_one(exp, GRPQUOTA, gid, bytes, files);
+}
+
+/**
+ * @brief Make the next lookup of a quota fetch it again
+ *
+ * @param[in] exp		MDCACHE export
+ * @param[in] quota_type	USRQUOTA or GRPQUOTA
+ * @param[in] quota_id		User or group id
+ */
+void mdc_quota_forget(struct mdcache_fsal_export *exp, int quota_type,
+		      int quota_id)
+{
+	struct mdc_quota_part *part = mdc_quota_part(exp, quota_type,
+						     quota_id);
+	struct mdc_quota *q;
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	q = mdc_quota_lookup(part, quota_type, quota_id);
+	if (q != NULL)
+		q->q_fetched = 0;
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+}
+
+/** @} */
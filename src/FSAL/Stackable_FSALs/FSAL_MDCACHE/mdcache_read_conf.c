@@ -57,6 +57,8 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, nparts),
 	CONF_ITEM_UI32("Cache_Size", 1, UINT32_MAX, 32633,
 		       mdcache_parameter, cache_size),
+	CONF_ITEM_BOOL("Handle_Index", false,
+		       mdcache_parameter, handle_index),
 	CONF_ITEM_BOOL("Use_Getattr_Directory_Invalidation", false,
 		       mdcache_parameter, getattr_dir_invalidation),
 	CONF_ITEM_UI32("Dir_Chunk", 0, UINT32_MAX, 128,
@@ -65,6 +67,8 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, dir.avl_detached_mult),
 	CONF_ITEM_UI32("Entries_HWMark", 1, UINT32_MAX, 100000,
 		       mdcache_parameter, entries_hwmark),
+	CONF_ITEM_UI32("Entries_Budget_Floor", 1, UINT32_MAX, 10000,
+		       mdcache_parameter, entries_budget_floor),
 	CONF_ITEM_UI32("Chunks_HWMark", 1, UINT32_MAX, 100000,
 		       mdcache_parameter, chunks_hwmark),
 	CONF_ITEM_UI32("LRU_Run_Interval", 1, 24 * 3600, 90,
@@ -91,6 +95,8 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, futility_count),
 	CONF_ITEM_UI32("Dirmap_HWMark", 1, UINT32_MAX, 10000,
 		       mdcache_parameter, dirmap_hwmark),
+	CONF_ITEM_UI32("Quota_Expiration", 0, 3600, 0,
+		       mdcache_parameter, quota_expiration),
 	CONFIG_EOL
 };
 
@@ -389,3 +389,57 @@ fsal_status_t nullfs_fallocate(struct fsal_obj_handle *obj_hdl,
 	op_ctx->fsal_export = &export->export;
 	return status;
 }
+
+fsal_status_t nullfs_copy_range2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *dst_state,
+				 uint64_t dst_offset,
+				 struct fsal_obj_handle *src_hdl,
+				 struct state_t *src_state,
+				 uint64_t src_offset,
+				 uint64_t count,
+				 uint32_t flags,
+				 uint64_t *copied)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+	struct nullfs_fsal_obj_handle *src =
+		container_of(src_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->copy_range2(handle->sub_handle,
+							  dst_state, dst_offset,
+							  src->sub_handle,
+							  src_state, src_offset,
+							  count, flags, copied);
+	op_ctx->fsal_export = &export->export;
+	return status;
+}
+
+fsal_status_t nullfs_write_same2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *state,
+				 struct fsal_write_same_arg *ws_arg)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->write_same2(handle->sub_handle,
+							  state, ws_arg);
+	op_ctx->fsal_export = &export->export;
+	return status;
+}
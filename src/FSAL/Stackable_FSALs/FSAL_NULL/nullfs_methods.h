@@ -163,6 +163,18 @@ fsal_status_t nullfs_close2(struct fsal_obj_handle *obj_hdl,
 fsal_status_t nullfs_fallocate(struct fsal_obj_handle *obj_hdl,
 			       struct state_t *state, uint64_t offset,
 			       uint64_t length, bool allocate);
+fsal_status_t nullfs_copy_range2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *dst_state,
+				 uint64_t dst_offset,
+				 struct fsal_obj_handle *src_hdl,
+				 struct state_t *src_state,
+				 uint64_t src_offset,
+				 uint64_t count,
+				 uint32_t flags,
+				 uint64_t *copied);
+fsal_status_t nullfs_write_same2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *state,
+				 struct fsal_write_same_arg *ws_arg);
 
 /* extended attributes management */
 fsal_status_t nullfs_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
@@ -0,0 +1,2352 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file cache.c
+ * @brief Data cache engine of FSAL_WBCACHE
+ *
+ * Every block in a handle's tree holds the complete contents of its
+ * part of the file, zero past end of file, so a block can be read
+ * without looking at the sub-FSAL.  Partially written blocks are filled
+ * from the sub-FSAL before the write lands in the cache file.
+ *
+ * Locking: a handle's cache_lock is taken before the export lock.  The
+ * evictor holds the export lock and only try-locks the handle owning
+ * the victim block, skipping it when that fails.  A handle's ra_mutex is
+ * not held with any other lock.
+ *
+ * Prefetch reads the sub-FSAL without holding cache_lock, so it notes
+ * the handle's data_gen first and drops what it read if the file's data
+ * changed meanwhile.  Everything that changes the data bumps data_gen
+ * with cache_lock held for write.
+ *
+ * All functions here are called with op_ctx->fsal_export set to the
+ * WBCACHE export, and switch to the sub export around sub-FSAL calls.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "FSAL/fsal_commonlib.h"
+#include "common_utils.h"
+#include "city.h"
+#include "fridgethr.h"
+#include "wbcache_methods.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Name of the journal in an export's cache directory */
+#define WBCACHE_JOURNAL "journal"
+
+/** Name of the journal being rewritten by compaction */
+#define WBCACHE_JOURNAL_NEW WBCACHE_JOURNAL ".new"
+
+/** Smallest journal size at which it is compacted */
+#define WBCACHE_JOURNAL_COMPACT (16 * 1024 * 1024)
+
+/** Largest write issued when flushing contiguous dirty blocks */
+#define WBCACHE_FLUSH_MAX (4 * 1024 * 1024)
+
+/** Threads prefetching for an export */
+#define WBCACHE_PREFETCH_THREADS 4
+
+#define WBCACHE_JREC_MAGIC 0x5742434aU	/* "WBCJ" */
+
+enum wbcache_jrec_type {
+	WBCACHE_JREC_DIRTY = 1,	/*< An extent was written to the cache */
+	WBCACHE_JREC_CLEAN = 2,	/*< All dirty data of a file was written back */
+};
+
+/**
+ * @brief Journal record, followed by wire_len bytes of wire handle
+ */
+struct wbcache_jrec {
+	uint32_t magic;
+	uint16_t type;
+	uint16_t wire_len;
+	uint64_t seq;
+	uint64_t fsid_major;
+	uint64_t fsid_minor;
+	uint64_t fileid;
+	uint64_t offset;
+	uint64_t length;
+	uint64_t check;		/*< Hash of the record with check zeroed */
+};
+
+/**
+ * @brief Dirty blocks of a released handle that could not be written back
+ *
+ * Kept on the export's orphans list, protected by the export lock, until
+ * a handle for the same file takes them over.
+ */
+struct wbcache_orphan {
+	struct glist_head link;		/*< Link in the export's orphans */
+	fsal_fsid_t fsid;
+	uint64_t fileid;
+	struct avltree blocks;		/*< The dirty blocks */
+	uint32_t ndirty;
+	uint64_t size;
+	struct timespec dirty_mtime;
+	struct gsh_buffdesc wire;
+};
+
+/**
+ * @brief Completion of a sub-FSAL read2 or write2
+ */
+struct wbcache_sync_io {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool done;
+	fsal_status_t status;
+};
+
+static void wbcache_sync_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			    void *obj_data, void *caller_data)
+{
+	struct wbcache_sync_io *sio = caller_data;
+
+	PTHREAD_MUTEX_lock(&sio->mutex);
+	sio->status = ret;
+	sio->done = true;
+	pthread_cond_signal(&sio->cond);
+	PTHREAD_MUTEX_unlock(&sio->mutex);
+}
+
+/**
+ * @brief Read or write through the sub-FSAL and wait for the result
+ */
+static fsal_status_t wbcache_sub_io(struct wbcache_fsal_export *exp,
+				    struct fsal_obj_handle *sub_handle,
+				    bool write, bool bypass,
+				    struct fsal_io_arg *io_arg)
+{
+	struct wbcache_sync_io sio = { .done = false };
+
+	PTHREAD_MUTEX_init(&sio.mutex, NULL);
+	PTHREAD_COND_init(&sio.cond, NULL);
+
+	op_ctx->fsal_export = exp->export.sub_export;
+	if (write)
+		sub_handle->obj_ops->write2(sub_handle, bypass,
+					    wbcache_sync_cb, io_arg, &sio);
+	else
+		sub_handle->obj_ops->read2(sub_handle, bypass,
+					   wbcache_sync_cb, io_arg, &sio);
+	op_ctx->fsal_export = &exp->export;
+
+	PTHREAD_MUTEX_lock(&sio.mutex);
+	while (!sio.done)
+		pthread_cond_wait(&sio.cond, &sio.mutex);
+	PTHREAD_MUTEX_unlock(&sio.mutex);
+
+	PTHREAD_MUTEX_destroy(&sio.mutex);
+	PTHREAD_COND_destroy(&sio.cond);
+
+	return sio.status;
+}
+
+/**
+ * @brief Read a range of a file from the sub-FSAL, zero filling past EOF
+ */
+static fsal_status_t wbcache_sub_read(struct wbcache_fsal_export *exp,
+				      struct wbcache_fsal_obj_handle *hdl,
+				      struct state_t *state, uint64_t offset,
+				      char *buf, size_t len)
+{
+	struct fsal_io_arg *read_arg = alloca(sizeof(*read_arg) +
+					      sizeof(struct iovec));
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	size_t done = 0;
+
+	while (done < len) {
+		memset(read_arg, 0, sizeof(*read_arg));
+		read_arg->state = state;
+		read_arg->offset = offset + done;
+		read_arg->iov_count = 1;
+		read_arg->iov[0].iov_base = buf + done;
+		read_arg->iov[0].iov_len = len - done;
+
+		status = wbcache_sub_io(exp, hdl->sub_handle, false, true,
+					read_arg);
+		if (FSAL_IS_ERROR(status))
+			return status;
+
+		done += read_arg->io_amount;
+		if (read_arg->end_of_file || read_arg->io_amount == 0)
+			break;
+	}
+
+	if (done < len)
+		memset(buf + done, 0, len - done);
+
+	return status;
+}
+
+/**
+ * @brief Write a range of a file to the sub-FSAL, unstable
+ */
+static fsal_status_t wbcache_sub_write(struct wbcache_fsal_export *exp,
+				       struct fsal_obj_handle *sub_handle,
+				       uint64_t offset, char *buf, size_t len)
+{
+	struct fsal_io_arg *write_arg = alloca(sizeof(*write_arg) +
+					       sizeof(struct iovec));
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	size_t done = 0;
+
+	while (done < len) {
+		memset(write_arg, 0, sizeof(*write_arg));
+		write_arg->offset = offset + done;
+		write_arg->iov_count = 1;
+		write_arg->iov[0].iov_base = buf + done;
+		write_arg->iov[0].iov_len = len - done;
+
+		status = wbcache_sub_io(exp, sub_handle, true, true,
+					write_arg);
+		if (FSAL_IS_ERROR(status))
+			return status;
+
+		if (write_arg->io_amount == 0)
+			return fsalstat(ERR_FSAL_IO, EIO);
+
+		done += write_arg->io_amount;
+	}
+
+	return status;
+}
+
+static fsal_status_t wbcache_sub_commit(struct wbcache_fsal_export *exp,
+					struct fsal_obj_handle *sub_handle)
+{
+	fsal_status_t status;
+
+	op_ctx->fsal_export = exp->export.sub_export;
+	status = sub_handle->obj_ops->commit2(sub_handle, 0, 0);
+	op_ctx->fsal_export = &exp->export;
+
+	return status;
+}
+
+static int wbcache_block_cmpf(const struct avltree_node *lhs,
+			      const struct avltree_node *rhs)
+{
+	struct wbcache_block *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct wbcache_block, node_k);
+	rk = avltree_container_of(rhs, struct wbcache_block, node_k);
+
+	if (lk->index < rk->index)
+		return -1;
+
+	if (lk->index > rk->index)
+		return 1;
+
+	return 0;
+}
+
+static struct wbcache_block *wbcache_block_lookup(
+					struct wbcache_fsal_obj_handle *hdl,
+					uint64_t index)
+{
+	struct wbcache_block key;
+	struct avltree_node *node;
+
+	key.index = index;
+	node = avltree_lookup(&key.node_k, &hdl->blocks);
+
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct wbcache_block, node_k);
+}
+
+static inline bool wbcache_block_dirty(struct wbcache_block *blk)
+{
+	return blk->dirty_end != 0;
+}
+
+/**
+ * @brief Open (creating if needed) the cache file of a handle
+ *
+ * Called with the handle's cache_lock held for write.
+ */
+static int wbcache_open_cache_file(struct wbcache_fsal_export *exp,
+				   struct wbcache_fsal_obj_handle *hdl)
+{
+	char name[64];
+
+	if (hdl->cache_fd >= 0)
+		return 0;
+
+	(void)snprintf(name, sizeof(name), "%" PRIx64 ".%" PRIx64
+		       ".%" PRIx64, hdl->obj_handle.fsid.major,
+		       hdl->obj_handle.fsid.minor, hdl->obj_handle.fileid);
+
+	hdl->cache_fd = openat(exp->dir_fd, name, O_RDWR | O_CREAT | O_CLOEXEC,
+			       0600);
+	if (hdl->cache_fd < 0) {
+		int retval = errno;
+
+		LogCrit(COMPONENT_FSAL,
+			"Could not open cache file %s/%s: %s",
+			exp->cache_dir, name, strerror(retval));
+		return retval;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Release the space of a block in the cache file
+ */
+static void wbcache_punch(struct wbcache_fsal_export *exp,
+			  struct wbcache_fsal_obj_handle *hdl,
+			  uint64_t offset, uint64_t len)
+{
+	if (hdl->cache_fd < 0 || len == 0)
+		return;
+
+	if (fallocate(hdl->cache_fd,
+		      FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		      offset, len) < 0)
+		LogDebug(COMPONENT_FSAL,
+			 "Could not punch cache file hole: %s",
+			 strerror(errno));
+}
+
+/**
+ * @brief Free a block
+ *
+ * Called with the handle's cache_lock held for write and the export
+ * lock held.
+ */
+static void wbcache_block_free_locked(struct wbcache_fsal_export *exp,
+				      struct wbcache_block *blk)
+{
+	struct wbcache_fsal_obj_handle *hdl = blk->hdl;
+
+	avltree_remove(&blk->node_k, &hdl->blocks);
+
+	if (wbcache_block_dirty(blk)) {
+		hdl->ndirty--;
+		(void)atomic_sub_uint64_t(&exp->stats.dirty_bytes,
+					  blk->dirty_end - blk->dirty_start);
+		if (hdl->ndirty == 0)
+			exp->dirty_files--;
+	} else {
+		glist_del(&blk->lru_link);
+	}
+
+	(void)atomic_sub_uint64_t(&exp->stats.cached_bytes, exp->block_size);
+
+	wbcache_punch(exp, hdl, blk->index * exp->block_size,
+		      exp->block_size);
+
+	gsh_free(blk);
+}
+
+/**
+ * @brief Make room for a new block
+ *
+ * Evicts clean blocks, least recently used first.  Blocks of handles
+ * that are busy are skipped.  Called with @a hdl's cache_lock held for
+ * write.
+ *
+ * @return true if the block was accounted for, false if the cache is full.
+ */
+static bool wbcache_reserve(struct wbcache_fsal_export *exp,
+			    struct wbcache_fsal_obj_handle *hdl)
+{
+	struct glist_head *glist, *glistn;
+	struct wbcache_block *blk;
+	struct wbcache_fsal_obj_handle *victim;
+	bool reserved = false;
+
+	PTHREAD_MUTEX_lock(&exp->lock);
+
+	glist_for_each_safe(glist, glistn, &exp->lru) {
+		if (atomic_fetch_uint64_t(&exp->stats.cached_bytes) +
+		    exp->block_size <= exp->cache_size)
+			break;
+
+		blk = glist_entry(glist, struct wbcache_block, lru_link);
+		victim = blk->hdl;
+
+		if (victim != hdl &&
+		    PTHREAD_RWLOCK_trywrlock(&victim->cache_lock) != 0)
+			continue;
+
+		wbcache_block_free_locked(exp, blk);
+		(void)atomic_inc_uint64_t(&exp->stats.evictions);
+
+		if (victim != hdl)
+			PTHREAD_RWLOCK_unlock(&victim->cache_lock);
+	}
+
+	if (atomic_fetch_uint64_t(&exp->stats.cached_bytes) +
+	    exp->block_size <= exp->cache_size) {
+		(void)atomic_add_uint64_t(&exp->stats.cached_bytes,
+					  exp->block_size);
+		reserved = true;
+	}
+
+	PTHREAD_MUTEX_unlock(&exp->lock);
+
+	return reserved;
+}
+
+/**
+ * @brief Add a block to a handle, clean
+ *
+ * Called with the handle's cache_lock held for write, after the space
+ * was reserved.
+ */
+static struct wbcache_block *wbcache_block_add(
+					struct wbcache_fsal_export *exp,
+					struct wbcache_fsal_obj_handle *hdl,
+					uint64_t index)
+{
+	struct wbcache_block *blk = gsh_calloc(1, sizeof(*blk));
+
+	blk->hdl = hdl;
+	blk->index = index;
+	(void)avltree_insert(&blk->node_k, &hdl->blocks);
+
+	PTHREAD_MUTEX_lock(&exp->lock);
+	glist_add_tail(&exp->lru, &blk->lru_link);
+	PTHREAD_MUTEX_unlock(&exp->lock);
+
+	return blk;
+}
+
+/**
+ * @brief Read a block from the sub-FSAL into the cache file
+ *
+ * Called with the handle's cache_lock held for write.
+ */
+static fsal_status_t wbcache_block_fill(struct wbcache_fsal_export *exp,
+					struct wbcache_fsal_obj_handle *hdl,
+					struct state_t *state, uint64_t index)
+{
+	uint64_t offset = index * exp->block_size;
+	size_t len = exp->block_size;
+	fsal_status_t status;
+	char *buf;
+	ssize_t n;
+
+	if (offset >= hdl->size)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	if (offset + len > hdl->size)
+		len = hdl->size - offset;
+
+	buf = gsh_malloc(len);
+
+	status = wbcache_sub_read(exp, hdl, state, offset, buf, len);
+	if (!FSAL_IS_ERROR(status)) {
+		n = pwrite(hdl->cache_fd, buf, len, offset);
+		if (n != (ssize_t) len)
+			status = fsalstat(posix2fsal_error(n < 0 ? errno : EIO),
+					  n < 0 ? errno : EIO);
+	}
+
+	gsh_free(buf);
+
+	return status;
+}
+
+/**
+ * @brief Get the size of the file, including dirty data
+ *
+ * Called with the handle's cache_lock held for write.
+ */
+static fsal_status_t wbcache_get_size(struct wbcache_fsal_export *exp,
+				      struct wbcache_fsal_obj_handle *hdl)
+{
+	struct attrlist attrs;
+	fsal_status_t status;
+
+	if (hdl->size_known)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	fsal_prepare_attrs(&attrs, ATTR_SIZE);
+
+	op_ctx->fsal_export = exp->export.sub_export;
+	status = hdl->sub_handle->obj_ops->getattrs(hdl->sub_handle, &attrs);
+	op_ctx->fsal_export = &exp->export;
+
+	if (!FSAL_IS_ERROR(status)) {
+		hdl->size = attrs.filesize;
+		hdl->size_known = true;
+	}
+
+	fsal_release_attrs(&attrs);
+
+	return status;
+}
+
+/**
+ * @brief A journal record read back from disk
+ */
+struct wbcache_replay {
+	struct wbcache_jrec rec;
+	char *wire;
+};
+
+static int wbcache_replay_cmp(const void *a, const void *b)
+{
+	const struct wbcache_jrec *ra, *rb;
+
+	ra = &((const struct wbcache_replay *)a)->rec;
+	rb = &((const struct wbcache_replay *)b)->rec;
+
+	if (ra->fsid_major != rb->fsid_major)
+		return ra->fsid_major < rb->fsid_major ? -1 : 1;
+	if (ra->fsid_minor != rb->fsid_minor)
+		return ra->fsid_minor < rb->fsid_minor ? -1 : 1;
+	if (ra->fileid != rb->fileid)
+		return ra->fileid < rb->fileid ? -1 : 1;
+	if (ra->seq != rb->seq)
+		return ra->seq < rb->seq ? -1 : 1;
+	return 0;
+}
+
+static inline bool wbcache_same_file(const struct wbcache_jrec *a,
+				     const struct wbcache_jrec *b)
+{
+	return a->fsid_major == b->fsid_major &&
+	       a->fsid_minor == b->fsid_minor && a->fileid == b->fileid;
+}
+
+/**
+ * @brief Read the records of a journal up to the first damaged one
+ *
+ * @param[in]  fd     The journal
+ * @param[out] nrecs  Number of records read
+ *
+ * @return The records, to be freed with wbcache_journal_free().
+ */
+static struct wbcache_replay *wbcache_journal_load(int fd, size_t *nrecs)
+{
+	struct wbcache_replay *recs = NULL;
+	size_t allocated = 0;
+	struct wbcache_jrec rec;
+	char wire[NFS4_FHSIZE];
+	char tmp[sizeof(rec) + NFS4_FHSIZE];
+	uint64_t check, off = 0;
+
+	*nrecs = 0;
+
+	for (;;) {
+		if (pread(fd, &rec, sizeof(rec), off) != sizeof(rec))
+			break;
+
+		if (rec.magic != WBCACHE_JREC_MAGIC ||
+		    rec.wire_len > sizeof(wire) ||
+		    pread(fd, wire, rec.wire_len, off + sizeof(rec)) !=
+		    rec.wire_len)
+			break;
+
+		check = rec.check;
+		rec.check = 0;
+		memcpy(tmp, &rec, sizeof(rec));
+		memcpy(tmp + sizeof(rec), wire, rec.wire_len);
+		if (CityHash64(tmp, sizeof(rec) + rec.wire_len) != check)
+			break;
+		rec.check = check;
+
+		if (*nrecs == allocated) {
+			allocated = allocated ? allocated * 2 : 64;
+			recs = gsh_realloc(recs, allocated * sizeof(*recs));
+		}
+
+		recs[*nrecs].rec = rec;
+		recs[*nrecs].wire = gsh_malloc(rec.wire_len);
+		memcpy(recs[*nrecs].wire, wire, rec.wire_len);
+		(*nrecs)++;
+
+		off += sizeof(rec) + rec.wire_len;
+	}
+
+	if (*nrecs != 0)
+		qsort(recs, *nrecs, sizeof(*recs), wbcache_replay_cmp);
+
+	return recs;
+}
+
+static void wbcache_journal_free(struct wbcache_replay *recs, size_t nrecs)
+{
+	size_t i;
+
+	for (i = 0; i < nrecs; i++)
+		gsh_free(recs[i].wire);
+	gsh_free(recs);
+}
+
+/**
+ * @brief Find the records of a file that still count
+ *
+ * The records of the file starting at @a i are [i, *end), in journal
+ * order; only the dirty records after the last clean one count.
+ *
+ * @return The first record that counts, *end if none does.
+ */
+static size_t wbcache_journal_live(const struct wbcache_replay *recs,
+				   size_t nrecs, size_t i, size_t *end)
+{
+	size_t j, k = i;
+
+	for (j = i; j < nrecs && wbcache_same_file(&recs[i].rec, &recs[j].rec);
+	     j++)
+		if (recs[j].rec.type == WBCACHE_JREC_CLEAN)
+			k = j + 1;
+
+	*end = j;
+	return k;
+}
+
+/**
+ * @brief Rewrite the journal with only the records that still count
+ *
+ * The new journal is written aside, synced and renamed over the old
+ * one, so a crash leaves one or the other.  Called with the export lock
+ * held.
+ */
+static void wbcache_journal_compact(struct wbcache_fsal_export *exp)
+{
+	struct wbcache_replay *recs;
+	struct iovec iov[2];
+	size_t nrecs, i, j, k, reclen;
+	uint64_t off = 0;
+	bool ok = false;
+	int fd;
+
+	recs = wbcache_journal_load(exp->journal_fd, &nrecs);
+
+	fd = openat(exp->dir_fd, WBCACHE_JOURNAL_NEW,
+		    O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		goto out;
+
+	for (i = 0; i < nrecs; i = j) {
+		for (k = wbcache_journal_live(recs, nrecs, i, &j); k < j; k++) {
+			iov[0].iov_base = &recs[k].rec;
+			iov[0].iov_len = sizeof(recs[k].rec);
+			iov[1].iov_base = recs[k].wire;
+			iov[1].iov_len = recs[k].rec.wire_len;
+			reclen = iov[0].iov_len + iov[1].iov_len;
+
+			if (pwritev(fd, iov, 2, off) != (ssize_t) reclen)
+				goto out;
+
+			off += reclen;
+		}
+	}
+
+	ok = fdatasync(fd) == 0 &&
+	     renameat(exp->dir_fd, WBCACHE_JOURNAL_NEW, exp->dir_fd,
+		      WBCACHE_JOURNAL) == 0;
+
+out:
+	if (ok) {
+		if (fsync(exp->dir_fd) < 0)
+			LogCrit(COMPONENT_FSAL,
+				"Could not sync cache directory %s: %s",
+				exp->cache_dir, strerror(errno));
+
+		LogDebug(COMPONENT_FSAL,
+			 "Compacted journal of %s from %" PRIu64 " to %"
+			 PRIu64 " bytes", exp->cache_dir, exp->journal_off,
+			 off);
+
+		close(exp->journal_fd);
+		exp->journal_fd = fd;
+		exp->journal_off = off;
+	} else {
+		LogCrit(COMPONENT_FSAL, "Could not compact journal of %s: %s",
+			exp->cache_dir, strerror(errno));
+
+		if (fd >= 0) {
+			close(fd);
+			(void)unlinkat(exp->dir_fd, WBCACHE_JOURNAL_NEW, 0);
+		}
+	}
+
+	/* Do not try again before the journal has doubled */
+	exp->journal_compact_at = MAX(WBCACHE_JOURNAL_COMPACT,
+				      2 * exp->journal_off);
+
+	wbcache_journal_free(recs, nrecs);
+}
+
+/**
+ * @brief Append a record to the export's journal and sync it
+ *
+ * A dirty record must only be appended once the data it describes is on
+ * disk in the cache file, and a clean record must be on disk before that
+ * data can be dropped, or a replay would write stale data back.  Called
+ * with the handle's cache_lock held for write.
+ *
+ * @return true if the record is on disk.
+ */
+static bool wbcache_journal_append(struct wbcache_fsal_export *exp,
+				   struct wbcache_fsal_obj_handle *hdl,
+				   enum wbcache_jrec_type type,
+				   uint64_t offset, uint64_t length)
+{
+	char fh[NFS4_FHSIZE];
+	struct gsh_buffdesc fh_desc = { .addr = fh, .len = sizeof(fh) };
+	struct wbcache_jrec *rec;
+	size_t reclen;
+	fsal_status_t status;
+	bool synced = false;
+	ssize_t n;
+
+	if (hdl->wire.addr == NULL) {
+		op_ctx->fsal_export = exp->export.sub_export;
+		status = hdl->sub_handle->obj_ops->handle_to_wire(
+				hdl->sub_handle, FSAL_DIGEST_NFSV4, &fh_desc);
+		op_ctx->fsal_export = &exp->export;
+
+		if (FSAL_IS_ERROR(status)) {
+			LogCrit(COMPONENT_FSAL,
+				"Could not journal dirty data of fileid %"
+				PRIu64 ": %s", hdl->obj_handle.fileid,
+				msg_fsal_err(status.major));
+			return false;
+		}
+
+		hdl->wire.addr = gsh_malloc(fh_desc.len);
+		hdl->wire.len = fh_desc.len;
+		memcpy(hdl->wire.addr, fh, fh_desc.len);
+	}
+
+	reclen = sizeof(*rec) + hdl->wire.len;
+	rec = alloca(reclen);
+	memset(rec, 0, sizeof(*rec));
+	rec->magic = WBCACHE_JREC_MAGIC;
+	rec->type = type;
+	rec->wire_len = hdl->wire.len;
+	rec->fsid_major = hdl->obj_handle.fsid.major;
+	rec->fsid_minor = hdl->obj_handle.fsid.minor;
+	rec->fileid = hdl->obj_handle.fileid;
+	rec->offset = offset;
+	rec->length = length;
+	memcpy(rec + 1, hdl->wire.addr, hdl->wire.len);
+
+	PTHREAD_MUTEX_lock(&exp->lock);
+
+	rec->seq = exp->journal_seq++;
+	rec->check = CityHash64((char *)rec, reclen);
+
+	n = pwrite(exp->journal_fd, rec, reclen, exp->journal_off);
+	if (n == (ssize_t) reclen) {
+		exp->journal_off += reclen;
+		synced = fdatasync(exp->journal_fd) == 0;
+	}
+
+	if (!synced)
+		LogCrit(COMPONENT_FSAL,
+			"Could not append to journal of %s: %s",
+			exp->cache_dir,
+			n >= 0 && n != (ssize_t) reclen ? "short write"
+							: strerror(errno));
+	else if (exp->journal_off >= exp->journal_compact_at)
+		wbcache_journal_compact(exp);
+
+	PTHREAD_MUTEX_unlock(&exp->lock);
+
+	return synced;
+}
+
+/**
+ * @brief Forget the journal once nothing is dirty
+ */
+static void wbcache_journal_reset(struct wbcache_fsal_export *exp)
+{
+	PTHREAD_MUTEX_lock(&exp->lock);
+
+	if (exp->dirty_files == 0 && exp->journal_off != 0) {
+		if (ftruncate(exp->journal_fd, 0) == 0) {
+			exp->journal_off = 0;
+			exp->journal_compact_at = WBCACHE_JOURNAL_COMPACT;
+			if (fdatasync(exp->journal_fd) < 0)
+				LogCrit(COMPONENT_FSAL,
+					"Could not sync journal of %s: %s",
+					exp->cache_dir, strerror(errno));
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&exp->lock);
+}
+
+/**
+ * @brief Mark a block clean
+ *
+ * Called with the handle's cache_lock held for write.
+ */
+static void wbcache_block_clean(struct wbcache_fsal_export *exp,
+				struct wbcache_block *blk)
+{
+	struct wbcache_fsal_obj_handle *hdl = blk->hdl;
+
+	PTHREAD_MUTEX_lock(&exp->lock);
+
+	(void)atomic_sub_uint64_t(&exp->stats.dirty_bytes,
+				  blk->dirty_end - blk->dirty_start);
+	blk->dirty_start = 0;
+	blk->dirty_end = 0;
+	glist_add_tail(&exp->lru, &blk->lru_link);
+
+	hdl->ndirty--;
+	if (hdl->ndirty == 0)
+		exp->dirty_files--;
+
+	PTHREAD_MUTEX_unlock(&exp->lock);
+}
+
+/**
+ * @brief Add a range to the dirty range of a block
+ *
+ * Called with the handle's cache_lock held for write.
+ */
+static void wbcache_block_dirty_range(struct wbcache_fsal_export *exp,
+				      struct wbcache_block *blk,
+				      uint32_t start, uint32_t end)
+{
+	struct wbcache_fsal_obj_handle *hdl = blk->hdl;
+	uint32_t old = blk->dirty_end - blk->dirty_start;
+
+	PTHREAD_MUTEX_lock(&exp->lock);
+
+	if (!wbcache_block_dirty(blk)) {
+		glist_del(&blk->lru_link);
+		blk->dirty_start = start;
+		blk->dirty_end = end;
+		if (hdl->ndirty++ == 0)
+			exp->dirty_files++;
+	} else {
+		if (start < blk->dirty_start)
+			blk->dirty_start = start;
+		if (end > blk->dirty_end)
+			blk->dirty_end = end;
+	}
+
+	(void)atomic_add_uint64_t(&exp->stats.dirty_bytes,
+				  blk->dirty_end - blk->dirty_start - old);
+
+	PTHREAD_MUTEX_unlock(&exp->lock);
+}
+
+/**
+ * @brief Move blocks just used to the tail of the LRU
+ */
+static void wbcache_touch(struct wbcache_fsal_export *exp,
+			  struct wbcache_fsal_obj_handle *hdl,
+			  uint64_t first, uint64_t last)
+{
+	struct wbcache_block *blk;
+	uint64_t index;
+
+	PTHREAD_MUTEX_lock(&exp->lock);
+
+	for (index = first; index <= last; index++) {
+		blk = wbcache_block_lookup(hdl, index);
+		if (blk != NULL && !wbcache_block_dirty(blk)) {
+			glist_del(&blk->lru_link);
+			glist_add_tail(&exp->lru, &blk->lru_link);
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&exp->lock);
+}
+
+/**
+ * @brief Write a handle's dirty blocks to the sub-FSAL and commit them
+ *
+ * Blocks are written in offset order, contiguous dirty ranges are
+ * coalesced.  Blocks are only marked clean once the commit succeeded,
+ * until then an unstable write to the sub-FSAL may still be lost.
+ * Called with the handle's cache_lock held for write.
+ */
+static fsal_status_t wbcache_flush_locked(struct wbcache_fsal_export *exp,
+					  struct wbcache_fsal_obj_handle *hdl)
+{
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	struct avltree_node *node;
+	struct wbcache_block *blk, *last, *next;
+	size_t buflen = MAX(exp->block_size, WBCACHE_FLUSH_MAX);
+	uint64_t start, end, flushed = 0;
+	char *buf;
+	ssize_t n;
+
+	if (hdl->ndirty == 0)
+		return status;
+
+	buf = gsh_malloc(buflen);
+
+	node = avltree_first(&hdl->blocks);
+	while (node != NULL) {
+		blk = avltree_container_of(node, struct wbcache_block, node_k);
+
+		if (!wbcache_block_dirty(blk)) {
+			node = avltree_next(node);
+			continue;
+		}
+
+		last = blk;
+		start = blk->index * exp->block_size + blk->dirty_start;
+		end = blk->index * exp->block_size + blk->dirty_end;
+		node = avltree_next(node);
+
+		/* Extend the write over following blocks dirty from their
+		 * start, as long as the previous one is dirty to its end.
+		 */
+		while (node != NULL && last->dirty_end == exp->block_size) {
+			next = avltree_container_of(node, struct wbcache_block,
+						    node_k);
+			if (next->index != last->index + 1 ||
+			    !wbcache_block_dirty(next) ||
+			    next->dirty_start != 0 ||
+			    next->index * exp->block_size + next->dirty_end -
+			    start > buflen)
+				break;
+
+			last = next;
+			end = last->index * exp->block_size + last->dirty_end;
+			node = avltree_next(node);
+		}
+
+		if (end > hdl->size)
+			end = hdl->size;
+
+		if (end > start) {
+			n = pread(hdl->cache_fd, buf, end - start, start);
+			if (n != (ssize_t) (end - start)) {
+				status = fsalstat(posix2fsal_error(n < 0 ?
+								   errno : EIO),
+						  n < 0 ? errno : EIO);
+				break;
+			}
+
+			status = wbcache_sub_write(exp, hdl->sub_handle, start,
+						   buf, end - start);
+			if (FSAL_IS_ERROR(status))
+				break;
+
+			flushed += end - start;
+		}
+	}
+
+	gsh_free(buf);
+
+	if (!FSAL_IS_ERROR(status))
+		status = wbcache_sub_commit(exp, hdl->sub_handle);
+
+	/* Until the clean record is on disk a replay would still write the
+	 * cache file back, so its blocks must not be dropped yet.
+	 */
+	if (!FSAL_IS_ERROR(status) &&
+	    !wbcache_journal_append(exp, hdl, WBCACHE_JREC_CLEAN, 0, 0))
+		status = fsalstat(ERR_FSAL_IO, EIO);
+
+	if (FSAL_IS_ERROR(status)) {
+		/* All blocks stay dirty and are retried by the next flush */
+		LogCrit(COMPONENT_FSAL,
+			"Write back of fileid %" PRIu64 " failed: %s",
+			hdl->obj_handle.fileid, msg_fsal_err(status.major));
+		return status;
+	}
+
+	node = avltree_first(&hdl->blocks);
+	while (node != NULL) {
+		blk = avltree_container_of(node, struct wbcache_block, node_k);
+		node = avltree_next(node);
+		if (wbcache_block_dirty(blk))
+			wbcache_block_clean(exp, blk);
+	}
+
+	(void)atomic_inc_uint64_t(&exp->stats.flushes);
+	(void)atomic_add_uint64_t(&exp->stats.flushed_bytes, flushed);
+
+	wbcache_journal_reset(exp);
+
+	return status;
+}
+
+/**
+ * @brief Write back a handle's dirty data
+ */
+fsal_status_t wbcache_flush(struct wbcache_fsal_export *exp,
+			    struct wbcache_fsal_obj_handle *hdl)
+{
+	fsal_status_t status;
+
+	PTHREAD_RWLOCK_wrlock(&hdl->cache_lock);
+	status = wbcache_flush_locked(exp, hdl);
+	PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+
+	return status;
+}
+
+/**
+ * @brief Read through the sub-FSAL, bypassing the cache
+ *
+ * Dirty data is written back first.  Called with the handle's
+ * cache_lock held for write.
+ */
+static fsal_status_t wbcache_read_bypass(struct wbcache_fsal_export *exp,
+					 struct wbcache_fsal_obj_handle *hdl,
+					 struct fsal_io_arg *read_arg)
+{
+	fsal_status_t status;
+
+	status = wbcache_flush_locked(exp, hdl);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	(void)atomic_inc_uint64_t(&exp->stats.read_bypass);
+
+	return wbcache_sub_io(exp, hdl->sub_handle, false, true, read_arg);
+}
+
+/**
+ * @brief Find the access pattern tracker of a reader
+ *
+ * Readers are told apart by their state, and by client for stateless
+ * reads.  A new reader takes over the least recently used tracker.
+ * Called with the handle's ra_mutex held.
+ */
+static struct fsal_readahead *wbcache_ra_find(
+					struct wbcache_fsal_obj_handle *hdl,
+					struct state_t *state)
+{
+	const void *owner = state;
+	struct wbcache_ra *tracker = &hdl->ra[0];
+	int i;
+
+	if (owner == NULL && op_ctx != NULL)
+		owner = op_ctx->client;
+
+	for (i = 0; i < WBCACHE_RA_READERS; i++) {
+		if (hdl->ra[i].owner == owner) {
+			tracker = &hdl->ra[i];
+			goto found;
+		}
+
+		if (hdl->ra[i].used < tracker->used)
+			tracker = &hdl->ra[i];
+	}
+
+	memset(tracker, 0, sizeof(*tracker));
+	tracker->owner = owner;
+
+found:
+	tracker->used = ++hdl->ra_clock;
+	return &tracker->ra;
+}
+
+/**
+ * @brief Feed a cached read to the reader's access pattern tracker
+ */
+static bool wbcache_ra_read(struct wbcache_fsal_obj_handle *hdl,
+			    struct state_t *state, uint64_t offset,
+			    uint64_t length, struct fsal_ra_advice *advice)
+{
+	bool advised;
+
+	PTHREAD_MUTEX_lock(&hdl->ra_mutex);
+	advised = fsal_readahead_read(wbcache_ra_find(hdl, state), offset,
+				      length, advice);
+	PTHREAD_MUTEX_unlock(&hdl->ra_mutex);
+
+	return advised;
+}
+
+/**
+ * @brief Apply IO_ADVISE hints to the reader's access pattern tracker
+ *
+ * @return The hints honoured.
+ */
+uint32_t wbcache_ra_hint(struct wbcache_fsal_obj_handle *hdl,
+			 struct state_t *state,
+			 const struct io_hints *hints,
+			 struct fsal_ra_advice *advice)
+{
+	uint32_t honoured;
+
+	PTHREAD_MUTEX_lock(&hdl->ra_mutex);
+	honoured = fsal_readahead_hint(wbcache_ra_find(hdl, state), hints,
+				       advice);
+	PTHREAD_MUTEX_unlock(&hdl->ra_mutex);
+
+	return honoured;
+}
+
+/**
+ * @brief A prefetch queued on the export's prefetch threads
+ *
+ * The handle waits for its prefetch to stop before it is released, and
+ * the export outlives its handles, so no references are taken.
+ */
+struct wbcache_prefetch_job {
+	struct wbcache_fsal_export *exp;
+	struct wbcache_fsal_obj_handle *hdl;
+	struct gsh_export *export;	/*< For the op context */
+};
+
+/**
+ * @brief Fill the missing blocks of a range ahead of the reader
+ *
+ * Each block is read from the sub-FSAL without cache_lock held and added
+ * unless the file changed or the block was filled meanwhile.  Stops at
+ * end of file, on error, when the cache has no room left, or when the
+ * handle is being released.
+ */
+static void wbcache_prefetch_range(struct wbcache_fsal_export *exp,
+				   struct wbcache_fsal_obj_handle *hdl,
+				   uint64_t offset, uint64_t length)
+{
+	uint64_t first, last, index, bstart, gen;
+	fsal_status_t status;
+	size_t len = 0;
+	bool skip, stop;
+	char *buf;
+	ssize_t n;
+
+	PTHREAD_RWLOCK_wrlock(&hdl->cache_lock);
+
+	status = wbcache_get_size(exp, hdl);
+	if (FSAL_IS_ERROR(status) || offset >= hdl->size ||
+	    wbcache_open_cache_file(exp, hdl) != 0) {
+		PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+		return;
+	}
+
+	if (offset + length > hdl->size)
+		length = hdl->size - offset;
+
+	PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+
+	first = offset / exp->block_size;
+	last = (offset + length - 1) / exp->block_size;
+	buf = gsh_malloc(exp->block_size);
+
+	for (index = first; index <= last; index++) {
+		PTHREAD_MUTEX_lock(&hdl->ra_mutex);
+		stop = hdl->pf_stop;
+		PTHREAD_MUTEX_unlock(&hdl->ra_mutex);
+
+		if (stop)
+			break;
+
+		bstart = index * exp->block_size;
+
+		PTHREAD_RWLOCK_rdlock(&hdl->cache_lock);
+		skip = wbcache_block_lookup(hdl, index) != NULL;
+		gen = hdl->data_gen;
+		if (bstart < hdl->size)
+			len = MIN(exp->block_size, hdl->size - bstart);
+		else
+			len = 0;
+		PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+
+		if (skip)
+			continue;
+
+		if (len == 0)
+			break;
+
+		status = wbcache_sub_read(exp, hdl, NULL, bstart, buf, len);
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		PTHREAD_RWLOCK_wrlock(&hdl->cache_lock);
+
+		if (hdl->data_gen != gen ||
+		    wbcache_block_lookup(hdl, index) != NULL) {
+			PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+			continue;
+		}
+
+		if (!wbcache_reserve(exp, hdl)) {
+			PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+			break;
+		}
+
+		n = pwrite(hdl->cache_fd, buf, len, bstart);
+		if (n != (ssize_t) len) {
+			(void)atomic_sub_uint64_t(&exp->stats.cached_bytes,
+						  exp->block_size);
+			PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+			break;
+		}
+
+		(void)wbcache_block_add(exp, hdl, index);
+
+		PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+	}
+
+	gsh_free(buf);
+}
+
+/**
+ * @brief Run a handle's prefetches until no new range comes in
+ *
+ * @param[in] ctx	Thread context, arg is the job
+ */
+static void wbcache_prefetch_run(struct fridgethr_context *ctx)
+{
+	struct wbcache_prefetch_job *job = ctx->arg;
+	struct wbcache_fsal_obj_handle *hdl = job->hdl;
+	struct root_op_context root_op_context;
+	uint64_t offset, length;
+
+	/* Cache fills are not on behalf of anyone, readers of the cached
+	 * data are checked when they read.
+	 */
+	init_root_op_context(&root_op_context, job->export,
+			     &job->exp->export, 0, 0, NFS_REQUEST);
+
+	PTHREAD_MUTEX_lock(&hdl->ra_mutex);
+
+	while (!hdl->pf_stop) {
+		offset = hdl->pf_offset;
+		length = hdl->pf_length;
+		hdl->pf_again = false;
+		PTHREAD_MUTEX_unlock(&hdl->ra_mutex);
+
+		wbcache_prefetch_range(job->exp, hdl, offset, length);
+
+		PTHREAD_MUTEX_lock(&hdl->ra_mutex);
+		if (!hdl->pf_again)
+			break;
+	}
+
+	hdl->pf_busy = false;
+	pthread_cond_broadcast(&hdl->ra_cond);
+	PTHREAD_MUTEX_unlock(&hdl->ra_mutex);
+
+	release_root_op_context();
+	gsh_free(job);
+}
+
+/**
+ * @brief Prefetch a range of a file ahead of the reader
+ *
+ * The range is read in the background by the export's prefetch threads.
+ * A handle has one prefetch at a time; a range that comes in while one
+ * is queued or running replaces any range not yet started.  At most
+ * FSAL_RA_WINDOW_MAX bytes are read.
+ */
+void wbcache_prefetch(struct wbcache_fsal_export *exp,
+		      struct wbcache_fsal_obj_handle *hdl,
+		      uint64_t offset, uint64_t length)
+{
+	struct wbcache_prefetch_job *job;
+	int rc;
+
+	if (exp->prefetch_fridge == NULL)
+		return;
+
+	if (length == 0 || length > FSAL_RA_WINDOW_MAX)
+		length = FSAL_RA_WINDOW_MAX;
+
+	PTHREAD_MUTEX_lock(&hdl->ra_mutex);
+
+	if (hdl->pf_stop) {
+		PTHREAD_MUTEX_unlock(&hdl->ra_mutex);
+		return;
+	}
+
+	hdl->pf_offset = offset;
+	hdl->pf_length = length;
+
+	if (hdl->pf_busy) {
+		hdl->pf_again = true;
+		PTHREAD_MUTEX_unlock(&hdl->ra_mutex);
+		return;
+	}
+
+	hdl->pf_busy = true;
+
+	PTHREAD_MUTEX_unlock(&hdl->ra_mutex);
+
+	job = gsh_malloc(sizeof(*job));
+	job->exp = exp;
+	job->hdl = hdl;
+	job->export = op_ctx->ctx_export;
+
+	rc = fridgethr_submit(exp->prefetch_fridge, wbcache_prefetch_run, job);
+	if (rc == 0)
+		return;
+
+	LogDebug(COMPONENT_FSAL, "Could not queue prefetch: %d", rc);
+	gsh_free(job);
+
+	PTHREAD_MUTEX_lock(&hdl->ra_mutex);
+	hdl->pf_busy = false;
+	pthread_cond_broadcast(&hdl->ra_cond);
+	PTHREAD_MUTEX_unlock(&hdl->ra_mutex);
+}
+
+/**
+ * @brief Read from the cache, filling missing blocks
+ *
+ * Only single buffer reads are cached.  Readahead advised by the
+ * access pattern tracker is prefetched once the read is done.
+ */
+fsal_status_t wbcache_cache_read(struct wbcache_fsal_export *exp,
+				 struct wbcache_fsal_obj_handle *hdl,
+				 struct fsal_io_arg *read_arg)
+{
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	uint64_t offset = read_arg->offset;
+	uint64_t first, last, index;
+	size_t len = read_arg->iov[0].iov_len;
+	struct fsal_ra_advice advice;
+	bool write_locked = false;
+	bool missed = false;
+	bool prefetch;
+	ssize_t n;
+
+	read_arg->io_amount = 0;
+
+	if (read_arg->iov_count != 1) {
+		PTHREAD_RWLOCK_wrlock(&hdl->cache_lock);
+		status = wbcache_read_bypass(exp, hdl, read_arg);
+		PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+		return status;
+	}
+
+	prefetch = wbcache_ra_read(hdl, read_arg->state, offset, len,
+				   &advice) &&
+		   advice.op == FSAL_RA_WILLNEED;
+
+	PTHREAD_RWLOCK_rdlock(&hdl->cache_lock);
+
+again:
+	if (!hdl->size_known) {
+		if (!write_locked)
+			goto upgrade;
+
+		status = wbcache_get_size(exp, hdl);
+		if (FSAL_IS_ERROR(status))
+			goto out;
+	}
+
+	if (offset >= hdl->size || len == 0) {
+		read_arg->end_of_file = offset >= hdl->size;
+		goto out;
+	}
+
+	if (offset + len > hdl->size)
+		len = hdl->size - offset;
+
+	first = offset / exp->block_size;
+	last = (offset + len - 1) / exp->block_size;
+
+	for (index = first; index <= last; index++) {
+		if (wbcache_block_lookup(hdl, index) != NULL)
+			continue;
+
+		if (!write_locked)
+			goto upgrade;
+
+		missed = true;
+
+		if (wbcache_open_cache_file(exp, hdl) != 0 ||
+		    !wbcache_reserve(exp, hdl)) {
+			status = wbcache_read_bypass(exp, hdl, read_arg);
+			goto out;
+		}
+
+		status = wbcache_block_fill(exp, hdl, read_arg->state, index);
+		if (FSAL_IS_ERROR(status)) {
+			(void)atomic_sub_uint64_t(&exp->stats.cached_bytes,
+						  exp->block_size);
+			goto out;
+		}
+
+		(void)wbcache_block_add(exp, hdl, index);
+	}
+
+	n = pread(hdl->cache_fd, read_arg->iov[0].iov_base, len, offset);
+	if (n < 0) {
+		status = fsalstat(posix2fsal_error(errno), errno);
+		goto out;
+	}
+
+	read_arg->io_amount = n;
+	read_arg->end_of_file = offset + n >= hdl->size;
+
+	wbcache_touch(exp, hdl, first, last);
+
+	if (missed)
+		(void)atomic_inc_uint64_t(&exp->stats.read_misses);
+	else
+		(void)atomic_inc_uint64_t(&exp->stats.read_hits);
+
+out:
+	PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+
+	if (prefetch && !FSAL_IS_ERROR(status) && !read_arg->end_of_file)
+		wbcache_prefetch(exp, hdl, advice.offset, advice.length);
+
+	return status;
+
+upgrade:
+	PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+	PTHREAD_RWLOCK_wrlock(&hdl->cache_lock);
+	write_locked = true;
+	len = read_arg->iov[0].iov_len;
+	goto again;
+}
+
+/**
+ * @brief Drop cached blocks overlapping a range
+ *
+ * Called with the handle's cache_lock held for write.  The blocks must
+ * be clean.
+ */
+static void wbcache_invalidate(struct wbcache_fsal_export *exp,
+			       struct wbcache_fsal_obj_handle *hdl,
+			       uint64_t first, uint64_t last)
+{
+	struct avltree_node *node;
+	struct wbcache_block *blk;
+
+	PTHREAD_MUTEX_lock(&exp->lock);
+
+	node = avltree_first(&hdl->blocks);
+	while (node != NULL) {
+		blk = avltree_container_of(node, struct wbcache_block, node_k);
+		node = avltree_next(node);
+
+		if (blk->index > last)
+			break;
+
+		if (blk->index >= first)
+			wbcache_block_free_locked(exp, blk);
+	}
+
+	PTHREAD_MUTEX_unlock(&exp->lock);
+}
+
+/**
+ * @brief Write through to the sub-FSAL with the caller's stability
+ *
+ * Called with the handle's cache_lock held for write and no dirty data.
+ */
+static fsal_status_t wbcache_write_through(struct wbcache_fsal_export *exp,
+					   struct wbcache_fsal_obj_handle *hdl,
+					   struct fsal_io_arg *write_arg,
+					   bool bypass)
+{
+	uint64_t end = write_arg->offset;
+	fsal_status_t status;
+	int i;
+
+	for (i = 0; i < write_arg->iov_count; i++)
+		end += write_arg->iov[i].iov_len;
+
+	if (end > write_arg->offset && hdl->blocks.first != NULL)
+		wbcache_invalidate(exp, hdl,
+				   write_arg->offset / exp->block_size,
+				   (end - 1) / exp->block_size);
+
+	status = wbcache_sub_io(exp, hdl->sub_handle, true, bypass, write_arg);
+
+	if (!FSAL_IS_ERROR(status)) {
+		if (hdl->size_known &&
+		    write_arg->offset + write_arg->io_amount > hdl->size)
+			hdl->size = write_arg->offset + write_arg->io_amount;
+		(void)atomic_inc_uint64_t(&exp->stats.writes_through);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Write to the cache
+ *
+ * Unstable writes are kept in the cache until the file is flushed.
+ * Stable writes to a file with no dirty data go straight to the
+ * sub-FSAL, otherwise they are cached and the file flushed.
+ */
+fsal_status_t wbcache_cache_write(struct wbcache_fsal_export *exp,
+				  struct wbcache_fsal_obj_handle *hdl,
+				  struct fsal_io_arg *write_arg, bool bypass)
+{
+	fsal_status_t status;
+	uint64_t offset = write_arg->offset;
+	size_t len = write_arg->iov[0].iov_len;
+	uint64_t first, last, index, bstart, bend;
+	struct wbcache_block *blk;
+	bool stable = write_arg->fsal_stable;
+	ssize_t n;
+
+	write_arg->io_amount = 0;
+
+	PTHREAD_RWLOCK_wrlock(&hdl->cache_lock);
+
+	hdl->data_gen++;
+
+	if (write_arg->iov_count != 1 || len == 0 ||
+	    (stable && hdl->ndirty == 0)) {
+		status = wbcache_flush_locked(exp, hdl);
+		if (!FSAL_IS_ERROR(status))
+			status = wbcache_write_through(exp, hdl, write_arg,
+						       bypass);
+		goto out;
+	}
+
+	status = wbcache_get_size(exp, hdl);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	if (wbcache_open_cache_file(exp, hdl) != 0)
+		goto through;
+
+	first = offset / exp->block_size;
+	last = (offset + len - 1) / exp->block_size;
+
+	for (index = first; index <= last; index++) {
+		if (wbcache_block_lookup(hdl, index) != NULL)
+			continue;
+
+		if (!wbcache_reserve(exp, hdl))
+			goto through;
+
+		/* A block only partly covered by the write needs the rest of
+		 * its data from the sub-FSAL.
+		 */
+		bstart = index * exp->block_size;
+		bend = MIN(bstart + exp->block_size, hdl->size);
+		if (bstart < hdl->size &&
+		    (offset > bstart || offset + len < bend)) {
+			status = wbcache_block_fill(exp, hdl, write_arg->state,
+						    index);
+			if (FSAL_IS_ERROR(status)) {
+				(void)atomic_sub_uint64_t(
+					&exp->stats.cached_bytes,
+					exp->block_size);
+				goto out;
+			}
+		}
+
+		(void)wbcache_block_add(exp, hdl, index);
+	}
+
+	/* The data must be on disk before the journal says it is there */
+	n = pwrite(hdl->cache_fd, write_arg->iov[0].iov_base, len, offset);
+	if (n == (ssize_t) len && fdatasync(hdl->cache_fd) < 0)
+		n = -1;
+	if (n != (ssize_t) len) {
+		LogCrit(COMPONENT_FSAL,
+			"Could not write to cache file of fileid %" PRIu64
+			": %s", hdl->obj_handle.fileid,
+			n < 0 ? strerror(errno) : "short write");
+		/* The blocks are left as they were, drop them. */
+		status = wbcache_flush_locked(exp, hdl);
+		if (FSAL_IS_ERROR(status))
+			goto out;
+		wbcache_invalidate(exp, hdl, first, last);
+		goto through;
+	}
+
+	for (index = first; index <= last; index++) {
+		blk = wbcache_block_lookup(hdl, index);
+		bstart = index * exp->block_size;
+		wbcache_block_dirty_range(
+			exp, blk,
+			offset > bstart ? offset - bstart : 0,
+			MIN(offset + len - bstart, exp->block_size));
+	}
+
+	if (offset + len > hdl->size)
+		hdl->size = offset + len;
+
+	now(&hdl->dirty_mtime);
+
+	/* Data the journal does not know about would not survive a crash,
+	 * write it back right away.
+	 */
+	if (!wbcache_journal_append(exp, hdl, WBCACHE_JREC_DIRTY, offset, len))
+		stable = true;
+
+	write_arg->io_amount = len;
+	(void)atomic_inc_uint64_t(&exp->stats.writes_cached);
+
+	if (stable) {
+		status = wbcache_flush_locked(exp, hdl);
+		write_arg->fsal_stable = !FSAL_IS_ERROR(status);
+		if (FSAL_IS_ERROR(status))
+			write_arg->io_amount = 0;
+	} else {
+		write_arg->fsal_stable = false;
+	}
+
+	goto out;
+
+through:
+	status = wbcache_flush_locked(exp, hdl);
+	if (!FSAL_IS_ERROR(status))
+		status = wbcache_write_through(exp, hdl, write_arg, bypass);
+
+out:
+	PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+	return status;
+}
+
+/**
+ * @brief Write back dirty data and drop blocks beyond a new file size
+ *
+ * Called before the size of the file is changed in the sub-FSAL.
+ */
+fsal_status_t wbcache_truncate(struct wbcache_fsal_export *exp,
+			       struct wbcache_fsal_obj_handle *hdl,
+			       uint64_t size)
+{
+	struct avltree_node *node;
+	struct wbcache_block *blk;
+	fsal_status_t status;
+	uint64_t bstart;
+
+	PTHREAD_RWLOCK_wrlock(&hdl->cache_lock);
+
+	hdl->data_gen++;
+
+	status = wbcache_flush_locked(exp, hdl);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	PTHREAD_MUTEX_lock(&exp->lock);
+
+	node = avltree_first(&hdl->blocks);
+	while (node != NULL) {
+		blk = avltree_container_of(node, struct wbcache_block, node_k);
+		node = avltree_next(node);
+
+		bstart = blk->index * exp->block_size;
+		if (bstart >= size) {
+			wbcache_block_free_locked(exp, blk);
+		} else if (bstart + exp->block_size > size) {
+			/* Zero what is now past the end of file */
+			wbcache_punch(exp, hdl, size,
+				      bstart + exp->block_size - size);
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&exp->lock);
+
+	/* The sub-FSAL sets the size, refetch it next time */
+	hdl->size_known = false;
+
+out:
+	PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+	return status;
+}
+
+/**
+ * @brief Write back dirty data and drop blocks overlapping a range
+ *
+ * Called before the sub-FSAL changes the range behind our back, as
+ * fallocate does.
+ */
+fsal_status_t wbcache_invalidate_range(struct wbcache_fsal_export *exp,
+				       struct wbcache_fsal_obj_handle *hdl,
+				       uint64_t offset, uint64_t length)
+{
+	fsal_status_t status;
+
+	PTHREAD_RWLOCK_wrlock(&hdl->cache_lock);
+
+	hdl->data_gen++;
+
+	status = wbcache_flush_locked(exp, hdl);
+	if (!FSAL_IS_ERROR(status)) {
+		if (length != 0 && hdl->blocks.first != NULL)
+			wbcache_invalidate(exp, hdl, offset / exp->block_size,
+					   (offset + length - 1) /
+					   exp->block_size);
+
+		/* The file may grow */
+		hdl->size_known = false;
+	}
+
+	PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+
+	return status;
+}
+
+/**
+ * @brief Drop all cached data of a file without writing it back
+ *
+ * Used when the file is gone.
+ */
+void wbcache_discard(struct wbcache_fsal_export *exp,
+		     struct wbcache_fsal_obj_handle *hdl)
+{
+	struct avltree_node *node;
+	bool dirty;
+
+	PTHREAD_RWLOCK_wrlock(&hdl->cache_lock);
+
+	hdl->data_gen++;
+	dirty = hdl->ndirty != 0;
+
+	PTHREAD_MUTEX_lock(&exp->lock);
+	while ((node = avltree_first(&hdl->blocks)) != NULL)
+		wbcache_block_free_locked(exp,
+					  avltree_container_of(
+						node, struct wbcache_block,
+						node_k));
+	PTHREAD_MUTEX_unlock(&exp->lock);
+
+	if (dirty) {
+		(void)wbcache_journal_append(exp, hdl, WBCACHE_JREC_CLEAN, 0, 0);
+		wbcache_journal_reset(exp);
+	}
+
+	PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+}
+
+/**
+ * @brief Account for dirty data in attributes from the sub-FSAL
+ */
+void wbcache_fixup_attrs(struct wbcache_fsal_obj_handle *hdl,
+			 struct attrlist *attrs)
+{
+	PTHREAD_RWLOCK_rdlock(&hdl->cache_lock);
+
+	if (hdl->ndirty != 0) {
+		if (FSAL_TEST_MASK(attrs->valid_mask, ATTR_SIZE) &&
+		    hdl->size_known && hdl->size > attrs->filesize) {
+			attrs->filesize = hdl->size;
+		}
+
+		if (FSAL_TEST_MASK(attrs->valid_mask, ATTR_MTIME) &&
+		    gsh_time_cmp(&hdl->dirty_mtime, &attrs->mtime) > 0)
+			attrs->mtime = hdl->dirty_mtime;
+
+		if (FSAL_TEST_MASK(attrs->valid_mask, ATTR_CTIME) &&
+		    gsh_time_cmp(&hdl->dirty_mtime, &attrs->ctime) > 0)
+			attrs->ctime = hdl->dirty_mtime;
+	}
+
+	PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+}
+
+/**
+ * @brief Set up the cache state of a new handle
+ *
+ * Dirty data left by an earlier handle of the same file is taken over,
+ * so that it is not overwritten and is retried by the next flush.
+ */
+void wbcache_handle_cache_init(struct wbcache_fsal_export *exp,
+			       struct wbcache_fsal_obj_handle *hdl)
+{
+	struct wbcache_orphan *orphan = NULL;
+	struct glist_head *glist;
+	struct avltree_node *node;
+	struct wbcache_block *blk;
+
+	PTHREAD_RWLOCK_init(&hdl->cache_lock, NULL);
+	PTHREAD_MUTEX_init(&hdl->ra_mutex, NULL);
+	PTHREAD_COND_init(&hdl->ra_cond, NULL);
+	avltree_init(&hdl->blocks, wbcache_block_cmpf, 0);
+	hdl->cache_fd = -1;
+
+	if (!wbcache_cacheable(hdl))
+		return;
+
+	PTHREAD_MUTEX_lock(&exp->lock);
+
+	glist_for_each(glist, &exp->orphans) {
+		orphan = glist_entry(glist, struct wbcache_orphan, link);
+		if (orphan->fileid == hdl->obj_handle.fileid &&
+		    orphan->fsid.major == hdl->obj_handle.fsid.major &&
+		    orphan->fsid.minor == hdl->obj_handle.fsid.minor)
+			break;
+		orphan = NULL;
+	}
+
+	/* The handle is not published yet, nobody else can see its blocks */
+	if (orphan != NULL && wbcache_open_cache_file(exp, hdl) == 0) {
+		glist_del(&orphan->link);
+
+		while ((node = avltree_first(&orphan->blocks)) != NULL) {
+			blk = avltree_container_of(node, struct wbcache_block,
+						   node_k);
+			avltree_remove(node, &orphan->blocks);
+			blk->hdl = hdl;
+			(void)avltree_insert(node, &hdl->blocks);
+		}
+
+		hdl->ndirty = orphan->ndirty;
+		hdl->size = orphan->size;
+		hdl->size_known = true;
+		hdl->dirty_mtime = orphan->dirty_mtime;
+		hdl->wire = orphan->wire;
+		gsh_free(orphan);
+	}
+
+	PTHREAD_MUTEX_unlock(&exp->lock);
+}
+
+/**
+ * @brief Keep the dirty blocks of a handle being released
+ *
+ * Used when they could not be written back.  The dirty blocks stay in
+ * the cache file and the journal, and still count as dirty so that the
+ * journal is not reset.  Clean blocks are dropped.
+ */
+static void wbcache_orphan(struct wbcache_fsal_export *exp,
+			   struct wbcache_fsal_obj_handle *hdl)
+{
+	struct wbcache_orphan *orphan = gsh_calloc(1, sizeof(*orphan));
+	struct avltree_node *node, *next;
+	struct wbcache_block *blk;
+
+	orphan->fsid = hdl->obj_handle.fsid;
+	orphan->fileid = hdl->obj_handle.fileid;
+	avltree_init(&orphan->blocks, wbcache_block_cmpf, 0);
+
+	/* The evictor may still try-lock us for a clean block */
+	PTHREAD_RWLOCK_wrlock(&hdl->cache_lock);
+	PTHREAD_MUTEX_lock(&exp->lock);
+
+	orphan->ndirty = hdl->ndirty;
+	orphan->size = hdl->size;
+	orphan->dirty_mtime = hdl->dirty_mtime;
+	orphan->wire = hdl->wire;
+	hdl->wire.addr = NULL;
+
+	for (node = avltree_first(&hdl->blocks); node != NULL; node = next) {
+		next = avltree_next(node);
+		blk = avltree_container_of(node, struct wbcache_block, node_k);
+
+		if (!wbcache_block_dirty(blk)) {
+			wbcache_block_free_locked(exp, blk);
+			continue;
+		}
+
+		avltree_remove(node, &hdl->blocks);
+		blk->hdl = NULL;
+		(void)avltree_insert(node, &orphan->blocks);
+	}
+
+	hdl->ndirty = 0;
+	glist_add_tail(&exp->orphans, &orphan->link);
+
+	PTHREAD_MUTEX_unlock(&exp->lock);
+	PTHREAD_RWLOCK_unlock(&hdl->cache_lock);
+}
+
+/**
+ * @brief Write back and drop a handle's cache before it is released
+ *
+ * Dirty data that cannot be written back is kept for the next handle of
+ * the file, or for the journal replay at the next start.
+ */
+void wbcache_handle_cache_fini(struct wbcache_fsal_export *exp,
+			       struct wbcache_fsal_obj_handle *hdl)
+{
+	char name[64];
+
+	/* Wait for the prefetch, it stops at its next block */
+	PTHREAD_MUTEX_lock(&hdl->ra_mutex);
+	hdl->pf_stop = true;
+	while (hdl->pf_busy)
+		pthread_cond_wait(&hdl->ra_cond, &hdl->ra_mutex);
+	PTHREAD_MUTEX_unlock(&hdl->ra_mutex);
+
+	if (hdl->ndirty != 0)
+		(void)wbcache_flush(exp, hdl);
+
+	if (hdl->ndirty == 0) {
+		wbcache_discard(exp, hdl);
+
+		if (hdl->cache_fd >= 0) {
+			(void)snprintf(name, sizeof(name), "%" PRIx64 ".%"
+				       PRIx64 ".%" PRIx64,
+				       hdl->obj_handle.fsid.major,
+				       hdl->obj_handle.fsid.minor,
+				       hdl->obj_handle.fileid);
+			(void)unlinkat(exp->dir_fd, name, 0);
+		}
+	} else {
+		LogCrit(COMPONENT_FSAL,
+			"Dirty data of fileid %" PRIu64
+			" is kept in the cache after a failed write back",
+			hdl->obj_handle.fileid);
+		wbcache_orphan(exp, hdl);
+	}
+
+	if (hdl->cache_fd >= 0)
+		close(hdl->cache_fd);
+
+	gsh_free(hdl->wire.addr);
+	PTHREAD_COND_destroy(&hdl->ra_cond);
+	PTHREAD_MUTEX_destroy(&hdl->ra_mutex);
+	PTHREAD_RWLOCK_destroy(&hdl->cache_lock);
+}
+
+/**
+ * @brief Open the cache directory and journal of an export
+ *
+ * @return 0 or an errno.
+ */
+int wbcache_export_cache_init(struct wbcache_fsal_export *exp,
+			      const char *cache_root, uint16_t export_id)
+{
+	struct fridgethr_params frp;
+	char path[MAXPATHLEN];
+	int retval, n;
+
+	glist_init(&exp->lru);
+	glist_init(&exp->orphans);
+	PTHREAD_MUTEX_init(&exp->lock, NULL);
+	exp->dir_fd = -1;
+	exp->journal_fd = -1;
+	exp->journal_compact_at = WBCACHE_JOURNAL_COMPACT;
+	exp->prefetch_fridge = NULL;
+
+	n = snprintf(path, sizeof(path), "%s/export-%" PRIu16, cache_root,
+		     export_id);
+	if (n < 0 || n >= (int) sizeof(path))
+		return ENAMETOOLONG;
+
+	exp->cache_dir = gsh_strdup(path);
+
+	if (mkdir(cache_root, 0700) < 0 && errno != EEXIST) {
+		retval = errno;
+		goto err;
+	}
+
+	if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+		retval = errno;
+		goto err;
+	}
+
+	exp->dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (exp->dir_fd < 0) {
+		retval = errno;
+		goto err;
+	}
+
+	exp->journal_fd = openat(exp->dir_fd, WBCACHE_JOURNAL,
+				 O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (exp->journal_fd < 0) {
+		retval = errno;
+		goto err;
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = WBCACHE_PREFETCH_THREADS;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	retval = fridgethr_init(&exp->prefetch_fridge, "WBC_prefetch", &frp);
+	if (retval != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to start prefetch threads of %s, error %d, prefetch is off",
+			 path, retval);
+		exp->prefetch_fridge = NULL;
+	}
+
+	return 0;
+
+err:
+	LogCrit(COMPONENT_FSAL, "Could not set up cache directory %s: %s",
+		path, strerror(retval));
+	return retval;
+}
+
+/**
+ * @brief Close the cache of an export
+ *
+ * Dirty data of released handles is still in the journal and is written
+ * back when the export is next created.
+ */
+void wbcache_export_cache_fini(struct wbcache_fsal_export *exp)
+{
+	struct wbcache_orphan *orphan;
+	struct avltree_node *node;
+	int rc;
+
+	/* All handles are gone, so are their prefetches */
+	if (exp->prefetch_fridge != NULL) {
+		rc = fridgethr_sync_command(exp->prefetch_fridge,
+					    fridgethr_comm_stop, 120);
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_FSAL,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(exp->prefetch_fridge);
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_FSAL,
+				 "Failed shutting down prefetch threads: %d",
+				 rc);
+		}
+
+		fridgethr_destroy(exp->prefetch_fridge);
+		exp->prefetch_fridge = NULL;
+	}
+
+	while ((orphan = glist_first_entry(&exp->orphans,
+					   struct wbcache_orphan,
+					   link)) != NULL) {
+		glist_del(&orphan->link);
+		while ((node = avltree_first(&orphan->blocks)) != NULL) {
+			avltree_remove(node, &orphan->blocks);
+			gsh_free(avltree_container_of(node,
+						      struct wbcache_block,
+						      node_k));
+		}
+		gsh_free(orphan->wire.addr);
+		gsh_free(orphan);
+	}
+
+	if (exp->journal_fd >= 0)
+		close(exp->journal_fd);
+
+	if (exp->dir_fd >= 0)
+		close(exp->dir_fd);
+
+	gsh_free(exp->cache_dir);
+	PTHREAD_MUTEX_destroy(&exp->lock);
+}
+
+/** Suffix of files kept after a failed write back at start */
+#define WBCACHE_UNFLUSHED ".unflushed"
+
+static void wbcache_keep(struct wbcache_fsal_export *exp, const char *name,
+			 const char *suffix)
+{
+	char kept[96];
+
+	(void)snprintf(kept, sizeof(kept), "%s%s", name, suffix);
+
+	if (renameat(exp->dir_fd, name, exp->dir_fd, kept) < 0)
+		LogCrit(COMPONENT_FSAL, "Could not rename %s/%s: %s",
+			exp->cache_dir, name, strerror(errno));
+}
+
+/**
+ * @brief Write back the dirty extents of one file found in the journal
+ *
+ * If that fails the cache file is renamed, adding @a suffix, so that it
+ * is neither reused nor removed.
+ *
+ * @return true if all extents were written back and committed.
+ */
+static bool wbcache_replay_file(struct wbcache_fsal_export *exp,
+				struct wbcache_replay *recs, size_t nrecs,
+				const char *suffix)
+{
+	struct fsal_export *sub_export = exp->export.sub_export;
+	struct fsal_obj_handle *sub_handle = NULL;
+	char fh[NFS4_FHSIZE];
+	struct gsh_buffdesc fh_desc;
+	fsal_status_t status;
+	char name[64];
+	char *buf = NULL;
+	size_t i, buflen = 0;
+	bool ok = false;
+	int fd;
+	ssize_t n;
+
+	(void)snprintf(name, sizeof(name), "%" PRIx64 ".%" PRIx64 ".%" PRIx64,
+		       recs[0].rec.fsid_major, recs[0].rec.fsid_minor,
+		       recs[0].rec.fileid);
+
+	fd = openat(exp->dir_fd, name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Cache file %s/%s of dirty data is missing: %s",
+			exp->cache_dir, name, strerror(errno));
+		return false;
+	}
+
+	memcpy(fh, recs[0].wire, recs[0].rec.wire_len);
+	fh_desc.addr = fh;
+	fh_desc.len = recs[0].rec.wire_len;
+
+	op_ctx->fsal_export = sub_export;
+	status = sub_export->exp_ops.wire_to_host(sub_export,
+						  FSAL_DIGEST_NFSV4,
+						  &fh_desc, 0);
+	if (!FSAL_IS_ERROR(status))
+		status = sub_export->exp_ops.create_handle(sub_export,
+							   &fh_desc,
+							   &sub_handle, NULL);
+	op_ctx->fsal_export = &exp->export;
+
+	if (FSAL_IS_ERROR(status)) {
+		LogCrit(COMPONENT_FSAL,
+			"Dirty data in %s/%s is for a file that is gone: %s",
+			exp->cache_dir, name, msg_fsal_err(status.major));
+		close(fd);
+		wbcache_keep(exp, name, suffix);
+		return false;
+	}
+
+	for (i = 0; i < nrecs; i++) {
+		if (recs[i].rec.length > buflen) {
+			buflen = recs[i].rec.length;
+			buf = gsh_realloc(buf, buflen);
+		}
+
+		n = pread(fd, buf, recs[i].rec.length, recs[i].rec.offset);
+		if (n != (ssize_t) recs[i].rec.length) {
+			LogCrit(COMPONENT_FSAL,
+				"Could not read dirty data from %s/%s",
+				exp->cache_dir, name);
+			goto out;
+		}
+
+		status = wbcache_sub_write(exp, sub_handle, recs[i].rec.offset,
+					   buf, recs[i].rec.length);
+		if (FSAL_IS_ERROR(status))
+			goto out;
+	}
+
+	status = wbcache_sub_commit(exp, sub_handle);
+	ok = !FSAL_IS_ERROR(status);
+
+	LogEvent(COMPONENT_FSAL,
+		 "Wrote back %zu dirty extents of fileid %" PRIu64
+		 " from %s: %s", nrecs, recs[0].rec.fileid, exp->cache_dir,
+		 msg_fsal_err(status.major));
+
+out:
+	gsh_free(buf);
+	close(fd);
+
+	op_ctx->fsal_export = sub_export;
+	sub_handle->obj_ops->release(sub_handle);
+	op_ctx->fsal_export = &exp->export;
+
+	if (!ok)
+		wbcache_keep(exp, name, suffix);
+
+	return ok;
+}
+
+/**
+ * @brief Remove the cache files of an export
+ */
+static void wbcache_wipe(struct wbcache_fsal_export *exp)
+{
+	DIR *dir;
+	struct dirent *de;
+	int fd = dup(exp->dir_fd);
+
+	if (fd < 0)
+		return;
+
+	dir = fdopendir(fd);
+	if (dir == NULL) {
+		close(fd);
+		return;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		if (de->d_name[0] == '.' ||
+		    strcmp(de->d_name, WBCACHE_JOURNAL) == 0 ||
+		    strstr(de->d_name, WBCACHE_UNFLUSHED) != NULL)
+			continue;
+		(void)unlinkat(exp->dir_fd, de->d_name, 0);
+	}
+
+	closedir(dir);
+}
+
+/**
+ * @brief Write back dirty data left by a previous run
+ *
+ * Reads the journal up to the first damaged record, writes back every
+ * extent journaled dirty and not followed by a clean record for its
+ * file, then starts with an empty cache.  Called from create_export,
+ * with op_ctx->fsal_export set to the WBCACHE export.
+ */
+void wbcache_replay_journal(struct wbcache_fsal_export *exp)
+{
+	struct wbcache_replay *recs;
+	size_t nrecs, i, j, k, failed = 0;
+	uint64_t stamp = time(NULL);
+	char suffix[40], kept[64];
+
+	/* What an earlier failed replay kept must not be overwritten */
+	do {
+		(void)snprintf(suffix, sizeof(suffix),
+			       WBCACHE_UNFLUSHED ".%" PRIu64, stamp++);
+		(void)snprintf(kept, sizeof(kept), WBCACHE_JOURNAL "%s",
+			       suffix);
+	} while (faccessat(exp->dir_fd, kept, F_OK, 0) == 0);
+
+	recs = wbcache_journal_load(exp->journal_fd, &nrecs);
+
+	for (i = 0; i < nrecs; i = j) {
+		k = wbcache_journal_live(recs, nrecs, i, &j);
+		if (k < j && !wbcache_replay_file(exp, recs + k, j - k, suffix))
+			failed++;
+	}
+
+	wbcache_journal_free(recs, nrecs);
+
+	if (failed != 0) {
+		/* Keep the journal next to the renamed cache files, it tells
+		 * which of their extents were dirty.
+		 */
+		LogCrit(COMPONENT_FSAL,
+			"%zu files with dirty data in %s could not be written back, their cache files and the journal are kept with suffix %s",
+			failed, exp->cache_dir, suffix);
+		if (renameat(exp->dir_fd, WBCACHE_JOURNAL, exp->dir_fd,
+			     kept) < 0)
+			LogCrit(COMPONENT_FSAL,
+				"Could not rename journal of %s: %s",
+				exp->cache_dir, strerror(errno));
+		close(exp->journal_fd);
+		exp->journal_fd = openat(exp->dir_fd, WBCACHE_JOURNAL,
+					 O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if (exp->journal_fd < 0)
+			LogCrit(COMPONENT_FSAL,
+				"Could not create journal of %s: %s",
+				exp->cache_dir, strerror(errno));
+	}
+
+	wbcache_wipe(exp);
+
+	if (ftruncate(exp->journal_fd, 0) < 0)
+		LogCrit(COMPONENT_FSAL, "Could not reset journal of %s: %s",
+			exp->cache_dir, strerror(errno));
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Append the cache counters of every WBCACHE export
+ *
+ * The reply is the FSAL name, an array of per export counters and a
+ * status message.
+ */
+void wbcache_extract_stats(struct fsal_module *fsal_hdl, void *iter)
+{
+	DBusMessageIter *iter1 = iter;
+	DBusMessageIter array_iter, struct_iter;
+	struct glist_head *glist;
+	struct fsal_export *exp_hdl;
+	struct wbcache_fsal_export *exp;
+	struct wbcache_stats st;
+	char *message = "WBCACHE";
+	uint64_t *val;
+	unsigned int i;
+
+	dbus_message_iter_append_basic(iter1, DBUS_TYPE_STRING, &message);
+	dbus_message_iter_open_container(iter1, DBUS_TYPE_ARRAY,
+					 "(qtttttttttt)", &array_iter);
+
+	PTHREAD_RWLOCK_rdlock(&fsal_hdl->lock);
+
+	glist_for_each(glist, &fsal_hdl->exports) {
+		exp_hdl = glist_entry(glist, struct fsal_export, exports);
+		exp = container_of(exp_hdl, struct wbcache_fsal_export,
+				   export);
+
+		/* Copy the counters one by one, they change under us */
+		for (i = 0, val = (uint64_t *) &exp->stats;
+		     i < sizeof(st) / sizeof(uint64_t); i++)
+			((uint64_t *) &st)[i] = atomic_fetch_uint64_t(&val[i]);
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT16,
+					       &exp_hdl->export_id);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st.read_hits);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st.read_misses);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st.read_bypass);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st.writes_cached);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st.writes_through);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st.flushes);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st.flushed_bytes);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st.evictions);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st.cached_bytes);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st.dirty_bytes);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	PTHREAD_RWLOCK_unlock(&fsal_hdl->lock);
+
+	dbus_message_iter_close_container(iter1, &array_iter);
+
+	message = "OK";
+	dbus_message_iter_append_basic(iter1, DBUS_TYPE_STRING, &message);
+}
+#endif
+
+/**
+ * @brief Reset the event counters of every WBCACHE export
+ *
+ * cached_bytes and dirty_bytes describe the cache and are kept.
+ */
+void wbcache_reset_stats(struct fsal_module *fsal_hdl)
+{
+	struct glist_head *glist;
+	struct wbcache_fsal_export *exp;
+
+	PTHREAD_RWLOCK_rdlock(&fsal_hdl->lock);
+
+	glist_for_each(glist, &fsal_hdl->exports) {
+		exp = container_of(glist_entry(glist, struct fsal_export,
+					       exports),
+				   struct wbcache_fsal_export, export);
+
+		atomic_store_uint64_t(&exp->stats.read_hits, 0);
+		atomic_store_uint64_t(&exp->stats.read_misses, 0);
+		atomic_store_uint64_t(&exp->stats.read_bypass, 0);
+		atomic_store_uint64_t(&exp->stats.writes_cached, 0);
+		atomic_store_uint64_t(&exp->stats.writes_through, 0);
+		atomic_store_uint64_t(&exp->stats.flushes, 0);
+		atomic_store_uint64_t(&exp->stats.flushed_bytes, 0);
+		atomic_store_uint64_t(&exp->stats.evictions, 0);
+	}
+
+	PTHREAD_RWLOCK_unlock(&fsal_hdl->lock);
+}
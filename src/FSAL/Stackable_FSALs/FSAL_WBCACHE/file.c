@@ -0,0 +1,536 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* file.c
+ * File I/O methods for WBCACHE module
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include "fsal.h"
+#include "FSAL/access_check.h"
+#include "fsal_convert.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "FSAL/fsal_commonlib.h"
+#include "wbcache_methods.h"
+
+/**
+ * @brief Callback arg for WBCACHE async callbacks
+ *
+ * WBCACHE needs to know what its object is related to the sub-FSAL's
+ * object.  This wraps the given callback arg with WBCACHE specific info
+ */
+struct wbcache_async_arg {
+	struct fsal_obj_handle *obj_hdl;	/**< WBCACHE's handle */
+	fsal_async_cb cb;			/**< Wrapped callback */
+	void *cb_arg;				/**< Wrapped callback data */
+};
+
+/**
+ * @brief Callback for WBCACHE async calls
+ *
+ * Unstack, and call up.
+ *
+ * @param[in] obj		Object being acted on
+ * @param[in] ret		Return status of call
+ * @param[in] obj_data		Data for call
+ * @param[in] caller_data	Data for caller
+ */
+void wbcache_async_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+		   void *obj_data, void *caller_data)
+{
+	struct fsal_export *save_exp = op_ctx->fsal_export;
+	struct wbcache_async_arg *arg = caller_data;
+
+	op_ctx->fsal_export = save_exp->super_export;
+	arg->cb(arg->obj_hdl, ret, obj_data, arg->cb_arg);
+	op_ctx->fsal_export = save_exp;
+
+	gsh_free(arg);
+}
+
+/* wbcache_close
+ * Write back dirty data and close the file if it is still open.
+ * Yes, we ignor lock status.  Closing a file in POSIX
+ * releases all locks but that is state and cache inode's problem.
+ */
+
+fsal_status_t wbcache_close(struct fsal_obj_handle *obj_hdl)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* Data that could not be written back stays dirty and is retried
+	 * later, that is no reason to keep the file open.
+	 */
+	if (wbcache_cacheable(handle))
+		(void)wbcache_flush(export, handle);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->close(handle->sub_handle);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t wbcache_open2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags,
+			   enum fsal_create_mode createmode,
+			   const char *name,
+			   struct attrlist *attrs_in,
+			   fsal_verifier_t verifier,
+			   struct fsal_obj_handle **new_obj,
+			   struct attrlist *attrs_out,
+			   bool *caller_perm_check)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	struct fsal_obj_handle *sub_handle = NULL;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->open2(handle->sub_handle, state,
+						  openflags, createmode, name,
+						  attrs_in, verifier,
+						  &sub_handle, attrs_out,
+						  caller_perm_check);
+	op_ctx->fsal_export = &export->export;
+
+	if (sub_handle) {
+		/* wrap the subfsal handle in a wbcache handle. */
+		return wbcache_alloc_and_check_handle(export, sub_handle,
+						     obj_hdl->fs, new_obj,
+						     status);
+	}
+
+	return status;
+}
+
+bool wbcache_check_verifier(struct fsal_obj_handle *obj_hdl,
+			   fsal_verifier_t verifier)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	bool result =
+		handle->sub_handle->obj_ops->check_verifier(handle->sub_handle,
+							   verifier);
+	op_ctx->fsal_export = &export->export;
+
+	return result;
+}
+
+fsal_openflags_t wbcache_status2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_openflags_t result =
+		handle->sub_handle->obj_ops->status2(handle->sub_handle,
+						    state);
+	op_ctx->fsal_export = &export->export;
+
+	return result;
+}
+
+fsal_status_t wbcache_reopen2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     fsal_openflags_t openflags)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->reopen2(handle->sub_handle,
+						    state, openflags);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+void wbcache_read2(struct fsal_obj_handle *obj_hdl,
+		  bool bypass,
+		  fsal_async_cb done_cb,
+		  struct fsal_io_arg *read_arg,
+		  void *caller_arg)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	struct wbcache_async_arg *arg;
+	fsal_status_t status;
+
+	if (wbcache_cacheable(handle)) {
+		status = wbcache_cache_read(export, handle, read_arg);
+		done_cb(obj_hdl, status, read_arg, caller_arg);
+		return;
+	}
+
+	/* Set up async callback */
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->read2(handle->sub_handle, bypass,
+					  wbcache_async_cb, read_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+void wbcache_write2(struct fsal_obj_handle *obj_hdl,
+		   bool bypass,
+		   fsal_async_cb done_cb,
+		   struct fsal_io_arg *write_arg,
+		   void *caller_arg)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	struct wbcache_async_arg *arg;
+	fsal_status_t status;
+
+	if (wbcache_cacheable(handle)) {
+		status = wbcache_cache_write(export, handle, write_arg, bypass);
+		done_cb(obj_hdl, status, write_arg, caller_arg);
+		return;
+	}
+
+	/* Set up async callback */
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->write2(handle->sub_handle, bypass,
+					   wbcache_async_cb, write_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+fsal_status_t wbcache_seek2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   struct io_info *info)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* Holes and data are only known to the sub-FSAL */
+	if (wbcache_cacheable(handle)) {
+		status = wbcache_flush(export, handle);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->seek2(handle->sub_handle, state,
+						    info);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t wbcache_io_advise2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				struct io_hints *hints)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	struct fsal_ra_advice advice;
+	struct io_hints sub_hints = *hints;
+	uint32_t honoured = 0;
+	fsal_status_t status;
+
+	if (wbcache_cacheable(handle)) {
+		honoured = wbcache_ra_hint(handle, state, hints, &advice);
+		if (advice.op == FSAL_RA_WILLNEED)
+			wbcache_prefetch(export, handle, advice.offset,
+					 advice.length);
+	}
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->io_advise2(handle->sub_handle,
+							 state, &sub_hints);
+	op_ctx->fsal_export = &export->export;
+
+	hints->hints = honoured;
+	if (!FSAL_IS_ERROR(status))
+		hints->hints |= sub_hints.hints;
+
+	/* What the cache honoured is enough */
+	if (status.major == ERR_FSAL_NOTSUPP && honoured != 0)
+		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	return status;
+}
+
+fsal_status_t wbcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			     size_t len)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* Write back everything cached, the dirty ranges are not worth
+	 * matching against the committed range.
+	 */
+	if (wbcache_cacheable(handle)) {
+		status = wbcache_flush(export, handle);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->commit2(handle->sub_handle,
+						      offset, len);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t wbcache_lock_op2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      void *p_owner,
+			      fsal_lock_op_t lock_op,
+			      fsal_lock_param_t *req_lock,
+			      fsal_lock_param_t *conflicting_lock)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->lock_op2(handle->sub_handle, state,
+						     p_owner, lock_op, req_lock,
+						     conflicting_lock);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t wbcache_close2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* As for wbcache_close, a failed write back is retried later */
+	if (wbcache_cacheable(handle))
+		(void)wbcache_flush(export, handle);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->close2(handle->sub_handle, state);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t wbcache_fallocate(struct fsal_obj_handle *obj_hdl,
+			       struct state_t *state, uint64_t offset,
+			       uint64_t length, bool allocate)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	if (wbcache_cacheable(handle)) {
+		status = wbcache_invalidate_range(export, handle, offset,
+						  length);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->fallocate(handle->sub_handle,
+							state, offset, length,
+							allocate);
+	op_ctx->fsal_export = &export->export;
+	return status;
+}
+
+fsal_status_t wbcache_copy_range2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *dst_state,
+				  uint64_t dst_offset,
+				  struct fsal_obj_handle *src_hdl,
+				  struct state_t *src_state,
+				  uint64_t src_offset,
+				  uint64_t count,
+				  uint32_t flags,
+				  uint64_t *copied)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+	struct wbcache_fsal_obj_handle *src =
+		container_of(src_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* The sub-FSAL copies what it has, so it must have the source's
+	 * dirty data, and the cache must not shadow the destination.
+	 */
+	if (wbcache_cacheable(src)) {
+		status = wbcache_flush(export, src);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	if (wbcache_cacheable(handle)) {
+		status = wbcache_invalidate_range(export, handle, dst_offset,
+						  count);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->copy_range2(handle->sub_handle,
+							  dst_state, dst_offset,
+							  src->sub_handle,
+							  src_state, src_offset,
+							  count, flags, copied);
+	op_ctx->fsal_export = &export->export;
+	return status;
+}
+
+fsal_status_t wbcache_write_same2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *state,
+				  struct fsal_write_same_arg *ws_arg)
+{
+	struct wbcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct wbcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct wbcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct wbcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* The sub-FSAL writes the blocks, the cache must not shadow them */
+	if (wbcache_cacheable(handle)) {
+		status = wbcache_invalidate_range(export, handle,
+						  ws_arg->offset,
+						  ws_arg->block_size *
+						  ws_arg->block_count);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->write_same2(handle->sub_handle,
+							  state, ws_arg);
+	op_ctx->fsal_export = &export->export;
+	return status;
+}
@@ -0,0 +1,357 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file wbcache_methods.h
+ * @brief WBCACHE, a write-back data cache stackable FSAL
+ *
+ * WBCACHE sits between MDCACHE and a slow sub-FSAL and keeps file data
+ * in a local cache directory, usually on an SSD.  Each regular file with
+ * cached data has a sparse cache file that mirrors the file's layout, so
+ * cached data lives at the same offset as in the real file.  Data is
+ * cached in blocks of Block_Size bytes.
+ *
+ * Reads are served from cached blocks, missing blocks are read from the
+ * sub-FSAL in full and kept.  Sequential and strided reads of a file, and
+ * ranges advised WILLNEED, are prefetched into the cache ahead of the
+ * reader by the export's prefetch threads.  The access pattern is
+ * followed per open state, and per client for stateless reads.
+ * Unstable writes go to the cache file only
+ * and are flushed to the sub-FSAL, in offset order, on COMMIT, close,
+ * truncate or when the handle is released.  Stable writes to files with
+ * no dirty data are written through.  Clean blocks are evicted in LRU
+ * order when the export's Cache_Size would be exceeded; if nothing can
+ * be evicted, I/O bypasses the cache.
+ *
+ * Every cached write appends a record to the export's journal once the
+ * data is on disk in the cache file, and a clean record is appended once
+ * a file's dirty data has been committed to the sub-FSAL; the journal is
+ * synced before the write returns.  When the export is created, extents
+ * that are dirty according to the journal are written back to the
+ * sub-FSAL before anything else, so data acknowledged but not yet flushed
+ * survives a crash of the server.  Dirty data that cannot be written
+ * back when its handle is released is kept, in the cache and in the
+ * journal, for the next handle of the file or the next start.  The
+ * journal is truncated when nothing is dirty, and rewritten with only
+ * its live records when it grows large.
+ *
+ * Only single buffer reads and writes, which is what the NFS protocols
+ * issue, go through the cache; others write back dirty data and go to
+ * the sub-FSAL.  Cached data of a file whose last link is removed is
+ * dropped, dirty or not.
+ *
+ * The cache assumes it is the only writer of the sub-FSAL's files.
+ */
+
+#ifndef WBCACHE_METHODS_H
+#define WBCACHE_METHODS_H
+
+#include "avltree.h"
+#include "gsh_list.h"
+#include "FSAL/fsal_readahead.h"
+
+struct wbcache_fsal_module {
+	struct fsal_module module;
+	struct fsal_obj_ops handle_ops;
+};
+
+extern struct wbcache_fsal_module WBCACHE;
+
+struct wbcache_fsal_obj_handle;
+
+/**
+ * Structure used to store data for read_dirents callback.
+ *
+ * Before executing the upper level callback (it might be another
+ * stackable fsal or the inode cache), the context has to be restored.
+ */
+struct wbcache_readdir_state {
+	fsal_readdir_cb cb; /*< Callback to the upper layer. */
+	struct wbcache_fsal_export *exp; /*< Export of the current wbcache. */
+	void *dir_state; /*< State to be sent to the next callback. */
+};
+
+extern struct fsal_up_vector fsal_up_top;
+void wbcache_handle_ops_init(struct fsal_obj_ops *ops);
+
+/**
+ * @brief Cache counters of an export
+ *
+ * Updated with atomics.
+ */
+struct wbcache_stats {
+	uint64_t read_hits;	/*< Reads served entirely from the cache */
+	uint64_t read_misses;	/*< Reads that had to fill blocks */
+	uint64_t read_bypass;	/*< Reads that bypassed the cache */
+	uint64_t writes_cached;	/*< Writes absorbed by the cache */
+	uint64_t writes_through;	/*< Writes sent to the sub-FSAL */
+	uint64_t flushes;	/*< Write-backs of a file's dirty data */
+	uint64_t flushed_bytes;	/*< Bytes written back */
+	uint64_t evictions;	/*< Clean blocks evicted */
+	uint64_t cached_bytes;	/*< Space used by cached blocks */
+	uint64_t dirty_bytes;	/*< Bytes not yet written back */
+};
+
+/*
+ * WBCACHE internal export
+ */
+struct wbcache_fsal_export {
+	struct fsal_export export;
+	char *cache_dir;	/*< Cache directory of this export */
+	uint64_t cache_size;	/*< Space cached blocks may use */
+	uint32_t block_size;	/*< Size of a cache block */
+	int dir_fd;		/*< Open cache directory */
+	int journal_fd;		/*< Open journal */
+	/** Protects the members below */
+	pthread_mutex_t lock;
+	struct glist_head lru;	/*< Clean blocks, least recently used first */
+	uint64_t journal_off;	/*< End of the journal */
+	uint64_t journal_seq;	/*< Sequence number of the next record */
+	uint64_t journal_compact_at;	/*< Size that triggers compaction */
+	uint32_t dirty_files;	/*< Files with dirty blocks, orphans included */
+	struct glist_head orphans;	/*< Dirty data of released handles */
+	struct fridgethr *prefetch_fridge;	/*< Prefetch threads, NULL if
+						    prefetch is off */
+	struct wbcache_stats stats;
+};
+
+fsal_status_t wbcache_lookup_path(struct fsal_export *exp_hdl,
+				  const char *path,
+				  struct fsal_obj_handle **handle,
+				  struct attrlist *attrs_out);
+
+fsal_status_t wbcache_create_handle(struct fsal_export *exp_hdl,
+				    struct gsh_buffdesc *hdl_desc,
+				    struct fsal_obj_handle **handle,
+				    struct attrlist *attrs_out);
+
+fsal_status_t wbcache_alloc_and_check_handle(
+		struct wbcache_fsal_export *export,
+		struct fsal_obj_handle *sub_handle,
+		struct fsal_filesystem *fs,
+		struct fsal_obj_handle **new_handle,
+		fsal_status_t subfsal_status);
+
+/**
+ * @brief A cached block of a file
+ *
+ * The block's data is at the same offset in the cache file as in the
+ * file.  A block is on the export LRU when it is clean.
+ */
+struct wbcache_block {
+	struct avltree_node node_k;	/*< Node in the handle's block tree */
+	struct glist_head lru_link;	/*< Link in the export LRU if clean */
+	struct wbcache_fsal_obj_handle *hdl;	/*< Owning handle */
+	uint64_t index;			/*< Block number within the file */
+	uint32_t dirty_start;		/*< Start of dirty range in block */
+	uint32_t dirty_end;		/*< End of dirty range, 0 if clean */
+};
+
+/** Readers whose access pattern is followed per file */
+#define WBCACHE_RA_READERS 4
+
+/**
+ * @brief Access pattern tracker of one reader of a file
+ */
+struct wbcache_ra {
+	const void *owner;	/*< State, or client for stateless reads */
+	uint64_t used;		/*< Last use, to pick a tracker to reuse */
+	struct fsal_readahead ra;
+};
+
+/*
+ * WBCACHE internal object handle
+ *
+ * It contains a pointer to the fsal_obj_handle used by the subfsal, and
+ * the cache state of regular files.
+ */
+struct wbcache_fsal_obj_handle {
+	struct fsal_obj_handle obj_handle; /*< Handle containing wbcache data.*/
+	struct fsal_obj_handle *sub_handle; /*< Handle of the sub fsal.*/
+	int32_t refcnt;		/*< Reference count.  This is signed to make
+				   mistakes easy to see. */
+	/** Protects the cache state below */
+	pthread_rwlock_t cache_lock;
+	struct avltree blocks;	/*< Cached blocks by index */
+	int cache_fd;		/*< Cache file, -1 if not open */
+	bool size_known;	/*< Whether size is valid */
+	uint64_t size;		/*< File size, including dirty data */
+	uint32_t ndirty;	/*< Dirty blocks */
+	struct timespec dirty_mtime;	/*< Time of the last cached write */
+	struct gsh_buffdesc wire;	/*< Sub-FSAL wire handle, for the
+					    journal */
+	uint64_t data_gen;	/*< Bumped whenever the file's data changes */
+	/** Protects the readahead and prefetch state below */
+	pthread_mutex_t ra_mutex;
+	pthread_cond_t ra_cond;	/*< Signalled when prefetch stops */
+	struct wbcache_ra ra[WBCACHE_RA_READERS];	/*< Readers' patterns */
+	uint64_t ra_clock;	/*< Use counter of the trackers */
+	uint64_t pf_offset;	/*< Range to prefetch next */
+	uint64_t pf_length;
+	bool pf_busy;		/*< A prefetch is queued or running */
+	bool pf_again;		/*< A new range came in meanwhile */
+	bool pf_stop;		/*< The handle is being released */
+};
+
+/* Cache engine */
+void wbcache_handle_cache_init(struct wbcache_fsal_export *exp,
+			       struct wbcache_fsal_obj_handle *hdl);
+void wbcache_handle_cache_fini(struct wbcache_fsal_export *exp,
+			       struct wbcache_fsal_obj_handle *hdl);
+fsal_status_t wbcache_cache_read(struct wbcache_fsal_export *exp,
+				 struct wbcache_fsal_obj_handle *hdl,
+				 struct fsal_io_arg *read_arg);
+uint32_t wbcache_ra_hint(struct wbcache_fsal_obj_handle *hdl,
+			 struct state_t *state,
+			 const struct io_hints *hints,
+			 struct fsal_ra_advice *advice);
+void wbcache_prefetch(struct wbcache_fsal_export *exp,
+		      struct wbcache_fsal_obj_handle *hdl,
+		      uint64_t offset, uint64_t length);
+fsal_status_t wbcache_cache_write(struct wbcache_fsal_export *exp,
+				  struct wbcache_fsal_obj_handle *hdl,
+				  struct fsal_io_arg *write_arg, bool bypass);
+fsal_status_t wbcache_flush(struct wbcache_fsal_export *exp,
+			    struct wbcache_fsal_obj_handle *hdl);
+fsal_status_t wbcache_truncate(struct wbcache_fsal_export *exp,
+			       struct wbcache_fsal_obj_handle *hdl,
+			       uint64_t size);
+fsal_status_t wbcache_invalidate_range(struct wbcache_fsal_export *exp,
+				       struct wbcache_fsal_obj_handle *hdl,
+				       uint64_t offset, uint64_t length);
+void wbcache_discard(struct wbcache_fsal_export *exp,
+		     struct wbcache_fsal_obj_handle *hdl);
+void wbcache_fixup_attrs(struct wbcache_fsal_obj_handle *hdl,
+			 struct attrlist *attrs);
+int wbcache_export_cache_init(struct wbcache_fsal_export *exp,
+			      const char *cache_root, uint16_t export_id);
+void wbcache_export_cache_fini(struct wbcache_fsal_export *exp);
+void wbcache_replay_journal(struct wbcache_fsal_export *exp);
+#ifdef USE_DBUS
+void wbcache_extract_stats(struct fsal_module *fsal_hdl, void *iter);
+#endif
+void wbcache_reset_stats(struct fsal_module *fsal_hdl);
+
+/**
+ * @brief Whether a handle's I/O goes through the cache
+ */
+static inline bool wbcache_cacheable(struct wbcache_fsal_obj_handle *hdl)
+{
+	return hdl->obj_handle.type == REGULAR_FILE;
+}
+
+/* I/O management */
+fsal_status_t wbcache_close(struct fsal_obj_handle *obj_hdl);
+
+/* Multi-FD */
+fsal_status_t wbcache_open2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state,
+			    fsal_openflags_t openflags,
+			    enum fsal_create_mode createmode,
+			    const char *name,
+			    struct attrlist *attrs_in,
+			    fsal_verifier_t verifier,
+			    struct fsal_obj_handle **new_obj,
+			    struct attrlist *attrs_out,
+			    bool *caller_perm_check);
+bool wbcache_check_verifier(struct fsal_obj_handle *obj_hdl,
+			    fsal_verifier_t verifier);
+fsal_openflags_t wbcache_status2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *state);
+fsal_status_t wbcache_reopen2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      fsal_openflags_t openflags);
+void wbcache_read2(struct fsal_obj_handle *obj_hdl,
+		   bool bypass,
+		   fsal_async_cb done_cb,
+		   struct fsal_io_arg *read_arg,
+		   void *caller_arg);
+void wbcache_write2(struct fsal_obj_handle *obj_hdl,
+		    bool bypass,
+		    fsal_async_cb done_cb,
+		    struct fsal_io_arg *write_arg,
+		    void *caller_arg);
+fsal_status_t wbcache_seek2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state,
+			    struct io_info *info);
+fsal_status_t wbcache_io_advise2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *state,
+				 struct io_hints *hints);
+fsal_status_t wbcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			      size_t len);
+fsal_status_t wbcache_lock_op2(struct fsal_obj_handle *obj_hdl,
+			       struct state_t *state,
+			       void *p_owner,
+			       fsal_lock_op_t lock_op,
+			       fsal_lock_param_t *req_lock,
+			       fsal_lock_param_t *conflicting_lock);
+fsal_status_t wbcache_close2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state);
+fsal_status_t wbcache_fallocate(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state, uint64_t offset,
+				uint64_t length, bool allocate);
+fsal_status_t wbcache_copy_range2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *dst_state,
+				  uint64_t dst_offset,
+				  struct fsal_obj_handle *src_hdl,
+				  struct state_t *src_state,
+				  uint64_t src_offset,
+				  uint64_t count,
+				  uint32_t flags,
+				  uint64_t *copied);
+fsal_status_t wbcache_write_same2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *state,
+				  struct fsal_write_same_arg *ws_arg);
+
+/* extended attributes management */
+fsal_status_t wbcache_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
+				     unsigned int cookie,
+				     fsal_xattrent_t *xattrs_tab,
+				     unsigned int xattrs_tabsize,
+				     unsigned int *p_nb_returned,
+				     int *end_of_list);
+fsal_status_t wbcache_getextattr_id_by_name(struct fsal_obj_handle *obj_hdl,
+					    const char *xattr_name,
+					    unsigned int *pxattr_id);
+fsal_status_t wbcache_getextattr_value_by_name(
+					struct fsal_obj_handle *obj_hdl,
+					const char *xattr_name,
+					void *buffer_addr,
+					size_t buffer_size,
+					size_t *p_output_size);
+fsal_status_t wbcache_getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					     unsigned int xattr_id,
+					     void *buffer_addr,
+					     size_t buffer_size,
+					     size_t *p_output_size);
+fsal_status_t wbcache_setextattr_value(struct fsal_obj_handle *obj_hdl,
+				       const char *xattr_name,
+				       void *buffer_addr,
+				       size_t buffer_size,
+				       int create);
+fsal_status_t wbcache_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					     unsigned int xattr_id,
+					     void *buffer_addr,
+					     size_t buffer_size);
+fsal_status_t wbcache_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
+					   unsigned int xattr_id);
+fsal_status_t wbcache_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
+					     const char *xattr_name);
+
+#endif			/* WBCACHE_METHODS_H */
@@ -53,6 +53,7 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/statvfs.h>
+#include <arpa/inet.h>
 #if __FreeBSD__
 #include <sys/mount.h>
 #else
@@ -3181,4 +3182,112 @@ bool fsal_common_is_referral(struct fsal_obj_handle *obj_hdl,
 	return true;
 }
 
+/**
+ * @brief Check whether a WRITE_SAME zeroes its range
+ *
+ * @param[in] ws_arg WRITE_SAME description
+ *
+ * @return true if every byte written is zero.
+ */
+bool fsal_write_same_is_zero(const struct fsal_write_same_arg *ws_arg)
+{
+	const char *pattern = ws_arg->pattern.addr;
+	size_t i;
+
+	if (fsal_write_same_numbered(ws_arg))
+		return false;
+
+	if (ws_arg->reloff_pattern >= ws_arg->block_size)
+		return true;
+
+	for (i = 0; i < ws_arg->pattern.len; i++)
+		if (pattern[i] != 0)
+			return false;
+
+	return true;
+}
+
+/**
+ * @brief Build the data of a WRITE_SAME range
+ *
+ * Fills @a buf with what @a ws_arg puts at [pos, pos + len).  The pattern
+ * is copied once per block and then replicated from the buffer itself,
+ * doubling each time, so the cost does not depend on the pattern size.
+ *
+ * @param[in]  ws_arg WRITE_SAME description
+ * @param[in]  pos    File offset of buf, at or after ws_arg->offset
+ * @param[out] buf    Buffer to fill
+ * @param[in]  len    Length of buf
+ */
+void fsal_write_same_fill(const struct fsal_write_same_arg *ws_arg,
+			  uint64_t pos, char *buf, size_t len)
+{
+	uint64_t bs = ws_arg->block_size;
+	uint64_t plen = ws_arg->pattern.len;
+	uint64_t rel = pos - ws_arg->offset;
+	bool numbered = fsal_write_same_numbered(ws_arg);
+
+	while (len > 0) {
+		uint64_t block = rel / bs;
+		uint64_t in = rel % bs;
+		uint64_t end = MIN(bs, in + len);
+		uint64_t x = in;
+		char *dst = buf;
+
+		/* Zero up to the pattern */
+		if (x < ws_arg->reloff_pattern) {
+			uint64_t n = MIN(ws_arg->reloff_pattern, end) - x;
+
+			memset(dst, 0, n);
+			dst += n;
+			x += n;
+		}
+
+		if (x < end && plen == 0) {
+			memset(dst, 0, end - x);
+		} else if (x < end) {
+			uint64_t phase = (x - ws_arg->reloff_pattern) % plen;
+			uint64_t n = MIN(plen - phase, end - x);
+			char *period;
+			uint64_t done;
+
+			/* Finish the period x falls in */
+			memcpy(dst, (char *)ws_arg->pattern.addr + phase, n);
+			dst += n;
+			x += n;
+
+			/* Lay one whole period, then double it */
+			period = dst;
+			n = MIN(plen, end - x);
+			memcpy(dst, ws_arg->pattern.addr, n);
+			done = n;
+
+			while (x + done < end) {
+				n = MIN(done, end - x - done);
+				memcpy(period + done, period, n);
+				done += n;
+			}
+		}
+
+		/* The block number goes over whatever is there */
+		if (numbered) {
+			uint32_t num = htonl(ws_arg->block_num +
+					     (uint32_t)block);
+			const char *nb = (const char *)&num;
+			size_t i;
+
+			for (i = 0; i < sizeof(num); i++) {
+				uint64_t at = ws_arg->reloff_blocknum + i;
+
+				if (at >= in && at < end)
+					buf[at - in] = nb[i];
+			}
+		}
+
+		buf += end - in;
+		len -= end - in;
+		rel += end - in;
+	}
+}
+
 /** @} */
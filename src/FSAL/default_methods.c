@@ -1375,16 +1375,44 @@ static fsal_status_t seek2(struct fsal_obj_handle *obj_hdl,
 }
 
 /* io io_advise2
- * default case not supported
+ * default case falls back to the stateless io_advise
  */
 
 static fsal_status_t io_advise2(struct fsal_obj_handle *obj_hdl,
 				struct state_t *fd,
 				struct io_hints *hints)
 {
-	hints->hints = 0;
+	return obj_hdl->obj_ops->io_advise(obj_hdl, hints);
+}
 
-	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+/* copy_range2
+ * default case not supported
+ */
+
+static fsal_status_t copy_range2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *dst_state,
+				 uint64_t dst_offset,
+				 struct fsal_obj_handle *src_hdl,
+				 struct state_t *src_state,
+				 uint64_t src_offset,
+				 uint64_t count,
+				 uint32_t flags,
+				 uint64_t *copied)
+{
+	*copied = 0;
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
+}
+
+/* write_same2
+ * default case not supported
+ */
+
+static fsal_status_t write_same2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *state,
+				 struct fsal_write_same_arg *ws_arg)
+{
+	ws_arg->io_amount = 0;
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
 /* commit2
@@ -1524,6 +1552,8 @@ struct fsal_obj_ops def_handle_ops = {
 	.setattr2 = setattr2,
 	.close2 = close2,
 	.is_referral = is_referral,
+	.copy_range2 = copy_range2,
+	.write_same2 = write_same2,
 };
 
 /* fsal_pnfs_ds common methods */
@@ -0,0 +1,593 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @addtogroup FSAL
+ * @{
+ */
+
+/**
+ * @file fsal_fdcache.c
+ * @brief Shared cache of file descriptors for stateless I/O
+ *
+ * The cache is split into partitions, each with its own lock, hash
+ * chains and LRU, so that unrelated files do not contend.  The hash only
+ * covers the file system and handle key; open mode and credentials
+ * class are compared on lookup.  That way invalidating a file finds every
+ * descriptor open on it in a single chain.
+ *
+ * Descriptors are reference counted.  An entry that is invalidated while
+ * in use is unhashed and marked dead, and the descriptor is closed when
+ * the last user puts it.  Idle descriptors are closed from the tail of
+ * the LRU whenever a partition is over its share of Entries_HWMark, or
+ * when they have been unused for longer than Idle_Timeout.  Insert and
+ * put reap a few entries of their own partition; the MDCACHE LRU thread
+ * calls fsal_fdcache_reap so that quiet partitions age out as well.
+ *
+ * Cached descriptors are charged to open_fd_count like any other open
+ * file, so they count against the FD limits enforced by the LRU.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "log.h"
+#include "fsal.h"
+#include "city.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "config_parsing.h"
+#include "FSAL/fsal_fdcache.h"
+
+/** Maximum number of idle entries examined by one reap */
+#define FDCACHE_REAP_SCAN 16
+
+struct fdcache_partition {
+	pthread_mutex_t mtx;		/*< Protects everything below */
+	struct glist_head lru;		/*< Most recently used first */
+	uint32_t count;			/*< Hashed entries */
+	struct glist_head *chains;	/*< Hash chains */
+};
+
+struct fsal_fdcache_parameter fsal_fdcache_param;
+
+static struct fdcache_partition *fdcache_parts;
+static uint32_t fdcache_nparts;
+static uint32_t fdcache_nchains;
+static uint32_t fdcache_part_hwmark;
+
+static struct {
+	uint64_t hits;		/*< Opens avoided */
+	uint64_t misses;	/*< Lookups that had to open */
+	uint64_t closes_avoided;	/*< Puts that kept the fd open */
+	uint64_t evictions;	/*< Idle descriptors closed by the reaper */
+	uint64_t invalidations;	/*< Descriptors dropped by invalidate */
+	uint64_t entries;	/*< Descriptors currently cached */
+} fdcache_st;
+
+static struct config_item fdcache_params[] = {
+	CONF_ITEM_BOOL("Enable", false,
+		       fsal_fdcache_parameter, enable),
+	CONF_ITEM_UI32("Entries_HWMark", 1, 1000000, 4096,
+		       fsal_fdcache_parameter, entries_hwmark),
+	CONF_ITEM_UI32("Idle_Timeout", 1, 3600, 30,
+		       fsal_fdcache_parameter, idle_timeout),
+	CONF_ITEM_UI32("Partitions", 1, 1024, 7,
+		       fsal_fdcache_parameter, partitions),
+	CONFIG_EOL
+};
+
+static void *fdcache_param_init(void *link_mem, void *self_struct)
+{
+	if (self_struct == NULL)
+		return &fsal_fdcache_param;
+	else
+		return NULL;
+}
+
+struct config_block fdcache_param_blk = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.fd_cache",
+	.blk_desc.name = "FD_CACHE",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = fdcache_param_init,
+	.blk_desc.u.blk.params = fdcache_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+int fsal_fdcache_set_param_from_conf(config_file_t parse_tree,
+				     struct config_error_type *err_type)
+{
+	(void) load_config_from_parse(parse_tree,
+				      &fdcache_param_blk,
+				      NULL,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type)) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing FD_CACHE specific configuration");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Set up the partitions
+ *
+ * Must be called after the configuration has been read.  Does nothing if
+ * the cache is not enabled.
+ */
+void fsal_fdcache_pkginit(void)
+{
+	uint32_t i, j;
+
+	if (!fsal_fdcache_param.enable)
+		return;
+
+	fdcache_nparts = fsal_fdcache_param.partitions;
+	fdcache_part_hwmark = fsal_fdcache_param.entries_hwmark /
+							fdcache_nparts;
+	if (fdcache_part_hwmark == 0)
+		fdcache_part_hwmark = 1;
+
+	/* Aim for short chains at the high water mark */
+	fdcache_nchains = fdcache_part_hwmark < 16 ? 16 : fdcache_part_hwmark;
+
+	fdcache_parts = gsh_calloc(fdcache_nparts, sizeof(*fdcache_parts));
+
+	for (i = 0; i < fdcache_nparts; i++) {
+		struct fdcache_partition *part = &fdcache_parts[i];
+
+		PTHREAD_MUTEX_init(&part->mtx, NULL);
+		glist_init(&part->lru);
+		part->chains = gsh_malloc(fdcache_nchains *
+					  sizeof(*part->chains));
+		for (j = 0; j < fdcache_nchains; j++)
+			glist_init(&part->chains[j]);
+	}
+
+	LogInfo(COMPONENT_FSAL,
+		"FD cache enabled with %"PRIu32" partitions of %"PRIu32
+		" descriptors", fdcache_nparts, fdcache_part_hwmark);
+}
+
+static inline uint64_t fdcache_hash(struct fsal_filesystem *fs,
+				    const void *key, size_t key_len)
+{
+	return CityHash64WithSeed(key, key_len, (uint64_t) (uintptr_t) fs);
+}
+
+static inline struct fdcache_partition *fdcache_part(uint64_t hash)
+{
+	return &fdcache_parts[hash % fdcache_nparts];
+}
+
+static inline struct glist_head *fdcache_chain(struct fdcache_partition *part,
+					       uint64_t hash)
+{
+	return &part->chains[(hash / fdcache_nparts) % fdcache_nchains];
+}
+
+static inline bool fdcache_key_match(struct fsal_fdcache_entry *entry,
+				     struct fsal_filesystem *fs,
+				     uint64_t hash,
+				     const void *key, size_t key_len)
+{
+	return entry->hash == hash && entry->fs == fs &&
+	       entry->key_len == key_len &&
+	       memcmp(entry->key, key, key_len) == 0;
+}
+
+/**
+ * @brief Unhash an entry
+ *
+ * If the entry is not in use it is queued on @a dispose for closing once
+ * the partition lock has been dropped, otherwise it is left for the last
+ * put.
+ */
+static void fdcache_unhash(struct fdcache_partition *part,
+			   struct fsal_fdcache_entry *entry,
+			   struct glist_head *dispose)
+{
+	glist_del(&entry->hash_link);
+	glist_del(&entry->lru_link);
+	entry->dead = true;
+	part->count--;
+	(void) atomic_dec_uint64_t(&fdcache_st.entries);
+
+	if (entry->refcnt == 0)
+		glist_add_tail(dispose, &entry->lru_link);
+}
+
+static void fdcache_dispose(struct glist_head *dispose)
+{
+	struct glist_head *glist, *glistn;
+	struct fsal_fdcache_entry *entry;
+
+	glist_for_each_safe(glist, glistn, dispose) {
+		entry = glist_entry(glist, struct fsal_fdcache_entry,
+				    lru_link);
+		glist_del(&entry->lru_link);
+
+		LogFullDebug(COMPONENT_FSAL, "Closing cached fd %d", entry->fd);
+		close(entry->fd);
+		(void) atomic_dec_size_t(&open_fd_count);
+		gsh_free(entry);
+	}
+}
+
+/**
+ * @brief Close idle descriptors from the tail of a partition's LRU
+ *
+ * Descriptors are closed while the partition is over its high water
+ * mark, or while they have been idle longer than the timeout.  Busy
+ * entries are skipped.  Called with the partition lock held.
+ *
+ * @param[in]  part     Partition to reap
+ * @param[in]  now      Current time
+ * @param[in]  scan     Maximum number of entries to examine
+ * @param[in]  all_idle Close every idle descriptor examined
+ * @param[out] dispose  Entries to close once the lock is dropped
+ */
+static void fdcache_reap(struct fdcache_partition *part, time_t now,
+			 uint32_t scan, bool all_idle,
+			 struct glist_head *dispose)
+{
+	struct glist_head *glist, *glistp;
+	struct fsal_fdcache_entry *entry;
+	uint32_t scanned = 0;
+
+	for (glist = part->lru.prev, glistp = glist->prev;
+	     glist != &part->lru && scanned < scan;
+	     glist = glistp, glistp = glist->prev, scanned++) {
+		entry = glist_entry(glist, struct fsal_fdcache_entry,
+				    lru_link);
+
+		if (entry->refcnt != 0)
+			continue;
+
+		if (!all_idle && part->count <= fdcache_part_hwmark &&
+		    now - entry->last_used < fsal_fdcache_param.idle_timeout)
+			break;
+
+		fdcache_unhash(part, entry, dispose);
+		(void) atomic_inc_uint64_t(&fdcache_st.evictions);
+	}
+}
+
+/**
+ * @brief Age out idle descriptors in every partition
+ *
+ * Called periodically from the MDCACHE LRU thread.  When the server is
+ * over its FD high water mark, every idle descriptor is closed rather
+ * than just the expired ones.
+ *
+ * @param[in] all_idle Close every idle descriptor
+ */
+void fsal_fdcache_reap(bool all_idle)
+{
+	struct glist_head dispose;
+	time_t now = time(NULL);
+	uint32_t i;
+
+	if (!fsal_fdcache_enabled())
+		return;
+
+	glist_init(&dispose);
+
+	for (i = 0; i < fdcache_nparts; i++) {
+		struct fdcache_partition *part = &fdcache_parts[i];
+
+		PTHREAD_MUTEX_lock(&part->mtx);
+		fdcache_reap(part, now, UINT32_MAX, all_idle, &dispose);
+		PTHREAD_MUTEX_unlock(&part->mtx);
+	}
+
+	fdcache_dispose(&dispose);
+}
+
+/**
+ * @brief Look up a cached descriptor
+ *
+ * A descriptor open read/write satisfies a request for read or for
+ * write.  On success the entry is returned with a reference that must be
+ * released with fsal_fdcache_put.
+ *
+ * @param[in] fs          File system the handle belongs to
+ * @param[in] key         Handle key
+ * @param[in] key_len     Length of the handle key
+ * @param[in] openflags   Access needed, FSAL_O_READ, FSAL_O_WRITE or both
+ * @param[in] cred_class  FSAL defined credentials class
+ *
+ * @return The entry, or NULL on a miss.
+ */
+struct fsal_fdcache_entry *fsal_fdcache_get(struct fsal_filesystem *fs,
+					    const void *key, size_t key_len,
+					    fsal_openflags_t openflags,
+					    uint32_t cred_class)
+{
+	uint64_t hash = fdcache_hash(fs, key, key_len);
+	struct fdcache_partition *part = fdcache_part(hash);
+	struct fsal_fdcache_entry *entry, *found = NULL;
+	struct glist_head *glist;
+
+	openflags &= FSAL_O_RDWR;
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	glist_for_each(glist, fdcache_chain(part, hash)) {
+		entry = glist_entry(glist, struct fsal_fdcache_entry,
+				    hash_link);
+
+		if (!fdcache_key_match(entry, fs, hash, key, key_len) ||
+		    entry->cred_class != cred_class ||
+		    (entry->openflags & openflags) != openflags)
+			continue;
+
+		found = entry;
+
+		/* An exact match is best, keep looking otherwise */
+		if (entry->openflags == openflags)
+			break;
+	}
+
+	if (found != NULL) {
+		found->refcnt++;
+		glist_del(&found->lru_link);
+		glist_add(&part->lru, &found->lru_link);
+	}
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+
+	if (found != NULL) {
+		(void) atomic_inc_uint64_t(&fdcache_st.hits);
+		LogFullDebug(COMPONENT_FSAL, "Reusing cached fd %d", found->fd);
+	} else {
+		(void) atomic_inc_uint64_t(&fdcache_st.misses);
+	}
+
+	return found;
+}
+
+/**
+ * @brief Hand a freshly opened descriptor to the cache
+ *
+ * If another thread inserted an equivalent descriptor in the meantime,
+ * @a fd is closed and the existing entry is returned instead.
+ *
+ * @return The entry with a reference held.
+ */
+struct fsal_fdcache_entry *fsal_fdcache_insert(struct fsal_filesystem *fs,
+					       const void *key, size_t key_len,
+					       fsal_openflags_t openflags,
+					       uint32_t cred_class, int fd)
+{
+	uint64_t hash = fdcache_hash(fs, key, key_len);
+	struct fdcache_partition *part = fdcache_part(hash);
+	struct glist_head *chain = fdcache_chain(part, hash);
+	struct fsal_fdcache_entry *entry, *new_entry;
+	struct glist_head *glist;
+	struct glist_head dispose;
+	time_t now = time(NULL);
+
+	openflags &= FSAL_O_RDWR;
+	glist_init(&dispose);
+
+	new_entry = gsh_calloc(1, sizeof(*new_entry) + key_len);
+	new_entry->fs = fs;
+	new_entry->hash = hash;
+	new_entry->openflags = openflags;
+	new_entry->cred_class = cred_class;
+	new_entry->refcnt = 1;
+	new_entry->last_used = now;
+	new_entry->fd = fd;
+	new_entry->key_len = key_len;
+	memcpy(new_entry->key, key, key_len);
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	glist_for_each(glist, chain) {
+		entry = glist_entry(glist, struct fsal_fdcache_entry,
+				    hash_link);
+
+		if (fdcache_key_match(entry, fs, hash, key, key_len) &&
+		    entry->cred_class == cred_class &&
+		    entry->openflags == openflags) {
+			/* Lost the race, use the winner's descriptor */
+			entry->refcnt++;
+			PTHREAD_MUTEX_unlock(&part->mtx);
+			close(fd);
+			gsh_free(new_entry);
+			return entry;
+		}
+	}
+
+	glist_add(chain, &new_entry->hash_link);
+	glist_add(&part->lru, &new_entry->lru_link);
+	part->count++;
+	(void) atomic_inc_uint64_t(&fdcache_st.entries);
+	(void) atomic_inc_size_t(&open_fd_count);
+
+	fdcache_reap(part, now, FDCACHE_REAP_SCAN, false, &dispose);
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+
+	fdcache_dispose(&dispose);
+
+	return new_entry;
+}
+
+/**
+ * @brief Release a reference on a cached descriptor
+ *
+ * The descriptor stays open for the next user unless the entry was
+ * invalidated while in use.
+ */
+void fsal_fdcache_put(struct fsal_fdcache_entry *entry)
+{
+	uint64_t hash = entry->hash;
+	struct fdcache_partition *part = fdcache_part(hash);
+	struct glist_head dispose;
+	time_t now = time(NULL);
+
+	glist_init(&dispose);
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	entry->last_used = now;
+
+	if (--entry->refcnt == 0) {
+		if (entry->dead)
+			glist_add_tail(&dispose, &entry->lru_link);
+		else
+			(void) atomic_inc_uint64_t(&fdcache_st.closes_avoided);
+	}
+
+	fdcache_reap(part, now, FDCACHE_REAP_SCAN, false, &dispose);
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+
+	fdcache_dispose(&dispose);
+}
+
+/**
+ * @brief Drop every descriptor cached for a file
+ *
+ * Used when the file is removed, so the cache does not keep an unlinked
+ * inode alive.
+ */
+void fsal_fdcache_invalidate(struct fsal_filesystem *fs,
+			     const void *key, size_t key_len)
+{
+	uint64_t hash;
+	struct fdcache_partition *part;
+	struct fsal_fdcache_entry *entry;
+	struct glist_head *glist, *glistn;
+	struct glist_head dispose;
+
+	if (!fsal_fdcache_enabled())
+		return;
+
+	hash = fdcache_hash(fs, key, key_len);
+	part = fdcache_part(hash);
+	glist_init(&dispose);
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	glist_for_each_safe(glist, glistn, fdcache_chain(part, hash)) {
+		entry = glist_entry(glist, struct fsal_fdcache_entry,
+				    hash_link);
+
+		if (!fdcache_key_match(entry, fs, hash, key, key_len))
+			continue;
+
+		fdcache_unhash(part, entry, &dispose);
+		(void) atomic_inc_uint64_t(&fdcache_st.invalidations);
+	}
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+
+	fdcache_dispose(&dispose);
+}
+
+/**
+ * @brief Drop every descriptor cached for a file system
+ *
+ * Used when the FSAL releases the file system.
+ */
+void fsal_fdcache_purge_fs(struct fsal_filesystem *fs)
+{
+	struct fsal_fdcache_entry *entry;
+	struct glist_head *glist, *glistn;
+	struct glist_head dispose;
+	uint32_t i, j;
+
+	if (!fsal_fdcache_enabled())
+		return;
+
+	glist_init(&dispose);
+
+	for (i = 0; i < fdcache_nparts; i++) {
+		struct fdcache_partition *part = &fdcache_parts[i];
+
+		PTHREAD_MUTEX_lock(&part->mtx);
+
+		for (j = 0; j < fdcache_nchains; j++) {
+			glist_for_each_safe(glist, glistn, &part->chains[j]) {
+				entry = glist_entry(glist,
+						    struct fsal_fdcache_entry,
+						    hash_link);
+				if (entry->fs != fs)
+					continue;
+
+				fdcache_unhash(part, entry, &dispose);
+				(void) atomic_inc_uint64_t(
+						&fdcache_st.invalidations);
+			}
+		}
+
+		PTHREAD_MUTEX_unlock(&part->mtx);
+	}
+
+	fdcache_dispose(&dispose);
+}
+
+#ifdef USE_DBUS
+void fsal_fdcache_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+	char *type;
+	uint64_t val;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	type = " Opens avoided: ";
+	val = atomic_fetch_uint64_t(&fdcache_st.hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = " Misses: ";
+	val = atomic_fetch_uint64_t(&fdcache_st.misses);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = " Closes avoided: ";
+	val = atomic_fetch_uint64_t(&fdcache_st.closes_avoided);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = " Evictions: ";
+	val = atomic_fetch_uint64_t(&fdcache_st.evictions);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = " Invalidations: ";
+	val = atomic_fetch_uint64_t(&fdcache_st.invalidations);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = " Cached FDs: ";
+	val = atomic_fetch_uint64_t(&fdcache_st.entries);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif
+
+/** @} */
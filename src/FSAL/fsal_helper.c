@@ -370,6 +370,7 @@ fsal_status_t open2_by_name(struct fsal_obj_handle *in_obj,
 	fsal_status_t status = { 0, 0 };
 	fsal_status_t close_status = { 0, 0 };
 	bool caller_perm_check = false;
+	bool notify = false;
 	char *reason;
 
 	*obj = NULL;
@@ -391,6 +392,20 @@ fsal_status_t open2_by_name(struct fsal_obj_handle *in_obj,
 	if (FSAL_IS_ERROR(status))
 		return status;
 
+	if (createmode != FSAL_NO_CREATE && state_dir_delegated(in_obj)) {
+		/* Directory delegations only hear of names that are new */
+		struct fsal_obj_handle *existing = NULL;
+
+		status = fsal_lookup(in_obj, name, &existing, NULL);
+		if (existing != NULL)
+			existing->obj_ops->put_ref(existing);
+
+		notify = status.major == ERR_FSAL_NOENT;
+		if (notify &&
+		    state_dir_deleg_conflict(in_obj, NOTIFY4_ADD_ENTRY))
+			return fsalstat(ERR_FSAL_DELAY, 0);
+	}
+
 	status = in_obj->obj_ops->open2(in_obj,
 				       state,
 				       openflags,
@@ -414,6 +429,9 @@ fsal_status_t open2_by_name(struct fsal_obj_handle *in_obj,
 		     "Created entry %p FSAL %s for %s",
 		     *obj, (*obj)->fsal->name, name);
 
+	if (notify)
+		state_dir_deleg_notify(in_obj, NOTIFY4_ADD_ENTRY, name, NULL);
+
 	if (!caller_perm_check)
 		return status;
 
@@ -476,6 +494,10 @@ fsal_status_t fsal_setattr(struct fsal_obj_handle *obj, bool bypass,
 		return fsalstat(ERR_FSAL_BADTYPE, 0);
 	}
 
+	/* Directory attribute changes are never notified, only recalled */
+	if (state_dir_deleg_conflict(obj, NOTIFY4_CHANGE_DIR_ATTRS))
+		return fsalstat(ERR_FSAL_DELAY, 0);
+
 	/* Is it allowed to change times ? */
 	if (!op_ctx->fsal_export->exp_ops.fs_supports(op_ctx->fsal_export,
 						      fso_cansettime) &&
@@ -630,9 +652,14 @@ fsal_status_t fsal_link(struct fsal_obj_handle *obj,
 			return status;
 	}
 
+	if (state_dir_deleg_conflict(dest_dir, NOTIFY4_ADD_ENTRY))
+		return fsalstat(ERR_FSAL_DELAY, 0);
+
 	/* Rather than performing a lookup first, just try to make the
 	   link and return the FSAL's error if it fails. */
 	status = obj->obj_ops->link(obj, dest_dir, name);
+	if (!FSAL_IS_ERROR(status))
+		state_dir_deleg_notify(dest_dir, NOTIFY4_ADD_ENTRY, name, NULL);
 	return status;
 }
 
@@ -814,6 +841,14 @@ fsal_status_t fsal_create(struct fsal_obj_handle *parent,
 	    attrs->group == op_ctx->creds->caller_gid)
 		FSAL_UNSET_MASK(attrs->valid_mask, ATTR_GROUP);
 
+	/* Regular files go through open2_by_name, which checks */
+	if (type != REGULAR_FILE &&
+	    state_dir_deleg_conflict(parent, NOTIFY4_ADD_ENTRY)) {
+		status = fsalstat(ERR_FSAL_DELAY, 0);
+		*obj = NULL;
+		goto out;
+	}
+
 	/* Permission checking will be done by the FSAL operation. */
 
 	/* Try to create it first */
@@ -887,6 +922,9 @@ fsal_status_t fsal_create(struct fsal_obj_handle *parent,
 		goto out;
 	}
 
+	if (type != REGULAR_FILE)
+		state_dir_deleg_notify(parent, NOTIFY4_ADD_ENTRY, name, NULL);
+
  out:
 
 	/* Restore original mask so caller isn't bamboozled... */
@@ -1224,6 +1262,11 @@ fsal_remove(struct fsal_obj_handle *parent, const char *name)
 		goto out;
 #endif /* ENABLE_RFC_ACL */
 
+	if (state_dir_deleg_conflict(parent, NOTIFY4_REMOVE_ENTRY)) {
+		status = fsalstat(ERR_FSAL_DELAY, 0);
+		goto out;
+	}
+
 	status = parent->obj_ops->unlink(parent, to_remove_obj, name);
 
 	if (FSAL_IS_ERROR(status)) {
@@ -1232,6 +1275,8 @@ fsal_remove(struct fsal_obj_handle *parent, const char *name)
 		goto out;
 	}
 
+	state_dir_deleg_notify(parent, NOTIFY4_REMOVE_ENTRY, name, NULL);
+
 out:
 
 	to_remove_obj->obj_ops->put_ref(to_remove_obj);
@@ -1295,6 +1340,17 @@ fsal_status_t fsal_rename(struct fsal_obj_handle *dir_src,
 		goto out;
 	}
 
+	/* Directory delegations see a move between directories as a
+	 * removal from one and an addition to the other.
+	 */
+	if (dir_src == dir_dest
+	    ? state_dir_deleg_conflict(dir_src, NOTIFY4_RENAME_ENTRY)
+	    : (state_dir_deleg_conflict(dir_src, NOTIFY4_REMOVE_ENTRY) ||
+	       state_dir_deleg_conflict(dir_dest, NOTIFY4_ADD_ENTRY))) {
+		fsal_status = fsalstat(ERR_FSAL_DELAY, 0);
+		goto out;
+	}
+
 	LogFullDebug(COMPONENT_FSAL, "about to call FSAL rename");
 
 	fsal_status = dir_src->obj_ops->rename(lookup_src, dir_src, oldname,
@@ -1311,6 +1367,16 @@ fsal_status_t fsal_rename(struct fsal_obj_handle *dir_src,
 		goto out;
 	}
 
+	if (dir_src == dir_dest) {
+		state_dir_deleg_notify(dir_src, NOTIFY4_RENAME_ENTRY,
+				       oldname, newname);
+	} else {
+		state_dir_deleg_notify(dir_src, NOTIFY4_REMOVE_ENTRY,
+				       oldname, NULL);
+		state_dir_deleg_notify(dir_dest, NOTIFY4_ADD_ENTRY,
+				       newname, NULL);
+	}
+
 out:
 	if (lookup_src) {
 		/* Note that even with a junction, this object is in the same
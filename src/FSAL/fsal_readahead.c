@@ -0,0 +1,321 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @addtogroup FSAL
+ * @{
+ */
+
+/**
+ * @file fsal_readahead.c
+ * @brief Access pattern detection for server side readahead
+ *
+ * Each READ is compared with the previous one on the same tracker: it
+ * is sequential when it starts where the last one ended, strided when
+ * it is as far from the last one as that was from the one before, and
+ * random otherwise.  A pattern is only acted on once a few reads in a
+ * row agree, and random access takes longer to confirm than the others
+ * so that a single seek does not throw away a sequential window.
+ *
+ * Sequential streams are read ahead in a window that starts small and
+ * doubles every time the reader gets within half a window of the end of
+ * what was read ahead, up to FSAL_RA_WINDOW_MAX.  Strided streams get
+ * the next stride read ahead.  A READ that falls entirely within the
+ * last range read ahead counts as a readahead hit.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include "log.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "FSAL/fsal_readahead.h"
+
+/** Matching reads before a sequential or strided pattern is acted on */
+#define RA_CONFIRM 2
+/** Matching reads before random access is acted on */
+#define RA_CONFIRM_RANDOM 4
+
+#define RA_HINT(h) (1U << (h))
+
+/**
+ * @brief Readahead counters, updated with atomics
+ */
+static struct {
+	uint64_t reads;		/*< READs seen by a tracker */
+	uint64_t sequential;	/*< READs in a sequential stream */
+	uint64_t stride;	/*< READs in a strided stream */
+	uint64_t random;	/*< READs in random access */
+	uint64_t readaheads;	/*< Ranges read ahead */
+	uint64_t readahead_bytes;	/*< Bytes read ahead */
+	uint64_t hits;		/*< READs within the last readahead */
+	uint64_t hints;		/*< IO_ADVISE calls */
+} ra_st;
+
+/**
+ * @brief Record a range to read ahead
+ */
+static void ra_willneed(struct fsal_readahead *ra,
+			struct fsal_ra_advice *advice,
+			uint64_t offset, uint64_t length)
+{
+	if (offset != ra->ra_end)
+		ra->ra_start = offset;
+	ra->ra_end = offset + length;
+
+	advice->op = FSAL_RA_WILLNEED;
+	advice->offset = offset;
+	advice->length = length;
+
+	(void) atomic_inc_uint64_t(&ra_st.readaheads);
+	(void) atomic_add_uint64_t(&ra_st.readahead_bytes, length);
+}
+
+/**
+ * @brief Switch the pattern acted on
+ */
+static void ra_set_pattern(struct fsal_readahead *ra,
+			   struct fsal_ra_advice *advice,
+			   enum fsal_io_pattern pattern)
+{
+	if (pattern == ra->pattern)
+		return;
+
+	if (pattern != FSAL_IO_SEQUENTIAL)
+		ra->window = 0;
+
+	ra->pattern = pattern;
+	advice->pattern_changed = true;
+	advice->pattern = pattern;
+}
+
+/**
+ * @brief Feed a READ to a tracker
+ *
+ * @param[in,out] ra     Tracker of the open file
+ * @param[in]     offset Offset of the READ
+ * @param[in]     length Length of the READ
+ * @param[out]    advice What the FSAL should do
+ *
+ * @return true if there is something in @a advice to act on.
+ */
+bool fsal_readahead_read(struct fsal_readahead *ra, uint64_t offset,
+			 uint64_t length, struct fsal_ra_advice *advice)
+{
+	enum fsal_io_pattern seen, pattern;
+	bool hinted = ra->hints & RA_HINT(IO_ADVISE4_SEQUENTIAL);
+	uint64_t start;
+
+	memset(advice, 0, sizeof(*advice));
+
+	if (length == 0)
+		return false;
+
+	(void) atomic_inc_uint64_t(&ra_st.reads);
+
+	if (offset >= ra->ra_start && offset + length <= ra->ra_end)
+		(void) atomic_inc_uint64_t(&ra_st.hits);
+
+	/* Classify this read against the previous ones */
+	if (ra->streak == 0)
+		seen = FSAL_IO_UNKNOWN;
+	else if (offset == ra->next_offset)
+		seen = FSAL_IO_SEQUENTIAL;
+	else if (ra->stride > 0 && offset == ra->last_offset + ra->stride)
+		seen = FSAL_IO_STRIDE;
+	else
+		seen = FSAL_IO_RANDOM;
+
+	if (seen == ra->seen && ra->streak != 0) {
+		ra->streak++;
+	} else {
+		ra->seen = seen;
+		ra->streak = 1;
+	}
+
+	ra->stride = seen == FSAL_IO_UNKNOWN ? 0 : offset - ra->last_offset;
+	ra->last_offset = offset;
+	ra->next_offset = offset + length;
+
+	/* Hints win, otherwise only change once a pattern is confirmed */
+	if (hinted)
+		pattern = FSAL_IO_SEQUENTIAL;
+	else if (ra->hints & RA_HINT(IO_ADVISE4_RANDOM))
+		pattern = FSAL_IO_RANDOM;
+	else if (seen != FSAL_IO_UNKNOWN &&
+		 ra->streak >= (seen == FSAL_IO_RANDOM ? RA_CONFIRM_RANDOM
+						       : RA_CONFIRM))
+		pattern = seen;
+	else
+		pattern = ra->pattern;
+
+	ra_set_pattern(ra, advice, pattern);
+
+	switch (pattern) {
+	case FSAL_IO_SEQUENTIAL:
+		(void) atomic_inc_uint64_t(&ra_st.sequential);
+
+		/* A jump within a sequential stream is not read ahead */
+		if (seen != FSAL_IO_SEQUENTIAL && !hinted)
+			break;
+
+		if (ra->window == 0)
+			ra->window = hinted ? FSAL_RA_WINDOW_MAX
+					    : FSAL_RA_WINDOW_MIN;
+
+		/* Still far enough from the end of the last readahead */
+		if (ra->next_offset >= ra->ra_start &&
+		    ra->next_offset + ra->window / 2 < ra->ra_end)
+			break;
+
+		/* Carry on from the last readahead if the reader is in it */
+		if (ra->next_offset >= ra->ra_start &&
+		    ra->next_offset < ra->ra_end)
+			start = ra->ra_end;
+		else
+			start = ra->next_offset;
+
+		ra_willneed(ra, advice, start, ra->window);
+
+		if (ra->window < FSAL_RA_WINDOW_MAX)
+			ra->window *= 2;
+		break;
+
+	case FSAL_IO_STRIDE:
+		(void) atomic_inc_uint64_t(&ra_st.stride);
+
+		if (seen != FSAL_IO_STRIDE)
+			break;
+
+		start = offset + ra->stride;
+		if (start >= ra->ra_start && start + length <= ra->ra_end)
+			break;
+
+		ra_willneed(ra, advice, start, length);
+		break;
+
+	case FSAL_IO_RANDOM:
+		(void) atomic_inc_uint64_t(&ra_st.random);
+		break;
+
+	case FSAL_IO_UNKNOWN:
+		break;
+	}
+
+	return advice->pattern_changed || advice->op != FSAL_RA_NONE;
+}
+
+/**
+ * @brief Apply IO_ADVISE hints to a tracker
+ *
+ * SEQUENTIAL and RANDOM set the pattern until NORMAL is advised;
+ * WILLNEED, DONTNEED and NOREUSE apply to the hinted range.
+ *
+ * @param[in,out] ra     Tracker of the open file
+ * @param[in]     hints  Hints as IO_ADVISE4 bits, with their range
+ * @param[out]    advice What the FSAL should do
+ *
+ * @return The hints that were honoured, as IO_ADVISE4 bits.
+ */
+uint32_t fsal_readahead_hint(struct fsal_readahead *ra,
+			     const struct io_hints *hints,
+			     struct fsal_ra_advice *advice)
+{
+	uint32_t want = hints->hints;
+	uint32_t honoured = 0;
+
+	memset(advice, 0, sizeof(*advice));
+
+	(void) atomic_inc_uint64_t(&ra_st.hints);
+
+	if (want & RA_HINT(IO_ADVISE4_NORMAL)) {
+		ra->hints = 0;
+		ra_set_pattern(ra, advice, FSAL_IO_UNKNOWN);
+		honoured |= RA_HINT(IO_ADVISE4_NORMAL);
+	}
+
+	if (want & RA_HINT(IO_ADVISE4_SEQUENTIAL)) {
+		ra->hints = RA_HINT(IO_ADVISE4_SEQUENTIAL);
+		ra_set_pattern(ra, advice, FSAL_IO_SEQUENTIAL);
+		ra->window = FSAL_RA_WINDOW_MAX;
+		honoured |= RA_HINT(IO_ADVISE4_SEQUENTIAL);
+	} else if (want & RA_HINT(IO_ADVISE4_RANDOM)) {
+		ra->hints = RA_HINT(IO_ADVISE4_RANDOM);
+		ra_set_pattern(ra, advice, FSAL_IO_RANDOM);
+		honoured |= RA_HINT(IO_ADVISE4_RANDOM);
+	}
+
+	advice->offset = hints->offset;
+	advice->length = hints->count;
+
+	if (want & (RA_HINT(IO_ADVISE4_WILLNEED) |
+		    RA_HINT(IO_ADVISE4_WILLNEED_OPPORTUNISTIC))) {
+		advice->op = FSAL_RA_WILLNEED;
+		honoured |= want & (RA_HINT(IO_ADVISE4_WILLNEED) |
+				    RA_HINT(IO_ADVISE4_WILLNEED_OPPORTUNISTIC));
+		if (hints->count != 0) {
+			ra->ra_start = hints->offset;
+			ra->ra_end = hints->offset + hints->count;
+		}
+	} else if (want & RA_HINT(IO_ADVISE4_DONTNEED)) {
+		advice->op = FSAL_RA_DONTNEED;
+		honoured |= RA_HINT(IO_ADVISE4_DONTNEED);
+	} else if (want & RA_HINT(IO_ADVISE4_NOREUSE)) {
+		advice->op = FSAL_RA_NOREUSE;
+		honoured |= RA_HINT(IO_ADVISE4_NOREUSE);
+	}
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "IO_ADVISE hints 0x%" PRIx32 " honoured 0x%" PRIx32
+		     " offset %" PRIu64 " count %" PRIu64,
+		     want, honoured, hints->offset, hints->count);
+
+	return honoured;
+}
+
+#ifdef USE_DBUS
+void fsal_readahead_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+	uint64_t val;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	val = atomic_fetch_uint64_t(&ra_st.reads);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&ra_st.sequential);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&ra_st.stride);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&ra_st.random);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&ra_st.readaheads);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&ra_st.readahead_bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&ra_st.hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&ra_st.hints);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif
+
+/** @} */
@@ -449,6 +449,43 @@ int async_delegrecall(struct fridgethr *fr, struct fsal_obj_handle *obj)
 	return rc;
 }
 
+/* Directory delegation recall */
+
+struct dir_delegrecall_args {
+	struct fsal_obj_handle *obj;
+	notify_type4 type;
+	clientid4 clientid;
+};
+
+static void queue_dir_delegrecall(struct fridgethr_context *ctx)
+{
+	struct dir_delegrecall_args *args = ctx->arg;
+
+	(void)delegrecall_dir_impl(args->obj, args->type, args->clientid);
+	args->obj->obj_ops->put_ref(args->obj);
+	gsh_free(args);
+}
+
+int async_dir_delegrecall(struct fridgethr *fr, struct fsal_obj_handle *obj,
+			  notify_type4 type, clientid4 clientid)
+{
+	struct dir_delegrecall_args *args = gsh_malloc(sizeof(*args));
+	int rc;
+
+	args->obj = obj;
+	args->type = type;
+	args->clientid = clientid;
+
+	/* get a ref to prevent races when delegrecall is called too late */
+	obj->obj_ops->get_ref(obj);
+	rc = fridgethr_submit(fr, queue_dir_delegrecall, args);
+	if (rc != 0) {
+		obj->obj_ops->put_ref(obj);
+		gsh_free(args);
+	}
+	return rc;
+}
+
 static void up_queue_delegrecall(struct fridgethr_context *ctx)
 {
 
@@ -1497,14 +1497,92 @@ static int schedule_delegrevoke_check(struct delegrecall_context *ctx,
 	return rc;
 }
 
+/**
+ * @brief Start recalling one delegation
+ *
+ * @note The state_lock MUST be held for write, and op_ctx must point to
+ *       a request context the export can be set in.
+ *
+ * @param[in] obj   File or directory
+ * @param[in] state Delegation to recall
+ */
+static void delegrecall_state(struct fsal_obj_handle *obj,
+			      struct state_t *state)
+{
+	uint32_t *deleg_state = NULL;
+	state_owner_t *owner;
+	struct delegrecall_context *drc_ctx;
+
+	if (isDebug(COMPONENT_NFS_CB)) {
+		char str[LOG_BUFF_LEN] = "\0";
+		struct display_buffer dspbuf = {sizeof(str), str, str};
+
+		display_stateid(&dspbuf, state);
+		LogDebug(COMPONENT_NFS_CB, "Delegation for %s", str);
+	}
+
+	deleg_state = &state->state_data.deleg.sd_state;
+	if (*deleg_state != DELEG_GRANTED) {
+		LogDebug(COMPONENT_FSAL_UP,
+			 "Delegation already being recalled, NOOP");
+		return;
+	}
+	*deleg_state = DELEG_RECALL_WIP;
+
+	drc_ctx = gsh_malloc(sizeof(struct delegrecall_context));
+
+	/* Get references on the owner and the the export. The
+	 * export reference we will hold while we perform the recall.
+	 * The owner reference will be used to get access to the
+	 * clientid and reserve the lease.
+	 */
+	if (!get_state_obj_export_owner_refs(state, NULL,
+					     &drc_ctx->drc_exp,
+					     &owner)) {
+		LogDebug(COMPONENT_FSAL_UP,
+			 "Something is going stale, no need to recall delegation");
+		gsh_free(drc_ctx);
+		return;
+	}
+
+	/* op_ctx may be used by state_del_locked and others */
+	op_ctx->ctx_export = drc_ctx->drc_exp;
+	op_ctx->fsal_export = drc_ctx->drc_exp->fsal_export;
+
+	drc_ctx->drc_clid = owner->so_owner.so_nfs4_owner.so_clientrec;
+	COPY_STATEID(&drc_ctx->drc_stateid, state);
+	inc_client_id_ref(drc_ctx->drc_clid);
+	dec_state_owner_ref(owner);
+
+	if (obj->type == REGULAR_FILE)
+		obj->state_hdl->file.fdeleg_stats.fds_last_recall = time(NULL);
+	else
+		dir_deleg_stats_recalled();
+
+	/* Prevent client's lease expiring until we complete
+	 * this recall/revoke operation. If the client's lease
+	 * has already expired, let the reaper thread handling
+	 * expired clients revoke this delegation, and we just
+	 * skip it here.
+	 */
+	PTHREAD_MUTEX_lock(&drc_ctx->drc_clid->cid_mutex);
+	if (!reserve_lease(drc_ctx->drc_clid)) {
+		PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
+		put_gsh_export(drc_ctx->drc_exp);
+		dec_client_id_ref(drc_ctx->drc_clid);
+		gsh_free(drc_ctx);
+		return;
+	}
+	PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
+
+	delegrecall_one(obj, state, drc_ctx);
+}
+
 state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
 {
 	struct glist_head *glist, *glist_n;
 	state_status_t rc = 0;
-	uint32_t *deleg_state = NULL;
 	struct state_t *state;
-	state_owner_t *owner;
-	struct delegrecall_context *drc_ctx;
 	struct req_op_context *save_ctx = op_ctx, req_ctx = {0};
 
 	LogDebug(COMPONENT_FSAL_UP,
@@ -1512,88 +1590,60 @@ state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
 		 obj, obj->type);
 
 	STATELOCK_wrlock(obj->state_hdl);
-	glist_for_each_safe(glist, glist_n,
-			    &obj->state_hdl->file.list_of_states) {
+	op_ctx = &req_ctx;
+	glist_for_each_safe(glist, glist_n, state_obj_list_of_states(obj)) {
 		state = glist_entry(glist, struct state_t, state_list);
 
 		if (state->state_type != STATE_TYPE_DELEG)
 			continue;
 
-		if (isDebug(COMPONENT_NFS_CB)) {
-			char str[LOG_BUFF_LEN] = "\0";
-			struct display_buffer dspbuf = {sizeof(str), str, str};
-
-			display_stateid(&dspbuf, state);
-			LogDebug(COMPONENT_NFS_CB, "Delegation for %s", str);
-		}
-
-		deleg_state = &state->state_data.deleg.sd_state;
-		if (*deleg_state != DELEG_GRANTED) {
-			LogDebug(COMPONENT_FSAL_UP,
-				 "Delegation already being recalled, NOOP");
-			continue;
-		}
-		*deleg_state = DELEG_RECALL_WIP;
-
-		drc_ctx = gsh_malloc(sizeof(struct delegrecall_context));
+		delegrecall_state(obj, state);
+	}
+	STATELOCK_unlock(obj->state_hdl);
 
-		/* Get references on the owner and the the export. The
-		 * export reference we will hold while we perform the recall.
-		 * The owner reference will be used to get access to the
-		 * clientid and reserve the lease.
-		 */
-		if (!get_state_obj_export_owner_refs(state, NULL,
-						     &drc_ctx->drc_exp,
-						     &owner)) {
-			LogDebug(COMPONENT_FSAL_UP,
-				 "Something is going stale, no need to recall delegation");
-			gsh_free(drc_ctx);
-			continue;
-		}
+	op_ctx = save_ctx;
+	return rc;
+}
 
-		/* op_ctx may be used by state_del_locked and others */
-		op_ctx = &req_ctx;
-		op_ctx->ctx_export = drc_ctx->drc_exp;
-		op_ctx->fsal_export = drc_ctx->drc_exp->fsal_export;
+/**
+ * @brief Recall the directory delegations a change conflicts with
+ *
+ * Delegations whose holder asked to be notified of this kind of change
+ * are kept, as is one held by the client making the change.
+ *
+ * @param[in] obj      Directory being changed
+ * @param[in] type     The change, as a NOTIFY4_* value
+ * @param[in] clientid Client making the change, 0 if none
+ *
+ * @return State status.
+ */
+state_status_t delegrecall_dir_impl(struct fsal_obj_handle *obj,
+				    notify_type4 type, clientid4 clientid)
+{
+	struct glist_head *glist, *glist_n;
+	struct state_t *state;
+	struct req_op_context *save_ctx = op_ctx, req_ctx = {0};
 
-		drc_ctx->drc_clid = owner->so_owner.so_nfs4_owner.so_clientrec;
-		COPY_STATEID(&drc_ctx->drc_stateid, state);
-		inc_client_id_ref(drc_ctx->drc_clid);
-		dec_state_owner_ref(owner);
+	LogDebug(COMPONENT_FSAL_UP,
+		 "FSAL_UP_DELEG: dir %p change %d", obj, type);
 
-		obj->state_hdl->file.fdeleg_stats.fds_last_recall = time(NULL);
+	STATELOCK_wrlock(obj->state_hdl);
+	op_ctx = &req_ctx;
+	glist_for_each_safe(glist, glist_n,
+			    &obj->state_hdl->dir.list_of_states) {
+		state = glist_entry(glist, struct state_t, state_list);
 
-		/* Prevent client's lease expiring until we complete
-		 * this recall/revoke operation. If the client's lease
-		 * has already expired, let the reaper thread handling
-		 * expired clients revoke this delegation, and we just
-		 * skip it here.
-		 */
-		PTHREAD_MUTEX_lock(&drc_ctx->drc_clid->cid_mutex);
-		if (!reserve_lease(drc_ctx->drc_clid)) {
-			PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
-			put_gsh_export(drc_ctx->drc_exp);
-			dec_client_id_ref(drc_ctx->drc_clid);
-			gsh_free(drc_ctx);
+		if (!state_dir_deleg_recall_needed(state, type, clientid))
 			continue;
-		}
-		PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
 
-		delegrecall_one(obj, state, drc_ctx);
+		delegrecall_state(obj, state);
 	}
 	STATELOCK_unlock(obj->state_hdl);
 
 	op_ctx = save_ctx;
-	return rc;
+	return STATE_SUCCESS;
 }
 
-/**
- * @brief Recall a delegation
- *
- * @param[in] handle Handle on which the delegation is held
- *
- * @return STATE_SUCCESS or errors.
- */
 state_status_t delegrecall(const struct fsal_up_vector *vec,
 			   struct gsh_buffdesc *handle)
 {
@@ -48,6 +48,8 @@
 #include "pnfs_utils.h"
 #include "fsal.h"
 #include "netgroup_cache.h"
+#include "nfs_proto_functions.h"
+#include "nlm_async.h"
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
 #include "mdcache.h"
@@ -736,6 +738,14 @@ static void do_shutdown(void)
 			 "State asynchronous request system shut down.");
 	}
 
+#ifdef _USE_NLM
+	LogEvent(COMPONENT_MAIN, "Stopping NLM callback threads");
+	nlm_async_callback_shutdown();
+#endif /* _USE_NLM */
+
+	LogEvent(COMPONENT_MAIN, "Stopping group list refresh thread");
+	uid2grp_refresh_shutdown();
+
 	LogEvent(COMPONENT_MAIN, "Unregistering ports used by NFS service");
 	/* finalize RPC package */
 	Clean_RPC();
@@ -769,6 +779,30 @@ static void do_shutdown(void)
 	}
 #endif
 
+	rc = nfs4_compound_par_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down parallel compound fridge: %d",
+			 rc);
+		disorderly = true;
+	}
+
+	rc = nfs4_copy_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down copy fridge: %d", rc);
+		disorderly = true;
+	}
+
+	rc = nfs_resume_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down resume fridge: %d", rc);
+		disorderly = true;
+	} else {
+		LogEvent(COMPONENT_THREAD, "Resume fridge shut down.");
+	}
+
 	rc = general_fridge_shutdown();
 	if (rc != 0) {
 		LogMajor(COMPONENT_THREAD,
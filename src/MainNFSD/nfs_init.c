@@ -46,6 +46,7 @@
 #include "gsh_dbus.h"
 #endif
 #include "FSAL/fsal_commonlib.h"
+#include "FSAL/fsal_fdcache.h"
 #ifdef _USE_CB_SIMULATOR
 #include "nfs_rpc_callback_simulator.h"
 #endif
@@ -440,6 +441,12 @@ int nfs_set_param_from_conf(config_file_t parse_tree,
 	if (mdcache_set_param_from_conf(parse_tree, err_type) < 0)
 		return -1;
 
+	if (fs_log_set_param_from_conf(parse_tree, err_type) < 0)
+		return -1;
+
+	if (fsal_fdcache_set_param_from_conf(parse_tree, err_type) < 0)
+		return -1;
+
 #ifdef USE_RADOS_RECOV
 	if (rados_kv_set_param_from_conf(parse_tree, err_type) < 0)
 		return -1;
@@ -460,9 +467,15 @@ int init_server_pkgs(void)
 
 	/* init uid2grp cache */
 	uid2grp_cache_init();
+	uid2grp_refresh_init();
 
 	ng_cache_init(); /* netgroup cache */
 
+	/* Before the LRU thread, which reaps it, and before exports claim
+	 * file systems.
+	 */
+	fsal_fdcache_pkginit();
+
 	/* MDCACHE Initialisation */
 	fsal_status = mdcache_pkginit();
 	if (FSAL_IS_ERROR(fsal_status)) {
@@ -604,6 +617,36 @@ static void nfs_Start_threads(void)
 	}
 	LogEvent(COMPONENT_THREAD, "General fridge was started successfully");
 
+	/* Starting the threads that finish resumed requests */
+	rc = nfs_resume_init();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not create resume fridge, error = %d (%s)",
+			 rc, strerror(rc));
+	}
+	LogEvent(COMPONENT_THREAD, "Resume fridge was started successfully");
+
+	/* Starting the threads that run parallel COMPOUND segments */
+	if (nfs_param.nfsv4_param.parallel_compound) {
+		rc = nfs4_compound_par_init();
+		if (rc != 0) {
+			LogFatal(COMPONENT_THREAD,
+				 "Could not create parallel compound fridge, error = %d (%s)",
+				 rc, strerror(rc));
+		}
+		LogEvent(COMPONENT_THREAD,
+			 "Parallel compound fridge was started successfully");
+	}
+
+	/* Starting the threads that run asynchronous NFSv4.2 COPY */
+	rc = nfs4_copy_init();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not create copy fridge, error = %d (%s)",
+			 rc, strerror(rc));
+	}
+	LogEvent(COMPONENT_THREAD, "Copy fridge was started successfully");
+
 	pthread_attr_destroy(&attr_thr);
 }
 
@@ -645,6 +688,8 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	nfs_request_pool =
 	    pool_basic_init("Request pool", sizeof(request_data_t));
 
+	req_arena_pkginit();
+
 	/* If rpcsec_gss is used, set the path to the keytab */
 #ifdef _HAVE_GSSAPI
 #ifdef HAVE_KRB5
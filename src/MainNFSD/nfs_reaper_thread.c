@@ -39,6 +39,7 @@
 #include "nfs_core.h"
 #include "log.h"
 #include "fridgethr.h"
+#include "mem_budget.h"
 
 #define REAPER_DELAY 10
 
@@ -306,6 +307,11 @@ static void reaper_run(struct fridgethr_context *ctx)
 	     reap_hash_table(ht_unconfirmed_client_id));
 
 	rst->count += reap_expired_open_owners();
+
+	/* Reclaim from the caches first, trimming can then return it */
+	if (nfs_param.core_param.rss_target != 0)
+		mem_budget_run(get_current_rss());
+
 	if (nfs_param.core_param.enable_trim)
 		reap_malloc_frag();
 }
@@ -833,7 +833,7 @@ rpc_call_channel_t *nfs_rpc_get_chan(nfs_client_id_t *clientid, uint32_t flags)
 
 	/* Get the first working back channel we have */
 	chan = NULL;
-	pthread_mutex_lock(&clientid->cid_mutex);
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
 	glist_for_each(glist, &clientid->cid_cb.v41.cb_session_list) {
 		session = glist_entry(glist, nfs41_session_t, session_link);
 		if (atomic_fetch_uint32_t(&session->flags) & session_bc_up) {
@@ -841,7 +841,7 @@ rpc_call_channel_t *nfs_rpc_get_chan(nfs_client_id_t *clientid, uint32_t flags)
 			break;
 		}
 	}
-	pthread_mutex_unlock(&clientid->cid_mutex);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
 
 	return chan;
 }
@@ -1192,7 +1192,7 @@ static int nfs_rpc_v41_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
 	bool wait = false;
 
 restart:
-	pthread_mutex_lock(&clientid->cid_mutex);
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
 	glist_for_each(glist, &clientid->cid_cb.v41.cb_session_list) {
 		nfs41_session_t *scur, *session;
 		slotid4 slot = 0;
@@ -1237,7 +1237,7 @@ restart:
 		assert(session == scur);
 
 		/* Drop mutex since we have a session ref */
-		pthread_mutex_unlock(&clientid->cid_mutex);
+		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
 
 		call = construct_v41(session, op, refer, slot, highest_slot);
 
@@ -1262,7 +1262,7 @@ restart:
 		dec_session_ref(session);
 		goto restart;
 	}
-	pthread_mutex_unlock(&clientid->cid_mutex);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
 
 	/* If it didn't work, then try again and wait on a slot */
 	if (ret && !wait) {
@@ -44,6 +44,12 @@
 #endif
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#ifdef SO_MEMINFO
+#include <linux/sock_diag.h>
+#endif
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+#include <linux/filter.h>
+#endif
 #include <assert.h>
 #include "hashtable.h"
 #include "log.h"
@@ -60,6 +66,10 @@
 #include "nfs_proto_functions.h"
 #include "nfs_dupreq.h"
 #include "nfs_file_handle.h"
+#include "flight_recorder.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
 
 #define NFS_pcp nfs_param.core_param
 #define NFS_options NFS_pcp.core_options
@@ -72,21 +82,40 @@
 
 struct rpc_evchan {
 	uint32_t chan_id;	/*< Channel ID */
+	int32_t xprts;		/*< TCP connections served */
+	uint64_t accepted;	/*< TCP connections accepted */
 };
 
-enum evchan {
-	UDP_UREG_CHAN,		/*< Put UDP on a dedicated channel */
-	TCP_UREG_CHAN,		/*< Accepts new TCP connections */
-#ifdef _USE_NFS_RDMA
-	RDMA_UREG_CHAN,		/*< Accepts new RDMA connections */
+/** Most TCP channels RPC_TCP_Channels = 0 sizes to */
+#define TCP_AUTO_CHANNELS_MAX 64
+
+/**
+ * SO_REUSEPORT spreads connections and datagrams between the sockets
+ * sharing a port on Linux; elsewhere one of them gets them all.
+ */
+#if defined(SO_REUSEPORT) && defined(__linux__)
+#define RPC_REUSEPORT
+/* Connections stay on the channel of the listener that accepted them */
+#define TCP_EVCHAN_FLAGS SVC_RQST_FLAG_CHAN_AFFINITY
+#else
+#define TCP_EVCHAN_FLAGS SVC_RQST_FLAG_NONE
 #endif
-	EVCHAN_SIZE
-};
-#define N_TCP_EVENT_CHAN  3	/*< We don't really want to have too many,
-				   relative to the number of available cores. */
-#define N_EVENT_CHAN (N_TCP_EVENT_CHAN + EVCHAN_SIZE)
 
-static struct rpc_evchan rpc_evchan[EVCHAN_SIZE];
+/**
+ * TCP channels.  Listener i of every protocol is served by
+ * tcp_evchan[i], and the connections it accepts stay on that channel.
+ */
+static struct rpc_evchan *tcp_evchan;
+
+/**
+ * UDP channels, one per socket of a protocol: socket i of every
+ * protocol is served by udp_evchan[i].
+ */
+static struct rpc_evchan *udp_evchan;
+
+#ifdef _USE_NFS_RDMA
+static struct rpc_evchan rdma_evchan;	/*< Accepts new RDMA connections */
+#endif
 
 static enum xprt_stat nfs_rpc_tcp_user_data(SVCXPRT *);
 static enum xprt_stat nfs_rpc_free_user_data(SVCXPRT *);
@@ -141,11 +170,35 @@ struct netconfig *netconfig_tcpv4;
 struct netconfig *netconfig_udpv6;
 struct netconfig *netconfig_tcpv6;
 
+/**
+ * @brief A socket a protocol is served on
+ *
+ * Each protocol has RPC_UDP_Sockets UDP sockets and, where SO_REUSEPORT
+ * is available, one TCP listener per TCP channel, all bound to its port
+ * with SO_REUSEPORT so the kernel spreads clients between them.
+ */
+struct rpc_listener {
+	int fd;
+	SVCXPRT *xprt;
+	struct rpc_evchan *chan;	/*< Channel serving the socket */
+	uint64_t recvs;		/*< Datagrams handed to TI-RPC (UDP) */
+};
+
 /* RPC Service Sockets and Transports */
-int udp_socket[P_COUNT];
-int tcp_socket[P_COUNT];
-SVCXPRT *udp_xprt[P_COUNT];
-SVCXPRT *tcp_xprt[P_COUNT];
+static struct rpc_listener *udp_listener[P_COUNT];
+static struct rpc_listener *tcp_listener[P_COUNT];
+
+/**
+ * @brief Number of TCP listeners of a protocol
+ */
+static inline uint32_t tcp_listeners(protos p)
+{
+#ifdef RPC_REUSEPORT
+	if (p < P_NFS_VSOCK)
+		return NFS_pcp.rpc.tcp_channels;
+#endif
+	return 1;
+}
 
 /* Flag to indicate if V6 interfaces on the host are enabled */
 bool v6disabled;
@@ -223,6 +276,24 @@ static inline bool nfs_protocol_enabled(protos p)
 	return false;
 }
 
+/**
+ * @brief Close and free a protocol's sockets
+ */
+static void close_listeners(struct rpc_listener *rl, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; rl && i < count; i++) {
+		if (rl[i].fd != -1)
+			close(rl[i].fd);
+		if (rl[i].xprt) {
+			SVC_DESTROY(rl[i].xprt);
+			SVC_RELEASE(rl[i].xprt, SVC_REF_FLAG_NONE);
+		}
+	}
+	gsh_free(rl);
+}
+
 /**
  * @brief Close transports and file descriptors used for RPC services.
  *
@@ -239,20 +310,12 @@ static void close_rpc_fd(void)
 	protos p;
 
 	for (p = P_NFS; p < P_COUNT; p++) {
-		if (udp_socket[p] != -1)
-			close(udp_socket[p]);
-		if (udp_xprt[p]) {
-			SVC_DESTROY(udp_xprt[p]);
-			SVC_RELEASE(udp_xprt[p], SVC_REF_FLAG_NONE);
-		}
-		if (tcp_socket[p] != -1)
-			close(tcp_socket[p]);
-		if (tcp_xprt[p]) {
-			SVC_DESTROY(tcp_xprt[p]);
-			SVC_RELEASE(tcp_xprt[p], SVC_REF_FLAG_NONE);
-		}
+		close_listeners(udp_listener[p], NFS_pcp.rpc.udp_sockets);
+		udp_listener[p] = NULL;
+		close_listeners(tcp_listener[p], tcp_listeners(p));
+		tcp_listener[p] = NULL;
 	}
-	/* no need for special tcp_xprt[P_NFS_VSOCK] treatment */
+	/* no need for special P_NFS_VSOCK treatment */
 }
 
 /**
@@ -266,13 +329,25 @@ static void close_rpc_fd(void)
  * TCP initial connections are bound to socket NFS_TCPSocket
  * all the other cases are requests from already connected TCP Clients
  */
+
+/**
+ * @brief Receive a datagram on one of a protocol's UDP sockets
+ */
+static inline enum xprt_stat nfs_rpc_udp_recv(SVCXPRT *xprt)
+{
+	struct rpc_listener *ul = xprt->xp_u1;
+
+	atomic_inc_uint64_t(&ul->recvs);
+	return SVC_RECV(xprt);
+}
+
 static enum xprt_stat nfs_rpc_dispatch_udp_NFS(SVCXPRT *xprt)
 {
 	LogFullDebug(COMPONENT_DISPATCH,
 		     "NFS UDP request for SVCXPRT %p fd %d",
 		     xprt, xprt->xp_fd);
 	xprt->xp_dispatch.process_cb = nfs_rpc_valid_NFS;
-	return SVC_RECV(xprt);
+	return nfs_rpc_udp_recv(xprt);
 }
 
 static enum xprt_stat nfs_rpc_dispatch_udp_MNT(SVCXPRT *xprt)
@@ -281,7 +356,7 @@ static enum xprt_stat nfs_rpc_dispatch_udp_MNT(SVCXPRT *xprt)
 		     "MOUNT UDP request for SVCXPRT %p fd %d",
 		     xprt, xprt->xp_fd);
 	xprt->xp_dispatch.process_cb = nfs_rpc_valid_MNT;
-	return SVC_RECV(xprt);
+	return nfs_rpc_udp_recv(xprt);
 }
 
 static enum xprt_stat nfs_rpc_dispatch_udp_NLM(SVCXPRT *xprt)
@@ -290,7 +365,7 @@ static enum xprt_stat nfs_rpc_dispatch_udp_NLM(SVCXPRT *xprt)
 		     "NLM UDP request for SVCXPRT %p fd %d",
 		     xprt, xprt->xp_fd);
 	xprt->xp_dispatch.process_cb = nfs_rpc_valid_NLM;
-	return SVC_RECV(xprt);
+	return nfs_rpc_udp_recv(xprt);
 }
 
 static enum xprt_stat nfs_rpc_dispatch_udp_RQUOTA(SVCXPRT *xprt)
@@ -299,7 +374,7 @@ static enum xprt_stat nfs_rpc_dispatch_udp_RQUOTA(SVCXPRT *xprt)
 		     "RQUOTA UDP request for SVCXPRT %p fd %d",
 		     xprt, xprt->xp_fd);
 	xprt->xp_dispatch.process_cb = nfs_rpc_valid_RQUOTA;
-	return SVC_RECV(xprt);
+	return nfs_rpc_udp_recv(xprt);
 }
 
 const svc_xprt_fun_t udp_dispatch[] = {
@@ -367,43 +442,69 @@ const svc_xprt_fun_t tcp_dispatch[] = {
 
 void Create_udp(protos prot)
 {
-	udp_xprt[prot] =
-	    svc_dg_create(udp_socket[prot],
-			  nfs_param.core_param.rpc.max_send_buffer_size,
-			  nfs_param.core_param.rpc.max_recv_buffer_size);
-	if (udp_xprt[prot] == NULL)
-		LogFatal(COMPONENT_DISPATCH, "Cannot allocate %s/UDP SVCXPRT",
-			 tags[prot]);
+	struct rpc_listener *ul;
+	uint32_t i;
+
+	for (i = 0; i < NFS_pcp.rpc.udp_sockets; i++) {
+		ul = &udp_listener[prot][i];
+		ul->xprt =
+		    svc_dg_create(ul->fd,
+				  NFS_pcp.rpc.max_send_buffer_size,
+				  NFS_pcp.rpc.max_recv_buffer_size);
+		if (ul->xprt == NULL)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot allocate %s/UDP SVCXPRT %" PRIu32,
+				 tags[prot], i);
 
-	udp_xprt[prot]->xp_dispatch.rendezvous_cb = udp_dispatch[prot];
+		ul->chan = &udp_evchan[i];
+		ul->xprt->xp_u1 = ul;
+		ul->xprt->xp_dispatch.rendezvous_cb = udp_dispatch[prot];
 
-	/* Hook xp_free_user_data (finalize/free private data) */
-	(void)SVC_CONTROL(udp_xprt[prot], SVCSET_XP_FREE_USER_DATA,
-			  nfs_rpc_free_user_data);
+		/* Hook xp_free_user_data (finalize/free private data) */
+		(void)SVC_CONTROL(ul->xprt, SVCSET_XP_FREE_USER_DATA,
+				  nfs_rpc_free_user_data);
 
-	(void)svc_rqst_evchan_reg(rpc_evchan[UDP_UREG_CHAN].chan_id,
-				  udp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+		(void)svc_rqst_evchan_reg(udp_evchan[i].chan_id, ul->xprt,
+					  SVC_RQST_FLAG_XPRT_UREG);
+	}
 }
 
+/**
+ * @brief Create the listening SVCXPRTs of a protocol
+ *
+ * They are created in index order, which is the order they join the
+ * port's SO_REUSEPORT group in, so listener i is the i-th socket of
+ * the group when connections are steered to it.
+ */
 void Create_tcp(protos prot)
 {
-	tcp_xprt[prot] =
-		svc_vc_ncreatef(tcp_socket[prot],
-				nfs_param.core_param.rpc.max_send_buffer_size,
-				nfs_param.core_param.rpc.max_recv_buffer_size,
-				SVC_CREATE_FLAG_CLOSE | SVC_CREATE_FLAG_LISTEN);
-	if (tcp_xprt[prot] == NULL)
-		LogFatal(COMPONENT_DISPATCH, "Cannot allocate %s/TCP SVCXPRT",
-			 tags[prot]);
+	struct rpc_listener *tl;
+	uint32_t i;
+
+	for (i = 0; i < tcp_listeners(prot); i++) {
+		tl = &tcp_listener[prot][i];
+		tl->xprt =
+		    svc_vc_ncreatef(tl->fd,
+				    NFS_pcp.rpc.max_send_buffer_size,
+				    NFS_pcp.rpc.max_recv_buffer_size,
+				    SVC_CREATE_FLAG_CLOSE |
+				    SVC_CREATE_FLAG_LISTEN);
+		if (tl->xprt == NULL)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot allocate %s/TCP SVCXPRT %" PRIu32,
+				 tags[prot], i);
 
-	tcp_xprt[prot]->xp_dispatch.rendezvous_cb = tcp_dispatch[prot];
+		tl->chan = &tcp_evchan[i];
+		tl->xprt->xp_u1 = tl;
+		tl->xprt->xp_dispatch.rendezvous_cb = tcp_dispatch[prot];
 
-	/* Hook xp_free_user_data (finalize/free private data) */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_FREE_USER_DATA,
-			  nfs_rpc_free_user_data);
+		/* Hook xp_free_user_data (finalize/free private data) */
+		(void)SVC_CONTROL(tl->xprt, SVCSET_XP_FREE_USER_DATA,
+				  nfs_rpc_free_user_data);
 
-	(void)svc_rqst_evchan_reg(rpc_evchan[TCP_UREG_CHAN].chan_id,
-				  tcp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+		(void)svc_rqst_evchan_reg(tl->chan->chan_id, tl->xprt,
+					  SVC_RQST_FLAG_XPRT_UREG);
+	}
 }
 
 #ifdef _USE_NFS_RDMA
@@ -432,23 +533,30 @@ static enum xprt_stat nfs_rpc_dispatch_RDMA(SVCXPRT *xprt)
 
 void Create_RDMA(protos prot)
 {
+	struct rpc_listener *tl;
+
+	tcp_listener[prot] = gsh_calloc(1, sizeof(*tcp_listener[prot]));
+	tl = tcp_listener[prot];
+	tl->fd = -1;
+	tl->chan = &rdma_evchan;
+
 	/* This has elements of both UDP and TCP setup */
-	tcp_xprt[prot] =
+	tl->xprt =
 		svc_rdma_create(&rpc_rdma_xa,
 				nfs_param.core_param.rpc.max_send_buffer_size,
 				nfs_param.core_param.rpc.max_recv_buffer_size);
-	if (tcp_xprt[prot] == NULL)
+	if (tl->xprt == NULL)
 		LogFatal(COMPONENT_DISPATCH, "Cannot allocate RPC/%s SVCXPRT",
 			 tags[prot]);
 
-	tcp_xprt[prot]->xp_dispatch.rendezvous_cb = nfs_rpc_dispatch_RDMA;
+	tl->xprt->xp_dispatch.rendezvous_cb = nfs_rpc_dispatch_RDMA;
 
 	/* Hook xp_free_user_data (finalize/free private data) */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_FREE_USER_DATA,
+	(void)SVC_CONTROL(tl->xprt, SVCSET_XP_FREE_USER_DATA,
 			  nfs_rpc_free_user_data);
 
-	(void)svc_rqst_evchan_reg(rpc_evchan[RDMA_UREG_CHAN].chan_id,
-				  tcp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+	(void)svc_rqst_evchan_reg(rdma_evchan.chan_id,
+				  tl->xprt, SVC_RQST_FLAG_XPRT_UREG);
 }
 #endif
 
@@ -475,6 +583,21 @@ void Create_SVCXPRTs(void)
 #endif /* _USE_NFS_RDMA */
 }
 
+/**
+ * @brief Bind all the sockets of a protocol to its address
+ */
+static int bind_listeners(struct rpc_listener *rl, uint32_t count,
+			  struct sockaddr *addr, socklen_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		if (bind(rl[i].fd, addr, len) == -1)
+			return -1;
+
+	return 0;
+}
+
 /**
  * @brief Bind the udp and tcp sockets for V6 Interfaces
  */
@@ -506,7 +629,7 @@ static int Bind_sockets_V6(void)
 			pdatap->bindaddr_udp6.qlen = SOMAXCONN;
 			pdatap->bindaddr_udp6.addr = pdatap->netbuf_udp6;
 
-			if (!__rpc_fd2sockinfo(udp_socket[p],
+			if (!__rpc_fd2sockinfo(udp_listener[p][0].fd,
 			    &pdatap->si_udp6)) {
 				LogWarn(COMPONENT_DISPATCH,
 					 "Cannot get %s socket info for udp6 socket errno=%d (%s)",
@@ -514,7 +637,8 @@ static int Bind_sockets_V6(void)
 				return -1;
 			}
 
-			rc = bind(udp_socket[p],
+			rc = bind_listeners(udp_listener[p],
+				  NFS_pcp.rpc.udp_sockets,
 			      (struct sockaddr *)pdatap->bindaddr_udp6.addr.buf,
 				  (socklen_t) pdatap->si_udp6.si_alen);
 			if (rc == -1) {
@@ -542,7 +666,7 @@ static int Bind_sockets_V6(void)
 			pdatap->bindaddr_tcp6.qlen = SOMAXCONN;
 			pdatap->bindaddr_tcp6.addr = pdatap->netbuf_tcp6;
 
-			if (!__rpc_fd2sockinfo(tcp_socket[p],
+			if (!__rpc_fd2sockinfo(tcp_listener[p][0].fd,
 			    &pdatap->si_tcp6)) {
 				LogWarn(COMPONENT_DISPATCH,
 					 "Cannot get %s socket info for tcp6 socket errno=%d (%s)",
@@ -550,7 +674,7 @@ static int Bind_sockets_V6(void)
 				return -1;
 			}
 
-			rc = bind(tcp_socket[p],
+			rc = bind_listeners(tcp_listener[p], tcp_listeners(p),
 				  (struct sockaddr *)
 				   pdatap->bindaddr_tcp6.addr.buf,
 				 (socklen_t) pdatap->si_tcp6.si_alen);
@@ -598,7 +722,7 @@ static int Bind_sockets_V4(void)
 			pdatap->bindaddr_udp6.qlen = SOMAXCONN;
 			pdatap->bindaddr_udp6.addr = pdatap->netbuf_udp6;
 
-			if (!__rpc_fd2sockinfo(udp_socket[p],
+			if (!__rpc_fd2sockinfo(udp_listener[p][0].fd,
 			    &pdatap->si_udp6)) {
 				LogWarn(COMPONENT_DISPATCH,
 					"Cannot get %s socket info for udp6 socket errno=%d (%s)",
@@ -606,7 +730,8 @@ static int Bind_sockets_V4(void)
 				return -1;
 			}
 
-			rc = bind(udp_socket[p],
+			rc = bind_listeners(udp_listener[p],
+				  NFS_pcp.rpc.udp_sockets,
 				  (struct sockaddr *)
 				  pdatap->bindaddr_udp6.addr.buf,
 				  (socklen_t) pdatap->si_udp6.si_alen);
@@ -635,7 +760,7 @@ static int Bind_sockets_V4(void)
 			pdatap->bindaddr_tcp6.qlen = SOMAXCONN;
 			pdatap->bindaddr_tcp6.addr = pdatap->netbuf_tcp6;
 
-			if (!__rpc_fd2sockinfo(tcp_socket[p],
+			if (!__rpc_fd2sockinfo(tcp_listener[p][0].fd,
 			    &pdatap->si_tcp6)) {
 				LogWarn(COMPONENT_DISPATCH,
 					"V4 : Cannot get %s socket info for tcp socket error %d(%s)",
@@ -643,7 +768,7 @@ static int Bind_sockets_V4(void)
 				return -1;
 			}
 
-			rc = bind(tcp_socket[p],
+			rc = bind_listeners(tcp_listener[p], tcp_listeners(p),
 				  (struct sockaddr *)
 				  pdatap->bindaddr_tcp6.addr.buf,
 				  (socklen_t) pdatap->si_tcp6.si_alen);
@@ -670,7 +795,7 @@ int bind_sockets_vsock(void)
 		.svm_port = nfs_param.core_param.port[P_NFS],
 	};
 
-	rc = bind(tcp_socket[P_NFS_VSOCK], (struct sockaddr *)
+	rc = bind(tcp_listener[P_NFS_VSOCK][0].fd, (struct sockaddr *)
 		(struct sockaddr *)&sa_listen, sizeof(sa_listen));
 	if (rc == -1) {
 		LogWarn(COMPONENT_DISPATCH,
@@ -714,18 +839,15 @@ void Bind_sockets(void)
 }
 
 /**
- * @brief Function to set the socket options on the allocated
- *	  udp and tcp sockets
- *
+ * @brief Set the socket options on one of the udp sockets of a protocol
  */
-static int alloc_socket_setopts(int p)
+static int udp_socket_setopts(int p, int fd)
 {
 	int one = 1;
-	const struct nfs_core_param *nfs_cp = &nfs_param.core_param;
 
 	/* Use SO_REUSEADDR in order to avoid wait
 	 * the 2MSL timeout */
-	if (setsockopt(udp_socket[p],
+	if (setsockopt(fd,
 		       SOL_SOCKET, SO_REUSEADDR,
 		       &one, sizeof(one))) {
 		LogWarn(COMPONENT_DISPATCH,
@@ -735,7 +857,42 @@ static int alloc_socket_setopts(int p)
 		return -1;
 	}
 
-	if (setsockopt(tcp_socket[p],
+#ifdef RPC_REUSEPORT
+	/* Let the protocol's sockets share its port */
+	if (NFS_pcp.rpc.udp_sockets > 1 &&
+	    setsockopt(fd,
+		       SOL_SOCKET, SO_REUSEPORT,
+		       &one, sizeof(one))) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Bad udp socket option reuseport for %s, error %d(%s)",
+			tags[p], errno, strerror(errno));
+
+		return -1;
+	}
+#endif
+
+	/* We prefer using non-blocking socket
+	 * in the specific case */
+	if (fcntl(fd, F_SETFL, FNDELAY) == -1) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Cannot set udp socket for %s as non blocking, error %d(%s)",
+			tags[p], errno, strerror(errno));
+
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Set the socket options on one of the tcp listeners of a protocol
+ */
+static int tcp_socket_setopts(int p, int fd)
+{
+	int one = 1;
+	const struct nfs_core_param *nfs_cp = &nfs_param.core_param;
+
+	if (setsockopt(fd,
 		       SOL_SOCKET, SO_REUSEADDR,
 		       &one, sizeof(one))) {
 		LogWarn(COMPONENT_DISPATCH,
@@ -745,8 +902,22 @@ static int alloc_socket_setopts(int p)
 		return -1;
 	}
 
+#ifdef RPC_REUSEPORT
+	/* Let the protocol's listeners share its port */
+	if (tcp_listeners(p) > 1 &&
+	    setsockopt(fd,
+		       SOL_SOCKET, SO_REUSEPORT,
+		       &one, sizeof(one))) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Bad tcp socket option reuseport for %s, error %d(%s)",
+			tags[p], errno, strerror(errno));
+
+		return -1;
+	}
+#endif
+
 	if (nfs_cp->enable_tcp_keepalive) {
-		if (setsockopt(tcp_socket[p],
+		if (setsockopt(fd,
 			       SOL_SOCKET, SO_KEEPALIVE,
 			       &one, sizeof(one))) {
 			LogWarn(COMPONENT_DISPATCH,
@@ -757,7 +928,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepcnt) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP, TCP_KEEPCNT,
+			if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT,
 				       &nfs_cp->tcp_keepcnt,
 				       sizeof(nfs_cp->tcp_keepcnt))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -769,7 +940,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepidle) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP, TCP_KEEPIDLE,
+			if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE,
 				       &nfs_cp->tcp_keepidle,
 				       sizeof(nfs_cp->tcp_keepidle))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -781,7 +952,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepintvl) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP,
+			if (setsockopt(fd, IPPROTO_TCP,
 				       TCP_KEEPINTVL, &nfs_cp->tcp_keepintvl,
 				       sizeof(nfs_cp->tcp_keepintvl))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -793,17 +964,71 @@ static int alloc_socket_setopts(int p)
 		}
 	}
 
-	/* We prefer using non-blocking socket
-	 * in the specific case */
-	if (fcntl(udp_socket[p], F_SETFL, FNDELAY) == -1) {
-		LogWarn(COMPONENT_DISPATCH,
-			"Cannot set udp socket for %s as non blocking, error %d(%s)",
-			tags[p], errno, strerror(errno));
+	return 0;
+}
 
-		return -1;
+/**
+ * @brief Function to set the socket options on the allocated
+ *	  udp and tcp sockets
+ *
+ */
+static int alloc_socket_setopts(int p)
+{
+	uint32_t i;
+
+	for (i = 0; i < NFS_pcp.rpc.udp_sockets; i++)
+		if (udp_socket_setopts(p, udp_listener[p][i].fd))
+			return -1;
+
+	for (i = 0; i < tcp_listeners(p); i++)
+		if (tcp_socket_setopts(p, tcp_listener[p][i].fd))
+			return -1;
+
+	return 0;
+}
+
+/**
+ * @brief Allocate an array of sockets, none open yet
+ */
+static struct rpc_listener *new_listeners(uint32_t count)
+{
+	struct rpc_listener *rl = gsh_calloc(count, sizeof(*rl));
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		rl[i].fd = -1;
+
+	return rl;
+}
+
+/**
+ * @brief Open the sockets of a protocol
+ *
+ * On failure none are left open, and errno is that of the failed
+ * socket() call.
+ */
+static int alloc_listeners(struct rpc_listener *rl, uint32_t count,
+			   int domain, int type, int protocol)
+{
+	uint32_t i;
+	int err;
+
+	for (i = 0; i < count; i++) {
+		rl[i].fd = socket(domain, type, protocol);
+		if (rl[i].fd == -1)
+			goto err;
 	}
 
 	return 0;
+
+err:
+	err = errno;
+	while (i-- > 0) {
+		close(rl[i].fd);
+		rl[i].fd = -1;
+	}
+	errno = err;
+	return -1;
 }
 
 /**
@@ -812,11 +1037,8 @@ static int alloc_socket_setopts(int p)
  */
 static int Allocate_sockets_V4(int p)
 {
-	udp_socket[p] = socket(AF_INET,
-			       SOCK_DGRAM,
-			       IPPROTO_UDP);
-
-	if (udp_socket[p] == -1) {
+	if (alloc_listeners(udp_listener[p], NFS_pcp.rpc.udp_sockets,
+			    AF_INET, SOCK_DGRAM, IPPROTO_UDP) == -1) {
 		if (errno == EAFNOSUPPORT) {
 			LogInfo(COMPONENT_DISPATCH,
 				"No V6 and V4 intfs configured?!");
@@ -829,11 +1051,8 @@ static int Allocate_sockets_V4(int p)
 		return -1;
 	}
 
-	tcp_socket[p] = socket(AF_INET,
-			       SOCK_STREAM,
-			       IPPROTO_TCP);
-
-	if (tcp_socket[p] == -1) {
+	if (alloc_listeners(tcp_listener[p], tcp_listeners(p),
+			    AF_INET, SOCK_STREAM, IPPROTO_TCP) == -1) {
 		LogWarn(COMPONENT_DISPATCH,
 			"Cannot allocate a tcp socket for %s, error %d(%s)",
 			tags[p], errno, strerror(errno));
@@ -851,15 +1070,18 @@ static int Allocate_sockets_V4(int p)
 static int allocate_socket_vsock(void)
 {
 	int one = 1;
+	int fd;
 
-	tcp_socket[P_NFS_VSOCK] = socket(AF_VSOCK, SOCK_STREAM, 0);
-	if (tcp_socket[P_NFS_VSOCK] == -1) {
+	tcp_listener[P_NFS_VSOCK] = new_listeners(1);
+	fd = socket(AF_VSOCK, SOCK_STREAM, 0);
+	if (fd == -1) {
 		LogWarn(COMPONENT_DISPATCH,
 			"socket create failed for %s, error %d(%s)",
 			tags[P_NFS_VSOCK], errno, strerror(errno));
 		return -1;
 	}
-	if (setsockopt(tcp_socket[P_NFS_VSOCK],
+	tcp_listener[P_NFS_VSOCK][0].fd = fd;
+	if (setsockopt(fd,
 			SOL_SOCKET, SO_REUSEADDR,
 			&one, sizeof(one))) {
 		LogWarn(COMPONENT_DISPATCH,
@@ -872,7 +1094,7 @@ static int allocate_socket_vsock(void)
 	LogDebug(COMPONENT_DISPATCH,
 		"Socket numbers are: %s tcp=%u",
 		tags[P_NFS_VSOCK],
-		tcp_socket[P_NFS_VSOCK]);
+		fd);
 	return 0;
 }
 #endif /* RPC_VSOCK */
@@ -890,18 +1112,20 @@ static void Allocate_sockets(void)
 	for (p = P_NFS; p < P_COUNT; p++) {
 		/* Initialize all the sockets to -1 because
 		 * it makes some code later easier */
-		udp_socket[p] = -1;
-		tcp_socket[p] = -1;
+		udp_listener[p] = NULL;
+		tcp_listener[p] = NULL;
 
 		if (nfs_protocol_enabled(p)) {
+			udp_listener[p] =
+				new_listeners(NFS_pcp.rpc.udp_sockets);
+			tcp_listener[p] = new_listeners(tcp_listeners(p));
+
 			if (v6disabled)
 				goto try_V4;
 
-			udp_socket[p] = socket(AF_INET6,
-					       SOCK_DGRAM,
-					       IPPROTO_UDP);
-
-			if (udp_socket[p] == -1) {
+			if (alloc_listeners(udp_listener[p],
+					    NFS_pcp.rpc.udp_sockets, AF_INET6,
+					    SOCK_DGRAM, IPPROTO_UDP) == -1) {
 				/*
 				 * We assume that EAFNOSUPPORT points
 				 * to the likely case when the host has
@@ -923,9 +1147,9 @@ static void Allocate_sockets(void)
 					 tags[p], errno, strerror(errno));
 			}
 
-			tcp_socket[p] = socket(AF_INET6,
-					       SOCK_STREAM,
-					       IPPROTO_TCP);
+			rc = alloc_listeners(tcp_listener[p], tcp_listeners(p),
+					     AF_INET6, SOCK_STREAM,
+					     IPPROTO_TCP);
 
 			/* We fail with LogFatal here on error because it
 			 * shouldn't be that we have managed to create a
@@ -935,7 +1159,7 @@ static void Allocate_sockets(void)
 			 * the first udp sock create and would have moved
 			 * on to create the V4 sockets.
 			 */
-			if (tcp_socket[p] == -1)
+			if (rc == -1)
 				LogFatal(COMPONENT_DISPATCH,
 					 "Cannot allocate a tcp socket for %s, error %d(%s)",
 					 tags[p], errno, strerror(errno));
@@ -957,10 +1181,13 @@ try_V4:
 					 p, tags[p]);
 			}
 			LogDebug(COMPONENT_DISPATCH,
-				"Socket numbers are: %s tcp=%u udp=%u",
+				"Socket numbers are: %s tcp=%u udp=%u (%" PRIu32
+				" tcp and %" PRIu32 " udp sockets)",
 				tags[p],
-				tcp_socket[p],
-				udp_socket[p]);
+				tcp_listener[p][0].fd,
+				udp_listener[p][0].fd,
+				tcp_listeners(p),
+				NFS_pcp.rpc.udp_sockets);
 		}
 	}
 #ifdef RPC_VSOCK
@@ -987,12 +1214,12 @@ void Clean_RPC(void)
 }
 
 #define UDP_REGISTER(prot, vers, netconfig) \
-	svc_reg(udp_xprt[prot], NFS_program[prot], \
+	svc_reg(udp_listener[prot][0].xprt, NFS_program[prot], \
 		(u_long) vers,					    \
 		nfs_rpc_dispatch_dummy, netconfig)
 
 #define TCP_REGISTER(prot, vers, netconfig) \
-	svc_reg(tcp_xprt[prot], NFS_program[prot], \
+	svc_reg(tcp_listener[prot][0].xprt, NFS_program[prot], \
 		(u_long) vers,					    \
 		nfs_rpc_dispatch_dummy, netconfig)
 
@@ -1055,6 +1282,23 @@ static void Register_program(protos prot, int flag, int vers)
 }
 #endif /* RPCBIND */
 
+/**
+ * @brief Create a TI-RPC event channel
+ */
+static void new_evchan(struct rpc_evchan *evchan, uint32_t flags,
+		       const char *type, int ix)
+{
+	int code;
+
+	evchan->chan_id = 0;
+	code = svc_rqst_new_evchan(&evchan->chan_id, NULL /* u_data */,
+				   flags);
+	if (code)
+		LogFatal(COMPONENT_DISPATCH,
+			 "Cannot create TI-RPC %s event channel (%d, %d)",
+			 type, ix, code);
+}
+
 /**
  * @brief Init the svc descriptors for the nfs daemon
  *
@@ -1065,7 +1309,6 @@ void nfs_Init_svc(void)
 {
 	svc_init_params svc_params;
 	int ix;
-	int code;
 
 	LogDebug(COMPONENT_DISPATCH, "NFS INIT: Core options = %d",
 		 NFS_options);
@@ -1085,6 +1328,22 @@ void nfs_Init_svc(void)
 #ifdef _USE_NFS_RDMA
 	rdma = NFS_options & CORE_OPTION_NFS_RDMA;
 #endif
+#ifndef RPC_REUSEPORT
+	if (NFS_pcp.rpc.udp_sockets > 1) {
+		LogWarn(COMPONENT_DISPATCH,
+			"SO_REUSEPORT not supported, using one UDP socket per protocol");
+		NFS_pcp.rpc.udp_sockets = 1;
+	}
+#endif
+	if (NFS_pcp.rpc.tcp_channels == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+		NFS_pcp.rpc.tcp_channels =
+			ncpu > 0 ? MIN(ncpu, TCP_AUTO_CHANNELS_MAX) : 1;
+	}
+	LogInfo(COMPONENT_DISPATCH,
+		"%" PRIu32 " TCP and %" PRIu32 " UDP event channels",
+		NFS_pcp.rpc.tcp_channels, NFS_pcp.rpc.udp_sockets);
 
 	/* New TI-RPC package init function */
 	svc_params.disconnect_cb = NULL;
@@ -1095,7 +1354,11 @@ void nfs_Init_svc(void)
 	svc_params.max_events = 1024;	/* length of epoll event queue */
 	svc_params.ioq_send_max =
 	    nfs_param.core_param.rpc.max_send_buffer_size;
-	svc_params.channels = N_EVENT_CHAN;
+	/* Ours, and as many again as TCP channels for TI-RPC to place
+	 * connections on where they do not stay with their listener.
+	 */
+	svc_params.channels = 2 * NFS_pcp.rpc.tcp_channels +
+			      NFS_pcp.rpc.udp_sockets + 1;
 	svc_params.idle_timeout = nfs_param.core_param.rpc.idle_timeout_s;
 	svc_params.ioq_thrd_min = nfs_param.core_param.rpc.ioq_thrd_min;
 	svc_params.ioq_thrd_max = nfs_param.core_param.rpc.ioq_thrd_max;
@@ -1111,17 +1374,17 @@ void nfs_Init_svc(void)
 	if (!svc_init(&svc_params))
 		LogFatal(COMPONENT_INIT, "SVC initialization failed");
 
-	for (ix = 0; ix < EVCHAN_SIZE; ++ix) {
-		rpc_evchan[ix].chan_id = 0;
-		code = svc_rqst_new_evchan(&rpc_evchan[ix].chan_id,
-					   NULL /* u_data */,
-					   SVC_RQST_FLAG_NONE);
-		if (code)
-			LogFatal(COMPONENT_DISPATCH,
-				 "Cannot create TI-RPC event channel (%d, %d)",
-				 ix, code);
-		/* XXX bail?? */
-	}
+	tcp_evchan = gsh_calloc(NFS_pcp.rpc.tcp_channels, sizeof(*tcp_evchan));
+	for (ix = 0; ix < NFS_pcp.rpc.tcp_channels; ++ix)
+		new_evchan(&tcp_evchan[ix], TCP_EVCHAN_FLAGS, "TCP", ix);
+
+	udp_evchan = gsh_calloc(NFS_pcp.rpc.udp_sockets, sizeof(*udp_evchan));
+	for (ix = 0; ix < NFS_pcp.rpc.udp_sockets; ++ix)
+		new_evchan(&udp_evchan[ix], SVC_RQST_FLAG_NONE, "UDP", ix);
+
+#ifdef _USE_NFS_RDMA
+	new_evchan(&rdma_evchan, SVC_RQST_FLAG_NONE, "RDMA", 0);
+#endif
 
 	/* Get the netconfig entries from /etc/netconfig */
 	netconfig_udpv4 = (struct netconfig *)getnetconfigent("udp");
@@ -1230,13 +1493,182 @@ void nfs_Init_svc(void)
 
 }
 
+#ifdef USE_DBUS
+/**
+ * @brief Append the counters of one UDP socket
+ *
+ * Drops and queued bytes are the kernel's, so they cover datagrams that
+ * never reached TI-RPC because the socket buffer was full.
+ */
+static void udp_listener_dbus_append(DBusMessageIter *iter, protos p,
+				     uint32_t i)
+{
+	DBusMessageIter sock_iter;
+	struct rpc_listener *ul = &udp_listener[p][i];
+	uint64_t recvs = atomic_fetch_uint64_t(&ul->recvs);
+	uint64_t drops = 0, queued = 0, rcvbuf = 0;
+	const char *tag = tags[p];
+#ifdef SO_MEMINFO
+	uint32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t len = sizeof(meminfo);
+
+	if (getsockopt(ul->fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0) {
+		drops = meminfo[SK_MEMINFO_DROPS];
+		queued = meminfo[SK_MEMINFO_RMEM_ALLOC];
+		rcvbuf = meminfo[SK_MEMINFO_RCVBUF];
+	}
+#endif
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &sock_iter);
+	dbus_message_iter_append_basic(&sock_iter, DBUS_TYPE_STRING, &tag);
+	dbus_message_iter_append_basic(&sock_iter, DBUS_TYPE_UINT32, &i);
+	dbus_message_iter_append_basic(&sock_iter, DBUS_TYPE_UINT64, &recvs);
+	dbus_message_iter_append_basic(&sock_iter, DBUS_TYPE_UINT64, &drops);
+	dbus_message_iter_append_basic(&sock_iter, DBUS_TYPE_UINT64, &queued);
+	dbus_message_iter_append_basic(&sock_iter, DBUS_TYPE_UINT64, &rcvbuf);
+	dbus_message_iter_close_container(iter, &sock_iter);
+}
+
+/**
+ * @brief Report the datagrams received, dropped and queued by socket
+ */
+void nfs_rpc_udp_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter, array_iter;
+	protos p;
+	uint32_t i;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &NFS_pcp.rpc.udp_sockets);
+	dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY,
+					 "(sutttt)", &array_iter);
+
+	for (p = P_NFS; p < P_COUNT; p++)
+		for (i = 0; udp_listener[p] && i < NFS_pcp.rpc.udp_sockets;
+		     i++)
+			if (udp_listener[p][i].xprt != NULL)
+				udp_listener_dbus_append(&array_iter, p, i);
+
+	dbus_message_iter_close_container(&struct_iter, &array_iter);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif
+
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+/**
+ * Connections are steered to the least loaded TCP channel by a one
+ * instruction reuseport program returning the index of its listener.
+ * The target only moves once it has TCP_STEER_SLACK connections more
+ * than the least loaded channel, so a storm does not reattach the
+ * program on every accept.  If connections keep landing elsewhere, as
+ * they would were the listeners not in creation order in their group,
+ * steering is dropped and the kernel's hash spreads them again.
+ */
+#define TCP_STEER_SLACK 4
+#define TCP_STEER_MISSES 8192
+
+static pthread_mutex_t tcp_steer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t tcp_steer_target;
+static uint32_t tcp_steer_misses;
+static bool tcp_steer_active;
+static bool tcp_steer_off;
+
+/**
+ * @brief Send new connections of every protocol to listener @a index
+ *
+ * An index past the last listener hands the choice back to the kernel.
+ */
+static void tcp_steer_attach(uint32_t index)
+{
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_RET | BPF_K, index),
+	};
+	struct sock_fprog prog = {
+		.len = 1,
+		.filter = code,
+	};
+	protos p;
+
+	for (p = P_NFS; p < P_NFS_VSOCK; p++) {
+		if (tcp_listener[p] == NULL || tcp_listener[p][0].xprt == NULL)
+			continue;
+
+		if (setsockopt(tcp_listener[p][0].fd, SOL_SOCKET,
+			       SO_ATTACH_REUSEPORT_CBPF, &prog,
+			       sizeof(prog)) != 0)
+			LogDebug(COMPONENT_DISPATCH,
+				 "Cannot steer %s connections, error %d(%s)",
+				 tags[p], errno, strerror(errno));
+	}
+}
+
+/**
+ * @brief Point new connections at the least loaded TCP channel
+ *
+ * @param[in] tl Listener that accepted the last connection
+ */
+static void tcp_steer(struct rpc_listener *tl)
+{
+	struct rpc_evchan *target;
+	int32_t xprts, least = INT32_MAX;
+	uint32_t i, index = 0;
+
+	/* Not in a SO_REUSEPORT group */
+	if (tl == tcp_listener[P_NFS_VSOCK])
+		return;
+
+	/* Another listener is at it, this accept can go uncounted */
+	if (pthread_mutex_trylock(&tcp_steer_mutex) != 0)
+		return;
+
+	if (tcp_steer_off)
+		goto out;
+
+	target = &tcp_evchan[tcp_steer_target];
+
+	if (!tcp_steer_active || tl->chan == target) {
+		tcp_steer_misses = 0;
+	} else if (++tcp_steer_misses > TCP_STEER_MISSES) {
+		LogWarn(COMPONENT_DISPATCH,
+			"TCP connections are not following the least loaded channel, leaving their placement to the kernel");
+		tcp_steer_attach(UINT32_MAX);
+		tcp_steer_off = true;
+		goto out;
+	}
+
+	for (i = 0; i < NFS_pcp.rpc.tcp_channels; i++) {
+		xprts = atomic_fetch_int32_t(&tcp_evchan[i].xprts);
+		if (xprts < least) {
+			least = xprts;
+			index = i;
+		}
+	}
+
+	if (atomic_fetch_int32_t(&target->xprts) < least + TCP_STEER_SLACK &&
+	    tcp_steer_active)
+		goto out;
+
+	if (index != tcp_steer_target || !tcp_steer_active) {
+		tcp_steer_attach(index);
+		tcp_steer_target = index;
+		tcp_steer_misses = 0;
+		tcp_steer_active = true;
+	}
+
+out:
+	PTHREAD_MUTEX_unlock(&tcp_steer_mutex);
+}
+#endif /* SO_ATTACH_REUSEPORT_CBPF */
+
 /**
  * @brief Rendezvous callout.  This routine will be called by TI-RPC
  *        after newxprt has been accepted.
  *
- * Register newxprt on a TCP event channel.  Balancing events/channels
- * could become involved.  To start with, just cycle through them as
- * new connections are accepted.
+ * newxprt stays on the channel of the listener that accepted it, and
+ * is counted against that channel until it is destroyed.
  *
  * @param[in] newxprt Newly created transport
  *
@@ -1244,9 +1676,77 @@ void nfs_Init_svc(void)
  */
 static enum xprt_stat nfs_rpc_tcp_user_data(SVCXPRT *newxprt)
 {
+	struct rpc_listener *tl = newxprt->xp_parent->xp_u1;
+
+	newxprt->xp_u1 = tl->chan;
+	atomic_inc_int32_t(&tl->chan->xprts);
+	atomic_inc_uint64_t(&tl->chan->accepted);
+
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+	if (NFS_pcp.rpc.tcp_channels > 1)
+		tcp_steer(tl);
+#endif
 	return SVC_STAT(newxprt->xp_parent);
 }
 
+/**
+ * @brief Number of TCP event channels
+ */
+uint32_t nfs_rpc_tcp_channels(void)
+{
+	return NFS_pcp.rpc.tcp_channels;
+}
+
+/**
+ * @brief Connections on a TCP event channel
+ *
+ * @param[in]  chan     Channel index
+ * @param[out] xprts    Connections it serves
+ * @param[out] accepted Connections it has accepted
+ */
+void nfs_rpc_tcp_channel_load(uint32_t chan, int32_t *xprts,
+			      uint64_t *accepted)
+{
+	*xprts = atomic_fetch_int32_t(&tcp_evchan[chan].xprts);
+	*accepted = atomic_fetch_uint64_t(&tcp_evchan[chan].accepted);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the connections served and accepted by TCP channel
+ */
+void nfs_rpc_tcp_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter, array_iter, chan_iter;
+	int32_t xprts;
+	uint64_t accepted;
+	uint32_t i;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &NFS_pcp.rpc.tcp_channels);
+	dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY,
+					 "(uit)", &array_iter);
+
+	for (i = 0; i < NFS_pcp.rpc.tcp_channels; i++) {
+		nfs_rpc_tcp_channel_load(i, &xprts, &accepted);
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &chan_iter);
+		dbus_message_iter_append_basic(&chan_iter, DBUS_TYPE_UINT32,
+					       &i);
+		dbus_message_iter_append_basic(&chan_iter, DBUS_TYPE_INT32,
+					       &xprts);
+		dbus_message_iter_append_basic(&chan_iter, DBUS_TYPE_UINT64,
+					       &accepted);
+		dbus_message_iter_close_container(&array_iter, &chan_iter);
+	}
+
+	dbus_message_iter_close_container(&struct_iter, &array_iter);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif
+
 /**
  * @brief xprt destructor callout
  *
@@ -1254,6 +1754,14 @@ static enum xprt_stat nfs_rpc_tcp_user_data(SVCXPRT *newxprt)
  */
 static enum xprt_stat nfs_rpc_free_user_data(SVCXPRT *xprt)
 {
+	struct rpc_evchan *chan = xprt->xp_u1;
+
+	/* Accepted TCP connections, see nfs_rpc_tcp_user_data() */
+	if (xprt->xp_parent && chan) {
+		atomic_dec_int32_t(&chan->xprts);
+		xprt->xp_u1 = NULL;
+	}
+
 	if (xprt->xp_u2) {
 		nfs_dupreq_put_drc(xprt->xp_u2);
 		xprt->xp_u2 = NULL;
@@ -1311,6 +1819,7 @@ int free_nfs_request(request_data_t *reqdata)
 		break;
 	}
 	SVC_RELEASE(xprt, SVC_RELEASE_FLAG_NONE);
+	req_arena_release(&reqdata->arena);
 	pool_free(nfs_request_pool, reqdata);
 	(void) atomic_inc_uint64_t(&nfs_health_.dequeued_reqs);
 	return 0;
@@ -1336,6 +1845,7 @@ static enum xprt_stat nfs_rpc_decode_request(SVCXPRT *xprt, XDR *xdrs)
 		 xprt, xprt->xp_fd, xdrs);
 
 	reqdata = alloc_nfs_request(xprt, xdrs);
+	fr_request_start();
 #if HAVE_BLKIN
 	blkin_init_new_trace(&reqdata->r_u.req.svc.bl_trace, "nfs-ganesha",
 			&xprt->blkin.endp);
@@ -1358,6 +1868,7 @@ static enum xprt_stat nfs_rpc_decode_request(SVCXPRT *xprt, XDR *xdrs)
 		"rq-xid",
 		reqdata->r_u.req.svc.rq_xid);
 #endif
+	fr_request_end();
 
 	if (unlikely(stat > XPRT_DESTROYED)) {
 		LogInfo(COMPONENT_DISPATCH,
@@ -60,6 +60,8 @@
 #include "export_mgr.h"
 #include "server_stats.h"
 #include "uid2grp.h"
+#include "flight_recorder.h"
+#include "fridgethr.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -660,6 +662,321 @@ const nfs_function_desc_t rquota2_func_desc[] = {
 				       .dispatch_behaviour = NEEDS_CRED}
 };
 
+/**
+ * @brief Send the reply to a processed request
+ *
+ * @param[in,out] reqdata	NFS request
+ * @param[in]     rc		Result of the service function
+ */
+static void complete_request(request_data_t *reqdata, int rc)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	nfs_res_t *res_nfs = reqdata->r_u.req.res_nfs;
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	const char *client_ip = "<unknown client>";
+	enum xprt_stat xprt_rc;
+
+	if (op_ctx->client != NULL)
+		client_ip = op_ctx->client->hostaddr_str;
+
+/* NFSv4 stats are handled in nfs4_compound()
+ */
+	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
+	    || reqdata->r_u.req.svc.rq_msg.cb_vers != NFS_V4)
+		server_stats_nfs_done(reqdata, rc, false);
+
+	/* If request is dropped, no return to the client */
+	if (rc == NFS_REQ_DROP) {
+		/* The request was dropped */
+		LogDebug(COMPONENT_DISPATCH,
+			 "Drop request rpc_xid=%" PRIu32
+			 ", program %" PRIu32
+			 ", version %" PRIu32
+			 ", function %" PRIu32,
+			 reqdata->r_u.req.svc.rq_msg.rm_xid,
+			 reqdata->r_u.req.svc.rq_msg.cb_prog,
+			 reqdata->r_u.req.svc.rq_msg.cb_vers,
+			 reqdata->r_u.req.svc.rq_msg.cb_proc);
+
+		/* If the request is not normally cached, then the entry
+		 * will be removed later.  We only remove a reply that is
+		 * normally cached that has been dropped.
+		 */
+		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
+		    != DUPREQ_SUCCESS) {
+			LogCrit(COMPONENT_DISPATCH,
+				"Attempt to delete duplicate request failed on line %d",
+				__LINE__);
+		}
+		return;
+	}
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "Before svc_sendreply on socket %d", xprt->xp_fd);
+
+	reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_results.where = res_nfs;
+	reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_results.proc =
+				fr_encode_proc(reqdesc->xdr_encode_func);
+	fr_mark(FR_SEND, NULL);
+	xprt_rc = svc_sendreply(&reqdata->r_u.req.svc);
+	fr_mark(FR_SENT, NULL);
+	if (xprt_rc >= XPRT_DIED) {
+		LogDebug(COMPONENT_DISPATCH,
+			 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request. rpcxid=%"
+			 PRIu32
+			 " socket=%d function:%s client:%s program:%"
+			 PRIu32
+			 " nfs version:%" PRIu32
+			 " proc:%" PRIu32
+			 " errno: %d",
+			 reqdata->r_u.req.svc.rq_msg.rm_xid,
+			 xprt->xp_fd,
+			 reqdesc->funcname,
+			 client_ip,
+			 reqdata->r_u.req.svc.rq_msg.cb_prog,
+			 reqdata->r_u.req.svc.rq_msg.cb_vers,
+			 reqdata->r_u.req.svc.rq_msg.cb_proc,
+			 errno);
+		SVC_DESTROY(xprt);
+		/* We failed to send the response, but the
+		 * request is complete, so we should mark
+		 * the same in our DRC.
+		 */
+	}
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "After svc_sendreply on socket %d", xprt->xp_fd);
+
+	/* Finish the request in the duplicate request cache */
+	(void) nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
+}
+
+/**
+ * @brief Free the arguments of a request and release its context
+ *
+ * @param[in,out] reqdata	NFS request
+ */
+static void free_args(request_data_t *reqdata)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
+
+	/* Free the allocated resources once the work is done */
+	/* Free the arguments */
+	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
+	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 3)
+	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 4)) {
+		if (!xdr_free(reqdesc->xdr_decode_func, arg_nfs)) {
+			LogCrit(COMPONENT_DISPATCH,
+				"%s FAILURE: Bad xdr_free for %s",
+				__func__,
+				reqdesc->funcname);
+		}
+	}
+
+	/* Finalize the request. */
+	if (reqdata->r_u.req.res_nfs)
+		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
+
+	SetClientIP(NULL);
+	if (op_ctx->client != NULL) {
+		put_gsh_client(op_ctx->client);
+		op_ctx->client = NULL;
+	}
+	if (op_ctx->ctx_export != NULL) {
+		put_gsh_export(op_ctx->ctx_export);
+		op_ctx->ctx_export = NULL;
+	}
+	clean_credentials();
+	op_ctx = NULL;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, end, reqdata);
+#endif
+}
+
+/** Threads that finish requests resumed after an asynchronous FSAL call */
+static struct fridgethr *resume_fridge;
+
+/**
+ * @brief Start the threads that run resumed requests
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+int nfs_resume_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.core_param.rpc.resume_thrd_max;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&resume_fridge, "Resume", &frp);
+	if (rc != 0)
+		LogMajor(COMPONENT_THREAD,
+			 "Unable to initialize resume fridge, error code %d.",
+			 rc);
+
+	return rc;
+}
+
+/**
+ * @brief Stop the threads that run resumed requests
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+int nfs_resume_shutdown(void)
+{
+	int rc = fridgethr_sync_command(resume_fridge,
+					fridgethr_comm_stop,
+					120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_THREAD,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(resume_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Failed shutting down resume fridge: %d", rc);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Continue a suspended request
+ *
+ * Runs the request's continuation with its own op_ctx and, once it is
+ * done, replies and releases the request.  Drops the reference taken by
+ * nfs_req_suspend().
+ *
+ * @param[in] ctx	Thread context, arg is the request
+ */
+static void nfs_rpc_resume_request(struct fridgethr_context *ctx)
+{
+	request_data_t *reqdata = ctx->arg;
+	struct fr_record *fr_prev;
+	int rc;
+
+	fr_prev = fr_request_resume(reqdata->r_u.req.fr);
+	reqdata->r_u.req.fr = NULL;
+
+	op_ctx = &reqdata->r_u.req.req_ctx;
+	if (op_ctx->client != NULL)
+		SetClientIP(op_ctx->client->hostaddr_str);
+
+	/* The thread that issued the I/O may still be unwinding through
+	 * stackable FSALs, which swap op_ctx->fsal_export as they go.  Put
+	 * back the export's own FSAL export, which is what they restore.
+	 */
+	if (op_ctx->ctx_export != NULL)
+		op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
+
+	rc = reqdata->r_u.req.resume_fn(reqdata);
+
+	if (rc == NFS_REQ_ASYNC_WAIT) {
+		/* Suspended again */
+		SetClientIP(NULL);
+		op_ctx = NULL;
+	} else {
+		complete_request(reqdata, rc);
+		free_args(reqdata);
+		fr_request_end();
+		/* req_ctx goes away with the request */
+		SetClientIP(NULL);
+		op_ctx = NULL;
+	}
+
+	fr_request_restore(fr_prev);
+	free_nfs_request(reqdata);
+}
+
+/**
+ * @brief Suspend a request on an asynchronous FSAL call
+ *
+ * Called by the thread that issued the FSAL call, once the call has
+ * returned, with the flags the FSAL callback hands to
+ * nfs_req_async_done().  The request's resume_fn and proc_data must be set
+ * up before.  If the callback has not run yet, the request is suspended:
+ * the caller must return NFS_REQ_ASYNC_WAIT and not touch the request
+ * again, it is resumed from nfs_req_async_done().  Otherwise the caller
+ * continues as if the call had been synchronous.
+ *
+ * @param[in]     reqdata	Request issuing the call
+ * @param[in,out] flags		NFS_ASYNC_* flags of the call
+ *
+ * @return true if the request is suspended.
+ */
+bool nfs_req_suspend(request_data_t *reqdata, uint32_t *flags)
+{
+	/* Keep the request, its transport and its arguments around until
+	 * the request is resumed.
+	 */
+	(void) atomic_inc_uint32_t(&reqdata->r_u.req.svc.rq_refcnt);
+
+	/* Whoever resumes the request carries on with its timeline */
+	reqdata->r_u.req.fr = fr_request_suspend();
+
+	if (!(atomic_postset_uint32_t_bits(flags, NFS_ASYNC_EXIT) &
+	      NFS_ASYNC_DONE))
+		return true;
+
+	/* The callback beat us to it, carry on synchronously. */
+	fr_request_reattach(reqdata->r_u.req.fr);
+	reqdata->r_u.req.fr = NULL;
+	(void) atomic_dec_uint32_t(&reqdata->r_u.req.svc.rq_refcnt);
+	return false;
+}
+
+/**
+ * @brief Note that the FSAL call a request may be suspended on is done
+ *
+ * Called from the FSAL callback, on whatever thread that runs on, once
+ * the callback has saved the result of the call.  If the issuing thread
+ * has already suspended the request, the request is queued to be resumed.
+ *
+ * @param[in]     reqdata	Request that issued the call
+ * @param[in,out] flags		NFS_ASYNC_* flags of the call
+ */
+void nfs_req_async_done(request_data_t *reqdata, uint32_t *flags)
+{
+	struct fridgethr_context ctx;
+	struct req_op_context *saved_ctx;
+	int rc;
+
+	if (!(atomic_postset_uint32_t_bits(flags, NFS_ASYNC_DONE) &
+	      NFS_ASYNC_EXIT))
+		return;
+
+	fr_request_queued(reqdata->r_u.req.fr);
+
+	rc = fridgethr_submit(resume_fridge, nfs_rpc_resume_request, reqdata);
+	if (rc == 0)
+		return;
+
+	LogMajor(COMPONENT_DISPATCH,
+		 "Unable to queue resumed request, error %d, finishing it here",
+		 rc);
+
+	/* Better hold up the FSAL than lose the request.  This thread may be
+	 * in the middle of another request (the callback can run from the
+	 * FSAL call that completes it), so put its op_ctx back afterwards.
+	 */
+	saved_ctx = op_ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.arg = reqdata;
+	nfs_rpc_resume_request(&ctx);
+
+	op_ctx = saved_ctx;
+	if (op_ctx != NULL && op_ctx->client != NULL)
+		SetClientIP(op_ctx->client->hostaddr_str);
+	else
+		SetClientIP(NULL);
+}
+
 /**
  * @brief Main RPC dispatcher routine
  *
@@ -675,9 +992,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
 	XDR *xdrs = reqdata->r_u.req.svc.rq_xdrs;
 	nfs_res_t *res_nfs;
-	struct export_perms export_perms;
-	struct user_cred user_credentials;
-	struct req_op_context req_ctx;
+	struct export_perms *export_perms = &reqdata->r_u.req.export_perms;
 	dupreq_status_t dpq_status;
 	struct timespec timer_start;
 	enum auth_stat auth_rc;
@@ -782,17 +1097,20 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 		}
 		return svcerr_decode(&reqdata->r_u.req.svc);
 	}
+	fr_mark(FR_DECODE, NULL);
 
 	/* set up the request context
 	 */
-	memset(&export_perms, 0, sizeof(export_perms));
-	memset(&req_ctx, 0, sizeof(req_ctx));
-	op_ctx = &req_ctx;
-	op_ctx->creds = &user_credentials;
+	memset(export_perms, 0, sizeof(*export_perms));
+	memset(&reqdata->r_u.req.req_ctx, 0, sizeof(reqdata->r_u.req.req_ctx));
+	op_ctx = &reqdata->r_u.req.req_ctx;
+	op_ctx->creds = &reqdata->r_u.req.user_credentials;
 	op_ctx->caller_addr = (sockaddr_t *)svc_getrpccaller(xprt);
 	op_ctx->nfs_vers = reqdata->r_u.req.svc.rq_msg.cb_vers;
 	op_ctx->req_type = reqdata->rtype;
-	op_ctx->export_perms = &export_perms;
+	op_ctx->export_perms = export_perms;
+	reqdata->r_u.req.resume_fn = NULL;
+	reqdata->r_u.req.proc_data = NULL;
 
 	/* Set up initial export permissions that don't allow anything. */
 	export_check_access();
@@ -841,6 +1159,8 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 			 reqdata->r_u.req.svc.rq_msg.cb_proc,
 			 reqdata->r_u.req.svc.rq_msg.rm_xid);
 	}
+	fr_request_info(reqdata->r_u.req.svc.rq_msg.rm_xid, reqdesc->funcname,
+			client_ip);
 
 #if defined(HAVE_BLKIN)
 	BLKIN_TIMESTAMP(
@@ -852,6 +1172,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 	 * nothing but allocate a result object and mark the request (ie, the
 	 * path is short, lockless, and does no hash/search). */
 	dpq_status = nfs_dupreq_start(&reqdata->r_u.req, &reqdata->r_u.req.svc);
+	fr_mark(FR_DRC, NULL);
 	res_nfs = reqdata->r_u.req.res_nfs;
 	if (dpq_status == DUPREQ_SUCCESS) {
 		/* A new request, continue processing it. */
@@ -1101,7 +1422,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 
 		export_check_access();
 
-		if ((export_perms.options & EXPORT_OPTION_ACCESS_MASK) == 0) {
+		if ((export_perms->options & EXPORT_OPTION_ACCESS_MASK) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Client %s is not allowed to access Export_Id %d %s, vers=%"
 				PRIu32 ", proc=%" PRIu32,
@@ -1115,7 +1436,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 			goto auth_failure;
 		}
 
-		if ((EXPORT_OPTION_NFSV3 & export_perms.options) == 0) {
+		if ((EXPORT_OPTION_NFSV3 & export_perms->options) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" not allowed on Export_Id %d %s for client %s",
@@ -1131,9 +1452,9 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 
 		/* Check transport type */
 		if (((xprt_type == XPRT_UDP)
-		     && ((export_perms.options & EXPORT_OPTION_UDP) == 0))
+		     && ((export_perms->options & EXPORT_OPTION_UDP) == 0))
 		    || ((xprt_type == XPRT_TCP)
-			&& ((export_perms.options & EXPORT_OPTION_TCP) == 0))) {
+			&& ((export_perms->options & EXPORT_OPTION_TCP) == 0))) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" over %s not allowed on Export_Id %d %s for client %s",
@@ -1167,7 +1488,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 		/* Check if client is using a privileged port,
 		 * but only for NFS protocol */
 		if ((reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
-		 && (export_perms.options & EXPORT_OPTION_PRIVILEGED_PORT)
+		 && (export_perms->options & EXPORT_OPTION_PRIVILEGED_PORT)
 		 && (port >= IPPORT_RESERVED)) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Non-reserved Port %d is not allowed on Export_Id %d %s for client %s",
@@ -1186,7 +1507,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 	 */
 	if (op_ctx->ctx_export != NULL
 	    && (reqdesc->dispatch_behaviour & MAKES_IO)
-	    && !(export_perms.options & EXPORT_OPTION_RW_ACCESS)) {
+	    && !(export_perms->options & EXPORT_OPTION_RW_ACCESS)) {
 		/* Request of type MDONLY_RO were rejected at the
 		 * nfs_rpc_dispatcher level.
 		 * This is done by replying EDQUOT
@@ -1218,7 +1539,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 		}
 	} else if (op_ctx->ctx_export != NULL
 		   && (reqdesc->dispatch_behaviour & MAKES_WRITE)
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_WRITE_ACCESS
 			| EXPORT_OPTION_MD_WRITE_ACCESS)) == 0) {
 		if (reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
@@ -1245,7 +1566,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 			rc = NFS_REQ_DROP;
 		}
 	} else if (op_ctx->ctx_export != NULL
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_READ_ACCESS
 			 | EXPORT_OPTION_MD_READ_ACCESS)) == 0) {
 		LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -1262,7 +1583,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 		if (reqdesc->dispatch_behaviour & NEEDS_CRED) {
 			/* If we don't have an export, don't squash */
 			if (op_ctx->fsal_export == NULL) {
-				export_perms.options &=
+				export_perms->options &=
 					~EXPORT_OPTION_SQUASH_TYPES;
 			} else if (nfs_req_creds(&reqdata->r_u.req.svc) !=
 					NFS4_OK) {
@@ -1274,6 +1595,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 				goto auth_failure;
 			}
 		}
+		fr_mark(FR_CREDS, NULL);
 
 		/* processing
 		 * At this point, op_ctx->ctx_export has one of the following
@@ -1328,8 +1650,10 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 			(op_ctx->ctx_export != NULL)
 			? op_ctx->ctx_export->export_id : -1);
 #endif
+		fr_mark(FR_OP, reqdesc->funcname);
 		rc = reqdesc->service_function(arg_nfs, &reqdata->r_u.req.svc,
 					res_nfs);
+		fr_mark(FR_OP_DONE, reqdesc->funcname);
 
 #ifdef USE_LTTNG
 	tracepoint(nfs_rpc, op_end, reqdata);
@@ -1347,76 +1671,16 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
  req_error:
 #endif /* _USE_NFS3 */
 
-/* NFSv4 stats are handled in nfs4_compound()
- */
-	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
-	    || reqdata->r_u.req.svc.rq_msg.cb_vers != NFS_V4)
-		server_stats_nfs_done(reqdata, rc, false);
-
-	/* If request is dropped, no return to the client */
-	if (rc == NFS_REQ_DROP) {
-		/* The request was dropped */
-		LogDebug(COMPONENT_DISPATCH,
-			 "Drop request rpc_xid=%" PRIu32
-			 ", program %" PRIu32
-			 ", version %" PRIu32
-			 ", function %" PRIu32,
-			 reqdata->r_u.req.svc.rq_msg.rm_xid,
-			 reqdata->r_u.req.svc.rq_msg.cb_prog,
-			 reqdata->r_u.req.svc.rq_msg.cb_vers,
-			 reqdata->r_u.req.svc.rq_msg.cb_proc);
-
-		/* If the request is not normally cached, then the entry
-		 * will be removed later.  We only remove a reply that is
-		 * normally cached that has been dropped.
+	if (rc == NFS_REQ_ASYNC_WAIT) {
+		/* The request was suspended by nfs_req_suspend(), whoever
+		 * resumes it completes it.  Don't touch it any more.
 		 */
-		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
-		    != DUPREQ_SUCCESS) {
-			LogCrit(COMPONENT_DISPATCH,
-				"Attempt to delete duplicate request failed on line %d",
-				__LINE__);
-		}
-		goto freeargs;
-	} else {
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "Before svc_sendreply on socket %d", xprt->xp_fd);
-
-		reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_results.where = res_nfs;
-		reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_results.proc =
-					reqdesc->xdr_encode_func;
-		xprt_rc = svc_sendreply(&reqdata->r_u.req.svc);
-		if (xprt_rc >= XPRT_DIED) {
-			LogDebug(COMPONENT_DISPATCH,
-				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request. rpcxid=%"
-				 PRIu32
-				 " socket=%d function:%s client:%s program:%"
-				 PRIu32
-				 " nfs version:%" PRIu32
-				 " proc:%" PRIu32
-				 " errno: %d",
-				 reqdata->r_u.req.svc.rq_msg.rm_xid,
-				 xprt->xp_fd,
-				 reqdesc->funcname,
-				 client_ip,
-				 reqdata->r_u.req.svc.rq_msg.cb_prog,
-				 reqdata->r_u.req.svc.rq_msg.cb_vers,
-				 reqdata->r_u.req.svc.rq_msg.cb_proc,
-				 errno);
-			SVC_DESTROY(xprt);
-			/* We failed to send the response, but the
-			 * request is complete, so we should mark
-			 * the same in our DRC.
-			 */
-		}
-
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "After svc_sendreply on socket %d", xprt->xp_fd);
-
-	}			/* rc == NFS_REQ_DROP */
+		SetClientIP(NULL);
+		op_ctx = NULL;
+		return SVC_STAT(xprt);
+	}
 
-	/* Finish any request not already deleted */
-	if (dpq_status == DUPREQ_SUCCESS)
-		dpq_status = nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
+	complete_request(reqdata, rc);
 	goto freeargs;
 
  auth_failure:
@@ -1429,38 +1693,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 	}
 
  freeargs:
-	/* Free the allocated resources once the work is done */
-	/* Free the arguments */
-	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
-	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 3)
-	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 4)) {
-		if (!xdr_free(reqdesc->xdr_decode_func, arg_nfs)) {
-			LogCrit(COMPONENT_DISPATCH,
-				"%s FAILURE: Bad xdr_free for %s",
-				__func__,
-				reqdesc->funcname);
-		}
-	}
-
-	/* Finalize the request. */
-	if (res_nfs)
-		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
-
-	SetClientIP(NULL);
-	if (op_ctx->client != NULL) {
-		put_gsh_client(op_ctx->client);
-		op_ctx->client = NULL;
-	}
-	if (op_ctx->ctx_export != NULL) {
-		put_gsh_export(op_ctx->ctx_export);
-		op_ctx->ctx_export = NULL;
-	}
-	clean_credentials();
-	op_ctx = NULL;
-
-#ifdef USE_LTTNG
-	tracepoint(nfs_rpc, end, reqdata);
-#endif
+	free_args(reqdata);
 	return SVC_STAT(xprt);
 }
 
@@ -47,6 +47,9 @@
 struct _9p_read_data {
 	struct gsh_client *client;	/**< Client for stats */
 	fsal_status_t ret;		/**< Return from read */
+	bool done;			/**< The read is done */
+	pthread_mutex_t mtx;		/**< Protects done */
+	pthread_cond_t cond;		/**< Signals done */
 };
 
 /**
@@ -76,6 +79,11 @@ static void _9p_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 				     read_arg->io_amount, FSAL_IS_ERROR(ret),
 				     false);
 	}
+
+	PTHREAD_MUTEX_lock(&data->mtx);
+	data->done = true;
+	pthread_cond_signal(&data->cond);
+	PTHREAD_MUTEX_unlock(&data->mtx);
 }
 
 int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
@@ -150,6 +158,7 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 		read_arg->info = NULL;
 		read_arg->state = pfid->state;
+		read_arg->attrs_out = NULL;
 		read_arg->offset = *offset;
 		read_arg->iov_count = 1;
 		read_arg->iov[0].iov_len = *count;
@@ -158,11 +167,23 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		read_arg->end_of_file = false;
 
 		read_data.client = req9p->pconn->client;
+		read_data.done = false;
+		PTHREAD_MUTEX_init(&read_data.mtx, NULL);
+		PTHREAD_COND_init(&read_data.cond, NULL);
 
 		/* Do the actual read */
 		pfid->pentry->obj_ops->read2(pfid->pentry, true, _9p_read_cb,
 					    read_arg, &read_data);
 
+		/* The FSAL may complete the read on another thread */
+		PTHREAD_MUTEX_lock(&read_data.mtx);
+		while (!read_data.done)
+			pthread_cond_wait(&read_data.cond, &read_data.mtx);
+		PTHREAD_MUTEX_unlock(&read_data.mtx);
+
+		PTHREAD_COND_destroy(&read_data.cond);
+		PTHREAD_MUTEX_destroy(&read_data.mtx);
+
 		if (FSAL_IS_ERROR(read_data.ret))
 			return _9p_rerror(req9p, msgtag,
 					  _9p_tools_errno(read_data.ret),
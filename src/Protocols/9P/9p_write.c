@@ -48,6 +48,9 @@
 struct _9p_write_data {
 	struct gsh_client *client;	/**< Client for stats */
 	fsal_status_t ret;		/**< Return from write */
+	bool done;			/**< The write is done */
+	pthread_mutex_t mtx;		/**< Protects done */
+	pthread_cond_t cond;		/**< Signals done */
 };
 
 /**
@@ -77,6 +80,11 @@ static void _9p_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 				     write_arg->io_amount, FSAL_IS_ERROR(ret),
 				     false);
 	}
+
+	PTHREAD_MUTEX_lock(&data->mtx);
+	data->done = true;
+	pthread_cond_signal(&data->cond);
+	PTHREAD_MUTEX_unlock(&data->mtx);
 }
 
 int _9p_write(struct _9p_request_data *req9p, u32 *plenout, char *preply)
@@ -171,6 +179,7 @@ int _9p_write(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 		write_arg->info = NULL;
 		write_arg->state = pfid->state;
+		write_arg->attrs_out = NULL;
 		write_arg->offset = *offset;
 		write_arg->iov_count = 1;
 		write_arg->iov[0].iov_len = size;
@@ -179,11 +188,23 @@ int _9p_write(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		write_arg->fsal_stable = false;
 
 		write_data.client = req9p->pconn->client;
+		write_data.done = false;
+		PTHREAD_MUTEX_init(&write_data.mtx, NULL);
+		PTHREAD_COND_init(&write_data.cond, NULL);
 
 		/* Do the actual write */
 		pfid->pentry->obj_ops->write2(pfid->pentry, true, _9p_write_cb,
 					    write_arg, &write_data);
 
+		/* The FSAL may complete the write on another thread */
+		PTHREAD_MUTEX_lock(&write_data.mtx);
+		while (!write_data.done)
+			pthread_cond_wait(&write_data.cond, &write_data.mtx);
+		PTHREAD_MUTEX_unlock(&write_data.mtx);
+
+		PTHREAD_COND_destroy(&write_data.cond);
+		PTHREAD_MUTEX_destroy(&write_data.mtx);
+
 		if (FSAL_IS_ERROR(write_data.ret))
 			return _9p_rerror(req9p, msgtag,
 					  _9p_tools_errno(write_data.ret),
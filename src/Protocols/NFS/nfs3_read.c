@@ -69,11 +69,20 @@ static void nfs_read_ok(nfs_res_t *res, char *data, uint32_t read_size,
 struct nfs3_read_data {
 	nfs_res_t *res;		/**< Results for read */
 	int rc;			/**< Return code */
+	struct fsal_obj_handle *obj;	/**< Object being read */
+	fsal_status_t ret;	/**< Status of the read */
+	request_data_t *reqdata;	/**< Request to resume */
+	uint32_t flags;		/**< NFS_ASYNC_* flags */
+	struct fsal_io_arg *read_arg;	/**< Read arguments, allocated with
+					     this structure */
 };
 
 /**
  * @brief Callback for NFS3 read done
  *
+ * Saves the result and lets the thread that issued the read, or the
+ * request once resumed, finish the request.
+ *
  * @param[in] obj		Object being acted on
  * @param[in] ret		Return status of call
  * @param[in] read_data		Data for read call
@@ -83,8 +92,27 @@ static void nfs3_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 			  void *read_data, void *caller_data)
 {
 	struct nfs3_read_data *data = caller_data;
-	struct fsal_io_arg *read_arg = read_data;
+
+	data->ret = ret;
+	nfs_req_async_done(data->reqdata, &data->flags);
+}
+
+/**
+ * @brief Build the READ result once the FSAL read is done
+ *
+ * Releases the object reference and frees @a data.
+ *
+ * @param[in] data	Read data
+ *
+ * @return NFS_REQ_OK or NFS_REQ_DROP.
+ */
+static int nfs3_complete_read(struct nfs3_read_data *data)
+{
+	struct fsal_io_arg *read_arg = data->read_arg;
+	struct fsal_obj_handle *obj = data->obj;
+	fsal_status_t ret = data->ret;
 	READ3resfail *resfail = &data->res->res_read3.READ3res_u.resfail;
+	int rc;
 	int i;
 
 	/* Fixup FSAL_SHARE_DENIED status */
@@ -147,6 +175,23 @@ static void nfs3_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 
 	server_stats_io_done(read_arg->iov[0].iov_len, read_arg->io_amount,
 			     (data->rc == NFS_REQ_OK) ?  true : false, false);
+
+	rc = data->rc;
+	gsh_free(data);
+
+	return rc;
+}
+
+/**
+ * @brief Finish a READ that was suspended
+ *
+ * @param[in] reqdata	The request
+ *
+ * @return NFS_REQ_OK or NFS_REQ_DROP.
+ */
+static int nfs3_read_resume(request_data_t *reqdata)
+{
+	return nfs3_complete_read(reqdata->r_u.req.proc_data);
 }
 
 /**
@@ -176,11 +221,16 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	uint64_t MaxOffsetRead =
 		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetRead);
 	READ3resfail *resfail = &res->res_read3.READ3res_u.resfail;
-	struct nfs3_read_data read_data;
-	struct fsal_io_arg *read_arg = alloca(sizeof(*read_arg) +
-						sizeof(struct iovec));
+	struct nfs3_read_data *read_data;
+	struct fsal_io_arg *read_arg;
+	int rc = NFS_REQ_OK;
 
-	read_data.rc = NFS_REQ_OK;
+	/* The read may complete on another thread after we return, so
+	 * everything it uses lives on the heap.
+	 */
+	read_data = gsh_calloc(1, sizeof(*read_data) + sizeof(*read_arg) +
+				  sizeof(struct iovec));
+	read_arg = (struct fsal_io_arg *)(read_data + 1);
 
 	if (isDebug(COMPONENT_NFSPROTO)) {
 		char str[LEN_FH_STR];
@@ -206,7 +256,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	res->res_read3.READ3res_u.resok.data.data_len = 0;
 	res->res_read3.status = NFS3_OK;
 	obj = nfs3_FhandleToCache(&arg->arg_read3.file,
-				    &res->res_read3.status, &read_data.rc);
+				    &res->res_read3.status, &rc);
 
 	if (obj == NULL) {
 		/* Status and rc have been set by nfs3_FhandleToCache */
@@ -229,7 +279,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	if (FSAL_IS_ERROR(fsal_status)) {
 		res->res_read3.status = nfs3_Errno_status(fsal_status);
-		read_data.rc = NFS_REQ_OK;
+		rc = NFS_REQ_OK;
 		goto putref;
 	}
 
@@ -240,7 +290,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		else
 			res->res_read3.status = NFS3ERR_INVAL;
 
-		read_data.rc = NFS_REQ_OK;
+		rc = NFS_REQ_OK;
 		goto putref;
 	}
 
@@ -266,7 +316,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 			nfs_SetPostOpAttr(obj, &resfail->file_attributes, NULL);
 
-			read_data.rc = NFS_REQ_OK;
+			rc = NFS_REQ_OK;
 			goto putref;
 		}
 	}
@@ -282,7 +332,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	if (size == 0) {
 		nfs_read_ok(res, NULL, 0, obj, 0);
-		read_data.rc = NFS_REQ_OK;
+		rc = NFS_REQ_OK;
 		goto putref;
 	}
 
@@ -291,7 +341,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	/* Check for delegation conflict. */
 	if (state_deleg_conflict(obj, false)) {
 		res->res_read3.status = NFS3ERR_JUKEBOX;
-		read_data.rc = NFS_REQ_OK;
+		rc = NFS_REQ_OK;
 		gsh_free(data);
 		goto putref;
 	}
@@ -299,17 +349,28 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	read_arg->info = NULL;
 	/** @todo for now pass NULL state */
 	read_arg->state = NULL;
+	read_arg->attrs_out = NULL;
 	read_arg->iov_count = 1;
 	read_arg->iov[0].iov_len = size;
 	read_arg->iov[0].iov_base = data;
 	read_arg->io_amount = 0;
 	read_arg->end_of_file = false;
 
-	read_data.res = res;
+	read_data->res = res;
+	read_data->rc = NFS_REQ_OK;
+	read_data->obj = obj;
+	read_data->reqdata = nfs_req_from_svc(req);
+	read_data->read_arg = read_arg;
+	read_data->reqdata->r_u.req.resume_fn = nfs3_read_resume;
+	read_data->reqdata->r_u.req.proc_data = read_data;
 
 	/* Do the actual read */
-	obj->obj_ops->read2(obj, true, nfs3_read_cb, read_arg, &read_data);
-	return read_data.rc;
+	obj->obj_ops->read2(obj, true, nfs3_read_cb, read_arg, read_data);
+
+	if (nfs_req_suspend(read_data->reqdata, &read_data->flags))
+		return NFS_REQ_ASYNC_WAIT;
+
+	return nfs3_complete_read(read_data);
 
 putref:
 	/* return references */
@@ -317,9 +378,10 @@ putref:
 		obj->obj_ops->put_ref(obj);
 
 	server_stats_io_done(size, 0,
-			     (read_data.rc == NFS_REQ_OK) ? true : false,
+			     (rc == NFS_REQ_OK) ? true : false,
 			     false);
-	return read_data.rc;
+	gsh_free(read_data);
+	return rc;
 }				/* nfs3_read */
 
 /**
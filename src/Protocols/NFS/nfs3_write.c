@@ -50,11 +50,21 @@
 struct nfs3_write_data {
 	nfs_res_t *res;		/**< Results for write */
 	int rc;			/**< Return code */
+	struct attrlist attrs;	/**< Attributes after the write */
+	struct fsal_obj_handle *obj;	/**< Object being written */
+	fsal_status_t ret;	/**< Status of the write */
+	request_data_t *reqdata;	/**< Request to resume */
+	uint32_t flags;		/**< NFS_ASYNC_* flags */
+	struct fsal_io_arg *write_arg;	/**< Write arguments, allocated with
+					     this structure */
 };
 
 /**
  * @brief Callback for NFS3 write done
  *
+ * Saves the result and lets the thread that issued the write, or the
+ * request once resumed, finish the request.
+ *
  * @param[in] obj		Object being acted on
  * @param[in] ret		Return status of call
  * @param[in] write_data	Data for write call
@@ -64,7 +74,26 @@ static void nfs3_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 			  void *write_data, void *caller_data)
 {
 	struct nfs3_write_data *data = caller_data;
-	struct fsal_io_arg *write_arg = write_data;
+
+	data->ret = ret;
+	nfs_req_async_done(data->reqdata, &data->flags);
+}
+
+/**
+ * @brief Build the WRITE result once the FSAL write is done
+ *
+ * Releases the object reference and frees @a data.
+ *
+ * @param[in] data	Write data
+ *
+ * @return NFS_REQ_OK or NFS_REQ_DROP.
+ */
+static int nfs3_complete_write(struct nfs3_write_data *data)
+{
+	struct fsal_io_arg *write_arg = data->write_arg;
+	struct fsal_obj_handle *obj = data->obj;
+	fsal_status_t ret = data->ret;
+	int rc;
 	WRITE3resfail *resfail = &data->res->res_write3.WRITE3res_u.resfail;
 	WRITE3resok *resok = &data->res->res_write3.WRITE3res_u.resok;
 
@@ -89,8 +118,17 @@ static void nfs3_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 
 		data->rc = NFS_REQ_OK;
 	} else {
-		/* Build Weak Cache Coherency data */
-		nfs_SetWccData(NULL, obj, &resok->file_wcc);
+		/* Build Weak Cache Coherency data, using the attributes the
+		 * write returned if there are any.
+		 */
+		if (data->attrs.valid_mask != 0 &&
+		    !(data->attrs.valid_mask & ATTR_RDATTR_ERR)) {
+			resok->file_wcc.before.attributes_follow = false;
+			nfs_SetPostOpAttr(obj, &resok->file_wcc.after,
+					  &data->attrs);
+		} else {
+			nfs_SetWccData(NULL, obj, &resok->file_wcc);
+		}
 
 		/* Set the written size */
 		resok->count = write_arg->io_amount;
@@ -110,12 +148,31 @@ static void nfs3_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 	data->rc = NFS_REQ_OK;
 
 out:
+	fsal_release_attrs(&data->attrs);
+
 	/* return references */
 	obj->obj_ops->put_ref(obj);
 
 	server_stats_io_done(write_arg->iov[0].iov_len, write_arg->io_amount,
 			     (data->rc == NFS_REQ_OK) ? true : false,
 			     true);
+
+	rc = data->rc;
+	gsh_free(data);
+
+	return rc;
+}
+
+/**
+ * @brief Finish a WRITE that was suspended
+ *
+ * @param[in] reqdata	The request
+ *
+ * @return NFS_REQ_OK or NFS_REQ_DROP.
+ */
+static int nfs3_write_resume(request_data_t *reqdata)
+{
+	return nfs3_complete_write(reqdata->r_u.req.proc_data);
 }
 
 /**
@@ -137,9 +194,6 @@ out:
 int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 {
 	struct fsal_obj_handle *obj;
-	pre_op_attr pre_attr = {
-		.attributes_follow = false
-	};
 	fsal_status_t fsal_status = {0, 0};
 	size_t size = 0;
 	uint64_t MaxWrite =
@@ -147,13 +201,19 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	uint64_t MaxOffsetWrite =
 		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
 	bool force_sync = op_ctx->export_perms->options & EXPORT_OPTION_COMMIT;
-	struct nfs3_write_data write_data;
+	struct nfs3_write_data *write_data;
 	WRITE3resfail *resfail = &res->res_write3.WRITE3res_u.resfail;
 	WRITE3resok *resok = &res->res_write3.WRITE3res_u.resok;
-	struct fsal_io_arg *write_arg = alloca(sizeof(*write_arg) +
-					       sizeof(struct iovec));
+	struct fsal_io_arg *write_arg;
+	int rc = NFS_REQ_OK;
 
-	write_data.rc = NFS_REQ_OK;
+	/* The write may complete on another thread after we return, so
+	 * everything it uses lives on the heap.  The data to write is in
+	 * the request arguments, which live as long as the request.
+	 */
+	write_data = gsh_calloc(1, sizeof(*write_data) + sizeof(*write_arg) +
+				   sizeof(struct iovec));
+	write_arg = (struct fsal_io_arg *)(write_data + 1);
 
 	write_arg->offset = arg->arg_write3.offset;
 	size = arg->arg_write3.count;
@@ -195,21 +255,20 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	obj = nfs3_FhandleToCache(&arg->arg_write3.file,
 				    &res->res_write3.status,
-				    &write_data.rc);
+				    &rc);
 
 	if (obj == NULL) {
 		/* Status and rc have been set by nfs3_FhandleToCache */
-		return write_data.rc;
+		gsh_free(write_data);
+		return rc;
 	}
 
-	nfs_SetPreOpAttr(obj, &pre_attr);
-
 	fsal_status =
 	    obj->obj_ops->test_access(obj, FSAL_WRITE_ACCESS, NULL, NULL, true);
 
 	if (FSAL_IS_ERROR(fsal_status)) {
 		res->res_write3.status = nfs3_Errno_status(fsal_status);
-		write_data.rc = NFS_REQ_OK;
+		rc = NFS_REQ_OK;
 		goto putref;
 	}
 
@@ -220,7 +279,7 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		else
 			res->res_write3.status = NFS3ERR_INVAL;
 
-		write_data.rc = NFS_REQ_OK;
+		rc = NFS_REQ_OK;
 		goto putref;
 	}
 
@@ -233,14 +292,14 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	if (FSAL_IS_ERROR(fsal_status)) {
 		res->res_write3.status = NFS3ERR_DQUOT;
-		write_data.rc = NFS_REQ_OK;
+		rc = NFS_REQ_OK;
 		goto putref;
 	}
 
 	if (size > arg->arg_write3.data.data_len) {
 		/* should never happen */
 		res->res_write3.status = NFS3ERR_INVAL;
-		write_data.rc = NFS_REQ_OK;
+		rc = NFS_REQ_OK;
 		goto putref;
 	}
 
@@ -262,7 +321,7 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 			nfs_SetWccData(NULL, obj, &resfail->file_wcc);
 
-			write_data.rc = NFS_REQ_OK;
+			rc = NFS_REQ_OK;
 			goto putref;
 		}
 	}
@@ -277,7 +336,7 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		fsal_status = fsalstat(ERR_FSAL_NO_ERROR, 0);
 		res->res_write3.status = NFS3_OK;
 		nfs_SetWccData(NULL, obj, &resfail->file_wcc);
-		write_data.rc = NFS_REQ_OK;
+		rc = NFS_REQ_OK;
 		if (write_arg->fsal_stable)
 			resok->committed = FILE_SYNC;
 		else
@@ -291,31 +350,44 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	/* Check for delegation conflict. */
 	if (state_deleg_conflict(obj, true)) {
 		res->res_write3.status = NFS3ERR_JUKEBOX;
-		write_data.rc = NFS_REQ_OK;
+		rc = NFS_REQ_OK;
 		goto putref;
 	}
 
 	write_arg->info = NULL;
 	/** @todo for now pass NULL state */
 	write_arg->state = NULL;
+	write_arg->attrs_out = &write_data->attrs;
 	write_arg->iov_count = 1;
 	write_arg->iov[0].iov_len = size;
 	write_arg->iov[0].iov_base = arg->arg_write3.data.data_val;
 	write_arg->io_amount = 0;
 
-	write_data.res = res;
+	write_data->res = res;
+	write_data->rc = NFS_REQ_OK;
+	write_data->obj = obj;
+	write_data->reqdata = nfs_req_from_svc(req);
+	write_data->write_arg = write_arg;
+	write_data->reqdata->r_u.req.resume_fn = nfs3_write_resume;
+	write_data->reqdata->r_u.req.proc_data = write_data;
+	fsal_prepare_attrs(&write_data->attrs, ATTRS_NFS3);
+
+	obj->obj_ops->write2(obj, true, nfs3_write_cb, write_arg, write_data);
+
+	if (nfs_req_suspend(write_data->reqdata, &write_data->flags))
+		return NFS_REQ_ASYNC_WAIT;
 
-	obj->obj_ops->write2(obj, true, nfs3_write_cb, write_arg, &write_data);
-	return write_data.rc;
+	return nfs3_complete_write(write_data);
 
  putref:
 	/* return references */
 	obj->obj_ops->put_ref(obj);
 
 	server_stats_io_done(size, 0,
-			     (write_data.rc == NFS_REQ_OK) ? true : false,
+			     (rc == NFS_REQ_OK) ? true : false,
 			     true);
-	return write_data.rc;
+	gsh_free(write_data);
+	return rc;
 
 }				/* nfs3_write */
 
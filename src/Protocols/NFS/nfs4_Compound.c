@@ -42,6 +42,13 @@
 #include "server_stats.h"
 #include "export_mgr.h"
 #include "nfs_creds.h"
+#include "flight_recorder.h"
+#include "nfs_dupreq.h"
+#include "fridgethr.h"
+#include "abstract_atomic.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -381,10 +388,10 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0},
 	[NFS4_OP_GET_DIR_DELEGATION] = {
 		.name = "OP_GET_DIR_DELEGATION",
-		.funct = nfs4_op_illegal,
-		.free_res = nfs4_op_illegal_Free,
+		.funct = nfs4_op_get_dir_delegation,
+		.free_res = nfs4_op_get_dir_delegation_Free,
 		.resp_size = sizeof(GET_DIR_DELEGATION4res),
-		.exp_perm_flags = 0	/* tbd */},
+		.exp_perm_flags = 0},
 	[NFS4_OP_GETDEVICEINFO] = {
 		.name = "OP_GETDEVICEINFO",
 		.funct = nfs4_op_getdeviceinfo,
@@ -467,10 +474,10 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0},
 	[NFS4_OP_COPY] = {
 		.name = "OP_COPY",
-		.funct = nfs4_op_notsupp,
-		.free_res = nfs4_op_notsupp_Free,
+		.funct = nfs4_op_copy,
+		.free_res = nfs4_op_copy_Free,
 		.resp_size = sizeof(COPY4res),
-		.exp_perm_flags = 0},
+		.exp_perm_flags = EXPORT_OPTION_MODIFY_ACCESS},
 	[NFS4_OP_COPY_NOTIFY] = {
 		.name = "OP_COPY_NOTIFY",
 		.funct = nfs4_op_notsupp,
@@ -503,14 +510,14 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_CANCEL] = {
 		.name = "OP_OFFLOAD_CANCEL",
-		.funct = nfs4_op_notsupp,
-		.free_res = nfs4_op_notsupp_Free,
-		.resp_size = sizeof(OFFLOAD_ABORT4res),
+		.funct = nfs4_op_offload_cancel,
+		.free_res = nfs4_op_offload_cancel_Free,
+		.resp_size = sizeof(OFFLOAD_CANCEL4res),
 		.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_STATUS] = {
 		.name = "OP_OFFLOAD_STATUS",
-		.funct = nfs4_op_notsupp,
-		.free_res = nfs4_op_notsupp_Free,
+		.funct = nfs4_op_offload_status,
+		.free_res = nfs4_op_offload_status_Free,
 		.resp_size = sizeof(OFFLOAD_STATUS4res),
 		.exp_perm_flags = 0},
 	[NFS4_OP_READ_PLUS] = {
@@ -530,13 +537,13 @@ static const struct nfs4_op_desc optabv4[] = {
 		.funct = nfs4_op_write_same,
 		.free_res = nfs4_op_write_same_Free,
 		.resp_size = sizeof(WRITE_SAME4res),
-		.exp_perm_flags = 0},
+		.exp_perm_flags = EXPORT_OPTION_WRITE_ACCESS},
 	[NFS4_OP_CLONE] = {
 		.name = "OP_CLONE",
-		.funct = nfs4_op_notsupp,
-		.free_res = nfs4_op_notsupp_Free,
-		.resp_size = sizeof(ILLEGAL4res),
-		.exp_perm_flags = 0},
+		.funct = nfs4_op_clone,
+		.free_res = nfs4_op_clone_Free,
+		.resp_size = sizeof(CLONE4res),
+		.exp_perm_flags = EXPORT_OPTION_MODIFY_ACCESS},
 
 	/* NFSv4.3 */
 	[NFS4_OP_GETXATTR] = {
@@ -574,14 +581,27 @@ nfs_opnum4 LastOpcode[] = {
 	NFS4_OP_REMOVEXATTR
 };
 
-void copy_tag(utf8str_cs *dest, utf8str_cs *src)
+/**
+ * @brief Copy a COMPOUND tag
+ *
+ * @param[out] dest  The copy
+ * @param[in]  src   The tag to copy
+ * @param[in]  arena Arena to allocate the copy from, or NULL for the heap
+ */
+void copy_tag(utf8str_cs *dest, utf8str_cs *src, struct req_arena *arena)
 {
 	/* Keeping the same tag as in the arguments */
 	dest->utf8string_len = src->utf8string_len;
 
 	if (dest->utf8string_len > 0) {
 
-		dest->utf8string_val = gsh_malloc(dest->utf8string_len + 1);
+		if (arena != NULL)
+			dest->utf8string_val =
+				req_arena_alloc(arena,
+						dest->utf8string_len + 1);
+		else
+			dest->utf8string_val =
+				gsh_malloc(dest->utf8string_len + 1);
 
 		memcpy(dest->utf8string_val,
 		       src->utf8string_val,
@@ -594,224 +614,626 @@ void copy_tag(utf8str_cs *dest, utf8str_cs *src)
 }
 
 /**
- * @brief The NFS PROC4 COMPOUND
- *
- * Implements the NFS PROC4 COMPOUND.  This routine processes the
- * content of the nfsv4 operation list and composes the result.  On
- * this aspect it is a little similar to a dispatch routine.
- * Operation and functions necessary to process them are defined in
- * the optabv4 array.
+ * @brief Account for a finished operation of a COMPOUND
  *
+ * Records the status of the operation at data->oppos and tallies its
+ * response size.  The caller records the operation's statistics.
  *
- *  @param[in]  arg        Generic nfs arguments
- *  @param[in]  req        NFSv4 request structure
- *  @param[out] res        NFSv4 reply structure
- *
- *  @see nfs4_op_<*> functions
- *  @see nfs4_GetPseudoFs
+ * @param[in,out] data    Compound request's data
+ * @param[in,out] status  Status of the operation, updated if the result
+ *                        is replayed from the session slot
  *
- * @retval NFS_REQ_OKAY if a result is sent.
- * @retval NFS_REQ_DROP if we pretend we never saw the request.
+ * @return true if the next operation is to be processed.
  */
-
-int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
+static bool complete_op(compound_data_t *data, int *status)
 {
-	unsigned int i = 0;
-	int status = NFS4_OK;
-	compound_data_t data;
-	nfs_opnum4 opcode;
-	const uint32_t compound4_minor = arg->arg_compound4.minorversion;
-	const uint32_t argarray_len = arg->arg_compound4.argarray.argarray_len;
-	/* Array of op arguments */
-	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
-	nfs_resop4 *resarray;
-	nsecs_elapsed_t op_start_time;
-	struct timespec ts;
-	int perm_flags;
-	char *notag = "NO TAG";
-	char *tagname = notag;
-	const char *bad_op_state_reason = "";
-	log_components_t alt_component = COMPONENT_NFS_V4;
-
-	if (compound4_minor > 2) {
-		LogCrit(COMPONENT_NFS_V4, "Bad Minor Version %d",
-			compound4_minor);
+	unsigned int i = data->oppos;
+	nfs_res_t *res = data->res;
+	nfs_resop4 *resarray = data->resarray;
 
-		res->res_compound4.status = NFS4ERR_MINOR_VERS_MISMATCH;
-		res->res_compound4.resarray.resarray_len = 0;
-		return NFS_REQ_OK;
-	}
+	LogCompoundFH(data);
 
-	if ((nfs_param.nfsv4_param.minor_versions &
-			(1 << compound4_minor)) == 0) {
-		LogInfo(COMPONENT_NFS_V4, "Unsupported minor version %d",
-			compound4_minor);
-		res->res_compound4.status = NFS4ERR_MINOR_VERS_MISMATCH;
-		res->res_compound4.resarray.resarray_len = 0;
-		return NFS_REQ_OK;
+	/* All the operation, like NFS4_OP_ACESS, have a first replyied
+	 * field called .status
+	 */
+	resarray[i].nfs_resop4_u.opaccess.status = *status;
+
+	/* Tally the response size */
+	if (*status != NFS4_OK &&
+	    (optabv4[data->opcode].resp_size != VARIABLE_RESP_SIZE ||
+	     data->op_resp_size == VARIABLE_RESP_SIZE)) {
+		/* If the op failed and has a static response size, or
+		 * it has a variable size that hasn't been set, use the
+		 * sizeof nfsstat4 instead.
+		 */
+		data->op_resp_size = sizeof(nfsstat4);
 	}
 
-	/* Keeping the same tag as in the arguments */
-	copy_tag(&res->res_compound4.tag, &arg->arg_compound4.tag);
+	data->resp_size += sizeof(nfs_opnum4) + data->op_resp_size;
 
-	if (res->res_compound4.tag.utf8string_len > 0) {
-		/* Check if the tag is a valid utf8 string */
-		status =
-		    nfs4_utf8string2dynamic(&(res->res_compound4.tag),
-					    UTF8_SCAN_NAME, &tagname);
-		if (status != 0) {
-			char str[LOG_BUFF_LEN];
-			struct display_buffer dspbuf = {sizeof(str), str, str};
+	LogDebug(COMPONENT_NFS_V4,
+		 "Status of %s in position %d = %s, op response size is %"
+		 PRIu32" total response size is %"PRIu32,
+		 data->opname, i, nfsstat4_to_str(*status),
+		 data->op_resp_size, data->resp_size);
+
+	if (*status != NFS4_OK) {
+		/* An error occured, we do not manage the other requests
+		 * in the COMPOUND, this may be a regular behavior
+		 */
+		res->res_compound4.resarray.resarray_len = i + 1;
+		return false;
+	}
 
-			display_opaque_bytes(
-				&dspbuf,
-				res->res_compound4.tag.utf8string_val,
-				res->res_compound4.tag.utf8string_len);
+	/* NFS_V4.1 specific stuff */
+	if (data->use_slot_cached_result) {
+		/* Replay cache, only true for SEQUENCE or
+		 * CREATE_SESSION w/o SEQUENCE. Since will only be set
+		 * in those cases, no need to check operation or
+		 * anything.
+		 */
 
-			LogCrit(COMPONENT_NFS_V4,
-				"COMPOUND: bad tag %p len %d bytes %s",
-				res->res_compound4.tag.utf8string_val,
-				res->res_compound4.tag.utf8string_len,
-				str);
+		/* Free the reply allocated above */
+		if (!res->res_compound4_extended.res_arena)
+			gsh_free(res->res_compound4.resarray.resarray_val);
 
-			status = NFS4ERR_INVAL;
-			res->res_compound4.status = status;
-			res->res_compound4.resarray.resarray_len = 0;
-			return NFS_REQ_OK;
-		}
+		/* Copy the reply from the cache */
+		res->res_compound4_extended = *data->cached_result;
+		*status = ((COMPOUND4res *) data->cached_result)->status;
+		LogFullDebug(COMPONENT_SESSIONS,
+			     "Use session replay cache %p result %s",
+			     data->cached_result,
+			     nfsstat4_to_str(*status));
+		return false;
 	}
 
-	/* Managing the operation list */
-	LogDebug(COMPONENT_NFS_V4,
-		 "COMPOUND: There are %d operations, res = %p, tag = %s",
-		 argarray_len, res, tagname);
+	return true;
+}
 
-	if (tagname != notag)
-		gsh_free(tagname);
+/*
+ * Parallel COMPOUND segments
+ *
+ * Clients that walk a directory often send long COMPOUNDs of the form
+ * PUTFH, GETATTR, PUTFH, GETATTR...  Each PUTFH starts afresh, so the
+ * segments it starts do not depend on each other and their FSAL calls
+ * may run concurrently.  With Parallel_Compound set, a run of at least two
+ * such segments is executed with one segment per thread, the last one on
+ * the request's own thread so that it leaves the compound data as a
+ * sequential execution would.  The results are then accounted for in
+ * operation order, which stops at the first error as usual and throws away
+ * whatever the later segments speculatively produced.
+ *
+ * Segments only hold read only operations that neither change the current
+ * filehandle nor use state, and every PUTFH of the run must stay in the
+ * current export.  The credentials and export permissions of the request
+ * are thus valid for all the segments, which only need their own compound
+ * data and their own references on the export and current object.
+ */
 
-	/* Check for empty COMPOUND request */
-	if (argarray_len == 0) {
-		LogMajor(COMPONENT_NFS_V4,
-			 "An empty COMPOUND (no operation in it) was received");
+/** Threads that run parallel COMPOUND segments */
+static struct fridgethr *compound_par_fridge;
 
-		res->res_compound4.status = NFS4_OK;
-		res->res_compound4.resarray.resarray_len = 0;
-		return NFS_REQ_OK;
-	}
+/** Statistics of parallel COMPOUND segments */
+static struct {
+	uint64_t runs;		/*< Runs of segments executed in parallel */
+	uint64_t segments;	/*< Segments of those runs */
+	uint64_t ops;		/*< Operations executed in those segments */
+} compound_par_stats;
 
-	/* Check for too long request */
-	if (argarray_len > 100) {
-		LogMajor(COMPONENT_NFS_V4,
-			 "A COMPOUND with too many operations (%d) was received",
-			 argarray_len);
+/**
+ * @brief An operation of a parallel run
+ */
+struct par_op {
+	uint32_t resp_size;	/*< Response size of the operation */
+	bool done;		/*< The operation was executed */
+};
 
-		res->res_compound4.status = NFS4ERR_RESOURCE;
-		res->res_compound4.resarray.resarray_len = 0;
-		return NFS_REQ_OK;
-	}
+/**
+ * @brief A run of parallel segments
+ */
+struct compound_par {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint32_t pending;	/*< Segments still running on other threads */
+	uint32_t first;		/*< Position of the run's first operation */
+	struct par_op *ops;	/*< Operations of the run */
+};
 
-	/* Initialisation of the compound request internal's data */
-	memset(&data, 0, sizeof(data));
-	op_ctx->nfs_minorvers = compound4_minor;
+/**
+ * @brief A segment of a parallel run
+ */
+struct compound_seg {
+	struct compound_par *par;	/*< The run */
+	uint32_t first;			/*< Position of the segment's PUTFH */
+	uint32_t end;			/*< Position past its last operation */
+	compound_data_t data;		/*< Compound data of the segment */
+	struct req_op_context ctx;	/*< Request context of the segment */
+};
 
-	/* Minor version related stuff */
-	data.minorversion = compound4_minor;
-	data.req = req;
+/**
+ * @brief Start the threads that run parallel COMPOUND segments
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+int nfs4_compound_par_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.nfsv4_param.parallel_compound_thrd_max;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&compound_par_fridge, "Compound", &frp);
+	if (rc != 0)
+		LogMajor(COMPONENT_THREAD,
+			 "Unable to initialize parallel compound fridge, error code %d.",
+			 rc);
+
+	return rc;
+}
 
-	/* Initialize response size with size of compound response size. */
-	data.resp_size = sizeof(COMPOUND4res) - sizeof(nfs_resop4 *);
+/**
+ * @brief Stop the threads that run parallel COMPOUND segments
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+int nfs4_compound_par_shutdown(void)
+{
+	int rc;
+
+	if (compound_par_fridge == NULL)
+		return 0;
+
+	rc = fridgethr_sync_command(compound_par_fridge,
+				    fridgethr_comm_stop,
+				    120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_THREAD,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(compound_par_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Failed shutting down parallel compound fridge: %d",
+			 rc);
+	}
 
-	/* Building the client credential field */
-	if (nfs_rpc_req2client_cred(req, &(data.credential)) == -1)
-		return NFS_REQ_DROP;	/* Malformed credential */
+	return rc;
+}
 
-	/* Keeping the same tag as in the arguments */
-	res->res_compound4.tag.utf8string_len =
-	    arg->arg_compound4.tag.utf8string_len;
+/**
+ * @brief Whether an operation may be part of a parallel segment
+ *
+ * @param[in] opcode  The operation
+ *
+ * @return true if the operation only reads the current object.
+ */
+static bool par_op_allowed(nfs_opnum4 opcode)
+{
+	switch (opcode) {
+	case NFS4_OP_ACCESS:
+	case NFS4_OP_GETATTR:
+	case NFS4_OP_GETFH:
+	case NFS4_OP_NVERIFY:
+	case NFS4_OP_READLINK:
+	case NFS4_OP_VERIFY:
+		return true;
+	default:
+		return false;
+	}
+}
 
-	/* Allocating the reply nfs_resop4 */
-	res->res_compound4.resarray.resarray_val =
-		gsh_calloc(argarray_len, sizeof(struct nfs_resop4));
+/**
+ * @brief Whether a PUTFH may start a parallel segment
+ *
+ * @param[in] fh  Filehandle of the PUTFH
+ *
+ * @return true if the handle is a valid MDS handle of the current export.
+ */
+static bool par_putfh_allowed(nfs_fh4 *fh)
+{
+	struct file_handle_v4 *v4_handle;
 
-	res->res_compound4.resarray.resarray_len = argarray_len;
-	resarray = res->res_compound4.resarray.resarray_val;
+	if (nfs4_Is_Fh_Invalid(fh) != NFS4_OK || nfs4_Is_Fh_DSHandle(fh))
+		return false;
 
-	/* Manage errors NFS4ERR_OP_NOT_IN_SESSION and NFS4ERR_NOT_ONLY_OP.
-	 * These checks apply only to 4.1 */
-	if (compound4_minor > 0) {
+	v4_handle = (struct file_handle_v4 *)fh->nfs_fh4_val;
 
-		/* Check for valid operation to start an NFS v4.1 COMPOUND:
-		 */
-		if (argarray[0].argop != NFS4_OP_ILLEGAL
-		    && argarray[0].argop != NFS4_OP_SEQUENCE
-		    && argarray[0].argop != NFS4_OP_EXCHANGE_ID
-		    && argarray[0].argop != NFS4_OP_CREATE_SESSION
-		    && argarray[0].argop != NFS4_OP_DESTROY_SESSION
-		    && argarray[0].argop != NFS4_OP_BIND_CONN_TO_SESSION
-		    && argarray[0].argop != NFS4_OP_DESTROY_CLIENTID) {
-			status = NFS4ERR_OP_NOT_IN_SESSION;
-			res->res_compound4.status = status;
-			res->res_compound4.resarray.resarray_len = 0;
-			return NFS_REQ_OK;
-		}
+	return ntohs(v4_handle->id.exports) == op_ctx->ctx_export->export_id;
+}
 
-		if (argarray_len > 1) {
-			/* If not prepended by OP4_SEQUENCE, OP4_EXCHANGE_ID
-			 * should be the only request in the compound see
-			 * 18.35.3. and test EID8 for details
-			 *
-			 * If not prepended bu OP4_SEQUENCE, OP4_CREATE_SESSION
-			 * should be the only request in the compound see
-			 * 18.36.3 and test CSESS23 for details
-			 *
-			 * If the COMPOUND request does not start with SEQUENCE,
-			 * and if DESTROY_SESSION is not the sole operation,
-			 * then server MUST return  NFS4ERR_NOT_ONLY_OP. See
-			 * 18.37.3 nd test DSESS9005 for details
-			 */
-			if (argarray[0].argop == NFS4_OP_EXCHANGE_ID ||
-			    argarray[0].argop == NFS4_OP_CREATE_SESSION ||
-			    argarray[0].argop == NFS4_OP_DESTROY_CLIENTID ||
-			    argarray[0].argop == NFS4_OP_DESTROY_SESSION ||
-			    argarray[0].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
-				status = NFS4ERR_NOT_ONLY_OP;
-				res->res_compound4.status = status;
-				res->res_compound4.resarray.resarray_len = 0;
-				return NFS_REQ_OK;
-			}
+/**
+ * @brief Find a run of parallel segments
+ *
+ * @param[in] data   Compound request's data
+ * @param[in] first  Position of a PUTFH
+ *
+ * @return Position past the run, 0 if there are not at least two segments
+ *         from first on.
+ */
+static uint32_t par_run_end(compound_data_t *data, uint32_t first)
+{
+	nfs_argop4 * const argarray = data->argarray;
+	uint32_t limit = data->argarray_len;
+	uint32_t segments = 0;
+	uint32_t i;
+
+	/* Parallel segments share the current export and don't fit in
+	 * after a DS handle.
+	 */
+	if (op_ctx->ctx_export == NULL || op_ctx->fsal_pnfs_ds != NULL)
+		return 0;
+
+	/* Leave the operation over the limit to the sequential path */
+	if (data->minorversion > 0 && data->session != NULL &&
+	    data->session->fore_channel_attrs.ca_maxoperations < limit)
+		limit = data->session->fore_channel_attrs.ca_maxoperations;
+
+	for (i = first; i < limit; i++) {
+		if (argarray[i].argop == NFS4_OP_PUTFH) {
+			if (!par_putfh_allowed(
+				    &argarray[i].nfs_argop4_u.opputfh.object))
+				break;
+			segments++;
+		} else if (!par_op_allowed(argarray[i].argop)) {
+			break;
 		}
 	}
 
-	for (i = 0; i < argarray_len; i++) {
-		/* Used to check if OP_SEQUENCE is the first operation */
-		data.oppos = i;
-		data.op_resp_size = sizeof(nfsstat4);
-		opcode = argarray[i].argop;
+	return segments >= 2 ? i : 0;
+}
 
-		/* Handle opcode overflow */
-		if (opcode > LastOpcode[compound4_minor])
-			opcode = 0;
+/**
+ * @brief Execute the operations of a parallel segment
+ *
+ * Stops at the first error.  The response size of the operations is
+ * recorded for their accounting, which is left to process_par().
+ *
+ * @param[in]     seg   The segment
+ * @param[in,out] data  Compound data to execute the segment with
+ */
+static void par_seg_run(struct compound_seg *seg, compound_data_t *data)
+{
+	struct compound_par *par = seg->par;
+	nfs_argop4 * const argarray = data->argarray;
+	nfs_resop4 * const resarray = data->resarray;
+	struct timespec ts;
+	int perm_flags;
+	uint32_t i;
+	nfs_opnum4 opcode;
+	int status;
 
-		data.opname = optabv4[opcode].name;
+	for (i = seg->first; i < seg->end; i++) {
+		struct par_op *pop = &par->ops[i - par->first];
 
-		LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
-			 argarray[i].argop, data.opname);
+		opcode = argarray[i].argop;
+		data->oppos = i;
+		data->opcode = opcode;
+		data->opname = optabv4[opcode].name;
+		data->op_resp_size = optabv4[opcode].resp_size;
 
-		/* Verify BIND_CONN_TO_SESSION is not used in a compound
-		 * with length > 1. This check is NOT redundant with the
-		 * checks above.
-		 */
-		if (i > 0 &&
-		    argarray[i].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
-			status = NFS4ERR_NOT_ONLY_OP;
-			bad_op_state_reason =
-					"BIND_CONN_TO_SESSION past position 1";
-			goto bad_op_state;
+		now(&ts);
+		data->op_start_time = timespec_diff(&nfs_ServerBootTime, &ts);
+
+		perm_flags =
+		    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
+
+		if ((op_ctx->export_perms->options & perm_flags) !=
+		    perm_flags) {
+			/* None of the operations modifies anything */
+			status = NFS4ERR_ACCESS;
+			resarray[i].nfs_resop4_u.opaccess.status = status;
+			resarray[i].resop = opcode;
+			pop->resp_size = sizeof(nfsstat4);
+			pop->done = true;
+			break;
 		}
 
-		/* OP_SEQUENCE is always the first operation of the request */
+		status = (optabv4[opcode].funct) (&argarray[i],
+						  data,
+						  &resarray[i]);
+
+		resarray[i].nfs_resop4_u.opaccess.status = status;
+		server_stats_nfsv4_op_done(opcode, data->op_start_time, status);
+
+		pop->resp_size = data->op_resp_size;
+		pop->done = true;
+
+		if (status != NFS4_OK)
+			break;
+	}
+}
+
+/**
+ * @brief Execute a parallel segment with its own context
+ *
+ * @param[in] seg  The segment
+ */
+static void par_seg_exec(struct compound_seg *seg)
+{
+	struct compound_par *par = seg->par;
+	struct req_op_context *saved_ctx = op_ctx;
+
+	op_ctx = &seg->ctx;
+
+	par_seg_run(seg, &seg->data);
+
+	/* Drop the segment's references */
+	set_current_entry(&seg->data, NULL);
+	if (op_ctx->ctx_export != NULL)
+		put_gsh_export(op_ctx->ctx_export);
+
+	op_ctx = saved_ctx;
+
+	PTHREAD_MUTEX_lock(&par->mutex);
+	if (--par->pending == 0)
+		pthread_cond_signal(&par->cond);
+	PTHREAD_MUTEX_unlock(&par->mutex);
+}
+
+/**
+ * @brief Run a parallel segment on a compound thread
+ *
+ * @param[in] ctx  Thread context, arg is the segment
+ */
+static void par_seg_thread(struct fridgethr_context *ctx)
+{
+	struct compound_seg *seg = ctx->arg;
+
+	if (seg->ctx.client != NULL)
+		SetClientIP(seg->ctx.client->hostaddr_str);
+
+	par_seg_exec(seg);
+
+	SetClientIP(NULL);
+}
+
+/**
+ * @brief Process a run of parallel segments
+ *
+ * @param[in,out] data    Compound request's data
+ * @param[in]     first   Position of the run's first PUTFH
+ * @param[in]     end     Position past the run, from par_run_end()
+ * @param[in,out] status  Status of the last operation accounted for
+ *
+ * @return true if the operation after the run is to be processed.
+ */
+static bool process_par(compound_data_t *data, uint32_t first, uint32_t end,
+			int *status)
+{
+	struct req_arena *arena = &nfs_req_from_svc(data->req)->arena;
+	nfs_argop4 * const argarray = data->argarray;
+	nfs_resop4 * const resarray = data->resarray;
+	struct compound_par par;
+	struct compound_seg *segs, *seg;
+	uint32_t nsegs = 0;
+	uint32_t ops = 0;
+	uint32_t i, s;
+	int rc;
+
+	for (i = first; i < end; i++)
+		if (argarray[i].argop == NFS4_OP_PUTFH)
+			nsegs++;
+
+	/* Everything the segments use is allocated up front, the arena is
+	 * not to be used by several threads.
+	 */
+	segs = req_arena_alloc(arena, nsegs * sizeof(*segs));
+	par.ops = req_arena_alloc(arena, (end - first) * sizeof(*par.ops));
+	par.first = first;
+	par.pending = nsegs - 1;
+	PTHREAD_MUTEX_init(&par.mutex, NULL);
+	PTHREAD_COND_init(&par.cond, NULL);
+
+	seg = NULL;
+	for (i = first; i < end; i++) {
+		if (argarray[i].argop == NFS4_OP_PUTFH) {
+			seg = seg == NULL ? segs : seg + 1;
+			seg->par = &par;
+			seg->first = i;
+		}
+		seg->end = i + 1;
+	}
+
+	LogDebug(COMPONENT_NFS_V4,
+		 "Processing positions %"PRIu32" to %"PRIu32
+		 " as %"PRIu32" parallel segments",
+		 first, end - 1, nsegs);
+
+	for (s = 0; s < nsegs - 1; s++) {
+		seg = &segs[s];
+
+		/* The segment starts with a PUTFH, it has no current or
+		 * saved filehandle of its own yet.
+		 */
+		seg->data = *data;
+		seg->data.currentFH.nfs_fh4_len = 0;
+		seg->data.currentFH.nfs_fh4_val =
+			req_arena_alloc(arena, NFS4_FHSIZE);
+		seg->data.savedFH.nfs_fh4_len = 0;
+		seg->data.savedFH.nfs_fh4_val = NULL;
+		seg->data.current_stateid_valid = false;
+		seg->data.saved_stateid_valid = false;
+		seg->data.current_obj = NULL;
+		seg->data.saved_obj = NULL;
+		seg->data.current_ds = NULL;
+		seg->data.saved_ds = NULL;
+		seg->data.current_filetype = NO_FILE_TYPE;
+		seg->data.saved_filetype = NO_FILE_TYPE;
+		seg->data.saved_export = NULL;
+		seg->data.op_resume = NULL;
+		seg->data.op_data = NULL;
+
+		/* Its PUTFH releases the export it finds in the context */
+		seg->ctx = *op_ctx;
+		get_gsh_export_ref(seg->ctx.ctx_export);
+	}
+
+	for (s = 0; s < nsegs - 1; s++) {
+		rc = fridgethr_submit(compound_par_fridge, par_seg_thread,
+				      &segs[s]);
+		if (rc != 0) {
+			LogDebug(COMPONENT_NFS_V4,
+				 "Unable to queue parallel segment, error %d",
+				 rc);
+			par_seg_exec(&segs[s]);
+		}
+	}
+
+	/* The last segment leaves the request in the state a sequential
+	 * execution of the run would.
+	 */
+	par_seg_run(&segs[nsegs - 1], data);
+
+	PTHREAD_MUTEX_lock(&par.mutex);
+	while (par.pending != 0)
+		pthread_cond_wait(&par.cond, &par.mutex);
+	PTHREAD_MUTEX_unlock(&par.mutex);
+
+	PTHREAD_MUTEX_destroy(&par.mutex);
+	PTHREAD_COND_destroy(&par.cond);
+
+	/* Account for the operations in order */
+	for (i = first; i < end; i++) {
+		struct par_op *pop = &par.ops[i - first];
+
+		ops++;
+		data->oppos = i;
+		data->opcode = argarray[i].argop;
+		data->opname = optabv4[data->opcode].name;
+		data->op_resp_size = pop->resp_size;
+		*status = resarray[i].nfs_resop4_u.opaccess.status;
+
+		if (*status == NFS4_OK) {
+			/* The segment could only check the room left before
+			 * the run.
+			 */
+			rc = check_resp_room(data, data->op_resp_size);
+			if (rc != NFS4_OK) {
+				nfs4_Compound_FreeOne(&resarray[i]);
+				*status = rc;
+				data->op_resp_size = sizeof(nfsstat4);
+			}
+		}
+
+		if (!complete_op(data, status))
+			break;
+	}
+
+	/* Throw away what was done past an error */
+	for (s = i + 1; s < end; s++)
+		if (par.ops[s - first].done)
+			nfs4_Compound_FreeOne(&resarray[s]);
+
+	if (nfs_param.core_param.enable_NFSSTATS) {
+		(void) atomic_inc_uint64_t(&compound_par_stats.runs);
+		(void) atomic_add_uint64_t(&compound_par_stats.segments,
+					   nsegs);
+		(void) atomic_add_uint64_t(&compound_par_stats.ops, ops);
+	}
+
+	return i == end;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report parallel COMPOUND statistics
+ *
+ * Appends (runs, segments, operations).
+ */
+void nfs4_compound_par_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+	uint64_t runs, segments, ops;
+
+	runs = atomic_fetch_uint64_t(&compound_par_stats.runs);
+	segments = atomic_fetch_uint64_t(&compound_par_stats.segments);
+	ops = atomic_fetch_uint64_t(&compound_par_stats.ops);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &runs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &segments);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &ops);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif
+
+/**
+ * @brief Process the operations of a COMPOUND
+ *
+ * @param[in,out] data    Compound request's data
+ * @param[in]     first   Position of the first operation to process
+ * @param[in,out] status  Status of the last operation processed
+ *
+ * @return true if an operation suspended the COMPOUND.
+ */
+static bool process_ops(compound_data_t *data, unsigned int first,
+			int *status)
+{
+	unsigned int i;
+	nfs_opnum4 opcode;
+	const uint32_t compound4_minor = data->minorversion;
+	const uint32_t argarray_len = data->argarray_len;
+	nfs_argop4 * const argarray = data->argarray;
+	nfs_resop4 * const resarray = data->resarray;
+	nfs_res_t *res = data->res;
+	struct timespec ts;
+	int perm_flags;
+	const char *bad_op_state_reason = "";
+	log_components_t alt_component = COMPONENT_NFS_V4;
+
+	for (i = first; i < argarray_len; i++) {
+		/* Used to check if OP_SEQUENCE is the first operation */
+		data->oppos = i;
+		data->op_resp_size = sizeof(nfsstat4);
+		opcode = argarray[i].argop;
+
+		/* Handle opcode overflow */
+		if (opcode > LastOpcode[compound4_minor])
+			opcode = 0;
+
+		data->opcode = opcode;
+		data->opname = optabv4[opcode].name;
+
+		LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
+			 argarray[i].argop, data->opname);
+
+		/* Hand a run of independent segments to the compound
+		 * threads.
+		 */
+		if (opcode == NFS4_OP_PUTFH && compound_par_fridge != NULL) {
+			uint32_t end = par_run_end(data, i);
+
+			if (end != 0) {
+				if (!process_par(data, i, end, status))
+					break;
+				i = end - 1;
+				continue;
+			}
+		}
+
+		/* Verify BIND_CONN_TO_SESSION is not used in a compound
+		 * with length > 1. This check is NOT redundant with the
+		 * checks above.
+		 */
+		if (i > 0 &&
+		    argarray[i].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
+			*status = NFS4ERR_NOT_ONLY_OP;
+			bad_op_state_reason =
+					"BIND_CONN_TO_SESSION past position 1";
+			goto bad_op_state;
+		}
+
+		/* OP_SEQUENCE is always the first operation of the request */
 		if (i > 0 && argarray[i].argop == NFS4_OP_SEQUENCE) {
-			status = NFS4ERR_SEQUENCE_POS;
+			*status = NFS4ERR_SEQUENCE_POS;
 			bad_op_state_reason =
 					"SEQUENCE past position 1";
 			goto bad_op_state;
@@ -844,7 +1266,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 				   bad_pos ? "not last op in compound" : "opk");
 
 			if (bad_pos) {
-				status = NFS4ERR_NOT_ONLY_OP;
+				*status = NFS4ERR_NOT_ONLY_OP;
 				bad_op_state_reason =
 				    "DESTROY_SESSION not last op in compound";
 				goto bad_op_state;
@@ -853,11 +1275,11 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 		/* time each op */
 		now(&ts);
-		op_start_time = timespec_diff(&nfs_ServerBootTime, &ts);
+		data->op_start_time = timespec_diff(&nfs_ServerBootTime, &ts);
 
-		if (compound4_minor > 0 && data.session != NULL &&
-		    data.session->fore_channel_attrs.ca_maxoperations == i) {
-			status = NFS4ERR_TOO_MANY_OPS;
+		if (compound4_minor > 0 && data->session != NULL &&
+		    data->session->fore_channel_attrs.ca_maxoperations == i) {
+			*status = NFS4ERR_TOO_MANY_OPS;
 			bad_op_state_reason = "Too many operations";
 			goto bad_op_state;
 		}
@@ -866,8 +1288,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
 
 		if (perm_flags != 0) {
-			status = nfs4_Is_Fh_Empty(&data.currentFH);
-			if (status != NFS4_OK) {
+			*status = nfs4_Is_Fh_Empty(&data->currentFH);
+			if (*status != NFS4_OK) {
 				bad_op_state_reason = "Empty or NULL handle";
 				goto bad_op_state;
 			}
@@ -888,9 +1310,9 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 				 */
 				if ((perm_flags & EXPORT_OPTION_MODIFY_ACCESS)
 				    != 0)
-					status = NFS4ERR_ROFS;
+					*status = NFS4ERR_ROFS;
 				else
-					status = NFS4ERR_ACCESS;
+					*status = NFS4ERR_ACCESS;
 
 				bad_op_state_reason =
 						"Export permission failure";
@@ -902,28 +1324,29 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		/* Set up the minimum/default response size and check if there
 		 * is room for it.
 		*/
-		data.op_resp_size = optabv4[opcode].resp_size;
+		data->op_resp_size = optabv4[opcode].resp_size;
 
-		status = check_resp_room(&data, data.op_resp_size);
+		*status = check_resp_room(data, data->op_resp_size);
 
-		if (status != NFS4_OK) {
+		if (*status != NFS4_OK) {
 			bad_op_state_reason = "op response size";
 
  bad_op_state:
 			/* Tally the response size */
-			data.resp_size += sizeof(nfs_opnum4) + sizeof(nfsstat4);
+			data->resp_size += sizeof(nfs_opnum4) +
+					   sizeof(nfsstat4);
 
 			LogDebugAlt(COMPONENT_NFS_V4, alt_component,
 				    "Status of %s in position %d due to %s is %s, op response size = %"
 				    PRIu32" total response size = %"PRIu32,
-				    data.opname, i, bad_op_state_reason,
-				    nfsstat4_to_str(status),
-				    data.op_resp_size, data.resp_size);
+				    data->opname, i, bad_op_state_reason,
+				    nfsstat4_to_str(*status),
+				    data->op_resp_size, data->resp_size);
 
 			/* All the operation, like NFS4_OP_ACCESS, have
 			 * a first replied field called .status
 			 */
-			resarray[i].nfs_resop4_u.opaccess.status = status;
+			resarray[i].nfs_resop4_u.opaccess.status = *status;
 			resarray[i].resop = argarray[i].argop;
 
 			/* Do not manage the other requests in the COMPOUND. */
@@ -936,77 +1359,55 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		 **************************************************************/
 #ifdef USE_LTTNG
 		tracepoint(nfs_rpc, v4op_start, i, argarray[i].argop,
-			   data.opname);
+			   data->opname);
 #endif
 
-		status = (optabv4[opcode].funct) (&argarray[i],
-						  &data,
-						  &resarray[i]);
-
-#ifdef USE_LTTNG
-		tracepoint(nfs_rpc, v4op_end, i, argarray[i].argop,
-			   data.opname, nfsstat4_to_str(status));
-#endif
-
-		LogCompoundFH(&data);
-
-		/* All the operation, like NFS4_OP_ACESS, have a first replyied
-		 * field called .status
-		 */
-		resarray[i].nfs_resop4_u.opaccess.status = status;
-
-		server_stats_nfsv4_op_done(opcode, op_start_time, status);
+		fr_mark(FR_OP, data->opname);
+		*status = (optabv4[opcode].funct) (&argarray[i],
+						   data,
+						   &resarray[i]);
 
-		/* Tally the response size */
-		if (status != NFS4_OK &&
-		    (optabv4[opcode].resp_size != VARIABLE_RESP_SIZE ||
-		     data.op_resp_size == VARIABLE_RESP_SIZE)) {
-			/* If the op failed and has a static response size, or
-			 * it has a variable size that hasn't been set, use the
-			 * sizeof nfsstat4 instead.
+		if (*status == NFS4_OP_ASYNC_WAIT) {
+			/* The op suspended the request, data now belongs to
+			 * whoever resumes it.
 			 */
-			data.op_resp_size = sizeof(nfsstat4);
+			return true;
 		}
 
-		data.resp_size += sizeof(nfs_opnum4) + data.op_resp_size;
+		fr_mark(FR_OP_DONE, data->opname);
 
-		LogDebug(COMPONENT_NFS_V4,
-			 "Status of %s in position %d = %s, op response size is %"
-			 PRIu32" total response size is %"PRIu32,
-			 data.opname, i, nfsstat4_to_str(status),
-			 data.op_resp_size, data.resp_size);
+#ifdef USE_LTTNG
+		tracepoint(nfs_rpc, v4op_end, i, argarray[i].argop,
+			   data->opname, nfsstat4_to_str(*status));
+#endif
 
-		if (status != NFS4_OK) {
-			/* An error occured, we do not manage the other requests
-			 * in the COMPOUND, this may be a regular behavior
-			 */
-			res->res_compound4.resarray.resarray_len = i + 1;
-			break;
-		}
+		server_stats_nfsv4_op_done(data->opcode, data->op_start_time,
+					   *status);
 
-		/* NFS_V4.1 specific stuff */
-		if (data.use_slot_cached_result) {
-			/* Replay cache, only true for SEQUENCE or
-			 * CREATE_SESSION w/o SEQUENCE. Since will only be set
-			 * in those cases, no need to check operation or
-			 * anything.
-			 */
+		if (!complete_op(data, status))
+			break;
+	}			/* for */
 
-			/* Free the reply allocated above */
-			gsh_free(res->res_compound4.resarray.resarray_val);
+	return false;
+}
 
-			/* Copy the reply from the cache */
-			res->res_compound4_extended = *data.cached_result;
-			status = ((COMPOUND4res *) data.cached_result)->status;
-			LogFullDebug(COMPONENT_SESSIONS,
-				     "Use session replay cache %p result %s",
-				     data.cached_result,
-				     nfsstat4_to_str(status));
-			break;	/* Exit the for loop */
-		}
-	}			/* for */
+/**
+ * @brief Finish a COMPOUND whose operations have all been processed
+ *
+ * Fills in the COMPOUND status, manages the session reply cache, and
+ * frees the compound data.
+ *
+ * @param[in] data    Compound request's data
+ * @param[in] status  Status of the last operation processed
+ *
+ * @return NFS_REQ_OK.
+ */
+static int complete_compound(compound_data_t *data, int status)
+{
+	nfs_res_t *res = data->res;
+	nfs_argop4 * const argarray = data->argarray;
 
-	server_stats_compound_done(argarray_len, status);
+	server_stats_compound_done(data->argarray_len, status);
 
 	/* Complete the reply, in particular, tell where you stopped if
 	 * unsuccessfull COMPOUD
@@ -1016,28 +1417,46 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
 	 * save a replayed result again.
 	 */
-	if (data.sa_cachethis) {
+	if (data->sa_cachethis) {
 		/* Pointer has been set by nfs4_op_sequence and points to slot
 		 * to cache result in.
 		 */
 		LogFullDebug(COMPONENT_SESSIONS,
 			     "Save result in session replay cache %p sizeof nfs_res_t=%d",
-			     data.cached_result, (int)sizeof(nfs_res_t));
+			     data->cached_result, (int)sizeof(nfs_res_t));
 
 		/* Indicate to nfs4_Compound_Free that this reply is cached. */
 		res->res_compound4_extended.res_cached = true;
 
+		/* The slot keeps the reply past this request, so move what
+		 * was allocated from the request's arena to the heap.  The
+		 * results of the operations are on the heap already.
+		 */
+		if (res->res_compound4_extended.res_arena) {
+			size_t size = res->res_compound4.resarray.resarray_len *
+				      sizeof(struct nfs_resop4);
+			nfs_resop4 *resarray = gsh_malloc(size);
+			utf8str_cs tag = res->res_compound4.tag;
+
+			memcpy(resarray,
+			       res->res_compound4.resarray.resarray_val, size);
+			res->res_compound4.resarray.resarray_val = resarray;
+			copy_tag(&res->res_compound4.tag, &tag, NULL);
+			res->res_compound4_extended.res_arena = false;
+		}
+
 		/* Save the result in the cache (copy out of the result array
 		 * into the slot cache (which is pointed to by
-		 * data.cached_result).
+		 * data->cached_result).
 		 */
-		*data.cached_result = res->res_compound4_extended;
-	} else if (compound4_minor > 0 && !data.use_slot_cached_result &&
+		*data->cached_result = res->res_compound4_extended;
+	} else if (data->minorversion > 0 && !data->use_slot_cached_result &&
 		   argarray[0].argop == NFS4_OP_SEQUENCE &&
-		   data.cached_result != NULL) {
+		   data->cached_result != NULL) {
 		/* We need to cache an "uncached" response. The length is
 		 * 1 if only one op processed, otherwise 2. */
-		struct COMPOUND4res *c_res = &data.cached_result->res_compound4;
+		struct COMPOUND4res *c_res =
+					&data->cached_result->res_compound4;
 		u_int resarray_len =
 			res->res_compound4.resarray.resarray_len == 1 ? 1 : 2;
 		struct nfs_resop4 *res0;
@@ -1045,7 +1464,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		c_res->resarray.resarray_len = resarray_len;
 		c_res->resarray.resarray_val =
 			gsh_calloc(resarray_len, sizeof(struct nfs_resop4));
-		copy_tag(&c_res->tag, &res->res_compound4.tag);
+		copy_tag(&c_res->tag, &res->res_compound4.tag, NULL);
+		data->cached_result->res_arena = false;
 		res0 = c_res->resarray.resarray_val;
 
 		/* Copy the sequence result. */
@@ -1089,24 +1509,25 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		}
 
 		/* Indicate that this reply is cached in slot cache. */
-		data.cached_result->res_cached = true;
+		data->cached_result->res_cached = true;
 	}
 
 	/* If we have reserved a lease, update it and release it */
-	if (data.preserved_clientid != NULL) {
+	if (data->preserved_clientid != NULL) {
 		/* Update and release lease */
-		PTHREAD_MUTEX_lock(&data.preserved_clientid->cid_mutex);
+		PTHREAD_MUTEX_lock(&data->preserved_clientid->cid_mutex);
 
-		update_lease(data.preserved_clientid);
+		update_lease(data->preserved_clientid);
 
-		PTHREAD_MUTEX_unlock(&data.preserved_clientid->cid_mutex);
+		PTHREAD_MUTEX_unlock(&data->preserved_clientid->cid_mutex);
 	}
 
 	if (status != NFS4_OK)
 		LogDebug(COMPONENT_NFS_V4, "End status = %s lastindex = %d",
-			 nfsstat4_to_str(status), i);
+			 nfsstat4_to_str(status), data->oppos);
 
-	compound_data_Free(&data);
+	/* data itself is in the request's arena */
+	compound_data_Free(data);
 
 	/* release current active export in op_ctx. */
 	if (op_ctx->ctx_export) {
@@ -1116,6 +1537,266 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 
 	return NFS_REQ_OK;
+}
+
+/**
+ * @brief Resume a COMPOUND suspended by one of its operations
+ *
+ * Finishes the suspended operation, then processes the rest of the
+ * COMPOUND.
+ *
+ * @param[in] reqdata  The request
+ *
+ * @retval NFS_REQ_OK if a result is to be sent.
+ * @retval NFS_REQ_ASYNC_WAIT if an operation suspended the COMPOUND again.
+ */
+static int nfs4_compound_resume(request_data_t *reqdata)
+{
+	compound_data_t *data = reqdata->r_u.req.proc_data;
+	int (*op_resume)(struct compound_data *, struct nfs_resop4 *) =
+							data->op_resume;
+	int status;
+
+	data->op_resume = NULL;
+	status = op_resume(data, &data->resarray[data->oppos]);
+
+	if (status == NFS4_OP_ASYNC_WAIT)
+		return NFS_REQ_ASYNC_WAIT;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, v4op_end, data->oppos,
+		   data->argarray[data->oppos].argop,
+		   data->opname, nfsstat4_to_str(status));
+#endif
+
+	server_stats_nfsv4_op_done(data->opcode, data->op_start_time, status);
+
+	if (complete_op(data, &status) &&
+	    process_ops(data, data->oppos + 1, &status))
+		return NFS_REQ_ASYNC_WAIT;
+
+	return complete_compound(data, status);
+}
+
+/**
+ * @brief The NFS PROC4 COMPOUND
+ *
+ * Implements the NFS PROC4 COMPOUND.  This routine processes the
+ * content of the nfsv4 operation list and composes the result.  On
+ * this aspect it is a little similar to a dispatch routine.
+ * Operation and functions necessary to process them are defined in
+ * the optabv4 array.
+ *
+ * An operation waiting on an asynchronous FSAL call may suspend the
+ * COMPOUND, which is then resumed by nfs4_compound_resume() on whatever
+ * thread the call completes.  Everything the remaining operations need
+ * is kept in the compound data for that reason.
+ *
+ *
+ *  @param[in]  arg        Generic nfs arguments
+ *  @param[in]  req        NFSv4 request structure
+ *  @param[out] res        NFSv4 reply structure
+ *
+ *  @see nfs4_op_<*> functions
+ *  @see nfs4_GetPseudoFs
+ *
+ * @retval NFS_REQ_OKAY if a result is sent.
+ * @retval NFS_REQ_DROP if we pretend we never saw the request.
+ * @retval NFS_REQ_ASYNC_WAIT if the COMPOUND was suspended.
+ */
+
+int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
+{
+	request_data_t *reqdata = nfs_req_from_svc(req);
+	int status = NFS4_OK;
+	compound_data_t *data;
+	const uint32_t compound4_minor = arg->arg_compound4.minorversion;
+	const uint32_t argarray_len = arg->arg_compound4.argarray.argarray_len;
+	/* Array of op arguments */
+	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
+	char *notag = "NO TAG";
+	char *tagname = notag;
+	struct req_arena *res_arena = NULL;
+
+	if (compound4_minor > 2) {
+		LogCrit(COMPONENT_NFS_V4, "Bad Minor Version %d",
+			compound4_minor);
+
+		res->res_compound4.status = NFS4ERR_MINOR_VERS_MISMATCH;
+		res->res_compound4.resarray.resarray_len = 0;
+		return NFS_REQ_OK;
+	}
+
+	if ((nfs_param.nfsv4_param.minor_versions &
+			(1 << compound4_minor)) == 0) {
+		LogInfo(COMPONENT_NFS_V4, "Unsupported minor version %d",
+			compound4_minor);
+		res->res_compound4.status = NFS4ERR_MINOR_VERS_MISMATCH;
+		res->res_compound4.resarray.resarray_len = 0;
+		return NFS_REQ_OK;
+	}
+
+	/* A reply kept in the duplicate request cache outlives the request,
+	 * otherwise its bookkeeping goes in the request's arena.
+	 */
+	if (!nfs_dupreq_keeps_res(req))
+		res_arena = &reqdata->arena;
+	res->res_compound4_extended.res_arena = res_arena != NULL;
+
+	/* Keeping the same tag as in the arguments */
+	copy_tag(&res->res_compound4.tag, &arg->arg_compound4.tag, res_arena);
+
+	if (res->res_compound4.tag.utf8string_len > 0) {
+		/* Check if the tag is a valid utf8 string */
+		status =
+		    nfs4_utf8string2dynamic(&(res->res_compound4.tag),
+					    UTF8_SCAN_NAME, &tagname);
+		if (status != 0) {
+			char str[LOG_BUFF_LEN];
+			struct display_buffer dspbuf = {sizeof(str), str, str};
+
+			display_opaque_bytes(
+				&dspbuf,
+				res->res_compound4.tag.utf8string_val,
+				res->res_compound4.tag.utf8string_len);
+
+			LogCrit(COMPONENT_NFS_V4,
+				"COMPOUND: bad tag %p len %d bytes %s",
+				res->res_compound4.tag.utf8string_val,
+				res->res_compound4.tag.utf8string_len,
+				str);
+
+			status = NFS4ERR_INVAL;
+			res->res_compound4.status = status;
+			res->res_compound4.resarray.resarray_len = 0;
+			return NFS_REQ_OK;
+		}
+	}
+
+	/* Managing the operation list */
+	LogDebug(COMPONENT_NFS_V4,
+		 "COMPOUND: There are %d operations, res = %p, tag = %s",
+		 argarray_len, res, tagname);
+
+	if (tagname != notag)
+		gsh_free(tagname);
+
+	/* Check for empty COMPOUND request */
+	if (argarray_len == 0) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "An empty COMPOUND (no operation in it) was received");
+
+		res->res_compound4.status = NFS4_OK;
+		res->res_compound4.resarray.resarray_len = 0;
+		return NFS_REQ_OK;
+	}
+
+	/* Check for too long request */
+	if (argarray_len > 100) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "A COMPOUND with too many operations (%d) was received",
+			 argarray_len);
+
+		res->res_compound4.status = NFS4ERR_RESOURCE;
+		res->res_compound4.resarray.resarray_len = 0;
+		return NFS_REQ_OK;
+	}
+
+	/* Initialisation of the compound request internal's data.  It, and
+	 * the filehandle buffers, never outlive the request.
+	 */
+	data = req_arena_alloc(&reqdata->arena, sizeof(*data));
+	data->currentFH.nfs_fh4_val = req_arena_alloc(&reqdata->arena,
+						      NFS4_FHSIZE);
+	data->savedFH.nfs_fh4_val = req_arena_alloc(&reqdata->arena,
+						    NFS4_FHSIZE);
+	op_ctx->nfs_minorvers = compound4_minor;
+
+	/* Minor version related stuff */
+	data->minorversion = compound4_minor;
+	data->req = req;
+
+	/* Initialize response size with size of compound response size. */
+	data->resp_size = sizeof(COMPOUND4res) - sizeof(nfs_resop4 *);
+
+	/* Building the client credential field */
+	if (nfs_rpc_req2client_cred(req, &data->credential) == -1)
+		return NFS_REQ_DROP;	/* Malformed credential */
+
+	/* Keeping the same tag as in the arguments */
+	res->res_compound4.tag.utf8string_len =
+	    arg->arg_compound4.tag.utf8string_len;
+
+	/* Allocating the reply nfs_resop4 */
+	if (res_arena != NULL)
+		res->res_compound4.resarray.resarray_val =
+			req_arena_alloc(res_arena,
+					argarray_len *
+						sizeof(struct nfs_resop4));
+	else
+		res->res_compound4.resarray.resarray_val =
+			gsh_calloc(argarray_len, sizeof(struct nfs_resop4));
+
+	res->res_compound4.resarray.resarray_len = argarray_len;
+
+	data->argarray = argarray;
+	data->argarray_len = argarray_len;
+	data->resarray = res->res_compound4.resarray.resarray_val;
+	data->res = res;
+
+	/* Manage errors NFS4ERR_OP_NOT_IN_SESSION and NFS4ERR_NOT_ONLY_OP.
+	 * These checks apply only to 4.1 */
+	if (compound4_minor > 0) {
+
+		/* Check for valid operation to start an NFS v4.1 COMPOUND:
+		 */
+		if (argarray[0].argop != NFS4_OP_ILLEGAL
+		    && argarray[0].argop != NFS4_OP_SEQUENCE
+		    && argarray[0].argop != NFS4_OP_EXCHANGE_ID
+		    && argarray[0].argop != NFS4_OP_CREATE_SESSION
+		    && argarray[0].argop != NFS4_OP_DESTROY_SESSION
+		    && argarray[0].argop != NFS4_OP_BIND_CONN_TO_SESSION
+		    && argarray[0].argop != NFS4_OP_DESTROY_CLIENTID) {
+			status = NFS4ERR_OP_NOT_IN_SESSION;
+			res->res_compound4.status = status;
+			res->res_compound4.resarray.resarray_len = 0;
+			return NFS_REQ_OK;
+		}
+
+		if (argarray_len > 1) {
+			/* If not prepended by OP4_SEQUENCE, OP4_EXCHANGE_ID
+			 * should be the only request in the compound see
+			 * 18.35.3. and test EID8 for details
+			 *
+			 * If not prepended bu OP4_SEQUENCE, OP4_CREATE_SESSION
+			 * should be the only request in the compound see
+			 * 18.36.3 and test CSESS23 for details
+			 *
+			 * If the COMPOUND request does not start with SEQUENCE,
+			 * and if DESTROY_SESSION is not the sole operation,
+			 * then server MUST return  NFS4ERR_NOT_ONLY_OP. See
+			 * 18.37.3 nd test DSESS9005 for details
+			 */
+			if (argarray[0].argop == NFS4_OP_EXCHANGE_ID ||
+			    argarray[0].argop == NFS4_OP_CREATE_SESSION ||
+			    argarray[0].argop == NFS4_OP_DESTROY_CLIENTID ||
+			    argarray[0].argop == NFS4_OP_DESTROY_SESSION ||
+			    argarray[0].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
+				status = NFS4ERR_NOT_ONLY_OP;
+				res->res_compound4.status = status;
+				res->res_compound4.resarray.resarray_len = 0;
+				return NFS_REQ_OK;
+			}
+		}
+	}
+
+	reqdata->r_u.req.resume_fn = nfs4_compound_resume;
+	reqdata->r_u.req.proc_data = data;
+
+	if (process_ops(data, 0, &status))
+		return NFS_REQ_ASYNC_WAIT;
+
+	return complete_compound(data, status);
 }				/* nfs4_Compound */
 
 /**
@@ -1176,10 +1857,13 @@ void nfs4_Compound_Free(nfs_res_t *res)
 		}
 	}
 
-	gsh_free(res->res_compound4.resarray.resarray_val);
-	res->res_compound4.resarray.resarray_val = NULL;
+	/* Arena memory is released with the request */
+	if (!res->res_compound4_extended.res_arena) {
+		gsh_free(res->res_compound4.resarray.resarray_val);
+		gsh_free(res->res_compound4.tag.utf8string_val);
+	}
 
-	gsh_free(res->res_compound4.tag.utf8string_val);
+	res->res_compound4.resarray.resarray_val = NULL;
 	res->res_compound4.tag.utf8string_val = NULL;
 }
 
@@ -1215,13 +1899,6 @@ void compound_data_Free(compound_data_t *data)
 		put_gsh_export(data->saved_export);
 		data->saved_export = NULL;
 	}
-
-	if (data->currentFH.nfs_fh4_val != NULL)
-		gsh_free(data->currentFH.nfs_fh4_val);
-
-	if (data->savedFH.nfs_fh4_val != NULL)
-		gsh_free(data->savedFH.nfs_fh4_val);
-
 }				/* compound_data_Free */
 
 /**
@@ -0,0 +1,976 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs4_op_copy.c
+ * @brief Routines used for managing the NFS4 COMPOUND functions.
+ *
+ * Routines used for managing the NFS4 COMPOUND functions COPY, CLONE,
+ * OFFLOAD_STATUS and OFFLOAD_CANCEL.
+ *
+ * Only intra-server copies are supported: the source is the saved
+ * filehandle and must be in the same export as the current filehandle,
+ * which is the destination.  An asynchronous COPY is run on the "Copy"
+ * fridge in chunks, so that OFFLOAD_STATUS can report progress and
+ * OFFLOAD_CANCEL can stop it, and is reported to the client with
+ * CB_OFFLOAD.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "nfs_convert.h"
+#include "nfs_file_handle.h"
+#include "nfs_rpc_callback.h"
+#include "export_mgr.h"
+#include "client_mgr.h"
+#include "fridgethr.h"
+#include "gsh_list.h"
+
+/** Bytes copied per call into the FSAL by an asynchronous copy */
+#define COPY_CHUNK_SIZE (64 * 1024 * 1024)
+
+/** Threads running asynchronous copies */
+#define COPY_THRD_MAX 8
+
+/**
+ * @brief An asynchronous copy
+ *
+ * The job is on copy_jobs from the COPY that starts it until CB_OFFLOAD
+ * has been answered, or until it stops after OFFLOAD_CANCEL.  copied,
+ * status, complete and cancelled are protected by copy_jobs_mutex; the
+ * rest is set before the job is queued.  The copy runs with the
+ * credentials and export permissions of the COPY that started it.
+ */
+
+struct copy_job {
+	struct glist_head list;	/*< Entry in copy_jobs */
+	stateid4 stateid;	/*< Callback stateid naming the copy */
+	nfs_client_id_t *clientid;	/*< Client to send CB_OFFLOAD to */
+	struct gsh_export *export;	/*< Export of both files */
+	struct fsal_obj_handle *src_obj;	/*< Source file */
+	struct fsal_obj_handle *dst_obj;	/*< Destination file */
+	state_t *src_state;	/*< Source state, may be NULL */
+	state_t *dst_state;	/*< Destination state, may be NULL */
+	uint64_t src_offset;	/*< Start of the source range */
+	uint64_t dst_offset;	/*< Start of the destination range */
+	uint64_t count;		/*< Length of the range */
+	uint64_t copied;	/*< Bytes copied so far */
+	nfsstat4 status;	/*< Result once complete */
+	bool complete;		/*< The copy has stopped */
+	bool cancelled;		/*< OFFLOAD_CANCEL was received */
+	nfs_fh4 dst_fh;		/*< Destination filehandle for CB_OFFLOAD */
+	char dst_fh_buf[NFS4_FHSIZE];	/*< Buffer for dst_fh */
+	struct req_op_context req_ctx;	/*< op_ctx the copy runs with */
+	struct user_cred creds;	/*< Caller's creds, own group array */
+	struct export_perms export_perms;	/*< Caller's export perms */
+};
+
+/**
+ * @brief Arguments for CB_OFFLOAD, freed by its completion
+ */
+
+struct copy_cb {
+	nfs_cb_argop4 arg;	/*< Arguments (so we can free them) */
+	struct copy_job *job;	/*< The job being reported */
+};
+
+static struct fridgethr *copy_fridge;
+static struct glist_head copy_jobs = GLIST_HEAD_INIT(copy_jobs);
+static pthread_mutex_t copy_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Start the threads that run asynchronous copies
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+int nfs4_copy_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = COPY_THRD_MAX;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&copy_fridge, "Copy", &frp);
+	if (rc != 0)
+		LogMajor(COMPONENT_THREAD,
+			 "Unable to initialize copy fridge, error code %d.",
+			 rc);
+
+	return rc;
+}
+
+/**
+ * @brief Stop the threads that run asynchronous copies
+ *
+ * Copies in progress are cancelled and stop at their next chunk.
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+int nfs4_copy_shutdown(void)
+{
+	struct glist_head *glist;
+	int rc;
+
+	if (copy_fridge == NULL)
+		return 0;
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+
+	glist_for_each(glist, &copy_jobs) {
+		glist_entry(glist, struct copy_job, list)->cancelled = true;
+	}
+
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	rc = fridgethr_sync_command(copy_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_THREAD,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(copy_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Failed shutting down copy fridge: %d", rc);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Find an asynchronous copy by its stateid
+ *
+ * Must be called with copy_jobs_mutex held.
+ *
+ * @param[in] stateid   The callback stateid returned by COPY
+ * @param[in] clientid  The client asking
+ *
+ * @return The job, or NULL if there is none.
+ */
+
+static struct copy_job *copy_job_lookup(stateid4 *stateid,
+					nfs_client_id_t *clientid)
+{
+	struct glist_head *glist;
+	struct copy_job *job;
+
+	glist_for_each(glist, &copy_jobs) {
+		job = glist_entry(glist, struct copy_job, list);
+
+		if (job->clientid == clientid &&
+		    memcmp(job->stateid.other, stateid->other,
+			   sizeof(stateid->other)) == 0)
+			return job;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Remove a finished copy from the table and free it
+ *
+ * The object, state and export references have already been dropped.
+ *
+ * @param[in] job  The job
+ */
+
+static void copy_job_free(struct copy_job *job)
+{
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+	glist_del(&job->list);
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	if (job->req_ctx.client != NULL)
+		put_gsh_client(job->req_ctx.client);
+
+	gsh_free(job->creds.caller_garray);
+	dec_client_id_ref(job->clientid);
+	gsh_free(job);
+}
+
+/**
+ * @brief Handle the CB_OFFLOAD response
+ *
+ * @param[in] call  The RPC call being completed
+ */
+
+static void copy_cb_completion(rpc_call_t *call)
+{
+	struct copy_cb *cb = call->call_arg;
+
+	LogFullDebug(COMPONENT_NFS_CB, "status %d arg %p",
+		     call->cbt.v_u.v4.res.status, call->call_arg);
+
+	/* COPY is NFSv4.2 only, so this always went on a back channel */
+	nfs41_release_single(call);
+	copy_job_free(cb->job);
+	gsh_free(cb);
+}
+
+/**
+ * @brief Tell the client an asynchronous copy has finished
+ *
+ * @param[in] job  The finished job
+ * @param[in] verf_desc  The write verifier for the copied data
+ */
+
+static void copy_send_cb_offload(struct copy_job *job,
+				 struct gsh_buffdesc *verf_desc)
+{
+	struct copy_cb *cb = gsh_calloc(1, sizeof(struct copy_cb));
+	CB_OFFLOAD4args *cb_offload = &cb->arg.nfs_cb_argop4_u.opcboffload;
+	write_response4 *wr = &cb_offload->coa_offload_info.coa_resok4;
+	int code;
+
+	cb->job = job;
+	cb->arg.argop = NFS4_OP_CB_OFFLOAD;
+
+	cb_offload->coa_fh = job->dst_fh;
+	cb_offload->coa_stateid = job->stateid;
+	cb_offload->coa_status = job->status;
+
+	if (job->status == NFS4_OK) {
+		wr->wr_ids = 0;
+		wr->wr_count = job->copied;
+		wr->wr_committed = UNSTABLE4;
+		memcpy(wr->wr_writeverf, verf_desc->addr, sizeof(verifier4));
+	} else {
+		cb_offload->coa_offload_info.coa_bytes_copied = job->copied;
+	}
+
+	code = nfs_rpc_cb_single(job->clientid, &cb->arg, NULL,
+				 copy_cb_completion, cb);
+	if (code != 0) {
+		LogDebug(COMPONENT_NFS_CB,
+			 "CB_OFFLOAD could not be sent, error %d", code);
+		gsh_free(cb);
+		copy_job_free(job);
+	}
+}
+
+/**
+ * @brief Run an asynchronous copy
+ *
+ * @param[in] ctx  Thread context, the arg is the copy_job
+ */
+
+static void copy_job_run(struct fridgethr_context *ctx)
+{
+	struct copy_job *job = ctx->arg;
+	struct req_op_context *saved_ctx = op_ctx;
+	fsal_status_t fsal_status = {0, 0};
+	verifier4 verf;
+	struct gsh_buffdesc verf_desc = {
+		.addr = verf,
+		.len = sizeof(verf)
+	};
+	uint64_t copied, done;
+	bool cancelled;
+
+	op_ctx = &job->req_ctx;
+
+	for (;;) {
+		PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+		cancelled = job->cancelled;
+		copied = job->copied;
+		PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+		if (cancelled || copied >= job->count)
+			break;
+
+		fsal_status = job->dst_obj->obj_ops->copy_range2(
+				job->dst_obj, job->dst_state,
+				job->dst_offset + copied, job->src_obj,
+				job->src_state, job->src_offset + copied,
+				MIN(job->count - copied, COPY_CHUNK_SIZE),
+				0, &done);
+
+		if (FSAL_IS_ERROR(fsal_status) || done == 0)
+			break;
+
+		PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+		job->copied += done;
+		PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+	}
+
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+	if (job->src_state != NULL)
+		dec_state_t_ref(job->src_state);
+
+	if (job->dst_state != NULL)
+		dec_state_t_ref(job->dst_state);
+
+	job->src_obj->obj_ops->put_ref(job->src_obj);
+	job->dst_obj->obj_ops->put_ref(job->dst_obj);
+	put_gsh_export(job->export);
+
+	op_ctx = saved_ctx;
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+	job->status = nfs4_Errno_status(fsal_status);
+	job->complete = true;
+	cancelled = job->cancelled;
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "Copy of %" PRIu64 " bytes finished with %" PRIu64
+		     " copied, status %s%s",
+		     job->count, job->copied, nfsstat4_to_str(job->status),
+		     cancelled ? ", cancelled" : "");
+
+	/* No CB_OFFLOAD is sent for a cancelled copy */
+	if (cancelled)
+		copy_job_free(job);
+	else
+		copy_send_cb_offload(job, &verf_desc);
+}
+
+/**
+ * @brief Check a stateid for one side of a COPY or CLONE
+ *
+ * This follows the checks done for READ and WRITE: a lock stateid stands
+ * for its open, a delegation must allow the access, an open must have
+ * been for the access, and an anonymous stateid must not conflict with a
+ * delegation.
+ *
+ * @param[in]  data     Compound request's data
+ * @param[in]  obj      The file the stateid is for
+ * @param[in]  stateid  The stateid
+ * @param[in]  write    Whether the file is being written
+ * @param[in]  tag      Name of the operation, for logging
+ * @param[out] state    The state, with a reference, or NULL
+ *
+ * @return NFS4_OK or an error.
+ */
+
+static nfsstat4 copy_check_stateid(compound_data_t *data,
+				   struct fsal_obj_handle *obj,
+				   stateid4 *stateid, bool write,
+				   const char *tag, state_t **state)
+{
+	state_t *state_found = NULL;
+	state_t *state_open;
+	uint32_t access = write ? OPEN4_SHARE_ACCESS_WRITE
+				: OPEN4_SHARE_ACCESS_READ;
+	nfsstat4 status;
+
+	*state = NULL;
+
+	status = nfs4_Check_Stateid(stateid, obj, &state_found, data,
+				    STATEID_SPECIAL_ANY, 0, false, tag);
+	if (status != NFS4_OK)
+		return status;
+
+	if (state_found == NULL) {
+		/* Anonymous stateid */
+		if (state_deleg_conflict(obj, write))
+			return NFS4ERR_DELAY;
+		return NFS4_OK;
+	}
+
+	switch (state_found->state_type) {
+	case STATE_TYPE_SHARE:
+		break;
+	case STATE_TYPE_LOCK:
+		state_open = state_found->state_data.lock.openstate;
+		inc_state_t_ref(state_open);
+		dec_state_t_ref(state_found);
+		state_found = state_open;
+		break;
+	case STATE_TYPE_DELEG:
+		if (write &&
+		    !(state_found->state_data.deleg.sd_type &
+		      OPEN_DELEGATE_WRITE)) {
+			status = NFS4ERR_BAD_STATEID;
+			goto out;
+		}
+		/* As with READ and WRITE, a delegation stateid only provides
+		 * ordering, so do the I/O without a state.
+		 */
+		dec_state_t_ref(state_found);
+		return NFS4_OK;
+	default:
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "%s with invalid stateid of type %d",
+			 tag, (int)state_found->state_type);
+		status = NFS4ERR_BAD_STATEID;
+		goto out;
+	}
+
+	if ((state_found->state_data.share.share_access & access) == 0) {
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "%s stateid doesn't have OPEN4_SHARE_ACCESS_%s",
+			 tag, write ? "WRITE" : "READ");
+		status = NFS4ERR_OPENMODE;
+		goto out;
+	}
+
+	*state = state_found;
+	return NFS4_OK;
+
+out:
+	dec_state_t_ref(state_found);
+	return status;
+}
+
+/**
+ * @brief Arguments common to COPY and CLONE, once checked
+ */
+
+struct copy_args {
+	struct fsal_obj_handle *src_obj;	/*< Saved object */
+	struct fsal_obj_handle *dst_obj;	/*< Current object */
+	state_t *src_state;	/*< Source state, may be NULL */
+	state_t *dst_state;	/*< Destination state, may be NULL */
+	uint64_t count;		/*< Length, with 0 resolved to EOF */
+};
+
+/**
+ * @brief Check the files, stateids, range and access for COPY or CLONE
+ *
+ * @param[in]  data        Compound request's data
+ * @param[in]  src_stateid Stateid for the saved filehandle
+ * @param[in]  dst_stateid Stateid for the current filehandle
+ * @param[in]  src_offset  Start of the source range
+ * @param[in]  dst_offset  Start of the destination range
+ * @param[in]  count       Length, 0 meaning to the end of the source
+ * @param[in]  tag         Name of the operation, for logging
+ * @param[out] args        The checked arguments, with references
+ *
+ * @return NFS4_OK or an error; on error no references are held.
+ */
+
+static nfsstat4 copy_prepare(compound_data_t *data,
+			     stateid4 *src_stateid, stateid4 *dst_stateid,
+			     uint64_t src_offset, uint64_t dst_offset,
+			     uint64_t count, const char *tag,
+			     struct copy_args *args)
+{
+	struct attrlist attrs;
+	fsal_status_t fsal_status;
+	nfsstat4 status;
+	uint64_t src_size;
+	uint64_t MaxOffsetWrite =
+		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
+
+	memset(args, 0, sizeof(*args));
+
+	status = nfs4_sanity_check_saved_FH(data, REGULAR_FILE, false);
+	if (status != NFS4_OK)
+		return status;
+
+	status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (status != NFS4_OK)
+		return status;
+
+	/* Intra-server copies only, and within one export so that one FSAL
+	 * does the copy.
+	 */
+	if (data->saved_export != op_ctx->ctx_export)
+		return NFS4ERR_XDEV;
+
+	args->src_obj = data->saved_obj;
+	args->dst_obj = data->current_obj;
+
+	fsal_prepare_attrs(&attrs, ATTR_SIZE);
+	fsal_status = args->src_obj->obj_ops->getattrs(args->src_obj, &attrs);
+	src_size = attrs.filesize;
+	fsal_release_attrs(&attrs);
+
+	if (FSAL_IS_ERROR(fsal_status))
+		return nfs4_Errno_status(fsal_status);
+
+	if (src_offset > src_size)
+		return NFS4ERR_INVAL;
+
+	if (count == 0)
+		count = src_size - src_offset;
+	else if (count > src_size - src_offset)
+		return NFS4ERR_INVAL;
+
+	if (dst_offset > UINT64_MAX - count)
+		return NFS4ERR_INVAL;
+
+	if (args->src_obj == args->dst_obj && count != 0 &&
+	    src_offset < dst_offset + count &&
+	    dst_offset < src_offset + count)
+		return NFS4ERR_INVAL;
+
+	if (MaxOffsetWrite < UINT64_MAX &&
+	    dst_offset + count > MaxOffsetWrite) {
+		LogEvent(COMPONENT_NFS_V4,
+			 "A client tried to violate max file size %"
+			 PRIu64 " for exportid #%hu",
+			 MaxOffsetWrite, op_ctx->ctx_export->export_id);
+		return NFS4ERR_FBIG;
+	}
+
+	args->count = count;
+
+	fsal_status = args->src_obj->obj_ops->test_access(args->src_obj,
+							  FSAL_READ_ACCESS,
+							  NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status))
+		return nfs4_Errno_status(fsal_status);
+
+	fsal_status = args->dst_obj->obj_ops->test_access(args->dst_obj,
+							  FSAL_WRITE_ACCESS,
+							  NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status))
+		return nfs4_Errno_status(fsal_status);
+
+	status = copy_check_stateid(data, args->src_obj, src_stateid, false,
+				    tag, &args->src_state);
+	if (status != NFS4_OK)
+		return status;
+
+	status = copy_check_stateid(data, args->dst_obj, dst_stateid, true,
+				    tag, &args->dst_state);
+	if (status != NFS4_OK) {
+		if (args->src_state != NULL)
+			dec_state_t_ref(args->src_state);
+		args->src_state = NULL;
+	}
+
+	return status;
+}
+
+/**
+ * @brief Drop the state references taken by copy_prepare
+ *
+ * @param[in] args  The checked arguments
+ */
+
+static void copy_args_release(struct copy_args *args)
+{
+	if (args->src_state != NULL)
+		dec_state_t_ref(args->src_state);
+
+	if (args->dst_state != NULL)
+		dec_state_t_ref(args->dst_state);
+}
+
+/**
+ * @brief Queue an asynchronous copy
+ *
+ * The references in args pass to the job.
+ *
+ * @param[in]  data        Compound request's data
+ * @param[in]  args        The checked arguments
+ * @param[in]  src_offset  Start of the source range
+ * @param[in]  dst_offset  Start of the destination range
+ * @param[out] stateid     The callback stateid for the copy
+ *
+ * @return NFS4_OK or an error; on error the references are still held.
+ */
+
+static nfsstat4 copy_start_async(compound_data_t *data,
+				 struct copy_args *args,
+				 uint64_t src_offset, uint64_t dst_offset,
+				 stateid4 *stateid)
+{
+	nfs_client_id_t *clientid = data->session->clientid_record;
+	struct copy_job *job;
+	int rc;
+
+	job = gsh_calloc(1, sizeof(struct copy_job));
+
+	job->stateid.seqid = 1;
+	nfs4_BuildStateId_Other(clientid, job->stateid.other);
+	job->clientid = clientid;
+	job->export = op_ctx->ctx_export;
+	job->src_obj = args->src_obj;
+	job->dst_obj = args->dst_obj;
+	job->src_state = args->src_state;
+	job->dst_state = args->dst_state;
+	job->src_offset = src_offset;
+	job->dst_offset = dst_offset;
+	job->count = args->count;
+
+	job->dst_fh.nfs_fh4_len = data->currentFH.nfs_fh4_len;
+	job->dst_fh.nfs_fh4_val = job->dst_fh_buf;
+	memcpy(job->dst_fh_buf, data->currentFH.nfs_fh4_val,
+	       data->currentFH.nfs_fh4_len);
+
+	/* Run the copy as the caller, not as root: keep copies of its
+	 * creds and export permissions, which go away with the request.
+	 */
+	job->creds = *op_ctx->creds;
+	if (job->creds.caller_glen != 0)
+		job->creds.caller_garray =
+			gsh_memdup(op_ctx->creds->caller_garray,
+				   job->creds.caller_glen * sizeof(gid_t));
+	else
+		job->creds.caller_garray = NULL;
+
+	job->export_perms = *op_ctx->export_perms;
+
+	job->req_ctx.creds = &job->creds;
+	job->req_ctx.clientid = &clientid->cid_clientid;
+	job->req_ctx.nfs_vers = op_ctx->nfs_vers;
+	job->req_ctx.nfs_minorvers = op_ctx->nfs_minorvers;
+	job->req_ctx.req_type = op_ctx->req_type;
+	job->req_ctx.client = op_ctx->client;
+	job->req_ctx.ctx_export = job->export;
+	job->req_ctx.fsal_export = job->export->fsal_export;
+	job->req_ctx.export_perms = &job->export_perms;
+	job->req_ctx.fsal_module = job->export->fsal_export->fsal;
+
+	if (job->req_ctx.client != NULL)
+		inc_gsh_client_refcount(job->req_ctx.client);
+	inc_client_id_ref(clientid);
+	get_gsh_export_ref(job->export);
+	job->src_obj->obj_ops->get_ref(job->src_obj);
+	job->dst_obj->obj_ops->get_ref(job->dst_obj);
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+	glist_add_tail(&copy_jobs, &job->list);
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	rc = fridgethr_submit(copy_fridge, copy_job_run, job);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Unable to queue copy, error %d", rc);
+
+		job->src_obj->obj_ops->put_ref(job->src_obj);
+		job->dst_obj->obj_ops->put_ref(job->dst_obj);
+		put_gsh_export(job->export);
+		copy_job_free(job);
+		return NFS4ERR_DELAY;
+	}
+
+	*stateid = job->stateid;
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief The NFS4_OP_COPY operation
+ *
+ * This functions handles the NFS4_OP_COPY operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.
+ *
+ * The saved filehandle is the source and the current filehandle the
+ * destination.  A copy is done synchronously unless the client allows an
+ * asynchronous one, in which case it is queued and reported with
+ * CB_OFFLOAD.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+
+int nfs4_op_copy(struct nfs_argop4 *op, compound_data_t *data,
+		 struct nfs_resop4 *resp)
+{
+	COPY4args * const arg_COPY4 = &op->nfs_argop4_u.opcopy;
+	COPY4res * const res_COPY4 = &resp->nfs_resop4_u.opcopy;
+	COPY4resok *resok = &res_COPY4->COPY4res_u.cr_resok4;
+	struct copy_args args;
+	fsal_status_t fsal_status = {0, 0};
+	struct gsh_buffdesc verf_desc;
+	uint64_t copied = 0, done;
+
+	resp->resop = NFS4_OP_COPY;
+
+	/* Inter-server copies need COPY_NOTIFY, which is not supported */
+	if (arg_COPY4->ca_source_server.ca_source_server_len != 0) {
+		res_COPY4->cr_status = NFS4ERR_NOTSUPP;
+		return res_COPY4->cr_status;
+	}
+
+	res_COPY4->cr_status = copy_prepare(data, &arg_COPY4->ca_src_stateid,
+					    &arg_COPY4->ca_dst_stateid,
+					    arg_COPY4->ca_src_offset,
+					    arg_COPY4->ca_dst_offset,
+					    arg_COPY4->ca_count, "COPY",
+					    &args);
+	if (res_COPY4->cr_status != NFS4_OK)
+		return res_COPY4->cr_status;
+
+	memset(resok, 0, sizeof(*resok));
+	resok->cr_requirements.cr_consecutive = true;
+
+	if (!arg_COPY4->ca_synchronous && args.count != 0 &&
+	    data->session != NULL && copy_fridge != NULL) {
+		res_COPY4->cr_status =
+			copy_start_async(data, &args,
+					 arg_COPY4->ca_src_offset,
+					 arg_COPY4->ca_dst_offset,
+					 &resok->cr_response.wr_callback_id);
+		if (res_COPY4->cr_status != NFS4_OK) {
+			copy_args_release(&args);
+			return res_COPY4->cr_status;
+		}
+
+		resok->cr_response.wr_ids = 1;
+		resok->cr_response.wr_committed = UNSTABLE4;
+		resok->cr_requirements.cr_synchronous = false;
+		goto verifier;
+	}
+
+	while (copied < args.count) {
+		fsal_status = args.dst_obj->obj_ops->copy_range2(
+				args.dst_obj, args.dst_state,
+				arg_COPY4->ca_dst_offset + copied,
+				args.src_obj, args.src_state,
+				arg_COPY4->ca_src_offset + copied,
+				args.count - copied, 0, &done);
+
+		if (FSAL_IS_ERROR(fsal_status) || done == 0)
+			break;
+
+		copied += done;
+	}
+
+	copy_args_release(&args);
+
+	/* A short copy is reported as such; only fail if nothing was done */
+	if (FSAL_IS_ERROR(fsal_status) && copied == 0) {
+		res_COPY4->cr_status = nfs4_Errno_status(fsal_status);
+		return res_COPY4->cr_status;
+	}
+
+	resok->cr_response.wr_count = copied;
+	resok->cr_response.wr_committed = UNSTABLE4;
+	resok->cr_requirements.cr_synchronous = true;
+
+verifier:
+	verf_desc.addr = resok->cr_response.wr_writeverf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+	return res_COPY4->cr_status;
+}
+
+/**
+ * @brief Free memory allocated for COPY result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+
+void nfs4_op_copy_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_CLONE operation
+ *
+ * This functions handles the NFS4_OP_CLONE operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.
+ *
+ * The range of the saved filehandle is made to share storage with the
+ * range of the current filehandle.  FSALs that can't do this return
+ * NFS4ERR_NOTSUPP.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+
+int nfs4_op_clone(struct nfs_argop4 *op, compound_data_t *data,
+		  struct nfs_resop4 *resp)
+{
+	CLONE4args * const arg_CLONE4 = &op->nfs_argop4_u.opclone;
+	CLONE4res * const res_CLONE4 = &resp->nfs_resop4_u.opclone;
+	struct copy_args args;
+	fsal_status_t fsal_status;
+	uint64_t done;
+
+	resp->resop = NFS4_OP_CLONE;
+
+	res_CLONE4->cl_status = copy_prepare(data, &arg_CLONE4->cl_src_stateid,
+					     &arg_CLONE4->cl_dst_stateid,
+					     arg_CLONE4->cl_src_offset,
+					     arg_CLONE4->cl_dst_offset,
+					     arg_CLONE4->cl_count, "CLONE",
+					     &args);
+	if (res_CLONE4->cl_status != NFS4_OK)
+		return res_CLONE4->cl_status;
+
+	if (args.count != 0) {
+		fsal_status = args.dst_obj->obj_ops->copy_range2(
+				args.dst_obj, args.dst_state,
+				arg_CLONE4->cl_dst_offset,
+				args.src_obj, args.src_state,
+				arg_CLONE4->cl_src_offset,
+				args.count, FSAL_COPY_CLONE, &done);
+
+		if (FSAL_IS_ERROR(fsal_status))
+			res_CLONE4->cl_status = nfs4_Errno_status(fsal_status);
+	}
+
+	copy_args_release(&args);
+
+	return res_CLONE4->cl_status;
+}
+
+/**
+ * @brief Free memory allocated for CLONE result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+
+void nfs4_op_clone_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_STATUS operation
+ *
+ * This functions handles the NFS4_OP_OFFLOAD_STATUS operation in NFSv4.2.
+ * This function can be called only from nfs4_Compound.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+
+int nfs4_op_offload_status(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_STATUS4args * const arg_OSTATUS4 =
+					&op->nfs_argop4_u.opoffload_status;
+	OFFLOAD_STATUS4res * const res_OSTATUS4 =
+					&resp->nfs_resop4_u.opoffload_status;
+	OFFLOAD_STATUS4resok *resok =
+				&res_OSTATUS4->OFFLOAD_STATUS4res_u.osr_resok4;
+	struct copy_job *job;
+
+	resp->resop = NFS4_OP_OFFLOAD_STATUS;
+
+	if (data->session == NULL) {
+		res_OSTATUS4->osr_status = NFS4ERR_BAD_STATEID;
+		return res_OSTATUS4->osr_status;
+	}
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+
+	job = copy_job_lookup(&arg_OSTATUS4->osa_stateid,
+			      data->session->clientid_record);
+
+	if (job == NULL) {
+		res_OSTATUS4->osr_status = NFS4ERR_BAD_STATEID;
+	} else {
+		res_OSTATUS4->osr_status = NFS4_OK;
+		resok->osr_count = job->copied;
+		resok->osr_complete_len = job->complete ? 1 : 0;
+		resok->osr_complete = job->status;
+	}
+
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	return res_OSTATUS4->osr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_STATUS result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+
+void nfs4_op_offload_status_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_CANCEL operation
+ *
+ * This functions handles the NFS4_OP_OFFLOAD_CANCEL operation in NFSv4.2.
+ * This function can be called only from nfs4_Compound.
+ *
+ * The copy stops at the end of the chunk in progress, and no CB_OFFLOAD
+ * is sent for it.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+
+int nfs4_op_offload_cancel(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_CANCEL4args * const arg_OCANCEL4 =
+					&op->nfs_argop4_u.opoffload_cancel;
+	OFFLOAD_CANCEL4res * const res_OCANCEL4 =
+					&resp->nfs_resop4_u.opoffload_cancel;
+	struct copy_job *job;
+
+	resp->resop = NFS4_OP_OFFLOAD_CANCEL;
+
+	if (data->session == NULL) {
+		res_OCANCEL4->ocr_status = NFS4ERR_BAD_STATEID;
+		return res_OCANCEL4->ocr_status;
+	}
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+
+	job = copy_job_lookup(&arg_OCANCEL4->oca_stateid,
+			      data->session->clientid_record);
+
+	if (job == NULL) {
+		res_OCANCEL4->ocr_status = NFS4ERR_BAD_STATEID;
+	} else if (job->complete) {
+		/* Too late, CB_OFFLOAD is on its way */
+		res_OCANCEL4->ocr_status = NFS4ERR_COMPLETE_ALREADY;
+	} else {
+		job->cancelled = true;
+		res_OCANCEL4->ocr_status = NFS4_OK;
+	}
+
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	return res_OCANCEL4->ocr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_CANCEL result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
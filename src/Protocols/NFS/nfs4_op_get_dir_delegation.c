@@ -0,0 +1,203 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs4_op_get_dir_delegation.c
+ * @brief Routines used for managing the NFS4 COMPOUND functions.
+ *
+ * Routines used for managing the NFS4 COMPOUND function
+ * GET_DIR_DELEGATION.
+ *
+ * A directory delegation lets the client trust its cached view of the
+ * directory until it is recalled.  Entry additions, removals and
+ * renames are sent to the holder in CB_NOTIFY when it asks for them,
+ * so they do not break the delegation; any other change recalls it.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "sal_functions.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "export_mgr.h"
+
+/** Notifications sent in CB_NOTIFY, as NOTIFY4_* bits */
+#define GDD_NOTIFY_TYPES ((1U << NOTIFY4_REMOVE_ENTRY) | \
+			  (1U << NOTIFY4_ADD_ENTRY) | \
+			  (1U << NOTIFY4_RENAME_ENTRY))
+
+/**
+ * @brief Check whether a directory delegation may be granted
+ *
+ * @param[in] data Compound request's data
+ */
+static bool dir_deleg_available(compound_data_t *data)
+{
+	if (!nfs_param.nfsv4_param.dir_delegations)
+		return false;
+
+	if (!(op_ctx->export_perms->options & EXPORT_OPTION_READ_DELEG))
+		return false;
+
+	/* CB_NOTIFY and CB_RECALL need a back channel */
+	if (data->session == NULL ||
+	    !(atomic_fetch_uint32_t(&data->session->flags) & session_bc_up))
+		return false;
+
+	return true;
+}
+
+/**
+ * @brief NFS4_OP_GET_DIR_DELEGATION
+ *
+ * This function implements the NFS4_OP_GET_DIR_DELEGATION operation.
+ * A delegation that cannot be granted is reported with the non-fatal
+ * GDD4_UNAVAIL; Ganesha never signals that one became available.
+ *
+ * @param[in]     op   Arguments for nfs4_op
+ * @param[in,out] data Compound request's data
+ * @param[out]    resp Results for nfs4_op
+ *
+ * @return per RFC5661, p. 377
+ */
+int nfs4_op_get_dir_delegation(struct nfs_argop4 *op, compound_data_t *data,
+			       struct nfs_resop4 *resp)
+{
+	GET_DIR_DELEGATION4args * const arg_GDD4 =
+	    &op->nfs_argop4_u.opget_dir_delegation;
+	GET_DIR_DELEGATION4res * const res_GDD4 =
+	    &resp->nfs_resop4_u.opget_dir_delegation;
+	GET_DIR_DELEGATION4res_non_fatal *res_nf =
+	    &res_GDD4->GET_DIR_DELEGATION4res_u.gddr_res_non_fatal4;
+	GET_DIR_DELEGATION4resok *resok =
+	    &res_nf->GET_DIR_DELEGATION4res_non_fatal_u.gddrnf_resok4;
+	struct fsal_obj_handle *dir;
+	state_owner_t *clientowner;
+	union state_data state_data;
+	struct state_refer refer;
+	struct glist_head *glist;
+	state_t *state = NULL;
+	state_t *new_state = NULL;
+	state_status_t state_status;
+	uint32_t notify_types = 0;
+
+	resp->resop = NFS4_OP_GET_DIR_DELEGATION;
+
+	res_GDD4->gddr_status = nfs4_sanity_check_FH(data, DIRECTORY, false);
+
+	if (res_GDD4->gddr_status != NFS4_OK)
+		return res_GDD4->gddr_status;
+
+	if (!dir_deleg_available(data))
+		goto unavail;
+
+	dir = data->current_obj;
+	clientowner = &data->session->clientid_record->cid_owner;
+
+	if (arg_GDD4->gdda_notification_types.bitmap4_len > 0)
+		notify_types = arg_GDD4->gdda_notification_types.map[0] &
+			       GDD_NOTIFY_TYPES;
+
+	/* Record the sequence info */
+	memcpy(refer.session, data->session->session_id, sizeof(sessionid4));
+	refer.sequence = data->sequence;
+	refer.slot = data->slot;
+
+	STATELOCK_wrlock(dir->state_hdl);
+
+	/* A client asking again gets the delegation it already holds */
+	glist_for_each(glist, &dir->state_hdl->dir.list_of_states) {
+		state_t *cur = glist_entry(glist, state_t, state_list);
+
+		if (cur->state_type == STATE_TYPE_DELEG &&
+		    cur->state_owner == clientowner &&
+		    cur->state_data.deleg.sd_state == DELEG_GRANTED) {
+			state = cur;
+			state->state_data.deleg.sd_notify_types = notify_types;
+			break;
+		}
+	}
+
+	if (state == NULL) {
+		init_new_dir_deleg_state(&state_data, notify_types);
+
+		state_status = state_add_impl(dir, STATE_TYPE_DELEG,
+					      &state_data, clientowner,
+					      &new_state, &refer);
+		if (state_status != STATE_SUCCESS) {
+			STATELOCK_unlock(dir->state_hdl);
+			LogDebug(COMPONENT_NFS_V4_LOCK,
+				 "GET_DIR_DELEGATION failed to add state with status %s",
+				 state_err_str(state_status));
+			goto unavail;
+		}
+
+		new_state->state_seqid++;
+		state = new_state;
+		dir_deleg_stats_granted();
+	}
+
+	COPY_STATEID(&resok->gddr_stateid, state);
+
+	STATELOCK_unlock(dir->state_hdl);
+
+	if (new_state != NULL)
+		dec_state_t_ref(new_state);
+
+	LogFullDebugOpaque(COMPONENT_STATE,
+			   "directory delegation granted, stateid: %s",
+			   100, resok->gddr_stateid.other, OTHERSIZE);
+
+	res_nf->gddrnf_status = GDD4_OK;
+
+	/* Cookies are not kept stable across changes, so READDIR
+	 * verifiers are not offered, nor attribute notifications.
+	 */
+	memset(resok->gddr_cookieverf, 0, NFS4_VERIFIER_SIZE);
+	resok->gddr_notification.bitmap4_len = 1;
+	resok->gddr_notification.map[0] = notify_types;
+	resok->gddr_child_attributes.bitmap4_len = 0;
+	resok->gddr_dir_attributes.bitmap4_len = 0;
+
+	return res_GDD4->gddr_status;
+
+ unavail:
+	res_nf->gddrnf_status = GDD4_UNAVAIL;
+	res_nf->GET_DIR_DELEGATION4res_non_fatal_u.gddrnf_signal = false;
+
+	return res_GDD4->gddr_status;
+}
+
+/**
+ * @brief Free memory allocated for GET_DIR_DELEGATION result
+ *
+ * This function frees any memory allocated for the result of the
+ * NFS4_OP_GET_DIR_DELEGATION operation.
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_get_dir_delegation_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
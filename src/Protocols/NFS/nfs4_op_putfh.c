@@ -262,10 +262,6 @@ int nfs4_op_putfh(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_PUTFH4->status != NFS4_OK)
 		return res_PUTFH4->status;
 
-	/* If no currentFH were set, allocate one */
-	if (data->currentFH.nfs_fh4_val == NULL)
-		nfs4_AllocateFH(&data->currentFH);
-
 	/* Copy the filehandle from the arg structure */
 	data->currentFH.nfs_fh4_len = arg_PUTFH4->object.nfs_fh4_len;
 	memcpy(data->currentFH.nfs_fh4_val, arg_PUTFH4->object.nfs_fh4_val,
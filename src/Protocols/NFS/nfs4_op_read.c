@@ -51,11 +51,27 @@
 struct nfs4_read_data {
 	READ4res *res_READ4;		/**< Results for read */
 	state_owner_t *owner;		/**< Owner of state */
+	state_t *state_found;		/**< State the read is done under */
+	state_t *state_open;		/**< Open state of state_found */
+	struct fsal_obj_handle *obj;	/**< Object being read */
+	fsal_status_t ret;		/**< Status of the read */
+	request_data_t *reqdata;	/**< Request to resume, NULL if the
+					     read can't be suspended */
+	uint32_t flags;			/**< NFS_ASYNC_* flags */
+	pthread_mutex_t mtx;		/**< Protects flags when the read
+					     can't be suspended */
+	pthread_cond_t cond;		/**< Signals the read is done when it
+					     can't be suspended */
+	struct fsal_io_arg *read_arg;	/**< Read arguments, allocated with
+					     this structure */
 };
 
 /**
  * @brief Callback for NFS4 read done
  *
+ * Saves the result and lets the thread that issued the read, or the
+ * request once resumed, finish the operation.
+ *
  * @param[in] obj		Object being acted on
  * @param[in] ret		Return status of call
  * @param[in] read_data		Data for read call
@@ -65,7 +81,35 @@ static void nfs4_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 			  void *read_data, void *caller_data)
 {
 	struct nfs4_read_data *data = caller_data;
-	struct fsal_io_arg *read_arg = read_data;
+
+	data->ret = ret;
+
+	if (data->reqdata != NULL) {
+		nfs_req_async_done(data->reqdata, &data->flags);
+		return;
+	}
+
+	PTHREAD_MUTEX_lock(&data->mtx);
+	data->flags |= NFS_ASYNC_DONE;
+	pthread_cond_signal(&data->cond);
+	PTHREAD_MUTEX_unlock(&data->mtx);
+}
+
+/**
+ * @brief Build the READ result once the FSAL read is done
+ *
+ * Releases what the read held on to and frees @a data.
+ *
+ * @param[in] data	Read data
+ *
+ * @return The status of the READ.
+ */
+static int nfs4_complete_read(struct nfs4_read_data *data)
+{
+	struct fsal_io_arg *read_arg = data->read_arg;
+	struct fsal_obj_handle *obj = data->obj;
+	fsal_status_t ret = data->ret;
+	nfsstat4 status;
 	int i;
 
 	/* Fixup FSAL_SHARE_DENIED status */
@@ -124,6 +168,40 @@ done:
 	server_stats_io_done(read_arg->iov[0].iov_len, read_arg->io_amount,
 			     (data->res_READ4->status == NFS4_OK) ? true :
 			     false, false);
+
+	if (data->state_open != NULL)
+		dec_state_t_ref(data->state_open);
+
+	if (data->owner != NULL) {
+		op_ctx->clientid = NULL;
+		dec_state_owner_ref(data->owner);
+	}
+
+	if (data->state_found != NULL)
+		dec_state_t_ref(data->state_found);
+
+	if (data->reqdata == NULL) {
+		PTHREAD_COND_destroy(&data->cond);
+		PTHREAD_MUTEX_destroy(&data->mtx);
+	}
+
+	status = data->res_READ4->status;
+	gsh_free(data);
+
+	return status;
+}
+
+/**
+ * @brief Finish a READ that suspended the COMPOUND
+ *
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return The status of the READ.
+ */
+static int nfs4_read_resume(compound_data_t *data, struct nfs_resop4 *resp)
+{
+	return nfs4_complete_read(data->op_data);
 }
 
 /**
@@ -290,9 +368,8 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	bool anonymous_started = false;
 	state_owner_t *owner = NULL;
 	bool bypass = false;
-	struct nfs4_read_data read_data;
-	struct fsal_io_arg *read_arg = alloca(sizeof(*read_arg) +
-						sizeof(struct iovec));
+	struct nfs4_read_data *read_data;
+	struct fsal_io_arg *read_arg;
 	uint32_t resp_size;
 
 	/* Say we are managing NFS4_OP_READ */
@@ -330,7 +407,7 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		struct state_deleg *sdeleg;
 
 		if (info)
-			info->io_advise = state_found->state_data.io_advise;
+			info->io_advise = state_found->state_io_advise;
 		switch (state_found->state_type) {
 		case STATE_TYPE_SHARE:
 			state_open = state_found;
@@ -545,9 +622,17 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
+	/* The read may complete on another thread after we return, so
+	 * everything it uses lives on the heap.
+	 */
+	read_data = gsh_calloc(1, sizeof(*read_data) + sizeof(*read_arg) +
+				  sizeof(struct iovec));
+	read_arg = (struct fsal_io_arg *)(read_data + 1);
+
 	/* Set up args */
 	read_arg->info = info;
 	read_arg->state = state_found;
+	read_arg->attrs_out = NULL;
 	read_arg->offset = offset;
 	read_arg->iov_count = 1;
 	read_arg->iov[0].iov_len = size;
@@ -555,11 +640,43 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	read_arg->io_amount = 0;
 	read_arg->end_of_file = false;
 
-	read_data.res_READ4 = res_READ4;
-	read_data.owner = owner;
+	read_data->res_READ4 = res_READ4;
+	read_data->owner = owner;
+	read_data->state_found = state_found;
+	read_data->state_open = state_open;
+	read_data->obj = obj;
+	read_data->read_arg = read_arg;
+
+	/* READ_PLUS hands us its io_info on the stack, so only READ can
+	 * suspend the COMPOUND.  READ_PLUS waits for the read instead.
+	 */
+	if (info == NULL) {
+		read_data->reqdata = nfs_req_from_svc(data->req);
+	} else {
+		PTHREAD_MUTEX_init(&read_data->mtx, NULL);
+		PTHREAD_COND_init(&read_data->cond, NULL);
+	}
 
 	/* Do the actual read */
-	obj->obj_ops->read2(obj, bypass, nfs4_read_cb, read_arg, &read_data);
+	obj->obj_ops->read2(obj, bypass, nfs4_read_cb, read_arg, read_data);
+
+	if (read_data->reqdata == NULL) {
+		PTHREAD_MUTEX_lock(&read_data->mtx);
+		while (!(read_data->flags & NFS_ASYNC_DONE))
+			pthread_cond_wait(&read_data->cond, &read_data->mtx);
+		PTHREAD_MUTEX_unlock(&read_data->mtx);
+	} else {
+		data->op_resume = nfs4_read_resume;
+		data->op_data = read_data;
+
+		if (nfs_req_suspend(read_data->reqdata, &read_data->flags))
+			return NFS4_OP_ASYNC_WAIT;
+
+		data->op_resume = NULL;
+		data->op_data = NULL;
+	}
+
+	return nfs4_complete_read(read_data);
 
  out:
 	if (state_open != NULL)
@@ -736,13 +853,14 @@ int nfs4_op_io_advise(struct nfs_argop4 *op, compound_data_t *data,
 		hints.offset = arg_IO_ADVISE->iaa_offset;
 		hints.count = arg_IO_ADVISE->iaa_count;
 
-		fsal_status = obj->obj_ops->io_advise(obj, &hints);
+		fsal_status = obj->obj_ops->io_advise2(obj, state_found,
+							&hints);
 		if (FSAL_IS_ERROR(fsal_status)) {
 			res_IO_ADVISE->iaa_status = NFS4ERR_NOTSUPP;
 			goto done;
 		}
 		/* save hints to use with other operations */
-		state_found->state_data.io_advise = hints.hints;
+		state_found->state_io_advise = hints.hints;
 
 		res_IO_ADVISE->iaa_status = NFS4_OK;
 		res_IO_ADVISE->iaa_hints.bitmap4_len = 1;
@@ -810,7 +928,7 @@ int nfs4_op_seek(struct nfs_argop4 *op, compound_data_t *data,
 		goto done;
 
 	if (state_found != NULL) {
-		info.io_advise = state_found->state_data.io_advise;
+		info.io_advise = state_found->state_io_advise;
 		info.io_content.what = arg_SEEK->sa_what;
 
 		if (arg_SEEK->sa_what == NFS4_CONTENT_DATA ||
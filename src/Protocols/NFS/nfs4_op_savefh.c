@@ -77,10 +77,6 @@ int nfs4_op_savefh(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_SAVEFH->status != NFS4_OK)
 		return res_SAVEFH->status;
 
-	/* If the savefh is not allocated, do it now */
-	if (data->savedFH.nfs_fh4_val == NULL)
-		nfs4_AllocateFH(&data->savedFH);
-
 	/* Determine if we can get a new export reference. If there is
 	 * no op_ctx->ctx_export, don't get a reference.
 	 */
@@ -47,11 +47,26 @@
 struct nfs4_write_data {
 	WRITE4res *res_WRITE4;		/**< Results for write */
 	state_owner_t *owner;		/**< Owner of state */
+	state_t *state_found;		/**< State the write is done under */
+	state_t *state_open;		/**< Open state of state_found */
+	fsal_status_t ret;		/**< Status of the write */
+	request_data_t *reqdata;	/**< Request to resume, NULL if the
+					     write can't be suspended */
+	uint32_t flags;			/**< NFS_ASYNC_* flags */
+	pthread_mutex_t mtx;		/**< Protects flags when the write
+					     can't be suspended */
+	pthread_cond_t cond;		/**< Signals the write is done when it
+					     can't be suspended */
+	struct fsal_io_arg *write_arg;	/**< Write arguments, allocated with
+					     this structure */
 };
 
 /**
  * @brief Callback for NFS4 write done
  *
+ * Saves the result and lets the thread that issued the write, or the
+ * request once resumed, finish the operation.
+ *
  * @param[in] obj		Object being acted on
  * @param[in] ret		Return status of call
  * @param[in] write_data		Data for write call
@@ -61,8 +76,35 @@ static void nfs4_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 			  void *write_data, void *caller_data)
 {
 	struct nfs4_write_data *data = caller_data;
-	struct fsal_io_arg *write_arg = write_data;
+
+	data->ret = ret;
+
+	if (data->reqdata != NULL) {
+		nfs_req_async_done(data->reqdata, &data->flags);
+		return;
+	}
+
+	PTHREAD_MUTEX_lock(&data->mtx);
+	data->flags |= NFS_ASYNC_DONE;
+	pthread_cond_signal(&data->cond);
+	PTHREAD_MUTEX_unlock(&data->mtx);
+}
+
+/**
+ * @brief Build the WRITE result once the FSAL write is done
+ *
+ * Releases what the write held on to and frees @a data.
+ *
+ * @param[in] data	Write data
+ *
+ * @return The status of the WRITE.
+ */
+static int nfs4_complete_write(struct nfs4_write_data *data)
+{
+	struct fsal_io_arg *write_arg = data->write_arg;
+	fsal_status_t ret = data->ret;
 	struct gsh_buffdesc verf_desc;
+	nfsstat4 status;
 
 	/* Fixup ERR_FSAL_SHARE_DENIED status */
 	if (ret.major == ERR_FSAL_SHARE_DENIED)
@@ -91,6 +133,40 @@ done:
 	server_stats_io_done(write_arg->iov[0].iov_len, write_arg->io_amount,
 			     (data->res_WRITE4->status == NFS4_OK) ? true :
 			     false, true /*is_write*/);
+
+	if (data->state_open != NULL)
+		dec_state_t_ref(data->state_open);
+
+	if (data->owner != NULL) {
+		op_ctx->clientid = NULL;
+		dec_state_owner_ref(data->owner);
+	}
+
+	if (data->state_found != NULL)
+		dec_state_t_ref(data->state_found);
+
+	if (data->reqdata == NULL) {
+		PTHREAD_COND_destroy(&data->cond);
+		PTHREAD_MUTEX_destroy(&data->mtx);
+	}
+
+	status = data->res_WRITE4->status;
+	gsh_free(data);
+
+	return status;
+}
+
+/**
+ * @brief Finish a WRITE that suspended the COMPOUND
+ *
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return The status of the WRITE.
+ */
+static int nfs4_write_resume(compound_data_t *data, struct nfs_resop4 *resp)
+{
+	return nfs4_complete_write(data->op_data);
 }
 
 /**
@@ -216,9 +292,8 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	uint64_t MaxOffsetWrite =
 		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
 	bool force_sync = op_ctx->export_perms->options & EXPORT_OPTION_COMMIT;
-	struct nfs4_write_data write_data;
-	struct fsal_io_arg *write_arg = alloca(sizeof(*write_arg) +
-						sizeof(struct iovec));
+	struct nfs4_write_data *write_data;
+	struct fsal_io_arg *write_arg;
 
 	/* Lock are not supported */
 	resp->resop = NFS4_OP_WRITE;
@@ -278,7 +353,7 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		struct state_deleg *sdeleg;
 
 		if (info)
-			info->io_advise = state_found->state_data.io_advise;
+			info->io_advise = state_found->state_io_advise;
 		switch (state_found->state_type) {
 		case STATE_TYPE_SHARE:
 			state_open = state_found;
@@ -432,9 +507,18 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
+	/* The write may complete on another thread after we return, so
+	 * everything it uses lives on the heap.  The data to write is in
+	 * the request arguments, which live as long as the request.
+	 */
+	write_data = gsh_calloc(1, sizeof(*write_data) + sizeof(*write_arg) +
+				   sizeof(struct iovec));
+	write_arg = (struct fsal_io_arg *)(write_data + 1);
+
 	/* Set up args */
 	write_arg->info = info;
 	write_arg->state = state_found;
+	write_arg->attrs_out = NULL;
 	write_arg->offset = offset;
 	write_arg->iov_count = 1;
 	write_arg->iov[0].iov_len = size;
@@ -446,11 +530,42 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		write_arg->fsal_stable = false;
 
 
-	write_data.res_WRITE4 = res_WRITE4;
-	write_data.owner = owner;
+	write_data->res_WRITE4 = res_WRITE4;
+	write_data->owner = owner;
+	write_data->state_found = state_found;
+	write_data->state_open = state_open;
+	write_data->write_arg = write_arg;
+
+	/* Only a plain WRITE can suspend the COMPOUND, anything passing
+	 * an io_info waits for the write instead.
+	 */
+	if (info == NULL) {
+		write_data->reqdata = nfs_req_from_svc(data->req);
+	} else {
+		PTHREAD_MUTEX_init(&write_data->mtx, NULL);
+		PTHREAD_COND_init(&write_data->cond, NULL);
+	}
 
 	/* Do the actual write */
-	obj->obj_ops->write2(obj, false, nfs4_write_cb, write_arg, &write_data);
+	obj->obj_ops->write2(obj, false, nfs4_write_cb, write_arg, write_data);
+
+	if (write_data->reqdata == NULL) {
+		PTHREAD_MUTEX_lock(&write_data->mtx);
+		while (!(write_data->flags & NFS_ASYNC_DONE))
+			pthread_cond_wait(&write_data->cond, &write_data->mtx);
+		PTHREAD_MUTEX_unlock(&write_data->mtx);
+	} else {
+		data->op_resume = nfs4_write_resume;
+		data->op_data = write_data;
+
+		if (nfs_req_suspend(write_data->reqdata, &write_data->flags))
+			return NFS4_OP_ASYNC_WAIT;
+
+		data->op_resume = NULL;
+		data->op_data = NULL;
+	}
+
+	return nfs4_complete_write(write_data);
 
  out:
 
@@ -511,19 +626,188 @@ void nfs4_op_write_Free(nfs_resop4 *resp)
  * This functions handles the NFS4_OP_WRITE_SAME operation in NFSv4.2. This
  * function can be called only from nfs4_Compound.
  *
+ * The blocks are built by the FSAL, which can zero a range without
+ * writing it or replicate a pattern without it crossing the wire.  The
+ * write may be short by whole blocks, as reported in wr_count.
+ *
  * @param[in]     op    Arguments for nfs4_op
  * @param[in,out] data  Compound request's data
  * @param[out]    resp  Results for nfs4_op
  *
+ * @return per RFC7862, p. 79
  */
 
 int nfs4_op_write_same(struct nfs_argop4 *op, compound_data_t *data,
 		  struct nfs_resop4 *resp)
 {
+	WRITE_SAME4args * const arg_WSAME = &op->nfs_argop4_u.opwrite_plus;
 	WRITE_SAME4res * const res_WSAME = &resp->nfs_resop4_u.opwrite_plus;
+	write_response4 *resok = &res_WSAME->wpr_resok4;
+	app_data_block4 *adb = &arg_WSAME->wp_adb;
+	struct fsal_write_same_arg ws_arg;
+	fsal_status_t fsal_status = {0, 0};
+	struct fsal_obj_handle *obj;
+	struct gsh_buffdesc verf_desc;
+	state_t *state_found = NULL;
+	state_t *state = NULL;
+	uint64_t size;
+	uint64_t MaxOffsetWrite =
+		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
+	bool force_sync = op_ctx->export_perms->options & EXPORT_OPTION_COMMIT;
 
 	resp->resop = NFS4_OP_WRITE_SAME;
-	res_WSAME->wpr_status =  NFS4ERR_NOTSUPP;
+	res_WSAME->wpr_status = NFS4_OK;
+
+	res_WSAME->wpr_status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (res_WSAME->wpr_status != NFS4_OK)
+		return res_WSAME->wpr_status;
+
+	/* A block must hold something, and the range must be addressable */
+	if (adb->adb_block_size == 0 ||
+	    adb->adb_block_count > UINT64_MAX / adb->adb_block_size) {
+		res_WSAME->wpr_status = NFS4ERR_INVAL;
+		return res_WSAME->wpr_status;
+	}
+
+	size = adb->adb_block_size * adb->adb_block_count;
+
+	if (size > UINT64_MAX - adb->adb_offset) {
+		res_WSAME->wpr_status = NFS4ERR_INVAL;
+		return res_WSAME->wpr_status;
+	}
+
+	fsal_status = op_ctx->fsal_export->exp_ops.check_quota(
+						op_ctx->fsal_export,
+						op_ctx->ctx_export->fullpath,
+						FSAL_QUOTA_BLOCKS);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_WSAME->wpr_status = NFS4ERR_DQUOT;
+		return res_WSAME->wpr_status;
+	}
+
+	obj = data->current_obj;
+
+	/* Check stateid correctness and get pointer to state
+	 * (also checks for special stateids)
+	 */
+	res_WSAME->wpr_status = nfs4_Check_Stateid(&arg_WSAME->wp_stateid,
+						   obj, &state_found, data,
+						   STATEID_SPECIAL_ANY, 0,
+						   false, "WRITE_SAME");
+	if (res_WSAME->wpr_status != NFS4_OK)
+		return res_WSAME->wpr_status;
+
+	if (state_found != NULL) {
+		switch (state_found->state_type) {
+		case STATE_TYPE_SHARE:
+			state = state_found;
+			inc_state_t_ref(state);
+			break;
+
+		case STATE_TYPE_LOCK:
+			state = state_found->state_data.lock.openstate;
+			inc_state_t_ref(state);
+			break;
+
+		case STATE_TYPE_DELEG:
+			/* As with WRITE, a delegation only provides ordering */
+			if (!(state_found->state_data.deleg.sd_type &
+			      OPEN_DELEGATE_WRITE)) {
+				res_WSAME->wpr_status = NFS4ERR_BAD_STATEID;
+				goto out;
+			}
+			break;
+
+		default:
+			LogDebug(COMPONENT_NFS_V4_LOCK,
+				 "WRITE_SAME with invalid stateid of type %d",
+				 (int)state_found->state_type);
+			res_WSAME->wpr_status = NFS4ERR_BAD_STATEID;
+			goto out;
+		}
+
+		if (state != NULL &&
+		    (state->state_data.share.share_access &
+		     OPEN4_SHARE_ACCESS_WRITE) == 0) {
+			LogDebug(COMPONENT_NFS_V4_LOCK,
+				 "WRITE_SAME stateid doesn't have OPEN4_SHARE_ACCESS_WRITE");
+			res_WSAME->wpr_status = NFS4ERR_OPENMODE;
+			goto out;
+		}
+	} else if (state_deleg_conflict(obj, true)) {
+		res_WSAME->wpr_status = NFS4ERR_DELAY;
+		goto out;
+	}
+
+	fsal_status = obj->obj_ops->test_access(obj, FSAL_WRITE_ACCESS,
+					       NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_WSAME->wpr_status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	if (MaxOffsetWrite < UINT64_MAX &&
+	    adb->adb_offset + size > MaxOffsetWrite) {
+		LogEvent(COMPONENT_NFS_V4,
+			 "A client tried to violate max file size %" PRIu64
+			 " for exportid #%hu",
+			 MaxOffsetWrite, op_ctx->ctx_export->export_id);
+		res_WSAME->wpr_status = NFS4ERR_FBIG;
+		goto out;
+	}
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "offset = %" PRIu64 " block_size = %" PRIu64
+		     " block_count = %" PRIu64 " pattern length = %u"
+		     " stable = %d",
+		     adb->adb_offset, adb->adb_block_size,
+		     adb->adb_block_count, adb->adb_data.data_len,
+		     arg_WSAME->wp_stable);
+
+	memset(&ws_arg, 0, sizeof(ws_arg));
+	ws_arg.offset = adb->adb_offset;
+	ws_arg.block_size = adb->adb_block_size;
+	ws_arg.block_count = adb->adb_block_count;
+	ws_arg.reloff_blocknum = adb->adb_reloff_blocknum;
+	ws_arg.block_num = adb->adb_block_num;
+	ws_arg.reloff_pattern = adb->adb_reloff_pattern;
+	ws_arg.pattern.addr = adb->adb_data.data_val;
+	ws_arg.pattern.len = adb->adb_data.data_len;
+	ws_arg.fsal_stable = arg_WSAME->wp_stable != UNSTABLE4 || force_sync;
+
+	if (size != 0) {
+		fsal_status = obj->obj_ops->write_same2(obj, state, &ws_arg);
+
+		/* Fixup ERR_FSAL_SHARE_DENIED status */
+		if (fsal_status.major == ERR_FSAL_SHARE_DENIED)
+			fsal_status = fsalstat(ERR_FSAL_LOCKED, 0);
+
+		server_stats_io_done(size, ws_arg.io_amount,
+				     !FSAL_IS_ERROR(fsal_status), true);
+
+		if (FSAL_IS_ERROR(fsal_status)) {
+			res_WSAME->wpr_status = nfs4_Errno_status(fsal_status);
+			goto out;
+		}
+	}
+
+	resok->wr_ids = 0;
+	memset(&resok->wr_callback_id, 0, sizeof(resok->wr_callback_id));
+	resok->wr_count = ws_arg.io_amount;
+	resok->wr_committed = ws_arg.fsal_stable ? FILE_SYNC4 : UNSTABLE4;
+
+	verf_desc.addr = resok->wr_writeverf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+ out:
+
+	if (state != NULL)
+		dec_state_t_ref(state);
+
+	if (state_found != NULL)
+		dec_state_t_ref(state_found);
 
 	return res_WSAME->wpr_status;
 }
@@ -443,32 +443,73 @@ bool pseudo_mount_export(struct gsh_export *export)
 	return true;
 }
 
+/**
+ * @brief export_run_parallel callback mounting an export in the PseudoFS
+ */
+static bool pseudo_mount_cb(struct gsh_export *export, void *state)
+{
+	struct root_op_context root_op_context;
+	bool rc;
+
+	/* Initialize a root context */
+	init_root_op_context(&root_op_context, NULL, NULL,
+			     NFS_V4, 0, NFS_REQUEST);
+
+	rc = pseudo_mount_export(export);
+
+	release_root_op_context();
+
+	return rc;
+}
+
 /**
  * @brief Build a pseudo fs from an exportlist
  *
  * foreach through the exports to create pseudofs entries.
  *
+ * Each export is mounted on the export whose pseudo path is the longest
+ * prefix of its own, whether or not that one is mounted yet, so exports
+ * can be mounted in any order and are mounted in parallel.  Concurrent
+ * creation of the same PseudoFS directory is resolved by
+ * make_pseudofs_node() looking it up again.
+ *
  * @return status as errno (0 == SUCCESS).
  */
 
 void create_pseudofs(void)
 {
-	struct root_op_context root_op_context;
+	struct gsh_export **exports = NULL;
 	struct gsh_export *export;
-
-	/* Initialize a root context */
-	init_root_op_context(&root_op_context, NULL, NULL,
-			     NFS_V4, 0, NFS_REQUEST);
+	uint32_t count = 0, size = 0, i;
+	bool *ok;
 
 	while (true) {
 		export = export_take_mount_work();
 		if (export == NULL)
 			break;
-		if (!pseudo_mount_export(export))
+		if (count == size) {
+			size = size == 0 ? 64 : size * 2;
+			exports = gsh_realloc(exports,
+					      size * sizeof(*exports));
+		}
+		exports[count++] = export;
+	}
+
+	if (count == 0)
+		return;
+
+	ok = gsh_calloc(count, sizeof(*ok));
+
+	export_run_parallel(exports, ok, count, pseudo_mount_cb, NULL);
+
+	for (i = 0; i < count; i++) {
+		if (!ok[i])
 			LogFatal(COMPONENT_EXPORT,
 				 "Could not complete creating PseudoFS");
 	}
-	release_root_op_context();
+
+	gsh_free(ok);
+	gsh_free(exports);
 }
 
 /**
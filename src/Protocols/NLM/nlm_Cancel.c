@@ -143,7 +143,7 @@ static void nlm4_cancel_message_resp(state_async_queue_t *arg)
 			     "Calling nlm_send_async cookie=%s status=%s",
 			     buffer, lock_result_str(res->res_nlm4.stat.stat));
 	}
-	nlm_send_async(NLMPROC4_CANCEL_RES, nlm_arg->nlm_async_host, res, NULL);
+	nlm_send_async(NLMPROC4_CANCEL_RES, nlm_arg->nlm_async_host, res, 0);
 	nlm4_Cancel_Free(res);
 	dec_nsm_client_ref(nlm_arg->nlm_async_host->slc_nsm_client);
 	dec_nlm_client_ref(nlm_arg->nlm_async_host);
@@ -47,6 +47,7 @@ int nlm4_Granted_Res(nfs_arg_t *args, struct svc_req *req, nfs_res_t *res)
 	char buffer[1024] = "\0";
 	state_status_t state_status = STATE_SUCCESS;
 	state_cookie_entry_t *cookie_entry;
+	state_nlm_client_t *host;
 
 	netobj_to_string(&arg->cookie, buffer, 1024);
 	LogDebug(COMPONENT_NLM,
@@ -65,6 +66,17 @@ int nlm4_Granted_Res(nfs_arg_t *args, struct svc_req *req, nfs_res_t *res)
 		return NFS_REQ_OK;
 	}
 
+	/* Whatever the answer, the call is over: free its slot before the
+	 * cookie entry can go.  The lock entry, and through its owner the
+	 * client, outlive the cookie entry.
+	 */
+	if (cookie_entry->sce_lock_entry != NULL) {
+		host = cookie_entry->sce_lock_entry->sle_owner
+				->so_owner.so_nlm_owner.so_client;
+		nlm_signal_async_resp(host,
+				      nlm_granted_cookie_seq(&arg->cookie));
+	}
+
 	if (cookie_entry->sce_lock_entry == NULL
 	    || cookie_entry->sce_lock_entry->sle_block_data == NULL) {
 		/* This must be an old NLM_GRANTED_RES */
@@ -99,7 +111,6 @@ int nlm4_Granted_Res(nfs_arg_t *args, struct svc_req *req, nfs_res_t *res)
 		}
 	} else {
 		state_complete_grant(cookie_entry);
-		nlm_signal_async_resp(cookie_entry);
 	}
 
 	return NFS_REQ_OK;
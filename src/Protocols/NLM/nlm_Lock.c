@@ -173,6 +173,10 @@ int nlm4_Lock(nfs_arg_t *args, struct svc_req *req, nfs_res_t *res)
 		res->res_nlm4.stat.stat =
 				nlm_convert_state_error(state_status);
 
+		/* A GRANTED_MSG will follow, connect back now */
+		if (state_status == STATE_LOCK_BLOCKED)
+			nlm_async_prewarm(nlm_client);
+
 		if (state_status == STATE_IN_GRACE) {
 			res->res_nlm4.stat.stat = NLM4_DENIED_GRACE_PERIOD;
 			goto out_ok;
@@ -224,7 +228,7 @@ static void nlm4_lock_message_resp(state_async_queue_t *arg)
 			     buffer, lock_result_str(res->res_nlm4.stat.stat));
 	}
 
-	nlm_send_async(NLMPROC4_LOCK_RES, nlm_arg->nlm_async_host, res, NULL);
+	nlm_send_async(NLMPROC4_LOCK_RES, nlm_arg->nlm_async_host, res, 0);
 
 	nlm4_Lock_Free(res);
 	dec_nsm_client_ref(nlm_arg->nlm_async_host->slc_nsm_client);
@@ -170,7 +170,7 @@ static void nlm4_test_message_resp(state_async_queue_t *arg)
 			     buffer,
 			     lock_result_str(res->res_nlm4test.test_stat.stat));
 	}
-	nlm_send_async(NLMPROC4_TEST_RES, nlm_arg->nlm_async_host, res, NULL);
+	nlm_send_async(NLMPROC4_TEST_RES, nlm_arg->nlm_async_host, res, 0);
 
 	nlm4_Test_Free(res);
 	dec_nsm_client_ref(nlm_arg->nlm_async_host->slc_nsm_client);
@@ -141,7 +141,7 @@ static void nlm4_unlock_message_resp(state_async_queue_t *arg)
 			     lock_result_str(res->res_nlm4.stat.stat));
 	}
 
-	nlm_send_async(NLMPROC4_UNLOCK_RES, nlm_arg->nlm_async_host, res, NULL);
+	nlm_send_async(NLMPROC4_UNLOCK_RES, nlm_arg->nlm_async_host, res, 0);
 
 	nlm4_Unlock_Free(res);
 	dec_nsm_client_ref(nlm_arg->nlm_async_host->slc_nsm_client);
@@ -34,9 +34,31 @@
 #include "sal_functions.h"
 #include "nlm_util.h"
 #include "nlm_async.h"
+#include "fridgethr.h"
+#include "delayed_exec.h"
 
-pthread_mutex_t nlm_async_resp_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t nlm_async_resp_cond = PTHREAD_COND_INITIALIZER;
+/**
+ * @brief Threads sending NLM replies and GRANTED callbacks
+ *
+ * Replies to the *_MSG procedures and GRANTED_MSG calls are sent from
+ * this fridge rather than from State_Async, so a client that is slow to
+ * connect or to answer holds up one thread, not every client.
+ */
+static struct fridgethr *nlm_callback_fridge;
+
+/** How long a resolved callback address is trusted, in seconds */
+#define NLM_CALLBACK_ADDR_TTL 300
+/** How long a GRANTED_MSG holds its slot without a GRANTED_RES */
+#define NLM_CALLBACK_TIMEOUT 5
+
+/**
+ * @brief A GRANTED_MSG sent and not answered yet
+ */
+struct nlm_inflight {
+	struct glist_head list;	/*< On the host's slc_inflight */
+	uint64_t key;		/*< Sequence number of the grant */
+	time_t expire;		/*< When the slot is given up */
+};
 
 int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 			    nfs_res_t *pres)
@@ -54,7 +76,7 @@ int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 	copy_netobj(&nlm_arg->nlm_async_args.nlm_async_res.res_nlm4.cookie,
 		    &pres->res_nlm4.cookie);
 
-	status = state_async_schedule(arg);
+	status = nlm_async_schedule(arg);
 
 	if (status != STATE_SUCCESS) {
 		gsh_free(arg);
@@ -87,7 +109,7 @@ int nlm_send_async_res_nlm4test(state_nlm_client_t *host,
 		     &pres->res_nlm4test.test_stat.nlm4_testrply_u.holder.oh);
 	}
 
-	status = state_async_schedule(arg);
+	status = nlm_async_schedule(arg);
 
 	if (status != STATE_SUCCESS) {
 		nlm4_Test_Free(res);
@@ -106,154 +128,627 @@ xdrproc_t nlm_reply_proc[] = {
 	[NLMPROC4_UNLOCK_RES] = (xdrproc_t) xdr_nlm4_res,
 };
 
-static void *resp_key;
-
 static const int MAX_ASYNC_RETRY = 2;
 static const struct timespec tout = { 0, 0 }; /* one-shot */
 
-/* Client routine  to send the asynchrnous response,
- * key is used to wait for a response
+/**
+ * @brief Run an NLM asynchronous function
+ *
+ * @param[in] ctx Thread context, containing arguments.
  */
-int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
+static void nlm_async_func_caller(struct fridgethr_context *ctx)
 {
-	struct clnt_req *cc;
-	char *t;
-	struct timeval start, now;
-	struct timespec timeout;
-	int retval, retry;
+	state_async_queue_t *entry = ctx->arg;
+
+	entry->state_async_func(entry);
+}
+
+/**
+ * @brief Schedule an NLM reply or GRANTED callback
+ *
+ * @param[in] arg Request to schedule
+ *
+ * @return State status.
+ */
+state_status_t nlm_async_schedule(state_async_queue_t *arg)
+{
+	int rc;
+
+	if (nlm_callback_fridge == NULL)
+		return state_async_schedule(arg);
+
+	LogFullDebug(COMPONENT_NLM, "Schedule %p", arg);
+
+	rc = fridgethr_submit(nlm_callback_fridge, nlm_async_func_caller, arg);
+
+	if (rc != 0)
+		LogCrit(COMPONENT_NLM, "Unable to schedule request: %d", rc);
+
+	return rc == 0 ? STATE_SUCCESS : STATE_SIGNAL_ERROR;
+}
+
+/**
+ * @brief Initialize the NLM callback threads
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+int nlm_async_callback_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.core_param.nlm_callback_threads;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&nlm_callback_fridge, "NLM_Callback", &frp);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_NLM,
+			 "Unable to initialize NLM callback thread fridge: %d",
+			 rc);
+		nlm_callback_fridge = NULL;
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Stop the NLM callback threads
+ */
+void nlm_async_callback_shutdown(void)
+{
+	int rc;
+
+	if (nlm_callback_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(nlm_callback_fridge,
+				    fridgethr_comm_stop,
+				    120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_NLM,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(nlm_callback_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_NLM,
+			 "Failed shutting down NLM callback threads: %d", rc);
+	}
+}
+
+/**
+ * @brief Initialize the callback state of a new NLM client
+ *
+ * @param[in] host The client
+ */
+void nlm_async_host_init(state_nlm_client_t *host)
+{
+	host->slc_callback_clnt = NULL;
+	host->slc_callback_auth = NULL;
+	host->slc_callback_addrlen = 0;
+	host->slc_callback_expire = 0;
+	host->slc_callback_warming = false;
+	host->slc_inflight_count = 0;
+	glist_init(&host->slc_inflight);
+	glist_init(&host->slc_deferred);
+	host->slc_inflight_timer = false;
+	PTHREAD_MUTEX_init(&host->slc_callback_mutex, NULL);
+	PTHREAD_MUTEX_init(&host->slc_inflight_mutex, NULL);
+}
+
+/**
+ * @brief Release the callback state of an NLM client
+ *
+ * Deferred GRANTED calls and the expiry timer hold references on the
+ * client, so none are left by now.
+ *
+ * @param[in] host The client
+ */
+void nlm_async_host_fini(state_nlm_client_t *host)
+{
+	struct nlm_inflight *call;
+
+	while ((call = glist_first_entry(&host->slc_inflight,
+					 struct nlm_inflight, list)) != NULL) {
+		glist_del(&call->list);
+		gsh_free(call);
+	}
+
+	if (host->slc_callback_clnt != NULL)
+		CLNT_DESTROY(host->slc_callback_clnt);
+
+	PTHREAD_MUTEX_destroy(&host->slc_inflight_mutex);
+	PTHREAD_MUTEX_destroy(&host->slc_callback_mutex);
+}
+
+/**
+ * @brief Find the address of a client's NLM service
+ *
+ * The portmapper and the resolver are only asked once per
+ * NLM_CALLBACK_ADDR_TTL, or after a call to the client failed.
+ *
+ * @note The slc_callback_mutex MUST be held.
+ *
+ * @param[in] host The client
+ *
+ * @return 0, RPC_UNKNOWNADDR if worth retrying, -1 otherwise.
+ */
+static int nlm_callback_resolve(state_nlm_client_t *host)
+{
+	struct netbuf *buf;
+	struct addrinfo *result;
+	struct addrinfo hints;
+	char port_str[20];
 	char *caller_name = host->slc_nsm_client->ssc_nlm_caller_name;
 	const char *client_type_str = xprt_type_to_str(host->slc_client_type);
-	bool stats = nfs_param.core_param.enable_AUTHSTATS;
+	time_t now = time(NULL);
+	int retval;
+
+	if (host->slc_callback_addrlen != 0 && now < host->slc_callback_expire)
+		return 0;
+
+	buf = rpcb_find_mapped_addr((char *) client_type_str,
+				    NLMPROG, NLM4_VERS, caller_name);
+	/* handle error here, for example,
+	 * client side blocking rpc call
+	 */
+	if (buf == NULL) {
+		LogMajor(COMPONENT_NLM,
+			 "Cannot create NLM async %s connection to client %s",
+			 client_type_str, caller_name);
+		return -1;
+	}
 
-	for (retry = 0; retry < MAX_ASYNC_RETRY; retry++) {
-		if (host->slc_callback_clnt == NULL) {
-			LogFullDebug(COMPONENT_NLM,
-				     "clnt_ncreate %s",
-				     caller_name);
-
-			if (host->slc_client_type == XPRT_TCP) {
-				int fd;
-				struct sockaddr_in6 server_addr;
-				struct netbuf *buf, local_buf;
-				struct addrinfo *result;
-				struct addrinfo hints;
-				char port_str[20];
-
-				fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
-				if (fd < 0)
-					return -1;
-
-				memcpy(&server_addr,
-				       &(host->slc_server_addr),
-				       sizeof(struct sockaddr_in6));
-				server_addr.sin6_port = 0;
-
-				if (bind(fd,
-					 (struct sockaddr *)&server_addr,
-					  sizeof(server_addr)) == -1) {
-					LogMajor(COMPONENT_NLM, "Cannot bind");
-					close(fd);
-					return -1;
-				}
-
-				buf = rpcb_find_mapped_addr(
-						(char *) client_type_str,
-						NLMPROG, NLM4_VERS,
-						caller_name);
-				/* handle error here, for example,
-				 * client side blocking rpc call
-				 */
-				if (buf == NULL) {
-					LogMajor(COMPONENT_NLM,
-						 "Cannot create NLM async %s connection to client %s",
-						 client_type_str, caller_name);
-					close(fd);
-					return -1;
-				}
-
-				memset(&hints, 0, sizeof(struct addrinfo));
-				hints.ai_family = AF_INET6;	/* only INET6 */
-				hints.ai_socktype = SOCK_STREAM; /* TCP */
-				hints.ai_protocol = 0;	/* Any protocol */
-				hints.ai_canonname = NULL;
-				hints.ai_addr = NULL;
-				hints.ai_next = NULL;
-
-				/* convert port to string format */
-				sprintf(port_str, "%d",
-					htons(((struct sockaddr_in *)
-						buf->buf)->sin_port));
-
-				/* buf with inet is only needed for the port */
-				gsh_free(buf->buf);
-				gsh_free(buf);
-
-				/* get the IPv4 mapped IPv6 address */
-				retval = gsh_getaddrinfo(caller_name,
-						     port_str,
-						     &hints,
-						     &result,
-						     stats);
-
-				/* retry for spurious EAI_NONAME errors */
-				if (retval == EAI_NONAME ||
-				    retval == EAI_AGAIN) {
-					LogEvent(COMPONENT_NLM,
-						 "failed to resolve %s to an address: %s",
-						 caller_name,
-						 gai_strerror(retval));
-					/* getaddrinfo() failed, retry */
-					retval = RPC_UNKNOWNADDR;
-					usleep(1000);
-					continue;
-				} else if (retval != 0) {
-					LogMajor(COMPONENT_NLM,
-						 "failed to resolve %s to an address: %s",
-						 caller_name,
-						 gai_strerror(retval));
-					return -1;
-				}
-
-				/* setup the netbuf with in6 address */
-				local_buf.buf = result->ai_addr;
-				local_buf.len = local_buf.maxlen =
-				    result->ai_addrlen;
-
-				host->slc_callback_clnt =
-				    clnt_vc_ncreatef(fd, &local_buf, NLMPROG,
-						     NLM4_VERS, 0, 0,
-						     CLNT_CREATE_FLAG_CLOSE |
-						     CLNT_CREATE_FLAG_CONNECT);
-				freeaddrinfo(result);
-			} else {
-
-				host->slc_callback_clnt =
-				    clnt_ncreate(caller_name, NLMPROG,
-						 NLM4_VERS,
-						 (char *) client_type_str);
-			}
-
-			if (CLNT_FAILURE(host->slc_callback_clnt)) {
-				char *err = rpc_sperror(
-					&host->slc_callback_clnt->cl_error,
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_INET6;	/* only INET6 */
+	hints.ai_socktype = SOCK_STREAM; /* TCP */
+	hints.ai_protocol = 0;	/* Any protocol */
+
+	/* convert port to string format */
+	sprintf(port_str, "%d",
+		htons(((struct sockaddr_in *)buf->buf)->sin_port));
+
+	/* buf with inet is only needed for the port */
+	gsh_free(buf->buf);
+	gsh_free(buf);
+
+	/* get the IPv4 mapped IPv6 address */
+	retval = gsh_getaddrinfo(caller_name, port_str, &hints, &result,
+				 nfs_param.core_param.enable_AUTHSTATS);
+
+	/* retry for spurious EAI_NONAME errors */
+	if (retval == EAI_NONAME || retval == EAI_AGAIN) {
+		LogEvent(COMPONENT_NLM,
+			 "failed to resolve %s to an address: %s",
+			 caller_name, gai_strerror(retval));
+		return RPC_UNKNOWNADDR;
+	} else if (retval != 0) {
+		LogMajor(COMPONENT_NLM,
+			 "failed to resolve %s to an address: %s",
+			 caller_name, gai_strerror(retval));
+		return -1;
+	}
+
+	memcpy(&host->slc_callback_addr, result->ai_addr,
+	       result->ai_addrlen);
+	host->slc_callback_addrlen = result->ai_addrlen;
+	host->slc_callback_expire = now + NLM_CALLBACK_ADDR_TTL;
+	freeaddrinfo(result);
+
+	return 0;
+}
+
+/**
+ * @brief Drop a client's callback connection and cached address
+ *
+ * @note The slc_callback_mutex MUST be held.
+ *
+ * @param[in] host The client
+ */
+static void nlm_callback_reset(state_nlm_client_t *host)
+{
+	if (host->slc_callback_clnt != NULL) {
+		CLNT_DESTROY(host->slc_callback_clnt);
+		host->slc_callback_clnt = NULL;
+	}
+
+	host->slc_callback_addrlen = 0;
+}
+
+/**
+ * @brief Connect to a client's NLM service unless already connected
+ *
+ * @note The slc_callback_mutex MUST be held.
+ *
+ * @param[in] host The client
+ *
+ * @return 0, RPC_UNKNOWNADDR if worth retrying, -1 otherwise.
+ */
+static int nlm_callback_connect(state_nlm_client_t *host)
+{
+	char *caller_name = host->slc_nsm_client->ssc_nlm_caller_name;
+	const char *client_type_str = xprt_type_to_str(host->slc_client_type);
+	int retval;
+
+	if (host->slc_callback_clnt != NULL)
+		return 0;
+
+	LogFullDebug(COMPONENT_NLM, "clnt_ncreate %s", caller_name);
+
+	if (host->slc_client_type == XPRT_TCP) {
+		int fd;
+		struct sockaddr_in6 server_addr;
+		struct netbuf local_buf;
+
+		retval = nlm_callback_resolve(host);
+		if (retval != 0)
+			return retval;
+
+		fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
+		if (fd < 0)
+			return -1;
+
+		memcpy(&server_addr, &(host->slc_server_addr),
+		       sizeof(struct sockaddr_in6));
+		server_addr.sin6_port = 0;
+
+		if (bind(fd, (struct sockaddr *)&server_addr,
+			 sizeof(server_addr)) == -1) {
+			LogMajor(COMPONENT_NLM, "Cannot bind");
+			close(fd);
+			return -1;
+		}
+
+		/* setup the netbuf with in6 address */
+		local_buf.buf = &host->slc_callback_addr;
+		local_buf.len = local_buf.maxlen = host->slc_callback_addrlen;
+
+		host->slc_callback_clnt =
+		    clnt_vc_ncreatef(fd, &local_buf, NLMPROG, NLM4_VERS, 0, 0,
+				     CLNT_CREATE_FLAG_CLOSE |
+				     CLNT_CREATE_FLAG_CONNECT);
+	} else {
+		host->slc_callback_clnt =
+		    clnt_ncreate(caller_name, NLMPROG, NLM4_VERS,
+				 (char *) client_type_str);
+	}
+
+	if (CLNT_FAILURE(host->slc_callback_clnt)) {
+		char *err = rpc_sperror(&host->slc_callback_clnt->cl_error,
 					"failed");
 
-				LogMajor(COMPONENT_NLM,
-					 "Create NLM async %s connection to client %s %s",
-					 client_type_str, caller_name, err);
-				gsh_free(err);
-				CLNT_DESTROY(host->slc_callback_clnt);
-				host->slc_callback_clnt = NULL;
-				return -1;
-			}
-
-			/* split auth (for authnone, idempotent) */
-			host->slc_callback_auth = authnone_ncreate();
+		LogMajor(COMPONENT_NLM,
+			 "Create NLM async %s connection to client %s %s",
+			 client_type_str, caller_name, err);
+		gsh_free(err);
+		nlm_callback_reset(host);
+		return -1;
+	}
+
+	/* split auth (for authnone, idempotent) */
+	host->slc_callback_auth = authnone_ncreate();
+
+	return 0;
+}
+
+/**
+ * @brief Connect to a client in the background
+ *
+ * @param[in] ctx Thread context, containing the client.
+ */
+static void nlm_callback_prewarm(struct fridgethr_context *ctx)
+{
+	state_nlm_client_t *host = ctx->arg;
+
+	PTHREAD_MUTEX_lock(&host->slc_callback_mutex);
+	(void) nlm_callback_connect(host);
+	host->slc_callback_warming = false;
+	PTHREAD_MUTEX_unlock(&host->slc_callback_mutex);
+
+	dec_nlm_client_ref(host);
+}
+
+/**
+ * @brief Open the callback connection to a client ahead of need
+ *
+ * Called when a client's lock blocks, so that the GRANTED_MSG does not
+ * have to wait for the portmapper, the resolver and the connect.
+ *
+ * @param[in] host The client
+ */
+void nlm_async_prewarm(state_nlm_client_t *host)
+{
+	if (nlm_callback_fridge == NULL || host->slc_client_type != XPRT_TCP)
+		return;
+
+	PTHREAD_MUTEX_lock(&host->slc_callback_mutex);
+
+	if (host->slc_callback_clnt != NULL || host->slc_callback_warming) {
+		PTHREAD_MUTEX_unlock(&host->slc_callback_mutex);
+		return;
+	}
+
+	host->slc_callback_warming = true;
+	PTHREAD_MUTEX_unlock(&host->slc_callback_mutex);
+
+	inc_nlm_client_ref(host);
+
+	if (fridgethr_submit(nlm_callback_fridge, nlm_callback_prewarm,
+			     host) != 0) {
+		PTHREAD_MUTEX_lock(&host->slc_callback_mutex);
+		host->slc_callback_warming = false;
+		PTHREAD_MUTEX_unlock(&host->slc_callback_mutex);
+		dec_nlm_client_ref(host);
+	}
+}
+
+/**
+ * @brief Give up the slots of GRANTED calls that were never answered
+ *
+ * @note The slc_inflight_mutex MUST be held.
+ */
+static void nlm_inflight_expire(state_nlm_client_t *host, time_t now)
+{
+	struct nlm_inflight *call;
+
+	while ((call = glist_first_entry(&host->slc_inflight,
+					 struct nlm_inflight, list)) != NULL &&
+	       call->expire <= now) {
+		LogFullDebug(COMPONENT_NLM,
+			     "No GRANTED_RES for key %" PRIu64, call->key);
+		glist_del(&call->list);
+		gsh_free(call);
+		host->slc_inflight_count--;
+	}
+}
+
+/**
+ * @brief Take one of a client's in-flight slots for @a key
+ *
+ * @note The slc_inflight_mutex MUST be held and a slot MUST be free.
+ */
+static void nlm_inflight_add(state_nlm_client_t *host, uint64_t key,
+			     time_t now)
+{
+	struct nlm_inflight *call = gsh_malloc(sizeof(*call));
+
+	call->key = key;
+	call->expire = now + NLM_CALLBACK_TIMEOUT;
+	glist_add_tail(&host->slc_inflight, &call->list);
+	host->slc_inflight_count++;
+}
+
+/**
+ * @brief Hand free slots to deferred GRANTED calls
+ *
+ * Expired slots are given up first.  The calls given a slot are moved to
+ * @a ready, for nlm_inflight_run once the mutex is dropped.
+ *
+ * @note The slc_inflight_mutex MUST be held.
+ */
+static void nlm_inflight_promote(state_nlm_client_t *host,
+				 struct glist_head *ready)
+{
+	state_async_queue_t *arg;
+	time_t now = time(NULL);
+
+	nlm_inflight_expire(host, now);
+
+	while (host->slc_inflight_count <
+	       nfs_param.core_param.nlm_callback_window &&
+	       (arg = glist_first_entry(&host->slc_deferred,
+					state_async_queue_t,
+					state_async_glist)) != NULL) {
+		glist_del(&arg->state_async_glist);
+		nlm_inflight_add(host,
+				 arg->state_async_data.state_nlm_async_data
+					.nlm_async_key,
+				 now);
+		glist_add_tail(ready, &arg->state_async_glist);
+	}
+}
+
+/**
+ * @brief Send the GRANTED calls that were given a slot
+ *
+ * @param[in] ready Calls moved there by nlm_inflight_promote
+ */
+static void nlm_inflight_run(struct glist_head *ready)
+{
+	state_async_queue_t *arg;
+
+	while ((arg = glist_first_entry(ready, state_async_queue_t,
+					state_async_glist)) != NULL) {
+		glist_del(&arg->state_async_glist);
+
+		/* Better hold up this thread than lose the grant */
+		if (nlm_async_schedule(arg) != STATE_SUCCESS)
+			arg->state_async_func(arg);
+	}
+}
+
+static void nlm_inflight_timer(void *arg);
+
+/**
+ * @brief Check for expired slots when the oldest call times out
+ *
+ * Only needed while calls are deferred, as nothing else may come along
+ * to give the slots up.
+ *
+ * @note The slc_inflight_mutex MUST be held.
+ */
+static void nlm_inflight_arm(state_nlm_client_t *host)
+{
+	struct nlm_inflight *oldest;
+	time_t now = time(NULL);
+	time_t delay;
+
+	if (host->slc_inflight_timer || glist_empty(&host->slc_deferred))
+		return;
+
+	oldest = glist_first_entry(&host->slc_inflight, struct nlm_inflight,
+				   list);
+	delay = oldest != NULL && oldest->expire > now ? oldest->expire - now
+						       : 1;
+
+	inc_nlm_client_ref(host);
+	host->slc_inflight_timer = true;
+
+	if (delayed_submit(nlm_inflight_timer, host, delay * NS_PER_SEC) != 0) {
+		LogCrit(COMPONENT_NLM,
+			"Unable to schedule expiry of GRANTED calls to %s",
+			host->slc_nlm_caller_name);
+		host->slc_inflight_timer = false;
+		dec_nlm_client_ref(host);
+	}
+}
+
+/**
+ * @brief Give up expired slots and send deferred calls in their place
+ *
+ * @param[in] arg The client, with a reference
+ */
+static void nlm_inflight_timer(void *arg)
+{
+	state_nlm_client_t *host = arg;
+	struct glist_head ready;
+
+	glist_init(&ready);
+
+	PTHREAD_MUTEX_lock(&host->slc_inflight_mutex);
+	host->slc_inflight_timer = false;
+	nlm_inflight_promote(host, &ready);
+	nlm_inflight_arm(host);
+	PTHREAD_MUTEX_unlock(&host->slc_inflight_mutex);
+
+	nlm_inflight_run(&ready);
+	dec_nlm_client_ref(host);
+}
+
+/**
+ * @brief Take one of a client's in-flight slots for a GRANTED call
+ *
+ * If the client has NLM_Callback_Window calls unanswered, the call is
+ * deferred instead, rather than holding up a callback thread: it is
+ * scheduled again, with a slot already taken for it, once a call is
+ * answered or the oldest gives up its slot.  Calls are given slots in
+ * the order they were deferred.
+ *
+ * @param[in] host The client
+ * @param[in] arg  The GRANTED call, its key the sequence number of the grant
+ *
+ * @return true if the call holds a slot and can be sent, false if it was
+ *         deferred and now belongs to the client's deferred list.
+ */
+bool nlm_inflight_reserve(state_nlm_client_t *host, state_async_queue_t *arg)
+{
+	uint64_t key = arg->state_async_data.state_nlm_async_data.nlm_async_key;
+	struct glist_head *glist;
+	time_t now = time(NULL);
+
+	PTHREAD_MUTEX_lock(&host->slc_inflight_mutex);
+
+	/* A deferred call was given its slot when it was scheduled again */
+	glist_for_each(glist, &host->slc_inflight) {
+		if (glist_entry(glist, struct nlm_inflight, list)->key == key) {
+			PTHREAD_MUTEX_unlock(&host->slc_inflight_mutex);
+			return true;
 		}
+	}
+
+	nlm_inflight_expire(host, now);
+
+	if (glist_empty(&host->slc_deferred) &&
+	    host->slc_inflight_count <
+	    nfs_param.core_param.nlm_callback_window) {
+		nlm_inflight_add(host, key, now);
+		PTHREAD_MUTEX_unlock(&host->slc_inflight_mutex);
+		return true;
+	}
+
+	LogFullDebug(COMPONENT_NLM,
+		     "%s has %" PRIu32 " GRANTED calls in flight, deferring",
+		     host->slc_nlm_caller_name, host->slc_inflight_count);
+
+	glist_add_tail(&host->slc_deferred, &arg->state_async_glist);
+	nlm_inflight_arm(host);
+
+	PTHREAD_MUTEX_unlock(&host->slc_inflight_mutex);
+	return false;
+}
+
+/**
+ * @brief Release the in-flight slot held for @a key
+ *
+ * The slot goes to the oldest deferred call, if any.
+ *
+ * @param[in] host The client
+ * @param[in] key  The sequence number of the grant
+ *
+ * @return true if @a key held a slot.
+ */
+static bool nlm_inflight_put(state_nlm_client_t *host, uint64_t key)
+{
+	struct glist_head *glist;
+	struct nlm_inflight *call;
+	struct glist_head ready;
+	bool found = false;
+
+	glist_init(&ready);
+
+	PTHREAD_MUTEX_lock(&host->slc_inflight_mutex);
+
+	glist_for_each(glist, &host->slc_inflight) {
+		call = glist_entry(glist, struct nlm_inflight, list);
+		if (call->key != key)
+			continue;
+
+		glist_del(&call->list);
+		gsh_free(call);
+		host->slc_inflight_count--;
+		found = true;
+		break;
+	}
+
+	nlm_inflight_promote(host, &ready);
+
+	PTHREAD_MUTEX_unlock(&host->slc_inflight_mutex);
 
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = key;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+	nlm_inflight_run(&ready);
+
+	return found;
+}
+
+/* Client routine  to send the asynchrnous response.
+ *
+ * The call is sent one-shot and we do not wait for the reply.  For a
+ * GRANTED_MSG, key holds the in-flight slot taken by
+ * nlm_inflight_reserve until the GRANTED_RES comes back, which bounds
+ * how far ahead of a slow client we run without blocking other clients.
+ * The slot is taken before the call, as the reply may beat its return.
+ */
+int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg,
+		   uint64_t key)
+{
+	struct clnt_req *cc;
+	char *t;
+	int retval = RPC_SUCCESS, retry;
+
+	for (retry = 0; retry < MAX_ASYNC_RETRY; retry++) {
+		PTHREAD_MUTEX_lock(&host->slc_callback_mutex);
+
+		retval = nlm_callback_connect(host);
+
+		if (retval == RPC_UNKNOWNADDR) {
+			/* getaddrinfo() failed, retry */
+			PTHREAD_MUTEX_unlock(&host->slc_callback_mutex);
+			usleep(1000);
+			continue;
+		} else if (retval != 0) {
+			PTHREAD_MUTEX_unlock(&host->slc_callback_mutex);
+			break;
+		}
 
 		LogFullDebug(COMPONENT_NLM, "About to make clnt_call");
 
@@ -273,6 +768,7 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 		if (retval == RPC_TIMEDOUT || retval == RPC_SUCCESS) {
 			retval = RPC_SUCCESS;
 			clnt_req_release(cc);
+			PTHREAD_MUTEX_unlock(&host->slc_callback_mutex);
 			break;
 		}
 
@@ -283,62 +779,27 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 		gsh_free(t);
 
 		clnt_req_release(cc);
-		CLNT_DESTROY(host->slc_callback_clnt);
-		host->slc_callback_clnt = NULL;
+		nlm_callback_reset(host);
+		PTHREAD_MUTEX_unlock(&host->slc_callback_mutex);
 	}
 
-	if (retry == MAX_ASYNC_RETRY) {
+	if (retry == MAX_ASYNC_RETRY)
 		LogMajor(COMPONENT_NLM,
 			 "NLM async Client exceeded retry count %d",
 			 MAX_ASYNC_RETRY);
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = NULL;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-		return retval;
-	}
-
-	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-
-	if (resp_key != NULL) {
-		/* Wait for 5 seconds or a signal */
-		gettimeofday(&start, NULL);
-		gettimeofday(&now, NULL);
-		timeout.tv_sec = 5 + start.tv_sec;
-		timeout.tv_nsec = 0;
-
-		LogFullDebug(COMPONENT_NLM,
-			     "About to wait for signal for key %p", resp_key);
-
-		while (resp_key != NULL && now.tv_sec < (start.tv_sec + 5)) {
-			int rc;
-
-			rc = pthread_cond_timedwait(&nlm_async_resp_cond,
-						    &nlm_async_resp_mutex,
-						    &timeout);
-			LogFullDebug(COMPONENT_NLM,
-				     "pthread_cond_timedwait returned %d",
-				     rc);
-			gettimeofday(&now, NULL);
-		}
-		LogFullDebug(COMPONENT_NLM, "Done waiting");
-	}
 
-	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+	if (retval != RPC_SUCCESS && key != 0)
+		(void) nlm_inflight_put(host, key);
 
 	return retval;
 }
 
-void nlm_signal_async_resp(void *key)
+void nlm_signal_async_resp(state_nlm_client_t *host, uint64_t key)
 {
-	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-
-	if (resp_key == key) {
-		resp_key = NULL;
-		pthread_cond_signal(&nlm_async_resp_cond);
-		LogFullDebug(COMPONENT_NLM, "Signaled condition variable");
-	} else {
-		LogFullDebug(COMPONENT_NLM, "Didn't signal condition variable");
-	}
-
-	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+	if (nlm_inflight_put(host, key))
+		LogFullDebug(COMPONENT_NLM,
+			     "Released slot for key %" PRIu64, key);
+	else
+		LogFullDebug(COMPONENT_NLM,
+			     "No slot held for key %" PRIu64, key);
 }
@@ -58,6 +58,33 @@ void next_granted_cookie(struct granted_cookie *cookie)
 	PTHREAD_MUTEX_unlock(&granted_mutex);
 }
 
+/**
+ * @brief Sequence number of a GRANTED cookie
+ *
+ * Numbers are never reused while the server runs, unlike the cookie
+ * entries, so they key the client's in-flight GRANTED calls.
+ *
+ * @param[in] cookie Cookie of a GRANTED call or GRANTED_RES
+ *
+ * @return The sequence number, or 0 if this server did not issue the
+ *         cookie.
+ */
+uint64_t nlm_granted_cookie_seq(netobj *cookie)
+{
+	struct granted_cookie gc;
+
+	if (cookie->n_len != sizeof(gc))
+		return 0;
+
+	memcpy(&gc, cookie->n_bytes, sizeof(gc));
+
+	if (gc.gc_seconds != granted_cookie.gc_seconds ||
+	    gc.gc_microseconds != granted_cookie.gc_microseconds)
+		return 0;
+
+	return gc.gc_cookie;
+}
+
 const char *lock_result_str(int rc)
 {
 	switch (rc) {
@@ -138,6 +165,8 @@ void nlm_init(void)
 	granted_cookie.gc_seconds = (unsigned long)nlm_grace_tv.tv_sec;
 	granted_cookie.gc_microseconds = (unsigned long)nlm_grace_tv.tv_usec;
 	granted_cookie.gc_cookie = 0;
+
+	(void) nlm_async_callback_init();
 }
 
 void free_grant_arg(state_async_queue_t *arg)
@@ -171,6 +200,12 @@ static void nlm4_send_grant_msg(state_async_queue_t *arg)
 
 	nlm_async_grant = &nlm_arg->nlm_async_args.nlm_async_grant;
 
+	/* Deferred until the client answers earlier GRANTED calls, the
+	 * call keeps its reference on the host and is scheduled again.
+	 */
+	if (!nlm_inflight_reserve(nlm_arg->nlm_async_host, arg))
+		return;
+
 	if (isDebug(COMPONENT_NLM)) {
 		netobj_to_string(&nlm_async_grant->cookie,
 				 buffer, sizeof(buffer));
@@ -636,7 +671,7 @@ state_status_t nlm_granted_callback(struct fsal_obj_handle *obj,
 	inc_nlm_client_ref(nlm_grant_client);
 	arg->state_async_func = nlm4_send_grant_msg;
 	nlm_async_data->nlm_async_host = nlm_grant_client;
-	nlm_async_data->nlm_async_key = cookie_entry;
+	nlm_async_data->nlm_async_key = nlm_grant_cookie.gc_cookie;
 	inarg = &nlm_async_data->nlm_async_args.nlm_async_grant;
 
 	copy_netobj(&inarg->alock.fh, &nlm_block_data->sbd_nlm_fh);
@@ -670,7 +705,7 @@ state_status_t nlm_granted_callback(struct fsal_obj_handle *obj,
 	}
 
 	/* Now try to schedule NLMPROC4_GRANTED_MSG call */
-	state_status = state_async_schedule(arg);
+	state_status = nlm_async_schedule(arg);
 
 	if (state_status != STATE_SUCCESS)
 		goto grant_fail;
@@ -49,6 +49,7 @@
 #include "abstract_mem.h"
 #include "gsh_intrinsic.h"
 #include "gsh_wait_queue.h"
+#include "mem_budget.h"
 
 #define DUPREQ_NOCACHE   0x02
 #define DUPREQ_MAX_RETRIES 5
@@ -60,6 +61,16 @@ pool_t *dupreq_pool;
 pool_t *nfs_res_pool;
 pool_t *tcp_drc_pool;		/* pool of per-connection DRC objects */
 
+/**
+ * @brief Usage of all DRCs together, for the memory budget
+ */
+static struct {
+	uint64_t entries;	/*< Entries allocated */
+	uint64_t hits;		/*< Requests answered from a DRC */
+	uint64_t misses;	/*< Requests added to a DRC */
+	uint64_t max_entries;	/*< Retire past this many, 0 for no cap */
+} drc_budget_st;
+
 const char *dupreq_status_table[] = {
 	"DUPREQ_SUCCESS",
 	"DUPREQ_INSERT_MALLOC_ERROR",
@@ -309,6 +320,53 @@ static inline void init_shared_drc(void)
 	}
 }
 
+/**
+ * @brief Memory held by DRC entries and their results
+ *
+ * What their pools have mapped, free objects in the slabs included.
+ */
+static uint64_t drc_budget_usage(void)
+{
+	return atomic_fetch_uint64_t(&dupreq_pool->slab_bytes) +
+	       atomic_fetch_uint64_t(&nfs_res_pool->slab_bytes);
+}
+
+static void drc_budget_benefit(uint64_t *hits, uint64_t *misses)
+{
+	*hits = atomic_fetch_uint64_t(&drc_budget_st.hits);
+	*misses = atomic_fetch_uint64_t(&drc_budget_st.misses);
+}
+
+/**
+ * @brief Cap the entries of all DRCs together
+ *
+ * DRCs over the cap retire entries as their requests complete, the same
+ * way they do past their own high water mark, so what this gives back
+ * is what entries retired since the last cycle left in empty slabs.
+ *
+ * @return Bytes the pools unmapped.
+ */
+static uint64_t drc_budget_limit(uint64_t bytes)
+{
+	uint64_t entries = atomic_fetch_uint64_t(&drc_budget_st.entries);
+	uint64_t per_entry = sizeof(dupreq_entry_t) + sizeof(nfs_res_t);
+	uint64_t usage = drc_budget_usage();
+
+	if (entries != 0 && usage / entries > per_entry)
+		per_entry = usage / entries;
+
+	atomic_store_uint64_t(&drc_budget_st.max_entries, bytes / per_entry);
+
+	return pool_reclaim(dupreq_pool) + pool_reclaim(nfs_res_pool);
+}
+
+static struct mem_budget_client drc_budget = {
+	.name = "drc",
+	.usage = drc_budget_usage,
+	.benefit = drc_budget_benefit,
+	.limit = drc_budget_limit,
+};
+
 /**
  * @brief Initialize the DRC package.
  */
@@ -343,6 +401,8 @@ void dupreq2_pkginit(void)
 
 	/* UDP DRC is global, shared */
 	init_shared_drc();
+
+	mem_budget_register(&drc_budget);
 }
 
 /**
@@ -854,6 +914,7 @@ static inline dupreq_entry_t *alloc_dupreq(void)
 	dv = pool_alloc(dupreq_pool);
 	gsh_mutex_init(&dv->mtx, NULL);
 	TAILQ_INIT_ENTRY(dv, fifo_q);
+	(void) atomic_inc_uint64_t(&drc_budget_st.entries);
 
 	return dv;
 }
@@ -883,6 +944,7 @@ static inline void nfs_dupreq_free_dupreq(dupreq_entry_t *dv)
 	}
 	PTHREAD_MUTEX_destroy(&dv->mtx);
 	pool_free(dupreq_pool, dv);
+	(void) atomic_dec_uint64_t(&drc_budget_st.entries);
 }
 
 /**
@@ -968,6 +1030,8 @@ static inline void dupreq_entry_put(dupreq_entry_t *dv)
  */
 static inline bool drc_should_retire(drc_t *drc)
 {
+	uint64_t max_entries;
+
 	/* do not exeed the hard bound on cache size */
 	if (unlikely(drc->size > drc->maxsize))
 		return true;
@@ -976,6 +1040,13 @@ static inline bool drc_should_retire(drc_t *drc)
 	if (unlikely(drc->retwnd > 0))
 		return false;
 
+	/* retire if all DRCs together are over the memory budget */
+	max_entries = atomic_fetch_uint64_t(&drc_budget_st.max_entries);
+	if (unlikely(max_entries != 0 &&
+		     atomic_fetch_uint64_t(&drc_budget_st.entries) >
+		     max_entries))
+		return true;
+
 	/* finally, retire if drc->size is above intended high water mark */
 	if (unlikely(drc->size > drc->hiwat))
 		return true;
@@ -1090,6 +1161,8 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 				reqnfs->res_nfs = req->rq_u2 = dv->res;
 				status = DUPREQ_EXISTS;
 				dupreq_entry_get(dv);
+				(void) atomic_inc_uint64_t(
+						&drc_budget_st.hits);
 			}
 			PTHREAD_MUTEX_unlock(&dv->mtx);
 
@@ -1124,6 +1197,7 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 			TAILQ_INSERT_TAIL(&drc->dupreq_q, dk, fifo_q);
 			++(drc->size);
 			PTHREAD_MUTEX_unlock(&drc->mtx);
+			(void) atomic_inc_uint64_t(&drc_budget_st.misses);
 
 			LogFullDebug(COMPONENT_DUPREQ,
 				     "starting dk=%p xid=%" PRIu32
@@ -1267,6 +1341,21 @@ dq_again:
 	return status;
 }
 
+/**
+ * @brief Check whether a request's result may outlive the request
+ *
+ * Results of requests tracked by a duplicate request cache are kept for
+ * replay, so they must not be allocated from the request's arena.
+ *
+ * @param[in] req The svc_req structure.
+ *
+ * @return true if the result is kept in a duplicate request cache.
+ */
+bool nfs_dupreq_keeps_res(struct svc_req *req)
+{
+	return req->rq_u1 != (void *)DUPREQ_NOCACHE;
+}
+
 /**
  *
  * @brief Remove an entry (request) from a duplicate request cache.
@@ -351,7 +351,7 @@ void nfs_wait_for_grace_enforcement(void)
 {
 	nfs_grace_start_t gsp = { .event = EVENT_JUST_GRACE };
 
-	pthread_mutex_lock(&enforcing_mutex);
+	PTHREAD_MUTEX_lock(&enforcing_mutex);
 	nfs_try_lift_grace();
 	while (nfs_in_grace() && !nfs_grace_enforcing()) {
 		struct timespec	timeo = { .tv_sec = time(NULL) + 5,
@@ -360,19 +360,19 @@ void nfs_wait_for_grace_enforcement(void)
 		pthread_cond_timedwait(&enforcing_cond, &enforcing_mutex,
 						&timeo);
 
-		pthread_mutex_unlock(&enforcing_mutex);
+		PTHREAD_MUTEX_unlock(&enforcing_mutex);
 		nfs_start_grace(&gsp);
 		nfs_try_lift_grace();
-		pthread_mutex_lock(&enforcing_mutex);
+		PTHREAD_MUTEX_lock(&enforcing_mutex);
 	}
-	pthread_mutex_unlock(&enforcing_mutex);
+	PTHREAD_MUTEX_unlock(&enforcing_mutex);
 }
 
 void nfs_notify_grace_waiters(void)
 {
-	pthread_mutex_lock(&enforcing_mutex);
+	PTHREAD_MUTEX_lock(&enforcing_mutex);
 	pthread_cond_broadcast(&enforcing_cond);
-	pthread_mutex_unlock(&enforcing_mutex);
+	PTHREAD_MUTEX_unlock(&enforcing_mutex);
 }
 
 /**
@@ -507,6 +507,8 @@ static int load_backend(const char *name)
 #endif
 	else if (!strcmp(name, "fs_ng"))
 		fs_ng_backend_init(&recovery_backend);
+	else if (!strcmp(name, "fs_log"))
+		fs_log_backend_init(&recovery_backend);
 	else
 		return -1;
 	return 0;
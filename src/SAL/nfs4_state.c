@@ -202,7 +202,7 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 
 	/* Add state to list for file */
 	PTHREAD_MUTEX_lock(&pnew_state->state_mutex);
-	glist_add_tail(&ostate->file.list_of_states, &pnew_state->state_list);
+	glist_add_tail(state_obj_list_of_states(obj), &pnew_state->state_list);
 	/* Get ref for this state entry */
 	obj->obj_ops->get_ref(obj);
 	PTHREAD_MUTEX_unlock(&pnew_state->state_mutex);
@@ -233,7 +233,12 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 #endif
 
 	if (pnew_state->state_type == STATE_TYPE_DELEG &&
-	    pnew_state->state_data.deleg.sd_type == OPEN_DELEGATE_WRITE)
+	    obj->type == DIRECTORY) {
+		/* The list was copied from state_data, start it over */
+		glist_init(&pnew_state->state_data.deleg.sd_notify_list);
+		(void) atomic_inc_int32_t(&ostate->dir.dir_delegations);
+	} else if (pnew_state->state_type == STATE_TYPE_DELEG &&
+		   pnew_state->state_data.deleg.sd_type == OPEN_DELEGATE_WRITE)
 		ostate->file.write_delegated = true;
 
 	/* Copy the result */
@@ -451,9 +456,13 @@ void _state_del_locked(state_t *state, const char *func, int line)
 	if (state->state_type == STATE_TYPE_SHARE)
 		assert(glist_empty(&state->state_data.share.share_lockstates));
 
-	/* Reset write delegated if this is a write delegation */
-	if (state->state_type == STATE_TYPE_DELEG &&
-	    state->state_data.deleg.sd_type == OPEN_DELEGATE_WRITE)
+	/* Reset write delegated if this is a write delegation, and drop
+	 * the notifications a directory delegation still had queued.
+	 */
+	if (state->state_type == STATE_TYPE_DELEG && obj->type == DIRECTORY)
+		state_dir_deleg_cleanup(obj, state);
+	else if (state->state_type == STATE_TYPE_DELEG &&
+		 state->state_data.deleg.sd_type == OPEN_DELEGATE_WRITE)
 		obj->state_hdl->file.write_delegated = false;
 
 	/* Remove from list of states for a particular export.
@@ -45,6 +45,7 @@
 #include "log.h"
 #include "client_mgr.h"
 #include "fsal.h"
+#include "nlm_async.h"
 
 /**
  * @brief NSM clients
@@ -1041,8 +1042,7 @@ void free_nlm_client(state_nlm_client_t *client)
 	gsh_free(client->slc_nlm_caller_name);
 
 	/* free the callback client */
-	if (client->slc_callback_clnt != NULL)
-		CLNT_DESTROY(client->slc_callback_clnt);
+	nlm_async_host_fini(client);
 
 	gsh_free(client);
 }
@@ -1260,6 +1260,7 @@ not_found:
 	memcpy(pclient, &key, sizeof(key));
 
 	pclient->slc_nlm_caller_name = gsh_strdup(key.slc_nlm_caller_name);
+	nlm_async_host_init(pclient);
 
 	/* Take a reference to the NSM Client */
 	inc_nsm_client_ref(nsm_client);
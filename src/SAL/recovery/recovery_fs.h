@@ -7,8 +7,19 @@
 
 extern char v4_recov_dir[PATH_MAX];
 
+void fs_create_clid_name(nfs_client_id_t *clientid);
 void fs_add_clid(nfs_client_id_t *clientid);
 void fs_rm_clid(nfs_client_id_t *clientid);
 void fs_add_revoke_fh(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle);
 void fs_clean_old_recov_dir_impl(char *parent_path);
+
+struct fs_log_parameter {
+	/** Directory holding the journal, snapshot and old files */
+	char *recov_dir;
+	/** Microseconds a group commit leader waits for more records */
+	uint32_t commit_delay;
+	/** Journal records before compaction is considered */
+	uint32_t compact_records;
+};
+extern struct fs_log_parameter fs_log_param;
 #endif	/* _RECOVERY_FS_H */
@@ -0,0 +1,1034 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file recovery_fs_log.c
+ * @brief Log structured filesystem recovery backend
+ *
+ * The "fs" backend represents every client as one or more directories
+ * under v4_recov_dir.  During a reconnect storm that turns into tens of
+ * thousands of synchronous mkdir/rmdir calls on what is usually shared
+ * storage.
+ *
+ * This backend instead appends one record per client add, remove or
+ * delegation revoke to a single journal file per node.  Concurrent
+ * callers are batched (group commit): the first caller to find no sync in
+ * progress becomes the leader, writes out every record queued so far and
+ * issues a single fdatasync on behalf of all of them.
+ *
+ * The full set of clients is also kept in memory, and once the journal
+ * grows well past the number of live clients it is compacted into a
+ * snapshot file.  Replaying a journal over a snapshot is idempotent (the
+ * last record for a given client decides its fate), so a crash between
+ * writing the snapshot and truncating the journal is harmless.
+ *
+ * Files, relative to the configured directory:
+ *
+ *   <node>.journal   records appended since the last compaction
+ *   <node>.snapshot  compacted state of the current epoch
+ *   <node>.old       clients of the previous epoch, kept until grace ends
+ *
+ * Record format is "<op> <taglen> <tag>[ <handle>]\n", where op is one of
+ * 'A' (add client), 'R' (remove client) or 'V' (revoked delegation, with
+ * a base64url encoded handle).  A record without a trailing newline is
+ * the result of a torn write and is ignored.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "nfs_core.h"
+#include "nfs4.h"
+#include "sal_functions.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include "avltree.h"
+#include "bsd-base64.h"
+#include "client_mgr.h"
+#include "fsal.h"
+#include "recovery_fs.h"
+
+#define FS_LOG_DIR		"v4log"
+#define FS_LOG_JOURNAL		"journal"
+#define FS_LOG_SNAPSHOT		"snapshot"
+#define FS_LOG_OLD		"old"
+
+#define FS_LOG_OP_ADD		'A'
+#define FS_LOG_OP_RM		'R'
+#define FS_LOG_OP_REVOKE	'V'
+
+struct fs_log_parameter fs_log_param;
+
+static struct config_item fs_log_params[] = {
+	CONF_ITEM_PATH("recov_dir", 1, MAXPATHLEN,
+		       NFS_V4_RECOV_ROOT "/" FS_LOG_DIR,
+		       fs_log_parameter, recov_dir),
+	CONF_ITEM_UI32("commit_delay", 0, 100000, 0,
+		       fs_log_parameter, commit_delay),
+	CONF_ITEM_UI32("compact_records", 64, UINT32_MAX, 65536,
+		       fs_log_parameter, compact_records),
+	CONFIG_EOL
+};
+
+static void *fs_log_param_init(void *link_mem, void *self_struct)
+{
+	if (self_struct == NULL)
+		return &fs_log_param;
+	else
+		return NULL;
+}
+
+struct config_block fs_log_param_blk = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.fs_log",
+	.blk_desc.name = "FS_LOG",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = fs_log_param_init,
+	.blk_desc.u.blk.params = fs_log_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+/**
+ * @brief A client known to the journal
+ */
+struct fs_log_clid {
+	struct avltree_node node;	/*< Link in the clid tree */
+	struct glist_head rfh_list;	/*< Revoked handles (fs_log_rfh) */
+	char *tag;			/*< cid_recov_tag of the client */
+};
+
+struct fs_log_rfh {
+	struct glist_head list;
+	char handle[];
+};
+
+/**
+ * @brief A caller waiting for its record to reach stable storage
+ */
+struct fs_log_waiter {
+	struct glist_head list;		/*< Link in fs_log.waiters */
+	char op;			/*< Record type */
+	const char *tag;		/*< Client tag */
+	const char *handle;		/*< Revoked handle, or NULL */
+	int rc;				/*< Result of the flush */
+	bool done;			/*< Flush covering this record ended */
+};
+
+/**
+ * @brief Journal state for this node
+ */
+static struct fs_log {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		/*< Signalled when a sync completes */
+	int fd;				/*< Journal, opened O_APPEND */
+	off_t off;			/*< End of the last durable record */
+	bool torn;			/*< Journal may end in a partial record */
+	char *buf;			/*< Records not yet written */
+	size_t buf_len;
+	size_t buf_size;
+	struct glist_head waiters;	/*< Callers of records in buf */
+	uint64_t seq_queued;		/*< Last record queued */
+	uint64_t seq_durable;		/*< Last record on stable storage */
+	bool syncing;			/*< A leader is writing */
+	uint32_t nrecords;		/*< Records in journal */
+	uint32_t nclids;		/*< Entries in clids */
+	struct avltree clids;
+	char node[NI_MAXHOST];
+} fs_log = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.fd = -1,
+	.waiters = GLIST_HEAD_INIT(fs_log.waiters),
+};
+
+static int fs_log_clid_cmpf(const struct avltree_node *lhs,
+			    const struct avltree_node *rhs)
+{
+	struct fs_log_clid *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct fs_log_clid, node);
+	rk = avltree_container_of(rhs, struct fs_log_clid, node);
+
+	return strcmp(lk->tag, rk->tag);
+}
+
+static struct fs_log_clid *fs_log_clid_lookup(struct avltree *tree,
+					      const char *tag)
+{
+	struct fs_log_clid key;
+	struct avltree_node *node;
+
+	key.tag = (char *)tag;
+	node = avltree_lookup(&key.node, tree);
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct fs_log_clid, node);
+}
+
+static void fs_log_clid_free(struct fs_log_clid *clid)
+{
+	struct fs_log_rfh *rfh;
+
+	while ((rfh = glist_first_entry(&clid->rfh_list, struct fs_log_rfh,
+					list)) != NULL) {
+		glist_del(&rfh->list);
+		gsh_free(rfh);
+	}
+	gsh_free(clid->tag);
+	gsh_free(clid);
+}
+
+/**
+ * @brief Apply one record to a clid tree
+ *
+ * @param[in,out] tree   Tree to update
+ * @param[in,out] nclids Number of entries in tree
+ * @param[in]     op     Record type
+ * @param[in]     tag    Client tag
+ * @param[in]     handle Revoked handle, for FS_LOG_OP_REVOKE
+ */
+static void fs_log_apply(struct avltree *tree, uint32_t *nclids, char op,
+			 const char *tag, const char *handle)
+{
+	struct fs_log_clid *clid = fs_log_clid_lookup(tree, tag);
+	struct fs_log_rfh *rfh;
+	struct glist_head *glist;
+	size_t hlen;
+
+	switch (op) {
+	case FS_LOG_OP_ADD:
+		if (clid != NULL)
+			return;
+		clid = gsh_malloc(sizeof(*clid));
+		clid->tag = gsh_strdup(tag);
+		glist_init(&clid->rfh_list);
+		avltree_insert(&clid->node, tree);
+		(*nclids)++;
+		return;
+
+	case FS_LOG_OP_RM:
+		if (clid == NULL)
+			return;
+		avltree_remove(&clid->node, tree);
+		fs_log_clid_free(clid);
+		(*nclids)--;
+		return;
+
+	case FS_LOG_OP_REVOKE:
+		if (clid == NULL) {
+			LogDebug(COMPONENT_CLIENTID,
+				 "Revoked handle %s for unknown client %s",
+				 handle, tag);
+			return;
+		}
+		glist_for_each(glist, &clid->rfh_list) {
+			rfh = glist_entry(glist, struct fs_log_rfh, list);
+			if (!strcmp(rfh->handle, handle))
+				return;
+		}
+		hlen = strlen(handle) + 1;
+		rfh = gsh_malloc(sizeof(*rfh) + hlen);
+		memcpy(rfh->handle, handle, hlen);
+		glist_add_tail(&clid->rfh_list, &rfh->list);
+		return;
+	}
+
+	LogEvent(COMPONENT_CLIENTID, "Unknown journal record type %c", op);
+}
+
+static void fs_log_tree_release(struct avltree *tree)
+{
+	struct avltree_node *node;
+
+	while ((node = avltree_first(tree)) != NULL) {
+		avltree_remove(node, tree);
+		fs_log_clid_free(avltree_container_of(node, struct fs_log_clid,
+						      node));
+	}
+}
+
+/**
+ * @brief Format a record into a growable buffer
+ */
+static void fs_log_format(char **buf, size_t *len, size_t *size, char op,
+			  const char *tag, const char *handle)
+{
+	size_t tlen = strlen(tag);
+	size_t need = tlen + 32 + (handle ? strlen(handle) + 1 : 0);
+	int n;
+
+	if (*len + need > *size) {
+		*size = *size * 2 > *len + need ? *size * 2 : *len + need;
+		*buf = gsh_realloc(*buf, *size);
+	}
+
+	if (handle)
+		n = snprintf(*buf + *len, *size - *len, "%c %zu %s %s\n",
+			     op, tlen, tag, handle);
+	else
+		n = snprintf(*buf + *len, *size - *len, "%c %zu %s\n",
+			     op, tlen, tag);
+	*len += n;
+}
+
+static int fs_log_write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void fs_log_path(char *path, size_t len, const char *dir,
+			const char *node, const char *suffix)
+{
+	snprintf(path, len, "%s/%s.%s", dir, node, suffix);
+}
+
+static void fs_log_sync_dir(const char *dir)
+{
+	int fd = open(dir, O_RDONLY | O_DIRECTORY);
+
+	if (fd < 0)
+		return;
+	(void) fsync(fd);
+	close(fd);
+}
+
+/**
+ * @brief Atomically replace a file with the contents of a clid tree
+ *
+ * @param[in] tree Clients to write
+ * @param[in] dir  Directory holding the file
+ * @param[in] path Final path of the file
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+static int fs_log_write_tree(struct avltree *tree, const char *dir,
+			     const char *path)
+{
+	char tmp[PATH_MAX];
+	char *buf = NULL;
+	size_t len = 0, size = 0;
+	struct avltree_node *node;
+	struct fs_log_clid *clid;
+	struct fs_log_rfh *rfh;
+	struct glist_head *glist;
+	int fd, rc;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		rc = -errno;
+		LogEvent(COMPONENT_CLIENTID, "Failed to create %s: %s",
+			 tmp, strerror(-rc));
+		return rc;
+	}
+
+	for (node = avltree_first(tree); node; node = avltree_next(node)) {
+		clid = avltree_container_of(node, struct fs_log_clid, node);
+		fs_log_format(&buf, &len, &size, FS_LOG_OP_ADD, clid->tag,
+			      NULL);
+		glist_for_each(glist, &clid->rfh_list) {
+			rfh = glist_entry(glist, struct fs_log_rfh, list);
+			fs_log_format(&buf, &len, &size, FS_LOG_OP_REVOKE,
+				      clid->tag, rfh->handle);
+		}
+	}
+
+	rc = fs_log_write_all(fd, buf, len);
+	gsh_free(buf);
+
+	if (rc == 0 && fdatasync(fd) < 0)
+		rc = -errno;
+	close(fd);
+
+	if (rc == 0 && rename(tmp, path) < 0)
+		rc = -errno;
+
+	if (rc != 0) {
+		LogEvent(COMPONENT_CLIENTID, "Failed to write %s: %s",
+			 path, strerror(-rc));
+		(void) unlink(tmp);
+		return rc;
+	}
+
+	fs_log_sync_dir(dir);
+	return 0;
+}
+
+/**
+ * @brief Replay a snapshot or journal file into a clid tree
+ *
+ * @param[in]     path   File to read
+ * @param[in,out] tree   Tree to update
+ * @param[in,out] nclids Number of entries in tree
+ *
+ * @return Number of records replayed, or negative errno.
+ */
+static int fs_log_replay(const char *path, struct avltree *tree,
+			 uint32_t *nclids)
+{
+	struct stat st;
+	char *buf, *p, *end, *eol, *tag, *handle;
+	unsigned long tlen;
+	int fd, nrec = 0;
+	ssize_t n;
+	size_t off = 0;
+	char op;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return 0;
+		LogEvent(COMPONENT_CLIENTID, "Failed to open %s: %s",
+			 path, strerror(errno));
+		return -errno;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -errno;
+	}
+
+	buf = gsh_malloc(st.st_size + 1);
+	while (off < st.st_size) {
+		n = read(fd, buf + off, st.st_size - off);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+		off += n;
+	}
+	close(fd);
+	buf[off] = '\0';
+
+	p = buf;
+	end = buf + off;
+	while (p < end) {
+		eol = memchr(p, '\n', end - p);
+		if (eol == NULL) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Ignoring torn record at end of %s", path);
+			break;
+		}
+
+		if (eol - p < 4) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Ignoring malformed record in %s", path);
+			p = eol + 1;
+			continue;
+		}
+
+		op = p[0];
+		tlen = strtoul(p + 2, &tag, 10);
+		if (*tag != ' ' || tag + 1 + tlen > eol ||
+		    tlen == 0 || tlen >= PATH_MAX) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Ignoring malformed record in %s", path);
+			p = eol + 1;
+			continue;
+		}
+		tag++;
+		handle = NULL;
+		if (op == FS_LOG_OP_REVOKE) {
+			if (tag + tlen == eol || tag[tlen] != ' ') {
+				LogEvent(COMPONENT_CLIENTID,
+					 "Ignoring malformed record in %s",
+					 path);
+				p = eol + 1;
+				continue;
+			}
+			handle = tag + tlen + 1;
+		} else if (tag + tlen != eol) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Ignoring malformed record in %s", path);
+			p = eol + 1;
+			continue;
+		}
+
+		/* Records are newline separated and tags never contain a
+		 * newline, so they can be terminated in place.
+		 */
+		tag[tlen] = '\0';
+		*eol = '\0';
+
+		fs_log_apply(tree, nclids, op, tag, handle);
+		nrec++;
+		p = eol + 1;
+	}
+
+	gsh_free(buf);
+	return nrec;
+}
+
+/**
+ * @brief Load snapshot and journal of a node
+ */
+static int fs_log_load(const char *dir, const char *node,
+		       struct avltree *tree, uint32_t *nclids)
+{
+	char path[PATH_MAX];
+	int rc, nrec;
+
+	fs_log_path(path, sizeof(path), dir, node, FS_LOG_SNAPSHOT);
+	rc = fs_log_replay(path, tree, nclids);
+	if (rc < 0)
+		return rc;
+
+	fs_log_path(path, sizeof(path), dir, node, FS_LOG_JOURNAL);
+	nrec = fs_log_replay(path, tree, nclids);
+	if (nrec < 0)
+		return nrec;
+
+	return nrec;
+}
+
+/**
+ * @brief Compact the journal into a snapshot
+ *
+ * Called with fs_log.lock held and no flush in progress.  Records queued
+ * but not yet written are not reflected in the tree yet; they will be
+ * appended to the (now empty) journal and replayed over the snapshot.
+ */
+static void fs_log_compact(void)
+{
+	char path[PATH_MAX];
+
+	fs_log_path(path, sizeof(path), fs_log_param.recov_dir, fs_log.node,
+		    FS_LOG_SNAPSHOT);
+
+	if (fs_log_write_tree(&fs_log.clids, fs_log_param.recov_dir,
+			      path) != 0)
+		return;
+
+	if (ftruncate(fs_log.fd, 0) < 0 || fdatasync(fs_log.fd) < 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to truncate recovery journal: %s",
+			 strerror(errno));
+		/* The snapshot covers everything, but the journal size is
+		 * now unknown; cut it back before the next append.
+		 */
+		fs_log.torn = true;
+		fs_log.off = 0;
+		return;
+	}
+
+	LogDebug(COMPONENT_CLIENTID,
+		 "Compacted %"PRIu32" journal records into %"PRIu32" clients",
+		 fs_log.nrecords, fs_log.nclids);
+	fs_log.off = 0;
+	fs_log.nrecords = 0;
+}
+
+/**
+ * @brief Write a batch of records and make it durable
+ *
+ * Called without fs_log.lock by the flush leader.  On failure the journal
+ * is cut back to the end of the last durable record so that a partial
+ * record cannot run into the next append or confuse recovery.
+ *
+ * @param[in] buf  Records to append
+ * @param[in] len  Length of buf
+ * @param[in] off  End of the last durable record
+ * @param[in] torn The journal may end in a partial record
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+static int fs_log_flush(const char *buf, size_t len, off_t off, bool torn)
+{
+	int rc;
+
+	if (torn && ftruncate(fs_log.fd, off) < 0)
+		return -errno;
+
+	rc = fs_log_write_all(fs_log.fd, buf, len);
+	if (rc == 0 && fdatasync(fs_log.fd) < 0)
+		rc = -errno;
+
+	if (rc != 0 && ftruncate(fs_log.fd, off) < 0)
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to truncate recovery journal to %lld: %s",
+			(long long)off, strerror(errno));
+
+	return rc;
+}
+
+/**
+ * @brief Queue a record and wait for it to reach stable storage
+ *
+ * The first caller to find no flush in progress writes out everything
+ * queued so far and issues one fdatasync for the whole batch; everyone
+ * else waits for the flush that covers their record.  The in-memory tree
+ * is only updated once a record is durable, so it never holds a client
+ * that the journal lost.
+ *
+ * @return 0 on success, negative errno if the batch holding the record
+ *         could not be written.
+ */
+static int fs_log_commit(char op, const char *tag, const char *handle)
+{
+	struct fs_log_waiter me = {
+		.op = op, .tag = tag, .handle = handle,
+	};
+	struct fs_log_waiter *w;
+	struct glist_head batch;
+	uint64_t target;
+	char *buf;
+	size_t len;
+	off_t off;
+	bool torn;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&fs_log.lock);
+
+	fs_log_format(&fs_log.buf, &fs_log.buf_len, &fs_log.buf_size,
+		      op, tag, handle);
+	glist_add_tail(&fs_log.waiters, &me.list);
+	++fs_log.seq_queued;
+
+	while (!me.done) {
+		if (fs_log.syncing) {
+			pthread_cond_wait(&fs_log.cond, &fs_log.lock);
+			continue;
+		}
+
+		fs_log.syncing = true;
+
+		if (fs_log_param.commit_delay) {
+			/* Give concurrent callers a chance to join */
+			PTHREAD_MUTEX_unlock(&fs_log.lock);
+			usleep(fs_log_param.commit_delay);
+			PTHREAD_MUTEX_lock(&fs_log.lock);
+		}
+
+		buf = fs_log.buf;
+		len = fs_log.buf_len;
+		target = fs_log.seq_queued;
+		off = fs_log.off;
+		torn = fs_log.torn;
+		fs_log.buf = NULL;
+		fs_log.buf_len = fs_log.buf_size = 0;
+		glist_init(&batch);
+		glist_splice_tail(&batch, &fs_log.waiters);
+
+		PTHREAD_MUTEX_unlock(&fs_log.lock);
+
+		rc = fs_log_flush(buf, len, off, torn);
+		gsh_free(buf);
+
+		PTHREAD_MUTEX_lock(&fs_log.lock);
+
+		if (rc == 0) {
+			fs_log.seq_durable = target;
+			fs_log.off = off + len;
+			fs_log.torn = false;
+		} else {
+			LogCrit(COMPONENT_CLIENTID,
+				"Failed to write recovery journal: %s",
+				strerror(-rc));
+			/* Cut the journal back again before the next
+			 * append in case the truncate above failed too.
+			 */
+			fs_log.torn = true;
+		}
+
+		while ((w = glist_first_entry(&batch, struct fs_log_waiter,
+					      list)) != NULL) {
+			glist_del(&w->list);
+			if (rc == 0) {
+				fs_log_apply(&fs_log.clids, &fs_log.nclids,
+					     w->op, w->tag, w->handle);
+				fs_log.nrecords++;
+			}
+			w->rc = rc;
+			w->done = true;
+		}
+
+		if (fs_log.nrecords >= fs_log_param.compact_records &&
+		    fs_log.nrecords > 2 * fs_log.nclids)
+			fs_log_compact();
+
+		fs_log.syncing = false;
+		pthread_cond_broadcast(&fs_log.cond);
+	}
+
+	PTHREAD_MUTEX_unlock(&fs_log.lock);
+
+	return me.rc;
+}
+
+static int fs_log_init(void)
+{
+	char path[PATH_MAX];
+	int err;
+
+	/* Its parent, as the default is one level below the v4 recovery
+	 * root.
+	 */
+	strlcpy(path, fs_log_param.recov_dir, sizeof(path));
+	err = mkdir(dirname(path), 0755);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir (%s): %s",
+			 path, strerror(errno));
+	}
+
+	err = mkdir(fs_log_param.recov_dir, 0700);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir (%s): %s",
+			 fs_log_param.recov_dir, strerror(errno));
+	}
+
+	if (nfs_param.core_param.clustered)
+		snprintf(fs_log.node, sizeof(fs_log.node), "node%d", g_nodeid);
+	else
+		strlcpy(fs_log.node, "local", sizeof(fs_log.node));
+
+	avltree_init(&fs_log.clids, fs_log_clid_cmpf, 0);
+
+	fs_log_path(path, sizeof(path), fs_log_param.recov_dir, fs_log.node,
+		    FS_LOG_JOURNAL);
+	fs_log.fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (fs_log.fd < 0) {
+		err = -errno;
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to open recovery journal (%s): %s",
+			path, strerror(-err));
+		return err;
+	}
+
+	fs_log.off = lseek(fs_log.fd, 0, SEEK_END);
+	if (fs_log.off < 0)
+		fs_log.off = 0;
+
+	return 0;
+}
+
+static void fs_log_shutdown(void)
+{
+	PTHREAD_MUTEX_lock(&fs_log.lock);
+	while (fs_log.syncing)
+		pthread_cond_wait(&fs_log.cond, &fs_log.lock);
+
+	if (fs_log.fd >= 0) {
+		(void) fs_log_write_all(fs_log.fd, fs_log.buf, fs_log.buf_len);
+		(void) fdatasync(fs_log.fd);
+		close(fs_log.fd);
+		fs_log.fd = -1;
+	}
+	gsh_free(fs_log.buf);
+	fs_log.buf = NULL;
+	fs_log.buf_len = fs_log.buf_size = 0;
+
+	fs_log_tree_release(&fs_log.clids);
+	fs_log.nclids = 0;
+	PTHREAD_MUTEX_unlock(&fs_log.lock);
+}
+
+/**
+ * @brief Hand every client in a tree to the SAL reclaim list
+ */
+static void fs_log_pop_clids(struct avltree *tree,
+			     add_clid_entry_hook add_clid_entry,
+			     add_rfh_entry_hook add_rfh_entry)
+{
+	struct avltree_node *node;
+	struct fs_log_clid *clid;
+	struct fs_log_rfh *rfh;
+	struct glist_head *glist;
+	clid_entry_t *new_ent;
+
+	for (node = avltree_first(tree); node; node = avltree_next(node)) {
+		clid = avltree_container_of(node, struct fs_log_clid, node);
+		new_ent = add_clid_entry(clid->tag);
+		glist_for_each(glist, &clid->rfh_list) {
+			rfh = glist_entry(glist, struct fs_log_rfh, list);
+			add_rfh_entry(new_ent, rfh->handle);
+		}
+		LogDebug(COMPONENT_CLIENTID, "added %s to clid list",
+			 new_ent->cl_name);
+	}
+}
+
+/**
+ * @brief Merge the clients of a tree into this node's old file
+ *
+ * The old file lets clients reclaim if we restart again before the grace
+ * period ends.
+ */
+static void fs_log_merge_old(struct avltree *tree)
+{
+	char path[PATH_MAX];
+	struct avltree old;
+	uint32_t nold = 0;
+	struct avltree_node *node;
+	struct fs_log_clid *clid;
+	struct fs_log_rfh *rfh;
+	struct glist_head *glist;
+
+	fs_log_path(path, sizeof(path), fs_log_param.recov_dir, fs_log.node,
+		    FS_LOG_OLD);
+
+	avltree_init(&old, fs_log_clid_cmpf, 0);
+	(void) fs_log_replay(path, &old, &nold);
+
+	for (node = avltree_first(tree); node; node = avltree_next(node)) {
+		clid = avltree_container_of(node, struct fs_log_clid, node);
+		fs_log_apply(&old, &nold, FS_LOG_OP_ADD, clid->tag, NULL);
+		glist_for_each(glist, &clid->rfh_list) {
+			rfh = glist_entry(glist, struct fs_log_rfh, list);
+			fs_log_apply(&old, &nold, FS_LOG_OP_REVOKE, clid->tag,
+				     rfh->handle);
+		}
+	}
+
+	(void) fs_log_write_tree(&old, fs_log_param.recov_dir, path);
+	fs_log_tree_release(&old);
+}
+
+/**
+ * @brief Load clients at startup
+ *
+ * Clients of the previous epoch (old file) and of the last run (snapshot
+ * and journal) are offered for reclaim.  Their union becomes the new old
+ * file and the current epoch starts out empty.
+ */
+static void fs_log_read_recov_clids_recover(add_clid_entry_hook add_clid_entry,
+					    add_rfh_entry_hook add_rfh_entry)
+{
+	char path[PATH_MAX];
+	struct avltree prev;
+	uint32_t nprev = 0;
+	int rc;
+
+	avltree_init(&prev, fs_log_clid_cmpf, 0);
+
+	fs_log_path(path, sizeof(path), fs_log_param.recov_dir, fs_log.node,
+		    FS_LOG_OLD);
+	rc = fs_log_replay(path, &prev, &nprev);
+	if (rc < 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to read v4 recovery file (%s)", path);
+
+	rc = fs_log_load(fs_log_param.recov_dir, fs_log.node, &prev, &nprev);
+	if (rc < 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to read v4 recovery journal for %s",
+			 fs_log.node);
+
+	fs_log_pop_clids(&prev, add_clid_entry, add_rfh_entry);
+
+	PTHREAD_MUTEX_lock(&fs_log.lock);
+
+	/* Persist the reclaim list before forgetting the last epoch */
+	if (fs_log_write_tree(&prev, fs_log_param.recov_dir, path) == 0) {
+		fs_log_path(path, sizeof(path), fs_log_param.recov_dir,
+			    fs_log.node, FS_LOG_SNAPSHOT);
+		if (unlink(path) < 0 && errno != ENOENT)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to remove %s: %s",
+				 path, strerror(errno));
+		if (ftruncate(fs_log.fd, 0) < 0 || fdatasync(fs_log.fd) < 0) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to truncate recovery journal: %s",
+				 strerror(errno));
+			fs_log.torn = true;
+		}
+		fs_log.off = 0;
+		fs_log.nrecords = 0;
+	}
+
+	PTHREAD_MUTEX_unlock(&fs_log.lock);
+
+	fs_log_tree_release(&prev);
+}
+
+/**
+ * @brief Load clients for recovery
+ *
+ * @param[in] gsp Grace start event, NULL at startup
+ */
+static void fs_log_read_recov_clids(nfs_grace_start_t *gsp,
+				    add_clid_entry_hook add_clid_entry,
+				    add_rfh_entry_hook add_rfh_entry)
+{
+	char dir[PATH_MAX];
+	char node[NI_MAXHOST];
+	struct avltree tree;
+	uint32_t nclids = 0;
+	int rc;
+
+	if (!gsp) {
+		fs_log_read_recov_clids_recover(add_clid_entry, add_rfh_entry);
+		return;
+	}
+
+	switch (gsp->event) {
+	case EVENT_UPDATE_CLIENTS:
+		PTHREAD_MUTEX_lock(&fs_log.lock);
+		fs_log_pop_clids(&fs_log.clids, add_clid_entry, add_rfh_entry);
+		PTHREAD_MUTEX_unlock(&fs_log.lock);
+		return;
+	case EVENT_TAKE_IP:
+		snprintf(dir, sizeof(dir), "%s/%s",
+			 fs_log_param.recov_dir, gsp->ipaddr);
+		strlcpy(node, "local", sizeof(node));
+		break;
+	case EVENT_TAKE_NODEID:
+		strlcpy(dir, fs_log_param.recov_dir, sizeof(dir));
+		snprintf(node, sizeof(node), "node%d", gsp->nodeid);
+		break;
+	default:
+		LogWarn(COMPONENT_STATE, "Recovery unknown event");
+		return;
+	}
+
+	LogEvent(COMPONENT_CLIENTID, "Recovery for nodeid %d journal (%s/%s)",
+		 gsp->nodeid, dir, node);
+
+	avltree_init(&tree, fs_log_clid_cmpf, 0);
+	rc = fs_log_load(dir, node, &tree, &nclids);
+	if (rc < 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to read v4 recovery journal (%s/%s)",
+			 dir, node);
+	} else {
+		fs_log_pop_clids(&tree, add_clid_entry, add_rfh_entry);
+		fs_log_merge_old(&tree);
+	}
+	fs_log_tree_release(&tree);
+}
+
+static void fs_log_end_grace(void)
+{
+	char path[PATH_MAX];
+
+	fs_log_path(path, sizeof(path), fs_log_param.recov_dir, fs_log.node,
+		    FS_LOG_OLD);
+	if (unlink(path) < 0 && errno != ENOENT)
+		LogEvent(COMPONENT_CLIENTID, "Failed to remove %s: %s",
+			 path, strerror(errno));
+}
+
+static void fs_log_add_clid(nfs_client_id_t *clientid)
+{
+	fs_create_clid_name(clientid);
+
+	if (clientid->cid_recov_tag == NULL)
+		return;
+
+	if (strlen(clientid->cid_recov_tag) >= PATH_MAX) {
+		LogEvent(COMPONENT_CLIENTID, "clid %s too long, not recorded",
+			 clientid->cid_recov_tag);
+		return;
+	}
+
+	if (fs_log_commit(FS_LOG_OP_ADD, clientid->cid_recov_tag,
+			  NULL) != 0) {
+		LogEvent(COMPONENT_CLIENTID, "Failed to log client [%s]",
+			 clientid->cid_recov_tag);
+		return;
+	}
+	LogDebug(COMPONENT_CLIENTID, "Logged client [%s]",
+		 clientid->cid_recov_tag);
+}
+
+static void fs_log_rm_clid(nfs_client_id_t *clientid)
+{
+	char *recov_tag = clientid->cid_recov_tag;
+
+	if (recov_tag == NULL)
+		return;
+
+	clientid->cid_recov_tag = NULL;
+	if (fs_log_commit(FS_LOG_OP_RM, recov_tag, NULL) != 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to log client removal [%s]", recov_tag);
+	else
+		LogDebug(COMPONENT_CLIENTID, "Logged client removal [%s]",
+			 recov_tag);
+	gsh_free(recov_tag);
+}
+
+static void fs_log_add_revoke_fh(nfs_client_id_t *delr_clid,
+				 nfs_fh4 *delr_handle)
+{
+	char rhdlstr[NAME_MAX];
+	int retval;
+
+	assert(delr_clid->cid_recov_tag != NULL);
+
+	/* Convert nfs_fh4_val into base64 encoded string */
+	retval = base64url_encode(delr_handle->nfs_fh4_val,
+				  delr_handle->nfs_fh4_len,
+				  rhdlstr, sizeof(rhdlstr));
+	assert(retval != -1);
+
+	if (fs_log_commit(FS_LOG_OP_REVOKE, delr_clid->cid_recov_tag,
+			  rhdlstr) != 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to log revoked handle %s for client [%s]",
+			 rhdlstr, delr_clid->cid_recov_tag);
+}
+
+int fs_log_set_param_from_conf(config_file_t parse_tree,
+			       struct config_error_type *err_type)
+{
+	(void) load_config_from_parse(parse_tree,
+				      &fs_log_param_blk,
+				      NULL,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type)) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing FS_LOG specific configuration");
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct nfs4_recovery_backend fs_log_backend = {
+	.recovery_init = fs_log_init,
+	.recovery_shutdown = fs_log_shutdown,
+	.end_grace = fs_log_end_grace,
+	.recovery_read_clids = fs_log_read_recov_clids,
+	.add_clid = fs_log_add_clid,
+	.rm_clid = fs_log_rm_clid,
+	.add_revoke_fh = fs_log_add_revoke_fh,
+};
+
+void fs_log_backend_init(struct nfs4_recovery_backend **backend)
+{
+	*backend = &fs_log_backend;
+}
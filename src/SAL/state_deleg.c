@@ -52,6 +52,11 @@
 #include "server_stats.h"
 #include "fsal_up.h"
 #include "nfs_file_handle.h"
+#include "delayed_exec.h"
+#include "abstract_atomic.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
 
 /**
  * @brief Initialize new delegation state as argument for state_add()
@@ -157,7 +162,13 @@ state_status_t acquire_lease_lock(struct state_hdl *ostate,
 state_status_t release_lease_lock(struct fsal_obj_handle *obj, state_t *state)
 {
 	state_status_t status;
-	state_owner_t *owner = get_state_owner_ref(state);
+	state_owner_t *owner;
+
+	/* Directory delegations are only known to Ganesha */
+	if (obj->type == DIRECTORY)
+		return STATE_SUCCESS;
+
+	owner = get_state_owner_ref(state);
 
 	/* Something is going stale? */
 	if (owner == NULL)
@@ -219,10 +230,14 @@ void deleg_heuristics_recall(struct fsal_obj_handle *obj,
 			     struct state_t *deleg)
 {
 	nfs_client_id_t *client = owner->so_owner.so_nfs4_owner.so_clientrec;
-	/* Update delegation stats for file. */
-	struct file_deleg_stats *statistics =
-		&obj->state_hdl->file.fdeleg_stats;
+	struct file_deleg_stats *statistics;
 
+	/* Directory delegations are not counted in the file heuristics */
+	if (obj->type != REGULAR_FILE)
+		return;
+
+	/* Update delegation stats for file. */
+	statistics = &obj->state_hdl->file.fdeleg_stats;
 	statistics->fds_curr_delegations--;
 	statistics->fds_recall_count++;
 
@@ -595,3 +610,554 @@ bool can_we_grant_deleg(struct state_hdl *ostate, state_t *open_state)
 
 	return true;
 }
+
+/******************************************************************************
+ *
+ * Directory delegations
+ *
+ ******************************************************************************/
+
+/* Most changes queued on a directory delegation.  Past this the holder
+ * is better off with a recall and a fresh READDIR.
+ */
+#define DIR_DELEG_NOTIFY_MAX 64
+
+static struct {
+	uint64_t granted;	/*< Directory delegations granted */
+	uint64_t recalled;	/*< Directory delegations recalled */
+	uint64_t notifies;	/*< CB_NOTIFY sent */
+	uint64_t changes;	/*< Changes sent in CB_NOTIFY */
+	/* Changes the holder acknowledged, each sparing it a GETATTR and
+	 * READDIR of the directory.
+	 */
+	uint64_t revalidations_avoided;
+} dir_deleg_stats;
+
+/**
+ * @brief A CB_NOTIFY in flight, freed on completion
+ */
+
+struct dir_notify_cb {
+	nfs_cb_argop4 arg;
+	uint32_t changes;	/*< Changes in the notify4 array */
+	notify4 notify[];
+};
+
+void dir_deleg_stats_granted(void)
+{
+	if (nfs_param.core_param.enable_NFSSTATS)
+		(void) atomic_inc_uint64_t(&dir_deleg_stats.granted);
+}
+
+void dir_deleg_stats_recalled(void)
+{
+	if (nfs_param.core_param.enable_NFSSTATS)
+		(void) atomic_inc_uint64_t(&dir_deleg_stats.recalled);
+}
+
+/**
+ * @brief Initialize new directory delegation state for state_add()
+ *
+ * @param[in/out] deleg_state  Delegation state struct to be init.
+ * @param[in]     notify_types Notifications granted, as NOTIFY4_* bits
+ */
+void init_new_dir_deleg_state(union state_data *deleg_state,
+			      uint32_t notify_types)
+{
+	memset(&deleg_state->deleg, 0, sizeof(deleg_state->deleg));
+	deleg_state->deleg.sd_type = OPEN_DELEGATE_READ;
+	deleg_state->deleg.sd_state = DELEG_GRANTED;
+	deleg_state->deleg.sd_notify_types = notify_types;
+}
+
+static void dir_notify_entry_free(struct dir_notify_entry *entry)
+{
+	gsh_free(entry->dne_name);
+	gsh_free(entry->dne_newname);
+	gsh_free(entry);
+}
+
+/**
+ * @brief Release what a directory delegation still has queued
+ *
+ * Called when the delegation state is deleted.
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in] dir   Directory
+ * @param[in] state Directory delegation
+ */
+void state_dir_deleg_cleanup(struct fsal_obj_handle *dir, state_t *state)
+{
+	struct state_deleg *deleg = &state->state_data.deleg;
+	struct glist_head *glist, *glistn;
+
+	glist_for_each_safe(glist, glistn, &deleg->sd_notify_list) {
+		struct dir_notify_entry *entry =
+			glist_entry(glist, struct dir_notify_entry, dne_list);
+
+		glist_del(&entry->dne_list);
+		dir_notify_entry_free(entry);
+	}
+	deleg->sd_notify_count = 0;
+
+	(void) atomic_dec_int32_t(&dir->state_hdl->dir.dir_delegations);
+}
+
+/**
+ * @brief Check whether a directory change concerns a delegation
+ *
+ * A delegation is concerned by a change made by any client but its
+ * holder.
+ *
+ * @note The state_lock MUST be held
+ */
+static bool dir_deleg_concerned(state_t *state, clientid4 clientid)
+{
+	state_owner_t *owner = state->state_owner;
+
+	if (state->state_type != STATE_TYPE_DELEG ||
+	    state->state_data.deleg.sd_state != DELEG_GRANTED)
+		return false;
+
+	return owner == NULL ||
+	       owner->so_owner.so_nfs4_owner.so_clientid != clientid;
+}
+
+/**
+ * @brief Check whether a directory change must recall a delegation
+ *
+ * It must if the holder did not ask to be notified of this kind of
+ * change, or if too many changes are already waiting for it.
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] state    State on the directory
+ * @param[in] type     The change, as a NOTIFY4_* value
+ * @param[in] clientid Client making the change, 0 if none
+ */
+bool state_dir_deleg_recall_needed(state_t *state, notify_type4 type,
+				   clientid4 clientid)
+{
+	struct state_deleg *deleg = &state->state_data.deleg;
+
+	if (!dir_deleg_concerned(state, clientid))
+		return false;
+
+	return !(deleg->sd_notify_types & (1U << type)) ||
+	       deleg->sd_notify_count >= DIR_DELEG_NOTIFY_MAX;
+}
+
+static clientid4 dir_deleg_changer(void)
+{
+	if (op_ctx != NULL && op_ctx->clientid != NULL)
+		return *op_ctx->clientid;
+
+	return 0;
+}
+
+static void dir_deleg_recall(struct fsal_obj_handle *dir, notify_type4 type,
+			     clientid4 clientid)
+{
+	if (async_dir_delegrecall(general_fridge, dir, type, clientid) != 0)
+		LogCrit(COMPONENT_STATE,
+			"Failed to start thread to recall directory delegation from conflicting operation.");
+}
+
+/**
+ * @brief Check if a directory change conflicts with delegations
+ *
+ * Called before changing a directory.  Delegations that cannot be kept
+ * up to date with CB_NOTIFY are recalled, and the caller should fail
+ * the change with a delay error so the client retries once they are
+ * returned.
+ *
+ * @param[in] dir  Directory about to be changed
+ * @param[in] type The change, as a NOTIFY4_* value
+ *
+ * @retval true if there is a conflict and the delegations are recalled.
+ * @retval false if the change may go ahead.
+ */
+bool state_dir_deleg_conflict(struct fsal_obj_handle *dir,
+			      notify_type4 type)
+{
+	struct glist_head *glist;
+	clientid4 clientid;
+	bool conflict = false;
+
+	if (!state_dir_delegated(dir))
+		return false;
+
+	clientid = dir_deleg_changer();
+
+	STATELOCK_rdlock(dir->state_hdl);
+	glist_for_each(glist, &dir->state_hdl->dir.list_of_states) {
+		state_t *state = glist_entry(glist, state_t, state_list);
+
+		if (state_dir_deleg_recall_needed(state, type, clientid)) {
+			conflict = true;
+			break;
+		}
+	}
+	STATELOCK_unlock(dir->state_hdl);
+
+	if (!conflict)
+		return false;
+
+	LogDebug(COMPONENT_STATE,
+		 "Directory change %d conflicts with a directory delegation",
+		 type);
+	dir_deleg_recall(dir, type, clientid);
+	return true;
+}
+
+/**
+ * @brief Encode one queued change as a notify4
+ *
+ * Entries are sent without attributes or cookies, which the client
+ * then gets with GETATTR or READDIR if it needs them.
+ *
+ * @param[out] notify The notify4 to fill
+ * @param[in]  entry  The change
+ *
+ * @return true if the change was encoded.
+ */
+static bool dir_notify_encode(notify4 *notify, struct dir_notify_entry *entry)
+{
+	notify_remove4 nrm;
+	notify_add4 nad;
+	notify_rename4 nrn;
+	u_int size;
+	char *buf;
+	XDR xdrs;
+	bool ok;
+
+	memset(&nrm, 0, sizeof(nrm));
+	memset(&nad, 0, sizeof(nad));
+	memset(&nrn, 0, sizeof(nrn));
+
+	/* A rename is the largest: two entries with empty attributes, the
+	 * old entry cookie, three array lengths and the last entry flag.
+	 */
+	size = 16 * BYTES_PER_XDR_UNIT + RNDUP(strlen(entry->dne_name));
+	if (entry->dne_newname != NULL)
+		size += RNDUP(strlen(entry->dne_newname));
+
+	buf = gsh_malloc(size);
+	xdrmem_create(&xdrs, buf, size, XDR_ENCODE);
+
+	switch (entry->dne_type) {
+	case NOTIFY4_REMOVE_ENTRY:
+		nrm.nrm_old_entry.ne_file.utf8string_val = entry->dne_name;
+		nrm.nrm_old_entry.ne_file.utf8string_len =
+			strlen(entry->dne_name);
+		ok = xdr_notify_remove4(&xdrs, &nrm);
+		break;
+	case NOTIFY4_ADD_ENTRY:
+		nad.nad_new_entry.ne_file.utf8string_val = entry->dne_name;
+		nad.nad_new_entry.ne_file.utf8string_len =
+			strlen(entry->dne_name);
+		ok = xdr_notify_add4(&xdrs, &nad);
+		break;
+	case NOTIFY4_RENAME_ENTRY:
+		nrn.nrn_old_entry.nrm_old_entry.ne_file.utf8string_val =
+			entry->dne_name;
+		nrn.nrn_old_entry.nrm_old_entry.ne_file.utf8string_len =
+			strlen(entry->dne_name);
+		nrn.nrn_new_entry.nad_new_entry.ne_file.utf8string_val =
+			entry->dne_newname;
+		nrn.nrn_new_entry.nad_new_entry.ne_file.utf8string_len =
+			strlen(entry->dne_newname);
+		ok = xdr_notify_rename4(&xdrs, &nrn);
+		break;
+	default:
+		ok = false;
+		break;
+	}
+
+	if (!ok) {
+		LogCrit(COMPONENT_STATE,
+			"Could not encode directory change %d",
+			entry->dne_type);
+		xdr_destroy(&xdrs);
+		gsh_free(buf);
+		return false;
+	}
+
+	notify->notify_mask.bitmap4_len = 1;
+	notify->notify_mask.map[0] = 1U << entry->dne_type;
+	notify->notify_vals.notifylist4_len = xdr_getpos(&xdrs);
+	notify->notify_vals.notifylist4_val = buf;
+	xdr_destroy(&xdrs);
+
+	return true;
+}
+
+static void dir_notify_cb_free(struct dir_notify_cb *cb)
+{
+	CB_NOTIFY4args *args = &cb->arg.nfs_cb_argop4_u.opcbnotify;
+	uint32_t i;
+
+	for (i = 0; i < cb->changes; i++)
+		gsh_free(cb->notify[i].notify_vals.notifylist4_val);
+
+	nfs4_freeFH(&args->cna_fh);
+	gsh_free(cb);
+}
+
+/**
+ * @brief Build a CB_NOTIFY from the changes queued on a delegation
+ *
+ * The queue is emptied.
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in] obj    Directory
+ * @param[in] state  Directory delegation
+ * @param[in] export Export for the file handle
+ *
+ * @return The CB_NOTIFY, NULL if there is nothing to send.
+ */
+static struct dir_notify_cb *dir_notify_cb_build(struct fsal_obj_handle *obj,
+						 state_t *state,
+						 struct gsh_export *export)
+{
+	struct state_deleg *deleg = &state->state_data.deleg;
+	CB_NOTIFY4args *args;
+	struct dir_notify_cb *cb;
+	struct glist_head *glist, *glistn;
+
+	if (deleg->sd_notify_count == 0)
+		return NULL;
+
+	cb = gsh_calloc(1, sizeof(struct dir_notify_cb) +
+			   deleg->sd_notify_count * sizeof(notify4));
+	cb->arg.argop = NFS4_OP_CB_NOTIFY;
+	args = &cb->arg.nfs_cb_argop4_u.opcbnotify;
+	COPY_STATEID(&args->cna_stateid, state);
+
+	if (!nfs4_FSALToFhandle(true, &args->cna_fh, obj, export)) {
+		LogCrit(COMPONENT_STATE,
+			"nfs4_FSALToFhandle failed, can not send CB_NOTIFY");
+		gsh_free(cb);
+		cb = NULL;
+	}
+
+	glist_for_each_safe(glist, glistn, &deleg->sd_notify_list) {
+		struct dir_notify_entry *entry =
+			glist_entry(glist, struct dir_notify_entry, dne_list);
+
+		glist_del(&entry->dne_list);
+		if (cb != NULL &&
+		    dir_notify_encode(&cb->notify[cb->changes], entry))
+			cb->changes++;
+		dir_notify_entry_free(entry);
+	}
+	deleg->sd_notify_count = 0;
+
+	if (cb != NULL && cb->changes == 0) {
+		dir_notify_cb_free(cb);
+		return NULL;
+	}
+
+	if (cb != NULL) {
+		args->cna_changes.cna_changes_len = cb->changes;
+		args->cna_changes.cna_changes_val = cb->notify;
+	}
+
+	return cb;
+}
+
+/**
+ * @brief Handle the CB_NOTIFY response
+ *
+ * @param[in] call  The RPC call being completed
+ */
+
+static void dir_notify_completion(rpc_call_t *call)
+{
+	struct dir_notify_cb *cb = call->call_arg;
+
+	LogFullDebug(COMPONENT_NFS_CB, "status %d arg %p",
+		     call->cbt.v_u.v4.res.status, call->call_arg);
+
+	if (!(call->states & NFS_CB_CALL_ABORTED) &&
+	    call->cbt.v_u.v4.res.status == NFS4_OK &&
+	    nfs_param.core_param.enable_NFSSTATS)
+		(void) atomic_add_uint64_t(
+			&dir_deleg_stats.revalidations_avoided, cb->changes);
+
+	/* Directory delegations need a session */
+	nfs41_release_single(call);
+	dir_notify_cb_free(cb);
+}
+
+/**
+ * @brief Send the changes batched on a directory delegation
+ *
+ * @param[in] ctx  The stateid other of the delegation
+ */
+
+static void dir_notify_task(void *ctx)
+{
+	struct state_t *state;
+	struct fsal_obj_handle *obj = NULL;
+	struct gsh_export *export = NULL;
+	state_owner_t *owner = NULL;
+	struct dir_notify_cb *cb = NULL;
+	struct req_op_context *save_ctx, req_ctx = {0};
+	uint32_t changes;
+	int rc;
+
+	state = nfs4_State_Get_Pointer(ctx);
+	gsh_free(ctx);
+
+	if (state == NULL) {
+		LogDebug(COMPONENT_NFS_CB,
+			 "Directory delegation is already returned");
+		return;
+	}
+
+	save_ctx = op_ctx;
+	op_ctx = &req_ctx;
+
+	if (!get_state_obj_export_owner_refs(state, &obj, &export, &owner)) {
+		LogDebug(COMPONENT_NFS_CB,
+			 "CB_NOTIFY skipped due to stale directory");
+		goto out;
+	}
+
+	op_ctx->ctx_export = export;
+	op_ctx->fsal_export = export->fsal_export;
+
+	STATELOCK_wrlock(obj->state_hdl);
+	state->state_data.deleg.sd_notify_sched = false;
+	if (state->state_data.deleg.sd_state == DELEG_GRANTED)
+		cb = dir_notify_cb_build(obj, state, export);
+	STATELOCK_unlock(obj->state_hdl);
+
+	if (cb == NULL)
+		goto out;
+
+	/* cb may be gone as soon as it is sent */
+	changes = cb->changes;
+	rc = nfs_rpc_cb_single(owner->so_owner.so_nfs4_owner.so_clientrec,
+			       &cb->arg, &state->state_refer,
+			       dir_notify_completion, cb);
+	if (rc != 0) {
+		/* The holder missed changes, have it revalidate */
+		LogDebug(COMPONENT_NFS_CB,
+			 "CB_NOTIFY could not be sent, error %d", rc);
+		dir_notify_cb_free(cb);
+		dir_deleg_recall(obj, NOTIFY4_CHANGE_DIR_ATTRS, 0);
+	} else if (nfs_param.core_param.enable_NFSSTATS) {
+		(void) atomic_inc_uint64_t(&dir_deleg_stats.notifies);
+		(void) atomic_add_uint64_t(&dir_deleg_stats.changes,
+					   changes);
+	}
+
+out:
+	if (owner != NULL)
+		dec_state_owner_ref(owner);
+	if (obj != NULL)
+		obj->obj_ops->put_ref(obj);
+	if (export != NULL)
+		put_gsh_export(export);
+	dec_state_t_ref(state);
+	op_ctx = save_ctx;
+}
+
+/**
+ * @brief Queue a directory change for the delegations on it
+ *
+ * Called after a directory was changed.  The change is batched with
+ * others for Dir_Deleg_Notify_Delay before CB_NOTIFY is sent; a
+ * delegation that cannot take it is recalled.
+ *
+ * @param[in] dir     Directory that was changed
+ * @param[in] type    The change, as a NOTIFY4_* value
+ * @param[in] name    Entry added or removed, or the old name
+ * @param[in] newname New name for NOTIFY4_RENAME_ENTRY, else NULL
+ */
+void state_dir_deleg_notify(struct fsal_obj_handle *dir, notify_type4 type,
+			    const char *name, const char *newname)
+{
+	struct glist_head *glist;
+	clientid4 clientid;
+	bool recall = false;
+	nsecs_elapsed_t delay;
+
+	if (!state_dir_delegated(dir))
+		return;
+
+	clientid = dir_deleg_changer();
+	delay = nfs_param.nfsv4_param.dir_deleg_notify_delay * NS_PER_MSEC;
+
+	STATELOCK_wrlock(dir->state_hdl);
+	glist_for_each(glist, &dir->state_hdl->dir.list_of_states) {
+		state_t *state = glist_entry(glist, state_t, state_list);
+		struct state_deleg *deleg = &state->state_data.deleg;
+		struct dir_notify_entry *entry;
+		char *other;
+
+		if (!dir_deleg_concerned(state, clientid))
+			continue;
+
+		if (state_dir_deleg_recall_needed(state, type, clientid)) {
+			/* Granted after the conflict check */
+			recall = true;
+			continue;
+		}
+
+		entry = gsh_malloc(sizeof(*entry));
+		entry->dne_type = type;
+		entry->dne_name = gsh_strdup(name);
+		entry->dne_newname = newname != NULL
+					? gsh_strdup(newname) : NULL;
+		glist_add_tail(&deleg->sd_notify_list, &entry->dne_list);
+		deleg->sd_notify_count++;
+
+		if (deleg->sd_notify_sched)
+			continue;
+
+		other = gsh_malloc(OTHERSIZE);
+		memcpy(other, state->stateid_other, OTHERSIZE);
+		if (delayed_submit(dir_notify_task, other, delay) == 0) {
+			deleg->sd_notify_sched = true;
+		} else {
+			gsh_free(other);
+			recall = true;
+		}
+	}
+	STATELOCK_unlock(dir->state_hdl);
+
+	if (recall)
+		dir_deleg_recall(dir, type, clientid);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report directory delegation statistics
+ *
+ * Appends (granted, recalled, notifies, changes, revalidations_avoided).
+ */
+void dir_deleg_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+	uint64_t val[5];
+	int i;
+
+	val[0] = atomic_fetch_uint64_t(&dir_deleg_stats.granted);
+	val[1] = atomic_fetch_uint64_t(&dir_deleg_stats.recalled);
+	val[2] = atomic_fetch_uint64_t(&dir_deleg_stats.notifies);
+	val[3] = atomic_fetch_uint64_t(&dir_deleg_stats.changes);
+	val[4] = atomic_fetch_uint64_t(&dir_deleg_stats.revalidations_avoided);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	for (i = 0; i < 5; i++)
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val[i]);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif
@@ -1291,12 +1291,23 @@ bool hold_state_owner(state_owner_t *owner)
 void state_wipe_file(struct fsal_obj_handle *obj)
 {
 	bool release;
+	struct glist_head *glist, *glistn;
+
 	/*
-	 * currently, only REGULAR files can have state; byte range locks and
-	 * stateid (for v4).  In the future, 4.1, directories could have
-	 * delegations, which is state.  At that point, we may need to modify
-	 * this routine to clear state on directories.
+	 * REGULAR files can have byte range locks and stateids (for v4);
+	 * directories can only have NFSv4.1 directory delegations.
 	 */
+	if (obj->type == DIRECTORY) {
+		STATELOCK_wrlock(obj->state_hdl);
+		glist_for_each_safe(glist, glistn,
+				    &obj->state_hdl->dir.list_of_states) {
+			state_del_locked(glist_entry(glist, state_t,
+						     state_list));
+		}
+		STATELOCK_unlock(obj->state_hdl);
+		return;
+	}
+
 	if (obj->type != REGULAR_FILE)
 		return;
 
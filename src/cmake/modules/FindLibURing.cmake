@@ -0,0 +1,45 @@
+# Tries to find liburing, the io_uring userspace library
+#
+# Usage of this module as follows:
+#
+#     find_package(LibURing)
+#
+# Variables used by this module, they can change the default behaviour and need
+# to be set before calling find_package:
+#
+#  LIBURING_PREFIX  Set this variable to the root installation of
+#                   liburing if the module has problems finding
+#                   the proper installation path.
+#
+# Variables defined by this module:
+#
+#  LIBURING_FOUND              System has liburing libs/headers
+#  LIBURING_LIBRARIES          The liburing library
+#  LIBURING_INCLUDE_DIR        The location of liburing headers
+
+find_library(LIBURING NAMES uring PATHS "${LIBURING_PREFIX}")
+check_library_exists(
+	uring
+	io_uring_queue_init
+	""
+	HAVE_IO_URING_QUEUE_INIT
+	)
+
+find_path(LIBURING_INCLUDE_DIR NAMES liburing.h
+	HINTS ${LIBURING_PREFIX}/include)
+
+if (HAVE_IO_URING_QUEUE_INIT)
+  set(LIBURING_LIBRARIES ${LIBURING})
+endif (HAVE_IO_URING_QUEUE_INIT)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(
+  LibURing
+  DEFAULT_MSG
+  LIBURING_LIBRARIES
+  LIBURING_INCLUDE_DIR)
+
+mark_as_advanced(
+  LIBURING_PREFIX
+  LIBURING_LIBRARIES
+  LIBURING_INCLUDE_DIR)
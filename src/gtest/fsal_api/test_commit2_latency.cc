@@ -105,6 +105,7 @@ namespace {
 
     struct fsal_obj_handle *test_file = nullptr;
     struct state_t* test_file_state = nullptr;
+    gtest::IOWait io_wait;
   };
 
   static void write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
@@ -115,6 +116,8 @@ namespace {
       ret = fsalstat(ERR_FSAL_LOCKED, 0);
 
     EXPECT_EQ(ret.major, 0);
+
+    static_cast<gtest::IOWait *>(caller_data)->done();
   }
 
 } /* namespace */
@@ -155,9 +158,12 @@ TEST_F(Commit2EmptyLatencyTest, SMALL_UNSTABLE_WRITE)
   write_arg.iov[0].iov_len = bytes;
   write_arg.iov[0].iov_base = databuffer;
   write_arg.io_amount = 0;
+  write_arg.attrs_out = NULL;
   write_arg.fsal_stable = false;
 
-  test_file->obj_ops->write2(test_file, true, write_cb, &write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, write_cb, &write_arg, &io_wait);
+  io_wait.wait();
 
   status = test_file->obj_ops->commit2(test_file, OFFSET, bytes);
   EXPECT_EQ(status.major, 0);
@@ -181,9 +187,12 @@ TEST_F(Commit2EmptyLatencyTest, SMALL_STABLE_WRITE)
   write_arg.iov[0].iov_len = bytes;
   write_arg.iov[0].iov_base = databuffer;
   write_arg.io_amount = 0;
+  write_arg.attrs_out = NULL;
   write_arg.fsal_stable = true;
 
-  test_file->obj_ops->write2(test_file, true, write_cb, &write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, write_cb, &write_arg, &io_wait);
+  io_wait.wait();
 
   status = test_file->obj_ops->commit2(test_file, OFFSET, bytes);
   EXPECT_EQ(status.major, 0);
@@ -207,9 +216,12 @@ TEST_F(Commit2EmptyLatencyTest, LARGE_UNSTABLE_WRITE)
   write_arg.iov[0].iov_len = bytes;
   write_arg.iov[0].iov_base = databuffer;
   write_arg.io_amount = 0;
+  write_arg.attrs_out = NULL;
   write_arg.fsal_stable = false;
 
-  test_file->obj_ops->write2(test_file, true, write_cb, &write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, write_cb, &write_arg, &io_wait);
+  io_wait.wait();
 
   status = test_file->obj_ops->commit2(test_file, OFFSET, bytes);
   EXPECT_EQ(status.major, 0);
@@ -233,9 +245,12 @@ TEST_F(Commit2EmptyLatencyTest, LARGE_STABLE_WRITE)
   write_arg.iov[0].iov_len = bytes;
   write_arg.iov[0].iov_base = databuffer;
   write_arg.io_amount = 0;
+  write_arg.attrs_out = NULL;
   write_arg.fsal_stable = true;
 
-  test_file->obj_ops->write2(test_file, true, write_cb, &write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, write_cb, &write_arg, &io_wait);
+  io_wait.wait();
 
   status = test_file->obj_ops->commit2(test_file, OFFSET, bytes);
   EXPECT_EQ(status.major, 0);
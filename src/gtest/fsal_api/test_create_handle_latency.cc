@@ -0,0 +1,383 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Lookup rate of cached handles.
+ *
+ * Wire handles of a set of files are turned back into objects the way
+ * PUTFH does, from one thread and then from several.  Run it with
+ * Handle_Index set and unset in the CacheInode block to compare the
+ * lockless handle index with the partition lookup.
+ *
+ * REAP_RACE looks handles up while the cache is kept at its high water
+ * mark, so entries are reaped and recycled under the lookups; every
+ * object found must still be the file asked for.  BUDGET checks that
+ * a memory budget shrinks the cache and reports what it freed, with or
+ * without the index, which keeps the entry pool's slabs mapped.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+#include "../FSAL/Stackable_FSALs/FSAL_MDCACHE/mdcache_debug.h"
+}
+
+#include "gtest.hh"
+
+#define TEST_ROOT "create_handle_latency"
+#define FILE_COUNT 10000
+#define LOOP_COUNT 1000000
+#define THREAD_COUNT 8
+#define REAP_COUNT 100000
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+
+  class CreateHandleLatencyTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+      struct gsh_buffdesc fh_desc;
+
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      create_and_prime_many(FILE_COUNT, objs);
+
+      for (int i = 0; i < FILE_COUNT; ++i) {
+	fh_desc.addr = wire[i];
+	fh_desc.len = NFS4_FHSIZE;
+
+	status = objs[i]->obj_ops->handle_to_wire(objs[i],
+						  FSAL_DIGEST_NFSV4,
+						  &fh_desc);
+	ASSERT_EQ(status.major, 0);
+	wire_len[i] = fh_desc.len;
+      }
+    }
+
+    virtual void TearDown() {
+      remove_many(FILE_COUNT, objs);
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    /* Turn the handle of file @a n back into an object, as PUTFH would */
+    struct fsal_obj_handle *get(int n) {
+      fsal_status_t status;
+      struct gsh_buffdesc fh_desc;
+      struct fsal_obj_handle *obj = nullptr;
+      char buf[NFS4_FHSIZE];
+
+      memcpy(buf, wire[n], wire_len[n]);
+      fh_desc.addr = buf;
+      fh_desc.len = wire_len[n];
+
+      status = op_ctx->fsal_export->exp_ops.wire_to_host(
+		op_ctx->fsal_export, FSAL_DIGEST_NFSV4, &fh_desc, 0);
+      EXPECT_EQ(status.major, 0);
+
+      status = op_ctx->fsal_export->exp_ops.create_handle(
+		op_ctx->fsal_export, &fh_desc, &obj, NULL);
+      EXPECT_EQ(status.major, 0);
+
+      return obj;
+    }
+
+    /* Look up the handle of file @a n */
+    void lookup(int n) {
+      struct fsal_obj_handle *obj = get(n);
+
+      ASSERT_NE(obj, nullptr);
+      EXPECT_EQ(obj, objs[n]);
+
+      obj->obj_ops->put_ref(obj);
+    }
+
+    /* Look up the handle of file @a n, unreferenced, and check the object
+     * found is that file and not an entry recycled for another.
+     */
+    void lookup_check(int n) {
+      fsal_status_t status;
+      struct gsh_buffdesc fh_desc;
+      struct fsal_obj_handle *obj = get(n);
+      char buf[NFS4_FHSIZE];
+
+      ASSERT_NE(obj, nullptr);
+
+      fh_desc.addr = buf;
+      fh_desc.len = NFS4_FHSIZE;
+      status = obj->obj_ops->handle_to_wire(obj, FSAL_DIGEST_NFSV4,
+					    &fh_desc);
+      EXPECT_EQ(status.major, 0);
+      EXPECT_EQ(fh_desc.len, wire_len[n]);
+      EXPECT_EQ(memcmp(buf, wire[n], wire_len[n]), 0);
+
+      obj->obj_ops->put_ref(obj);
+    }
+
+    struct fsal_obj_handle *objs[FILE_COUNT];
+    char wire[FILE_COUNT][NFS4_FHSIZE];
+    size_t wire_len[FILE_COUNT];
+  };
+
+} /* namespace */
+
+TEST_F(CreateHandleLatencyTest, SIMPLE)
+{
+  lookup(FILE_COUNT / 5);
+}
+
+TEST_F(CreateHandleLatencyTest, LOOP)
+{
+  struct timespec s_time, e_time;
+
+  enableEvents(event_list);
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  now(&s_time);
+
+  for (int i = 0; i < LOOP_COUNT; ++i)
+    lookup(i % FILE_COUNT);
+
+  now(&e_time);
+
+  if (profile_out)
+    ProfilerStop();
+  disableEvents(event_list);
+
+  fprintf(stderr, "Average time per create_handle: %" PRIu64 " ns\n",
+          timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+}
+
+TEST_F(CreateHandleLatencyTest, LOOP_THREADS)
+{
+  struct timespec s_time, e_time;
+  std::vector<std::thread> threads;
+  uint64_t ns;
+
+  enableEvents(event_list);
+
+  now(&s_time);
+
+  for (int t = 0; t < THREAD_COUNT; ++t) {
+    threads.emplace_back([this, t]() {
+	/* op_ctx is per thread */
+	op_ctx = &req_ctx;
+	for (int i = 0; i < LOOP_COUNT / THREAD_COUNT; ++i)
+	  lookup((i * THREAD_COUNT + t) % FILE_COUNT);
+      });
+  }
+
+  for (auto &thr : threads)
+    thr.join();
+
+  now(&e_time);
+
+  disableEvents(event_list);
+
+  ns = timespec_diff(&s_time, &e_time);
+  fprintf(stderr, "%d threads: %" PRIu64 " create_handle per second\n",
+	  THREAD_COUNT, (uint64_t) LOOP_COUNT * NS_PER_SEC / ns);
+}
+
+TEST_F(CreateHandleLatencyTest, REAP_RACE)
+{
+  std::vector<std::thread> threads;
+  std::atomic<bool> stop(false);
+  uint64_t save_hiwat;
+
+  /* Only entries nobody holds can be reaped */
+  for (int i = 0; i < FILE_COUNT; ++i)
+    objs[i]->obj_ops->put_ref(objs[i]);
+
+  /* Every new entry now reaps one */
+  save_hiwat = lru_set_entries_hiwat(FILE_COUNT / 2);
+
+  for (int t = 0; t < THREAD_COUNT; ++t) {
+    threads.emplace_back([this, t, &stop]() {
+	op_ctx = &req_ctx;
+	for (int i = 0; !stop; ++i)
+	  lookup_check((i * THREAD_COUNT + t) % FILE_COUNT);
+      });
+  }
+
+  /* Recycle entries under the lookups */
+  threads.emplace_back([this, &stop]() {
+      struct fsal_obj_handle *obj;
+      fsal_status_t status;
+      char fname[NAMELEN];
+
+      op_ctx = &req_ctx;
+      for (int i = 0; i < REAP_COUNT; ++i) {
+	sprintf(fname, "reap-%08x", i);
+	status = fsal_create(test_root, fname, REGULAR_FILE, &attrs, NULL,
+			     &obj, NULL);
+	EXPECT_EQ(status.major, 0);
+	if (FSAL_IS_ERROR(status))
+	  break;
+	obj->obj_ops->put_ref(obj);
+	status = fsal_remove(test_root, fname);
+	EXPECT_EQ(status.major, 0);
+      }
+      stop = true;
+    });
+
+  for (auto &thr : threads)
+    thr.join();
+
+  lru_set_entries_hiwat(save_hiwat);
+
+  /* TearDown() puts these */
+  for (int i = 0; i < FILE_COUNT; ++i)
+    objs[i] = get(i);
+}
+
+TEST_F(CreateHandleLatencyTest, BUDGET)
+{
+  uint32_t save_floor = mdcache_param.entries_budget_floor;
+  uint64_t before, after, freed;
+
+  for (int i = 0; i < FILE_COUNT; ++i)
+    objs[i]->obj_ops->put_ref(objs[i]);
+
+  mdcache_param.entries_budget_floor = FILE_COUNT / 10;
+
+  (void) lru_budget_cut(0, &before);
+  freed = lru_budget_cut(before / 2, &after);
+
+  EXPECT_GT(freed, 0U);
+  EXPECT_LT(after, before);
+
+  fprintf(stderr, "budget %" PRIu64 " of %" PRIu64 " bytes, now %" PRIu64
+	  ", freed %" PRIu64 "\n", before / 2, before, after, freed);
+
+  (void) lru_budget_cut(0, &after);
+  mdcache_param.entries_budget_floor = save_floor;
+
+  /* TearDown() puts these */
+  for (int i = 0; i < FILE_COUNT; ++i)
+    objs[i] = get(i);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+  using namespace std;
+  namespace po = boost::program_options;
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+
+      ("event-list", po::value<string>(),
+	"LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+	"Enable profiling and set output file.")
+      ;
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+  return code;
+}
@@ -0,0 +1,350 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * MDCACHE quota cache.
+ *
+ * Needs an FSAL_MEM export, whose quotas can be set without privileges on
+ * the host.  Limits changed under MDCACHE's feet show how long cached
+ * quotas are used, and writes and creates as an ordinary user check that
+ * local usage is counted and limits enforced between fetches.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include <os/quota.h>
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+#include "../FSAL/Stackable_FSALs/FSAL_MDCACHE/mdcache_ext.h"
+}
+
+#include "gtest.hh"
+
+#define TEST_ROOT "quota_cache"
+#define TEST_FILE "quota_file"
+#define EXPIRATION 60
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+
+  class QuotaCacheTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      save_expiration = mdcache_param.quota_expiration;
+      mdcache_param.quota_expiration = EXPIRATION;
+    }
+
+    virtual void TearDown() {
+      become(0);
+      mdcache_param.quota_expiration = save_expiration;
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    void become(uid_t id) {
+      user_credentials.caller_uid = id;
+      user_credentials.caller_gid = id;
+    }
+
+    /* Set limits through MDCACHE, or behind its back on the sub-FSAL */
+    void set_limits(int type, int id, fsal_quota_t *limits, bool sub) {
+      struct fsal_export *exp = op_ctx->fsal_export;
+      fsal_status_t status;
+
+      if (sub)
+	exp = exp->sub_export;
+
+      status = exp->exp_ops.set_quota(exp, a_export->fullpath, type, id,
+				      limits, NULL);
+      ASSERT_EQ(status.major, 0);
+    }
+
+    void get(int type, int id, fsal_quota_t *quota) {
+      fsal_status_t status;
+
+      status = op_ctx->fsal_export->exp_ops.get_quota(op_ctx->fsal_export,
+						      a_export->fullpath,
+						      type, id, quota);
+      ASSERT_EQ(status.major, 0);
+    }
+
+    fsal_errors_t check(int resource) {
+      return op_ctx->fsal_export->exp_ops.check_quota(op_ctx->fsal_export,
+						      a_export->fullpath,
+						      resource).major;
+    }
+
+    struct fsal_obj_handle *create(const char *name) {
+      struct fsal_obj_handle *obj = nullptr;
+      struct attrlist mode;
+      fsal_status_t status;
+
+      memset(&mode, 0, sizeof(mode));
+      FSAL_SET_MASK(mode.valid_mask, ATTR_MODE);
+      mode.mode = 0644;
+
+      status = fsal_create(test_root, name, REGULAR_FILE, &mode, NULL, &obj,
+			   NULL);
+      EXPECT_EQ(status.major, 0);
+      return obj;
+    }
+
+    static void write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 void *write_data, void *caller_data)
+    {
+      EXPECT_EQ(ret.major, 0);
+
+      static_cast<gtest::IOWait *>(caller_data)->done();
+    }
+
+    void write(struct fsal_obj_handle *obj, uint64_t offset, size_t bytes) {
+      struct fsal_io_arg *write_arg;
+      char *databuffer;
+
+      databuffer = (char *) malloc(bytes);
+      memset(databuffer, 'a', bytes);
+
+      write_arg = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
+					      sizeof(struct iovec));
+      write_arg->info = NULL;
+      write_arg->state = NULL;
+      write_arg->offset = offset;
+      write_arg->iov_count = 1;
+      write_arg->iov[0].iov_len = bytes;
+      write_arg->iov[0].iov_base = databuffer;
+      write_arg->io_amount = 0;
+      write_arg->attrs_out = NULL;
+      write_arg->fsal_stable = false;
+
+      io_wait.start();
+      obj->obj_ops->write2(obj, true, write_cb, write_arg, &io_wait);
+      io_wait.wait();
+
+      free(databuffer);
+    }
+
+    uint32_t save_expiration;
+    gtest::IOWait io_wait;
+  };
+
+} /* namespace */
+
+TEST_F(QuotaCacheTest, CACHED_UNTIL_SET)
+{
+  fsal_quota_t limits, quota;
+
+  memset(&limits, 0, sizeof(limits));
+  limits.bhardlimit = 1000;
+  set_limits(USRQUOTA, 4242, &limits, false);
+
+  get(USRQUOTA, 4242, &quota);
+  EXPECT_EQ(quota.bhardlimit, 1000UL);
+
+  /* Not seen while cached */
+  limits.bhardlimit = 2000;
+  set_limits(USRQUOTA, 4242, &limits, true);
+  get(USRQUOTA, 4242, &quota);
+  EXPECT_EQ(quota.bhardlimit, 1000UL);
+
+  /* Setting through MDCACHE fetches it again */
+  limits.bhardlimit = 3000;
+  set_limits(USRQUOTA, 4242, &limits, false);
+  get(USRQUOTA, 4242, &quota);
+  EXPECT_EQ(quota.bhardlimit, 3000UL);
+}
+
+TEST_F(QuotaCacheTest, EXPIRES)
+{
+  fsal_quota_t limits, quota;
+
+  mdcache_param.quota_expiration = 1;
+
+  memset(&limits, 0, sizeof(limits));
+  limits.fhardlimit = 10;
+  set_limits(USRQUOTA, 4243, &limits, false);
+  get(USRQUOTA, 4243, &quota);
+  EXPECT_EQ(quota.fhardlimit, 10UL);
+
+  limits.fhardlimit = 20;
+  set_limits(USRQUOTA, 4243, &limits, true);
+  get(USRQUOTA, 4243, &quota);
+  EXPECT_EQ(quota.fhardlimit, 10UL);
+
+  sleep(2);
+  get(USRQUOTA, 4243, &quota);
+  EXPECT_EQ(quota.fhardlimit, 20UL);
+}
+
+TEST_F(QuotaCacheTest, WRITE_ENFORCED)
+{
+  struct fsal_obj_handle *obj;
+  fsal_quota_t limits, quota;
+  fsal_status_t status;
+
+  /* 8k, in the 512 byte blocks of FSAL_MEM */
+  memset(&limits, 0, sizeof(limits));
+  limits.bhardlimit = 16;
+  set_limits(USRQUOTA, 4343, &limits, false);
+
+  become(4343);
+  EXPECT_EQ(check(FSAL_QUOTA_BLOCKS), ERR_FSAL_NO_ERROR);
+
+  obj = create(TEST_FILE);
+  ASSERT_NE(obj, nullptr);
+
+  /* Rewriting does not consume space */
+  write(obj, 0, 4096);
+  write(obj, 0, 4096);
+  EXPECT_EQ(check(FSAL_QUOTA_BLOCKS), ERR_FSAL_NO_ERROR);
+
+  write(obj, 4096, 4096);
+  EXPECT_EQ(check(FSAL_QUOTA_BLOCKS), ERR_FSAL_DQUOT);
+
+  /* Answered from memory, with what was written since the fetch */
+  get(USRQUOTA, 4343, &quota);
+  EXPECT_EQ(quota.curblocks, 16UL);
+  EXPECT_EQ(quota.curfiles, 1UL);
+
+  /* Root is not held to quotas */
+  become(0);
+  EXPECT_EQ(check(FSAL_QUOTA_BLOCKS), ERR_FSAL_NO_ERROR);
+
+  obj->obj_ops->put_ref(obj);
+  status = fsal_remove(test_root, TEST_FILE);
+  EXPECT_EQ(status.major, 0);
+}
+
+TEST_F(QuotaCacheTest, CREATE_ENFORCED)
+{
+  struct fsal_obj_handle *obj[2];
+  fsal_quota_t limits;
+  fsal_status_t status;
+  char name[NAMELEN];
+
+  /* Through the group quota */
+  memset(&limits, 0, sizeof(limits));
+  limits.fhardlimit = 2;
+  set_limits(GRPQUOTA, 4444, &limits, false);
+
+  become(4444);
+  EXPECT_EQ(check(FSAL_QUOTA_INODES), ERR_FSAL_NO_ERROR);
+
+  for (int i = 0; i < 2; ++i) {
+    sprintf(name, "%s-%d", TEST_FILE, i);
+    obj[i] = create(name);
+    ASSERT_NE(obj[i], nullptr);
+  }
+  EXPECT_EQ(check(FSAL_QUOTA_INODES), ERR_FSAL_DQUOT);
+
+  become(0);
+  for (int i = 0; i < 2; ++i) {
+    sprintf(name, "%s-%d", TEST_FILE, i);
+    obj[i]->obj_ops->put_ref(obj[i]);
+    status = fsal_remove(test_root, name);
+    EXPECT_EQ(status.major, 0);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+  using namespace std;
+  namespace po = boost::program_options;
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+      ;
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+  return code;
+}
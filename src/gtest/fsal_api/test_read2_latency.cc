@@ -52,6 +52,7 @@ void admin_halt(void);
 #define TEST_ROOT "read2_latency"
 #define TEST_FILE "read2_latency_file"
 #define LOOP_COUNT 1000000
+#define QUEUE_DEPTH 32
 #define OFFSET 0
 
 namespace {
@@ -103,6 +104,7 @@ namespace {
 
     struct fsal_obj_handle *test_file = nullptr;
     struct state_t *test_file_state;
+    gtest::IOWait io_wait;
   };
 
   static void callback(struct fsal_obj_handle *obj, fsal_status_t ret,
@@ -113,6 +115,8 @@ namespace {
       ret = fsalstat(ERR_FSAL_LOCKED, 0);
 
     EXPECT_EQ(ret.major, 0);
+
+    static_cast<gtest::IOWait *>(caller_data)->done();
   }
 
 } /* namespace */
@@ -138,22 +142,28 @@ TEST_F(Read2EmptyLatencyTest, SIMPLE)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = w_databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = false;
 
-  test_file->obj_ops->write2(test_file, true, callback, write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, callback, write_arg, &io_wait);
+  io_wait.wait();
 
   r_databuffer = (char *) malloc(bytes);
   read_arg = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
 					 sizeof(struct iovec));
   read_arg->info = NULL;
   read_arg->state = NULL;
+  read_arg->attrs_out = NULL;
   read_arg->offset = OFFSET;
   read_arg->iov_count = 1;
   read_arg->iov[0].iov_len = bytes;
   read_arg->iov[0].iov_base = r_databuffer;
   read_arg->io_amount = 0;
 
-  test_file->obj_ops->read2(test_file, true, callback, read_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->read2(test_file, true, callback, read_arg, &io_wait);
+  io_wait.wait();
 
   ret = memcmp(r_databuffer, w_databuffer, bytes);
   EXPECT_EQ(ret, 0);
@@ -183,12 +193,15 @@ TEST_F(Read2EmptyLatencyTest, SIMPLE_BYPASS)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = w_databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = false;
 
   sub_hdl = mdcdb_get_sub_handle(test_file);
   ASSERT_NE(sub_hdl, nullptr);
 
-  sub_hdl->obj_ops->write2(sub_hdl, true, callback, write_arg, NULL);
+  io_wait.start();
+  sub_hdl->obj_ops->write2(sub_hdl, true, callback, write_arg, &io_wait);
+  io_wait.wait();
 
   r_databuffer = (char *) malloc(bytes);
 
@@ -196,13 +209,16 @@ TEST_F(Read2EmptyLatencyTest, SIMPLE_BYPASS)
 					 sizeof(struct iovec));
   read_arg->info = NULL;
   read_arg->state = NULL;
+  read_arg->attrs_out = NULL;
   read_arg->offset = OFFSET;
   read_arg->iov_count = 1;
   read_arg->iov[0].iov_len = bytes;
   read_arg->iov[0].iov_base = r_databuffer;
   read_arg->io_amount = 0;
 
-  sub_hdl->obj_ops->read2(sub_hdl, true, callback, read_arg, NULL);
+  io_wait.start();
+  sub_hdl->obj_ops->read2(sub_hdl, true, callback, read_arg, &io_wait);
+  io_wait.wait();
 
   free(w_databuffer);
   free(r_databuffer);
@@ -229,22 +245,28 @@ TEST_F(Read2EmptyLatencyTest, LARGE_DATA_READ)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = w_databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = false;
 
-  test_file->obj_ops->write2(test_file, true, callback, write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, callback, write_arg, &io_wait);
+  io_wait.wait();
 
   r_databuffer = (char *) malloc(bytes);
   read_arg = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
 					 sizeof(struct iovec));
   read_arg->info = NULL;
   read_arg->state = NULL;
+  read_arg->attrs_out = NULL;
   read_arg->offset = OFFSET;
   read_arg->iov_count = 1;
   read_arg->iov[0].iov_len = bytes;
   read_arg->iov[0].iov_base = r_databuffer;
   read_arg->io_amount = 0;
 
-  test_file->obj_ops->read2(test_file, true, callback, read_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->read2(test_file, true, callback, read_arg, &io_wait);
+  io_wait.wait();
 
   ret = memcmp(r_databuffer, w_databuffer, bytes);
   EXPECT_EQ(ret, 0);
@@ -274,9 +296,12 @@ TEST_F(Read2EmptyLatencyTest, LOOP)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = w_databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = false;
 
-  test_file->obj_ops->write2(test_file, true, callback, write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, callback, write_arg, &io_wait);
+  io_wait.wait();
 
   bytes = 64;
   r_databuffer = (char *) malloc(bytes);
@@ -284,6 +309,7 @@ TEST_F(Read2EmptyLatencyTest, LOOP)
 					 sizeof(struct iovec));
   read_arg->info = NULL;
   read_arg->state = NULL;
+  read_arg->attrs_out = NULL;
   read_arg->offset = OFFSET;
   read_arg->iov_count = 1;
   read_arg->iov[0].iov_len = bytes;
@@ -293,7 +319,9 @@ TEST_F(Read2EmptyLatencyTest, LOOP)
   now(&s_time);
 
   for (int i = 0; i < LOOP_COUNT; ++i, read_arg->offset += 64) {
-    test_file->obj_ops->read2(test_file, true, callback, read_arg, NULL);
+    io_wait.start();
+    test_file->obj_ops->read2(test_file, true, callback, read_arg, &io_wait);
+    io_wait.wait();
   }
 
   now(&e_time);
@@ -327,12 +355,15 @@ TEST_F(Read2EmptyLatencyTest, LOOP_BYPASS)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = w_databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = false;
 
   sub_hdl = mdcdb_get_sub_handle(test_file);
   ASSERT_NE(sub_hdl, nullptr);
 
-  sub_hdl->obj_ops->write2(sub_hdl, true, callback, write_arg, NULL);
+  io_wait.start();
+  sub_hdl->obj_ops->write2(sub_hdl, true, callback, write_arg, &io_wait);
+  io_wait.wait();
 
   bytes = 64;
   r_databuffer = (char *) malloc(bytes);
@@ -340,6 +371,7 @@ TEST_F(Read2EmptyLatencyTest, LOOP_BYPASS)
                                          sizeof(struct iovec));
   read_arg->info = NULL;
   read_arg->state = NULL;
+  read_arg->attrs_out = NULL;
   read_arg->offset = OFFSET;
   read_arg->iov_count = 1;
   read_arg->iov[0].iov_len = bytes;
@@ -349,7 +381,75 @@ TEST_F(Read2EmptyLatencyTest, LOOP_BYPASS)
   now(&s_time);
 
   for (int i = 0; i < LOOP_COUNT; ++i, read_arg->offset += 64) {
-    sub_hdl->obj_ops->read2(sub_hdl, true, callback, read_arg, NULL);
+    io_wait.start();
+    sub_hdl->obj_ops->read2(sub_hdl, true, callback, read_arg, &io_wait);
+    io_wait.wait();
+  }
+
+  now(&e_time);
+
+  fprintf(stderr, "Average time per read2: %" PRIu64 " ns\n",
+          timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+
+  free(w_databuffer);
+  free(r_databuffer);
+}
+
+TEST_F(Read2EmptyLatencyTest, LOOP_QUEUED)
+{
+  char *w_databuffer;
+  char *r_databuffer;
+  struct fsal_io_arg *write_arg;
+  struct fsal_io_arg *read_arg[QUEUE_DEPTH];
+  int bytes = 64*LOOP_COUNT;
+  uint64_t offset = OFFSET;
+  struct timespec s_time, e_time;
+
+  w_databuffer = (char *) malloc(bytes);
+  memset(w_databuffer, 'a', bytes);
+
+  write_arg = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
+					  sizeof(struct iovec));
+  write_arg->info = NULL;
+  write_arg->state = NULL;
+  write_arg->offset = OFFSET;
+  write_arg->iov_count = 1;
+  write_arg->iov[0].iov_len = bytes;
+  write_arg->iov[0].iov_base = w_databuffer;
+  write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
+  write_arg->fsal_stable = false;
+
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, callback, write_arg, &io_wait);
+  io_wait.wait();
+
+  bytes = 64;
+  r_databuffer = (char *) malloc(bytes * QUEUE_DEPTH);
+  for (int j = 0; j < QUEUE_DEPTH; ++j) {
+    read_arg[j] = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
+					      sizeof(struct iovec));
+    read_arg[j]->info = NULL;
+    read_arg[j]->state = NULL;
+    read_arg[j]->attrs_out = NULL;
+    read_arg[j]->iov_count = 1;
+    read_arg[j]->iov[0].iov_len = bytes;
+    read_arg[j]->iov[0].iov_base = r_databuffer + j * bytes;
+  }
+
+  now(&s_time);
+
+  /* Keep QUEUE_DEPTH reads outstanding, so an asynchronous FSAL can
+   * overlap them */
+  for (int i = 0; i < LOOP_COUNT; i += QUEUE_DEPTH) {
+    for (int j = 0; j < QUEUE_DEPTH; ++j, offset += 64) {
+      read_arg[j]->offset = offset;
+      read_arg[j]->io_amount = 0;
+      io_wait.start();
+      test_file->obj_ops->read2(test_file, true, callback, read_arg[j],
+				&io_wait);
+    }
+    io_wait.wait();
   }
 
   now(&e_time);
@@ -52,6 +52,7 @@ void admin_halt(void);
 #define TEST_ROOT "write2_latency"
 #define TEST_FILE "test_file"
 #define LOOP_COUNT 1000000
+#define QUEUE_DEPTH 32
 #define OFFSET 0
 
 namespace {
@@ -103,6 +104,7 @@ namespace {
 
     struct fsal_obj_handle *test_file = nullptr;
     struct state_t* test_file_state;
+    gtest::IOWait io_wait;
   };
 
   static void write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
@@ -113,6 +115,8 @@ namespace {
       ret = fsalstat(ERR_FSAL_LOCKED, 0);
 
     EXPECT_EQ(ret.major, 0);
+
+    static_cast<gtest::IOWait *>(caller_data)->done();
   }
 
 } /* namespace */
@@ -135,9 +139,12 @@ TEST_F(Write2EmptyLatencyTest, SIMPLE)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = false;
 
-  test_file->obj_ops->write2(test_file, true, write_cb, write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, write_cb, write_arg, &io_wait);
+  io_wait.wait();
 
   free(databuffer);
 }
@@ -161,12 +168,15 @@ TEST_F(Write2EmptyLatencyTest, SIMPLE_BYPASS)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = false;
 
   sub_hdl = mdcdb_get_sub_handle(test_file);
   ASSERT_NE(sub_hdl, nullptr);
 
-  sub_hdl->obj_ops->write2(sub_hdl, true, write_cb, write_arg, NULL);
+  io_wait.start();
+  sub_hdl->obj_ops->write2(sub_hdl, true, write_cb, write_arg, &io_wait);
+  io_wait.wait();
 
   free(databuffer);
 }
@@ -189,9 +199,12 @@ TEST_F(Write2EmptyLatencyTest, SMALL_STABLE_WRITE)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = true;
 
-  test_file->obj_ops->write2(test_file, true, write_cb, write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, write_cb, write_arg, &io_wait);
+  io_wait.wait();
 
   free(databuffer);
 }
@@ -214,9 +227,12 @@ TEST_F(Write2EmptyLatencyTest, LARGE_UNSTABLE_WRITE)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = false;
 
-  test_file->obj_ops->write2(test_file, true, write_cb, write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, write_cb, write_arg, &io_wait);
+  io_wait.wait();
 
   free(databuffer);
 }
@@ -239,9 +255,12 @@ TEST_F(Write2EmptyLatencyTest, LARGE_STABLE_WRITE)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = true;
 
-  test_file->obj_ops->write2(test_file, true, write_cb, write_arg, NULL);
+  io_wait.start();
+  test_file->obj_ops->write2(test_file, true, write_cb, write_arg, &io_wait);
+  io_wait.wait();
 
   free(databuffer);
 }
@@ -265,12 +284,15 @@ TEST_F(Write2EmptyLatencyTest, LOOP)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = false;
 
   now(&s_time);
 
   for (int i = 0; i < LOOP_COUNT; ++i, write_arg->offset += 64) {
-    test_file->obj_ops->write2(test_file, true, write_cb, write_arg, NULL);
+    io_wait.start();
+    test_file->obj_ops->write2(test_file, true, write_cb, write_arg, &io_wait);
+    io_wait.wait();
   }
 
   now(&e_time);
@@ -301,6 +323,7 @@ TEST_F(Write2EmptyLatencyTest, LOOP_BYPASS)
   write_arg->iov[0].iov_len = bytes;
   write_arg->iov[0].iov_base = databuffer;
   write_arg->io_amount = 0;
+  write_arg->attrs_out = NULL;
   write_arg->fsal_stable = false;
 
   sub_hdl = mdcdb_get_sub_handle(test_file);
@@ -309,7 +332,55 @@ TEST_F(Write2EmptyLatencyTest, LOOP_BYPASS)
   now(&s_time);
 
   for (int i = 0; i < LOOP_COUNT; ++i, write_arg->offset += 64) {
-    sub_hdl->obj_ops->write2(sub_hdl, true, write_cb, write_arg, NULL);
+    io_wait.start();
+    sub_hdl->obj_ops->write2(sub_hdl, true, write_cb, write_arg, &io_wait);
+    io_wait.wait();
+  }
+
+  now(&e_time);
+
+  fprintf(stderr, "Average time per write2: %" PRIu64 " ns\n",
+          timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+
+  free(databuffer);
+}
+
+TEST_F(Write2EmptyLatencyTest, LOOP_QUEUED)
+{
+  char *databuffer;
+  struct fsal_io_arg *write_arg[QUEUE_DEPTH];
+  struct timespec s_time, e_time;
+  uint64_t offset = OFFSET;
+  int bytes = 64;
+  databuffer = (char *) malloc(bytes);
+
+  memset(databuffer, 'a', bytes);
+
+  for (int j = 0; j < QUEUE_DEPTH; ++j) {
+    write_arg[j] = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
+					       sizeof(struct iovec));
+    write_arg[j]->info = NULL;
+    write_arg[j]->state = NULL;
+    write_arg[j]->iov_count = 1;
+    write_arg[j]->iov[0].iov_len = bytes;
+    write_arg[j]->iov[0].iov_base = databuffer;
+    write_arg[j]->attrs_out = NULL;
+    write_arg[j]->fsal_stable = false;
+  }
+
+  now(&s_time);
+
+  /* Keep QUEUE_DEPTH writes outstanding, so an asynchronous FSAL can
+   * overlap them */
+  for (int i = 0; i < LOOP_COUNT; i += QUEUE_DEPTH) {
+    for (int j = 0; j < QUEUE_DEPTH; ++j, offset += 64) {
+      write_arg[j]->offset = offset;
+      write_arg[j]->io_amount = 0;
+      io_wait.start();
+      test_file->obj_ops->write2(test_file, true, write_cb, write_arg[j],
+				 &io_wait);
+    }
+    io_wait.wait();
   }
 
   now(&e_time);
@@ -0,0 +1,408 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/exception.hpp>
+#include <boost/program_options.hpp>
+#include <arpa/inet.h>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+/* For MDCACHE bypass.  Use with care */
+#include "../FSAL/Stackable_FSALs/FSAL_MDCACHE/mdcache_debug.h"
+}
+
+#include "gtest.hh"
+
+#define TEST_ROOT "write_same2_latency"
+#define TEST_FILE "test_file"
+#define LOOP_COUNT 1024
+#define CHUNK_SIZE (1024 * 1024)
+#define BLOCK_SIZE 4096
+#define OFFSET 0
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+
+  class WriteSame2LatencyTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+      bool caller_perm_check = false;
+
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      test_file_state = op_ctx->fsal_export->exp_ops.alloc_state(
+						op_ctx->fsal_export,
+						STATE_TYPE_SHARE,
+						NULL);
+      ASSERT_NE(test_file_state, nullptr);
+
+      status = test_root->obj_ops->open2(test_root, test_file_state,
+                      FSAL_O_RDWR, FSAL_UNCHECKED, TEST_FILE, NULL, NULL,
+                      &test_file, NULL, &caller_perm_check);
+      ASSERT_EQ(status.major, 0);
+    }
+
+    virtual void TearDown() {
+      fsal_status_t status;
+
+      status = test_file->obj_ops->close2(test_file, test_file_state);
+      EXPECT_EQ(0, status.major);
+
+      op_ctx->fsal_export->exp_ops.free_state(op_ctx->fsal_export,
+					      test_file_state);
+
+      status = fsal_remove(test_root, TEST_FILE);
+      EXPECT_EQ(status.major, 0);
+      test_file->obj_ops->put_ref(test_file);
+      test_file = NULL;
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    /* Write CHUNK_SIZE bytes with write2, as a client would without
+     * WRITE_SAME */
+    void write_chunk(char *databuffer, uint64_t offset) {
+      struct fsal_io_arg *write_arg;
+
+      write_arg = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
+					      sizeof(struct iovec));
+      write_arg->info = NULL;
+      write_arg->state = NULL;
+      write_arg->offset = offset;
+      write_arg->iov_count = 1;
+      write_arg->iov[0].iov_len = CHUNK_SIZE;
+      write_arg->iov[0].iov_base = databuffer;
+      write_arg->io_amount = 0;
+      write_arg->attrs_out = NULL;
+      write_arg->fsal_stable = false;
+
+      io_wait.start();
+      test_file->obj_ops->write2(test_file, true, io_cb, write_arg,
+				 &io_wait);
+      io_wait.wait();
+    }
+
+    void read_chunk(char *databuffer, uint64_t offset, size_t len) {
+      struct fsal_io_arg *read_arg;
+
+      read_arg = (struct fsal_io_arg*)alloca(sizeof(struct fsal_io_arg) +
+					     sizeof(struct iovec));
+      read_arg->info = NULL;
+      read_arg->state = NULL;
+      read_arg->attrs_out = NULL;
+      read_arg->offset = offset;
+      read_arg->iov_count = 1;
+      read_arg->iov[0].iov_len = len;
+      read_arg->iov[0].iov_base = databuffer;
+      read_arg->io_amount = 0;
+      read_arg->end_of_file = false;
+
+      io_wait.start();
+      test_file->obj_ops->read2(test_file, true, io_cb, read_arg, &io_wait);
+      io_wait.wait();
+    }
+
+    static void io_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+		      void *io_data, void *caller_data)
+    {
+      EXPECT_EQ(ret.major, 0);
+
+      static_cast<gtest::IOWait *>(caller_data)->done();
+    }
+
+    struct fsal_obj_handle *test_file = nullptr;
+    struct state_t* test_file_state;
+    gtest::IOWait io_wait;
+  };
+
+  void init_ws_arg(struct fsal_write_same_arg *ws_arg, char *pattern,
+		   size_t len)
+  {
+    memset(ws_arg, 0, sizeof(*ws_arg));
+    ws_arg->offset = OFFSET;
+    ws_arg->block_size = BLOCK_SIZE;
+    ws_arg->block_count = CHUNK_SIZE / BLOCK_SIZE;
+    ws_arg->reloff_blocknum = BLOCK_SIZE;	/* no block numbers */
+    ws_arg->pattern.addr = pattern;
+    ws_arg->pattern.len = len;
+  }
+
+  void report(const char *what, struct timespec *s_time,
+	      struct timespec *e_time)
+  {
+    uint64_t ns = timespec_diff(s_time, e_time);
+
+    fprintf(stderr, "%s: %" PRIu64 " ns per MiB, %" PRIu64 " MiB/s\n",
+	    what, ns / LOOP_COUNT,
+	    ns == 0 ? 0 : (uint64_t)LOOP_COUNT * 1000000000 / ns);
+  }
+
+} /* namespace */
+
+TEST_F(WriteSame2LatencyTest, ZERO)
+{
+  struct fsal_write_same_arg ws_arg;
+  fsal_status_t status;
+  char *databuffer = (char *) malloc(BLOCK_SIZE);
+
+  init_ws_arg(&ws_arg, NULL, 0);
+
+  status = test_file->obj_ops->write_same2(test_file, NULL, &ws_arg);
+  if (status.major == ERR_FSAL_NOTSUPP) {
+    free(databuffer);
+    return;
+  }
+  ASSERT_EQ(status.major, 0);
+  EXPECT_EQ(ws_arg.io_amount, (uint64_t)CHUNK_SIZE);
+
+  read_chunk(databuffer, OFFSET + CHUNK_SIZE - BLOCK_SIZE, BLOCK_SIZE);
+  for (int i = 0; i < BLOCK_SIZE; ++i)
+    ASSERT_EQ(databuffer[i], 0);
+
+  free(databuffer);
+}
+
+TEST_F(WriteSame2LatencyTest, NUMBERED_PATTERN)
+{
+  struct fsal_write_same_arg ws_arg;
+  fsal_status_t status;
+  char pattern[] = "abc";
+  char *databuffer = (char *) malloc(2 * BLOCK_SIZE);
+  uint32_t num;
+
+  init_ws_arg(&ws_arg, pattern, 3);
+  ws_arg.block_count = 2;
+  ws_arg.reloff_pattern = 8;
+  ws_arg.reloff_blocknum = 0;
+  ws_arg.block_num = 41;
+
+  status = test_file->obj_ops->write_same2(test_file, NULL, &ws_arg);
+  if (status.major == ERR_FSAL_NOTSUPP) {
+    free(databuffer);
+    return;
+  }
+  ASSERT_EQ(status.major, 0);
+  EXPECT_EQ(ws_arg.io_amount, (uint64_t)2 * BLOCK_SIZE);
+
+  read_chunk(databuffer, OFFSET, 2 * BLOCK_SIZE);
+
+  for (int b = 0; b < 2; ++b) {
+    char *block = databuffer + b * BLOCK_SIZE;
+
+    memcpy(&num, block, sizeof(num));
+    EXPECT_EQ(ntohl(num), 41U + b);
+    for (int i = 4; i < 8; ++i)
+      EXPECT_EQ(block[i], 0);
+    for (int i = 8; i < BLOCK_SIZE; ++i)
+      ASSERT_EQ(block[i], pattern[(i - 8) % 3]);
+  }
+
+  free(databuffer);
+}
+
+TEST_F(WriteSame2LatencyTest, ZERO_THROUGHPUT)
+{
+  struct fsal_write_same_arg ws_arg;
+  struct timespec s_time, e_time;
+  fsal_status_t status;
+  char *databuffer = (char *) calloc(1, CHUNK_SIZE);
+
+  now(&s_time);
+
+  for (int i = 0; i < LOOP_COUNT; ++i)
+    write_chunk(databuffer, OFFSET + (uint64_t)i * CHUNK_SIZE);
+
+  now(&e_time);
+  report("write2 of zeroes", &s_time, &e_time);
+
+  init_ws_arg(&ws_arg, NULL, 0);
+
+  now(&s_time);
+
+  for (int i = 0; i < LOOP_COUNT; ++i, ws_arg.offset += CHUNK_SIZE) {
+    status = test_file->obj_ops->write_same2(test_file, NULL, &ws_arg);
+    if (status.major == ERR_FSAL_NOTSUPP)
+      break;
+    ASSERT_EQ(status.major, 0);
+  }
+
+  now(&e_time);
+  if (status.major == 0)
+    report("write_same2 of zeroes", &s_time, &e_time);
+
+  free(databuffer);
+}
+
+TEST_F(WriteSame2LatencyTest, PATTERN_THROUGHPUT)
+{
+  struct fsal_write_same_arg ws_arg;
+  struct timespec s_time, e_time;
+  fsal_status_t status;
+  char pattern[512];
+  char *databuffer = (char *) malloc(CHUNK_SIZE);
+
+  for (size_t i = 0; i < sizeof(pattern); ++i)
+    pattern[i] = 'A' + i % 26;
+  for (int i = 0; i < CHUNK_SIZE; ++i)
+    databuffer[i] = pattern[i % sizeof(pattern)];
+
+  now(&s_time);
+
+  for (int i = 0; i < LOOP_COUNT; ++i)
+    write_chunk(databuffer, OFFSET + (uint64_t)i * CHUNK_SIZE);
+
+  now(&e_time);
+  report("write2 of a pattern", &s_time, &e_time);
+
+  init_ws_arg(&ws_arg, pattern, sizeof(pattern));
+
+  now(&s_time);
+
+  for (int i = 0; i < LOOP_COUNT; ++i, ws_arg.offset += CHUNK_SIZE) {
+    status = test_file->obj_ops->write_same2(test_file, NULL, &ws_arg);
+    if (status.major == ERR_FSAL_NOTSUPP)
+      break;
+    ASSERT_EQ(status.major, 0);
+  }
+
+  now(&e_time);
+  if (status.major == 0)
+    report("write_same2 of a pattern", &s_time, &e_time);
+
+  free(databuffer);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+
+      ("event-list", po::value<string>(),
+	"LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+	"Enable profiling and set output file.")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -23,6 +23,8 @@
  */
 
 #include "gtest/gtest.h"
+#include <mutex>
+#include <condition_variable>
 
 extern "C" {
 /* Manually forward this, an 9P is not C++ safe */
@@ -56,6 +58,33 @@ namespace gtest {
 
   class Environment* env;
 
+  /* FSAL read2/write2 may complete on another thread; track outstanding
+   * I/O so tests can wait for their callbacks. */
+  class IOWait {
+  public:
+    void start() {
+      std::lock_guard<std::mutex> lock(mtx);
+      ++pending;
+    }
+
+    void done() {
+      std::lock_guard<std::mutex> lock(mtx);
+      --pending;
+      cond.notify_all();
+    }
+
+    /* Wait until no more than max_pending I/Os are outstanding */
+    void wait(unsigned max_pending = 0) {
+      std::unique_lock<std::mutex> lock(mtx);
+      cond.wait(lock, [&] { return pending <= max_pending; });
+    }
+
+  private:
+    std::mutex mtx;
+    std::condition_variable cond;
+    unsigned pending = 0;
+  };
+
   class Environment : public ::testing::Environment {
   public:
     Environment() : Environment(NULL, NULL, -1, NULL) {}
@@ -0,0 +1,229 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Startup benchmark for export initialization.
+ *
+ * A batch of synthetic FSAL_MEM exports is parsed the way the startup
+ * configuration is, then their roots are initialized and they are mounted
+ * in the PseudoFS, first with one thread and then with several.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "nfs_core.h"
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "nfs_proto_functions.h"
+#include "config_parsing.h"
+#include "common_utils.h"
+}
+
+#include "gtest.hh"
+
+#define EXPORT_COUNT 1024
+#define EXPORT_ID_BASE 1000
+#define THREAD_COUNT 16
+#define CONF_PATH "/tmp/ganesha_export_init_bench.conf"
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+
+  class ExportInitLatencyTest : public gtest::GaneshaBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      std::ofstream conf(CONF_PATH);
+
+      for (int i = 0; i < EXPORT_COUNT; ++i) {
+	conf << "EXPORT {\n"
+	     << "  Export_Id = " << EXPORT_ID_BASE + i << ";\n"
+	     << "  Path = \"/export_init_bench/e" << i << "\";\n"
+	     << "  Pseudo = \"/export_init_bench/e" << i << "\";\n"
+	     << "  Access_Type = RW;\n"
+	     << "  Protocols = 3, 4;\n"
+	     << "  FSAL { Name = MEM; }\n"
+	     << "}\n";
+      }
+      conf.close();
+
+      save_threads = nfs_param.core_param.export_init_threads;
+    }
+
+    virtual void TearDown() {
+      struct gsh_export *exp;
+
+      for (int i = 0; i < EXPORT_COUNT; ++i) {
+	exp = get_gsh_export(EXPORT_ID_BASE + i);
+	if (exp == NULL)
+	  continue;
+	unexport(exp);
+	put_gsh_export(exp);
+      }
+
+      nfs_param.core_param.export_init_threads = save_threads;
+      unlink(CONF_PATH);
+    }
+
+    void read_exports() {
+      struct config_error_type err_type;
+      config_file_t config;
+
+      ASSERT_TRUE(init_error_type(&err_type));
+      config = config_ParseFile((char *) CONF_PATH, &err_type);
+      ASSERT_NE(config, nullptr);
+      EXPECT_EQ(ReadExports(config, &err_type), EXPORT_COUNT);
+      report_config_errors(&err_type, NULL, config_errs_to_log);
+      config_Free(config);
+    }
+
+    void run(uint32_t nthreads) {
+      struct timespec s_time, e_time, m_time;
+
+      nfs_param.core_param.export_init_threads = nthreads;
+
+      read_exports();
+
+      now(&s_time);
+      exports_pkginit();
+      now(&m_time);
+      create_pseudofs();
+      now(&e_time);
+
+      for (int i = 0; i < EXPORT_COUNT; ++i) {
+	struct gsh_export *exp = get_gsh_export(EXPORT_ID_BASE + i);
+
+	ASSERT_NE(exp, nullptr);
+	EXPECT_NE(exp->exp_root_obj, nullptr);
+	EXPECT_NE(exp->exp_junction_obj, nullptr);
+	put_gsh_export(exp);
+      }
+
+      fprintf(stderr, "%d exports, %" PRIu32 " threads: roots %" PRIu64
+	      " us, pseudofs %" PRIu64 " us\n", EXPORT_COUNT, nthreads,
+	      timespec_diff(&s_time, &m_time) / 1000,
+	      timespec_diff(&m_time, &e_time) / 1000);
+    }
+
+    uint32_t save_threads;
+  };
+
+} /* namespace */
+
+TEST_F(ExportInitLatencyTest, SERIAL)
+{
+  run(1);
+}
+
+TEST_F(ExportInitLatencyTest, PARALLEL)
+{
+  run(THREAD_COUNT);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, nullptr, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
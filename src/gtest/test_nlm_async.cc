@@ -0,0 +1,450 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * NLM GRANTED callback pipelining.
+ *
+ * A stand-in NLM client listens on the loopback and counts the calls it
+ * is sent.  GRANTED_MSG calls must go out without waiting for their
+ * GRANTED_RES, up to NLM_Callback_Window per client, and a GRANTED_RES
+ * must free its own slot.  Further grants are deferred, without holding
+ * up the thread sending them, until a slot is free.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "nfs_core.h"
+#include "sal_data.h"
+#include "nlm4.h"
+#include "nlm_async.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+}
+
+#include "gtest.hh"
+
+#define GRANT_COUNT 64
+#define WINDOW 16
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  /* Grants not yet sent, deferred ones may go from a callback thread */
+  std::atomic<int> unsent {0};
+
+  /* Listens on ::1 and counts the RPC calls it receives, by procedure */
+  class StandInClient {
+  public:
+    StandInClient() {
+      struct sockaddr_in6 addr;
+      socklen_t len = sizeof(addr);
+
+      lfd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
+      memset(&addr, 0, sizeof(addr));
+      addr.sin6_family = AF_INET6;
+      addr.sin6_addr = in6addr_loopback;
+      bind(lfd, (struct sockaddr *) &addr, sizeof(addr));
+      listen(lfd, 8);
+      getsockname(lfd, (struct sockaddr *) &bound, &len);
+
+      thr = std::thread([this]() { serve(); });
+    }
+
+    ~StandInClient() {
+      shutdown(lfd, SHUT_RDWR);
+      if (cfd >= 0)
+	shutdown(cfd, SHUT_RDWR);
+      thr.join();
+      close(lfd);
+      if (cfd >= 0)
+	close(cfd);
+    }
+
+    /* Wait for @a n calls to @a proc, up to a second */
+    bool wait_calls(int proc, int n) {
+      for (int i = 0; i < 1000; ++i) {
+	if (calls[proc].load() >= n)
+	  return true;
+	usleep(1000);
+      }
+      return false;
+    }
+
+    struct sockaddr_in6 bound;
+    std::atomic<int> calls[NLMPROC4_FREE_ALL + 1] {};
+
+  private:
+    bool read_full(void *buf, size_t len) {
+      char *p = (char *) buf;
+
+      while (len > 0) {
+	ssize_t n = read(cfd, p, len);
+
+	if (n <= 0)
+	  return false;
+	p += n;
+	len -= n;
+      }
+      return true;
+    }
+
+    void serve() {
+      uint32_t mark, len, hdr[6];
+      char body[4096];
+
+      cfd = accept(lfd, NULL, NULL);
+      if (cfd < 0)
+	return;
+
+      /* One record per call: xid, CALL, rpcvers, prog, vers, proc... */
+      while (read_full(&mark, sizeof(mark))) {
+	len = ntohl(mark) & 0x7fffffff;
+	if (len < sizeof(hdr) || len > sizeof(body))
+	  return;
+	if (!read_full(body, len))
+	  return;
+	memcpy(hdr, body, sizeof(hdr));
+	if (ntohl(hdr[3]) == NLMPROG && ntohl(hdr[5]) <= NLMPROC4_FREE_ALL)
+	  calls[ntohl(hdr[5])]++;
+      }
+    }
+
+    int lfd = -1;
+    std::atomic<int> cfd {-1};
+    std::thread thr;
+  };
+
+  class NLMAsyncTest : public gtest::GaneshaBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      struct sockaddr_in6 *local;
+
+      memset(&nsm, 0, sizeof(nsm));
+      memset(&host, 0, sizeof(host));
+
+      nsm.ssc_nlm_caller_name = (char *) "localhost";
+      nsm.ssc_nlm_caller_name_len = strlen(nsm.ssc_nlm_caller_name);
+
+      host.slc_nsm_client = &nsm;
+      host.slc_nlm_caller_name = nsm.ssc_nlm_caller_name;
+      host.slc_nlm_caller_name_len = nsm.ssc_nlm_caller_name_len;
+      host.slc_client_type = XPRT_TCP;
+      host.slc_refcount = 1;
+
+      local = (struct sockaddr_in6 *) &host.slc_server_addr;
+      local->sin6_family = AF_INET6;
+      local->sin6_addr = in6addr_loopback;
+
+      nlm_async_host_init(&host);
+
+      /* Resolved already, no portmapper involved */
+      memcpy(&host.slc_callback_addr, &client.bound, sizeof(client.bound));
+      host.slc_callback_addrlen = sizeof(client.bound);
+      host.slc_callback_expire = time(NULL) + 3600;
+
+      save_window = nfs_param.core_param.nlm_callback_window;
+      nfs_param.core_param.nlm_callback_window = WINDOW;
+
+      memset(&grant, 0, sizeof(grant));
+      grant.alock.caller_name = nsm.ssc_nlm_caller_name;
+      grant.alock.fh.n_len = sizeof(fh);
+      grant.alock.fh.n_bytes = fh;
+      grant.alock.oh.n_len = sizeof(oh);
+      grant.alock.oh.n_bytes = oh;
+    }
+
+    virtual void TearDown() {
+      /* Let callback threads and the expiry check let go of the host */
+      for (int i = 0; i < 10000; ++i) {
+	if (unsent.load() == 0 &&
+	    atomic_fetch_int32_t(&host.slc_refcount) == 1)
+	  break;
+	usleep(1000);
+      }
+
+      nfs_param.core_param.nlm_callback_window = save_window;
+      nlm_async_host_fini(&host);
+    }
+
+    /* What nlm4_send_grant_msg does, rerun once a deferred call has a
+     * slot.
+     */
+    static void send_grant_msg(state_async_queue_t *arg) {
+      state_nlm_async_data_t *nlm_arg =
+	&arg->state_async_data.state_nlm_async_data;
+
+      if (!nlm_inflight_reserve(nlm_arg->nlm_async_host, arg))
+	return;
+
+      EXPECT_EQ(nlm_send_async(NLMPROC4_GRANTED_MSG,
+			       nlm_arg->nlm_async_host,
+			       &nlm_arg->nlm_async_args.nlm_async_grant,
+			       nlm_arg->nlm_async_key),
+		RPC_SUCCESS);
+      unsent--;
+    }
+
+    /* Grant @a i, its key i + 1 as 0 is no key */
+    void send_grant(int i) {
+      state_async_queue_t *arg = &args[i];
+      state_nlm_async_data_t *nlm_arg =
+	&arg->state_async_data.state_nlm_async_data;
+      nlm4_testargs *inarg = &nlm_arg->nlm_async_args.nlm_async_grant;
+
+      memset(arg, 0, sizeof(*arg));
+      arg->state_async_func = send_grant_msg;
+      nlm_arg->nlm_async_host = &host;
+      nlm_arg->nlm_async_key = key(i);
+
+      *inarg = grant;
+      inarg->cookie.n_len = sizeof(keys[i]);
+      inarg->cookie.n_bytes = (char *) &keys[i];
+      inarg->alock.svid = i;
+      keys[i] = key(i);
+
+      unsent++;
+      arg->state_async_func(arg);
+    }
+
+    static uint64_t key(int i) {
+      return i + 1;
+    }
+
+    StandInClient client;
+    state_nsm_client_t nsm;
+    state_nlm_client_t host;
+    nlm4_testargs grant;
+    char fh[32] = {};
+    char oh[16] = {};
+    uint64_t keys[GRANT_COUNT] = {};
+    state_async_queue_t args[GRANT_COUNT];
+    uint32_t save_window;
+  };
+
+} /* namespace */
+
+TEST_F(NLMAsyncTest, REPLY_DOES_NOT_HOLD_A_SLOT)
+{
+  nlm4_res res;
+
+  memset(&res, 0, sizeof(res));
+  res.stat.stat = NLM4_GRANTED;
+
+  EXPECT_EQ(nlm_send_async(NLMPROC4_LOCK_RES, &host, &res, NULL),
+	    RPC_SUCCESS);
+  EXPECT_TRUE(client.wait_calls(NLMPROC4_LOCK_RES, 1));
+  EXPECT_EQ(host.slc_inflight_count, 0U);
+}
+
+TEST_F(NLMAsyncTest, PIPELINED)
+{
+  struct timespec s_time, e_time;
+
+  now(&s_time);
+  for (int i = 0; i < WINDOW; ++i)
+    send_grant(i);
+  now(&e_time);
+
+  /* No call waited for its GRANTED_RES */
+  EXPECT_LT(timespec_diff(&s_time, &e_time), NS_PER_SEC);
+  EXPECT_TRUE(client.wait_calls(NLMPROC4_GRANTED_MSG, WINDOW));
+  EXPECT_EQ(host.slc_inflight_count, (uint32_t) WINDOW);
+
+  /* Answered out of order, each frees its own slot */
+  for (int i = WINDOW - 1; i >= 0; --i)
+    nlm_signal_async_resp(&host, key(i));
+  EXPECT_EQ(host.slc_inflight_count, 0U);
+
+  /* A late or duplicate GRANTED_RES is harmless */
+  nlm_signal_async_resp(&host, key(0));
+  EXPECT_EQ(host.slc_inflight_count, 0U);
+
+  fprintf(stderr, "%d GRANTED_MSG sent in %" PRIu64 " us\n", WINDOW,
+	  timespec_diff(&s_time, &e_time) / 1000);
+}
+
+TEST_F(NLMAsyncTest, WINDOW_FULL)
+{
+  struct timespec s_time, e_time;
+
+  for (int i = 0; i < WINDOW; ++i)
+    send_grant(i);
+  EXPECT_TRUE(client.wait_calls(NLMPROC4_GRANTED_MSG, WINDOW));
+
+  /* The client has not answered anything, the next grant is deferred
+   * without holding up this thread.
+   */
+  now(&s_time);
+  send_grant(WINDOW);
+  now(&e_time);
+  EXPECT_LT(timespec_diff(&s_time, &e_time), NS_PER_SEC / 10);
+
+  usleep(200000);
+  EXPECT_EQ(client.calls[NLMPROC4_GRANTED_MSG].load(), WINDOW);
+
+  /* An unknown GRANTED_RES frees nothing */
+  nlm_signal_async_resp(&host, key(GRANT_COUNT));
+  usleep(200000);
+  EXPECT_EQ(client.calls[NLMPROC4_GRANTED_MSG].load(), WINDOW);
+
+  /* One GRANTED_RES lets it through */
+  nlm_signal_async_resp(&host, key(3));
+
+  EXPECT_TRUE(client.wait_calls(NLMPROC4_GRANTED_MSG, WINDOW + 1));
+  EXPECT_EQ(host.slc_inflight_count, (uint32_t) WINDOW);
+}
+
+TEST_F(NLMAsyncTest, WINDOW_EXPIRED)
+{
+  for (int i = 0; i < WINDOW + 1; ++i)
+    send_grant(i);
+
+  /* Nothing is answered, the deferred grant goes once the oldest call
+   * gives up its slot.
+   */
+  EXPECT_TRUE(client.wait_calls(NLMPROC4_GRANTED_MSG, WINDOW));
+  usleep(200000);
+  EXPECT_EQ(client.calls[NLMPROC4_GRANTED_MSG].load(), WINDOW);
+
+  for (int i = 0; i < 10 && !client.wait_calls(NLMPROC4_GRANTED_MSG,
+						WINDOW + 1); ++i)
+    ;
+  EXPECT_EQ(client.calls[NLMPROC4_GRANTED_MSG].load(), WINDOW + 1);
+}
+
+TEST_F(NLMAsyncTest, MANY_GRANTS)
+{
+  struct timespec s_time, e_time;
+  std::thread answer;
+
+  /* The stand-in answers each grant after a round trip's delay */
+  answer = std::thread([this]() {
+      for (int i = 0; i < GRANT_COUNT; ++i) {
+	client.wait_calls(NLMPROC4_GRANTED_MSG, i + 1);
+	usleep(100);
+	nlm_signal_async_resp(&host, key(i));
+      }
+    });
+
+  now(&s_time);
+  for (int i = 0; i < GRANT_COUNT; ++i)
+    send_grant(i);
+  answer.join();
+  now(&e_time);
+
+  EXPECT_EQ(client.calls[NLMPROC4_GRANTED_MSG].load(), GRANT_COUNT);
+  EXPECT_EQ(host.slc_inflight_count, 0U);
+
+  fprintf(stderr, "%d GRANTED_MSG answered in %" PRIu64 " us\n",
+	  GRANT_COUNT, timespec_diff(&s_time, &e_time) / 1000);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, nullptr, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
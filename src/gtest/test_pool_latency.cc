@@ -0,0 +1,223 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Object pool allocator tests, compared against plain gsh_calloc.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "abstract_mem.h"
+#include "common_utils.h"
+}
+
+#define LOOP_COUNT 1000000
+#define BATCH 256
+#define THREAD_COUNT 16
+#define OBJECT_SIZE 600
+
+namespace {
+
+  std::atomic<uint64_t> nconstructed;
+
+  struct ctor_object {
+    uint64_t magic;
+    char payload[OBJECT_SIZE];
+  };
+
+  void ctor(void *object)
+  {
+    ((struct ctor_object *) object)->magic = 0xfeedface;
+    ++nconstructed;
+  }
+
+  class PoolTest : public ::testing::Test {
+  protected:
+
+    virtual void SetUp() {
+      pool = pool_basic_init("test pool", OBJECT_SIZE);
+    }
+
+    virtual void TearDown() {
+      pool_destroy(pool);
+    }
+
+    /* Allocate and free in batches, as a request or entry pool would */
+    static void churn(pool_t *p, int loops) {
+      void *objs[BATCH];
+
+      for (int i = 0; i < loops; i += BATCH) {
+	for (int j = 0; j < BATCH; ++j)
+	  objs[j] = pool_alloc(p);
+	for (int j = 0; j < BATCH; ++j)
+	  pool_free(p, objs[j]);
+      }
+    }
+
+    static void churn_calloc(int loops) {
+      void *objs[BATCH];
+
+      for (int i = 0; i < loops; i += BATCH) {
+	for (int j = 0; j < BATCH; ++j)
+	  objs[j] = gsh_calloc(1, OBJECT_SIZE);
+	for (int j = 0; j < BATCH; ++j)
+	  gsh_free(objs[j]);
+      }
+    }
+
+    pool_t *pool;
+  };
+
+} /* namespace */
+
+TEST_F(PoolTest, ZEROED)
+{
+  char *obj = (char *) pool_alloc(pool);
+
+  memset(obj, 0xa5, OBJECT_SIZE);
+  pool_free(pool, obj);
+
+  obj = (char *) pool_alloc(pool);
+  for (int i = 0; i < OBJECT_SIZE; ++i)
+    ASSERT_EQ(obj[i], 0);
+  pool_free(pool, obj);
+}
+
+TEST_F(PoolTest, CTOR_PRESERVED)
+{
+  pool_t *cpool = pool_ctor_init("ctor pool", sizeof(struct ctor_object),
+				 ctor, NULL);
+  std::vector<struct ctor_object *> objs;
+  uint64_t constructed;
+
+  nconstructed = 0;
+
+  for (int i = 0; i < BATCH; ++i) {
+    objs.push_back((struct ctor_object *) pool_alloc(cpool));
+    EXPECT_EQ(objs.back()->magic, 0xfeedface);
+    objs.back()->payload[0] = 'x';
+  }
+  for (auto obj : objs)
+    pool_free(cpool, obj);
+  constructed = nconstructed;
+
+  /* Reallocating must neither construct nor zero */
+  for (int i = 0; i < BATCH; ++i) {
+    objs[i] = (struct ctor_object *) pool_alloc(cpool);
+    EXPECT_EQ(objs[i]->payload[0], 'x');
+  }
+  for (auto obj : objs)
+    pool_free(cpool, obj);
+
+  EXPECT_EQ(nconstructed, constructed);
+
+  pool_destroy(cpool);
+}
+
+TEST_F(PoolTest, RECLAIM)
+{
+  pool_t *rpool = pool_basic_init("reclaim pool", OBJECT_SIZE);
+  uint64_t kept;
+
+  /* Run on another thread so its magazine goes back to the depot when
+   * the thread exits, leaving every slab empty.
+   */
+  std::thread t([rpool]() {
+      std::vector<void *> objs;
+
+      for (int i = 0; i < 16 * BATCH; ++i)
+	objs.push_back(pool_alloc(rpool));
+      EXPECT_GT(rpool->slab_bytes, 2 * rpool->slab_size);
+      for (auto obj : objs)
+	pool_free(rpool, obj);
+    });
+  t.join();
+
+  /* Only the empty slabs kept for reuse remain */
+  kept = rpool->slab_bytes;
+  EXPECT_LE(kept, 2 * rpool->nnodes * rpool->slab_size);
+  EXPECT_EQ(pool_reclaim(rpool), kept);
+  EXPECT_EQ(rpool->slab_bytes, 0);
+
+  pool_destroy(rpool);
+}
+
+TEST_F(PoolTest, SINGLE_THREAD)
+{
+  struct timespec s_time, e_time;
+
+  now(&s_time);
+  churn_calloc(LOOP_COUNT);
+  now(&e_time);
+
+  fprintf(stderr, "Average time per gsh_calloc/gsh_free: %" PRIu64 " ns\n",
+	  timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+
+  now(&s_time);
+  churn(pool, LOOP_COUNT);
+  now(&e_time);
+
+  fprintf(stderr, "Average time per pool_alloc/pool_free: %" PRIu64 " ns\n",
+	  timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+}
+
+TEST_F(PoolTest, MULTI_THREAD)
+{
+  struct timespec s_time, e_time;
+  std::vector<std::thread> threads;
+
+  now(&s_time);
+  for (int t = 0; t < THREAD_COUNT; ++t)
+    threads.emplace_back([]() { churn_calloc(LOOP_COUNT); });
+  for (auto &th : threads)
+    th.join();
+  now(&e_time);
+  threads.clear();
+
+  fprintf(stderr, "Average time per gsh_calloc/gsh_free (%d threads): %"
+	  PRIu64 " ns\n", THREAD_COUNT,
+	  timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+
+  now(&s_time);
+  for (int t = 0; t < THREAD_COUNT; ++t)
+    threads.emplace_back([this]() { churn(pool, LOOP_COUNT); });
+  for (auto &th : threads)
+    th.join();
+  now(&e_time);
+
+  fprintf(stderr, "Average time per pool_alloc/pool_free (%d threads): %"
+	  PRIu64 " ns\n", THREAD_COUNT,
+	  timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,294 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Reconnect storm and takeover benchmark for the fs_log recovery backend.
+ *
+ * No server is started: the backend is driven directly, recording clients
+ * from several threads at once (the group commit case) and then reloading
+ * them the way a takeover by another node would.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "nfs_core.h"
+#include "sal_data.h"
+#include "sal_functions.h"
+#include "client_mgr.h"
+#include "common_utils.h"
+#include "../SAL/recovery/recovery_fs.h"
+}
+
+#define CLIENT_COUNT 20000
+#define THREAD_COUNT 16
+#define TAKEOVER_NODEID 7
+
+namespace bf = boost::filesystem;
+
+namespace {
+
+  std::string recov_dir = "/tmp/ganesha_fs_log_test";
+  std::atomic<uint64_t> nloaded;
+  std::atomic<uint64_t> nrevoked;
+
+  clid_entry_t *count_clid_entry(char *cl_name)
+  {
+    clid_entry_t *ent = (clid_entry_t *) gsh_malloc(sizeof(*ent));
+
+    glist_init(&ent->cl_rfh_list);
+    strlcpy(ent->cl_name, cl_name, sizeof(ent->cl_name));
+    ++nloaded;
+    return ent;
+  }
+
+  rdel_fh_t *count_rfh_entry(clid_entry_t *clid_ent, char *rfh_name)
+  {
+    rdel_fh_t *ent = (rdel_fh_t *) gsh_malloc(sizeof(*ent));
+
+    ent->rdfh_handle_str = gsh_strdup(rfh_name);
+    glist_add(&clid_ent->cl_rfh_list, &ent->rdfh_list);
+    ++nrevoked;
+    return ent;
+  }
+
+  class FsLogRecoveryTest : public ::testing::Test {
+  protected:
+
+    virtual void SetUp() {
+      bf::remove_all(recov_dir);
+      bf::create_directories(recov_dir);
+
+      fs_log_param.recov_dir = (char *) recov_dir.c_str();
+      fs_log_param.compact_records = 65536;
+
+      /* Record as the node we will later take over */
+      nfs_param.core_param.clustered = true;
+      g_nodeid = TAKEOVER_NODEID;
+
+      fs_log_backend_init(&backend);
+      ASSERT_EQ(backend->recovery_init(), 0);
+
+      clients.resize(CLIENT_COUNT);
+      for (int i = 0; i < CLIENT_COUNT; ++i) {
+	char name[32];
+	int len = snprintf(name, sizeof(name), "Linux NFSv4.1 c%08x", i);
+
+	clients[i].record = (nfs_client_record_t *)
+	  gsh_calloc(1, sizeof(nfs_client_record_t) + len);
+	memcpy(clients[i].record->cr_client_val, name, len);
+	clients[i].record->cr_client_val_len = len;
+
+	memset(&clients[i].clientid, 0, sizeof(clients[i].clientid));
+	clients[i].clientid.cid_client_record = clients[i].record;
+	clients[i].clientid.cid_clientid = i;
+      }
+    }
+
+    virtual void TearDown() {
+      for (auto &c : clients) {
+	gsh_free(c.clientid.cid_recov_tag);
+	gsh_free(c.record);
+      }
+      clients.clear();
+
+      backend->recovery_shutdown();
+      bf::remove_all(recov_dir);
+    }
+
+    void add_all(int nthreads) {
+      std::vector<std::thread> threads;
+
+      for (int t = 0; t < nthreads; ++t) {
+	threads.emplace_back([this, t, nthreads]() {
+	    for (int i = t; i < CLIENT_COUNT; i += nthreads)
+	      backend->add_clid(&clients[i].clientid);
+	  });
+      }
+      for (auto &th : threads)
+	th.join();
+    }
+
+    struct test_client {
+      nfs_client_id_t clientid;
+      nfs_client_record_t *record;
+    };
+
+    struct nfs4_recovery_backend *backend;
+    std::vector<test_client> clients;
+  };
+
+} /* namespace */
+
+TEST_F(FsLogRecoveryTest, RECONNECT_STORM_SINGLE)
+{
+  struct timespec s_time, e_time;
+
+  now(&s_time);
+  add_all(1);
+  now(&e_time);
+
+  fprintf(stderr, "Average time per add_clid (1 thread): %" PRIu64 " ns\n",
+	  timespec_diff(&s_time, &e_time) / CLIENT_COUNT);
+}
+
+TEST_F(FsLogRecoveryTest, RECONNECT_STORM_GROUP_COMMIT)
+{
+  struct timespec s_time, e_time;
+
+  now(&s_time);
+  add_all(THREAD_COUNT);
+  now(&e_time);
+
+  fprintf(stderr, "Average time per add_clid (%d threads): %" PRIu64 " ns\n",
+	  THREAD_COUNT, timespec_diff(&s_time, &e_time) / CLIENT_COUNT);
+}
+
+TEST_F(FsLogRecoveryTest, TAKEOVER)
+{
+  nfs_grace_start_t gs;
+  struct timespec s_time, e_time;
+
+  add_all(THREAD_COUNT);
+
+  /* Expire every other client so takeover has to replay removals */
+  for (int i = 0; i < CLIENT_COUNT; i += 2)
+    backend->rm_clid(&clients[i].clientid);
+
+  memset(&gs, 0, sizeof(gs));
+  gs.event = EVENT_TAKE_NODEID;
+  gs.nodeid = TAKEOVER_NODEID;
+  nloaded = 0;
+
+  now(&s_time);
+  backend->recovery_read_clids(&gs, count_clid_entry, count_rfh_entry);
+  now(&e_time);
+
+  EXPECT_EQ(nloaded, CLIENT_COUNT / 2);
+
+  fprintf(stderr, "Takeover of %" PRIu64 " clients: %" PRIu64 " ns\n",
+	  nloaded.load(), timespec_diff(&s_time, &e_time));
+}
+
+TEST_F(FsLogRecoveryTest, TAKEOVER_AFTER_COMPACTION)
+{
+  nfs_grace_start_t gs;
+  struct timespec s_time, e_time;
+
+  add_all(THREAD_COUNT);
+
+  /* Churn enough to trigger at least one compaction */
+  for (int loop = 0; loop < 4; ++loop) {
+    for (int i = 0; i < CLIENT_COUNT; ++i)
+      backend->rm_clid(&clients[i].clientid);
+    add_all(THREAD_COUNT);
+  }
+
+  memset(&gs, 0, sizeof(gs));
+  gs.event = EVENT_TAKE_NODEID;
+  gs.nodeid = TAKEOVER_NODEID;
+  nloaded = 0;
+
+  now(&s_time);
+  backend->recovery_read_clids(&gs, count_clid_entry, count_rfh_entry);
+  now(&e_time);
+
+  EXPECT_EQ(nloaded, CLIENT_COUNT);
+
+  fprintf(stderr, "Takeover of %" PRIu64 " clients: %" PRIu64 " ns\n",
+	  nloaded.load(), timespec_diff(&s_time, &e_time));
+}
+
+TEST_F(FsLogRecoveryTest, TAKE_IP)
+{
+  nfs_grace_start_t gs;
+  char ipaddr[] = "192.0.2.7";
+  bf::path ipdir = bf::path(recov_dir) / ipaddr;
+
+  add_all(THREAD_COUNT);
+
+  /* The address's clients are found under the configured recov_dir */
+  bf::create_directories(ipdir);
+  bf::copy_file(bf::path(recov_dir) /
+		("node" + std::to_string(TAKEOVER_NODEID) + ".journal"),
+		ipdir / "local.journal");
+
+  memset(&gs, 0, sizeof(gs));
+  gs.event = EVENT_TAKE_IP;
+  gs.ipaddr = ipaddr;
+  nloaded = 0;
+
+  backend->recovery_read_clids(&gs, count_clid_entry, count_rfh_entry);
+
+  EXPECT_EQ(nloaded, CLIENT_COUNT);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("dir", po::value<string>(),
+	"scratch directory for the journal (removed on completion)")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    vm_iter = vm.find("dir");
+    if (vm_iter != vm.end()) {
+      recov_dir = vm_iter->second.as<std::string>();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -0,0 +1,161 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Request arena tests, compared against plain gsh_calloc.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "req_arena.h"
+}
+
+#define LOOP_COUNT 1000000
+
+/* Roughly what a five operation COMPOUND allocates for its bookkeeping */
+#define DATA_SIZE 1200
+#define FH_SIZE 128
+#define RESOP_SIZE 256
+#define OPS 5
+#define TAG_SIZE 16
+
+namespace {
+
+  class ReqArenaTest : public ::testing::Test {
+  protected:
+
+    static void SetUpTestCase() {
+      req_arena_pkginit();
+    }
+
+    static void TearDownTestCase() {
+      req_arena_pkgshutdown();
+    }
+
+    virtual void SetUp() {
+      memset(&arena, 0, sizeof(arena));
+    }
+
+    virtual void TearDown() {
+      req_arena_release(&arena);
+    }
+
+    struct req_arena arena;
+  };
+
+} /* namespace */
+
+TEST_F(ReqArenaTest, ZEROED_AND_ALIGNED)
+{
+  const size_t sizes[] = { 1, 7, 16, 33, 128, 600, 1500 };
+
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t size : sizes) {
+      char *p = (char *) req_arena_alloc(&arena, size);
+
+      ASSERT_EQ((uintptr_t) p % REQ_ARENA_ALIGN, 0U);
+      for (size_t i = 0; i < size; ++i)
+	ASSERT_EQ(p[i], 0);
+      memset(p, 0xa5, size);
+    }
+    /* Chunks come back dirty, they must be zeroed again */
+    req_arena_release(&arena);
+  }
+}
+
+TEST_F(ReqArenaTest, OVERSIZE)
+{
+  char *small, *big, *next;
+
+  small = (char *) req_arena_alloc(&arena, 64);
+  big = (char *) req_arena_alloc(&arena, 3 * REQ_ARENA_CHUNK_SIZE);
+  memset(big, 0xa5, 3 * REQ_ARENA_CHUNK_SIZE);
+
+  /* The oversize allocation must not retire the chunk being carved */
+  next = (char *) req_arena_alloc(&arena, 64);
+  EXPECT_EQ(next, small + 64);
+
+  EXPECT_EQ(arena.allocs, 3U);
+  EXPECT_EQ(arena.nchunks, 2U);
+}
+
+TEST_F(ReqArenaTest, RELEASE_EMPTIES)
+{
+  for (int i = 0; i < 100; ++i)
+    (void) req_arena_alloc(&arena, 512);
+
+  EXPECT_GT(arena.nchunks, 1U);
+  req_arena_release(&arena);
+
+  EXPECT_EQ(arena.chunks, nullptr);
+  EXPECT_EQ(arena.allocs, 0U);
+  EXPECT_EQ(arena.nchunks, 0U);
+}
+
+TEST_F(ReqArenaTest, COMPOUND_LATENCY)
+{
+  struct timespec s_time, e_time;
+  void *objs[5];
+
+  now(&s_time);
+  for (int i = 0; i < LOOP_COUNT; ++i) {
+    int n = 0;
+
+    objs[n++] = gsh_calloc(1, DATA_SIZE);
+    objs[n++] = gsh_calloc(1, FH_SIZE);
+    objs[n++] = gsh_calloc(1, FH_SIZE);
+    objs[n++] = gsh_calloc(OPS, RESOP_SIZE);
+    objs[n++] = gsh_malloc(TAG_SIZE);
+    while (n > 0)
+      gsh_free(objs[--n]);
+  }
+  now(&e_time);
+
+  fprintf(stderr, "Average time per request with gsh_calloc: %" PRIu64
+	  " ns\n", timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+
+  now(&s_time);
+  for (int i = 0; i < LOOP_COUNT; ++i) {
+    (void) req_arena_alloc(&arena, DATA_SIZE);
+    (void) req_arena_alloc(&arena, FH_SIZE);
+    (void) req_arena_alloc(&arena, FH_SIZE);
+    (void) req_arena_alloc(&arena, OPS * RESOP_SIZE);
+    (void) req_arena_alloc(&arena, TAG_SIZE);
+    req_arena_release(&arena);
+  }
+  now(&e_time);
+
+  fprintf(stderr, "Average time per request with req_arena: %" PRIu64
+	  " ns\n", timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
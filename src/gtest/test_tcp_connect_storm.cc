@@ -0,0 +1,354 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * TCP connection storm on loopback.
+ *
+ * Clients connect to the NFS port from several threads, make an RPC NULL
+ * call and hang up, to measure the accept rate.  Then they hold their
+ * connections open, to check that they were spread over the TCP event
+ * channels.  Run it with RPC_TCP_Channels set to compare channel counts.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "nfs_core.h"
+#include "common_utils.h"
+}
+
+#include "gtest.hh"
+
+#define THREAD_COUNT 16
+#define LOOP_COUNT 1000
+#define HOLD_COUNT 1024
+/* The steering slack, plus accepts in flight when the target moves */
+#define SPREAD_SLACK (4 + THREAD_COUNT)
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+
+  class TcpConnectStormTest : public gtest::GaneshaBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(nfs_param.core_param.port[P_NFS]);
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+      ASSERT_TRUE(wait_idle());
+    }
+
+    /* Wait up to five seconds for the server to drop its connections */
+    bool wait_idle() {
+      for (int i = 0; i < 5000; ++i) {
+	if (connections() == 0)
+	  return true;
+	usleep(1000);
+      }
+      return false;
+    }
+
+    int32_t connections() {
+      int32_t xprts, total = 0;
+      uint64_t accepted;
+
+      for (uint32_t c = 0; c < nfs_rpc_tcp_channels(); ++c) {
+	nfs_rpc_tcp_channel_load(c, &xprts, &accepted);
+	total += xprts;
+      }
+      return total;
+    }
+
+    /* An RPC NULL call to NFSv4, record marked */
+    bool null_call(int fd, uint32_t xid) {
+      uint32_t call[] = {
+	htonl(0x80000000 | 40),
+	htonl(xid),
+	htonl(0),		/* CALL */
+	htonl(2),		/* RPC version */
+	htonl(nfs_param.core_param.program[P_NFS]),
+	htonl(4),
+	htonl(0),		/* NULLPROC */
+	htonl(0), htonl(0),	/* AUTH_NONE credential */
+	htonl(0), htonl(0),	/* AUTH_NONE verifier */
+      };
+      uint32_t reply[32];
+      uint32_t len;
+
+      if (write(fd, call, sizeof(call)) != sizeof(call))
+	return false;
+
+      if (recv(fd, &len, sizeof(len), MSG_WAITALL) != sizeof(len))
+	return false;
+      len = ntohl(len) & 0x7fffffff;
+      if (len < 8 || len > sizeof(reply))
+	return false;
+
+      if (recv(fd, reply, len, MSG_WAITALL) != (ssize_t) len)
+	return false;
+
+      return ntohl(reply[0]) == xid && ntohl(reply[1]) == 1 /* REPLY */;
+    }
+
+    /* Connect and make a NULL call, returning the socket or -1 */
+    int connect_one(uint32_t xid) {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+      if (fd == -1)
+	return -1;
+
+      if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+	  !null_call(fd, xid)) {
+	close(fd);
+	return -1;
+      }
+
+      return fd;
+    }
+
+    void show_channels(const std::vector<uint64_t> &before) {
+      int32_t xprts;
+      uint64_t accepted;
+
+      for (uint32_t c = 0; c < nfs_rpc_tcp_channels(); ++c) {
+	nfs_rpc_tcp_channel_load(c, &xprts, &accepted);
+	fprintf(stderr, "channel %u: %d connections, %" PRIu64
+		" accepted\n", c, xprts, accepted - before[c]);
+      }
+    }
+
+    std::vector<uint64_t> accepted() {
+      std::vector<uint64_t> acc(nfs_rpc_tcp_channels());
+      int32_t xprts;
+
+      for (uint32_t c = 0; c < acc.size(); ++c)
+	nfs_rpc_tcp_channel_load(c, &xprts, &acc[c]);
+      return acc;
+    }
+
+    struct sockaddr_in addr;
+  };
+
+} /* namespace */
+
+TEST_F(TcpConnectStormTest, SIMPLE)
+{
+  int fd = connect_one(1);
+
+  ASSERT_NE(fd, -1);
+  EXPECT_EQ(connections(), 1);
+  close(fd);
+  EXPECT_TRUE(wait_idle());
+}
+
+TEST_F(TcpConnectStormTest, STORM)
+{
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> before = accepted();
+  std::atomic<int> failures(0);
+  struct timespec s_time, e_time;
+  uint64_t ns;
+
+  enableEvents(event_list);
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  now(&s_time);
+
+  for (int t = 0; t < THREAD_COUNT; ++t) {
+    threads.emplace_back([this, t, &failures]() {
+	for (int i = 0; i < LOOP_COUNT; ++i) {
+	  int fd = connect_one(t * LOOP_COUNT + i);
+
+	  if (fd == -1)
+	    failures++;
+	  else
+	    close(fd);
+	}
+      });
+  }
+
+  for (auto &thr : threads)
+    thr.join();
+
+  now(&e_time);
+
+  if (profile_out)
+    ProfilerStop();
+  disableEvents(event_list);
+
+  EXPECT_EQ(failures.load(), 0);
+
+  ns = timespec_diff(&s_time, &e_time);
+  fprintf(stderr, "%d threads: %" PRIu64 " connections per second\n",
+	  THREAD_COUNT, (uint64_t) THREAD_COUNT * LOOP_COUNT * NS_PER_SEC / ns);
+  show_channels(before);
+
+  EXPECT_TRUE(wait_idle());
+}
+
+TEST_F(TcpConnectStormTest, SPREAD)
+{
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> before = accepted();
+  std::vector<int> fds(HOLD_COUNT, -1);
+  int32_t xprts, least = INT32_MAX, most = 0;
+  uint64_t acc;
+
+  for (int t = 0; t < THREAD_COUNT; ++t) {
+    threads.emplace_back([this, t, &fds]() {
+	for (int i = t; i < HOLD_COUNT; i += THREAD_COUNT)
+	  fds[i] = connect_one(i);
+      });
+  }
+
+  for (auto &thr : threads)
+    thr.join();
+
+  for (int fd : fds)
+    EXPECT_NE(fd, -1);
+  EXPECT_EQ(connections(), HOLD_COUNT);
+  show_channels(before);
+
+  for (uint32_t c = 0; c < nfs_rpc_tcp_channels(); ++c) {
+    nfs_rpc_tcp_channel_load(c, &xprts, &acc);
+    least = std::min(least, xprts);
+    most = std::max(most, xprts);
+  }
+  EXPECT_LE(most - least, SPREAD_SLACK);
+
+  for (int fd : fds)
+    if (fd != -1)
+      close(fd);
+
+  EXPECT_TRUE(wait_idle());
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+
+      ("event-list", po::value<string>(),
+	"LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+	"Enable profiling and set output file.")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, nullptr, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -0,0 +1,344 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Supplementary group cache.
+ *
+ * The name service is replaced by a stub that counts its calls and can be
+ * made slow, to check that concurrent misses share one lookup and that
+ * entries nearing expiry are refreshed without holding up callers.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "nfs_core.h"
+#include "uid2grp.h"
+#include "common_utils.h"
+}
+
+#include "gtest.hh"
+
+#define THREAD_COUNT 16
+#define TEST_UID 4242
+#define EXPIRATION 8
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+
+  /* The stub name service: user<uid> has primary group uid + 1000 and
+   * is also in groups 100 and 200. */
+  std::atomic<int> pw_calls;
+  std::atomic<int> gl_calls;
+  std::atomic<int> delay_us;
+
+  int stub_fill(uid_t uid, struct passwd *pwd, char *buf, size_t buflen,
+		struct passwd **result)
+  {
+    if (snprintf(buf, buflen, "user%u", uid) >= (int) buflen)
+      return ERANGE;
+
+    memset(pwd, 0, sizeof(*pwd));
+    pwd->pw_name = buf;
+    pwd->pw_uid = uid;
+    pwd->pw_gid = uid + 1000;
+    *result = pwd;
+    return 0;
+  }
+
+  int stub_getpwuid_r(uid_t uid, struct passwd *pwd, char *buf,
+		      size_t buflen, struct passwd **result)
+  {
+    pw_calls++;
+    usleep(delay_us.load());
+    return stub_fill(uid, pwd, buf, buflen, result);
+  }
+
+  int stub_getpwnam_r(const char *name, struct passwd *pwd, char *buf,
+		      size_t buflen, struct passwd **result)
+  {
+    unsigned int uid;
+
+    pw_calls++;
+    usleep(delay_us.load());
+    if (sscanf(name, "user%u", &uid) != 1) {
+      *result = NULL;
+      return 0;
+    }
+    return stub_fill(uid, pwd, buf, buflen, result);
+  }
+
+  int stub_getgrouplist(const char *user, gid_t group, gid_t *groups,
+			int *ngroups)
+  {
+    const gid_t all[] = { group, 100, 200 };
+    int n = sizeof(all) / sizeof(all[0]);
+
+    gl_calls++;
+    if (*ngroups < n) {
+      *ngroups = n;
+      return -1;
+    }
+    memcpy(groups, all, sizeof(all));
+    *ngroups = n;
+    return n;
+  }
+
+  const struct uid2grp_nss stub_nss = {
+    stub_getpwuid_r,
+    stub_getpwnam_r,
+    stub_getgrouplist,
+  };
+
+  class Uid2grpCacheTest : public gtest::GaneshaBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      save_nss = uid2grp_nss;
+      uid2grp_nss = stub_nss;
+      save_expiration = nfs_param.core_param.manage_gids_expiration;
+      nfs_param.core_param.manage_gids_expiration = EXPIRATION;
+
+      uid2grp_clear_cache();
+      pw_calls = 0;
+      gl_calls = 0;
+      delay_us = 0;
+    }
+
+    virtual void TearDown() {
+      uid2grp_clear_cache();
+      nfs_param.core_param.manage_gids_expiration = save_expiration;
+      uid2grp_nss = save_nss;
+    }
+
+    /* Wait up to a second for the stub to have been called @a n times */
+    bool wait_pw_calls(int n) {
+      for (int i = 0; i < 1000; ++i) {
+	if (pw_calls.load() >= n)
+	  return true;
+	usleep(1000);
+      }
+      return false;
+    }
+
+    struct uid2grp_nss save_nss;
+    time_t save_expiration;
+  };
+
+} /* namespace */
+
+TEST_F(Uid2grpCacheTest, MISS_THEN_HIT)
+{
+  struct group_data *gdata;
+
+  ASSERT_TRUE(uid2grp(TEST_UID, &gdata));
+  EXPECT_EQ(gdata->uid, (uid_t) TEST_UID);
+  EXPECT_EQ(gdata->gid, (gid_t) TEST_UID + 1000);
+  EXPECT_EQ(gdata->nbgroups, 3);
+  uid2grp_unref(gdata);
+  EXPECT_EQ(pw_calls.load(), 1);
+
+  ASSERT_TRUE(uid2grp(TEST_UID, &gdata));
+  uid2grp_unref(gdata);
+  EXPECT_EQ(pw_calls.load(), 1);
+
+  /* Found by name too, through the other shard */
+  struct gsh_buffdesc name = { (void *) "user4242", 8 };
+
+  ASSERT_TRUE(name2grp(&name, &gdata));
+  EXPECT_EQ(gdata->uid, (uid_t) TEST_UID);
+  uid2grp_unref(gdata);
+  EXPECT_EQ(pw_calls.load(), 1);
+}
+
+TEST_F(Uid2grpCacheTest, MISSES_COLLAPSE)
+{
+  std::vector<std::thread> threads;
+  std::atomic<int> found(0);
+
+  delay_us = 100000;
+
+  for (int t = 0; t < THREAD_COUNT; ++t) {
+    threads.emplace_back([&found]() {
+	struct group_data *gdata;
+
+	if (uid2grp(TEST_UID, &gdata)) {
+	  found++;
+	  uid2grp_unref(gdata);
+	}
+      });
+  }
+
+  for (auto &thr : threads)
+    thr.join();
+
+  EXPECT_EQ(found.load(), THREAD_COUNT);
+  EXPECT_EQ(pw_calls.load(), 1);
+}
+
+TEST_F(Uid2grpCacheTest, REFRESH_AHEAD)
+{
+  struct group_data *gdata, *old;
+  struct timespec s_time, e_time;
+
+  ASSERT_TRUE(uid2grp(TEST_UID, &old));
+  EXPECT_EQ(pw_calls.load(), 1);
+
+  /* In the last eighth of its life */
+  old->epoch = time(NULL) - EXPIRATION;
+  delay_us = 200000;
+
+  now(&s_time);
+  ASSERT_TRUE(uid2grp(TEST_UID, &gdata));
+  now(&e_time);
+
+  /* Served from cache, the lookup happens behind our back */
+  EXPECT_EQ(gdata, old);
+  EXPECT_LT(timespec_diff(&s_time, &e_time), 100 * NS_PER_MSEC);
+  uid2grp_unref(gdata);
+
+  /* Now expired, but being refreshed: still served, not looked up */
+  old->epoch = time(NULL) - EXPIRATION - 1;
+  now(&s_time);
+  ASSERT_TRUE(uid2grp(TEST_UID, &gdata));
+  now(&e_time);
+  EXPECT_EQ(gdata, old);
+  EXPECT_LT(timespec_diff(&s_time, &e_time), 100 * NS_PER_MSEC);
+  uid2grp_unref(gdata);
+
+  ASSERT_TRUE(wait_pw_calls(2));
+  usleep(300000);
+
+  /* The refreshed entry replaced the old one */
+  ASSERT_TRUE(uid2grp(TEST_UID, &gdata));
+  EXPECT_NE(gdata, old);
+  EXPECT_LE(time(NULL) - gdata->epoch, 1);
+  uid2grp_unref(gdata);
+  uid2grp_unref(old);
+
+  EXPECT_EQ(pw_calls.load(), 2);
+}
+
+TEST_F(Uid2grpCacheTest, EXPIRED_WITHOUT_REFRESH)
+{
+  struct group_data *gdata, *old;
+
+  ASSERT_TRUE(uid2grp(TEST_UID, &old));
+
+  /* Nobody used it near expiry, so nothing refreshed it */
+  old->epoch = time(NULL) - EXPIRATION - 1;
+
+  ASSERT_TRUE(uid2grp(TEST_UID, &gdata));
+  EXPECT_NE(gdata, old);
+  EXPECT_EQ(pw_calls.load(), 2);
+  uid2grp_unref(gdata);
+  uid2grp_unref(old);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, nullptr, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
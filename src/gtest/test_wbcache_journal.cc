@@ -0,0 +1,400 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Crash recovery tests for the FSAL_WBCACHE journal.
+ *
+ * No server is started: the cache engine is driven directly on top of a
+ * sub-FSAL kept in memory, which loses whatever was not committed when
+ * the test simulates a crash.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "fsal.h"
+#include "common_utils.h"
+#include "../FSAL/Stackable_FSALs/FSAL_WBCACHE/wbcache_methods.h"
+}
+
+#define BLOCK_SIZE 4096
+#define TEST_FILEID 42
+
+namespace bf = boost::filesystem;
+
+namespace {
+
+  std::string wbc_dir = "/tmp/ganesha_wbcache_test";
+
+  /* The sub-FSAL's file: data is what was written, stable what was
+   * committed and survives a crash. */
+  struct mock_file {
+    struct fsal_obj_handle obj;
+    std::string data;
+    std::string stable;
+    unsigned commits;
+    unsigned fail_commits;
+  } file;
+
+  struct fsal_obj_ops mock_ops;
+  struct fsal_export sub_export;
+
+  void mock_write2(struct fsal_obj_handle *obj_hdl, bool bypass,
+		   fsal_async_cb done_cb, struct fsal_io_arg *write_arg,
+		   void *caller_arg)
+  {
+    size_t off = write_arg->offset;
+
+    write_arg->io_amount = 0;
+    for (int i = 0; i < write_arg->iov_count; i++) {
+      size_t len = write_arg->iov[i].iov_len;
+
+      if (file.data.size() < off + len)
+	file.data.resize(off + len);
+      file.data.replace(off, len, (char *) write_arg->iov[i].iov_base, len);
+      off += len;
+      write_arg->io_amount += len;
+    }
+
+    done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), write_arg, caller_arg);
+  }
+
+  void mock_read2(struct fsal_obj_handle *obj_hdl, bool bypass,
+		  fsal_async_cb done_cb, struct fsal_io_arg *read_arg,
+		  void *caller_arg)
+  {
+    size_t off = read_arg->offset;
+    size_t len = 0;
+
+    if (off < file.data.size()) {
+      len = std::min(file.data.size() - off, read_arg->iov[0].iov_len);
+      memcpy(read_arg->iov[0].iov_base, file.data.data() + off, len);
+    }
+
+    read_arg->io_amount = len;
+    read_arg->end_of_file = off + len >= file.data.size();
+
+    done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), read_arg, caller_arg);
+  }
+
+  fsal_status_t mock_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			     size_t len)
+  {
+    if (file.fail_commits != 0) {
+      file.fail_commits--;
+      return fsalstat(ERR_FSAL_IO, EIO);
+    }
+
+    file.stable = file.data;
+    file.commits++;
+    return fsalstat(ERR_FSAL_NO_ERROR, 0);
+  }
+
+  fsal_status_t mock_getattrs(struct fsal_obj_handle *obj_hdl,
+			      struct attrlist *attrs)
+  {
+    attrs->filesize = file.data.size();
+    attrs->valid_mask |= ATTR_SIZE;
+    return fsalstat(ERR_FSAL_NO_ERROR, 0);
+  }
+
+  fsal_status_t mock_handle_to_wire(const struct fsal_obj_handle *obj_hdl,
+				    fsal_digesttype_t output_type,
+				    struct gsh_buffdesc *fh_desc)
+  {
+    memcpy(fh_desc->addr, &obj_hdl->fileid, sizeof(obj_hdl->fileid));
+    fh_desc->len = sizeof(obj_hdl->fileid);
+    return fsalstat(ERR_FSAL_NO_ERROR, 0);
+  }
+
+  void mock_release(struct fsal_obj_handle *obj_hdl)
+  {
+  }
+
+  fsal_status_t mock_wire_to_host(struct fsal_export *exp_hdl,
+				  fsal_digesttype_t in_type,
+				  struct gsh_buffdesc *fh_desc, int flags)
+  {
+    return fsalstat(ERR_FSAL_NO_ERROR, 0);
+  }
+
+  fsal_status_t mock_create_handle(struct fsal_export *exp_hdl,
+				   struct gsh_buffdesc *fh_desc,
+				   struct fsal_obj_handle **handle,
+				   struct attrlist *attrs_out)
+  {
+    uint64_t fileid;
+
+    memcpy(&fileid, fh_desc->addr, sizeof(fileid));
+    if (fileid != file.obj.fileid)
+      return fsalstat(ERR_FSAL_STALE, ESTALE);
+
+    *handle = &file.obj;
+    return fsalstat(ERR_FSAL_NO_ERROR, 0);
+  }
+
+  class WbcacheJournalTest : public ::testing::Test {
+  protected:
+
+    virtual void SetUp() {
+      bf::remove_all(wbc_dir);
+
+      memset(&mock_ops, 0, sizeof(mock_ops));
+      mock_ops.read2 = mock_read2;
+      mock_ops.write2 = mock_write2;
+      mock_ops.commit2 = mock_commit2;
+      mock_ops.getattrs = mock_getattrs;
+      mock_ops.handle_to_wire = mock_handle_to_wire;
+      mock_ops.release = mock_release;
+
+      memset(&sub_export, 0, sizeof(sub_export));
+      sub_export.exp_ops.wire_to_host = mock_wire_to_host;
+      sub_export.exp_ops.create_handle = mock_create_handle;
+
+      memset(&file.obj, 0, sizeof(file.obj));
+      file.obj.obj_ops = &mock_ops;
+      file.obj.type = REGULAR_FILE;
+      file.obj.fsid.major = 1;
+      file.obj.fsid.minor = 2;
+      file.obj.fileid = TEST_FILEID;
+      file.data.clear();
+      file.stable.clear();
+      file.commits = 0;
+      file.fail_commits = 0;
+
+      memset(&op_context, 0, sizeof(op_context));
+      op_ctx = &op_context;
+
+      exp = start();
+      hdl = open_handle();
+    }
+
+    virtual void TearDown() {
+      if (hdl != NULL)
+	release_handle(hdl);
+      if (exp != NULL)
+	stop(exp);
+      op_ctx = NULL;
+      bf::remove_all(wbc_dir);
+    }
+
+    /* Create the export, writing back what the journal holds */
+    struct wbcache_fsal_export *start() {
+      struct wbcache_fsal_export *e = (struct wbcache_fsal_export *)
+	gsh_calloc(1, sizeof(*e));
+
+      e->export.sub_export = &sub_export;
+      e->cache_size = 1024 * BLOCK_SIZE;
+      e->block_size = BLOCK_SIZE;
+      EXPECT_EQ(wbcache_export_cache_init(e, wbc_dir.c_str(), 1), 0);
+
+      op_ctx->fsal_export = &e->export;
+      wbcache_replay_journal(e);
+      return e;
+    }
+
+    void stop(struct wbcache_fsal_export *e) {
+      wbcache_export_cache_fini(e);
+      gsh_free(e);
+    }
+
+    struct wbcache_fsal_obj_handle *open_handle() {
+      struct wbcache_fsal_obj_handle *h =
+	(struct wbcache_fsal_obj_handle *) gsh_calloc(1, sizeof(*h));
+
+      h->obj_handle.type = REGULAR_FILE;
+      h->obj_handle.fsid = file.obj.fsid;
+      h->obj_handle.fileid = file.obj.fileid;
+      h->sub_handle = &file.obj;
+      wbcache_handle_cache_init(exp, h);
+      return h;
+    }
+
+    void release_handle(struct wbcache_fsal_obj_handle *h) {
+      wbcache_handle_cache_fini(exp, h);
+      gsh_free(h);
+    }
+
+    /* Lose everything in memory and whatever the sub-FSAL did not
+     * commit, leaving the cache directory as it is. */
+    void crash() {
+      struct avltree_node *node;
+
+      while ((node = avltree_first(&hdl->blocks)) != NULL) {
+	avltree_remove(node, &hdl->blocks);
+	gsh_free(avltree_container_of(node, struct wbcache_block, node_k));
+      }
+      if (hdl->cache_fd >= 0)
+	close(hdl->cache_fd);
+      gsh_free(hdl->wire.addr);
+      PTHREAD_RWLOCK_destroy(&hdl->cache_lock);
+      gsh_free(hdl);
+      hdl = NULL;
+
+      stop(exp);
+      exp = NULL;
+
+      file.data = file.stable;
+    }
+
+    fsal_status_t cache_write(uint64_t offset, const std::string &buf,
+			bool stable = false) {
+      char argbuf[sizeof(struct fsal_io_arg) + sizeof(struct iovec)];
+      struct fsal_io_arg *write_arg = (struct fsal_io_arg *) argbuf;
+
+      memset(argbuf, 0, sizeof(argbuf));
+      write_arg->offset = offset;
+      write_arg->iov_count = 1;
+      write_arg->iov[0].iov_base = (void *) buf.data();
+      write_arg->iov[0].iov_len = buf.size();
+      write_arg->fsal_stable = stable;
+
+      return wbcache_cache_write(exp, hdl, write_arg, false);
+    }
+
+    off_t journal_size() {
+      struct stat st;
+
+      if (stat((wbc_dir + "/export-1/journal").c_str(), &st) < 0)
+	return -1;
+      return st.st_size;
+    }
+
+    std::string expected() {
+      std::string data(3 * BLOCK_SIZE, 'a');
+
+      data.replace(BLOCK_SIZE / 2, BLOCK_SIZE, BLOCK_SIZE, 'b');
+      data.append(100, 'c');
+      return data;
+    }
+
+    void write_expected() {
+      ASSERT_FALSE(FSAL_IS_ERROR(cache_write(0, std::string(3 * BLOCK_SIZE,
+							'a'))));
+      ASSERT_FALSE(FSAL_IS_ERROR(cache_write(BLOCK_SIZE / 2,
+				       std::string(BLOCK_SIZE, 'b'))));
+      ASSERT_FALSE(FSAL_IS_ERROR(cache_write(3 * BLOCK_SIZE,
+				       std::string(100, 'c'))));
+    }
+
+    struct req_op_context op_context;
+    struct wbcache_fsal_export *exp = NULL;
+    struct wbcache_fsal_obj_handle *hdl = NULL;
+  };
+
+} /* namespace */
+
+TEST_F(WbcacheJournalTest, REPLAY_AFTER_CRASH)
+{
+  write_expected();
+
+  /* Unstable writes stay in the cache */
+  EXPECT_EQ(file.commits, 0u);
+  EXPECT_GT(journal_size(), 0);
+
+  crash();
+  EXPECT_TRUE(file.data.empty());
+
+  exp = start();
+  EXPECT_EQ(file.commits, 1u);
+  EXPECT_EQ(file.stable, expected());
+  EXPECT_EQ(journal_size(), 0);
+  EXPECT_FALSE(bf::exists(wbc_dir + "/export-1/1.2.2a"));
+}
+
+TEST_F(WbcacheJournalTest, FAILED_COMMIT_STAYS_DIRTY)
+{
+  fsal_status_t status;
+
+  write_expected();
+
+  file.fail_commits = 1;
+  status = wbcache_flush(exp, hdl);
+  EXPECT_TRUE(FSAL_IS_ERROR(status));
+
+  /* The data reached the sub-FSAL unstable, it is still dirty here */
+  EXPECT_EQ(file.data, expected());
+  EXPECT_NE(hdl->ndirty, 0u);
+  EXPECT_EQ(exp->dirty_files, 1u);
+  EXPECT_GT(journal_size(), 0);
+
+  crash();
+  EXPECT_TRUE(file.data.empty());
+
+  exp = start();
+  EXPECT_EQ(file.commits, 1u);
+  EXPECT_EQ(file.stable, expected());
+  EXPECT_EQ(journal_size(), 0);
+}
+
+TEST_F(WbcacheJournalTest, RELEASE_AFTER_FAILED_COMMIT)
+{
+  write_expected();
+
+  /* Dirty data outlives its handle and stays in the journal */
+  file.fail_commits = 1;
+  release_handle(hdl);
+  hdl = NULL;
+
+  EXPECT_EQ(file.commits, 0u);
+  EXPECT_EQ(exp->dirty_files, 1u);
+  EXPECT_GT(journal_size(), 0);
+
+  /* The next handle of the file takes it over and writes it back */
+  hdl = open_handle();
+  EXPECT_NE(hdl->ndirty, 0u);
+  EXPECT_FALSE(FSAL_IS_ERROR(wbcache_flush(exp, hdl)));
+  EXPECT_EQ(file.commits, 1u);
+  EXPECT_EQ(file.stable, expected());
+  EXPECT_EQ(exp->dirty_files, 0u);
+  EXPECT_EQ(journal_size(), 0);
+}
+
+TEST_F(WbcacheJournalTest, RESTART_AFTER_FAILED_RELEASE)
+{
+  write_expected();
+
+  file.fail_commits = 1;
+  release_handle(hdl);
+  hdl = NULL;
+
+  /* A shutdown keeps the journal for the next start */
+  stop(exp);
+  exp = NULL;
+  file.data = file.stable;
+
+  exp = start();
+  EXPECT_EQ(file.commits, 1u);
+  EXPECT_EQ(file.stable, expected());
+  EXPECT_EQ(journal_size(), 0);
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -276,6 +276,26 @@ bool check_verifier_attrlist(struct attrlist *attrs, fsal_verifier_t verifier);
 bool fsal_common_is_referral(struct fsal_obj_handle *obj_hdl,
 			     struct attrlist *attrs, bool cache_attrs);
 
+/**
+ * @brief Check whether a WRITE_SAME stores block numbers
+ *
+ * @param[in] ws_arg WRITE_SAME description
+ *
+ * @return true if the block number fits in each block.
+ */
+static inline bool
+fsal_write_same_numbered(const struct fsal_write_same_arg *ws_arg)
+{
+	return ws_arg->block_size >= sizeof(uint32_t) &&
+	       ws_arg->reloff_blocknum <=
+			ws_arg->block_size - sizeof(uint32_t);
+}
+
+bool fsal_write_same_is_zero(const struct fsal_write_same_arg *ws_arg);
+
+void fsal_write_same_fill(const struct fsal_write_same_arg *ws_arg,
+			  uint64_t pos, char *buf, size_t len);
+
 #ifdef USE_DBUS
 void dbus_cache_init(void);
 #endif
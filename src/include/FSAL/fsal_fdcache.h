@@ -0,0 +1,124 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup FSAL
+ * @{
+ */
+
+/**
+ * @file  fsal_fdcache.h
+ * @brief Shared cache of file descriptors for stateless I/O
+ *
+ * Stateless I/O (NFSv3, anonymous stateids) that cannot use an object's
+ * global file descriptor ends up opening a temporary one and closing it
+ * again when the operation completes.  This cache keeps such descriptors
+ * open, keyed by file system, handle key, open mode and a credentials
+ * class, so that the next stateless operation on the same file can pick
+ * them up.  Entries have their own LRU and limits and do not depend on
+ * the lifetime of the MDCACHE entry that opened them.
+ */
+
+#ifndef FSAL_FDCACHE_H
+#define FSAL_FDCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fsal_types.h"
+#include "gsh_list.h"
+#include "config_parsing.h"
+
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+struct fsal_filesystem;
+
+/**
+ * @brief FD_CACHE configuration parameters
+ */
+struct fsal_fdcache_parameter {
+	/** Whether the cache is used at all.  Defaults to false. */
+	bool enable;
+	/** Number of cached descriptors above which idle ones are closed */
+	uint32_t entries_hwmark;
+	/** Seconds after which an unused descriptor is closed */
+	uint32_t idle_timeout;
+	/** Number of independently locked partitions */
+	uint32_t partitions;
+};
+
+extern struct fsal_fdcache_parameter fsal_fdcache_param;
+
+/**
+ * @brief A cached file descriptor
+ *
+ * The descriptor is valid for as long as the caller holds the reference
+ * obtained from fsal_fdcache_get or fsal_fdcache_insert.
+ */
+struct fsal_fdcache_entry {
+	struct glist_head hash_link;	/*< Link in the hash chain */
+	struct glist_head lru_link;	/*< Link in the partition LRU */
+	struct fsal_filesystem *fs;	/*< File system of the handle */
+	uint64_t hash;			/*< Hash of fs and handle key */
+	fsal_openflags_t openflags;	/*< Mode the descriptor is open in */
+	uint32_t cred_class;		/*< Credentials class, FSAL defined */
+	int32_t refcnt;			/*< Callers using the descriptor */
+	bool dead;			/*< Unhashed, close on last put */
+	time_t last_used;		/*< Time of the last put */
+	int fd;				/*< The descriptor itself */
+	uint16_t key_len;		/*< Length of the handle key */
+	char key[];			/*< Handle key */
+};
+
+int fsal_fdcache_set_param_from_conf(config_file_t parse_tree,
+				     struct config_error_type *err_type);
+void fsal_fdcache_pkginit(void);
+
+/**
+ * @brief Check whether the fd cache is in use
+ */
+static inline bool fsal_fdcache_enabled(void)
+{
+	return fsal_fdcache_param.enable;
+}
+
+struct fsal_fdcache_entry *fsal_fdcache_get(struct fsal_filesystem *fs,
+					    const void *key, size_t key_len,
+					    fsal_openflags_t openflags,
+					    uint32_t cred_class);
+struct fsal_fdcache_entry *fsal_fdcache_insert(struct fsal_filesystem *fs,
+					       const void *key, size_t key_len,
+					       fsal_openflags_t openflags,
+					       uint32_t cred_class, int fd);
+void fsal_fdcache_put(struct fsal_fdcache_entry *entry);
+void fsal_fdcache_invalidate(struct fsal_filesystem *fs,
+			     const void *key, size_t key_len);
+void fsal_fdcache_purge_fs(struct fsal_filesystem *fs);
+void fsal_fdcache_reap(bool all_idle);
+
+#ifdef USE_DBUS
+void fsal_fdcache_dbus_show(DBusMessageIter *iter);
+#endif
+
+#endif /* FSAL_FDCACHE_H */
+
+/** @} */
@@ -0,0 +1,121 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup FSAL
+ * @{
+ */
+
+/**
+ * @file  fsal_readahead.h
+ * @brief Access pattern detection for server side readahead
+ *
+ * An FSAL keeps a struct fsal_readahead per open file (per stateid, or
+ * per handle for stateless I/O) and feeds it every READ.  The tracker
+ * classifies the stream as sequential, strided or random and tells the
+ * FSAL what to do about it: which access pattern to advise the backing
+ * store of and which range to read ahead.  Explicit IO_ADVISE4 hints
+ * override detection.  How the advice is carried out is up to the
+ * FSAL; FSAL_VFS uses posix_fadvise, a caching FSAL can prefetch.
+ *
+ * A tracker is updated without locking.  Concurrent READs on the same
+ * tracker may lose an update, which only makes detection less precise.
+ * A zeroed tracker is ready to use.
+ */
+
+#ifndef FSAL_READAHEAD_H
+#define FSAL_READAHEAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fsal_types.h"
+
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+struct io_hints;
+
+/** Smallest readahead window */
+#define FSAL_RA_WINDOW_MIN (128 * 1024)
+/** Largest readahead window, also used when SEQUENTIAL is advised */
+#define FSAL_RA_WINDOW_MAX (4 * 1024 * 1024)
+
+/**
+ * @brief Access pattern of an open file
+ */
+enum fsal_io_pattern {
+	FSAL_IO_UNKNOWN,	/*< Not enough reads to tell, or NORMAL */
+	FSAL_IO_SEQUENTIAL,	/*< Each read starts where the last ended */
+	FSAL_IO_STRIDE,		/*< Reads a constant distance apart */
+	FSAL_IO_RANDOM,		/*< No pattern */
+};
+
+/**
+ * @brief What to do with a range of the file
+ */
+enum fsal_ra_op {
+	FSAL_RA_NONE,
+	FSAL_RA_WILLNEED,	/*< Read the range ahead */
+	FSAL_RA_DONTNEED,	/*< Drop the range from caches */
+	FSAL_RA_NOREUSE,	/*< The range will be accessed once */
+};
+
+/**
+ * @brief Per open file access pattern tracker
+ */
+struct fsal_readahead {
+	uint64_t next_offset;	/*< Where a sequential read would start */
+	uint64_t last_offset;	/*< Start of the last read */
+	int64_t stride;		/*< Distance between the last two reads */
+	uint64_t ra_start;	/*< Start of the range last read ahead */
+	uint64_t ra_end;	/*< End of the range last read ahead */
+	uint32_t window;	/*< Size of the next sequential readahead */
+	uint32_t streak;	/*< Consecutive reads that matched @a seen */
+	uint32_t hints;		/*< Pattern hints set by IO_ADVISE */
+	enum fsal_io_pattern seen;	/*< Pattern of the last reads */
+	enum fsal_io_pattern pattern;	/*< Pattern currently acted on */
+};
+
+/**
+ * @brief Advice returned to the FSAL
+ */
+struct fsal_ra_advice {
+	bool pattern_changed;		/*< Advise @a pattern for the file */
+	enum fsal_io_pattern pattern;	/*< New access pattern */
+	enum fsal_ra_op op;		/*< What to do with the range */
+	uint64_t offset;		/*< Start of the range */
+	uint64_t length;		/*< Length of the range, 0 to EOF */
+};
+
+bool fsal_readahead_read(struct fsal_readahead *ra, uint64_t offset,
+			 uint64_t length, struct fsal_ra_advice *advice);
+uint32_t fsal_readahead_hint(struct fsal_readahead *ra,
+			     const struct io_hints *hints,
+			     struct fsal_ra_advice *advice);
+
+#ifdef USE_DBUS
+void fsal_readahead_dbus_show(DBusMessageIter *iter);
+#endif
+
+#endif /* FSAL_READAHEAD_H */
+
+/** @} */
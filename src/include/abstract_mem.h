@@ -42,6 +42,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
 #include "log.h"
 
 /**
@@ -262,6 +265,42 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 	free(p);
 }
 
+/**
+ * @page PoolAllocator Pool Allocator
+ *
+ * Pools hand out fixed size objects carved from slabs.  Each thread
+ * keeps a small magazine of free objects per pool, so the common
+ * allocate/free pair touches no shared state.  Magazines are refilled
+ * from, and spill back to, the pool's depots in batches, and a depot
+ * grows by whole slabs.  There is one depot per NUMA node; a thread
+ * refills from the depot of the node it runs on and slabs are mapped
+ * and touched there, so with the kernel's default first touch policy
+ * their pages are local to that node.
+ *
+ * A slab whose objects have all been freed back to its depot is
+ * returned to the system, beyond a couple kept per depot to absorb
+ * churn; pool_reclaim releases those too.  Users that read objects
+ * after freeing them (lockless lookups that validate what they found,
+ * like the MDCACHE handle index) must mark the pool with
+ * pool_set_type_stable, which keeps every slab mapped until the pool is
+ * destroyed.
+ *
+ * Objects from a pool created with pool_basic_init are zeroed on every
+ * allocation, like gsh_calloc.  A pool created with pool_ctor_init
+ * instead runs its constructor once, when an object is first carved from
+ * a slab, and then hands objects out as they were freed.  Users of such
+ * pools must return objects to their constructed state (locks
+ * initialized, lists empty and so on) before freeing them.
+ */
+
+/** Maximum number of pools that get per-thread magazines */
+#define POOL_MAX_MAGAZINES 256
+
+/**
+ * @brief Constructor or destructor for pool objects
+ */
+typedef void (*pool_constructor_t)(void *object);
+
 /**
  * @brief Type representing a pool
  *
@@ -277,25 +316,40 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 typedef struct pool {
 	char *name; /*< The name of the pool */
 	size_t object_size; /*< The size of the objects created */
+	size_t slot_size; /*< Object size rounded up for alignment */
+	uint32_t id; /*< Index of per-thread magazines, or
+			 POOL_MAX_MAGAZINES if none */
+	pool_constructor_t ctor; /*< Run once per object, or NULL */
+	pool_constructor_t dtor; /*< Run on every object of a released slab */
+	size_t slab_size; /*< Size, and alignment, of slabs */
+	uint32_t slab_objs; /*< Objects per slab */
+	uint32_t slab_hdr; /*< Offset of the first object in a slab */
+	bool type_stable; /*< Keep slabs mapped until pool_destroy */
+	uint32_t nnodes; /*< Entries in depots */
+	struct pool_depot *depots; /*< Free objects, one depot per node */
+	uint64_t slab_bytes; /*< Bytes held in slabs, updated atomically */
+	pthread_mutex_t lock; /*< Protects the fields below */
+	uint64_t allocs; /*< Allocations by exited or magazineless threads */
+	uint64_t frees; /*< Frees by exited or magazineless threads */
+	uint64_t hits; /*< Magazine hits by exited threads */
 } pool_t;
 
+pool_t *pool_ctor_init(const char *name, size_t object_size,
+		       pool_constructor_t ctor, pool_constructor_t dtor);
+
 /**
  * @brief Create a basic object pool
  *
- * This function creates a new object pool, given a name, object size,
- * constructor and destructor.
+ * This function creates a new object pool, given a name and object
+ * size.  Objects are zeroed on allocation.
  *
- * This particular implementation throws the name away, but other
- * implementations that do tracking or keep counts of allocated or
- * de-allocated objects will likely wish to use it in log messages.
+ * The name is used in statistics; pools without one are reported as
+ * unnamed.
  *
  * This initializer function is expected to abort if it fails.
  *
  * @param[in] name             The name of this pool
  * @param[in] object_size      The size of objects to allocate
- * @param[in] file             Calling source file
- * @param[in] line             Calling source line
- * @param[in] function         Calling source function
  *
  * @return A pointer to the pool object.  This pointer must not be
  *         dereferenced.  It may be stored or supplied as an argument
@@ -307,16 +361,7 @@ typedef struct pool {
 static inline pool_t *
 pool_basic_init(const char *name, size_t object_size)
 {
-	pool_t *pool = (pool_t *) gsh_malloc(sizeof(pool_t));
-
-	pool->object_size = object_size;
-
-	if (name)
-		pool->name = gsh_strdup(name);
-	else
-		pool->name = NULL;
-
-	return pool;
+	return pool_ctor_init(name, object_size, NULL, NULL);
 }
 
 /**
@@ -328,21 +373,20 @@ pool_basic_init(const char *name, size_t object_size)
  * @param[in] pool The pool to be destroyed.
  */
 
-static inline void
-pool_destroy(pool_t *pool)
-{
-	gsh_free(pool->name);
-	gsh_free(pool);
-}
+void pool_destroy(pool_t *pool);
+
+void pool_set_type_stable(pool_t *pool);
+size_t pool_reclaim(pool_t *pool);
+
+void *pool_alloc__(pool_t *pool);
 
 /**
  * @brief Allocate an object from a pool
  *
  * This function allocates a single object from the pool and returns a
- * pointer to it.  If a constructor was specified at pool creation, it
- * is called on that pointer.  This function must be thread safe.  If
- * the underlying pool abstraction requires a lock, this function must
- * take and release it.
+ * pointer to it.  If a constructor was specified at pool creation, the
+ * object is returned in the state it was freed in, otherwise it is
+ * zeroed.  This function is thread safe.
  *
  * This function returns void pointers.  Programmers who wish for more
  * type safety can easily create static inline wrappers (alloc_client
@@ -352,23 +396,17 @@ pool_destroy(pool_t *pool)
  * This function aborts if no memory is available.
  *
  * @param[in] pool       The pool from which to allocate
- * @param[in] file       Calling source file
- * @param[in] line       Calling source line
- * @param[in] function   Calling source function
  *
  * @return A pointer to the allocated pool item.
  */
 
-#define pool_alloc(pool) gsh_calloc(1, (pool)->object_size)
+#define pool_alloc(pool) pool_alloc__(pool)
 
 /**
  * @brief Return an entry to a pool
  *
- * This function returns a single object to the pool.  If a destructor
- * was defined at pool creation time, it is called before the object
- * is freed.  This function must be thread-safe.  If the underlying
- * pool abstract requires a lock, this function must take and release
- * it.
+ * This function returns a single object to the pool, where it is kept
+ * for reuse.  This function is thread-safe.
  *
  * @param[in] pool   Pool to which to return the object
  * @param[in] object Object to return.  This is a void pointer.
@@ -377,10 +415,6 @@ pool_destroy(pool_t *pool)
  *                   specific type (and omitting the pool parameter.)
  */
 
-static inline void
-pool_free(pool_t *pool, void *object)
-{
-	gsh_free(object);
-}
+void pool_free(pool_t *pool, void *object);
 
 #endif /* ABSTRACT_MEM_H */
@@ -84,6 +84,56 @@ extern int portable_clock_gettime(struct timespec *ts);
 #define SCANDIR_CONST
 #endif
 
+#ifdef ENABLE_LOCKPROF
+#include "lock_prof.h"
+
+/**
+ * @brief Acquire a lock, feeding the contention profiler
+ *
+ * The lock is tried first, and only if it is busy is the wait timed.
+ *
+ * @param[out] _rc    Result of the lock call
+ * @param[in]  _fn    Blocking lock function
+ * @param[in]  _try   Non-blocking lock function
+ * @param[in]  _prof  Profiling lock function for busy locks
+ * @param[in]  _lock  The lock
+ */
+#define LOCKPROF_ACQUIRE(_rc, _fn, _try, _prof, _lock)			\
+	do {								\
+		static struct lockprof_site lp_site =			\
+			LOCKPROF_SITE_INIT(#_lock);			\
+									\
+		_rc = _try(_lock);					\
+		if (_rc == EBUSY)					\
+			_rc = _prof(&lp_site, _lock);			\
+		else if (_rc == 0)					\
+			lockprof_acquired(&lp_site, _lock);		\
+	} while (0)
+
+/**
+ * @brief Try a lock, feeding the contention profiler on success
+ *
+ * @param[out] _rc    Result of the lock call
+ * @param[in]  _try   Non-blocking lock function
+ * @param[in]  _lock  The lock
+ */
+#define LOCKPROF_TRY(_rc, _try, _lock)					\
+	do {								\
+		static struct lockprof_site lp_site =			\
+			LOCKPROF_SITE_INIT(#_lock);			\
+									\
+		_rc = _try(_lock);					\
+		if (_rc == 0)						\
+			lockprof_acquired(&lp_site, _lock);		\
+	} while (0)
+
+#define LOCKPROF_RELEASE(_lock) lockprof_releasing(_lock)
+#else
+#define LOCKPROF_ACQUIRE(_rc, _fn, _try, _prof, _lock) ((_rc) = _fn(_lock))
+#define LOCKPROF_TRY(_rc, _try, _lock) ((_rc) = _try(_lock))
+#define LOCKPROF_RELEASE(_lock) ((void)0)
+#endif
+
 /**
  * @brief Logging rwlock initialization
  *
@@ -143,7 +193,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_rwlock_wrlock(_lock);			\
+		LOCKPROF_ACQUIRE(rc, pthread_rwlock_wrlock,		\
+				 pthread_rwlock_trywrlock,		\
+				 lockprof_rwlock_wrlock, _lock);	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got write lock on %p (%s) "	\
@@ -158,6 +210,34 @@ extern int portable_clock_gettime(struct timespec *ts);
 		}							\
 	} while (0)							\
 
+/**
+ * @brief Logging write-lock attempt
+ *
+ * @param[in,out] _lock Read-write lock
+ *
+ * @return 0 if the lock was taken, EBUSY if it is held elsewhere.
+ */
+
+#define PTHREAD_RWLOCK_trywrlock(_lock)					\
+	({								\
+		int rc;							\
+									\
+		LOCKPROF_TRY(rc, pthread_rwlock_trywrlock, _lock);	\
+		if (rc == 0) {						\
+			LogFullDebug(COMPONENT_RW_LOCK,			\
+				     "Got write lock on %p (%s) "	\
+				     "at %s:%d", _lock, #_lock,		\
+				     __FILE__, __LINE__);		\
+		} else if (rc != EBUSY) {				\
+			LogCrit(COMPONENT_RW_LOCK,			\
+				"Error %d, write locking %p (%s) "	\
+				"at %s:%d", rc, _lock, #_lock,		\
+				__FILE__, __LINE__);			\
+			abort();					\
+		}							\
+		rc;							\
+	})
+
 /**
  * @brief Logging read-lock
  *
@@ -168,7 +248,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_rwlock_rdlock(_lock);			\
+		LOCKPROF_ACQUIRE(rc, pthread_rwlock_rdlock,		\
+				 pthread_rwlock_tryrdlock,		\
+				 lockprof_rwlock_rdlock, _lock);	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got read lock on %p (%s) "	\
@@ -193,6 +275,7 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
+		LOCKPROF_RELEASE(_lock);				\
 		rc = pthread_rwlock_unlock(_lock);			\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
@@ -218,7 +301,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_mutex_lock(_mtx);				\
+		LOCKPROF_ACQUIRE(rc, pthread_mutex_lock,		\
+				 pthread_mutex_trylock,			\
+				 lockprof_mutex_lock, _mtx);		\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Acquired mutex %p (%s) at %s:%d",	\
@@ -243,6 +328,7 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
+		LOCKPROF_RELEASE(_mtx);					\
 		rc = pthread_mutex_unlock(_mtx);			\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
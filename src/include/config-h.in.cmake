@@ -46,6 +46,7 @@
 #cmakedefine HAVE_DAEMON 1
 #cmakedefine USE_LTTNG 1
 #cmakedefine ENABLE_VFS_DEBUG_ACL 1
+#cmakedefine USE_FSAL_VFS_IO_URING 1
 #cmakedefine ENABLE_RFC_ACL 1
 #cmakedefine USE_GLUSTER_XREADDIRPLUS 1
 #cmakedefine USE_GLUSTER_UPCALL_REGISTER 1
@@ -61,6 +62,7 @@
 #cmakedefine USE_FSAL_CEPH_GET_FS_CID 1
 #cmakedefine USE_FSAL_RGW_MOUNT2 1
 #cmakedefine ENABLE_LOCKTRACE 1
+#cmakedefine ENABLE_LOCKPROF 1
 #cmakedefine SANITIZE_ADDRESS 1
 #cmakedefine DEBUG_MDCACHE 1
 #cmakedefine USE_RADOS_RECOV 1
@@ -214,6 +214,10 @@ void export_add_to_unexport_work_locked(struct gsh_export *a_export);
 void export_add_to_unexport_work(struct gsh_export *a_export);
 struct gsh_export *export_take_mount_work(void);
 struct gsh_export *export_take_unexport_work(void);
+void export_run_parallel(struct gsh_export **exports, bool *ok,
+			 uint32_t count,
+			 bool (*cb)(struct gsh_export *exp, void *state),
+			 void *state);
 
 extern struct config_block add_export_param;
 extern struct config_block update_export_param;
@@ -0,0 +1,85 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file flight_recorder.h
+ * @brief Per-request timelines for slow request diagnosis
+ *
+ * Each worker thread records a timeline of the request it is processing
+ * into a small ring of its own, without locking.  When a request takes
+ * longer than NFS_CORE_PARAM Slow_Request_Threshold, its timeline is
+ * written to the log and kept in a global list of recent slow requests
+ * that can be queried over D-Bus.
+ *
+ * A request suspended on an asynchronous FSAL call takes its record
+ * with it (fr_request_suspend) and the thread that resumes it carries on
+ * recording into the same record (fr_request_resume).
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdint.h>
+#include "gsh_rpc.h"
+
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/**
+ * @brief Points in the life of a request
+ */
+enum fr_event_type {
+	FR_RECV,	/*< Worker picked up the request */
+	FR_DECODE,	/*< Arguments decoded and authenticated */
+	FR_DRC,		/*< Duplicate request cache checked */
+	FR_CREDS,	/*< Export and credentials set up */
+	FR_OP,		/*< Operation (or NFSv4 op) started */
+	FR_OP_DONE,	/*< Operation (or NFSv4 op) finished */
+	FR_FSAL,	/*< Call into the FSAL below MDCACHE started */
+	FR_FSAL_DONE,	/*< Call into the FSAL below MDCACHE returned */
+	FR_SUSPEND,	/*< Suspended on an asynchronous FSAL call */
+	FR_QUEUE,	/*< FSAL call done, queued for a resume thread */
+	FR_RESUME,	/*< Picked up by a resume thread */
+	FR_SEND,	/*< Encoding the reply */
+	FR_ENCODED,	/*< Reply encoded, sending it */
+	FR_SENT,	/*< Reply sent */
+	FR_DONE,	/*< Request complete */
+};
+
+struct fr_record;
+
+void fr_request_start(void);
+void fr_request_info(uint32_t xid, const char *name, const char *client);
+void fr_mark(enum fr_event_type type, const char *name);
+void fr_request_end(void);
+
+struct fr_record *fr_request_suspend(void);
+void fr_request_reattach(struct fr_record *rec);
+void fr_request_queued(struct fr_record *rec);
+struct fr_record *fr_request_resume(struct fr_record *rec);
+void fr_request_restore(struct fr_record *prev);
+
+xdrproc_t fr_encode_proc(xdrproc_t proc);
+
+#ifdef USE_DBUS
+void fr_dbus_show_slow(DBusMessageIter *iter);
+#endif
+
+#endif /* FLIGHT_RECORDER_H */
@@ -319,7 +319,7 @@ struct state_t;
  * rules), increment the minor version
  */
 
-#define FSAL_MINOR_VERSION 0
+#define FSAL_MINOR_VERSION 2
 
 /* Forward references for object methods */
 
@@ -360,6 +360,31 @@ struct io_hints {
 	uint32_t hints;
 };
 
+/** copy_range2 flags */
+#define FSAL_COPY_CLONE 0x01	/*< Share the source's extents, or fail */
+
+/**
+ * @brief Argument for write_same2
+ *
+ * Describes block_count blocks of block_size bytes written from offset.
+ * Each block is zero up to reloff_pattern, then holds pattern repeated to
+ * the end of the block.  The block's number, starting with block_num for
+ * the first block, is then stored at reloff_blocknum as a 32 bit big
+ * endian integer, unless it would not fit in the block.  An empty or all
+ * zero pattern without block numbers zeroes the range.
+ */
+struct fsal_write_same_arg {
+	uint64_t offset;		/*< Where the first block goes */
+	uint64_t block_size;		/*< Size of a block */
+	uint64_t block_count;		/*< Number of blocks */
+	uint64_t reloff_blocknum;	/*< Block number offset in a block */
+	uint32_t block_num;		/*< Number of the first block */
+	uint64_t reloff_pattern;	/*< Pattern offset in a block */
+	struct gsh_buffdesc pattern;	/*< Pattern to repeat */
+	bool fsal_stable;		/*< Requested/achieved stability */
+	uint64_t io_amount;		/*< Bytes written */
+};
+
 /**
  * @brief request op context
  *
@@ -1187,6 +1212,15 @@ struct export_ops {
  * @brief Filesystem operations
  */
 
+/**
+ * @brief Completion callback for read2 and write2
+ *
+ * The callback may be called before read2/write2 returns, or later from
+ * another thread.  In the latter case the FSAL must set op_ctx to the
+ * context read2/write2 was called with, or to a copy of it; the context
+ * stays valid until the callback returns.  The caller may resume the request as soon as the callback is
+ * called, so the FSAL must not touch @a caller_data afterwards.
+ */
 typedef void (*fsal_async_cb)(struct fsal_obj_handle *obj, fsal_status_t ret,
 			      void *obj_data, void *caller_data);
 
@@ -1296,6 +1330,8 @@ struct fsal_io_arg {
 		bool fsal_stable;	/**< requested/achieved stability */
 	};
 	struct state_t *state;	/**< State to use for read (or NULL) */
+	struct attrlist *attrs_out;	/**< Optional attributes after the
+					     write (or NULL) */
 	uint64_t offset;	/**< Offset into file to read */
 	int iov_count;		/**< Number of vectors in iov */
 	struct iovec iov[];	/**< Vector of buffers to fill */
@@ -2341,6 +2377,11 @@ struct fsal_obj_ops {
  * This is an (optionally) asynchronous call.  When the I/O is complete, the @a
  * done_cb callback is called.
  *
+ * If write_arg->attrs_out is not NULL, the FSAL may fill it with the
+ * attributes of the file after a successful write, when it can get them
+ * cheaply.  If it does not, attrs_out->valid_mask is left 0 and the caller
+ * must fetch the attributes itself.
+ *
  * @param[in]     obj_hdl       File on which to operate
  * @param[in]     bypass        If state doesn't indicate a share reservation,
  *                              bypass any non-mandatory deny write
@@ -2501,6 +2542,59 @@ struct fsal_obj_ops {
 			     struct attrlist *attrs,
 			     bool cache_attrs);
 
+/**
+ * @brief Copy a range of a file to another file
+ *
+ * This function copies count bytes of src_hdl from src_offset to obj_hdl
+ * at dst_offset, without moving the data through the upper layers.  The
+ * two files may be the same file, but the ranges may not overlap.  The
+ * copy may be short, the caller then continues from where it stopped.
+ *
+ * With FSAL_COPY_CLONE, the whole range must be made to share the
+ * source's storage, and ERR_FSAL_NOTSUPP is returned if it can't be.
+ *
+ * @param[in]  obj_hdl     File to copy to
+ * @param[in]  dst_state   state_t to use for obj_hdl
+ * @param[in]  dst_offset  Offset to copy to
+ * @param[in]  src_hdl     File to copy from
+ * @param[in]  src_state   state_t to use for src_hdl
+ * @param[in]  src_offset  Offset to copy from
+ * @param[in]  count       Number of bytes to copy
+ * @param[in]  flags       FSAL_COPY_* flags
+ * @param[out] copied      Number of bytes copied
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*copy_range2)(struct fsal_obj_handle *obj_hdl,
+				      struct state_t *dst_state,
+				      uint64_t dst_offset,
+				      struct fsal_obj_handle *src_hdl,
+				      struct state_t *src_state,
+				      uint64_t src_offset,
+				      uint64_t count,
+				      uint32_t flags,
+				      uint64_t *copied);
+
+/**
+ * @brief Write a repeated pattern to a file
+ *
+ * This function writes the blocks described by @a ws_arg without the
+ * data being sent or built by the upper layers, so the FSAL can zero
+ * ranges without writing them and replicate patterns locally.  The write
+ * may be short, but only by whole blocks; ws_arg->io_amount tells how
+ * much was written.  As with write2, fsal_stable asks for the data to
+ * be stable on return and is cleared if it is not.
+ *
+ * @param[in]     obj_hdl  File to write to
+ * @param[in]     state    state_t to use for this operation
+ * @param[in,out] ws_arg   What to write, and how much was written
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*write_same2)(struct fsal_obj_handle *obj_hdl,
+				      struct state_t *state,
+				      struct fsal_write_same_arg *ws_arg);
+
 /**@{*/
 
 /**
@@ -325,6 +325,8 @@ fsal_status_t up_async_delegrecall(struct fridgethr *fr,
 
 /** @} */
 int async_delegrecall(struct fridgethr *fr, struct fsal_obj_handle *obj);
+int async_dir_delegrecall(struct fridgethr *fr, struct fsal_obj_handle *obj,
+			  notify_type4 type, clientid4 clientid);
 
 void up_ready_init(struct fsal_up_vector *up_ops);
 void up_ready_set(struct fsal_up_vector *up_ops);
@@ -323,6 +323,18 @@ typedef struct nfs_core_param {
 		/** TIRPC ioq max simultaneous io threads.  Defaults to
 		    200 and settable by RPC_Ioq_ThrdMax. */
 		uint32_t ioq_thrd_max;
+		/** Max threads finishing requests resumed after an
+		    asynchronous FSAL call.  Defaults to 64 and settable
+		    by RPC_Resume_ThrdMax. */
+		uint32_t resume_thrd_max;
+		/** UDP sockets per protocol, sharing its port and each
+		    served by its own event channel.  Defaults to 1 and
+		    settable by RPC_UDP_Sockets. */
+		uint32_t udp_sockets;
+		/** TCP event channels, each with its own listener per
+		    protocol.  Defaults to 0, one per online CPU, and
+		    settable by RPC_TCP_Channels. */
+		uint32_t tcp_channels;
 		struct {
 			/** Partitions in GSS ctx cache table (default 13). */
 			uint32_t ctx_hash_partitions;
@@ -403,6 +415,25 @@ typedef struct nfs_core_param {
 	    <prefix>.org.ganesha.nfsd */
 	char *dbus_name_prefix;
 	bool enable_trim; /* Enable malloc trim */
+	/** Requests taking at least this many milliseconds have their
+	    timeline logged.  0, the default, disables the flight
+	    recorder. */
+	uint32_t slow_request_threshold;
+	/** Threads initialising export roots and mounting exports in
+	    the PseudoFS at startup.  Defaults to 16 and settable by
+	    Export_Init_Threads. */
+	uint32_t export_init_threads;
+	/** Resident set size, in MB, the caches are sized to stay
+	    under.  0, the default, leaves them at their configured
+	    sizes.  Settable by RSS_Target. */
+	uint32_t rss_target;
+	/** Threads sending NLM replies and GRANTED callbacks.  Defaults
+	    to 8 and settable by NLM_Callback_Threads. */
+	uint32_t nlm_callback_threads;
+	/** GRANTED callbacks sent to one client before its GRANTED_RES
+	    replies come back.  Defaults to 16 and settable by
+	    NLM_Callback_Window. */
+	uint32_t nlm_callback_window;
 } nfs_core_parameter_t;
 
 /** @} */
@@ -499,6 +530,19 @@ typedef struct nfs_version4_parameter {
 	unsigned int minor_versions;
 	/** Number of allowed slots in the 4.1 slot table */
 	uint32_t nb_slots;
+	/** Whether to execute independent PUTFH segments of a COMPOUND
+	    in parallel.  Defaults to false and settable with
+	    Parallel_Compound. */
+	bool parallel_compound;
+	/** Max threads executing parallel COMPOUND segments.  Settable
+	    with Parallel_Compound_ThrdMax. */
+	uint32_t parallel_compound_thrd_max;
+	/** Whether to grant NFSv4.1 directory delegations.  Defaults to
+	    false and settable with Dir_Delegations. */
+	bool dir_delegations;
+	/** Milliseconds directory changes are batched before being sent
+	    in CB_NOTIFY.  Settable with Dir_Deleg_Notify_Delay. */
+	uint32_t dir_deleg_notify_delay;
 } nfs_version4_parameter_t;
 
 /** @} */
@@ -0,0 +1,122 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file lock_prof.h
+ * @brief Lock contention profiler used by the PTHREAD_* lock macros
+ *
+ * Built when ENABLE_LOCKPROF is set.  Every PTHREAD_MUTEX_lock,
+ * PTHREAD_RWLOCK_rdlock and PTHREAD_RWLOCK_wrlock call site gets a
+ * static lockprof_site.  The macros try the lock first, and only when
+ * that fails is the wait for the lock timed.  Hold times are measured
+ * for every contended acquisition and for a sample of uncontended ones.
+ *
+ * Times go into per-site log2 histograms updated with atomics, so
+ * recording never takes a lock.  Sites register themselves on first use
+ * and can be listed, most contended first, with ShowLockProf over D-Bus.
+ *
+ * A lock released by pthread_cond_wait is still considered held, so hold
+ * times of mutexes used with condition variables include the wait.
+ */
+
+#ifndef LOCK_PROF_H
+#define LOCK_PROF_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Buckets of the wait and hold time histograms, bucket n counts times
+ *  below 2^n nanoseconds.
+ */
+#define LOCKPROF_BUCKETS 32
+
+/** One in this many uncontended acquisitions has its hold time measured */
+#define LOCKPROF_SAMPLE_RATE 64
+
+/**
+ * @brief Statistics of one lock call site
+ *
+ * All counters are updated with relaxed atomics.
+ */
+struct lockprof_site {
+	const char *name;	/*< Text of the lock expression */
+	const char *file;	/*< Source file of the call site */
+	int line;		/*< Source line of the call site */
+	uint32_t registered;	/*< Set once the site is on the site list */
+	struct lockprof_site *next;	/*< Next registered site */
+	uint64_t sampled;	/*< Uncontended acquisitions sampled */
+	uint64_t contended;	/*< Acquisitions that had to wait */
+	uint64_t wait_total;	/*< Total wait, nanoseconds */
+	uint64_t wait_max;	/*< Longest wait, nanoseconds */
+	uint64_t hold_count;	/*< Hold times recorded */
+	uint64_t hold_total;	/*< Total hold, nanoseconds */
+	uint64_t hold_max;	/*< Longest hold, nanoseconds */
+	uint64_t wait_hist[LOCKPROF_BUCKETS];
+	uint64_t hold_hist[LOCKPROF_BUCKETS];
+};
+
+#define LOCKPROF_SITE_INIT(_name) { _name, __FILE__, __LINE__ }
+
+/** Acquisitions left before this thread samples an uncontended one */
+extern __thread uint32_t lockprof_countdown;
+
+/** Locks this thread holds whose hold time is being measured */
+extern __thread uint32_t lockprof_depth;
+
+int lockprof_mutex_lock(struct lockprof_site *site, pthread_mutex_t *mtx);
+int lockprof_rwlock_rdlock(struct lockprof_site *site,
+			   pthread_rwlock_t *lock);
+int lockprof_rwlock_wrlock(struct lockprof_site *site,
+			   pthread_rwlock_t *lock);
+void lockprof_sample(struct lockprof_site *site, void *lock);
+void lockprof_release(void *lock);
+void lockprof_forget(void *lock);
+
+/**
+ * @brief Account for a lock acquired without waiting
+ *
+ * Any entry left for the lock is stale by now, drop it.
+ */
+static inline void lockprof_acquired(struct lockprof_site *site, void *lock)
+{
+	if (--lockprof_countdown == 0)
+		lockprof_sample(site, lock);
+	else if (lockprof_depth != 0)
+		lockprof_forget(lock);
+}
+
+/**
+ * @brief Account for a lock about to be released
+ */
+static inline void lockprof_releasing(void *lock)
+{
+	if (lockprof_depth != 0)
+		lockprof_release(lock);
+}
+
+#ifdef USE_DBUS
+void lockprof_dbus_show(DBusMessageIter *iter);
+#endif
+
+#endif /* LOCK_PROF_H */
@@ -0,0 +1,80 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file   mem_budget.h
+ * @brief  Memory budget shared by the caches
+ *
+ * Caches that can give memory back register as budget clients.  When
+ * RSS_Target is set, the reaper hands the accountant the resident set
+ * size every cycle.  Above the target, each client is asked to shrink in
+ * proportion to its size, how little its hits are worth and how much of
+ * what it was asked before it actually gave back to the system.  Well
+ * below the target, budgets grow again towards the configured cache
+ * sizes, favouring the clients with the best hit ratio.
+ */
+
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include <stdint.h>
+#include "gsh_list.h"
+
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/**
+ * @brief A cache whose size the accountant drives
+ *
+ * The callbacks are called from the reaper thread only.
+ */
+struct mem_budget_client {
+	const char *name;		/*< Shown in ganesha_stats */
+	/** Bytes currently held */
+	uint64_t (*usage)(void);
+	/** Cumulative lookups that hit and missed */
+	void (*benefit)(uint64_t *hits, uint64_t *misses);
+	/** Keep usage within @a bytes, 0 lifts the budget.  Returns the
+	 *  bytes given back to the system. */
+	uint64_t (*limit)(uint64_t bytes);
+	uint64_t max_bytes;		/*< Configured size, 0 if unbounded */
+	uint64_t min_bytes;		/*< Budget floor, never shrunk below */
+
+	/* Owned by the accountant */
+	struct glist_head list;
+	uint64_t used;			/*< Usage at the last cycle */
+	uint64_t budget;		/*< Current budget, 0 if none */
+	uint64_t reclaimed;		/*< Bytes given back so far */
+	uint64_t last_hits;
+	uint64_t last_misses;
+	uint32_t ratio;			/*< Smoothed hit ratio, permille */
+	uint32_t yield;			/*< Smoothed share of what was asked
+					    back that was freed, permille */
+};
+
+void mem_budget_register(struct mem_budget_client *client);
+void mem_budget_unregister(struct mem_budget_client *client);
+void mem_budget_run(uint64_t rss_mb);
+
+#ifdef USE_DBUS
+void mem_budget_dbus_show(DBusMessageIter *iter);
+#endif
+
+#endif /* MEM_BUDGET_H */
@@ -41,6 +41,7 @@
 #include "sal_data.h"
 #include "gsh_config.h"
 #include "gsh_wait_queue.h"
+#include "req_arena.h"
 
 #ifdef _USE_9P
 #include "9p.h"
@@ -48,6 +49,9 @@
 #ifdef _ERROR_INJECTION
 #include "err_inject.h"
 #endif
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
 
 /* Delegation client cache limits */
 #define DELEG_SPACE_LIMIT_FILESZ 102400  /* just 100K, revisit? */
@@ -114,8 +118,29 @@ typedef struct request_data {
 					 *  added to the worker thread queue.
 					 */
 	request_type_t rtype;
+	struct req_arena arena;		/*< Memory released with the request */
 } request_data_t;
 
+/**
+ * @brief Get the request an RPC request is part of
+ */
+static inline request_data_t *nfs_req_from_svc(struct svc_req *req)
+{
+	return container_of(req, request_data_t, r_u.req.svc);
+}
+
+/* in nfs_worker_thread.c */
+
+/* Flags of an asynchronous FSAL call a request can be suspended on. */
+#define NFS_ASYNC_DONE	0x01	/*< The FSAL callback has run */
+#define NFS_ASYNC_EXIT	0x02	/*< The issuing thread has let go of the
+				    request */
+
+bool nfs_req_suspend(request_data_t *reqdata, uint32_t *flags);
+void nfs_req_async_done(request_data_t *reqdata, uint32_t *flags);
+int nfs_resume_init(void);
+int nfs_resume_shutdown(void);
+
 /* in nfs_init.c */
 
 extern pool_t *nfs_request_pool;
@@ -164,6 +189,13 @@ void _9p_rdma_cleanup_conn(msk_trans_t *trans);
 void Clean_RPC(void);
 void nfs_Init_svc(void);
 void nfs_rpc_dispatch_stop(void);
+uint32_t nfs_rpc_tcp_channels(void);
+void nfs_rpc_tcp_channel_load(uint32_t chan, int32_t *xprts,
+			      uint64_t *accepted);
+#ifdef USE_DBUS
+void nfs_rpc_udp_dbus_show(DBusMessageIter *iter);
+void nfs_rpc_tcp_dbus_show(DBusMessageIter *iter);
+#endif
 
 /* Config parsing routines */
 extern config_file_t nfs_config_struct;
@@ -134,6 +134,7 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *,
 				 struct svc_req *);
 dupreq_status_t nfs_dupreq_finish(struct svc_req *, nfs_res_t *);
 dupreq_status_t nfs_dupreq_delete(struct svc_req *);
+bool nfs_dupreq_keeps_res(struct svc_req *);
 void nfs_dupreq_rele(struct svc_req *, const nfs_function_desc_t *);
 
 #endif /* NFS_DUPREQ_H */
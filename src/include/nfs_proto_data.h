@@ -103,6 +103,7 @@ typedef union nfs_arg__ {
 struct COMPOUND4res_extended {
 	COMPOUND4res res_compound4;
 	bool res_cached;
+	bool res_arena;	/*< resarray and tag are in the request's arena */
 };
 
 typedef union nfs_res__ {
@@ -188,12 +189,37 @@ typedef struct nfs_function_desc__ {
 	unsigned int dispatch_behaviour;
 } nfs_function_desc_t;
 
+struct request_data;
+struct fr_record;
+
+/**
+ * @brief Continue a suspended request
+ *
+ * Called, with op_ctx set up, once the asynchronous FSAL call the request
+ * was suspended on has completed.
+ *
+ * @return NFS_REQ_OK, NFS_REQ_DROP or NFS_REQ_ASYNC_WAIT.
+ */
+typedef int (*nfs_resume_function_t) (struct request_data *);
+
 typedef struct nfs_request {
 	struct svc_req svc;
 	struct nfs_request_lookahead lookahead;
 	nfs_arg_t arg_nfs;
 	nfs_res_t *res_nfs;
 	const nfs_function_desc_t *funcdesc;
+	/* The request context lives here rather than on the worker's stack
+	 * so that the request can be suspended and resumed on another
+	 * thread.
+	 */
+	struct export_perms export_perms;
+	struct user_cred user_credentials;
+	struct req_op_context req_ctx;
+	nfs_resume_function_t resume_fn;	/*< Continuation of a suspended
+						    request */
+	void *proc_data;	/*< Protocol state for resume_fn */
+	struct fr_record *fr;	/*< Flight recorder timeline while
+				    suspended */
 } nfs_request_t;
 
 enum rpc_chan_type {
@@ -290,8 +316,10 @@ typedef struct nfs_client_cred__ {
  * of a V4 compound request.
  */
 typedef struct compound_data {
-	nfs_fh4 currentFH;	/*< Current filehandle */
-	nfs_fh4 savedFH;	/*< Saved filehandle */
+	nfs_fh4 currentFH;	/*< Current filehandle, buffer in the request
+				    arena */
+	nfs_fh4 savedFH;	/*< Saved filehandle, buffer in the request
+				    arena */
 	stateid4 current_stateid;	/*< Current stateid */
 	bool current_stateid_valid;	/*< Current stateid is valid */
 	stateid4 saved_stateid;	/*< Saved stateid */
@@ -329,6 +357,19 @@ typedef struct compound_data {
 				   (if applicable) */
 	uint32_t resp_size;	/*< Running total response size. */
 	uint32_t op_resp_size;	/*< Current op's response size. */
+	/* Progress through the COMPOUND, so that it can be suspended and
+	 * resumed in the middle of the op array.
+	 */
+	nfs_argop4 *argarray;	/*< Operation arguments */
+	nfs_resop4 *resarray;	/*< Operation results */
+	uint32_t argarray_len;	/*< Number of operations */
+	nfs_res_t *res;		/*< Result of the COMPOUND */
+	nfs_opnum4 opcode;	/*< Opcode of the current operation */
+	nsecs_elapsed_t op_start_time;	/*< Start of the current operation */
+	int (*op_resume)(struct compound_data *,
+			 struct nfs_resop4 *);	/*< Finishes a suspended
+						    operation */
+	void *op_data;		/*< State of the suspended operation */
 } compound_data_t;
 
 #define VARIABLE_RESP_SIZE (0)
@@ -155,6 +155,10 @@ int nfs3_mknod(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 /* Functions needed for nfs v4 */
 
 int nfs4_Compound(nfs_arg_t *, struct svc_req *, nfs_res_t *);
+int nfs4_compound_par_init(void);
+int nfs4_compound_par_shutdown(void);
+int nfs4_copy_init(void);
+int nfs4_copy_shutdown(void);
 
 int nfs4_op_access(struct nfs_argop4 *, compound_data_t *,
 		   struct nfs_resop4 *);
@@ -281,6 +285,9 @@ int nfs4_op_free_stateid(struct nfs_argop4 *, compound_data_t *,
 int nfs4_op_getdeviceinfo(struct nfs_argop4 *, compound_data_t *,
 			  struct nfs_resop4 *);
 
+int nfs4_op_get_dir_delegation(struct nfs_argop4 *, compound_data_t *,
+			       struct nfs_resop4 *);
+
 int nfs4_op_destroy_clientid(struct nfs_argop4 *, compound_data_t *,
 			     struct nfs_resop4 *);
 
@@ -336,6 +343,26 @@ int nfs4_op_seek(struct nfs_argop4 *, compound_data_t *,
 
 void nfs4_op_seek_Free(nfs_resop4 *resp);
 
+int nfs4_op_copy(struct nfs_argop4 *, compound_data_t *,
+		 struct nfs_resop4 *);
+
+void nfs4_op_copy_Free(nfs_resop4 *resp);
+
+int nfs4_op_clone(struct nfs_argop4 *, compound_data_t *,
+		  struct nfs_resop4 *);
+
+void nfs4_op_clone_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_status(struct nfs_argop4 *, compound_data_t *,
+			   struct nfs_resop4 *);
+
+void nfs4_op_offload_status_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_cancel(struct nfs_argop4 *, compound_data_t *,
+			   struct nfs_resop4 *);
+
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp);
+
 int nfs4_op_io_advise(struct nfs_argop4 *, compound_data_t *,
 		      struct nfs_resop4 *);
 
@@ -378,6 +405,13 @@ void nfs4_op_removexattr_Free(nfs_resop4 *resp);
 
 #define NFS_REQ_OK   0
 #define NFS_REQ_DROP 1
+/** The request is waiting on an asynchronous FSAL call and will be
+ *  finished by nfs_request_t::resume_fn, see nfs_req_suspend(). */
+#define NFS_REQ_ASYNC_WAIT 2
+
+/** Returned instead of an nfsstat4 by an NFSv4 operation that suspended
+ *  the COMPOUND, the operation is finished by compound_data::op_resume. */
+#define NFS4_OP_ASYNC_WAIT (-1)
 
 /* Free functions */
 void mnt1_Mnt_Free(nfs_res_t *);
@@ -493,6 +527,7 @@ void nfs4_op_close_Free(nfs_resop4 *);
 void nfs4_op_create_session_Free(nfs_resop4 *);
 void nfs4_op_getdevicelist_Free(nfs_resop4 *);
 void nfs4_op_getdeviceinfo_Free(nfs_resop4 *);
+void nfs4_op_get_dir_delegation_Free(nfs_resop4 *);
 void nfs4_op_free_stateid_Free(nfs_resop4 *);
 void nfs4_op_destroy_session_Free(nfs_resop4 *);
 void nfs4_op_lock_Free(nfs_resop4 *);
@@ -28,10 +28,14 @@
 
 #include "sal_data.h"
 
-extern pthread_mutex_t nlm_async_resp_mutex;
-extern pthread_cond_t nlm_async_resp_cond;
-
 int nlm_async_callback_init(void);
+void nlm_async_callback_shutdown(void);
+
+void nlm_async_host_init(state_nlm_client_t *host);
+void nlm_async_host_fini(state_nlm_client_t *host);
+
+state_status_t nlm_async_schedule(state_async_queue_t *arg);
+void nlm_async_prewarm(state_nlm_client_t *host);
 
 int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 			    nfs_res_t *pres);
@@ -39,11 +43,15 @@ int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 int nlm_send_async_res_nlm4test(state_nlm_client_t *host,
 				state_async_func_t func, nfs_res_t *pres);
 
-/* Client routine  to send the asynchrnous response, key is used to wait for
- * a response
+bool nlm_inflight_reserve(state_nlm_client_t *host, state_async_queue_t *arg);
+
+/* Client routine  to send the asynchrnous response, a nonzero key holds
+ * the in-flight slot taken by nlm_inflight_reserve until
+ * nlm_signal_async_resp
  */
-int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key);
+int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg,
+		   uint64_t key);
 
-void nlm_signal_async_resp(void *key);
+void nlm_signal_async_resp(state_nlm_client_t *host, uint64_t key);
 
 #endif				/* NLM_ASYNC_H */
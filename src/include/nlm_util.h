@@ -82,4 +82,6 @@ nlm4_stats nlm_convert_state_error(state_status_t status);
 state_status_t nlm_granted_callback(struct fsal_obj_handle *obj,
 				    state_lock_entry_t *lock_entry);
 
+uint64_t nlm_granted_cookie_seq(netobj *cookie);
+
 #endif				/* NLM_UTIL_H */
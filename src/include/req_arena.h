@@ -0,0 +1,100 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file   req_arena.h
+ * @brief  Per-request bump allocator
+ *
+ * A request arena hands out zeroed memory by bumping a pointer through
+ * chunks taken from a pool, and gives everything back at once when the
+ * request is freed.  Nothing allocated from an arena may be freed on its
+ * own, or outlive the request: results kept in the duplicate request
+ * cache or in a session slot must be allocated from the heap instead.
+ */
+
+#ifndef REQ_ARENA_H
+#define REQ_ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "gsh_intrinsic.h"
+
+/** Size of a pooled arena chunk, header included */
+#define REQ_ARENA_CHUNK_SIZE 4096
+
+/** Alignment of arena allocations */
+#define REQ_ARENA_ALIGN 16
+
+/**
+ * @brief A chunk of arena memory
+ */
+struct req_arena_chunk {
+	struct req_arena_chunk *next;	/*< Next chunk of the arena */
+	uint32_t size;			/*< Usable bytes in data */
+	uint32_t used;			/*< Bytes handed out */
+	bool oversize;			/*< From the heap rather than the pool */
+	char data[] __attribute__ ((aligned(REQ_ARENA_ALIGN)));
+};
+
+/**
+ * @brief A request's arena
+ *
+ * Embedded in the request, an all zero arena is empty and ready for use.
+ */
+struct req_arena {
+	struct req_arena_chunk *chunks;	/*< Chunks, the one being carved
+					    first */
+	uint32_t allocs;		/*< Allocations served */
+	uint32_t nchunks;		/*< Chunks taken */
+};
+
+void req_arena_pkginit(void);
+void req_arena_pkgshutdown(void);
+void *req_arena_alloc_slow(struct req_arena *arena, size_t size);
+void req_arena_release(struct req_arena *arena);
+
+/**
+ * @brief Allocate zeroed memory from an arena
+ *
+ * This function aborts if no memory is available.
+ *
+ * @param[in,out] arena The arena
+ * @param[in]     size  Bytes to allocate
+ *
+ * @return The memory, valid until the arena is released.
+ */
+static inline void *req_arena_alloc(struct req_arena *arena, size_t size)
+{
+	struct req_arena_chunk *chunk = arena->chunks;
+	void *p;
+
+	size = (size + REQ_ARENA_ALIGN - 1) & ~(size_t)(REQ_ARENA_ALIGN - 1);
+
+	if (unlikely(chunk == NULL || chunk->size - chunk->used < size))
+		return req_arena_alloc_slow(arena, size);
+
+	p = chunk->data + chunk->used;
+	chunk->used += size;
+	arena->allocs++;
+	memset(p, 0, size);
+	return p;
+}
+
+#endif /* REQ_ARENA_H */
@@ -329,6 +329,24 @@ struct state_deleg {
 	open_delegation_type4 sd_type;
 	enum deleg_state sd_state;
 	struct cf_deleg_stats sd_clfile_stats;  /* client specific */
+	/* The rest is only used by directory delegations, and is
+	 * protected by the directory's state_lock.
+	 */
+	uint32_t sd_notify_types;	/*< Granted notifications, as bits */
+	uint32_t sd_notify_count;	/*< Changes queued on sd_notify_list */
+	struct glist_head sd_notify_list;	/*< Changes for CB_NOTIFY */
+	bool sd_notify_sched;	/*< A CB_NOTIFY is scheduled */
+};
+
+/**
+ * @brief A directory change waiting to be sent in CB_NOTIFY
+ */
+
+struct dir_notify_entry {
+	struct glist_head dne_list;	/*< Link in sd_notify_list */
+	notify_type4 dne_type;	/*< NOTIFY4_ADD_ENTRY etc. */
+	char *dne_name;		/*< Entry added or removed, or old name */
+	char *dne_newname;	/*< New name for NOTIFY4_RENAME_ENTRY */
 };
 
 /**
@@ -355,7 +373,6 @@ union state_data {
 	struct state_deleg deleg;
 	struct state_layout layout;
 	struct state_9p_fid fid;
-	uint32_t io_advise;
 };
 
 /**
@@ -400,6 +417,8 @@ struct state_t {
 	struct state_refer state_refer;	/**< For NFSv4.1, track the
 					   call that created a
 					   state. */
+	uint32_t state_io_advise;	/**< IO_ADVISE hints honoured for
+					   this stateid */
 };
 
 /* Macros to compare and copy state_t to a struct stateid4 */
@@ -513,6 +532,22 @@ struct state_nlm_client_t {
 	char *slc_nlm_caller_name;	/*< Client name */
 	CLIENT *slc_callback_clnt;	/*< Callback for blocking locks */
 	AUTH *slc_callback_auth;	/*< Authentication for callback */
+	pthread_mutex_t slc_callback_mutex;	/*< Protects the callback
+						   client and its address */
+	struct sockaddr_storage slc_callback_addr; /*< Resolved address of
+						       the client's NLM */
+	socklen_t slc_callback_addrlen;	/*< 0 until resolved */
+	time_t slc_callback_expire;	/*< When to resolve again */
+	bool slc_callback_warming;	/*< A connect is queued */
+	pthread_mutex_t slc_inflight_mutex;	/*< Protects slc_inflight,
+						   slc_deferred and
+						   slc_inflight_timer */
+	struct glist_head slc_inflight;	/*< GRANTED calls awaiting a
+					   GRANTED_RES */
+	uint32_t slc_inflight_count;	/*< Length of slc_inflight */
+	struct glist_head slc_deferred;	/*< GRANTED calls waiting for a
+					   slot in slc_inflight */
+	bool slc_inflight_timer;	/*< An expiry check is scheduled */
 };
 
 /**
@@ -912,6 +947,13 @@ struct state_dir {
 	    for which this entry is a root for. This field is used
 	    with the atomic inc/dec/fetch routines. */
 	int32_t exp_root_refcount;
+	/** Directory delegations on this directory.
+	 * Protected by state_lock */
+	struct glist_head list_of_states;
+	/** Number of directory delegations, so changes can skip the
+	    state_lock when there are none.  This field is used with the
+	    atomic inc/dec/fetch routines. */
+	int32_t dir_delegations;
 };
 
 struct state_hdl {
@@ -1021,7 +1063,7 @@ typedef void (state_async_func_t) (state_async_queue_t *arg);
  */
 typedef struct state_nlm_async_data_t {
 	state_nlm_client_t *nlm_async_host;	/*< The client */
-	void *nlm_async_key;	/*< Identifying key */
+	uint64_t nlm_async_key;	/*< Sequence number of a grant, or 0 */
 	union {
 		nfs_res_t nlm_async_res;	/*< Asynchronous response */
 		nlm4_testargs nlm_async_grant;	/*< Arguments for grant */
@@ -139,12 +139,45 @@ static inline void state_hdl_init(struct state_hdl *ostate,
 		break;
 	case DIRECTORY:
 		glist_init(&ostate->dir.export_roots);
+		glist_init(&ostate->dir.list_of_states);
 		break;
 	default:
 		break;
 	}
 }
 
+/**
+ * @brief Check whether a directory has directory delegations
+ *
+ * Lets changes to undelegated directories skip the state_lock.
+ *
+ * @param[in] dir	Object to look at
+ */
+static inline bool state_dir_delegated(struct fsal_obj_handle *dir)
+{
+	return dir->type == DIRECTORY &&
+	       atomic_fetch_int32_t(&dir->state_hdl->dir.dir_delegations) != 0;
+}
+
+/**
+ * @brief Get the list of NFSv4 states on an object
+ *
+ * Regular files keep their share, lock, delegation and layout states
+ * here; directories only have directory delegations.
+ *
+ * @param[in] obj	Object to look at
+ *
+ * @return The list, protected by the state_lock.
+ */
+static inline struct glist_head *
+state_obj_list_of_states(struct fsal_obj_handle *obj)
+{
+	if (obj->type == DIRECTORY)
+		return &obj->state_hdl->dir.list_of_states;
+
+	return &obj->state_hdl->file.list_of_states;
+}
+
 /**
  * @brief Clean up a state handle
  *
@@ -926,10 +959,30 @@ void get_deleg_perm(nfsace4 *permissions, open_delegation_type4 type);
 void update_delegation_stats(struct state_hdl *ostate,
 			     state_owner_t *owner);
 state_status_t delegrecall_impl(struct fsal_obj_handle *obj);
+state_status_t delegrecall_dir_impl(struct fsal_obj_handle *obj,
+				    notify_type4 type, clientid4 clientid);
 nfsstat4 deleg_revoke(struct fsal_obj_handle *obj, struct state_t *deleg_state);
 void state_deleg_revoke(struct fsal_obj_handle *obj, state_t *state);
 bool state_deleg_conflict(struct fsal_obj_handle *obj, bool write);
 
+/******************************************************************************
+ *
+ * Directory delegation functions
+ *
+ ******************************************************************************/
+
+void init_new_dir_deleg_state(union state_data *deleg_state,
+			      uint32_t notify_types);
+void state_dir_deleg_cleanup(struct fsal_obj_handle *dir, state_t *state);
+bool state_dir_deleg_recall_needed(state_t *state, notify_type4 type,
+				   clientid4 clientid);
+bool state_dir_deleg_conflict(struct fsal_obj_handle *dir,
+			      notify_type4 type);
+void state_dir_deleg_notify(struct fsal_obj_handle *dir, notify_type4 type,
+			    const char *name, const char *newname);
+void dir_deleg_stats_granted(void);
+void dir_deleg_stats_recalled(void);
+
 /******************************************************************************
  *
  * Layout functions
@@ -1075,6 +1128,8 @@ struct nfs4_recovery_backend {
 
 void fs_backend_init(struct nfs4_recovery_backend **);
 void fs_ng_backend_init(struct nfs4_recovery_backend **);
+int fs_log_set_param_from_conf(config_file_t, struct config_error_type *);
+void fs_log_backend_init(struct nfs4_recovery_backend **);
 #ifdef USE_RADOS_RECOV
 int rados_kv_set_param_from_conf(config_file_t, struct config_error_type *);
 void rados_kv_backend_init(struct nfs4_recovery_backend **);
@@ -435,6 +435,90 @@ CLNT_CMP_OPS_REPLY
 	.direction = "out"  \
 }
 
+#define MEM_POOLS_REPLY      \
+{                           \
+	.name = "pools", \
+	.type = "a(stttttt)",     \
+	.direction = "out"  \
+}
+
+#define SLOW_OPS_REPLY      \
+{                           \
+	.name = "slow_ops", \
+	.type = "a(usstts)",     \
+	.direction = "out"  \
+}
+
+#define LOCK_PROF_REPLY      \
+{                           \
+	.name = "lock_sites", \
+	.type = "a(sstttttttt)",     \
+	.direction = "out"  \
+}
+
+#define REQ_ARENA_REPLY      \
+{                           \
+	.name = "arena", \
+	.type = "(tttt)",     \
+	.direction = "out"  \
+}
+
+#define MEM_BUDGET_REPLY      \
+{                           \
+	.name = "mem_budget", \
+	.type = "(tta(sttttt))",     \
+	.direction = "out"  \
+}
+
+#define UID2GRP_REPLY      \
+{                           \
+	.name = "uid2grp", \
+	.type = "(ttttttttt)",     \
+	.direction = "out"  \
+}
+
+#define UDP_REPLY      \
+{                           \
+	.name = "udp", \
+	.type = "(ua(sutttt))",     \
+	.direction = "out"  \
+}
+
+#define TCP_REPLY      \
+{                           \
+	.name = "tcp", \
+	.type = "(ua(uit))",     \
+	.direction = "out"  \
+}
+
+#define COMPOUND_PAR_REPLY      \
+{                           \
+	.name = "compound_par", \
+	.type = "(ttt)",     \
+	.direction = "out"  \
+}
+
+#define DIR_DELEG_REPLY      \
+{                           \
+	.name = "dir_deleg", \
+	.type = "(ttttt)",     \
+	.direction = "out"  \
+}
+
+#define READAHEAD_REPLY      \
+{                           \
+	.name = "readahead", \
+	.type = "(tttttttt)",     \
+	.direction = "out"  \
+}
+
+#define FD_CACHE_REPLY      \
+{                           \
+	.name = "fd_cache", \
+	.type = "(stststststst)",     \
+	.direction = "out"  \
+}
+
 void server_stats_summary(DBusMessageIter * iter, struct gsh_stats *st);
 void server_dbus_client_io_ops(DBusMessageIter *iter,
 				struct gsh_client *client);
@@ -457,6 +541,10 @@ void global_dbus_total_ops(DBusMessageIter *iter);
 void server_dbus_fast_ops(DBusMessageIter *iter);
 void mdcache_dbus_show(DBusMessageIter *iter);
 void mdcache_utilization(DBusMessageIter *iter);
+void pool_dbus_show(DBusMessageIter *iter);
+void req_arena_dbus_show(DBusMessageIter *iter);
+void nfs4_compound_par_dbus_show(DBusMessageIter *iter);
+void dir_deleg_dbus_show(DBusMessageIter *iter);
 void server_dbus_v3_full_stats(DBusMessageIter *iter);
 void server_dbus_v4_full_stats(DBusMessageIter *iter);
 void reset_server_stats(void);
@@ -41,8 +41,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <pthread.h>
+#include <pwd.h>
 #include "gsh_rpc.h"
 #include "gsh_types.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
 
 /**
  * @brief Shared between idmapper.c and uid2grp_cache.c.  If you
@@ -57,11 +61,46 @@ typedef struct group_data {
 	time_t epoch;
 	int nbgroups;
 	unsigned int refcount;
+	uint32_t refreshing;	/*< A background refresh is queued */
 	pthread_mutex_t lock;
 	gid_t *groups;
 } group_data_t;
 
-extern pthread_rwlock_t uid2grp_user_lock;
+/**
+ * @brief Name service calls used to fill the cache
+ *
+ * The C library's by default, replaced by tests.
+ */
+struct uid2grp_nss {
+	int (*getpwuid_r)(uid_t uid, struct passwd *pwd, char *buf,
+			  size_t buflen, struct passwd **result);
+	int (*getpwnam_r)(const char *name, struct passwd *pwd, char *buf,
+			  size_t buflen, struct passwd **result);
+	int (*getgrouplist)(const char *user, gid_t group, gid_t *groups,
+			    int *ngroups);
+};
+
+extern struct uid2grp_nss uid2grp_nss;
+
+/** Shards of the cache, should be prime */
+#define UID2GRP_SHARDS 17
+
+static inline unsigned int uid2grp_uid_shard(uid_t uid)
+{
+	return uid % UID2GRP_SHARDS;
+}
+
+static inline unsigned int uid2grp_name_shard(const struct gsh_buffdesc *name)
+{
+	const unsigned char *p = name->addr;
+	unsigned int hash = 5381;
+	size_t i;
+
+	for (i = 0; i < name->len; i++)
+		hash = hash * 33 + p[i];
+
+	return hash % UID2GRP_SHARDS;
+}
 
 void uid2grp_cache_init(void);
 
@@ -70,9 +109,6 @@ bool uid2grp_lookup_by_uname(const struct gsh_buffdesc *, uid_t *,
 			     struct group_data **);
 bool uid2grp_lookup_by_uid(const uid_t, struct group_data **);
 
-void uid2grp_remove_by_uname(const struct gsh_buffdesc *);
-void uid2grp_remove_by_uid(const uid_t);
-
 void uid2grp_clear_cache(void);
 
 bool uid2grp(uid_t uid, struct group_data **);
@@ -81,5 +117,12 @@ void uid2grp_unref(struct group_data *gdata);
 void uid2grp_hold_group_data(struct group_data *);
 void uid2grp_release_group_data(struct group_data *);
 
+void uid2grp_refresh_init(void);
+void uid2grp_refresh_shutdown(void);
+
+#ifdef USE_DBUS
+void uid2grp_dbus_show(DBusMessageIter *iter);
+#endif
+
 #endif				/* UID2GRP_H */
 /** @} */
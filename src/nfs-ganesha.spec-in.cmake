@@ -48,6 +48,12 @@ Requires: openSUSE-release
 @BCOND_NULLFS@ nullfs
 %global use_fsal_null %{on_off_switch nullfs}
 
+@BCOND_WBCACHE@ wbcache
+%global use_fsal_wbcache %{on_off_switch wbcache}
+
+@BCOND_LATENCY@ latency
+%global use_fsal_latency %{on_off_switch latency}
+
 @BCOND_MEM@ mem
 %global use_fsal_mem %{on_off_switch mem}
 
@@ -301,6 +307,32 @@ This package contains a Stackable FSAL shared object to
 be used with NFS-Ganesha. This is mostly a template for future (more sophisticated) stackable FSALs
 %endif
 
+# WBCACHE
+%if %{with wbcache}
+%package wbcache
+Summary: The NFS-GANESHA WBCACHE Stackable FSAL
+Group: Applications/System
+Requires: nfs-ganesha = %{version}-%{release}
+
+%description wbcache
+This package contains a Stackable FSAL shared object to
+be used with NFS-Ganesha. It caches file data of a slower FSAL in a local
+directory, with write-back of dirty data on COMMIT and close.
+%endif
+
+# LATENCY
+%if %{with latency}
+%package latency
+Summary: The NFS-GANESHA LATENCY Stackable FSAL
+Group: Applications/System
+Requires: nfs-ganesha = %{version}-%{release}
+
+%description latency
+This package contains a Stackable FSAL shared object to
+be used with NFS-Ganesha. It records call counts, errors and latency
+histograms of each FSAL method of the FSAL below it.
+%endif
+
 # MEM
 %if %{with mem}
 %package mem
@@ -415,6 +447,8 @@ be used with NFS-Ganesha to support Gluster
 cmake .	-DCMAKE_BUILD_TYPE=Debug			\
 	-DBUILD_CONFIG=rpmbuild				\
 	-DUSE_FSAL_NULL=%{use_fsal_null}		\
+	-DUSE_FSAL_WBCACHE=%{use_fsal_wbcache}		\
+	-DUSE_FSAL_LATENCY=%{use_fsal_latency}		\
 	-DUSE_FSAL_MEM=%{use_fsal_mem}			\
 	-DUSE_FSAL_XFS=%{use_fsal_xfs}			\
 	-DUSE_FSAL_LUSTRE=%{use_fsal_lustre}			\
@@ -660,6 +694,16 @@ exit 0
 %{_libdir}/ganesha/libfsalnull*
 %endif
 
+%if %{with wbcache}
+%files wbcache
+%{_libdir}/ganesha/libfsalwbcache*
+%endif
+
+%if %{with latency}
+%files latency
+%{_libdir}/ganesha/libfsallatency*
+%endif
+
 %if %{with mem}
 %files mem
 %{_libdir}/ganesha/libfsalmem*
@@ -33,6 +33,66 @@ class RetrieveExportStats():
         stats_op = self.exportmgrobj.get_dbus_method("ShowCacheInode",
                                  self.dbus_exportstats_name)
         return InodeStats(stats_op())
+    # shared fd cache stats
+    def fd_cache_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowFDCache",
+                                 self.dbus_exportstats_name)
+        return FDCacheStats(stats_op())
+    # access pattern detection and readahead stats
+    def readahead_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowReadahead",
+                                 self.dbus_exportstats_name)
+        return ReadaheadStats(stats_op())
+    # object pool allocator stats
+    def mem_pools_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowMemPools",
+                                 self.dbus_exportstats_name)
+        return MemPoolStats(stats_op())
+    # per-request arena allocator stats
+    def req_arena_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowReqArena",
+                                 self.dbus_exportstats_name)
+        return ReqArenaStats(stats_op())
+    # memory budget stats
+    def mem_budget_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowMemBudget",
+                                 self.dbus_exportstats_name)
+        return MemBudgetStats(stats_op())
+    # supplementary group cache stats
+    def uid2grp_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowUid2grp",
+                                 self.dbus_exportstats_name)
+        return Uid2grpStats(stats_op())
+    # per socket UDP listener stats
+    def udp_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowUDP",
+                                 self.dbus_exportstats_name)
+        return UdpStats(stats_op())
+    # per channel TCP connection stats
+    def tcp_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowTCP",
+                                 self.dbus_exportstats_name)
+        return TcpStats(stats_op())
+    # parallel COMPOUND segment stats
+    def compound_par_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowCompoundPar",
+                                 self.dbus_exportstats_name)
+        return CompoundParStats(stats_op())
+    # directory delegation and CB_NOTIFY stats
+    def dir_deleg_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowDirDeleg",
+                                 self.dbus_exportstats_name)
+        return DirDelegStats(stats_op())
+    # recent slow requests from the flight recorder
+    def slow_ops_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowSlowOps",
+                                 self.dbus_exportstats_name)
+        return SlowOpsStats(stats_op())
+    # most contended lock call sites
+    def lock_prof_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowLockProf",
+                                 self.dbus_exportstats_name)
+        return LockProfStats(stats_op())
     # list of all exports
     def export_stats(self):
         stats_op = self.exportmgrobj.get_dbus_method("ShowExports",
@@ -485,6 +545,9 @@ class InodeStats():
             output += "\n" + (self.stats[3][6]).ljust(25) + "%s" % (str(self.stats[3][7]).rjust(20))
             output += "\n" + (self.stats[3][8]).ljust(25) + "%s" % (str(self.stats[3][9]).rjust(20))
             output += "\n" + (self.stats[3][10]).ljust(25) + "%s" % (str(self.stats[3][11]).rjust(20))
+            output += "\n" + (self.stats[3][12]).ljust(25) + "%s" % (str(self.stats[3][13]).rjust(20))
+            output += "\n" + (self.stats[3][14]).ljust(25) + "%s" % (str(self.stats[3][15]).rjust(20))
+            output += "\n" + (self.stats[3][16]).ljust(25) + "%s" % (str(self.stats[3][17]).rjust(20))
             output += "\n\nLRU Utilization Data"
             output += "\n" + (self.stats[4][0]).ljust(25) + "%s" % (str(self.stats[4][1]).rjust(20))
             output += "\n" + (self.stats[4][2]).ljust(25) + "%s" % (str(self.stats[4][3]).rjust(20))
@@ -494,6 +557,259 @@ class InodeStats():
         return output
 
 
+class FDCacheStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        output += "\nShared FD Cache statistics"
+        for i in range(0, len(self.stats[3]), 2):
+            output += "\n" + (self.stats[3][i]).ljust(25) + "%s" % (str(self.stats[3][i+1]).rjust(20))
+        return output
+
+
+class ReadaheadStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        reads, seq, stride, rand, readaheads, ra_bytes, hits, hints = self.stats[3]
+        output += "\nReadahead statistics"
+        output += "\n" + "Reads".ljust(25) + str(reads).rjust(20)
+        output += "\n" + "Sequential reads".ljust(25) + str(seq).rjust(20)
+        output += "\n" + "Strided reads".ljust(25) + str(stride).rjust(20)
+        output += "\n" + "Random reads".ljust(25) + str(rand).rjust(20)
+        output += "\n" + "Readaheads".ljust(25) + str(readaheads).rjust(20)
+        output += "\n" + "Bytes read ahead".ljust(25) + str(ra_bytes).rjust(20)
+        output += "\n" + "Readahead hits".ljust(25) + str(hits).rjust(20)
+        output += "\n" + "IO_ADVISE calls".ljust(25) + str(hints).rjust(20)
+        if reads:
+            output += "\n" + "Hit rate".ljust(25)
+            output += ("%.2f%%" % (100.0 * hits / reads)).rjust(20)
+        return output
+
+
+class MemPoolStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        output += "\n" + "Pool".ljust(30) + "Obj Size".rjust(10) + "Live".rjust(12)
+        output += "Slab Bytes".rjust(14) + "Allocs".rjust(14) + "Mag Hit %".rjust(11)
+        for pool in self.stats[3]:
+            if pool[4]:
+                hit_rate = "%.1f" % (100.0 * pool[6] / pool[4])
+            else:
+                hit_rate = "-"
+            output += "\n" + str(pool[0]).ljust(30) + str(pool[1]).rjust(10)
+            output += str(pool[2]).rjust(12) + str(pool[3]).rjust(14)
+            output += str(pool[4]).rjust(14) + hit_rate.rjust(11)
+        return output
+
+
+class MemBudgetStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        target, rss, clients = self.stats[3]
+        output += "\n" + "RSS target (MB)".ljust(25) + str(target).rjust(20)
+        output += "\n" + "RSS (MB)".ljust(25) + str(rss).rjust(20)
+        output += "\n\n" + "Cache".ljust(25) + "Used".rjust(14) + "Budget".rjust(14)
+        output += "Hit %".rjust(8) + "Reclaimed".rjust(14)
+        for client in clients:
+            if client[3] + client[4]:
+                hit_rate = "%.1f" % (100.0 * client[3] / (client[3] + client[4]))
+            else:
+                hit_rate = "-"
+            budget = str(client[2]) if client[2] else "-"
+            output += "\n" + str(client[0]).ljust(25) + str(client[1]).rjust(14)
+            output += budget.rjust(14) + hit_rate.rjust(8)
+            output += str(client[5]).rjust(14)
+        return output
+
+
+class Uid2grpStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        (hits, stale, misses, collapsed, miss_lat, refreshes, failures,
+         refresh_lat, refresh_max) = self.stats[3]
+        output += "\n" + "Hits".ljust(25) + str(hits).rjust(20)
+        output += "\n" + "Stale hits".ljust(25) + str(stale).rjust(20)
+        output += "\n" + "Misses".ljust(25) + str(misses).rjust(20)
+        output += "\n" + "Collapsed misses".ljust(25) + str(collapsed).rjust(20)
+        lookups = misses - collapsed
+        if lookups:
+            output += "\n" + "Miss latency (ms)".ljust(25)
+            output += ("%.3f" % (miss_lat / 1000000.0 / lookups)).rjust(20)
+        output += "\n" + "Refreshes".ljust(25) + str(refreshes).rjust(20)
+        output += "\n" + "Refresh failures".ljust(25) + str(failures).rjust(20)
+        if refreshes:
+            output += "\n" + "Refresh latency (ms)".ljust(25)
+            output += ("%.3f" % (refresh_lat / 1000000.0 / refreshes)).rjust(20)
+            output += "\n" + "Refresh max (ms)".ljust(25)
+            output += ("%.3f" % (refresh_max / 1000000.0)).rjust(20)
+        return output
+
+
+class UdpStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        nsockets, sockets = self.stats[3]
+        output += "\n" + "Sockets per protocol".ljust(25) + str(nsockets).rjust(20)
+        output += "\n\n" + "Socket".ljust(12) + "Received".rjust(16) + "Dropped".rjust(12)
+        output += "Queued".rjust(12) + "Buffer".rjust(12)
+        for (tag, index, recvs, drops, queued, rcvbuf) in sockets:
+            output += "\n" + (tag + "/" + str(index)).ljust(12)
+            output += str(recvs).rjust(16) + str(drops).rjust(12)
+            output += str(queued).rjust(12) + str(rcvbuf).rjust(12)
+        return output
+
+
+class TcpStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        nchannels, channels = self.stats[3]
+        output += "\n" + "Event channels".ljust(25) + str(nchannels).rjust(20)
+        output += "\n\n" + "Channel".ljust(12) + "Connections".rjust(16) + "Accepted".rjust(16)
+        for (index, xprts, accepted) in channels:
+            output += "\n" + str(index).ljust(12)
+            output += str(xprts).rjust(16) + str(accepted).rjust(16)
+        return output
+
+
+class ReqArenaStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        arenas, allocs, chunks, oversize = self.stats[3]
+        output += "\nRequest arena statistics"
+        output += "\n" + "Requests".ljust(25) + str(arenas).rjust(20)
+        output += "\n" + "Allocations".ljust(25) + str(allocs).rjust(20)
+        output += "\n" + "Chunks".ljust(25) + str(chunks).rjust(20)
+        output += "\n" + "Oversize chunks".ljust(25) + str(oversize).rjust(20)
+        if arenas:
+            output += "\n" + "Allocations per request".ljust(25)
+            output += ("%.1f" % (float(allocs) / arenas)).rjust(20)
+            output += "\n" + "Chunks per request".ljust(25)
+            output += ("%.2f" % (float(chunks) / arenas)).rjust(20)
+        return output
+
+
+class CompoundParStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        runs, segments, ops = self.stats[3]
+        output += "\nParallel COMPOUND statistics"
+        output += "\n" + "Parallel runs".ljust(25) + str(runs).rjust(20)
+        output += "\n" + "Segments".ljust(25) + str(segments).rjust(20)
+        output += "\n" + "Operations".ljust(25) + str(ops).rjust(20)
+        if runs:
+            output += "\n" + "Segments per run".ljust(25)
+            output += ("%.2f" % (float(segments) / runs)).rjust(20)
+            output += "\n" + "Operations per run".ljust(25)
+            output += ("%.1f" % (float(ops) / runs)).rjust(20)
+        return output
+
+
+class DirDelegStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        granted, recalled, notifies, changes, avoided = self.stats[3]
+        output += "\nDirectory delegation statistics"
+        output += "\n" + "Granted".ljust(25) + str(granted).rjust(20)
+        output += "\n" + "Recalled".ljust(25) + str(recalled).rjust(20)
+        output += "\n" + "CB_NOTIFY sent".ljust(25) + str(notifies).rjust(20)
+        output += "\n" + "Changes notified".ljust(25) + str(changes).rjust(20)
+        output += "\n" + "GETATTR+READDIR avoided".ljust(25) + str(avoided).rjust(20)
+        if notifies:
+            output += "\n" + "Changes per CB_NOTIFY".ljust(25)
+            output += ("%.2f" % (float(changes) / notifies)).rjust(20)
+        return output
+
+
+class SlowOpsStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        if not self.stats[3]:
+            return output + "\nNo slow requests recorded"
+        for req in self.stats[3]:
+            output += "\n" + time.ctime(req[3]) + " xid=" + str(req[0])
+            output += " " + str(req[1]) + " from " + str(req[2])
+            output += " took %d us" % (req[4] // 1000)
+            output += "\n    " + str(req[5])
+        return output
+
+
+class LockProfStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        output += "\n" + "Lock".ljust(32) + "Site".ljust(32) + "Contended".rjust(11)
+        output += "Wait ms".rjust(11) + "Max us".rjust(10) + "p99 us".rjust(10)
+        output += "Avg Hold us".rjust(13)
+        for site in self.stats[3]:
+            if site[7]:
+                avg_hold = "%.1f" % (site[8] / 1000.0 / site[7])
+            else:
+                avg_hold = "-"
+            output += "\n" + str(site[0])[:31].ljust(32) + str(site[1])[:31].ljust(32)
+            output += str(site[3]).rjust(11) + ("%.1f" % (site[4] / 1e6)).rjust(11)
+            output += str(site[5] // 1000).rjust(10) + str(site[6] // 1000).rjust(10)
+            output += avg_hold.rjust(13)
+        return output
+
+
 class FastStats():
     def __init__(self, stats):
         self.curtime = time.time()
@@ -699,6 +1015,60 @@ class DumpFSALStats():
                     output += " %12.6f" % (self.stats[4][i+4])
                     i += 5
                 return output
+            if self.stats[3] == "WBCACHE":
+                self.starttime = self.stats[2][0] + self.stats[2][1] / 1e9
+                self.duration = self.curtime - self.starttime
+                output += "FSAL stats for - WBCACHE \n"
+                output += "Stats collected since: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+                output += "Duration: " + "%.10f" % self.duration + " seconds\n"
+                if len(self.stats[4]) == 0:
+                    output += "No WBCACHE exports"
+                    return output
+                for export in self.stats[4]:
+                    reads = export[1] + export[2]
+                    output += "\nExport id: " + str(export[0])
+                    output += "\n\tRead hits: " + str(export[1])
+                    output += "\n\tRead misses: " + str(export[2])
+                    if reads:
+                        output += "\n\tHit ratio: " + "%.2f" % (100.0 * export[1] / reads) + "%"
+                    output += "\n\tReads bypassing cache: " + str(export[3])
+                    output += "\n\tWrites cached: " + str(export[4])
+                    output += "\n\tWrites through: " + str(export[5])
+                    output += "\n\tWrite backs: " + str(export[6])
+                    output += "\n\tBytes written back: " + str(export[7])
+                    output += "\n\tEvictions: " + str(export[8])
+                    output += "\n\tCached bytes: " + str(export[9])
+                    output += "\n\tDirty bytes: " + str(export[10])
+                return output
+            if self.stats[3] == "LATENCY":
+                self.starttime = self.stats[2][0] + self.stats[2][1] / 1e9
+                self.duration = self.curtime - self.starttime
+                output += "FSAL stats for - LATENCY \n"
+                output += "Stats collected since: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+                output += "Duration: " + "%.10f" % self.duration + " seconds\n"
+                if len(self.stats[4]) == 0:
+                    output += "No LATENCY methods called"
+                    return output
+                output += "Times in milliseconds, percentiles are bucket upper bounds\n"
+                output += "\n%6s %-14s %12s %10s %12s %12s %12s %12s" % ("Export", "Method", "Calls", "Errors", "Avg", "Max", "p50", "p99")
+                for op in self.stats[4]:
+                    output += "\n%6d %-14s %12d %10d %12.6f %12.6f %12s %12s" % (
+                        op[0], op[1], op[2], op[3],
+                        op[4] / 1e6 / max(op[2], 1), op[5] / 1e6,
+                        self.percentile(op[6], op[2], 50),
+                        self.percentile(op[6], op[2], 99))
+                return output
+
+    # The last histogram bucket has no upper bound
+    def percentile(self, hist, calls, pct):
+        seen = 0
+        for i in range(len(hist)):
+            seen += hist[i]
+            if seen * 100 >= calls * pct:
+                if i == len(hist) - 1:
+                    return ">%.3f" % ((1 << (i - 1)) / 1e3)
+                return "<%.3f" % ((1 << i) / 1e3)
+        return "-"
 
 class StatsEnable():
     def __init__(self, status):
@@ -22,7 +22,10 @@ def print_usage_exit(return_code):
     message += "  %s status \n" % (sys.argv[0])
     message += "\nTo display stat counters use: \n"
     message += "  %s [ list_clients | deleg <ip address> |\n" % (sys.argv[0])
-    message += "          inode | iov3 [export id] | iov4 [export id] |\n"
+    message += "          inode | fd_cache | readahead | mem_pools | req_arena |\n"
+    message += "          mem_budget | uid2grp | udp | tcp |\n"
+    message += "          compound_par | dir_deleg | slow_ops | locks |\n"
+    message += "          iov3 [export id] | iov4 [export id] |\n"
     message += "          export | total [export id] | fast | pnfs [export id] |\n"
     message += "          fsal <fsal name> | v3_full | v4_full | auth |\n"
     message += "          client_io_ops <ip address> | export_details <export id> |\n"
@@ -41,8 +44,8 @@ else:
     command = sys.argv[1]
 
 # check arguments
-commands = ('help', 'list_clients', 'deleg', 'global', 'inode', 'iov3',
-            'iov4', 'export', 'total', 'fast', 'pnfs', 'fsal', 'reset', 'enable',
+commands = ('help', 'list_clients', 'deleg', 'global', 'inode', 'fd_cache',
+            'readahead', 'mem_pools', 'req_arena', 'mem_budget', 'uid2grp', 'udp', 'tcp', 'compound_par', 'dir_deleg', 'slow_ops', 'locks', 'iov3', 'iov4', 'export', 'total', 'fast', 'pnfs', 'fsal', 'reset', 'enable',
             'disable', 'status', 'v3_full', 'v4_full', 'auth', 'client_io_ops',
             'export_details', 'client_all_ops')
 if command not in commands:
@@ -101,6 +104,30 @@ try:
         print(exp_interface.export_stats())
     elif command == "inode":
         print(exp_interface.inode_stats())
+    elif command == "fd_cache":
+        print(exp_interface.fd_cache_stats())
+    elif command == "readahead":
+        print(exp_interface.readahead_stats())
+    elif command == "mem_pools":
+        print(exp_interface.mem_pools_stats())
+    elif command == "req_arena":
+        print(exp_interface.req_arena_stats())
+    elif command == "mem_budget":
+        print(exp_interface.mem_budget_stats())
+    elif command == "uid2grp":
+        print(exp_interface.uid2grp_stats())
+    elif command == "udp":
+        print(exp_interface.udp_stats())
+    elif command == "tcp":
+        print(exp_interface.tcp_stats())
+    elif command == "compound_par":
+        print(exp_interface.compound_par_stats())
+    elif command == "dir_deleg":
+        print(exp_interface.dir_deleg_stats())
+    elif command == "slow_ops":
+        print(exp_interface.slow_ops_stats())
+    elif command == "locks":
+        print(exp_interface.lock_prof_stats())
     elif command == "fast":
         print(exp_interface.fast_stats())
     elif command == "list_clients":
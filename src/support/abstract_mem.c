@@ -0,0 +1,777 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file abstract_mem.c
+ * @brief Slab and magazine backed object pools
+ *
+ * See @ref PoolAllocator for an overview.
+ *
+ * Every pool with an id below POOL_MAX_MAGAZINES has one magazine per
+ * thread, allocated the first time the thread uses the pool.  A thread's
+ * magazines are reached through a thread local pointer and are also kept
+ * on a global list, so statistics can be gathered and so the magazines
+ * can be emptied back into their depots when the thread exits.  Pool ids
+ * are never reused, so a magazine left behind by a destroyed pool is
+ * simply freed at thread exit.
+ *
+ * Each pool has one depot per NUMA node.  A depot is a set of slabs,
+ * each with a stack of the indices of its free objects, kept on one of
+ * three lists by how many of its objects are free.  Slabs are naturally
+ * aligned to their size, so a freed object finds its slab, and through
+ * it its home depot, by masking its address.  A thread refills its
+ * magazines from the depot of the node it is running on, and whatever it
+ * frees goes back to the depot the object came from.  Slabs are mapped
+ * and touched by a thread of their node, so first touch places their
+ * pages on that node.
+ *
+ * Once a slab has every object back in its depot it is empty.  A depot
+ * keeps POOL_EMPTY_SLABS of those around to absorb churn and unmaps the
+ * rest, running the destructor on their objects first.  pool_reclaim
+ * releases the ones kept around as well.
+ *
+ * Lock order is pool_registry_lock, then a depot lock, then pool->lock.
+ * Only one depot lock is held at a time.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "gsh_list.h"
+#include "gsh_intrinsic.h"
+#include "log.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Objects held by a magazine */
+#define POOL_MAG_ROUNDS 64
+
+/** Minimum size of a slab */
+#define POOL_SLAB_SIZE (64 * 1024)
+
+/** Alignment of the first object of a slab */
+#define POOL_SLAB_ALIGN 64
+
+/** Alignment of objects within a slab */
+#define POOL_OBJ_ALIGN 16
+
+/** Empty slabs a depot keeps before unmapping them */
+#define POOL_EMPTY_SLABS 2
+
+/** Maximum number of NUMA nodes with their own depot */
+#define POOL_MAX_NODES 16
+
+/**
+ * @brief Header at the start of every slab
+ */
+struct pool_slab {
+	struct glist_head list;	/*< Link in a depot slab list */
+	uint32_t node;		/*< Depot the slab belongs to */
+	uint32_t nfree;		/*< Entries in free */
+	uint16_t free[];	/*< Indices of free objects */
+};
+
+/**
+ * @brief Free objects of a pool on one NUMA node
+ */
+struct pool_depot {
+	pthread_mutex_t lock;		/*< Protects everything below */
+	struct glist_head partial;	/*< Slabs with some objects free */
+	struct glist_head empty;	/*< Slabs with every object free */
+	struct glist_head full;		/*< Slabs with no object free */
+	uint32_t nempty;		/*< Slabs on empty */
+} __attribute__ ((aligned(GSH_CACHE_LINE_SIZE)));
+
+/**
+ * @brief A thread's magazine for one pool
+ *
+ * Only the owning thread writes to this, statistics are read racily.
+ */
+struct pool_magazine {
+	uint32_t rounds;	/*< Objects in objs */
+	uint64_t allocs;	/*< Allocations by this thread */
+	uint64_t frees;		/*< Frees by this thread */
+	uint64_t hits;		/*< Allocations served without the depot */
+	void *objs[POOL_MAG_ROUNDS];
+};
+
+/**
+ * @brief A thread's magazines
+ */
+struct pool_thread {
+	struct glist_head link;	/*< Link in pool_threads */
+	struct pool_magazine *mags[POOL_MAX_MAGAZINES];
+};
+
+static pthread_mutex_t pool_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_t *pool_registry[POOL_MAX_MAGAZINES];
+static uint32_t pool_next_id;
+static struct glist_head pool_threads = GLIST_HEAD_INIT(pool_threads);
+
+static pthread_key_t pool_key;
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+static __thread struct pool_thread *pool_thr;
+
+static pthread_once_t pool_nodes_once = PTHREAD_ONCE_INIT;
+static uint32_t pool_nnodes = 1;
+
+/**
+ * @brief Count the NUMA nodes from sysfs
+ *
+ * Without sysfs, or on a machine with a single node, every pool has one
+ * depot.
+ */
+static void pool_nodes_init(void)
+{
+	FILE *f = fopen("/sys/devices/system/node/possible", "r");
+	unsigned int first, last;
+	int n;
+
+	if (f == NULL)
+		return;
+
+	n = fscanf(f, "%u-%u", &first, &last);
+	fclose(f);
+
+	if (n == 2 && last >= first)
+		pool_nnodes = last + 1 < POOL_MAX_NODES
+				? last + 1 : POOL_MAX_NODES;
+}
+
+/**
+ * @brief Find the depot of the node the caller is running on
+ */
+static inline uint32_t pool_current_node(void)
+{
+	unsigned int cpu, node;
+
+	if (pool_nnodes == 1 ||
+	    syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+		return 0;
+
+	return node % pool_nnodes;
+}
+
+static inline struct pool_slab *pool_obj_slab(pool_t *pool, void *obj)
+{
+	return (struct pool_slab *)
+		((uintptr_t) obj & ~((uintptr_t) pool->slab_size - 1));
+}
+
+static inline void *pool_slab_obj(pool_t *pool, struct pool_slab *slab,
+				  uint32_t idx)
+{
+	return (char *) slab + pool->slab_hdr + idx * pool->slot_size;
+}
+
+static inline uint16_t pool_obj_idx(pool_t *pool, struct pool_slab *slab,
+				    void *obj)
+{
+	return ((char *) obj - (char *) slab - pool->slab_hdr) /
+		pool->slot_size;
+}
+
+/**
+ * @brief Map and carve a new slab
+ *
+ * Called with the depot lock held, on a thread of the depot's node, so
+ * the pages touched here are placed on that node.
+ *
+ * @return The slab, with every object free.
+ */
+static struct pool_slab *pool_slab_new(pool_t *pool, uint32_t node)
+{
+	size_t size = pool->slab_size;
+	struct pool_slab *slab;
+	char *map, *aligned;
+	uint32_t i;
+
+	/* Map twice the size and trim to get a naturally aligned slab */
+	map = mmap(NULL, size * 2, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		LogMallocFailure(__FILE__, __LINE__, __func__, "pool slab");
+		abort();
+	}
+
+	aligned = (char *) (((uintptr_t) map + size - 1) &
+			    ~((uintptr_t) size - 1));
+	if (aligned != map)
+		(void) munmap(map, aligned - map);
+	(void) munmap(aligned + size, map + size - aligned);
+
+	/* Fault in every page here rather than on first allocation */
+	memset(aligned, 0, size);
+
+	slab = (struct pool_slab *) aligned;
+	slab->node = node;
+	slab->nfree = pool->slab_objs;
+
+	/* Hand objects out in address order */
+	for (i = 0; i < pool->slab_objs; i++) {
+		slab->free[i] = pool->slab_objs - 1 - i;
+		if (pool->ctor != NULL)
+			pool->ctor(pool_slab_obj(pool, slab, i));
+	}
+
+	(void) atomic_add_uint64_t(&pool->slab_bytes, size);
+
+	return slab;
+}
+
+/**
+ * @brief Return a slab to the system
+ *
+ * Every object of the slab must be free.  Called without a depot lock.
+ */
+static void pool_slab_release(pool_t *pool, struct pool_slab *slab)
+{
+	uint32_t i;
+
+	if (pool->dtor != NULL) {
+		for (i = 0; i < pool->slab_objs; i++)
+			pool->dtor(pool_slab_obj(pool, slab, i));
+	}
+
+	(void) munmap(slab, pool->slab_size);
+	(void) atomic_sub_uint64_t(&pool->slab_bytes, pool->slab_size);
+}
+
+/**
+ * @brief Take objects from a depot
+ *
+ * Partly used slabs are drained first so empty ones can be released.
+ *
+ * @param[in]  pool Pool to allocate from
+ * @param[in]  node Depot to take from
+ * @param[out] objs Objects taken
+ * @param[in]  n    Number of objects wanted
+ */
+static void pool_depot_take(pool_t *pool, uint32_t node, void **objs,
+			    uint32_t n)
+{
+	struct pool_depot *depot = &pool->depots[node];
+	struct pool_slab *slab;
+	uint32_t got = 0;
+
+	PTHREAD_MUTEX_lock(&depot->lock);
+
+	while (got < n) {
+		slab = glist_first_entry(&depot->partial, struct pool_slab,
+					 list);
+		if (slab == NULL) {
+			slab = glist_first_entry(&depot->empty,
+						 struct pool_slab, list);
+			if (slab != NULL)
+				depot->nempty--;
+			else
+				slab = pool_slab_new(pool, node);
+		}
+
+		glist_del(&slab->list);
+
+		while (slab->nfree != 0 && got < n)
+			objs[got++] = pool_slab_obj(pool, slab,
+						    slab->free[--slab->nfree]);
+
+		if (slab->nfree == 0)
+			glist_add(&depot->full, &slab->list);
+		else
+			glist_add(&depot->partial, &slab->list);
+	}
+
+	PTHREAD_MUTEX_unlock(&depot->lock);
+}
+
+/**
+ * @brief Return objects to the depots they came from
+ *
+ * Slabs that become empty beyond what a depot keeps are unmapped.
+ *
+ * @param[in] pool Pool the objects belong to
+ * @param[in] objs Objects to return
+ * @param[in] n    Number of objects
+ */
+static void pool_depot_put(pool_t *pool, void **objs, uint32_t n)
+{
+	struct pool_depot *depot = NULL;
+	struct pool_slab *slab;
+	struct glist_head release;
+	uint32_t i;
+
+	glist_init(&release);
+
+	for (i = 0; i < n; i++) {
+		slab = pool_obj_slab(pool, objs[i]);
+
+		if (depot != &pool->depots[slab->node]) {
+			if (depot != NULL)
+				PTHREAD_MUTEX_unlock(&depot->lock);
+			depot = &pool->depots[slab->node];
+			PTHREAD_MUTEX_lock(&depot->lock);
+		}
+
+		slab->free[slab->nfree++] = pool_obj_idx(pool, slab, objs[i]);
+
+		if (slab->nfree == pool->slab_objs) {
+			glist_del(&slab->list);
+			if (depot->nempty < POOL_EMPTY_SLABS ||
+			    pool->type_stable) {
+				glist_add(&depot->empty, &slab->list);
+				depot->nempty++;
+			} else {
+				glist_add_tail(&release, &slab->list);
+			}
+		} else if (slab->nfree == 1) {
+			glist_del(&slab->list);
+			glist_add_tail(&depot->partial, &slab->list);
+		}
+	}
+
+	if (depot != NULL)
+		PTHREAD_MUTEX_unlock(&depot->lock);
+
+	while ((slab = glist_first_entry(&release, struct pool_slab,
+					 list)) != NULL) {
+		glist_del(&slab->list);
+		pool_slab_release(pool, slab);
+	}
+}
+
+static void pool_thread_exit(void *arg)
+{
+	struct pool_thread *thr = arg;
+	struct pool_magazine *mag;
+	pool_t *pool;
+	uint32_t id;
+
+	PTHREAD_MUTEX_lock(&pool_registry_lock);
+
+	glist_del(&thr->link);
+
+	for (id = 0; id < POOL_MAX_MAGAZINES; id++) {
+		mag = thr->mags[id];
+		if (mag == NULL)
+			continue;
+
+		pool = pool_registry[id];
+		if (pool != NULL) {
+			pool_depot_put(pool, mag->objs, mag->rounds);
+			PTHREAD_MUTEX_lock(&pool->lock);
+			pool->allocs += mag->allocs;
+			pool->frees += mag->frees;
+			pool->hits += mag->hits;
+			PTHREAD_MUTEX_unlock(&pool->lock);
+		}
+
+		gsh_free(mag);
+	}
+
+	PTHREAD_MUTEX_unlock(&pool_registry_lock);
+
+	gsh_free(thr);
+	pool_thr = NULL;
+}
+
+static void pool_key_init(void)
+{
+	int rc = pthread_key_create(&pool_key, pool_thread_exit);
+
+	if (rc != 0) {
+		LogFatal(COMPONENT_MEM_ALLOC,
+			 "Could not create pool thread key: %d", rc);
+	}
+}
+
+static struct pool_thread *pool_thread_init(void)
+{
+	struct pool_thread *thr = gsh_calloc(1, sizeof(*thr));
+
+	(void) pthread_once(&pool_key_once, pool_key_init);
+	(void) pthread_setspecific(pool_key, thr);
+
+	PTHREAD_MUTEX_lock(&pool_registry_lock);
+	glist_add_tail(&pool_threads, &thr->link);
+	PTHREAD_MUTEX_unlock(&pool_registry_lock);
+
+	pool_thr = thr;
+	return thr;
+}
+
+/**
+ * @brief Find this thread's magazine for a pool
+ *
+ * @return The magazine, or NULL if the pool has none.
+ */
+static inline struct pool_magazine *pool_get_magazine(pool_t *pool)
+{
+	struct pool_thread *thr = pool_thr;
+	struct pool_magazine *mag;
+
+	if (unlikely(pool->id >= POOL_MAX_MAGAZINES))
+		return NULL;
+
+	if (unlikely(thr == NULL))
+		thr = pool_thread_init();
+
+	mag = thr->mags[pool->id];
+	if (unlikely(mag == NULL)) {
+		mag = gsh_calloc(1, sizeof(*mag));
+		thr->mags[pool->id] = mag;
+	}
+
+	return mag;
+}
+
+/**
+ * @brief Work out the slab geometry of a pool
+ *
+ * Slabs are at least POOL_SLAB_SIZE and big enough for a magazine's
+ * worth of objects.  The header holds a 16 bit free index per object.
+ */
+static void pool_slab_geometry(pool_t *pool)
+{
+	size_t size = POOL_SLAB_SIZE;
+	size_t nobjs, hdr;
+
+	for (;;) {
+		nobjs = (size - sizeof(struct pool_slab)) /
+			(pool->slot_size + sizeof(uint16_t));
+		if (nobjs > UINT16_MAX)
+			nobjs = UINT16_MAX;
+
+		do {
+			hdr = (sizeof(struct pool_slab) +
+			       nobjs * sizeof(uint16_t) +
+			       POOL_SLAB_ALIGN - 1) &
+			      ~((size_t) POOL_SLAB_ALIGN - 1);
+		} while (hdr + nobjs * pool->slot_size > size && --nobjs);
+
+		if (nobjs >= POOL_MAG_ROUNDS)
+			break;
+		size *= 2;
+	}
+
+	pool->slab_size = size;
+	pool->slab_objs = nobjs;
+	pool->slab_hdr = hdr;
+}
+
+/**
+ * @brief Create an object pool
+ *
+ * @param[in] name        The name of this pool, used in statistics
+ * @param[in] object_size The size of objects to allocate
+ * @param[in] ctor        If not NULL, run once on each object when it is
+ *                        carved from a slab.  Objects from such a pool are
+ *                        not zeroed on allocation.
+ * @param[in] dtor        If not NULL, run on each object when its slab is
+ *                        returned to the system
+ *
+ * @return The new pool.
+ */
+pool_t *pool_ctor_init(const char *name, size_t object_size,
+		       pool_constructor_t ctor, pool_constructor_t dtor)
+{
+	pool_t *pool = gsh_calloc(1, sizeof(pool_t));
+	uint32_t i;
+
+	(void) pthread_once(&pool_nodes_once, pool_nodes_init);
+
+	pool->object_size = object_size;
+	pool->slot_size = (object_size + POOL_OBJ_ALIGN - 1) &
+						~((size_t) POOL_OBJ_ALIGN - 1);
+	if (pool->slot_size == 0)
+		pool->slot_size = POOL_OBJ_ALIGN;
+	pool_slab_geometry(pool);
+	pool->ctor = ctor;
+	pool->dtor = dtor;
+	PTHREAD_MUTEX_init(&pool->lock, NULL);
+
+	pool->nnodes = pool_nnodes;
+	pool->depots = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+					  pool->nnodes *
+						sizeof(struct pool_depot));
+	for (i = 0; i < pool->nnodes; i++) {
+		struct pool_depot *depot = &pool->depots[i];
+
+		PTHREAD_MUTEX_init(&depot->lock, NULL);
+		glist_init(&depot->partial);
+		glist_init(&depot->empty);
+		glist_init(&depot->full);
+		depot->nempty = 0;
+	}
+
+	if (name)
+		pool->name = gsh_strdup(name);
+	else
+		pool->name = NULL;
+
+	PTHREAD_MUTEX_lock(&pool_registry_lock);
+
+	if (pool_next_id < POOL_MAX_MAGAZINES) {
+		pool->id = pool_next_id++;
+		pool_registry[pool->id] = pool;
+	} else {
+		pool->id = POOL_MAX_MAGAZINES;
+		LogDebug(COMPONENT_MEM_ALLOC,
+			 "Pool %s created without per-thread magazines",
+			 name ? name : "(unnamed)");
+	}
+
+	PTHREAD_MUTEX_unlock(&pool_registry_lock);
+
+	return pool;
+}
+
+/**
+ * @brief Keep a pool's memory mapped until the pool is destroyed
+ *
+ * For users that may still read an object after freeing it, such as
+ * lockless lookups that validate what they found afterwards.  Empty
+ * slabs of such a pool are kept for reuse instead of being unmapped, and
+ * pool_reclaim does nothing.
+ */
+void pool_set_type_stable(pool_t *pool)
+{
+	pool->type_stable = true;
+}
+
+/**
+ * @brief Return every empty slab of a pool to the system
+ *
+ * Objects cached in thread magazines keep their slabs in use, so this
+ * releases what the depots hold and nothing more.
+ *
+ * @param[in] pool The pool to trim
+ *
+ * @return Number of bytes unmapped.
+ */
+size_t pool_reclaim(pool_t *pool)
+{
+	struct pool_depot *depot;
+	struct pool_slab *slab;
+	struct glist_head release;
+	size_t freed = 0;
+	uint32_t i;
+
+	if (pool->type_stable)
+		return 0;
+
+	glist_init(&release);
+
+	for (i = 0; i < pool->nnodes; i++) {
+		depot = &pool->depots[i];
+		PTHREAD_MUTEX_lock(&depot->lock);
+		glist_splice_tail(&release, &depot->empty);
+		depot->nempty = 0;
+		PTHREAD_MUTEX_unlock(&depot->lock);
+	}
+
+	while ((slab = glist_first_entry(&release, struct pool_slab,
+					 list)) != NULL) {
+		glist_del(&slab->list);
+		pool_slab_release(pool, slab);
+		freed += pool->slab_size;
+	}
+
+	return freed;
+}
+
+static void pool_release_list(pool_t *pool, struct glist_head *list)
+{
+	struct pool_slab *slab;
+
+	while ((slab = glist_first_entry(list, struct pool_slab,
+					 list)) != NULL) {
+		glist_del(&slab->list);
+		pool_slab_release(pool, slab);
+	}
+}
+
+void pool_destroy(pool_t *pool)
+{
+	struct pool_depot *depot;
+	uint32_t i;
+
+	if (pool->id < POOL_MAX_MAGAZINES) {
+		PTHREAD_MUTEX_lock(&pool_registry_lock);
+		pool_registry[pool->id] = NULL;
+		PTHREAD_MUTEX_unlock(&pool_registry_lock);
+	}
+
+	/* Objects still sitting in magazines keep their slabs off the
+	 * empty list, so release every slab.
+	 */
+	for (i = 0; i < pool->nnodes; i++) {
+		depot = &pool->depots[i];
+		pool_release_list(pool, &depot->empty);
+		pool_release_list(pool, &depot->partial);
+		pool_release_list(pool, &depot->full);
+		PTHREAD_MUTEX_destroy(&depot->lock);
+	}
+
+	PTHREAD_MUTEX_destroy(&pool->lock);
+	gsh_free(pool->depots);
+	gsh_free(pool->name);
+	gsh_free(pool);
+}
+
+void *pool_alloc__(pool_t *pool)
+{
+	struct pool_magazine *mag = pool_get_magazine(pool);
+	void *object;
+
+	if (likely(mag != NULL)) {
+		if (likely(mag->rounds != 0)) {
+			mag->hits++;
+		} else {
+			/* Refill half a magazine from the local depot */
+			pool_depot_take(pool, pool_current_node(), mag->objs,
+					POOL_MAG_ROUNDS / 2);
+			mag->rounds = POOL_MAG_ROUNDS / 2;
+		}
+
+		object = mag->objs[--mag->rounds];
+		mag->allocs++;
+	} else {
+		pool_depot_take(pool, pool_current_node(), &object, 1);
+
+		PTHREAD_MUTEX_lock(&pool->lock);
+		pool->allocs++;
+		PTHREAD_MUTEX_unlock(&pool->lock);
+	}
+
+	if (pool->ctor == NULL)
+		memset(object, 0, pool->object_size);
+
+	return object;
+}
+
+void pool_free(pool_t *pool, void *object)
+{
+	struct pool_magazine *mag;
+
+	if (object == NULL)
+		return;
+
+	mag = pool_get_magazine(pool);
+
+	if (likely(mag != NULL)) {
+		if (unlikely(mag->rounds == POOL_MAG_ROUNDS)) {
+			/* Spill half a magazine to the depots */
+			pool_depot_put(pool, &mag->objs[POOL_MAG_ROUNDS / 2],
+				       POOL_MAG_ROUNDS / 2);
+			mag->rounds = POOL_MAG_ROUNDS / 2;
+		}
+
+		mag->objs[mag->rounds++] = object;
+		mag->frees++;
+	} else {
+		pool_depot_put(pool, &object, 1);
+
+		PTHREAD_MUTEX_lock(&pool->lock);
+		pool->frees++;
+		PTHREAD_MUTEX_unlock(&pool->lock);
+	}
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report statistics for every pool
+ *
+ * Appends an array of (name, object size, live objects, slab bytes,
+ * allocations, magazine hits).
+ */
+void pool_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct glist_head *glist;
+	struct pool_thread *thr;
+	struct pool_magazine *mag;
+	pool_t *pool;
+	uint64_t size, live, slab_bytes, allocs, frees, hits;
+	char *name;
+	uint32_t id;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(stttttt)",
+					 &array_iter);
+
+	PTHREAD_MUTEX_lock(&pool_registry_lock);
+
+	for (id = 0; id < POOL_MAX_MAGAZINES; id++) {
+		pool = pool_registry[id];
+		if (pool == NULL)
+			continue;
+
+		PTHREAD_MUTEX_lock(&pool->lock);
+		allocs = pool->allocs;
+		frees = pool->frees;
+		hits = pool->hits;
+		PTHREAD_MUTEX_unlock(&pool->lock);
+		slab_bytes = atomic_fetch_uint64_t(&pool->slab_bytes);
+
+		glist_for_each(glist, &pool_threads) {
+			thr = glist_entry(glist, struct pool_thread, link);
+			mag = thr->mags[id];
+			if (mag == NULL)
+				continue;
+			allocs += mag->allocs;
+			frees += mag->frees;
+			hits += mag->hits;
+		}
+
+		name = pool->name ? pool->name : "(unnamed)";
+		size = pool->object_size;
+		live = allocs - frees;
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &size);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &live);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &slab_bytes);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &allocs);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &frees);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &hits);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	PTHREAD_MUTEX_unlock(&pool_registry_lock);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif
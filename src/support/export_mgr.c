@@ -65,6 +65,10 @@
 #include "nfs_proto_functions.h"
 #include "pnfs_utils.h"
 #include "idmapper.h"
+#include "FSAL/fsal_fdcache.h"
+#include "FSAL/fsal_readahead.h"
+#include "flight_recorder.h"
+#include "mem_budget.h"
 
 struct timespec nfs_stats_time;
 struct timespec fsal_stats_time;
@@ -789,6 +793,88 @@ bool foreach_gsh_export(bool(*cb) (struct gsh_export *exp, void *state),
 	return rc;
 }
 
+/**
+ * @brief Work shared by the threads of export_run_parallel
+ */
+struct export_parallel_work {
+	struct gsh_export **exports;
+	bool *ok;
+	uint32_t count;
+	uint32_t next;		/*< Next export to hand out */
+	bool (*cb)(struct gsh_export *exp, void *state);
+	void *state;
+};
+
+static void export_parallel_loop(struct export_parallel_work *work)
+{
+	uint32_t i;
+
+	while ((i = atomic_postinc_uint32_t(&work->next)) < work->count)
+		work->ok[i] = work->cb(work->exports[i], work->state);
+}
+
+static void *export_parallel_thread(void *arg)
+{
+	SetNameFunction("exp_init");
+	export_parallel_loop(arg);
+	return NULL;
+}
+
+/**
+ * @brief Call a function on each of a set of exports in parallel
+ *
+ * The exports are handed out one at a time to at most
+ * Export_Init_Threads threads, the caller being one of them, so a slow
+ * export does not hold up the others.  Returns once all are done.
+ *
+ * @param[in]  exports Exports to work on, referenced by the caller
+ * @param[out] ok      Result of @a cb for each export
+ * @param[in]  count   Number of exports
+ * @param[in]  cb      Function to call, must be safe to run concurrently
+ * @param[in]  state   Passed to @a cb
+ */
+void export_run_parallel(struct gsh_export **exports, bool *ok,
+			 uint32_t count,
+			 bool (*cb)(struct gsh_export *exp, void *state),
+			 void *state)
+{
+	struct export_parallel_work work = {
+		.exports = exports,
+		.ok = ok,
+		.count = count,
+		.next = 0,
+		.cb = cb,
+		.state = state,
+	};
+	uint32_t nthreads = MIN(count,
+				nfs_param.core_param.export_init_threads);
+	pthread_t *threads = NULL;
+	uint32_t started = 0;
+	int rc;
+
+	if (nthreads > 1)
+		threads = gsh_calloc(nthreads - 1, sizeof(pthread_t));
+
+	for (started = 0; started + 1 < nthreads; started++) {
+		rc = pthread_create(&threads[started], NULL,
+				    export_parallel_thread, &work);
+		if (rc != 0) {
+			LogWarn(COMPONENT_EXPORT,
+				"Could not start export thread, error %d, continuing with %"
+				PRIu32, rc, started + 1);
+			break;
+		}
+	}
+
+	/* Do our share of the work, then wait for the others */
+	export_parallel_loop(&work);
+
+	while (started > 0)
+		pthread_join(threads[--started], NULL);
+
+	gsh_free(threads);
+}
+
 bool remove_one_export(struct gsh_export *export, void *state)
 {
 	export_add_to_unexport_work_locked(export);
@@ -2014,6 +2100,256 @@ static bool show_cache_inode_stats(DBusMessageIter *args,
 	return true;
 }
 
+static bool show_fd_cache_stats(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	if (!fsal_fdcache_enabled())
+		errormsg = "FD cache disabled";
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	fsal_fdcache_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_readahead(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	fsal_readahead_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_mem_pools(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	pool_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_slow_ops(DBusMessageIter *args,
+			  DBusMessage *reply,
+			  DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	fr_dbus_show_slow(&iter);
+
+	return true;
+}
+
+static bool show_lock_prof(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+#ifdef ENABLE_LOCKPROF
+	bool success = true;
+	char *errormsg = "OK";
+#else
+	bool success = false;
+	char *errormsg = "Lock profiling not built in (ENABLE_LOCKPROF)";
+#endif
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+#ifdef ENABLE_LOCKPROF
+	lockprof_dbus_show(&iter);
+#endif
+
+	return true;
+}
+
+static bool show_req_arena(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	if (!nfs_param.core_param.enable_NFSSTATS)
+		errormsg = "NFS stat counting disabled";
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	req_arena_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_mem_budget(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	if (nfs_param.core_param.rss_target == 0)
+		errormsg = "RSS target not set";
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	mem_budget_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_uid2grp(DBusMessageIter *args,
+			 DBusMessage *reply,
+			 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	uid2grp_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_udp(DBusMessageIter *args,
+		     DBusMessage *reply,
+		     DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	nfs_rpc_udp_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_tcp(DBusMessageIter *args,
+		     DBusMessage *reply,
+		     DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	nfs_rpc_tcp_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_compound_par(DBusMessageIter *args,
+			      DBusMessage *reply,
+			      DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	if (!nfs_param.core_param.enable_NFSSTATS)
+		errormsg = "NFS stat counting disabled";
+	else if (!nfs_param.nfsv4_param.parallel_compound)
+		errormsg = "Parallel compound disabled";
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	nfs4_compound_par_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_dir_deleg(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	if (!nfs_param.core_param.enable_NFSSTATS)
+		errormsg = "NFS stat counting disabled";
+	else if (!nfs_param.nfsv4_param.dir_delegations)
+		errormsg = "Directory delegations disabled";
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	dir_deleg_dbus_show(&iter);
+
+	return true;
+}
+
 static struct gsh_dbus_method export_show_v41_layouts = {
 	.name = "GetNFSv41Layouts",
 	.method = get_nfsv41_export_layouts,
@@ -2653,6 +2989,114 @@ static struct gsh_dbus_method cache_inode_show = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method fd_cache_show = {
+	.name = "ShowFDCache",
+	.method = show_fd_cache_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 FD_CACHE_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method readahead_show = {
+	.name = "ShowReadahead",
+	.method = show_readahead,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 READAHEAD_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method mem_pools_show = {
+	.name = "ShowMemPools",
+	.method = show_mem_pools,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 MEM_POOLS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method req_arena_show = {
+	.name = "ShowReqArena",
+	.method = show_req_arena,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 REQ_ARENA_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method mem_budget_show = {
+	.name = "ShowMemBudget",
+	.method = show_mem_budget,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 MEM_BUDGET_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method uid2grp_show = {
+	.name = "ShowUid2grp",
+	.method = show_uid2grp,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 UID2GRP_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method udp_show = {
+	.name = "ShowUDP",
+	.method = show_udp,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 UDP_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method tcp_show = {
+	.name = "ShowTCP",
+	.method = show_tcp,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TCP_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method compound_par_show = {
+	.name = "ShowCompoundPar",
+	.method = show_compound_par,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 COMPOUND_PAR_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method dir_deleg_show = {
+	.name = "ShowDirDeleg",
+	.method = show_dir_deleg,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 DIR_DELEG_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method slow_ops_show = {
+	.name = "ShowSlowOps",
+	.method = show_slow_ops,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 SLOW_OPS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method lock_prof_show = {
+	.name = "ShowLockProf",
+	.method = show_lock_prof,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LOCK_PROF_REPLY,
+		 END_ARG_LIST}
+};
+
 /**
  * @brief Report all IO stats of all exports in one call
  *
@@ -2720,6 +3164,18 @@ static struct gsh_dbus_method *export_stats_methods[] = {
 	&global_show_total_ops,
 	&global_show_fast_ops,
 	&cache_inode_show,
+	&fd_cache_show,
+	&readahead_show,
+	&mem_pools_show,
+	&req_arena_show,
+	&mem_budget_show,
+	&uid2grp_show,
+	&udp_show,
+	&tcp_show,
+	&compound_par_show,
+	&dir_deleg_show,
+	&slow_ops_show,
+	&lock_prof_show,
 	&export_show_all_io,
 	&reset_statistics,
 	&fsal_statistics,
@@ -2120,41 +2120,92 @@ void free_export_resources(struct gsh_export *export)
 }
 
 /**
- * @brief pkginit callback to initialize exports from nfs_init
+ * @brief Exports gathered for initialization
+ */
+struct export_init_list {
+	struct gsh_export **exports;
+	uint32_t count;
+	uint32_t size;
+};
+
+/**
+ * @brief foreach_gsh_export callback collecting exports without a root
  *
- * Assumes being called with the export_by_id.lock held.
- * true on success
+ * Exports that already have a root object (added since startup) are
+ * skipped.  Each export collected is referenced.
  */
 
-static bool init_export_cb(struct gsh_export *exp, void *state)
+static bool collect_export_cb(struct gsh_export *exp, void *state)
 {
-	struct glist_head *errlist = state;
+	struct export_init_list *list = state;
+	bool has_root;
+
+	PTHREAD_RWLOCK_rdlock(&exp->lock);
+	has_root = exp->exp_root_obj != NULL;
+	PTHREAD_RWLOCK_unlock(&exp->lock);
 
-	if (init_export_root(exp)) {
-		glist_del(&exp->exp_list);
-		glist_add(errlist, &exp->exp_list);
+	if (has_root)
+		return true;
+
+	if (list->count == list->size) {
+		list->size = list->size == 0 ? 64 : list->size * 2;
+		list->exports = gsh_realloc(list->exports, list->size *
+					    sizeof(*list->exports));
 	}
 
+	get_gsh_export_ref(exp);
+	list->exports[list->count++] = exp;
+
 	return true;
 }
 
+/**
+ * @brief export_run_parallel callback initializing an export root
+ */
+
+static bool init_export_cb(struct gsh_export *exp, void *state)
+{
+	return init_export_root(exp) == 0;
+}
+
 /**
  * @brief Initialize exports over a live cache inode and fsal layer
+ *
+ * Export roots are looked up in parallel, since with many exports on a
+ * remote backend the lookups dominate startup.  Exports whose root could
+ * not be found are removed.
  */
 
 void exports_pkginit(void)
 {
-	struct glist_head errlist;
-	struct glist_head *glist, *glistn;
-	struct gsh_export *export;
+	struct export_init_list list = { NULL, 0, 0 };
+	struct timespec s_time, e_time;
+	bool *ok;
+	uint32_t i;
 
-	glist_init(&errlist);
-	foreach_gsh_export(init_export_cb, true, &errlist);
+	foreach_gsh_export(collect_export_cb, false, &list);
 
-	glist_for_each_safe(glist, glistn, &errlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-		export_revert(export);
+	if (list.count == 0)
+		return;
+
+	ok = gsh_calloc(list.count, sizeof(*ok));
+
+	now(&s_time);
+	export_run_parallel(list.exports, ok, list.count, init_export_cb, NULL);
+	now(&e_time);
+
+	LogInfo(COMPONENT_EXPORT,
+		"Initialized %" PRIu32 " export roots in %" PRIu64 " ms",
+		list.count, timespec_diff(&s_time, &e_time) / NS_PER_MSEC);
+
+	for (i = 0; i < list.count; i++) {
+		if (!ok[i])
+			export_revert(list.exports[i]);
+		put_gsh_export(list.exports[i]);
 	}
+
+	gsh_free(ok);
+	gsh_free(list.exports);
 }
 
 /**
@@ -2241,7 +2292,7 @@ static void set_fs_max_rdwr_size(struct gsh_export *export, uint64_t maxread,
 /**
  * @brief Initialize the root cache inode for an export.
  *
- * Assumes being called with the export_by_id.lock held.
+ * May be called for several exports at once.
  *
  * @param exp [IN] the export
  *
@@ -0,0 +1,535 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file flight_recorder.c
+ * @brief Per-request timelines for slow request diagnosis
+ *
+ * A worker handles one request at a time, so the record being filled in
+ * is reached through a thread local pointer and needs no locking.  The
+ * thread keeps its last few records in a ring, which is handy when
+ * looking at a core.  Only requests that cross the threshold are
+ * formatted, logged and copied into the global slow request list, so the
+ * cost of an ordinary request is a clock read per event.
+ *
+ * Operation names are expected to be static strings, only the pointer is
+ * recorded.
+ *
+ * A record normally belongs to a slot of its thread's ring.  When the
+ * request is suspended the record leaves the ring with it, the slot is
+ * refilled by the next request, and the record is freed by whichever
+ * thread finishes the request.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <pthread.h>
+#include "flight_recorder.h"
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "gsh_config.h"
+#include "gsh_intrinsic.h"
+#include "log.h"
+
+/** Records kept per thread */
+#define FR_RING_SIZE 8
+
+/** Events kept per record, the last slot is reserved for FR_DONE */
+#define FR_MAX_EVENTS 64
+
+/** Slow requests kept for D-Bus */
+#define FR_SLOW_KEEP 64
+
+/** Room for a client address */
+#define FR_CLIENT_LEN 48
+
+/** Room for a formatted timeline */
+#define FR_TIMELINE_LEN 1024
+
+struct fr_event {
+	uint64_t ts;		/*< Nanoseconds since the epoch */
+	const char *name;	/*< Operation or FSAL call name */
+	enum fr_event_type type;
+};
+
+struct fr_record {
+	uint64_t start;		/*< Time of FR_RECV */
+	uint32_t xid;		/*< RPC xid */
+	uint16_t nevents;	/*< Events recorded */
+	uint16_t dropped;	/*< Events that did not fit */
+	bool detached;		/*< Not in a ring, freed at the end */
+	struct fr_thread *home;	/*< Ring the record was detached from */
+	const char *name;	/*< Procedure name */
+	char client[FR_CLIENT_LEN];
+	struct fr_event events[FR_MAX_EVENTS];
+};
+
+struct fr_thread {
+	uint32_t next;		/*< Next slot of ring to use */
+	uint32_t cur;		/*< Slot of the current request */
+	struct fr_record *ring[FR_RING_SIZE];
+};
+
+struct fr_slow {
+	time_t when;		/*< Completion time */
+	uint64_t duration;	/*< Nanoseconds */
+	uint32_t xid;
+	const char *name;
+	char client[FR_CLIENT_LEN];
+	char timeline[FR_TIMELINE_LEN];
+};
+
+static const char * const fr_event_names[] = {
+	[FR_RECV] = "recv",
+	[FR_DECODE] = "decode",
+	[FR_DRC] = "drc",
+	[FR_CREDS] = "creds",
+	[FR_OP] = "op",
+	[FR_OP_DONE] = "op done",
+	[FR_FSAL] = "fsal",
+	[FR_FSAL_DONE] = "fsal done",
+	[FR_SUSPEND] = "suspend",
+	[FR_QUEUE] = "queue",
+	[FR_RESUME] = "resume",
+	[FR_SEND] = "encode",
+	[FR_ENCODED] = "send",
+	[FR_SENT] = "sent",
+	[FR_DONE] = "done",
+};
+
+static __thread struct fr_thread *fr_thr;
+static __thread struct fr_record *fr_cur;
+static __thread xdrproc_t fr_encode_real;
+
+static pthread_once_t fr_once = PTHREAD_ONCE_INIT;
+static pthread_key_t fr_key;
+
+static pthread_mutex_t fr_slow_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fr_slow fr_slow_ring[FR_SLOW_KEEP];
+static uint32_t fr_slow_next;
+static uint32_t fr_slow_count;
+
+static void fr_thread_exit(void *arg)
+{
+	struct fr_thread *thr = arg;
+	int i;
+
+	for (i = 0; i < FR_RING_SIZE; i++)
+		gsh_free(thr->ring[i]);
+	gsh_free(thr);
+}
+
+static void fr_init_key(void)
+{
+	int rc = pthread_key_create(&fr_key, fr_thread_exit);
+
+	if (rc != 0)
+		LogFatal(COMPONENT_DISPATCH,
+			 "Could not create flight recorder key, error %d", rc);
+}
+
+static inline uint64_t fr_now(void)
+{
+	struct timespec ts;
+
+	now(&ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static inline void fr_add(struct fr_record *rec, enum fr_event_type type,
+			  const char *name, uint64_t ts)
+{
+	struct fr_event *ev;
+
+	if (rec->nevents >= FR_MAX_EVENTS - 1 && type != FR_DONE) {
+		rec->dropped++;
+		return;
+	}
+
+	ev = &rec->events[rec->nevents++];
+	ev->ts = ts;
+	ev->name = name;
+	ev->type = type;
+}
+
+/**
+ * @brief Start recording a request on this thread
+ *
+ * Does nothing if Slow_Request_Threshold is 0.
+ */
+void fr_request_start(void)
+{
+	struct fr_record *rec;
+	uint64_t ts;
+
+	if (nfs_param.core_param.slow_request_threshold == 0) {
+		fr_cur = NULL;
+		return;
+	}
+
+	if (unlikely(fr_thr == NULL)) {
+		(void)pthread_once(&fr_once, fr_init_key);
+		fr_thr = gsh_calloc(1, sizeof(*fr_thr));
+		(void)pthread_setspecific(fr_key, fr_thr);
+	}
+
+	ts = fr_now();
+	fr_thr->cur = fr_thr->next++ % FR_RING_SIZE;
+	rec = fr_thr->ring[fr_thr->cur];
+	if (rec == NULL) {
+		/* First use, or the last record was taken by a suspended
+		 * request.
+		 */
+		rec = gsh_malloc(sizeof(*rec));
+		fr_thr->ring[fr_thr->cur] = rec;
+	}
+	rec->start = ts;
+	rec->detached = false;
+	rec->home = NULL;
+	rec->xid = 0;
+	rec->nevents = 0;
+	rec->dropped = 0;
+	rec->name = NULL;
+	rec->client[0] = '\0';
+	fr_add(rec, FR_RECV, NULL, ts);
+
+	fr_cur = rec;
+}
+
+/**
+ * @brief Identify the request being recorded
+ *
+ * @param[in] xid     RPC xid
+ * @param[in] name    Static procedure name
+ * @param[in] client  Client address, copied
+ */
+void fr_request_info(uint32_t xid, const char *name, const char *client)
+{
+	struct fr_record *rec = fr_cur;
+
+	if (rec == NULL)
+		return;
+
+	rec->xid = xid;
+	rec->name = name;
+	if (client != NULL)
+		(void)strlcpy(rec->client, client, sizeof(rec->client));
+}
+
+/**
+ * @brief Record an event for the current request
+ *
+ * @param[in] type  What happened
+ * @param[in] name  Static operation name for FR_OP and FR_OP_DONE
+ */
+void fr_mark(enum fr_event_type type, const char *name)
+{
+	struct fr_record *rec = fr_cur;
+
+	if (rec == NULL)
+		return;
+
+	fr_add(rec, type, name, fr_now());
+}
+
+/**
+ * @brief Format a record's timeline
+ *
+ * Each event is shown as its offset from FR_RECV in microseconds.
+ */
+static void fr_format(const struct fr_record *rec, char *buf, size_t len)
+{
+	const struct fr_event *ev;
+	size_t off = 0;
+	int n;
+	uint16_t i;
+
+	buf[0] = '\0';
+
+	for (i = 0; i < rec->nevents && off < len; i++) {
+		ev = &rec->events[i];
+
+		if ((ev->type == FR_OP || ev->type == FR_FSAL) && ev->name)
+			n = snprintf(buf + off, len - off, "%s+%" PRIu64 " %s",
+				     off ? ", " : "",
+				     (ev->ts - rec->start) / NS_PER_USEC,
+				     ev->name);
+		else if ((ev->type == FR_OP_DONE ||
+			  ev->type == FR_FSAL_DONE) && ev->name)
+			n = snprintf(buf + off, len - off,
+				     "%s+%" PRIu64 " %s done",
+				     off ? ", " : "",
+				     (ev->ts - rec->start) / NS_PER_USEC,
+				     ev->name);
+		else
+			n = snprintf(buf + off, len - off, "%s+%" PRIu64 " %s",
+				     off ? ", " : "",
+				     (ev->ts - rec->start) / NS_PER_USEC,
+				     fr_event_names[ev->type]);
+
+		if (n < 0)
+			break;
+		off += n;
+	}
+
+	if (rec->dropped != 0 && off < len)
+		(void)snprintf(buf + off, len - off, " (%" PRIu16 " dropped)",
+			       rec->dropped);
+}
+
+static void fr_report_slow(const struct fr_record *rec, uint64_t duration)
+{
+	struct fr_slow *slow;
+	char timeline[FR_TIMELINE_LEN];
+	const char *name = rec->name ? rec->name : "unknown";
+
+	fr_format(rec, timeline, sizeof(timeline));
+
+	LogWarn(COMPONENT_DISPATCH,
+		"Slow request xid=%" PRIu32 " %s from %s took %" PRIu64
+		" us: %s",
+		rec->xid, name, rec->client[0] ? rec->client : "unknown",
+		duration / NS_PER_USEC, timeline);
+
+	PTHREAD_MUTEX_lock(&fr_slow_lock);
+
+	slow = &fr_slow_ring[fr_slow_next];
+	fr_slow_next = (fr_slow_next + 1) % FR_SLOW_KEEP;
+	if (fr_slow_count < FR_SLOW_KEEP)
+		fr_slow_count++;
+
+	slow->when = time(NULL);
+	slow->duration = duration;
+	slow->xid = rec->xid;
+	slow->name = name;
+	memcpy(slow->client, rec->client, sizeof(slow->client));
+	memcpy(slow->timeline, timeline, sizeof(slow->timeline));
+
+	PTHREAD_MUTEX_unlock(&fr_slow_lock);
+}
+
+/**
+ * @brief Finish recording the current request
+ *
+ * If the request took at least Slow_Request_Threshold milliseconds, its
+ * timeline is logged and kept for ShowSlowOps.
+ */
+void fr_request_end(void)
+{
+	struct fr_record *rec = fr_cur;
+	uint64_t ts, duration, threshold;
+
+	if (rec == NULL)
+		return;
+
+	fr_cur = NULL;
+
+	ts = fr_now();
+	fr_add(rec, FR_DONE, NULL, ts);
+
+	duration = ts - rec->start;
+	threshold = (uint64_t) nfs_param.core_param.slow_request_threshold *
+		    NS_PER_MSEC;
+
+	if (threshold != 0 && duration >= threshold)
+		fr_report_slow(rec, duration);
+
+	if (rec->detached)
+		gsh_free(rec);
+}
+
+/**
+ * @brief Take the current record away from this thread
+ *
+ * Called before a request may be resumed on another thread.  The record
+ * leaves the thread's ring, so the next request recorded here does not
+ * overwrite it.
+ *
+ * @return The record, to be handed to fr_request_resume or
+ *         fr_request_reattach, or NULL if nothing is being recorded.
+ */
+struct fr_record *fr_request_suspend(void)
+{
+	struct fr_record *rec = fr_cur;
+
+	if (rec == NULL)
+		return NULL;
+
+	fr_add(rec, FR_SUSPEND, NULL, fr_now());
+
+	if (!rec->detached) {
+		fr_thr->ring[fr_thr->cur] = NULL;
+		rec->detached = true;
+		rec->home = fr_thr;
+	}
+
+	fr_cur = NULL;
+	return rec;
+}
+
+/**
+ * @brief Carry on recording a request that did not need to suspend
+ *
+ * The FSAL call completed before the request was suspended, so the
+ * suspend is dropped from the timeline and the record goes back to the
+ * ring it came from if that slot is still free.
+ *
+ * @param[in] rec	Record returned by fr_request_suspend
+ */
+void fr_request_reattach(struct fr_record *rec)
+{
+	if (rec == NULL)
+		return;
+
+	if (rec->nevents != 0 &&
+	    rec->events[rec->nevents - 1].type == FR_SUSPEND)
+		rec->nevents--;
+
+	if (rec->detached && rec->home == fr_thr &&
+	    fr_thr->ring[fr_thr->cur] == NULL) {
+		fr_thr->ring[fr_thr->cur] = rec;
+		rec->detached = false;
+	}
+
+	fr_cur = rec;
+}
+
+/**
+ * @brief Note that a suspended request was queued to be resumed
+ *
+ * Called by the thread that completed the FSAL call, which owns the
+ * record until the request is resumed.
+ *
+ * @param[in] rec	Record of the suspended request
+ */
+void fr_request_queued(struct fr_record *rec)
+{
+	if (rec != NULL)
+		fr_add(rec, FR_QUEUE, NULL, fr_now());
+}
+
+/**
+ * @brief Resume recording a suspended request on this thread
+ *
+ * The thread may be in the middle of a request of its own, when a
+ * request is resumed inline; fr_request_restore puts that one back.
+ *
+ * @param[in] rec	Record of the suspended request, may be NULL
+ *
+ * @return The record this thread was filling in before.
+ */
+struct fr_record *fr_request_resume(struct fr_record *rec)
+{
+	struct fr_record *prev = fr_cur;
+
+	fr_cur = rec;
+	if (rec != NULL)
+		fr_add(rec, FR_RESUME, NULL, fr_now());
+
+	return prev;
+}
+
+/**
+ * @brief Go back to the record returned by fr_request_resume
+ */
+void fr_request_restore(struct fr_record *prev)
+{
+	fr_cur = prev;
+}
+
+/**
+ * @brief Encode a reply, then mark the end of encoding
+ */
+static bool fr_xdr_encode(XDR *xdrs, void *res)
+{
+	bool rc = ((bool (*)(XDR *, void *)) fr_encode_real)(xdrs, res);
+
+	fr_mark(FR_ENCODED, NULL);
+	return rc;
+}
+
+/**
+ * @brief Wrap a reply encoder so encoding and sending are told apart
+ *
+ * svc_sendreply encodes and sends in one go on the calling thread.  When
+ * a request is being recorded, the returned encoder records FR_ENCODED
+ * once @a proc is done.
+ *
+ * @param[in] proc	Encoder of the reply
+ *
+ * @return Encoder to hand to svc_sendreply.
+ */
+xdrproc_t fr_encode_proc(xdrproc_t proc)
+{
+	if (fr_cur == NULL)
+		return proc;
+
+	fr_encode_real = proc;
+	return (xdrproc_t) fr_xdr_encode;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Append recent slow requests, oldest first, to a D-Bus reply
+ */
+void fr_dbus_show_slow(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct fr_slow *slow;
+	const char *str;
+	uint64_t when;
+	uint32_t i, idx;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(usstts)",
+					 &array_iter);
+
+	PTHREAD_MUTEX_lock(&fr_slow_lock);
+
+	for (i = 0; i < fr_slow_count; i++) {
+		idx = (fr_slow_next + FR_SLOW_KEEP - fr_slow_count + i) %
+		      FR_SLOW_KEEP;
+		slow = &fr_slow_ring[idx];
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &slow->xid);
+		str = slow->name;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &str);
+		str = slow->client;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &str);
+		when = slow->when;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &when);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &slow->duration);
+		str = slow->timeline;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &str);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	PTHREAD_MUTEX_unlock(&fr_slow_lock);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif
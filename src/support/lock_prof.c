@@ -0,0 +1,379 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file lock_prof.c
+ * @brief Lock contention profiler
+ *
+ * See lock_prof.h.  Nothing in here may use the PTHREAD_* lock macros,
+ * since they call into it.
+ *
+ * Each thread keeps a small stack of the locks whose hold time it is
+ * measuring.  A lock is pushed when it is acquired after waiting or when
+ * an uncontended acquisition is sampled, and popped when it is released
+ * through a PTHREAD_* unlock macro.
+ *
+ * A lock released directly with pthread_*_unlock leaves a stale entry
+ * behind.  So that such entries cannot pile up and stop sampling, a full
+ * stack makes room by dropping its oldest entry, which is the one most
+ * likely to be stale.  An entry is also dropped whenever its lock is
+ * acquired again by the same thread, so a lock that was released behind
+ * our back, or freed and its address reused, is never charged with a
+ * bogus hold time.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lock_prof.h"
+#include "abstract_mem.h"
+#include "log.h"
+
+/** Locks a thread can be measuring the hold time of at once */
+#define LOCKPROF_HELD 16
+
+/** Sites reported by ShowLockProf */
+#define LOCKPROF_SHOW_TOP 32
+
+struct lockprof_held {
+	void *lock;
+	struct lockprof_site *site;
+	uint64_t since;
+};
+
+__thread uint32_t lockprof_countdown = LOCKPROF_SAMPLE_RATE;
+__thread uint32_t lockprof_depth;
+
+static __thread struct lockprof_held lockprof_held[LOCKPROF_HELD];
+
+/** List of all sites that have been used */
+static struct lockprof_site *lockprof_sites;
+
+static inline uint64_t lockprof_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline unsigned int lockprof_bucket(uint64_t ns)
+{
+	unsigned int b;
+
+	if (ns == 0)
+		return 0;
+
+	b = 64 - __builtin_clzll(ns);
+	return b < LOCKPROF_BUCKETS ? b : LOCKPROF_BUCKETS - 1;
+}
+
+static inline void lockprof_max(uint64_t *max, uint64_t val)
+{
+	uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (val > cur &&
+	       !__atomic_compare_exchange_n(max, &cur, val, true,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+static void lockprof_register(struct lockprof_site *site)
+{
+	struct lockprof_site *head;
+
+	if (__atomic_load_n(&site->registered, __ATOMIC_ACQUIRE) ||
+	    __atomic_exchange_n(&site->registered, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	head = __atomic_load_n(&lockprof_sites, __ATOMIC_RELAXED);
+	do {
+		site->next = head;
+	} while (!__atomic_compare_exchange_n(&lockprof_sites, &head, site,
+					      true, __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
+
+/**
+ * @brief Stop measuring the hold time of a lock without recording it
+ */
+void lockprof_forget(void *lock)
+{
+	int i;
+
+	for (i = lockprof_depth - 1; i >= 0; i--) {
+		if (lockprof_held[i].lock == lock) {
+			lockprof_held[i] = lockprof_held[--lockprof_depth];
+			return;
+		}
+	}
+}
+
+static inline void lockprof_hold(struct lockprof_site *site, void *lock,
+				 uint64_t since)
+{
+	struct lockprof_held *held;
+	uint32_t i, oldest;
+
+	lockprof_forget(lock);
+
+	if (lockprof_depth == LOCKPROF_HELD) {
+		/* Most likely left behind by an unwrapped unlock */
+		for (i = 1, oldest = 0; i < LOCKPROF_HELD; i++) {
+			if (lockprof_held[i].since <
+			    lockprof_held[oldest].since)
+				oldest = i;
+		}
+		lockprof_held[oldest] = lockprof_held[--lockprof_depth];
+	}
+
+	held = &lockprof_held[lockprof_depth++];
+	held->lock = lock;
+	held->site = site;
+	held->since = since;
+}
+
+static void lockprof_waited(struct lockprof_site *site, void *lock,
+			    uint64_t start)
+{
+	uint64_t acquired = lockprof_now();
+	uint64_t wait = acquired - start;
+
+	lockprof_register(site);
+
+	__atomic_add_fetch(&site->contended, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&site->wait_total, wait, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&site->wait_hist[lockprof_bucket(wait)], 1,
+			   __ATOMIC_RELAXED);
+	lockprof_max(&site->wait_max, wait);
+
+	lockprof_hold(site, lock, acquired);
+}
+
+/**
+ * @brief Acquire a mutex that was found busy, timing the wait
+ *
+ * @return As for pthread_mutex_lock.
+ */
+int lockprof_mutex_lock(struct lockprof_site *site, pthread_mutex_t *mtx)
+{
+	uint64_t start = lockprof_now();
+	int rc = pthread_mutex_lock(mtx);
+
+	if (rc == 0)
+		lockprof_waited(site, mtx, start);
+
+	return rc;
+}
+
+/**
+ * @brief Read lock an rwlock that was found busy, timing the wait
+ *
+ * @return As for pthread_rwlock_rdlock.
+ */
+int lockprof_rwlock_rdlock(struct lockprof_site *site,
+			   pthread_rwlock_t *lock)
+{
+	uint64_t start = lockprof_now();
+	int rc = pthread_rwlock_rdlock(lock);
+
+	if (rc == 0)
+		lockprof_waited(site, lock, start);
+
+	return rc;
+}
+
+/**
+ * @brief Write lock an rwlock that was found busy, timing the wait
+ *
+ * @return As for pthread_rwlock_wrlock.
+ */
+int lockprof_rwlock_wrlock(struct lockprof_site *site,
+			   pthread_rwlock_t *lock)
+{
+	uint64_t start = lockprof_now();
+	int rc = pthread_rwlock_wrlock(lock);
+
+	if (rc == 0)
+		lockprof_waited(site, lock, start);
+
+	return rc;
+}
+
+/**
+ * @brief Start measuring the hold time of an uncontended acquisition
+ */
+void lockprof_sample(struct lockprof_site *site, void *lock)
+{
+	lockprof_countdown = LOCKPROF_SAMPLE_RATE;
+
+	lockprof_register(site);
+	__atomic_add_fetch(&site->sampled, 1, __ATOMIC_RELAXED);
+
+	lockprof_hold(site, lock, lockprof_now());
+}
+
+/**
+ * @brief Record the hold time of a lock being released
+ *
+ * Does nothing if the hold time of @a lock is not being measured.
+ */
+void lockprof_release(void *lock)
+{
+	struct lockprof_held *held;
+	struct lockprof_site *site;
+	uint64_t hold;
+	int i;
+
+	for (i = lockprof_depth - 1; i >= 0; i--) {
+		if (lockprof_held[i].lock == lock)
+			break;
+	}
+
+	if (i < 0)
+		return;
+
+	held = &lockprof_held[i];
+	site = held->site;
+	hold = lockprof_now() - held->since;
+
+	__atomic_add_fetch(&site->hold_count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&site->hold_total, hold, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&site->hold_hist[lockprof_bucket(hold)], 1,
+			   __ATOMIC_RELAXED);
+	lockprof_max(&site->hold_max, hold);
+
+	*held = lockprof_held[--lockprof_depth];
+}
+
+#ifdef USE_DBUS
+static int lockprof_cmp(const void *a, const void *b)
+{
+	const struct lockprof_site *sa = *(const struct lockprof_site **)a;
+	const struct lockprof_site *sb = *(const struct lockprof_site **)b;
+	uint64_t wa = __atomic_load_n(&sa->wait_total, __ATOMIC_RELAXED);
+	uint64_t wb = __atomic_load_n(&sb->wait_total, __ATOMIC_RELAXED);
+
+	return wa < wb ? 1 : wa > wb ? -1 : 0;
+}
+
+/**
+ * @brief Upper bound of the bucket holding the 99th percentile
+ */
+static uint64_t lockprof_p99(const uint64_t *hist)
+{
+	uint64_t total = 0, seen = 0;
+	unsigned int b;
+
+	for (b = 0; b < LOCKPROF_BUCKETS; b++)
+		total += __atomic_load_n(&hist[b], __ATOMIC_RELAXED);
+
+	if (total == 0)
+		return 0;
+
+	for (b = 0; b < LOCKPROF_BUCKETS; b++) {
+		seen += __atomic_load_n(&hist[b], __ATOMIC_RELAXED);
+		if (seen * 100 >= total * 99)
+			break;
+	}
+
+	return b < LOCKPROF_BUCKETS ? 1ULL << b : UINT64_MAX;
+}
+
+/**
+ * @brief Append the most contended lock sites to a D-Bus reply
+ *
+ * Sites are sorted by total time spent waiting.
+ */
+void lockprof_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct lockprof_site *site, **sites;
+	size_t nsites = 0, i;
+	char location[256];
+	const char *str;
+	uint64_t val;
+
+	for (site = __atomic_load_n(&lockprof_sites, __ATOMIC_ACQUIRE);
+	     site != NULL; site = site->next)
+		nsites++;
+
+	sites = gsh_calloc(nsites ? nsites : 1, sizeof(*sites));
+
+	i = 0;
+	for (site = __atomic_load_n(&lockprof_sites, __ATOMIC_ACQUIRE);
+	     site != NULL && i < nsites; site = site->next)
+		sites[i++] = site;
+	nsites = i;
+
+	qsort(sites, nsites, sizeof(*sites), lockprof_cmp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(sstttttttt)", &array_iter);
+
+	for (i = 0; i < nsites && i < LOCKPROF_SHOW_TOP; i++) {
+		site = sites[i];
+
+		str = strrchr(site->file, '/');
+		(void)snprintf(location, sizeof(location), "%s:%d",
+			       str ? str + 1 : site->file, site->line);
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		str = site->name;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &str);
+		str = location;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &str);
+		val = __atomic_load_n(&site->sampled, __ATOMIC_RELAXED);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = __atomic_load_n(&site->contended, __ATOMIC_RELAXED);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = __atomic_load_n(&site->wait_total, __ATOMIC_RELAXED);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = __atomic_load_n(&site->wait_max, __ATOMIC_RELAXED);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = lockprof_p99(site->wait_hist);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = __atomic_load_n(&site->hold_count, __ATOMIC_RELAXED);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = __atomic_load_n(&site->hold_total, __ATOMIC_RELAXED);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = __atomic_load_n(&site->hold_max, __ATOMIC_RELAXED);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(sites);
+}
+#endif
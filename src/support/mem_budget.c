@@ -0,0 +1,333 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file mem_budget.c
+ * @brief Memory budget shared by the caches
+ *
+ * Over the target, the excess plus a margin is split between clients
+ * by weight, a client's weight being its usage above its floor scaled by
+ * how often its lookups missed over the last cycles and by how much of
+ * what it was asked back it really freed.  A large cache with a poor hit
+ * ratio gives back the most, a cache whose memory does not go back to
+ * the system is left alone; no client loses more than half of what it
+ * holds in a cycle, so a cache is never emptied by one bad sample.
+ *
+ * Freed memory takes a while to show in RSS, so after a cut budgets are
+ * left as they are for MEM_BUDGET_SETTLE cycles unless RSS keeps rising.
+ *
+ * Under MEM_BUDGET_GROW of the target, the headroom is handed out by
+ * hit ratio alone.  A budget is lifted once it reaches the client's
+ * configured size, or twice its usage for a client without one.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "common_utils.h"
+#include "mem_budget.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Shrink this fraction of the target further than strictly needed */
+#define MEM_BUDGET_SLACK 20
+/** Only grow budgets while RSS is below this permille of the target */
+#define MEM_BUDGET_GROW 900
+/** Share of the headroom given to a client without hits, permille */
+#define MEM_BUDGET_EPSILON 10
+/** Cycles to wait after a cut before cutting again */
+#define MEM_BUDGET_SETTLE 2
+
+#define MEM_BUDGET_MB (1024 * 1024)
+
+static pthread_mutex_t mem_budget_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head mem_budget_clients =
+	GLIST_HEAD_INIT(mem_budget_clients);
+static uint64_t mem_budget_rss;		/*< RSS at the last cycle, MB */
+static uint64_t mem_budget_cut_rss;	/*< RSS at the last cut, MB */
+static uint32_t mem_budget_settle;	/*< Cycles left before cutting again */
+
+/**
+ * @brief Register a cache with the accountant
+ *
+ * @param[in] client The cache, with its callbacks and max_bytes set
+ */
+void mem_budget_register(struct mem_budget_client *client)
+{
+	client->used = 0;
+	client->budget = 0;
+	client->reclaimed = 0;
+	client->last_hits = 0;
+	client->last_misses = 0;
+	client->ratio = 0;
+	client->yield = 1000;
+
+	PTHREAD_MUTEX_lock(&mem_budget_lock);
+	glist_add_tail(&mem_budget_clients, &client->list);
+	PTHREAD_MUTEX_unlock(&mem_budget_lock);
+
+	LogDebug(COMPONENT_MEMLEAKS, "%s registered, max %" PRIu64 " bytes",
+		 client->name, client->max_bytes);
+}
+
+/**
+ * @brief Remove a cache from the accountant
+ *
+ * @param[in] client The cache
+ */
+void mem_budget_unregister(struct mem_budget_client *client)
+{
+	PTHREAD_MUTEX_lock(&mem_budget_lock);
+	glist_del(&client->list);
+	PTHREAD_MUTEX_unlock(&mem_budget_lock);
+}
+
+/**
+ * @brief Refresh a client's usage and hit ratio
+ */
+static void mem_budget_sample(struct mem_budget_client *client)
+{
+	uint64_t hits = 0, misses = 0, dh, dm;
+	uint32_t ratio;
+	bool first;
+
+	client->used = client->usage();
+
+	if (client->benefit == NULL)
+		return;
+
+	client->benefit(&hits, &misses);
+
+	first = client->last_hits == 0 && client->last_misses == 0;
+	dh = hits - client->last_hits;
+	dm = misses - client->last_misses;
+	client->last_hits = hits;
+	client->last_misses = misses;
+
+	/* No lookups, the last ratio still stands */
+	if (dh + dm == 0)
+		return;
+
+	ratio = dh * 1000 / (dh + dm);
+	client->ratio = first ? ratio : (client->ratio + ratio) / 2;
+}
+
+/**
+ * @brief Set a client's budget and apply it
+ *
+ * @return Bytes the client gave back to the system.
+ */
+static uint64_t mem_budget_set(struct mem_budget_client *client,
+			       uint64_t budget)
+{
+	client->budget = budget;
+	return client->limit(budget);
+}
+
+/**
+ * @brief How much of a client's usage can be cut, weighted
+ */
+static double mem_budget_weight(struct mem_budget_client *client)
+{
+	if (client->used <= client->min_bytes)
+		return 0;
+
+	return (double)(client->used - client->min_bytes) *
+	       (1100 - client->ratio) *
+	       (client->yield + MEM_BUDGET_EPSILON);
+}
+
+/**
+ * @brief Take @a excess bytes back from the clients
+ */
+static void mem_budget_shrink(uint64_t excess)
+{
+	struct glist_head *glist;
+	struct mem_budget_client *client;
+	double total = 0, weight;
+	uint64_t cut, freed;
+	uint32_t yield;
+
+	glist_for_each(glist, &mem_budget_clients) {
+		client = glist_entry(glist, struct mem_budget_client, list);
+		total += mem_budget_weight(client);
+	}
+
+	if (total == 0)
+		return;
+
+	glist_for_each(glist, &mem_budget_clients) {
+		client = glist_entry(glist, struct mem_budget_client, list);
+		weight = mem_budget_weight(client);
+		if (weight == 0)
+			continue;
+
+		cut = MIN((uint64_t)(excess * (weight / total)),
+			  client->used / 2);
+		cut = MIN(cut, client->used - client->min_bytes);
+		if (cut == 0)
+			continue;
+
+		freed = mem_budget_set(client, client->used - cut);
+
+		/* A client whose memory stays mapped is asked less next time */
+		yield = MIN(freed, cut) * 1000 / cut;
+		client->yield = (client->yield + yield) / 2;
+		client->reclaimed += freed;
+
+		LogDebug(COMPONENT_MEMLEAKS,
+			 "%s using %" PRIu64 " bytes, hit ratio %" PRIu32
+			 " permille, asked %" PRIu64 " bytes back, freed %"
+			 PRIu64, client->name, client->used, client->ratio,
+			 cut, freed);
+	}
+}
+
+/**
+ * @brief Hand @a headroom bytes out to the clients with a budget
+ */
+static void mem_budget_grow(uint64_t headroom)
+{
+	struct glist_head *glist;
+	struct mem_budget_client *client;
+	uint64_t total = 0, budget, ceiling;
+
+	glist_for_each(glist, &mem_budget_clients) {
+		client = glist_entry(glist, struct mem_budget_client, list);
+		if (client->budget != 0)
+			total += client->ratio + MEM_BUDGET_EPSILON;
+	}
+
+	if (total == 0)
+		return;
+
+	glist_for_each(glist, &mem_budget_clients) {
+		client = glist_entry(glist, struct mem_budget_client, list);
+		if (client->budget == 0)
+			continue;
+
+		budget = client->budget + headroom / total *
+			 (client->ratio + MEM_BUDGET_EPSILON);
+
+		/* Do not hand out more than the client can use this cycle */
+		budget = MIN(budget, client->used + headroom);
+
+		ceiling = client->max_bytes != 0 ? client->max_bytes
+						 : client->used * 2;
+
+		(void)mem_budget_set(client, budget >= ceiling ? 0 : budget);
+	}
+}
+
+/**
+ * @brief Drive the clients towards RSS_Target
+ *
+ * Called from the reaper while RSS_Target is set.
+ *
+ * @param[in] rss_mb Current resident set size, MB
+ */
+void mem_budget_run(uint64_t rss_mb)
+{
+	uint64_t target = nfs_param.core_param.rss_target;
+	uint64_t grow = target * MEM_BUDGET_GROW / 1000;
+	struct glist_head *glist;
+
+	PTHREAD_MUTEX_lock(&mem_budget_lock);
+
+	mem_budget_rss = rss_mb;
+
+	glist_for_each(glist, &mem_budget_clients)
+		mem_budget_sample(glist_entry(glist, struct mem_budget_client,
+					      list));
+
+	if (rss_mb > target) {
+		if (mem_budget_settle != 0 && rss_mb <= mem_budget_cut_rss) {
+			/* Give the last cut time to show */
+			mem_budget_settle--;
+		} else {
+			LogEvent(COMPONENT_MEMLEAKS,
+				 "rss %" PRIu64 " MB over target %" PRIu64
+				 " MB, reclaiming from caches",
+				 rss_mb, target);
+			mem_budget_shrink((rss_mb - target + target /
+					   MEM_BUDGET_SLACK) * MEM_BUDGET_MB);
+			mem_budget_settle = MEM_BUDGET_SETTLE;
+			mem_budget_cut_rss = rss_mb;
+		}
+	} else {
+		mem_budget_settle = 0;
+		if (rss_mb < grow)
+			mem_budget_grow((grow - rss_mb) * MEM_BUDGET_MB);
+	}
+
+	PTHREAD_MUTEX_unlock(&mem_budget_lock);
+}
+
+#ifdef USE_DBUS
+void mem_budget_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter, array_iter, client_iter;
+	struct glist_head *glist;
+	struct mem_budget_client *client;
+	uint64_t target = nfs_param.core_param.rss_target;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+
+	PTHREAD_MUTEX_lock(&mem_budget_lock);
+
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &target);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &mem_budget_rss);
+
+	dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY,
+					 "(sttttt)", &array_iter);
+
+	glist_for_each(glist, &mem_budget_clients) {
+		client = glist_entry(glist, struct mem_budget_client, list);
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &client_iter);
+		dbus_message_iter_append_basic(&client_iter, DBUS_TYPE_STRING,
+					       &client->name);
+		dbus_message_iter_append_basic(&client_iter, DBUS_TYPE_UINT64,
+					       &client->used);
+		dbus_message_iter_append_basic(&client_iter, DBUS_TYPE_UINT64,
+					       &client->budget);
+		dbus_message_iter_append_basic(&client_iter, DBUS_TYPE_UINT64,
+					       &client->last_hits);
+		dbus_message_iter_append_basic(&client_iter, DBUS_TYPE_UINT64,
+					       &client->last_misses);
+		dbus_message_iter_append_basic(&client_iter, DBUS_TYPE_UINT64,
+					       &client->reclaimed);
+		dbus_message_iter_close_container(&array_iter, &client_iter);
+	}
+
+	PTHREAD_MUTEX_unlock(&mem_budget_lock);
+
+	dbus_message_iter_close_container(&struct_iter, &array_iter);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif
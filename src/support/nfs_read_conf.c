@@ -139,6 +139,12 @@ static struct config_item core_params[] = {
 		       nfs_core_param, rpc.ioq_thrd_min),
 	CONF_ITEM_UI32("RPC_Ioq_ThrdMax", 2, 1024*128, 512,
 		       nfs_core_param, rpc.ioq_thrd_max),
+	CONF_ITEM_UI32("RPC_Resume_ThrdMax", 1, 1024*128, 64,
+		       nfs_core_param, rpc.resume_thrd_max),
+	CONF_ITEM_UI32("RPC_UDP_Sockets", 1, 64, 1,
+		       nfs_core_param, rpc.udp_sockets),
+	CONF_ITEM_UI32("RPC_TCP_Channels", 0, 256, 0,
+		       nfs_core_param, rpc.tcp_channels),
 	CONF_ITEM_UI32("RPC_GSS_Npart", 1, 1021, 13,
 		       nfs_core_param, rpc.gss.ctx_hash_partitions),
 	CONF_ITEM_UI32("RPC_GSS_Max_Ctx", 1, 1024*1024, 16384,
@@ -197,6 +203,16 @@ static struct config_item core_params[] = {
 		       nfs_core_param, dbus_name_prefix),
 	CONF_ITEM_BOOL("enable_trim", false,
 		       nfs_core_param, enable_trim),
+	CONF_ITEM_UI32("Slow_Request_Threshold", 0, 3600000, 0,
+		       nfs_core_param, slow_request_threshold),
+	CONF_ITEM_UI32("Export_Init_Threads", 1, 1024, 16,
+		       nfs_core_param, export_init_threads),
+	CONF_ITEM_UI32("RSS_Target", 0, UINT32_MAX, 0,
+		       nfs_core_param, rss_target),
+	CONF_ITEM_UI32("NLM_Callback_Threads", 1, 1024, 8,
+		       nfs_core_param, nlm_callback_threads),
+	CONF_ITEM_UI32("NLM_Callback_Window", 1, 1024, 16,
+		       nfs_core_param, nlm_callback_window),
 	CONFIG_EOL
 };
 
@@ -287,6 +303,14 @@ static struct config_item version4_params[] = {
 		       minor_versions, nfs_version4_parameter, minor_versions),
 	CONF_ITEM_UI32("slot_table_size", 1, 1024, NFS41_NB_SLOTS_DEF,
 		       nfs_version4_parameter, nb_slots),
+	CONF_ITEM_BOOL("Parallel_Compound", false,
+		       nfs_version4_parameter, parallel_compound),
+	CONF_ITEM_UI32("Parallel_Compound_ThrdMax", 1, 1024, 16,
+		       nfs_version4_parameter, parallel_compound_thrd_max),
+	CONF_ITEM_BOOL("Dir_Delegations", false,
+		       nfs_version4_parameter, dir_delegations),
+	CONF_ITEM_UI32("Dir_Deleg_Notify_Delay", 0, 10000, 50,
+		       nfs_version4_parameter, dir_deleg_notify_delay),
 	CONFIG_EOL
 };
 
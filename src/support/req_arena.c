@@ -0,0 +1,196 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file req_arena.c
+ * @brief Per-request bump allocator
+ *
+ * Chunks come from a constructed pool, so taking and returning one is
+ * normally served from the thread's magazine.  Allocations larger than
+ * half a chunk get a heap chunk of their own, linked behind the chunk
+ * being carved so its remaining space is not wasted.
+ */
+
+#include "config.h"
+
+#include <stddef.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "req_arena.h"
+#include "gsh_config.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Usable bytes in a pooled chunk */
+#define REQ_ARENA_PAYLOAD \
+	(REQ_ARENA_CHUNK_SIZE - offsetof(struct req_arena_chunk, data))
+
+static pool_t *req_arena_pool;
+
+/** Statistics, updated as arenas are released */
+static struct {
+	uint64_t arenas;	/*< Arenas that were used */
+	uint64_t allocs;	/*< Allocations served */
+	uint64_t chunks;	/*< Chunks taken */
+	uint64_t oversize;	/*< Chunks taken from the heap */
+} req_arena_stats;
+
+static void req_arena_chunk_ctor(void *object)
+{
+	struct req_arena_chunk *chunk = object;
+
+	chunk->next = NULL;
+	chunk->size = REQ_ARENA_PAYLOAD;
+	chunk->used = 0;
+	chunk->oversize = false;
+}
+
+/**
+ * @brief Set up the arena chunk pool
+ */
+void req_arena_pkginit(void)
+{
+	req_arena_pool = pool_ctor_init("Request arena chunk pool",
+					REQ_ARENA_CHUNK_SIZE,
+					req_arena_chunk_ctor, NULL);
+}
+
+/**
+ * @brief Destroy the arena chunk pool
+ *
+ * All arenas must have been released.
+ */
+void req_arena_pkgshutdown(void)
+{
+	pool_destroy(req_arena_pool);
+	req_arena_pool = NULL;
+}
+
+/**
+ * @brief Allocate from an arena whose current chunk is full
+ *
+ * @param[in,out] arena The arena
+ * @param[in]     size  Bytes to allocate, already aligned
+ *
+ * @return Zeroed memory.
+ */
+void *req_arena_alloc_slow(struct req_arena *arena, size_t size)
+{
+	struct req_arena_chunk *chunk;
+
+	if (size > REQ_ARENA_PAYLOAD / 2) {
+		chunk = gsh_malloc(offsetof(struct req_arena_chunk, data) +
+				   size);
+		chunk->size = size;
+		chunk->used = size;
+		chunk->oversize = true;
+
+		if (arena->chunks != NULL) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			chunk->next = NULL;
+			arena->chunks = chunk;
+		}
+	} else {
+		chunk = pool_alloc(req_arena_pool);
+		chunk->used = size;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+
+	arena->allocs++;
+	arena->nchunks++;
+	memset(chunk->data, 0, size);
+	return chunk->data;
+}
+
+/**
+ * @brief Free everything allocated from an arena
+ *
+ * The arena is left empty and may be used again.
+ *
+ * @param[in,out] arena The arena
+ */
+void req_arena_release(struct req_arena *arena)
+{
+	struct req_arena_chunk *chunk, *next;
+	uint64_t oversize = 0;
+
+	if (arena->chunks == NULL)
+		return;
+
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		if (chunk->oversize) {
+			oversize++;
+			gsh_free(chunk);
+		} else {
+			chunk->next = NULL;
+			chunk->used = 0;
+			pool_free(req_arena_pool, chunk);
+		}
+	}
+
+	if (nfs_param.core_param.enable_NFSSTATS) {
+		(void) atomic_inc_uint64_t(&req_arena_stats.arenas);
+		(void) atomic_add_uint64_t(&req_arena_stats.allocs,
+					   arena->allocs);
+		(void) atomic_add_uint64_t(&req_arena_stats.chunks,
+					   arena->nchunks);
+		if (oversize != 0)
+			(void) atomic_add_uint64_t(&req_arena_stats.oversize,
+						   oversize);
+	}
+
+	arena->chunks = NULL;
+	arena->allocs = 0;
+	arena->nchunks = 0;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report arena statistics
+ *
+ * Appends (requests, allocations, chunks, oversize chunks).
+ */
+void req_arena_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+	uint64_t arenas, allocs, chunks, oversize;
+
+	arenas = atomic_fetch_uint64_t(&req_arena_stats.arenas);
+	allocs = atomic_fetch_uint64_t(&req_arena_stats.allocs);
+	chunks = atomic_fetch_uint64_t(&req_arena_stats.chunks);
+	oversize = atomic_fetch_uint64_t(&req_arena_stats.oversize);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &arenas);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &allocs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &chunks);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &oversize);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif
@@ -45,9 +45,67 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "common_utils.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
 #include "uid2grp.h"
 #include "idmapper.h"
 
+/**
+ * @brief Name service calls, the C library's unless a test stubs them
+ */
+struct uid2grp_nss uid2grp_nss = {
+	.getpwuid_r = getpwuid_r,
+	.getpwnam_r = getpwnam_r,
+	.getgrouplist = getgrouplist,
+};
+
+/**
+ * @brief Entries are refreshed in the last 1/UID2GRP_REFRESH_AHEAD of
+ *        their life
+ */
+#define UID2GRP_REFRESH_AHEAD 8
+
+/**
+ * @brief Background refresher
+ *
+ * A single thread, so that a popular entry nearing expiry costs one
+ * name service lookup however many workers see it.
+ */
+static struct fridgethr *uid2grp_refresh_fridge;
+
+/**
+ * @brief A name service lookup in progress for a cache miss
+ *
+ * Later misses for the same user wait for it rather than issue their
+ * own lookup.
+ */
+struct uid2grp_pending {
+	struct glist_head list;
+	uid_t uid;
+	const struct gsh_buffdesc *name;	/*< NULL when by uid */
+	bool done;
+	bool found;		/*< The user was cached */
+	uint32_t waiters;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct glist_head list;
+} uid2grp_pending[UID2GRP_SHARDS];
+
+static struct {
+	uint64_t hits;		/*< Served fresh */
+	uint64_t stale_hits;	/*< Served expired while being refreshed */
+	uint64_t misses;	/*< Looked up in the name service */
+	uint64_t collapsed;	/*< Misses that shared another's lookup */
+	uint64_t miss_latency;	/*< Total ns spent in miss lookups */
+	uint64_t refreshes;	/*< Background refreshes */
+	uint64_t refresh_failures;
+	uint64_t refresh_latency;	/*< Total ns spent in refreshes */
+	uint64_t refresh_max;	/*< Longest refresh, ns */
+} uid2grp_stats;
+
 /* group_data has a reference counter. If it goes to zero, it implies
  * that it is out of the cache (AVL trees) and should be freed. The
  * reference count is 1 when we put it into AVL trees. We decrement when
@@ -107,7 +165,7 @@ static bool my_getgrouplist_alloc(char *user,
 	 * is a value-result argument: on  return  it always contains
 	 * the  number  of  groups found for user."
 	 */
-	(void)getgrouplist(user, gid, NULL, &ngroups);
+	(void)uid2grp_nss.getgrouplist(user, gid, NULL, &ngroups);
 
 	/* Allocate gdata->groups with the right size then call
 	 * getgrouplist() a second time to get the actual group list.
@@ -116,7 +174,7 @@ static bool my_getgrouplist_alloc(char *user,
 		groups = gsh_malloc(ngroups * sizeof(gid_t));
 
 	now(&s_time);
-	if (getgrouplist(user, gid, groups, &ngroups) == -1) {
+	if (uid2grp_nss.getgrouplist(user, gid, groups, &ngroups) == -1) {
 		LogEvent(COMPONENT_IDMAPPER,
 			 "getgrouplist for user: %s failed retrying", user);
 
@@ -127,7 +185,8 @@ static bool my_getgrouplist_alloc(char *user,
 		groups = gsh_malloc(ngroups * sizeof(gid_t));
 
 		now(&s_time);
-		if (getgrouplist(user, gid, groups, &ngroups) == -1) {
+		if (uid2grp_nss.getgrouplist(user, gid, groups,
+					     &ngroups) == -1) {
 			LogWarn(COMPONENT_IDMAPPER,
 				"getgrouplist for user:%s failed, ngroups: %d",
 				user, ngroups);
@@ -184,7 +243,7 @@ static struct group_data *uid2grp_allocate_by_name(
 	}
 
 	buff = alloca(buff_size);
-	retval = getpwnam_r(namebuff, &p, buff, buff_size, &pp);
+	retval = uid2grp_nss.getpwnam_r(namebuff, &p, buff, buff_size, &pp);
 	if (retval != 0) {
 		LogEvent(COMPONENT_IDMAPPER,
 			 "getpwnam_r for %s failed, error %d",
@@ -213,6 +272,7 @@ static struct group_data *uid2grp_allocate_by_name(
 	PTHREAD_MUTEX_init(&gdata->lock, NULL);
 	gdata->epoch = time(NULL);
 	gdata->refcount = 0;
+	gdata->refreshing = 0;
 	return gdata;
 }
 
@@ -233,7 +293,7 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
 	}
 
 	buff = alloca(buff_size);
-	retval = getpwuid_r(uid, &p, buff, buff_size, &pp);
+	retval = uid2grp_nss.getpwuid_r(uid, &p, buff, buff_size, &pp);
 	if (retval != 0) {
 		LogEvent(COMPONENT_IDMAPPER,
 			 "getpwuid_r for uid %u failed, error %d", uid, retval);
@@ -260,94 +320,229 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
 	PTHREAD_MUTEX_init(&gdata->lock, NULL);
 	gdata->epoch = time(NULL);
 	gdata->refcount = 0;
+	gdata->refreshing = 0;
 	return gdata;
 }
 
 /**
- * @brief Get supplementary groups given uname
+ * @brief Refresh a cache entry from the name service
  *
- * @param[in]  name  The name of the user
- * @param[out]  group_data
+ * @param[in] ctx Thread context, holding a reference to the entry.
+ */
+static void uid2grp_refresh(struct fridgethr_context *ctx)
+{
+	struct group_data *old = ctx->arg;
+	struct group_data *gdata;
+	struct timespec s_time, e_time;
+	nsecs_elapsed_t resp_time;
+
+	now(&s_time);
+	gdata = uid2grp_allocate_by_uid(old->uid);
+	now(&e_time);
+
+	resp_time = timespec_diff(&s_time, &e_time);
+	(void)atomic_inc_uint64_t(&uid2grp_stats.refreshes);
+	(void)atomic_add_uint64_t(&uid2grp_stats.refresh_latency, resp_time);
+	/* Only this thread updates it */
+	if (resp_time > atomic_fetch_uint64_t(&uid2grp_stats.refresh_max))
+		atomic_store_uint64_t(&uid2grp_stats.refresh_max, resp_time);
+
+	if (gdata) {
+		/* Replaces the old entry */
+		uid2grp_add_user(gdata);
+	} else {
+		/* Let it expire, the next use will look it up again */
+		(void)atomic_inc_uint64_t(&uid2grp_stats.refresh_failures);
+		atomic_store_uint32_t(&old->refreshing, 0);
+	}
+
+	uid2grp_release_group_data(old);
+}
+
+/**
+ * @brief Queue a refresh of an entry unless one is queued already
  *
- * @return true if successful, false otherwise
+ * @param[in] gdata The entry
  */
-#define uid2grp_expired(gdata) (time(NULL) - (gdata)->epoch > \
-		nfs_param.core_param.manage_gids_expiration)
-bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
+static void uid2grp_schedule_refresh(struct group_data *gdata)
 {
-	bool success = false;
-	uid_t uid = -1;
+	uint32_t idle = 0;
 
-	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success = uid2grp_lookup_by_uname(name, &uid, gdata);
+	if (uid2grp_refresh_fridge == NULL)
+		return;
 
-	/* Handle common case first */
-	if (success && !uid2grp_expired(*gdata)) {
-		uid2grp_hold_group_data(*gdata);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-		return success;
+	if (!__atomic_compare_exchange_n(&gdata->refreshing, &idle, 1, false,
+					 __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+		return;
+
+	uid2grp_hold_group_data(gdata);
+
+	if (fridgethr_submit(uid2grp_refresh_fridge, uid2grp_refresh,
+			     gdata) != 0) {
+		atomic_store_uint32_t(&gdata->refreshing, 0);
+		uid2grp_release_group_data(gdata);
 	}
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+}
 
-	if (success) {
-		/* Cache entry is expired */
-		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_by_uname(name);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+/**
+ * @brief Decide whether a cached entry may be handed out
+ *
+ * Fresh entries are, and queue a refresh once close to expiry.  Expired
+ * entries are still handed out while their refresh is pending, for up
+ * to another expiration period.
+ *
+ * @param[in] gdata The entry, held.  Released if not usable.
+ *
+ * @return true if the entry may be used.
+ */
+static bool uid2grp_usable(struct group_data *gdata)
+{
+	time_t expiration = nfs_param.core_param.manage_gids_expiration;
+	time_t age = time(NULL) - gdata->epoch;
+
+	if (age <= expiration) {
+		(void)atomic_inc_uint64_t(&uid2grp_stats.hits);
+		if (age > expiration - expiration / UID2GRP_REFRESH_AHEAD)
+			uid2grp_schedule_refresh(gdata);
+		return true;
 	}
 
-	*gdata = uid2grp_allocate_by_name(name);
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-	if (*gdata)
-		uid2grp_add_user(*gdata);
-	success = uid2grp_lookup_by_uname(name, &uid, gdata);
-	if (success)
-		uid2grp_hold_group_data(*gdata);
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	if (age <= 2 * expiration &&
+	    atomic_fetch_uint32_t(&gdata->refreshing)) {
+		(void)atomic_inc_uint64_t(&uid2grp_stats.stale_hits);
+		return true;
+	}
 
-	return success;
+	uid2grp_release_group_data(gdata);
+	return false;
+}
+
+static bool uid2grp_pending_match(struct uid2grp_pending *pending, uid_t uid,
+				  const struct gsh_buffdesc *name)
+{
+	if (name == NULL)
+		return pending->name == NULL && pending->uid == uid;
+
+	return pending->name != NULL &&
+	       pending->name->len == name->len &&
+	       memcmp(pending->name->addr, name->addr, name->len) == 0;
 }
 
 /**
- * @brief Get supplementary groups given uid
+ * @brief Look a user up in the name service and cache it
  *
- * @param[in]  uid  The uid of the user
- * @param[out]  group_data
+ * Concurrent misses for the same user share one lookup.
+ *
+ * @param[in]  uid   The uid of the user, if @a name is NULL
+ * @param[in]  name  The name of the user, or NULL
+ * @param[out] gdata The group data, held
  *
  * @return true if successful, false otherwise
  */
-bool uid2grp(uid_t uid, struct group_data **gdata)
+static bool uid2grp_fetch(uid_t uid, const struct gsh_buffdesc *name,
+			  struct group_data **gdata)
 {
-	bool success = false;
+	unsigned int idx = name ? uid2grp_name_shard(name)
+				: uid2grp_uid_shard(uid);
+	struct uid2grp_pending me, *pending;
+	struct glist_head *glist;
+	struct timespec s_time, e_time;
+	bool found;
 
-	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success = uid2grp_lookup_by_uid(uid, gdata);
+	(void)atomic_inc_uint64_t(&uid2grp_stats.misses);
 
-	/* Handle common case first */
-	if (success && !uid2grp_expired(*gdata)) {
-		uid2grp_hold_group_data(*gdata);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-		return success;
-	}
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	PTHREAD_MUTEX_lock(&uid2grp_pending[idx].lock);
+
+	glist_for_each(glist, &uid2grp_pending[idx].list) {
+		pending = glist_entry(glist, struct uid2grp_pending, list);
+		if (!uid2grp_pending_match(pending, uid, name))
+			continue;
 
-	if (success) {
-		/* Cache entry is expired */
-		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_by_uid(uid);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+		pending->waiters++;
+		while (!pending->done)
+			pthread_cond_wait(&uid2grp_pending[idx].cond,
+					  &uid2grp_pending[idx].lock);
+		found = pending->found;
+		if (--pending->waiters == 0)
+			pthread_cond_broadcast(&uid2grp_pending[idx].cond);
+		PTHREAD_MUTEX_unlock(&uid2grp_pending[idx].lock);
+
+		(void)atomic_inc_uint64_t(&uid2grp_stats.collapsed);
+
+		if (!found)
+			return false;
+
+		return name ? uid2grp_lookup_by_uname(name, NULL, gdata)
+			    : uid2grp_lookup_by_uid(uid, gdata);
 	}
 
-	*gdata = uid2grp_allocate_by_uid(uid);
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-	if (*gdata)
-		uid2grp_add_user(*gdata);
-	success = uid2grp_lookup_by_uid(uid, gdata);
-	if (success)
+	me.uid = uid;
+	me.name = name;
+	me.done = false;
+	me.waiters = 0;
+	glist_add_tail(&uid2grp_pending[idx].list, &me.list);
+
+	PTHREAD_MUTEX_unlock(&uid2grp_pending[idx].lock);
+
+	now(&s_time);
+	*gdata = name ? uid2grp_allocate_by_name(name)
+		      : uid2grp_allocate_by_uid(uid);
+	now(&e_time);
+	(void)atomic_add_uint64_t(&uid2grp_stats.miss_latency,
+				  timespec_diff(&s_time, &e_time));
+
+	if (*gdata) {
 		uid2grp_hold_group_data(*gdata);
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+		uid2grp_add_user(*gdata);
+	}
+
+	/* Wake the waiters, and keep me on the stack until they are gone */
+	PTHREAD_MUTEX_lock(&uid2grp_pending[idx].lock);
+	me.done = true;
+	me.found = *gdata != NULL;
+	glist_del(&me.list);
+	pthread_cond_broadcast(&uid2grp_pending[idx].cond);
+	while (me.waiters != 0)
+		pthread_cond_wait(&uid2grp_pending[idx].cond,
+				  &uid2grp_pending[idx].lock);
+	PTHREAD_MUTEX_unlock(&uid2grp_pending[idx].lock);
+
+	return *gdata != NULL;
+}
+
+/**
+ * @brief Get supplementary groups given uname
+ *
+ * @param[in]  name  The name of the user
+ * @param[out]  group_data
+ *
+ * @return true if successful, false otherwise
+ */
+bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
+{
+	/* Handle common case first */
+	if (uid2grp_lookup_by_uname(name, NULL, gdata) &&
+	    uid2grp_usable(*gdata))
+		return true;
+
+	return uid2grp_fetch(-1, name, gdata);
+}
+
+/**
+ * @brief Get supplementary groups given uid
+ *
+ * @param[in]  uid  The uid of the user
+ * @param[out]  group_data
+ *
+ * @return true if successful, false otherwise
+ */
+bool uid2grp(uid_t uid, struct group_data **gdata)
+{
+	/* Handle common case first */
+	if (uid2grp_lookup_by_uid(uid, gdata) && uid2grp_usable(*gdata))
+		return true;
 
-	return success;
+	return uid2grp_fetch(uid, NULL, gdata);
 }
 
 /*
@@ -359,4 +554,89 @@ void uid2grp_unref(struct group_data *gdata)
 	uid2grp_release_group_data(gdata);
 }
 
+/**
+ * @brief Start the background refresher
+ */
+void uid2grp_refresh_init(void)
+{
+	struct fridgethr_params frp;
+	int i, rc;
+
+	for (i = 0; i < UID2GRP_SHARDS; i++) {
+		PTHREAD_MUTEX_init(&uid2grp_pending[i].lock, NULL);
+		PTHREAD_COND_init(&uid2grp_pending[i].cond, NULL);
+		glist_init(&uid2grp_pending[i].list);
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&uid2grp_refresh_fridge, "uid2grp_refresh", &frp);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to initialize group list refresh thread fridge: %d, entries will be refreshed on expiry",
+			 rc);
+		uid2grp_refresh_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Stop the background refresher
+ */
+void uid2grp_refresh_shutdown(void)
+{
+	int rc;
+
+	if (uid2grp_refresh_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(uid2grp_refresh_fridge,
+				    fridgethr_comm_stop,
+				    120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(uid2grp_refresh_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Failed shutting down group list refresh thread: %d",
+			 rc);
+	}
+}
+
+#ifdef USE_DBUS
+void uid2grp_dbus_show(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+	uint64_t val;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+
+	val = atomic_fetch_uint64_t(&uid2grp_stats.hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&uid2grp_stats.stale_hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&uid2grp_stats.misses);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&uid2grp_stats.collapsed);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&uid2grp_stats.miss_latency);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&uid2grp_stats.refreshes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&uid2grp_stats.refresh_failures);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&uid2grp_stats.refresh_latency);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&uid2grp_stats.refresh_max);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif
+
 /** @} */
@@ -47,6 +47,9 @@
 
 /**
  * @brief User entry in the IDMapper cache
+ *
+ * An entry is in the uid tree of the shard of its uid and in the name
+ * tree of the shard of its name, which usually differ.
  */
 
 struct cache_info {
@@ -58,37 +61,34 @@ struct cache_info {
 };
 
 /**
- * @brief Number of entires in the UID cache, should be prime.
- */
-
-#define id_cache_size 1009
-
-/**
- * @brief UID cache, may only be accessed with uid2grp_user_lock
- * held.  If uid2grp_user_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
- */
-
-static struct avltree_node *uid_grplist_cache[id_cache_size];
-
-/**
- * @brief Lock that protects the idmapper user cache
+ * @brief Number of UID cache slots per shard, should be prime.
  */
 
-pthread_rwlock_t uid2grp_user_lock = PTHREAD_RWLOCK_INITIALIZER;
+#define id_cache_size 61
 
 /**
- * @brief Tree of users, by name
+ * @brief A shard of the cache
+ *
+ * Lookups take the lock of one shard for read.  Adding or removing a
+ * user takes the locks of both its shards for write, in index order.
  */
 
-static struct avltree uname_tree;
+struct uid2grp_shard {
+	pthread_rwlock_t lock;
+	struct avltree uname_tree;	/*< Users, by name */
+	struct avltree uid_tree;	/*< Users, by ID */
+	/** UID cache.  With the lock held for read, it must be accessed
+	    atomically. */
+	struct avltree_node *uid_cache[id_cache_size];
+} __attribute__ ((aligned(GSH_CACHE_LINE_SIZE)));
 
-/**
- * @brief Tree of users, by ID
- */
+static struct uid2grp_shard uid2grp_shards[UID2GRP_SHARDS];
 
-static struct avltree uid_tree;
+static inline struct avltree_node **uid_cache_slot(const uid_t uid)
+{
+	return &uid2grp_shards[uid2grp_uid_shard(uid)]
+		.uid_cache[(uid / UID2GRP_SHARDS) % id_cache_size];
+}
 
 /**
  * @brief Compare two buffers
@@ -180,21 +180,67 @@ static int uid_comparator(const struct avltree_node *node1,
 
 void uid2grp_cache_init(void)
 {
-	avltree_init(&uname_tree, uname_comparator, 0);
-	avltree_init(&uid_tree, uid_comparator, 0);
-	memset(uid_grplist_cache, 0,
-	       id_cache_size * sizeof(struct avltree_node *));
+	int i;
+
+	for (i = 0; i < UID2GRP_SHARDS; i++) {
+		struct uid2grp_shard *shard = &uid2grp_shards[i];
+
+		PTHREAD_RWLOCK_init(&shard->lock, NULL);
+		avltree_init(&shard->uname_tree, uname_comparator, 0);
+		avltree_init(&shard->uid_tree, uid_comparator, 0);
+		memset(shard->uid_cache, 0,
+		       id_cache_size * sizeof(struct avltree_node *));
+	}
+}
+
+/**
+ * @brief Write lock a set of shards, in index order
+ *
+ * @param[in] shards Bit mask of shards
+ */
+static void uid2grp_lock_shards(uint32_t shards)
+{
+	int i;
+
+	for (i = 0; i < UID2GRP_SHARDS; i++)
+		if (shards & (1U << i))
+			PTHREAD_RWLOCK_wrlock(&uid2grp_shards[i].lock);
+}
+
+static void uid2grp_unlock_shards(uint32_t shards)
+{
+	int i;
+
+	for (i = 0; i < UID2GRP_SHARDS; i++)
+		if (shards & (1U << i))
+			PTHREAD_RWLOCK_unlock(&uid2grp_shards[i].lock);
+}
+
+/**
+ * @brief Shards a user lives in
+ */
+static uint32_t uid2grp_shards_of(const struct cache_info *info)
+{
+	return (1U << uid2grp_uid_shard(info->uid)) |
+	       (1U << uid2grp_name_shard(&info->uname));
 }
 
 /* Remove given user/cache_info from the AVL trees
  *
- * @note The caller must hold uid2grp_user_lock for write.
+ * @note The caller must hold both shard locks of the user for write.
  */
 static void uid2grp_remove_user(struct cache_info *info)
 {
-	uid_grplist_cache[info->uid % id_cache_size] = NULL;
-	avltree_remove(&info->uid_node, &uid_tree);
-	avltree_remove(&info->uname_node, &uname_tree);
+	struct uid2grp_shard *uid_shard =
+		&uid2grp_shards[uid2grp_uid_shard(info->uid)];
+	struct uid2grp_shard *name_shard =
+		&uid2grp_shards[uid2grp_name_shard(&info->uname)];
+	struct avltree_node **slot = uid_cache_slot(info->uid);
+
+	if (*slot == &info->uid_node)
+		*slot = NULL;
+	avltree_remove(&info->uid_node, &uid_shard->uid_tree);
+	avltree_remove(&info->uname_node, &name_shard->uname_tree);
 	/* We decrement hold on group data when it is
 	 * removed from cache trees.
 	 */
@@ -202,24 +248,51 @@ static void uid2grp_remove_user(struct cache_info *info)
 	gsh_free(info);
 }
 
+static struct cache_info *tree_lookup_uname(const struct gsh_buffdesc *name)
+{
+	struct cache_info prototype = {
+		.uname = *name
+	};
+	struct avltree_node *found_node = avltree_lookup(
+		&prototype.uname_node,
+		&uid2grp_shards[uid2grp_name_shard(name)].uname_tree);
+
+	if (unlikely(!found_node))
+		return NULL;
+
+	return avltree_container_of(found_node, struct cache_info,
+				    uname_node);
+}
+
+static struct cache_info *tree_lookup_uid(const uid_t uid)
+{
+	struct cache_info prototype = {
+		.uid = uid
+	};
+	struct avltree_node *found_node = avltree_lookup(
+		&prototype.uid_node,
+		&uid2grp_shards[uid2grp_uid_shard(uid)].uid_tree);
+
+	if (unlikely(!found_node))
+		return NULL;
+
+	return avltree_container_of(found_node, struct cache_info, uid_node);
+}
+
 /**
  * @brief Add a user entry to the cache
  *
- * @note The caller must hold uid2grp_user_lock for write.
+ * A user already cached under the same name or ID is replaced.  That
+ * user's other shard may be neither of ours, in which case we go round
+ * again holding it as well.
  *
  * @param[in] group_data that has supplementary groups allocated
- *
- * @retval true on success.
- * @retval false if our reach exceeds our grasp.
  */
 void uid2grp_add_user(struct group_data *gdata)
 {
-	struct avltree_node *name_node;
-	struct avltree_node *id_node;
-	struct avltree_node *name_node2 = NULL;
-	struct avltree_node *id_node2 = NULL;
 	struct cache_info *info;
-	struct cache_info *tmp;
+	struct cache_info *by_name, *by_uid;
+	uint32_t held, needed;
 
 	info = gsh_malloc(sizeof(struct cache_info));
 
@@ -233,118 +306,55 @@ void uid2grp_add_user(struct group_data *gdata)
 	 */
 	uid2grp_hold_group_data(gdata);
 
-	/* We may have lost the race to insert. We remove existing
-	 * entry and insert this new entry if so!
-	 */
-	name_node = avltree_insert(&info->uname_node, &uname_tree);
-	if (unlikely(name_node)) {
-		tmp = avltree_container_of(name_node,
-					   struct cache_info,
-					   uname_node);
-		uid2grp_remove_user(tmp);
-		name_node2 = avltree_insert(&info->uname_node, &uname_tree);
-	}
-
-	id_node = avltree_insert(&info->uid_node, &uid_tree);
-	if (unlikely(id_node)) {
-		/* We should not come here unless someone changed uid of
-		 * a user. Remove old entry and re-insert the new
-		 * entry.
-		 */
-		tmp = avltree_container_of(id_node,
-					   struct cache_info,
-					   uid_node);
-		uid2grp_remove_user(tmp);
-		id_node2 = avltree_insert(&info->uid_node, &uid_tree);
-	}
-	uid_grplist_cache[info->uid % id_cache_size] = &info->uid_node;
-
-	if (name_node && id_node)
-		LogWarn(COMPONENT_IDMAPPER, "shouldn't happen, internal error");
-	if ((name_node && name_node2) || (id_node && id_node2))
-		LogWarn(COMPONENT_IDMAPPER, "shouldn't happen, internal error");
-}
-
+	needed = uid2grp_shards_of(info);
 
-static bool lookup_by_uname(const struct gsh_buffdesc *name,
-			    struct cache_info **info)
-{
-	struct cache_info prototype = {
-		.uname = *name
-	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.uname_node,
-							 &uname_tree);
-	struct cache_info *found_info;
-	void **cache_slot;
+	do {
+		held = needed;
+		uid2grp_lock_shards(held);
 
-	if (unlikely(!found_node))
-		return false;
+		by_name = tree_lookup_uname(&info->uname);
+		by_uid = tree_lookup_uid(info->uid);
 
-	found_info = avltree_container_of(found_node,
-					  struct cache_info,
-					  uname_node);
+		if (by_name)
+			needed |= uid2grp_shards_of(by_name);
+		if (by_uid)
+			needed |= uid2grp_shards_of(by_uid);
 
-	/* I assume that if someone likes this user enough to look it
-	   up by name, they'll like it enough to look it up by ID
-	   later. */
+		if (needed != held)
+			uid2grp_unlock_shards(held);
+	} while (needed != held);
 
-	cache_slot = (void **)
-		&uid_grplist_cache[found_info->uid % id_cache_size];
-	atomic_store_voidptr(cache_slot, &found_info->uid_node);
-
-	*info = found_info;
-
-	return true;
-}
-
-static bool lookup_by_uid(const uid_t uid, struct cache_info **info)
-{
-	struct cache_info prototype = {
-		.uid = uid
-	};
-	void **cache_slot = (void **)
-	    &uid_grplist_cache[prototype.uid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_info *found_info;
-	bool found = false;
-
-	/* Verify that the node found in the cache array is in fact what we
-	 * want.
+	/* We may have lost the race to insert. We remove existing
+	 * entries and insert this new entry if so! A different entry
+	 * by uid means someone changed uid of a user.
 	 */
-	if (likely(found_node)) {
-		found_info =
-		    avltree_container_of(found_node, struct cache_info,
-					 uid_node);
-		if (found_info->uid == uid)
-			found = true;
-	}
-
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.uid_node, &uid_tree);
-		if (unlikely(!found_node))
-			return false;
-
-		atomic_store_voidptr(cache_slot, found_node);
-		found_info =
-		    avltree_container_of(found_node, struct cache_info,
-					 uid_node);
-	}
+	if (by_name)
+		uid2grp_remove_user(by_name);
+	if (by_uid && by_uid != by_name)
+		uid2grp_remove_user(by_uid);
+
+	if (avltree_insert(&info->uname_node,
+			   &uid2grp_shards[uid2grp_name_shard(&info->uname)]
+			   .uname_tree) ||
+	    avltree_insert(&info->uid_node,
+			   &uid2grp_shards[uid2grp_uid_shard(info->uid)]
+			   .uid_tree))
+		LogWarn(COMPONENT_IDMAPPER, "shouldn't happen, internal error");
 
-	*info = found_info;
+	*uid_cache_slot(info->uid) = &info->uid_node;
 
-	return true;
+	uid2grp_unlock_shards(held);
 }
 
 /**
  * @brief Look up a user by name
  *
- * @note The caller must hold uid2grp_user_lock for read.
- *
  * @param[in]  name The user name to look up.
  * @param[out] uid  The user ID found.  May be NULL if the caller
  *                  isn't interested in the UID.  (This seems
  *                  unlikely.)
- * @gdata[out] group_data containing supplementary groups.
+ * @gdata[out] group_data containing supplementary groups, with a
+ *             reference the caller must drop with uid2grp_unref.
  *
  * @retval true on success.
  * @retval false if we need to try, try again.
@@ -353,26 +363,32 @@ static bool lookup_by_uid(const uid_t uid, struct cache_info **info)
 bool uid2grp_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 			     struct group_data **gdata)
 {
+	struct uid2grp_shard *shard =
+		&uid2grp_shards[uid2grp_name_shard(name)];
 	struct cache_info *info;
-	bool success;
 
-	success = lookup_by_uname(name, &info);
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
+
+	info = tree_lookup_uname(name);
 
-	if (success) {
+	if (info) {
 		*gdata = info->gdata;
-		*uid = info->gdata->uid;
+		if (uid)
+			*uid = info->gdata->uid;
+		uid2grp_hold_group_data(*gdata);
 	}
 
-	return success;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
+
+	return info != NULL;
 }
 
 /**
  * @brief Look up a user by ID
  *
- * @note The caller must hold uid2grp_user_lock for read.
- *
  * @param[in]  uid  The user ID to look up.
- * @gdata[out] group_data containing supplementary groups.
+ * @gdata[out] group_data containing supplementary groups, with a
+ *             reference the caller must drop with uid2grp_unref.
  *
  * @retval true on success.
  * @retval false if we weren't so successful.
@@ -380,34 +396,38 @@ bool uid2grp_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 
 bool uid2grp_lookup_by_uid(const uid_t uid, struct group_data **gdata)
 {
-	struct cache_info *info;
-	bool success;
+	struct uid2grp_shard *shard = &uid2grp_shards[uid2grp_uid_shard(uid)];
+	void **cache_slot = (void **)uid_cache_slot(uid);
+	struct avltree_node *found_node;
+	struct cache_info *info = NULL;
 
-	success = lookup_by_uid(uid, &info);
-	if (success)
-		*gdata = info->gdata;
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
 
-	return success;
-}
+	/* Verify that the node found in the cache array is in fact what we
+	 * want.
+	 */
+	found_node = atomic_fetch_voidptr(cache_slot);
+	if (likely(found_node)) {
+		info = avltree_container_of(found_node, struct cache_info,
+					    uid_node);
+		if (info->uid != uid)
+			info = NULL;
+	}
 
-void uid2grp_remove_by_uid(const uid_t uid)
-{
-	struct cache_info *info;
-	bool success;
+	if (unlikely(!info)) {
+		info = tree_lookup_uid(uid);
+		if (info)
+			atomic_store_voidptr(cache_slot, &info->uid_node);
+	}
 
-	success = lookup_by_uid(uid, &info);
-	if (success)
-		uid2grp_remove_user(info);
-}
+	if (info) {
+		*gdata = info->gdata;
+		uid2grp_hold_group_data(*gdata);
+	}
 
-void uid2grp_remove_by_uname(const struct gsh_buffdesc *name)
-{
-	struct cache_info *info;
-	bool success;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
-	success = lookup_by_uname(name, &info);
-	if (success)
-		uid2grp_remove_user(info);
+	return info != NULL;
 }
 
 /**
@@ -417,20 +437,24 @@ void uid2grp_remove_by_uname(const struct gsh_buffdesc *name)
 void uid2grp_clear_cache(void)
 {
 	struct avltree_node *node;
-
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-
-	while ((node = avltree_first(&uname_tree))) {
-		struct cache_info *info = avltree_container_of(node,
-							       struct
-							       cache_info,
-							       uname_node);
-		uid2grp_remove_user(info);
+	uint32_t all = (1U << UID2GRP_SHARDS) - 1;
+	int i;
+
+	uid2grp_lock_shards(all);
+
+	for (i = 0; i < UID2GRP_SHARDS; i++) {
+		while ((node = avltree_first(&uid2grp_shards[i].uname_tree))) {
+			struct cache_info *info =
+				avltree_container_of(node, struct cache_info,
+						     uname_node);
+			uid2grp_remove_user(info);
+		}
 	}
 
-	assert(avltree_first(&uid_tree) == NULL);
+	for (i = 0; i < UID2GRP_SHARDS; i++)
+		assert(avltree_first(&uid2grp_shards[i].uid_tree) == NULL);
 
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	uid2grp_unlock_shards(all);
 }
 
 /** @} */